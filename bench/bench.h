@@ -0,0 +1,36 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * bench.h - Benchmark harness shared by the micro and end-to-end suites
+ *
+ * Every result is one JSON object per line on stdout:
+ *
+ *   {"suite":"micro","name":"lexer_tokenize","unit":"ns/op",
+ *    "ops":100000,"runs":5,"min":812.4,"median":820.9}
+ *
+ * "ops" is the work done in one run and min/median are per op over the
+ * runs, so results from different releases can be diffed directly.
+ * Progress and diagnostics go to stderr.
+ * ============================================================================ */
+
+#ifndef VSH_BENCH_H
+#define VSH_BENCH_H
+
+#include <stdbool.h>
+
+#define BENCH_RUNS 5
+
+/* Monotonic clock in nanoseconds */
+double bench_now_ns(void);
+
+/* Print one result line. samples are per-op values, one per run. */
+void bench_report(const char *suite, const char *name, const char *unit,
+                  long ops, double *samples, int runs);
+
+/* The suites; e2e needs the path of the vsh binary under test */
+void bench_micro(const char *filter);
+void bench_e2e(const char *vsh, const char *filter);
+
+/* Whether name is selected by filter (NULL or a substring of name) */
+bool bench_selected(const char *filter, const char *name);
+
+#endif /* VSH_BENCH_H */
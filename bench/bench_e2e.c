@@ -0,0 +1,232 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * bench_e2e.c - End-to-end throughput of a vsh binary
+ *
+ * Each scenario runs the shell as a child process on generated input in a
+ * scratch directory, which is also its HOME and XDG_CACHE_HOME so no user
+ * configuration or cache leaks into the numbers. Wall-clock time per run
+ * is divided by the scenario's op count (commands, iterations, lines).
+ * ============================================================================ */
+
+#include "bench.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define E2E_RUNS 3
+
+static char scratch[64];                /* /tmp/vsh_bench_XXXXXX */
+
+/* ---- Helpers ------------------------------------------------------------ */
+
+static bool write_text(const char *name, const char *text) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", scratch, name);
+    FILE *fp = fopen(path, "w");
+    if (!fp) return false;
+    bool ok = fputs(text, fp) >= 0;
+    return fclose(fp) == 0 && ok;
+}
+
+/* Open a scratch file for a generator to fill */
+static FILE *create(const char *name) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", scratch, name);
+    return fopen(path, "w");
+}
+
+/* Run vsh with args (NULL-terminated) in the scratch directory with all
+ * standard streams on /dev/null; returns wall time in ns, < 0 on failure */
+static double run_vsh(const char *vsh, char *const args[]) {
+    char *argv[8] = { (char *)vsh };
+    int n = 1;
+    for (; args[n - 1] && n < 7; n++)
+        argv[n] = args[n - 1];
+    argv[n] = NULL;
+
+    double t0 = bench_now_ns();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int fd = open("/dev/null", O_RDWR);
+        if (fd < 0 || chdir(scratch) != 0) _exit(127);
+        dup2(fd, STDIN_FILENO);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        execv(vsh, argv);
+        _exit(127);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    double elapsed = bench_now_ns() - t0;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) return -1;
+    return elapsed;
+}
+
+/* Time from starting vsh on a terminal to the first byte of its prompt */
+static double first_prompt(const char *vsh) {
+    int master;
+    double t0 = bench_now_ns();
+    pid_t pid = forkpty(&master, NULL, NULL, NULL);
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        if (chdir(scratch) != 0) _exit(127);
+        execl(vsh, vsh, (char *)NULL);
+        _exit(127);
+    }
+
+    double elapsed = -1;
+    struct pollfd pfd = { .fd = master, .events = POLLIN };
+    char buf[4096];
+    if (poll(&pfd, 1, 5000) > 0 && read(master, buf, sizeof(buf)) > 0)
+        elapsed = bench_now_ns() - t0;
+
+    if (write(master, "exit\n", 5) != 5)
+        kill(pid, SIGHUP);
+    while (poll(&pfd, 1, 2000) > 0 && read(master, buf, sizeof(buf)) > 0) {}
+    close(master);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    return elapsed;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+                        struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static void clear_cache(void) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/cache", scratch);
+    nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/* Time E2E_RUNS runs of vsh args and report them per op; cold clears the
+ * compiled-script cache before every run */
+static void scenario(const char *vsh, const char *filter, const char *name,
+                     char *const args[], long ops, const char *unit,
+                     double scale, bool cold) {
+    if (!bench_selected(filter, name)) return;
+
+    double samples[E2E_RUNS];
+    for (int r = -1; r < E2E_RUNS; r++) {       /* r = -1: warm-up */
+        if (cold) clear_cache();
+        double ns = run_vsh(vsh, args);
+        if (ns < 0) {
+            fprintf(stderr, "vsh_bench: %s: %s failed\n", name, vsh);
+            return;
+        }
+        if (r >= 0) samples[r] = ns / (double)ops / scale;
+    }
+    bench_report("e2e", name, unit, ops, samples, E2E_RUNS);
+}
+
+/* ---- Inputs ------------------------------------------------------------- */
+
+static bool make_inputs(void) {
+    FILE *fp;
+
+    /* 500 external commands */
+    if (!(fp = create("external.sh"))) return false;
+    for (int i = 0; i < 500; i++) fputs("/bin/true\n", fp);
+    fclose(fp);
+
+    /* 20 four-stage pipelines over 2000 lines */
+    if (!(fp = create("data.txt"))) return false;
+    for (int i = 0; i < 2000; i++) fprintf(fp, "line %d of the bench data\n", i * 7919 % 2000);
+    fclose(fp);
+    if (!(fp = create("pipeline.sh"))) return false;
+    for (int i = 0; i < 20; i++)
+        fputs("cat data.txt | tr a-z A-Z | sort | wc -l\n", fp);
+    fclose(fp);
+
+    /* 100^3 iterations of a body that never leaves the shell */
+    const char *hundred =
+        "1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 "
+        "26 27 28 29 30 31 32 33 34 35 36 37 38 39 40 41 42 43 44 45 46 47 "
+        "48 49 50 51 52 53 54 55 56 57 58 59 60 61 62 63 64 65 66 67 68 69 "
+        "70 71 72 73 74 75 76 77 78 79 80 81 82 83 84 85 86 87 88 89 90 91 "
+        "92 93 94 95 96 97 98 99 100";
+    if (!(fp = create("loop.sh"))) return false;
+    fprintf(fp, "for a in %s; do\n for b in %s; do\n  for c in %s; do\n"
+                "   (( c > 50 )) && (( a + b )) || (( a - b ))\n"
+                "  done\n done\ndone\n", hundred, hundred, hundred);
+    fclose(fp);
+
+    /* A 10,000-line library to source */
+    if (!(fp = create("lib.sh"))) return false;
+    for (int i = 0; i < 10000; i++) {
+        switch (i % 4) {
+        case 0: fprintf(fp, "export LIB_V%d=value_%d\n", i % 64, i); break;
+        case 1: fprintf(fp, "f%d() { echo \"$1\" | tr a-z A-Z; }\n", i % 64); break;
+        case 2: fprintf(fp, "if (( %d > 5000 )); then export LIB_HI=%d; fi\n", i, i); break;
+        case 3: fprintf(fp, "# comment line %d\n", i); break;
+        }
+    }
+    fclose(fp);
+
+    return write_text("source.sh", "source lib.sh\n");
+}
+
+/* ---- Suite -------------------------------------------------------------- */
+
+void bench_e2e(const char *vsh, const char *filter) {
+    char abs[PATH_MAX];
+    if (!realpath(vsh, abs)) {
+        fprintf(stderr, "vsh_bench: %s: %s\n", vsh, strerror(errno));
+        return;
+    }
+
+    snprintf(scratch, sizeof(scratch), "/tmp/vsh_bench_XXXXXX");
+    if (!mkdtemp(scratch) || !make_inputs()) {
+        fprintf(stderr, "vsh_bench: cannot set up %s\n", scratch);
+        return;
+    }
+    char cache[PATH_MAX];
+    snprintf(cache, sizeof(cache), "%s/cache", scratch);
+    setenv("HOME", scratch, 1);
+    setenv("XDG_CACHE_HOME", cache, 1);
+
+    scenario(abs, filter, "external_commands", (char *[]){ "external.sh", NULL },
+             500, "us/op", 1e3, false);
+    scenario(abs, filter, "pipeline_4stage", (char *[]){ "pipeline.sh", NULL },
+             20, "us/op", 1e3, false);
+    scenario(abs, filter, "builtin_loop_1m", (char *[]){ "loop.sh", NULL },
+             1000000, "ns/op", 1, false);
+    scenario(abs, filter, "source_10k_cold", (char *[]){ "source.sh", NULL },
+             10000, "ns/op", 1, true);
+    scenario(abs, filter, "source_10k_warm", (char *[]){ "source.sh", NULL },
+             10000, "ns/op", 1, false);
+    scenario(abs, filter, "startup_exit", (char *[]){ "-c", "exit", NULL },
+             1, "us/op", 1e3, false);
+
+    if (bench_selected(filter, "startup_first_prompt")) {
+        double samples[E2E_RUNS];
+        int got = 0;
+        first_prompt(abs);                      /* Warm-up */
+        for (int r = 0; r < E2E_RUNS; r++) {
+            double ns = first_prompt(abs);
+            if (ns >= 0) samples[got++] = ns / 1e3;
+        }
+        if (got > 0)
+            bench_report("e2e", "startup_first_prompt", "us/op", 1, samples, got);
+        else
+            fprintf(stderr, "vsh_bench: startup_first_prompt: no prompt seen\n");
+    }
+
+    nftw(scratch, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
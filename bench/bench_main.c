@@ -0,0 +1,75 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * bench_main.c - Benchmark runner
+ *
+ * Usage: vsh_bench [--micro | --e2e] [--filter SUBSTR] [VSH]
+ *
+ * Runs both suites by default; VSH is the shell the end-to-end suite
+ * drives (default ./vsh).
+ * ============================================================================ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void bench_report(const char *suite, const char *name, const char *unit,
+                  long ops, double *samples, int runs) {
+    qsort(samples, (size_t)runs, sizeof(double), cmp_double);
+    double median = runs % 2 ? samples[runs / 2]
+                             : (samples[runs / 2 - 1] + samples[runs / 2]) / 2;
+    printf("{\"suite\":\"%s\",\"name\":\"%s\",\"unit\":\"%s\","
+           "\"ops\":%ld,\"runs\":%d,\"min\":%.1f,\"median\":%.1f}\n",
+           suite, name, unit, ops, runs, samples[0], median);
+    fflush(stdout);
+    fprintf(stderr, "  %-24s %12.1f %s\n", name, median, unit);
+}
+
+bool bench_selected(const char *filter, const char *name) {
+    return !filter || strstr(name, filter) != NULL;
+}
+
+int main(int argc, char **argv) {
+    bool micro = true, e2e = true;
+    const char *filter = NULL;
+    const char *vsh = "./vsh";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--micro") == 0) {
+            e2e = false;
+        } else if (strcmp(argv[i], "--e2e") == 0) {
+            micro = false;
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (argv[i][0] != '-') {
+            vsh = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [--micro | --e2e] [--filter SUBSTR] [VSH]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    if (micro) {
+        fprintf(stderr, "--- micro ---\n");
+        bench_micro(filter);
+    }
+    if (e2e) {
+        fprintf(stderr, "--- e2e (%s) ---\n", vsh);
+        bench_e2e(vsh, filter);
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * bench_micro.c - Microbenchmarks of the core modules
+ *
+ * Each benchmark does `ops` units of work per run on fixed inputs; the
+ * per-op time of each of BENCH_RUNS runs (after one warm-up run) is
+ * reported.
+ * ============================================================================ */
+
+#include "bench.h"
+#include "arena.h"
+#include "env.h"
+#include "history.h"
+#include "lexer.h"
+#include "parser.h"
+#include "safe_string.h"
+#include "shell.h"
+#include "wildcard.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Keeps results observable so the work is not optimised away */
+static volatile size_t sink;
+
+typedef struct MicroCtx {
+    Arena *arena;
+    Shell *shell;
+} MicroCtx;
+
+typedef void (*MicroFn)(MicroCtx *ctx, long ops);
+
+static const char *LINE =
+    "for f in *.c; do grep -n \"$PATTERN\" \"$f\" | sort -u > /tmp/out.$f 2>&1 && "
+    "echo \"${f%.c}: ok\" || echo 'failed' >&2; done";
+
+/* ---- Benchmarks --------------------------------------------------------- */
+
+static void run_arena_alloc(MicroCtx *ctx, long ops) {
+    arena_reset(ctx->arena);
+    for (long i = 0; i < ops; i++) {
+        if ((i & 4095) == 0)
+            arena_reset(ctx->arena);
+        char *p = arena_alloc(ctx->arena, 32 + (size_t)(i & 31));
+        p[0] = (char)i;
+        sink += (size_t)p[0];
+    }
+}
+
+static void run_lexer_tokenize(MicroCtx *ctx, long ops) {
+    for (long i = 0; i < ops; i++) {
+        arena_reset(ctx->arena);
+        Lexer lex;
+        lexer_init(&lex, LINE, ctx->arena);
+        TokenList *tl = lexer_tokenize(&lex);
+        sink += tl ? (size_t)tl->count : 0;
+    }
+}
+
+static void run_parser_parse(MicroCtx *ctx, long ops) {
+    for (long i = 0; i < ops; i++) {
+        arena_reset(ctx->arena);
+        Lexer lex;
+        lexer_init(&lex, LINE, ctx->arena);
+        TokenList *tl = lexer_tokenize(&lex);
+        Parser parser;
+        parser_init(&parser, tl, ctx->arena);
+        sink += parser_parse(&parser) != NULL;
+    }
+}
+
+static void run_env_expand(MicroCtx *ctx, long ops) {
+    for (long i = 0; i < ops; i++) {
+        arena_reset(ctx->arena);
+        char *s = env_expand(ctx->shell,
+                             "$HOME/src/${BENCH_NAME:-vsh}/$BENCH_UNSET-$?",
+                             ctx->arena);
+        sink += s ? strlen(s) : 0;
+    }
+}
+
+static void run_wildcard_match(MicroCtx *ctx, long ops) {
+    (void)ctx;
+    static const char *names[] = {
+        "main.c", "executor.c", "README.md", "vsh_readline.h", "Makefile",
+        "test_lexer.c", "a.out", "build.ninja",
+    };
+    for (long i = 0; i < ops; i++) {
+        const char *name = names[i & 7];
+        sink += wildcard_match("*.[ch]", name) + wildcard_match("t*_?exer.*", name);
+    }
+}
+
+static void run_history_add(MicroCtx *ctx, long ops) {
+    (void)ctx;
+    History *hist = history_create(HISTORY_MAX_SIZE);
+    char line[64];
+    for (long i = 0; i < ops; i++) {
+        snprintf(line, sizeof(line), "git commit -m 'change %ld'", i & 1023);
+        history_add(hist, line);
+    }
+    sink += (size_t)history_count(hist);
+    history_destroy(hist);
+}
+
+static void run_sstr_append(MicroCtx *ctx, long ops) {
+    (void)ctx;
+    SafeString *s = sstr_new(SSTR_INIT_CAP);
+    for (long i = 0; i < ops; i++) {
+        if ((i & 1023) == 0)
+            sstr_clear(s);
+        sstr_append(s, "segment/");
+    }
+    sink += strlen(sstr_cstr(s));
+    sstr_free(s);
+}
+
+/* ---- Runner ------------------------------------------------------------- */
+
+static const struct {
+    const char *name;
+    MicroFn     fn;
+    long        ops;
+} MICRO[] = {
+    { "arena_alloc",     run_arena_alloc,     4000000 },
+    { "lexer_tokenize",  run_lexer_tokenize,  100000 },
+    { "parser_parse",    run_parser_parse,    100000 },
+    { "env_expand",      run_env_expand,      500000 },
+    { "wildcard_match",  run_wildcard_match,  2000000 },
+    { "history_add",     run_history_add,     200000 },
+    { "sstr_append",     run_sstr_append,     4000000 },
+};
+
+void bench_micro(const char *filter) {
+    /* The shell is only a context for expansion: keep it non-interactive */
+    if (isatty(STDIN_FILENO)) {
+        int fd = open("/dev/null", O_RDONLY);
+        if (fd >= 0) {
+            dup2(fd, STDIN_FILENO);
+            close(fd);
+        }
+    }
+    char *argv[] = { "vsh", NULL };
+    MicroCtx ctx = { .arena = arena_create(), .shell = shell_init(1, argv) };
+    if (!ctx.arena || !ctx.shell) {
+        fprintf(stderr, "vsh_bench: out of memory\n");
+        return;
+    }
+    env_set(ctx.shell->env, "BENCH_NAME", "vanguard", false);
+
+    for (size_t b = 0; b < sizeof(MICRO) / sizeof(MICRO[0]); b++) {
+        if (!bench_selected(filter, MICRO[b].name))
+            continue;
+
+        double samples[BENCH_RUNS];
+        MICRO[b].fn(&ctx, MICRO[b].ops / 10);     /* Warm-up */
+        for (int r = 0; r < BENCH_RUNS; r++) {
+            double t0 = bench_now_ns();
+            MICRO[b].fn(&ctx, MICRO[b].ops);
+            samples[r] = (bench_now_ns() - t0) / (double)MICRO[b].ops;
+        }
+        bench_report("micro", MICRO[b].name, "ns/op", MICRO[b].ops,
+                     samples, BENCH_RUNS);
+    }
+
+    shell_destroy(ctx.shell);
+    arena_destroy(ctx.arena);
+}
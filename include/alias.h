@@ -0,0 +1,55 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * alias.h - Alias table and token-level alias expansion
+ *
+ * Aliases are substituted in the token stream between lexing and parsing.
+ * Each alias body is lexed once, on first use, into a small arena owned by
+ * its entry and reused until the alias is redefined or removed.
+ * ============================================================================ */
+
+#ifndef VSH_ALIAS_H
+#define VSH_ALIAS_H
+
+#include "lexer.h"
+#include <stdbool.h>
+
+typedef struct Arena Arena;
+
+#define ALIAS_HASH_SIZE 128
+
+/* Nested alias expansions followed for one word before giving up */
+#define ALIAS_DEPTH_MAX 16
+
+typedef struct AliasEntry {
+    char      *name;
+    char      *value;
+    Arena     *cache;           /* Owns tokens; NULL until first expanded */
+    TokenList *tokens;          /* value, lexed */
+    struct AliasEntry *next;
+} AliasEntry;
+
+typedef struct AliasTable {
+    AliasEntry   *buckets[ALIAS_HASH_SIZE];
+    int           count;
+    unsigned long serial;       /* Bumped by every set and remove */
+} AliasTable;
+
+/* Create / destroy the alias table */
+AliasTable *alias_table_create(void);
+void alias_table_destroy(AliasTable *table);
+
+/* Alias table operations; set and remove drop the entry's lexed body */
+void alias_set(AliasTable *table, const char *name, const char *value);
+const char *alias_get(AliasTable *table, const char *name);
+bool alias_remove(AliasTable *table, const char *name);
+
+/*
+ * Substitute aliases in a lexed command line. Unquoted words in command
+ * position are replaced by the tokens of their alias body; an alias is not
+ * expanded again inside its own expansion, and a body ending in a blank
+ * makes the following word a candidate too. Spliced tokens are copied into
+ * arena. Returns tokens itself when nothing was expanded, NULL on OOM.
+ */
+TokenList *alias_expand(AliasTable *table, TokenList *tokens, Arena *arena);
+
+#endif /* VSH_ALIAS_H */
@@ -19,6 +19,12 @@
 /* Alignment for all allocations (8-byte for 64-bit) */
 #define ARENA_ALIGNMENT 8
 
+/* Each page added to a chain is twice the previous one, up to this size */
+#define ARENA_PAGE_MAX (256 * 1024)
+
+/* Released pages are kept for reuse up to this many bytes per arena */
+#define ARENA_RETAIN_MAX (1024 * 1024)
+
 typedef struct ArenaPage {
     struct ArenaPage *next;
     size_t            size;     /* Total usable size of this page */
@@ -26,14 +32,39 @@ typedef struct ArenaPage {
     char              data[];   /* Flexible array member */
 } ArenaPage;
 
+typedef struct ArenaStats {
+    size_t bytes_used;         /* Bytes handed out since the last reset */
+    size_t peak_bytes;         /* High-water mark of bytes_used */
+    size_t pages;              /* Pages in the live chain */
+    size_t capacity;           /* Usable bytes across the live chain */
+    size_t retained_pages;     /* Pages parked on the free list */
+    size_t retained_bytes;
+    size_t page_mallocs;       /* Pages obtained from malloc */
+    size_t pages_reused;       /* Pages taken from the free list instead */
+} ArenaStats;
+
 typedef struct Arena {
     ArenaPage *head;           /* First page */
     ArenaPage *current;        /* Current page for allocations */
     size_t     page_size;      /* Default page size */
     size_t     total_allocated; /* Total bytes allocated (stats) */
     size_t     total_pages;    /* Number of pages (stats) */
+
+    ArenaPage *free_pages;     /* Pages released by reset/rewind, for reuse */
+    size_t     free_bytes;     /* Capacity held in free_pages */
+    size_t     peak_bytes;     /* High-water mark of total_allocated */
+    size_t     page_mallocs;
+    size_t     pages_reused;
 } Arena;
 
+/* A savepoint: everything allocated after it can be released at once */
+typedef struct ArenaMark {
+    ArenaPage *page;            /* Page that was current */
+    size_t     used;            /* Its fill level at the time */
+    size_t     total_allocated;
+    size_t     total_pages;
+} ArenaMark;
+
 /* Create a new arena with default page size */
 Arena *arena_create(void);
 
@@ -52,7 +83,41 @@ char *arena_strdup(Arena *arena, const char *str);
 /* Duplicate N bytes of a string into the arena (null-terminated) */
 char *arena_strndup(Arena *arena, const char *str, size_t n);
 
-/* Reset the arena (free all pages except the first, reset first page) */
+/* Record the current allocation point */
+ArenaMark arena_mark(const Arena *arena);
+
+/* Release everything allocated since mark. Marks must be rewound in LIFO
+ * order, and a mark is invalidated by arena_reset(). */
+void arena_rewind(Arena *arena, ArenaMark mark);
+
+/* Grow or shrink an allocation of old_size bytes to new_size. The last
+ * allocation of the current page is resized in place; anything else keeps
+ * its block when shrinking and is copied to a new one when growing (the
+ * old block is only reclaimed with the arena). */
+void *arena_resize(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+/* ---- Strings built in place --------------------------------------------- */
+
+/* A string appended to at the end of the arena. While nothing else is
+ * allocated in between it grows where it is; finishing it gives the spare
+ * room back. */
+typedef struct ArenaString {
+    Arena  *arena;
+    char   *data;
+    size_t  len;
+    size_t  cap;               /* Bytes reserved, including the NUL */
+} ArenaString;
+
+void astr_init(ArenaString *s, Arena *arena, size_t cap);
+void astr_append_n(ArenaString *s, const char *str, size_t n);
+void astr_append(ArenaString *s, const char *str);
+void astr_append_char(ArenaString *s, char c);
+
+/* NUL-terminate and release the unused capacity. Returns the string. */
+char *astr_finish(ArenaString *s);
+
+/* Reset the arena: every page but the first goes to the free list (up to
+ * ARENA_RETAIN_MAX bytes, the rest is freed) and the first page is emptied */
 void arena_reset(Arena *arena);
 
 /* Destroy the arena and free all memory */
@@ -61,4 +126,7 @@ void arena_destroy(Arena *arena);
 /* Get total bytes allocated (for debugging/stats) */
 size_t arena_bytes_used(const Arena *arena);
 
+/* Fill *out with usage and page-recycling counters */
+void arena_stats(const Arena *arena, ArenaStats *out);
+
 #endif /* VSH_ARENA_H */
@@ -0,0 +1,64 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * ast_cache.h - Parsed-AST cache for repeated command lines and scripts
+ *
+ * Maps the text of an interactive line (after history expansion) or of a
+ * sourced script to its parsed form, so running the same text again skips
+ * the lexer and parser. Each entry owns a small arena holding a deep copy
+ * of the AST, which therefore outlives resets of the parse arena.
+ * ============================================================================ */
+
+#ifndef VSH_AST_CACHE_H
+#define VSH_AST_CACHE_H
+
+#include "parser.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Arena Arena;
+
+#define AST_CACHE_SLOTS    32
+#define AST_CACHE_TEXT_MAX (64 * 1024)  /* Longer scripts are not kept */
+
+typedef enum AstKind {
+    AST_LINE,                   /* One interactive line: ast */
+    AST_SCRIPT                  /* A sourced file: script (+ error) */
+} AstKind;
+
+typedef struct AstCacheEntry {
+    AstKind        kind;
+    uint64_t       hash;
+    size_t         len;
+    char          *text;         /* The source text, for verification */
+    unsigned long  alias_serial; /* Alias table generation it was parsed in */
+    Arena         *arena;        /* Owns everything below; NULL if empty */
+    ASTNode       *ast;
+    Script        *script;
+    char          *error;        /* Script syntax error after its commands */
+    unsigned long  used;         /* LRU clock */
+    int            active;       /* Runs in progress: not evicted while > 0 */
+} AstCacheEntry;
+
+typedef struct AstCache AstCache;
+
+/* Create / destroy the cache */
+AstCache *ast_cache_create(void);
+void ast_cache_destroy(AstCache *cache);
+
+/* The entry for text, or NULL. An AST_LINE entry parsed under another
+ * alias_serial is stale and dropped. A returned entry is pinned until
+ * ast_cache_release(), so nested runs cannot evict it. */
+AstCacheEntry *ast_cache_find(AstCache *cache, AstKind kind,
+                              const char *text, size_t len,
+                              unsigned long alias_serial);
+void ast_cache_release(AstCacheEntry *entry);
+
+/* Store a copy of a freshly parsed line or script, evicting the least
+ * recently used unpinned entry. Failures (OOM, text too long, every entry
+ * pinned) just leave it uncached. */
+void ast_cache_add_line(AstCache *cache, const char *text, size_t len,
+                        unsigned long alias_serial, const ASTNode *ast);
+void ast_cache_add_script(AstCache *cache, const char *text, size_t len,
+                          const Script *script, const char *error);
+
+#endif /* VSH_AST_CACHE_H */
@@ -29,6 +29,39 @@ const BuiltinEntry *builtins_lookup(const char *name);
 /* Check if a command name is a builtin */
 bool builtins_is_builtin(const char *name);
 
+/* Builtins that only read shell state and write to stdout, so running
+ * them inside the shell is indistinguishable from running them in a
+ * subshell ($(...), pipeline stages) */
+bool builtins_is_pure(const BuiltinEntry *b);
+
+/* Can the builtin run in a subshell kept in the shell process? What it
+ * changes must be variables, the working directory or the directory stack,
+ * which such a subshell puts back (unset -f is the caller's to check) */
+bool builtins_is_contained(const BuiltinEntry *b);
+
+/* cat and tee: they move bytes between fds in the kernel and can run in
+ * the shell, even as a pipeline stage (builtins/cat.c) */
+bool builtins_is_copy(const BuiltinEntry *b);
+
+/* Can this cat/tee command run here, reading in_fd and writing out_fd?
+ * False for an option it does not implement and, where Ctrl+C cannot stop
+ * it (an interactive shell), for input that may never end or a file bound
+ * for the terminal. The external command of that name runs instead. */
+bool builtin_copy_accepts(int argc, char **argv, int in_fd, int out_fd);
+
+/* Run cat or tee (by argv[0]) from in_fd to out_fd; returns its status */
+int builtin_copy_run(int argc, char **argv, int in_fd, int out_fd);
+
+/* Should this command run as the external command of the same name
+ * instead of builtin b? True for a cat/tee that builtin_copy_accepts()
+ * turns down on the current stdin/stdout, if that command exists. */
+bool builtins_defers(Shell *shell, const BuiltinEntry *b, int argc, char **argv);
+
+/* Flush a builtin's output once it has returned. A failed write turns a
+ * zero status into 1 with a "write error" message against name, or into
+ * 128 + SIGPIPE, quietly, when the reader has gone away. */
+int builtins_finish(Shell *shell, const char *name, int status);
+
 /* Execute a builtin command. Returns exit status. */
 int builtins_execute(Shell *shell, int argc, char **argv);
 
@@ -47,6 +80,8 @@ int builtin_history(Shell *shell, int argc, char **argv);
 int builtin_jobs(Shell *shell, int argc, char **argv);
 int builtin_fg(Shell *shell, int argc, char **argv);
 int builtin_bg(Shell *shell, int argc, char **argv);
+int builtin_wait(Shell *shell, int argc, char **argv);
+int builtin_parallel(Shell *shell, int argc, char **argv);
 int builtin_source(Shell *shell, int argc, char **argv);
 int builtin_sysinfo(Shell *shell, int argc, char **argv);
 int builtin_httpfetch(Shell *shell, int argc, char **argv);
@@ -59,7 +94,13 @@ int builtin_colors(Shell *shell, int argc, char **argv);
 int builtin_pwd(Shell *shell, int argc, char **argv);
 int builtin_echo(Shell *shell, int argc, char **argv);
 int builtin_type(Shell *shell, int argc, char **argv);
+int builtin_hash(Shell *shell, int argc, char **argv);
 int builtin_return_cmd(Shell *shell, int argc, char **argv);
 int builtin_local(Shell *shell, int argc, char **argv);
+int builtin_read(Shell *shell, int argc, char **argv);
+int builtin_set(Shell *shell, int argc, char **argv);
+int builtin_shellstats(Shell *shell, int argc, char **argv);
+int builtin_cat(Shell *shell, int argc, char **argv);
+int builtin_tee(Shell *shell, int argc, char **argv);
 
 #endif /* VSH_BUILTINS_H */
@@ -0,0 +1,65 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * bytecode.h - Flat instruction form of compound commands
+ *
+ * Control flow (&&, ||, !, ;, { }, if, while, for) is compiled into a
+ * single array of instructions with jump targets, so running a loop is a
+ * tight dispatch over consecutive instructions rather than a recursive
+ * walk of the tree on every iteration. Simple commands and arithmetic are
+ * leaves the interpreter calls directly; pipelines, subshells, background
+ * jobs and function definitions are handed back to executor_execute().
+ * ============================================================================ */
+
+#ifndef VSH_BYTECODE_H
+#define VSH_BYTECODE_H
+
+#include "parser.h"
+#include <stdint.h>
+
+typedef struct Shell Shell;
+
+typedef enum BcOp {
+    BC_CMD,             /* Run simple command node */
+    BC_ARITH,           /* Evaluate (( node->expr )) */
+    BC_NODE,            /* Run node through executor_execute() */
+    BC_TRUE,            /* status = 0 */
+    BC_NOT,             /* status = !status */
+    BC_JUMP,            /* Continue at target */
+    BC_JUMP_OK,         /* ... if status is 0 */
+    BC_JUMP_FAIL,       /* ... if status is not 0 */
+    BC_LOOP_ENTER,      /* Start loop slot: result 0, remember arena mark */
+    BC_LOOP_SAVE,       /* result = status after a body */
+    BC_LOOP_EXIT,       /* Rewind to the loop's mark; status = result */
+    BC_FOR_NEXT,        /* Bind the next word of for node, or jump to target */
+} BcOp;
+
+/* BcInstr.flags */
+#define BC_READ_LOOP 0x01   /* Condition of `while read`: read owns stdin */
+#define BC_REWIND    0x02   /* LOOP_SAVE: release the pass's arena scratch */
+
+typedef struct BcInstr {
+    uint8_t  op;            /* BcOp */
+    uint8_t  flags;
+    uint16_t slot;          /* Loop slot (LOOP_*, FOR_NEXT) */
+    int32_t  target;        /* Jump target (JUMP*, FOR_NEXT) */
+    ASTNode *node;          /* Leaf or for node */
+} BcInstr;
+
+typedef struct BcProgram {
+    BcInstr *code;
+    int      count;
+    int      nloops;        /* Loop slots the program needs */
+} BcProgram;
+
+/* Upper bound on nested loops in one program; deeper trees are not compiled */
+#define BC_LOOP_MAX 256
+
+/* Compile node into arena. Returns NULL if it cannot be compiled
+ * (out of memory or too many loops); the tree walker runs it instead. */
+BcProgram *bc_compile(Arena *arena, ASTNode *node);
+
+/* Run a compiled program. Scratch memory comes from the parse arena and is
+ * released by the loops that allocated it. Returns the exit status. */
+int bc_run(Shell *shell, const BcProgram *prog);
+
+#endif /* VSH_BYTECODE_H */
@@ -0,0 +1,53 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * cwd.h - Logical working directory ($PWD) without getcwd
+ *
+ * The shell keeps the path it believes it is in, built arithmetically from
+ * the cd/pushd/popd arguments ("/a/link/.." is "/a", as with `cd -L`), and
+ * an O_PATH descriptor of that directory. Reading it costs one stat(".")
+ * to confirm nothing moved the process behind the shell's back; getcwd()
+ * and its walk up the `..` chain run only when something did.
+ * ============================================================================ */
+
+#ifndef VSH_CWD_H
+#define VSH_CWD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct Shell Shell;
+typedef struct Cwd Cwd;
+
+/* A directory to come back to (see cwd_mark) */
+typedef struct CwdMark {
+    int   fd;                   /* O_PATH descriptor */
+    char *path;                 /* Logical path, malloc'd */
+} CwdMark;
+
+/* Track the current directory. pwd (normally the inherited $PWD) is
+ * adopted when it is absolute and names "."; otherwise getcwd() decides. */
+Cwd *cwd_create(const char *pwd);
+
+void cwd_destroy(Cwd *cwd);
+
+/* The logical working directory, or NULL if it cannot be determined
+ * (the directory was removed before the shell ever knew its name) */
+const char *cwd_get(Cwd *cwd);
+
+/* Resolve target against the absolute directory base with "." and ".."
+ * applied to the text, not the filesystem. Returns false if the result
+ * does not fit in size bytes. */
+bool cwd_resolve(const char *base, const char *target, char *out, size_t size);
+
+/* Change directory, logically unless physical (cd -P), and update $PWD
+ * and $OLDPWD. Returns 0, or -1 with errno set and nothing changed. */
+int cwd_change(Shell *shell, const char *target, bool physical);
+
+/* Remember the current directory; false if it cannot be opened */
+bool cwd_mark(Cwd *cwd, CwdMark *mark);
+
+/* Go back to a marked directory and release the mark. Returns 0, or -1
+ * with errno set (the mark is released either way). */
+int cwd_return(Cwd *cwd, CwdMark *mark);
+
+#endif /* VSH_CWD_H */
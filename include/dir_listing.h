@@ -0,0 +1,49 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * dir_listing.h - Cached, sorted directory listing for file name completion
+ *
+ * The directory being completed in is listed once into one arena, sorted,
+ * and kept with its device, inode and mtime; another Tab there costs a
+ * stat() and a binary search, narrowed to the previous matches when the
+ * word only grew. A directory with more than DIR_LISTING_SYNC_MAX entries
+ * is finished by a worker thread: the line editor polls dir_listing_fd()
+ * next to the terminal and completes once the listing is in.
+ * ============================================================================ */
+
+#ifndef VSH_DIR_LISTING_H
+#define VSH_DIR_LISTING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct DirListing DirListing;
+
+/* Entries read before the rest of a directory is left to the worker */
+#define DIR_LISTING_SYNC_MAX 50000
+
+typedef enum DirListingStatus {
+    DIR_LISTING_OK,         /* *names holds the matches (maybe none) */
+    DIR_LISTING_BUSY,       /* Still being listed; ask again when the fd
+                             * becomes readable */
+    DIR_LISTING_NONE,       /* The directory cannot be read */
+} DirListingStatus;
+
+DirListing *dir_listing_create(void);
+void dir_listing_destroy(DirListing *dl);
+
+/* The names in dir starting with the base_len bytes of base, sorted, with
+ * a '/' after each directory (symlinks to one included). "." and ".." are
+ * left out, as are other hidden names when base is empty. The array is
+ * valid until the next call. */
+DirListingStatus dir_listing_match(DirListing *dl, const char *dir,
+                                   const char *base, size_t base_len,
+                                   const char *const **names, size_t *count);
+
+/* Readable when the worker has finished a listing, -1 when none runs */
+int dir_listing_fd(const DirListing *dl);
+
+/* Take in the worker's listing if it is done (non-blocking). Returns true
+ * when one was stored and a waiting completion can be retried. */
+bool dir_listing_collect(DirListing *dl);
+
+#endif /* VSH_DIR_LISTING_H */
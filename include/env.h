@@ -21,17 +21,32 @@ const char *env_get(EnvTable *env, const char *key);
 /* Set a variable */
 void env_set(EnvTable *env, const char *key, const char *value, bool exported);
 
+/* Set a variable's value, keeping it exported if it already is */
+void env_assign(EnvTable *env, const char *key, const char *value);
+
 /* Unset a variable */
 void env_unset(EnvTable *env, const char *key);
 
 /* Mark a variable as exported */
 void env_export(EnvTable *env, const char *key);
 
-/* Build an envp array for execve (caller must free the array, not the strings) */
-char **env_build_envp(EnvTable *env);
+/* Function scopes: env_push_scope on call, env_pop_scope on return. A
+ * variable made local with env_local gets its previous value and export
+ * flag (or its absence) back when the frame is popped; only the variables
+ * a frame touched are restored. Outside any frame env_local is env_set. */
+bool env_push_scope(EnvTable *env);
+void env_pop_scope(EnvTable *env);
+bool env_local(EnvTable *env, const char *key, const char *value);
+
+/* A frame for a subshell run in the shell: every variable set, unset or
+ * exported while it is innermost snapshot gets its value back at
+ * env_pop_scope, as if the changes had been made in a child process. */
+bool env_push_snapshot(EnvTable *env);
 
-/* Free an envp array built by env_build_envp */
-void env_free_envp(char **envp);
+/* The exported variables as an envp array for execve. The array is owned by
+ * the table and stays valid until the next env_set/env_unset/env_export;
+ * it is only rebuilt when an exported variable has changed. */
+char **env_envp(EnvTable *env);
 
 /* Perform variable expansion on a string.
  * Handles: $VAR, ${VAR}, ${VAR:-default}, ${VAR:=default},
@@ -39,6 +54,23 @@ void env_free_envp(char **envp);
  * Returns an arena-allocated string. */
 char *env_expand(Shell *shell, const char *input, struct Arena *arena);
 
+/* Expand the body of a here-document with an unquoted delimiter: $ and `
+ * constructs, with \$, \`, \\ and backslash-newline taken as escapes
+ * (any other backslash is kept). Returns an arena-allocated string. */
+char *env_expand_heredoc(Shell *shell, const char *body, struct Arena *arena);
+
+/* Expand one word in a single pass, straight into the arena: a leading ~
+ * if flags has WORD_TILDE, then $ and ` constructs if it has WORD_EXPAND
+ * (WORD_* from lexer.h). */
+char *env_expand_word(Shell *shell, const char *word, unsigned int flags,
+                      struct Arena *arena);
+
+/* Evaluate shell arithmetic, the text of $((...)) or ((...)), after
+ * expanding $ and ` inside it. Assigned variables are updated. Returns
+ * false, with the error printed, if it does not evaluate. */
+bool env_arith(Shell *shell, const char *expr, long long *value,
+               struct Arena *arena);
+
 /* Expand tilde (~) in a path */
 char *env_expand_tilde(Shell *shell, const char *path, struct Arena *arena);
 
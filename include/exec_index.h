@@ -0,0 +1,55 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * exec_index.h - Sorted index of the executables on PATH
+ *
+ * Each PATH directory is listed once and kept as a sorted name array along
+ * with the directory's identity and mtime. A refresh costs one stat() per
+ * directory; only directories whose mtime moved are re-read. Tab completion
+ * does a binary-search prefix scan over the merged executable names, and
+ * command lookup (through path_cache) binary-searches each directory in
+ * PATH order and stats only the directories that actually list the name.
+ * ============================================================================ */
+
+#ifndef VSH_EXEC_INDEX_H
+#define VSH_EXEC_INDEX_H
+
+#include <stddef.h>
+
+typedef struct ExecIndex ExecIndex;
+
+/* Called once per matching executable name, in sorted order, without
+ * duplicates. */
+typedef void (*ExecIndexFn)(const char *name, void *ctx);
+
+ExecIndex *exec_index_create(void);
+void exec_index_destroy(ExecIndex *idx);
+
+/* Point the index at a colon-separated path list (an empty element means
+ * the current directory). Directory listings whose path is still present
+ * are kept. serial identifies the list: the same serial is a no-op. */
+void exec_index_set_path(ExecIndex *idx, const char *path_list,
+                         unsigned long serial);
+
+/* Re-read the directories whose mtime changed (or could not be trusted at
+ * the last scan). Called by the lookups below. */
+void exec_index_refresh(ExecIndex *idx);
+
+/* Mark every directory stale so the next refresh re-reads it (hash -r) */
+void exec_index_invalidate(ExecIndex *idx);
+
+/* How often a refresh kept a directory listing, and how often it re-read
+ * one (shellstats) */
+void exec_index_counts(const ExecIndex *idx, unsigned long *kept,
+                       unsigned long *rescanned);
+
+/* Resolve name like path_search(): the first PATH directory holding an
+ * executable regular file of that name. Returns a malloc'd path or NULL. */
+char *exec_index_find(ExecIndex *idx, const char *name);
+
+/* Call fn for every executable whose name starts with prefix. Names
+ * beginning with '.' are skipped unless the prefix is non-empty. Returns
+ * the number of names reported. */
+int exec_index_complete(ExecIndex *idx, const char *prefix, size_t prefix_len,
+                        ExecIndexFn fn, void *ctx);
+
+#endif /* VSH_EXEC_INDEX_H */
@@ -9,20 +9,56 @@
 #include "parser.h"
 
 typedef struct Shell Shell;
+typedef struct SafeString SafeString;
 
 /* Execute an AST node. Returns the exit status. */
 int executor_execute(Shell *shell, ASTNode *node);
 
+/* Expand a command's words (variables, tilde, globs) into a NULL-terminated
+ * argv allocated from the parse arena; *out_argc receives the word count. */
+char **executor_expand_argv(Shell *shell, CommandNode *cmd, int *out_argc);
+
 /* Execute a simple command node */
 int executor_exec_command(Shell *shell, CommandNode *cmd);
 
+/* Replace the current (child) process with an external command resolved to
+ * path (NULL = not found). Never returns: exits 127/126 on failure. */
+void executor_exec_external(Shell *shell, const char *path, char **argv);
+
+/* Command substitution: run the commands in src[0..len) and append their
+ * standard output to out, minus trailing newlines. Pure builtins and shell
+ * functions run inside the shell with stdout on a memfd; anything else
+ * runs in a child read through a pipe. Returns (and sets $?) the status. */
+int executor_capture(Shell *shell, const char *src, size_t len,
+                     SafeString *out);
+
+/* Run an already parsed list the same way, appending all of its output
+ * (trailing newlines included). The node stays valid, so it can be
+ * run again. Returns the exit status. */
+int executor_capture_node(Shell *shell, ASTNode *node, SafeString *out);
+
 /* Execute a pipeline */
 int executor_exec_pipeline(Shell *shell, PipelineNode *pipeline);
 
-/* Apply redirections for the current process. Returns 0 on success. */
-int executor_apply_redirections(Redirection *redirs);
+/* Apply redirections for the current process, in list order. Here-document
+ * bodies are expanded with shell. Returns 0 on success. */
+int executor_apply_redirections(Shell *shell, Redirection *redirs);
+
+/* Descriptors replaced by an in-process redirection, so they can be undone */
+#define REDIR_SAVE_MAX 16
+
+typedef struct RedirSave {
+    int fd[REDIR_SAVE_MAX];     /* Redirected descriptor */
+    int saved[REDIR_SAVE_MAX];  /* Copy of its previous target (-1 = closed) */
+    int count;
+} RedirSave;
+
+/* Apply redirections inside the shell itself (builtins, functions),
+ * remembering the previous targets in *save. Returns 0 on success. */
+int executor_push_redirections(Shell *shell, Redirection *redirs,
+                               RedirSave *save);
 
-/* Restore redirections (called in parent after fork) */
-void executor_restore_redirections(void);
+/* Undo executor_push_redirections */
+void executor_restore_redirections(RedirSave *save);
 
 #endif /* VSH_EXECUTOR_H */
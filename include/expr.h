@@ -0,0 +1,66 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * expr.h - Compiled arithmetic expressions
+ *
+ * An expression is compiled once into a small stack bytecode and kept in a
+ * cache keyed by its source text, so evaluating the same expression again
+ * (calc in a loop) skips tokenizing and parsing entirely. Identifiers that
+ * are not constants or functions become variable slots; the caller binds a
+ * value to each slot before evaluating. Besides the scalar evaluator there
+ * is a block evaluator that runs each instruction over an array of inputs
+ * at a time, in loops the compiler can vectorize.
+ *
+ * Shell arithmetic ($((...))) compiles through the same cache into
+ * integer programs with C's operators, including assignment, ++ and --.
+ * ============================================================================ */
+
+#ifndef VSH_EXPR_H
+#define VSH_EXPR_H
+
+#include <stddef.h>
+
+#define EXPR_VARS_MAX  16     /* Distinct variables in one expression */
+#define EXPR_STACK_MAX 32     /* Evaluation stack depth */
+#define EXPR_BLOCK     256    /* Values per pass of the block evaluator */
+
+typedef struct ExprProgram ExprProgram;
+typedef struct ExprCache ExprCache;
+
+ExprCache *expr_cache_create(void);
+void expr_cache_destroy(ExprCache *cache);
+
+/* The compiled program for src, compiling and caching it on first use.
+ * Returns NULL on a syntax error, with a message in err. The program is
+ * owned by the cache and stays valid until it is evicted by a later
+ * compile, so use it before compiling anything else. A NULL cache (one
+ * that could not be created) fails as out of memory. */
+const ExprProgram *expr_compile(ExprCache *cache, const char *src,
+                                char *err, size_t errlen);
+
+/* The same for shell arithmetic: integers, C operators and assignments.
+ * Integer programs are only run by expr_eval_int. */
+const ExprProgram *expr_compile_int(ExprCache *cache, const char *src,
+                                    char *err, size_t errlen);
+
+/* Variables referenced by a program, in slot order */
+int expr_nvars(const ExprProgram *prog);
+const char *expr_var_name(const ExprProgram *prog, int slot);
+
+/* Evaluate with vars[slot] bound to each variable. Returns 0, or -1 with
+ * a message in err (division by zero, a domain error, ...). */
+int expr_eval(const ExprProgram *prog, const double *vars, double *result,
+              char *err, size_t errlen);
+
+/* Evaluate n times at once: cols[slot][i] is the variable's value for
+ * out[i]. Fails as a whole, like expr_eval, if any of them fails. */
+int expr_eval_block(const ExprProgram *prog, const double *const *cols,
+                    size_t n, double *out, char *err, size_t errlen);
+
+/* Evaluate an integer program. Assignments update vars[slot] and set
+ * bit slot in *assigned, also when evaluation fails part way through, so
+ * the caller can write them back. */
+int expr_eval_int(const ExprProgram *prog, long long *vars,
+                  unsigned int *assigned, long long *result,
+                  char *err, size_t errlen);
+
+#endif /* VSH_EXPR_H */
@@ -0,0 +1,48 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * fdcopy.h - Moving bytes between file descriptors inside the kernel
+ *
+ * The `cat` and `tee` builtins, the copy stages of a pipeline and the
+ * redirect-only `< in > out` command all end up here. The copy is done
+ * with the strongest call the two fd types allow:
+ *
+ *   regular file -> regular file   copy_file_range (reflink / server-side)
+ *   anything     <-> pipe          splice
+ *   regular file -> socket, ...    sendfile
+ *   otherwise (or on EINVAL ...)   read/write through a 128 KiB buffer
+ *
+ * A kernel path that refuses the pair (cross-device on old kernels, an
+ * O_APPEND target, a tty) falls through to the next one, continuing from
+ * wherever the first stopped.
+ * ============================================================================ */
+
+#ifndef VSH_FDCOPY_H
+#define VSH_FDCOPY_H
+
+#include <stddef.h>
+
+typedef enum FdCopyMethod {
+    FDCOPY_RANGE,       /* copy_file_range */
+    FDCOPY_SPLICE,      /* splice (one side is a pipe) */
+    FDCOPY_SENDFILE,    /* sendfile (input is a regular file) */
+    FDCOPY_BUFFER,      /* read/write */
+} FdCopyMethod;
+
+/* Size of the buffer the fallback loop reads through */
+#define FDCOPY_BUFFER_SIZE (128 * 1024)
+
+/* The first method fd_copy() would try for this pair */
+FdCopyMethod fd_copy_method(int in, int out);
+
+/* Copy from in's current position to end of file, writing at out's
+ * position. Returns the bytes copied, or -1 with errno set (EPIPE when
+ * the reader went away). */
+long long fd_copy(int in, int out);
+
+/* Copy in to every fd in outs, like tee(1). A regular-file input is
+ * copied to each output by offset; a pipe input with two outputs is
+ * duplicated with tee(2) and spliced. Writing stops at the first failing
+ * output. Returns the bytes read from in, or -1 with errno set. */
+long long fd_tee(int in, const int *outs, int nout);
+
+#endif /* VSH_FDCOPY_H */
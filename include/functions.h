@@ -0,0 +1,55 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * functions.h - Shell function table
+ *
+ * Function definitions outlive the command line that created them, so each
+ * body is deep-copied out of the parse arena into a private arena owned by
+ * the table entry. Lookup is a hash probe; no fork is needed to call one.
+ * ============================================================================ */
+
+#ifndef VSH_FUNCTIONS_H
+#define VSH_FUNCTIONS_H
+
+#include "parser.h"
+#include <stdbool.h>
+
+typedef struct Arena Arena;
+typedef struct Shell Shell;
+
+#define FUNC_HASH_SIZE 64
+
+/* Maximum nesting of function calls before we refuse to recurse further */
+#define FUNC_MAX_DEPTH 1000
+
+typedef struct FuncEntry {
+    char             *name;      /* Function name (arena-allocated) */
+    ASTNode          *body;      /* Deep copy of the body AST */
+    Arena            *arena;     /* Owns name and body */
+    int               active;    /* Calls currently executing this body */
+    bool              removed;   /* Unlinked while active; free when idle */
+    struct FuncEntry *next;
+} FuncEntry;
+
+typedef struct FuncTable {
+    FuncEntry *buckets[FUNC_HASH_SIZE];
+    int        count;
+} FuncTable;
+
+/* Create / destroy the function table */
+FuncTable *func_table_create(void);
+void func_table_destroy(FuncTable *table);
+
+/* Define (or redefine) a function, deep-copying body. Returns false on OOM. */
+bool func_define(FuncTable *table, const char *name, const ASTNode *body);
+
+/* Look up a function by name (NULL if not defined) */
+FuncEntry *func_lookup(FuncTable *table, const char *name);
+
+/* Remove a function definition. Returns true if it existed. */
+bool func_remove(FuncTable *table, const char *name);
+
+/* Invoke a function in the current shell process with argv bound to the
+ * positional parameters. Returns the function's exit status. */
+int func_call(Shell *shell, FuncEntry *fn, int argc, char **argv);
+
+#endif /* VSH_FUNCTIONS_H */
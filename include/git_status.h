@@ -0,0 +1,48 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * git_status.h - Cached git branch and asynchronous status for the prompt
+ *
+ * The branch is found once per working directory and then revalidated with
+ * a single stat() of the repository's HEAD; directories outside a repo are
+ * revalidated by their own mtime. When VSH_GIT_STATUS is set, a background
+ * `git status` computes the dirty flag and ahead/behind counts; the line
+ * editor polls its pipe alongside the terminal and repaints the prompt when
+ * the result arrives. The prompt never waits for the worker, and a repo
+ * whose status takes longer than GIT_STATUS_TIMEOUT_MS is no longer asked.
+ * ============================================================================ */
+
+#ifndef VSH_GIT_STATUS_H
+#define VSH_GIT_STATUS_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+typedef struct Shell Shell;
+typedef struct GitStatus GitStatus;
+
+#define GIT_STATUS_TIMEOUT_MS 3000
+
+typedef struct GitInfo {
+    const char *branch;     /* Branch or short commit; NULL outside a repo */
+    bool        have_detail;/* dirty/ahead/behind below are valid */
+    bool        dirty;      /* Tracked changes in the worktree or index */
+    int         ahead;
+    int         behind;
+} GitInfo;
+
+GitStatus *git_status_create(void);
+void git_status_destroy(GitStatus *gs);
+
+/* Repository state for cwd. Starts the background worker if detail is
+ * enabled and the cached detail is out of date. The result is valid until
+ * the next call. */
+const GitInfo *git_status_get(Shell *shell, const char *cwd);
+
+/* Read end of the running worker's pipe, or -1 when none is running */
+int git_status_fd(const GitStatus *gs);
+
+/* Consume worker output (non-blocking) and enforce the timeout. Returns
+ * true when new detail was stored and the prompt should be repainted. */
+bool git_status_collect(GitStatus *gs);
+
+#endif /* VSH_GIT_STATUS_H */
@@ -8,21 +8,55 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <time.h>
 
 #define HISTORY_MAX_SIZE 10000
 #define HISTORY_FILE     ".vsh_history"
 
+/*
+ * On disk every entry is one record, appended as it is added:
+ *     : <unix time>:0;<command>
+ * Newlines inside a command are written as backslash-newline. Plain lines
+ * from the older one-command-per-line format load with time 0. The file is
+ * compacted (records from all sessions merged by time, trimmed to the
+ * history capacity) once it holds HISTORY_COMPACT_FACTOR times that many.
+ */
+#define HISTORY_COMPACT_FACTOR 2
+
+/* Lines are packed into chunks appended in FIFO order; a chunk is released
+ * once every entry stored in it has been evicted. */
+#define HISTORY_CHUNK_SIZE 65536
+
+typedef struct HistoryChunk {
+    struct HistoryChunk *next;  /* Next newer chunk */
+    size_t               size;
+    size_t               used;
+    int                  live;  /* Entries still referring to this chunk */
+    char                 data[];
+} HistoryChunk;
+
 typedef struct HistoryEntry {
-    char *line;
-    int   index;     /* Global history index */
+    char         *line;     /* Points into chunk->data */
+    int           index;    /* Global history index */
+    time_t        when;     /* When it was entered (0 = unknown) */
+    HistoryChunk *chunk;
 } HistoryEntry;
 
 typedef struct History {
-    HistoryEntry *entries;
+    HistoryEntry *entries;    /* Ring buffer of `capacity` slots */
+    int           head;       /* Slot of the oldest entry */
     int           count;      /* Number of entries */
     int           capacity;   /* Max entries */
     int           pos;        /* Current navigation position (for up/down) */
     int           next_index; /* Next global index */
+    HistoryChunk *oldest;     /* Chunk list, oldest to newest */
+    HistoryChunk *newest;
+    HistoryChunk *spare;      /* One emptied chunk kept for reuse */
+    char         *file;       /* Attached history file (new entries are
+                                 appended to it), NULL = none */
+    int           file_records; /* Records believed to be in the file */
+    struct HistoryIndex *index; /* Trigram index for Ctrl+R, built on first
+                                   search (see history_search.h) */
 } History;
 
 /* Create a new history */
@@ -58,11 +92,18 @@ const char *history_search_prefix(History *hist, const char *prefix);
 /* Search backwards for a line containing substring */
 const char *history_search_substr(History *hist, const char *substr, int *out_pos);
 
-/* Load history from file */
+/* Load history from file (mmap'd and indexed in one pass) and attach it:
+ * every later history_add() appends its record with a single write. */
 void history_load(History *hist, const char *path);
 
-/* Save history to file */
-void history_save(const History *hist, const char *path);
+/* Save history to file. For the attached file everything is already on
+ * disk, so this only compacts it when it has grown past the threshold;
+ * any other path gets a full copy of the in-memory history. */
+void history_save(History *hist, const char *path);
+
+/* Rewrite the attached file: merge every session's records by time, drop
+ * adjacent duplicates and keep the newest `capacity`. Returns 0 on success. */
+int history_compact(History *hist);
 
 /* Clear all history */
 void history_clear(History *hist);
@@ -0,0 +1,64 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * history_search.h - Trigram index and incremental history search
+ *
+ * Ctrl+R needs "newest entry containing this substring" on every keystroke.
+ * The index maps each 3-byte sequence to the (ascending) global indices of
+ * entries containing it; a query of 3+ bytes only verifies entries on the
+ * shortest posting list of its trigrams. A search session keeps its
+ * candidate set, so typing another character just filters it.
+ * ============================================================================ */
+
+#ifndef VSH_HISTORY_SEARCH_H
+#define VSH_HISTORY_SEARCH_H
+
+#include <stddef.h>
+
+typedef struct History History;
+typedef struct HistoryIndex HistoryIndex;
+
+#define HISTORY_INDEX_BUCKETS 4096
+
+/* ---- Index (owned by History, maintained by history_add) ---------------- */
+
+/* Index every entry currently in hist. Returns NULL on allocation failure. */
+HistoryIndex *history_index_build(const History *hist);
+
+/* Record a newly added entry */
+void history_index_add(HistoryIndex *idx, const char *line, int index);
+
+/* Lowest global index in the index (older postings are stale) */
+int history_index_base(const HistoryIndex *idx);
+
+void history_index_destroy(HistoryIndex *idx);
+
+/* ---- Incremental search session ----------------------------------------- */
+
+typedef struct HistorySearch {
+    History *hist;
+    char    *query;      /* Query the candidates were computed for */
+    size_t   qlen;
+    int     *cands;      /* Global indices of matches, newest first */
+    int      ncands;
+    int      cap;
+    int      cur;        /* Current match within cands (-1 = none) */
+} HistorySearch;
+
+/* Start a session (the index is built on first use) */
+void history_search_begin(HistorySearch *s, History *hist);
+
+/* Set the query. If it extends the previous one only the previous matches
+ * are re-checked; the current match is kept when it still matches, else the
+ * next older match is chosen. Returns the current match or NULL. */
+const char *history_search_update(HistorySearch *s, const char *query);
+
+/* Move to the next older match (Ctrl+R again). Returns it, or NULL when
+ * there is none (the current match stays selected). */
+const char *history_search_older(HistorySearch *s);
+
+/* The current match, or NULL */
+const char *history_search_current(const HistorySearch *s);
+
+void history_search_end(HistorySearch *s);
+
+#endif /* VSH_HISTORY_SEARCH_H */
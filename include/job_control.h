@@ -8,6 +8,7 @@
 
 #include "shell.h"
 #include <sys/types.h>
+#include <sys/resource.h>
 #include <stdbool.h>
 
 /* Initialize job control (take control of terminal) */
@@ -32,12 +33,18 @@ Job *job_find_by_pid(Shell *shell, pid_t pid);
 /* Get the most recent job */
 Job *job_most_recent(Shell *shell);
 
-/* Update job status (call after waitpid) */
-void job_update_status(Shell *shell, pid_t pid, int status);
+/* Update job status (call after wait4). usage, when not NULL, is the
+ * child's rusage and is added to its job's totals if it exited. */
+void job_update_status(Shell *shell, pid_t pid, int status,
+                       const struct rusage *usage);
 
 /* Wait for a foreground job to complete or stop */
 int job_wait_foreground(Shell *shell, Job *job);
 
+/* Wait for a job to stop or finish without handing it the terminal.
+ * A finished job is removed. Returns its exit status. */
+int job_wait(Shell *shell, Job *job);
+
 /* Continue a stopped job in foreground */
 int job_continue_foreground(Shell *shell, Job *job);
 
@@ -50,13 +57,23 @@ void job_check_background(Shell *shell);
 /* Print job list */
 void job_list_print(Shell *shell);
 
+/* Print job list with each job's CPU%, resident memory and elapsed time
+ * (jobs -s). CPU% covers the time since the previous call, or the job's
+ * whole life on the first; a finished job shows its peak memory. */
+void job_stats_print(Shell *shell);
+
+/* In a forked child: put back the default disposition of every signal
+ * the shell ignores or handles, and unblock SIGCHLD */
+void job_child_reset_signals(void);
+
 /* Free all jobs */
 void job_table_destroy(Shell *shell);
 
-/* SIGCHLD handler (updates job statuses) */
-void sigchld_handler(int sig);
+/* Descriptor that becomes readable when a child changes state (a
+ * signalfd for SIGCHLD), or -1 when job control is not active */
+int job_event_fd(Shell *shell);
 
-/* Set up the global shell pointer for signal handlers */
-void job_set_shell(Shell *shell);
+/* Collect every child that changed state, without blocking */
+void job_reap(Shell *shell);
 
 #endif /* VSH_JOB_CONTROL_H */
@@ -5,8 +5,10 @@
  * Converts raw input string into a stream of tokens, handling:
  * - Single and double quoting
  * - Backslash escapes
- * - Operators (|, &&, ||, ;, &, >, >>, <, <<)
- * - Variable references ($VAR, ${VAR})
+ * - Operators (|, &&, ||, ;, &, >, >>, <, <<, <<-, <<<, >&, <&)
+ * - Variable references ($VAR, ${VAR}) and command substitution
+ *   ($(...), `...`), kept verbatim inside the word
+ * - Here-document bodies, read from the lines after the operator
  * ============================================================================ */
 
 #ifndef VSH_LEXER_H
@@ -27,8 +29,9 @@ typedef enum TokenType {
     TOK_REDIR_IN,      /* < */
     TOK_REDIR_OUT,     /* > */
     TOK_REDIR_APPEND,  /* >> */
-    TOK_REDIR_HEREDOC, /* << */
-    TOK_REDIR_DUP,     /* 2>&1 or >&2 etc */
+    TOK_REDIR_HEREDOC, /* << or <<- (body in Token.heredoc) */
+    TOK_REDIR_HERESTR, /* <<< */
+    TOK_REDIR_DUP,     /* >& or <& (target is the next word) */
     TOK_LPAREN,        /* ( */
     TOK_RPAREN,        /* ) */
     TOK_NEWLINE,       /* \n */
@@ -45,15 +48,38 @@ typedef enum TokenType {
     TOK_FUNCTION,      /* function keyword */
     TOK_RETURN,        /* return keyword */
     TOK_LOCAL,         /* local keyword */
+    TOK_TIME,          /* time keyword (prefix of a pipeline) */
     TOK_LBRACE,        /* { */
     TOK_RBRACE,        /* } */
     TOK_BANG,          /* ! (negation) */
+    TOK_ARITH,         /* ((expr)), value is expr */
     TOK_EOF            /* End of input */
 } TokenType;
 
+/* A here-document. The lexer creates it at the operator and fills in the
+ * body once it reaches the end of that line, so the body is complete by
+ * the time lexer_tokenize() returns. */
+typedef struct HereDoc {
+    char           *delim;
+    char           *body;        /* Arena-allocated, NULL until read */
+    bool            expand;      /* Delimiter unquoted: expand $ in body */
+    bool            strip_tabs;  /* <<-: leading tabs removed */
+    struct HereDoc *next;        /* Lexer's queue of unread bodies */
+} HereDoc;
+
+/* What a word needs when it is expanded, worked out while its quotes are
+ * still visible. A word with none of these is used exactly as lexed. */
+#define WORD_EXPAND 0x01      /* $ or ` outside single quotes */
+#define WORD_TILDE  0x02      /* Starts with an unquoted ~ */
+#define WORD_GLOB   0x04      /* Unquoted * ? [, or an unquoted expansion */
+#define WORD_ALL    (WORD_EXPAND | WORD_TILDE | WORD_GLOB)
+
 typedef struct Token {
     TokenType    type;
     char        *value;       /* Token text (arena-allocated) */
+    unsigned char word_flags; /* WORD_* for words, else 0 */
+    bool         quoted;      /* Word had quotes or backslashes */
+    HereDoc     *heredoc;     /* TOK_REDIR_HEREDOC only */
     int          redir_fd;    /* For redirections: the fd number (e.g., 2 in 2>) */
     int          line;        /* Source line number */
     int          col;         /* Source column number */
@@ -74,6 +100,10 @@ typedef struct Lexer {
     int         col;
     Arena      *arena;
     char       *error;       /* Error message (arena-allocated) */
+    bool        incomplete;  /* Input ended inside a quote or here-doc */
+    bool        word_quoted; /* Last word had quotes or backslashes */
+    HereDoc    *pending;     /* Here-docs whose body starts at the next line */
+    HereDoc   **pending_tail;
 } Lexer;
 
 /* Initialize the lexer with input and arena */
@@ -88,6 +118,11 @@ Token lexer_next(Lexer *lex);
 /* Peek at next token without consuming */
 Token lexer_peek(Lexer *lex);
 
+/* Length of the $(...), ${...} or `...` construct at the start of s,
+ * including its closing delimiter; 0 if it is not closed within n bytes.
+ * Quotes and nested substitutions inside it are skipped over. */
+size_t lexer_scan_subst(const char *s, size_t n);
+
 /* Check if a token type is a keyword */
 bool token_is_keyword(TokenType type);
 
@@ -0,0 +1,62 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * output.h - Block-buffered output for builtins
+ *
+ * Builtins write their output through one shell-owned buffer instead of
+ * stdio, so a builtin costs one write(2) however many small pieces it
+ * prints, whatever stdout is. The executor flushes the buffer once each
+ * builtin returns, and before anything that changes what fd 1 refers to
+ * or copies the process (redirections, $(...) capture, fork), so output
+ * always reaches the descriptor that was current when it was written.
+ * A payload too big to be worth copying goes out in the same writev(2)
+ * as whatever is buffered ahead of it.
+ * ============================================================================ */
+
+#ifndef VSH_OUTPUT_H
+#define VSH_OUTPUT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define OUT_BUF_SIZE 65536
+
+typedef struct OutBuf {
+    int    fd;              /* Where flushed output goes */
+    int    error;           /* errno of the first failed write, else 0 */
+    size_t len;
+    char   data[OUT_BUF_SIZE];
+} OutBuf;
+
+/* Create a buffer writing to fd */
+OutBuf *out_create(int fd);
+
+/* Flush and free */
+void out_destroy(OutBuf *out);
+
+/* Append bytes, flushing as needed */
+void out_write(OutBuf *out, const void *data, size_t n);
+
+/* Append a C string */
+void out_puts(OutBuf *out, const char *s);
+
+/* Append formatted text */
+void out_printf(OutBuf *out, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* Append n copies of the string s (box drawing, padding) */
+void out_repeat(OutBuf *out, const char *s, int n);
+
+static inline void out_putc(OutBuf *out, char c)
+{
+    if (out->len == OUT_BUF_SIZE)
+        out_write(out, &c, 1);
+    else
+        out->data[out->len++] = c;
+}
+
+/* Write out everything buffered. Returns -1 with errno set if a write
+ * failed since the last flush (the rest is dropped, as after EPIPE),
+ * else 0. */
+int out_flush(OutBuf *out);
+
+#endif /* VSH_OUTPUT_H */
@@ -5,10 +5,11 @@
  * Grammar:
  *   program     → list EOF
  *   list        → pipeline ((';' | '&' | '&&' | '||') pipeline)* [';' | '&']
- *   pipeline    → ['!'] command ('|' command)*
+ *   pipeline    → ['time' ['-p' | '-j']] ['!'] [command ('|' command)*]
  *   command     → simple_cmd | compound_cmd | function_def
  *   simple_cmd  → (assignment | redirection | WORD)+
  *   compound_cmd→ if_cmd | while_cmd | for_cmd | '{' list '}' | '(' list ')'
+ *               | '((' expr '))'
  *   if_cmd      → 'if' list 'then' list ('elif' list 'then' list)* ['else' list] 'fi'
  *   while_cmd   → 'while' list 'do' list 'done'
  *   for_cmd     → 'for' WORD ['in' WORD*] ';'|NL 'do' list 'done'
@@ -38,6 +39,7 @@ typedef enum ASTNodeType {
     NODE_FOR,          /* for/in/do/done */
     NODE_FUNCTION,     /* function definition */
     NODE_BLOCK,        /* { list } */
+    NODE_ARITH,        /* (( expr )) */
 } ASTNodeType;
 
 /* ---- Redirection -------------------------------------------------------- */
@@ -46,6 +48,7 @@ typedef enum RedirType {
     REDIR_OUTPUT,      /* > file */
     REDIR_APPEND,      /* >> file */
     REDIR_HEREDOC,     /* << DELIM */
+    REDIR_HERESTRING,  /* <<< word */
     REDIR_DUP_OUT,     /* >&N */
     REDIR_DUP_IN,      /* <&N */
 } RedirType;
@@ -53,7 +56,9 @@ typedef enum RedirType {
 typedef struct Redirection {
     RedirType    type;
     int          fd;       /* Source fd (-1 for default: 0 for input, 1 for output) */
-    char        *target;   /* Filename or fd number as string */
+    char        *target;   /* Filename, fd number ("-" closes), or the text
+                            * of a here-document or here-string */
+    bool         expand;   /* Here-doc/string: expand $ in target when run */
     struct Redirection *next;
 } Redirection;
 
@@ -62,17 +67,32 @@ typedef struct Redirection {
 /* Simple command: argv + redirections */
 typedef struct CommandNode {
     char       **argv;      /* Null-terminated argument array */
+    unsigned char *argv_flags; /* WORD_* for each argv word */
     int          argc;      /* Number of arguments */
     Redirection *redirs;    /* Linked list of redirections */
     char       **assignments; /* VAR=value assignments before command */
     int          nassign;
+
+    /* Dispatch cache: the builtin named by a literal argv[0], filled in by
+     * the executor on first run so loops and function bodies skip lookup */
+    const struct BuiltinEntry *builtin;
+    bool         resolved;
 } CommandNode;
 
+/* How a `time` prefix reports (PipelineNode.timed) */
+typedef enum TimeFormat {
+    TIME_NONE,          /* Not timed */
+    TIME_TABLE,         /* Per-stage table */
+    TIME_POSIX,         /* time -p: real/user/sys lines */
+    TIME_JSON           /* time -j: one JSON object */
+} TimeFormat;
+
 /* Pipeline: array of commands connected by pipes */
 typedef struct PipelineNode {
     struct ASTNode **commands;
-    int              count;
+    int              count;   /* 0 only for a bare `time` */
     bool             negated; /* ! prefix */
+    TimeFormat       timed;   /* time prefix */
 } PipelineNode;
 
 /* Binary operator (AND, OR, SEQUENCE) */
@@ -98,6 +118,7 @@ typedef struct WhileNode {
 typedef struct ForNode {
     char           *varname;
     char          **words;     /* Words to iterate over */
+    unsigned char  *word_flags; /* WORD_* for each word */
     int             nwords;
     struct ASTNode *body;
 } ForNode;
@@ -120,9 +141,18 @@ typedef struct ASTNode {
         ForNode       for_node;
         FunctionNode  func;
         struct ASTNode *child;  /* For BACKGROUND, NEGATE, SUBSHELL, BLOCK */
+        char          *expr;    /* For ARITH */
     };
 } ASTNode;
 
+/* ---- Script ------------------------------------------------------------- */
+
+/* A whole script parsed up front: one AST per top-level complete command */
+typedef struct Script {
+    ASTNode **commands;
+    int       count;
+} Script;
+
 /* ---- Parser ------------------------------------------------------------- */
 typedef struct Parser {
     TokenList *tokens;
@@ -130,6 +160,9 @@ typedef struct Parser {
     Arena     *arena;
     char      *error;       /* Error message (arena-allocated) */
     bool       had_error;
+    bool       incomplete;  /* Error hit end of input (more lines may fix it) */
+    bool       line_mode;   /* Stop top-level lists at a newline */
+    int        depth;       /* Current parse_list nesting depth */
 } Parser;
 
 /* Initialize the parser */
@@ -138,9 +171,17 @@ void parser_init(Parser *parser, TokenList *tokens, Arena *arena);
 /* Parse the token stream into an AST */
 ASTNode *parser_parse(Parser *parser);
 
+/* Parse the token stream as a script of newline-separated complete commands.
+ * On a syntax error the commands parsed before it are kept, had_error is set
+ * and the error message is available via parser_error(). */
+Script *parser_parse_script(Parser *parser);
+
 /* Get the error message (if parsing failed) */
 const char *parser_error(const Parser *parser);
 
+/* Deep-copy an AST (nodes, strings, redirections) into another arena */
+ASTNode *ast_clone(Arena *arena, const ASTNode *node);
+
 /* Debug: print the AST (for development) */
 void ast_print(const ASTNode *node, int indent);
 
@@ -0,0 +1,72 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * path_cache.h - Hashed command-name to executable-path cache
+ *
+ * External commands are resolved against PATH once in the parent shell and
+ * remembered, so the child can execve() the absolute path directly instead
+ * of probing every PATH directory. The cache is dropped whenever PATH is
+ * changed through env_set()/env_unset(), and is exposed by the `hash`
+ * builtin. Misses are resolved through the shared ExecIndex (exec_index.h),
+ * which tab completion queries as well.
+ * ============================================================================ */
+
+#ifndef VSH_PATH_CACHE_H
+#define VSH_PATH_CACHE_H
+
+#include <stdbool.h>
+
+typedef struct Shell Shell;
+typedef struct ExecIndex ExecIndex;
+
+#define PATH_CACHE_HASH_SIZE 128
+
+/* Search path used when PATH is unset (matches execvp's default) */
+#define PATH_CACHE_DEFAULT_PATH "/bin:/usr/bin"
+
+typedef struct PathCacheEntry {
+    char                  *name;    /* Command name as typed */
+    char                  *path;    /* Resolved absolute path */
+    unsigned long          hits;    /* Times the cached path was used */
+    struct PathCacheEntry *next;
+} PathCacheEntry;
+
+typedef struct PathCache {
+    PathCacheEntry *buckets[PATH_CACHE_HASH_SIZE];
+    int             count;
+    unsigned long   path_serial;    /* EnvTable.path_serial when filled */
+    ExecIndex      *index;          /* PATH directory listings */
+} PathCache;
+
+/* Create / destroy a cache */
+PathCache *path_cache_create(void);
+void path_cache_destroy(PathCache *cache);
+
+/* The shell's cache, emptied first if PATH changed since it was filled */
+PathCache *path_cache_current(Shell *shell);
+
+/* The shared executable index, pointed at the shell's current PATH.
+ * NULL when the shell has no cache. */
+ExecIndex *path_cache_index(Shell *shell);
+
+/* Resolve a command name to an executable path, consulting and filling the
+ * cache. Names containing '/' are returned as-is. Returns NULL if not found.
+ * The returned string is owned by the cache (valid until it changes). */
+const char *path_cache_lookup(Shell *shell, const char *name);
+
+/* Return the cached path for name without searching or counting a hit */
+const char *path_cache_peek(Shell *shell, const char *name);
+
+/* Resolve name and (re)insert it into the cache; false if not found */
+bool path_cache_add(Shell *shell, const char *name);
+
+/* Forget one entry (e.g. the binary disappeared). Returns true if present. */
+bool path_cache_forget(PathCache *cache, const char *name);
+
+/* Forget everything and re-read the PATH directories on next use (hash -r) */
+void path_cache_clear(Shell *shell);
+
+/* Search a colon-separated path list for an executable regular file.
+ * Returns a malloc'd absolute path or NULL. Does not touch any cache. */
+char *path_search(const char *path_list, const char *name);
+
+#endif /* VSH_PATH_CACHE_H */
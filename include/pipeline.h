@@ -6,14 +6,35 @@
 #ifndef VSH_PIPELINE_H
 #define VSH_PIPELINE_H
 
+#include <stdbool.h>
 #include <sys/types.h>
 
 typedef struct Shell Shell;
 typedef struct ASTNode ASTNode;
 typedef struct PipelineNode PipelineNode;
 
+/* What one stage read and wrote, from /proc/PID/io as it exits (the
+ * process's own reads and writes, not those of commands it ran) */
+typedef struct StageBytes {
+    pid_t              pid;     /* 0 if the stage ran in the shell */
+    bool               known;
+    unsigned long long read;
+    unsigned long long written;
+} StageBytes;
+
+/* The stages of a running pipeline under `set -o timing` */
+typedef struct PipeBytes {
+    struct PipeBytes *outer;    /* Enclosing pipeline, if any */
+    int               n;
+    StageBytes       *stages;
+} PipeBytes;
+
 /* Execute a pipeline of commands connected by pipes.
  * Returns the exit status of the last command in the pipeline. */
 int pipeline_execute(Shell *shell, PipelineNode *pipeline);
 
+/* Child pid has exited but is not reaped yet: if it is a stage being
+ * counted, take its byte counts now (called by the reaping code) */
+void pipeline_stage_exited(Shell *shell, pid_t pid);
+
 #endif /* VSH_PIPELINE_H */
@@ -0,0 +1,56 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * pipetime.h - The `time` keyword: resource usage of a pipeline
+ *
+ * While a timed pipeline runs, the shell's reaping code hands every child
+ * it waits for (with wait4) to the innermost PipeTimer. A child that is a
+ * stage of the pipeline is booked against that stage; its usage includes
+ * whatever it waited for itself. Any other child, such as a command run
+ * by a stage in the shell, is booked against the shell, together with the
+ * shell's own CPU time and faults over the run.
+ * ============================================================================ */
+
+#ifndef VSH_PIPETIME_H
+#define VSH_PIPETIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+typedef struct Shell Shell;
+typedef struct PipelineNode PipelineNode;
+typedef struct ASTNode ASTNode;
+
+typedef struct TimedStage {
+    pid_t         pid;          /* 0 if the stage ran in the shell */
+    bool          reaped;
+    uint64_t      end_ns;       /* Monotonic time it was reaped */
+    struct rusage usage;
+} TimedStage;
+
+typedef struct PipeTimer {
+    struct PipeTimer   *outer;  /* Enclosing timed pipeline, if any */
+    const PipelineNode *pipeline;
+    TimedStage         *stages; /* One per command of the pipeline */
+    struct rusage       others; /* Children that are not a stage */
+    uint64_t            start_ns;
+} PipeTimer;
+
+/* Run a pipeline with a `time` prefix and print its report to stderr in
+ * pipeline->timed format. Returns the pipeline's status. */
+int pipetime_execute(Shell *shell, PipelineNode *pipeline);
+
+/* Stage i of pipeline is process pid (called by pipeline_execute) */
+void pipetime_stage_started(Shell *shell, const PipelineNode *pipeline,
+                            int i, pid_t pid);
+
+/* What a stage is called in a report: the command word as written, or
+ * the kind of compound command */
+const char *pipetime_stage_label(const ASTNode *node);
+
+/* A child was reaped with wait status and usage from wait4() */
+void pipetime_reaped(Shell *shell, pid_t pid, int status,
+                     const struct rusage *usage);
+
+#endif /* VSH_PIPETIME_H */
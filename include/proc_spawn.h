@@ -0,0 +1,47 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * proc_spawn.h - posix_spawn fast path for external commands
+ *
+ * fork() has to duplicate the shell's page tables, arenas and history
+ * before the child can exec; for a simple external command all of that is
+ * thrown away immediately. spawn_command() starts the command with
+ * posix_spawn() instead (a CLONE_VM|CLONE_VFORK child on glibc), expressing
+ * pipe wiring, redirections, the process group and the terminal handoff
+ * as spawn attributes and file actions.
+ *
+ * Anything that needs the shell itself in the child -- builtins, functions,
+ * subshells, compound commands, command-local assignments -- still forks.
+ * ============================================================================ */
+
+#ifndef VSH_PROC_SPAWN_H
+#define VSH_PROC_SPAWN_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+typedef struct Shell Shell;
+typedef struct Redirection Redirection;
+
+typedef struct SpawnRequest {
+    const char  *path;        /* Resolved executable */
+    char       **argv;        /* NULL-terminated argument vector */
+    Redirection *redirs;      /* Applied after the pipe wiring */
+    int          stdin_fd;    /* Becomes fd 0 (-1 = inherit) */
+    int          stdout_fd;   /* Becomes fd 1 (-1 = inherit) */
+    const int   *close_fds;   /* Extra descriptors to close in the child */
+    int          nclose;
+    pid_t        pgid;        /* Group to join (0 = lead a new one); only used
+                                 * when the shell does job control */
+    bool         foreground;  /* Hand the terminal to the child's group */
+} SpawnRequest;
+
+/* Can these redirections (and the current shell mode) be expressed as
+ * spawn file actions? Callers fall back to fork() when this is false. */
+bool spawn_supported(Shell *shell, const Redirection *redirs, bool foreground);
+
+/* Start an external command. Returns the child's pid, or -1 with errno set
+ * if it could not be started; no diagnostic is printed, so the caller can
+ * retry through fork() to get the usual shell error messages. */
+pid_t spawn_command(Shell *shell, const SpawnRequest *req);
+
+#endif /* VSH_PROC_SPAWN_H */
@@ -0,0 +1,40 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * prompt.h - Segment-based prompt renderer
+ *
+ * The prompt is a fixed sequence of segments (time, user@host, cwd, git,
+ * jobs, status). Each segment first writes a key describing everything its
+ * output depends on; when the key matches the previous render, the cached
+ * bytes and their visible width are reused. The assembled prompt is only
+ * rebuilt when a segment changed, and its geometry (rows above the input
+ * line, visible width of that line) is computed once per render so the
+ * line editor never has to scan escape sequences on a keypress.
+ * ============================================================================ */
+
+#ifndef VSH_PROMPT_H
+#define VSH_PROMPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct Shell Shell;
+typedef struct Prompt Prompt;
+
+Prompt *prompt_create(void);
+void prompt_destroy(Prompt *p);
+
+/* Render the shell's prompt. The text is owned by shell->prompt and stays
+ * valid (at the same address) until a later render reports a change. If
+ * changed is non-NULL it is set when the text differs from the last one. */
+const char *prompt_render(Shell *shell, bool *changed);
+
+/* Geometry of a prompt string: the number of newlines it contains and the
+ * visible width of its last line. Uses the cached values when text is the
+ * shell's own rendered prompt. */
+void prompt_metrics(Shell *shell, const char *text, int *rows, int *width);
+
+/* Terminal columns taken by s[0..len): ANSI escapes take none, a UTF-8
+ * sequence takes one, and a newline restarts the count. */
+int prompt_visible_width(const char *s, size_t len);
+
+#endif /* VSH_PROMPT_H */
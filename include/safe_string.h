@@ -2,9 +2,20 @@
  * vsh - Vanguard Shell
  * safe_string.h - Bounds-checked dynamic string buffer
  *
- * Wraps a heap-allocated char buffer with length and capacity tracking.
- * All operations are bounds-checked. Auto-grows with 2x strategy.
- * Always null-terminated.
+ * Wraps a char buffer with length and capacity tracking. All operations
+ * are bounds-checked. Auto-grows with 2x strategy. Always null-terminated.
+ *
+ * The buffer lives in one of three places:
+ *   sstr_new() and friends   heap object and heap buffer; sstr_free()
+ *   sstr_init()              struct on the stack or embedded, text in
+ *                            inline_buf until it outgrows it; sstr_release()
+ *   sstr_init_arena()        buffer taken from (and grown in) an Arena,
+ *                            reclaimed with the arena
+ * An initialised struct points into itself: never copy one by value.
+ *
+ * sstr_scratch() hands out a heap string from a small per-thread pool and
+ * sstr_scratch_done() returns it, so a hot path that needs a temporary
+ * keeps reusing the same grown buffer instead of malloc/free each time.
  * ============================================================================ */
 
 #ifndef VSH_SAFE_STRING_H
@@ -13,12 +24,19 @@
 #include <stddef.h>
 #include <stdbool.h>
 
-#define SSTR_INIT_CAP 64
+#define SSTR_INIT_CAP    64
+#define SSTR_INLINE_CAP  48         /* Bytes held in the struct (sstr_init) */
+#define SSTR_SCRATCH_CAP 256        /* Initial size of a scratch string */
+#define SSTR_SCRATCH_MAX (64 * 1024) /* Larger ones are freed, not pooled */
+
+typedef struct Arena Arena;
 
 typedef struct SafeString {
     char  *data;   /* Null-terminated buffer */
     size_t len;    /* Current length (excluding null) */
     size_t cap;    /* Allocated capacity */
+    Arena *arena;  /* Buffer belongs to this arena (sstr_init_arena) */
+    char   inline_buf[SSTR_INLINE_CAP]; /* data, until it grows out */
 } SafeString;
 
 /* Create a new SafeString with given initial capacity */
@@ -33,6 +51,28 @@ SafeString *sstr_from_n(const char *data, size_t n);
 /* Free a SafeString */
 void sstr_free(SafeString *s);
 
+/* Initialise a caller-owned struct as an empty string held inline; no
+ * allocation happens until it needs SSTR_INLINE_CAP bytes or more. */
+void sstr_init(SafeString *s);
+
+/* Initialise a caller-owned struct with a buffer of at least cap bytes
+ * from arena. Growing uses arena_resize(), in place while the string is
+ * the last thing allocated. Returns false (s unusable) if out of memory. */
+bool sstr_init_arena(SafeString *s, Arena *arena, size_t cap);
+
+/* Release the buffer of an initialised struct (a no-op for arena ones) */
+void sstr_release(SafeString *s);
+
+/* An empty scratch string from this thread's pool (NULL if out of memory).
+ * Hand it back with sstr_scratch_done() and do not use it afterwards. */
+SafeString *sstr_scratch(void);
+
+/* Return a scratch string to the pool */
+void sstr_scratch_done(SafeString *s);
+
+/* Free this thread's pooled scratch strings */
+void sstr_scratch_drain(void);
+
 /* Ensure capacity for at least `needed` more bytes */
 bool sstr_ensure(SafeString *s, size_t needed);
 
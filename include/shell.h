@@ -7,47 +7,97 @@
 #define VSH_SHELL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <termios.h>
 #include <sys/types.h>
 
+#define VSH_VERSION_STRING "1.0.0"
+
 /* Forward declarations */
 typedef struct Arena Arena;
 typedef struct History History;
 typedef struct SafeString SafeString;
+typedef struct FuncTable FuncTable;
+typedef struct PathCache PathCache;
+typedef struct GitStatus GitStatus;
+typedef struct DirListing DirListing;
+typedef struct Prompt Prompt;
+typedef struct ExprCache ExprCache;
+typedef struct OutBuf OutBuf;
+typedef struct AliasTable AliasTable;
+typedef struct AstCache AstCache;
+typedef struct ShellStats ShellStats;
+typedef struct PipeTimer PipeTimer;
+typedef struct PipeBytes PipeBytes;
+typedef struct Startup Startup;
+typedef struct Cwd Cwd;
 
 /* ---- Environment Table -------------------------------------------------- */
-#define ENV_HASH_SIZE 256
+#define ENV_MIN_SLOTS    64     /* Initial slot count; always a power of two */
+#define ENV_INLINE_VALUE 24     /* Values shorter than this live in the entry */
+
+/* A variable name, interned: one copy per distinct name, hashed once */
+typedef struct EnvKey {
+    uint32_t hash;
+    uint32_t len;
+    char     name[];
+} EnvKey;
 
 typedef struct EnvEntry {
-    char *key;
-    char *value;
-    bool  exported;       /* Should be passed to child processes */
-    struct EnvEntry *next;
+    const EnvKey *key;
+    char         *value;        /* inline_value, or a heap block */
+    size_t        value_cap;    /* Heap block size; 0 while inline */
+    bool          exported;     /* Should be passed to child processes */
+    char          inline_value[ENV_INLINE_VALUE];
 } EnvEntry;
 
-typedef struct EnvTable {
-    EnvEntry *buckets[ENV_HASH_SIZE];
+/* Open-addressing slot (linear probing); entry == NULL means empty */
+typedef struct EnvSlot {
+    uint32_t  hash;
+    EnvEntry *entry;
+} EnvSlot;
+
+/* What a variable was before a function made it local */
+typedef struct EnvSaved {
+    const EnvKey *key;
+    char         *value;        /* malloc'd copy; NULL if it was unset */
+    bool          exported;
+} EnvSaved;
+
+/* One function call's local variables, or everything an in-process
+ * subshell changed */
+typedef struct EnvScope {
+    EnvSaved *saved;
     int       count;
-} EnvTable;
+    int       capacity;
+    bool      snapshot;     /* Saves every variable set, unset or exported */
+} EnvScope;
 
-/* ---- Alias Table -------------------------------------------------------- */
-#define ALIAS_HASH_SIZE 128
+typedef struct EnvTable {
+    EnvSlot      *slots;
+    int           capacity;     /* Number of slots */
+    int           count;        /* Variables set */
+    unsigned long path_serial;  /* Bumped whenever PATH is set or unset */
 
-typedef struct AliasEntry {
-    char *name;
-    char *value;
-    struct AliasEntry *next;
-} AliasEntry;
+    /* Interned names (insert-only open addressing) */
+    EnvKey      **keys;
+    int           key_capacity;
+    int           key_count;
 
-typedef struct AliasTable {
-    AliasEntry *buckets[ALIAS_HASH_SIZE];
-    int         count;
-} AliasTable;
+    /* Scope frames for function locals, innermost last */
+    EnvScope     *scopes;
+    int           depth;
+    int           scope_capacity;
+    int           snapshot;     /* Index + 1 of the innermost snapshot frame */
 
-/* Alias table operations */
-void alias_set(AliasTable *table, const char *name, const char *value);
-const char *alias_get(AliasTable *table, const char *name);
-bool alias_remove(AliasTable *table, const char *name);
+    /* Cached envp for exec: pointer array and KEY=VALUE strings share one
+     * block, rebuilt only when export_serial has moved past envp_serial. */
+    char        **envp;
+    unsigned long envp_serial;
+    unsigned long export_serial; /* Bumped when an exported variable changes */
+    int           export_count;  /* Exported entries */
+    size_t        export_bytes;  /* Sum of strlen("KEY=VALUE") + 1 over them */
+} EnvTable;
 
 /* ---- Job Control -------------------------------------------------------- */
 typedef enum JobState {
@@ -57,21 +107,43 @@ typedef enum JobState {
     JOB_KILLED
 } JobState;
 
+/* Entry of the pid -> job map; one per live process of a job */
+typedef struct JobPid {
+    pid_t          pid;
+    struct Job    *job;
+    int            index;     /* Slot in job->pids */
+    struct JobPid *next;      /* Bucket chain */
+} JobPid;
+
 typedef struct Job {
     int         id;           /* Job number [1], [2], ... */
     pid_t       pgid;         /* Process group ID */
-    pid_t      *pids;         /* Array of PIDs in pipeline */
+    pid_t      *pids;         /* Array of PIDs in pipeline (0 = reaped) */
     int         npids;        /* Number of processes */
+    int         nalive;       /* Processes not yet reaped */
+    int         status;       /* Wait status of the last stage */
+    JobPid     *links;        /* npids map entries, owned by the job */
     JobState    state;        /* Current state */
     char       *command;      /* Command string for display */
     bool        notified;     /* Has user been notified of completion? */
     bool        foreground;   /* Is this a foreground job? */
+    uint64_t    start_ns;     /* stats_now() when it was started */
+    uint64_t    end_ns;       /* When its last process was reaped */
+    uint64_t    cpu_us;       /* User + system time of reaped processes */
+    long        max_rss_kb;   /* Largest peak RSS among them */
+    uint64_t    sample_ns;    /* Last `jobs -s` look at it, 0 if none */
+    uint64_t    sample_cpu_us; /* Its CPU time (reaped + live) then */
     struct Job *next;
 } Job;
 
 typedef struct JobTable {
-    Job *head;
-    int  next_id;
+    Job     *head;
+    int      next_id;
+    JobPid **by_pid;          /* Hash buckets, power-of-two count */
+    int      nbuckets;
+    int      nlinks;          /* Live entries in by_pid */
+    int      event_fd;        /* signalfd for SIGCHLD, -1 if none */
+    int      pending;         /* Finished background jobs not yet reported */
 } JobTable;
 
 /* ---- Directory Stack ---------------------------------------------------- */
@@ -79,7 +151,7 @@ typedef struct JobTable {
 
 typedef struct DirStack {
     char *dirs[DIRSTACK_MAX];
-    int   top;
+    int   top;                  /* Entries in use */
 } DirStack;
 
 /* ---- Shell State -------------------------------------------------------- */
@@ -87,9 +159,25 @@ typedef struct Shell {
     Arena       *parse_arena;   /* Per-command arena (reset each iteration) */
     EnvTable    *env;           /* Environment variables */
     JobTable    *jobs;          /* Background jobs */
-    History     *history;       /* Command history */
+    History     *history;       /* Command history (interactive only; go
+                                 * through shell_history()) */
+    char        *history_file;  /* ~/.vsh_history it is loaded from */
     AliasTable  *aliases;       /* Alias table */
     DirStack    *dirstack;      /* pushd/popd stack */
+    Cwd         *cwd;           /* Logical working directory ($PWD) */
+    FuncTable   *functions;     /* Shell function definitions */
+    PathCache   *path_cache;    /* Command name -> executable path */
+    GitStatus   *git_status;    /* Prompt's repository state */
+    DirListing  *dir_listing;   /* Tab completion's directory cache */
+    Prompt      *prompt;        /* Cached prompt segments */
+    ExprCache   *expr_cache;    /* Compiled calc expressions */
+    AstCache    *ast_cache;     /* Parsed lines and sourced scripts */
+    OutBuf      *out;           /* Builtin stdout, flushed per command */
+    ShellStats  *stats;         /* Phase timings and counters */
+    PipeTimer   *timer;         /* Innermost running `time`, or NULL */
+    PipeBytes   *pipe_bytes;    /* Innermost pipeline counting its stages'
+                                 * bytes (set -o timing), or NULL */
+    Startup     *startup;       /* Background startup tasks, trace */
 
     int          last_status;   /* $? - exit status of last command */
     pid_t        shell_pid;     /* $$ - PID of the shell */
@@ -109,11 +197,35 @@ typedef struct Shell {
     /* Script execution state */
     int          script_depth;  /* Nesting depth for source/scripts */
     bool         in_function;   /* Currently executing a function? */
+    int          func_depth;    /* Nesting depth of function calls */
+    bool         returning;     /* 'return' ran: unwind to function/source */
+    bool         expand_error;  /* A $((...)) failed: the command it was
+                                 * expanded for is not run */
+
+    /* Options (set -o) */
+    bool         opt_lastpipe;  /* Last pipeline stage runs in the shell */
+    bool         opt_timing;    /* Print a phase breakdown after each line */
+    bool         opt_jobstats;  /* Finished-job notices give time and memory */
+    int          opt_pipe_size; /* Capacity of pipeline pipes (set -o
+                                 * pipesize=N); 0 for the kernel's default */
+    int          read_loop;     /* In a `while read` condition: read may
+                                 * buffer the pipe on stdin */
 } Shell;
 
-/* Initialize the shell */
+/* exit or return is in progress: stop running further commands */
+#define UNWINDING(shell) (!(shell)->running || (shell)->returning)
+
+/* Initialize the shell; interactive when stdin is a terminal */
 Shell *shell_init(int argc, char **argv);
 
+/* Initialize the shell in the given mode. A non-interactive shell (vsh -c,
+ * a script) gets no history, prompt, job control or ~/.vshrc. */
+Shell *shell_create(int argc, char **argv, bool interactive);
+
+/* The command history, once its background load has been joined. NULL in
+ * a non-interactive shell. */
+History *shell_history(Shell *shell);
+
 /* Destroy the shell and free all resources */
 void shell_destroy(Shell *shell);
 
@@ -123,15 +235,23 @@ int shell_run(Shell *shell);
 /* Execute a single line of input */
 int shell_exec_line(Shell *shell, const char *line);
 
+/* Lex, parse and run a whole script held in memory (name is for errors) */
+int shell_exec_script(Shell *shell, const char *src, const char *name);
+
+/* Run a script file through the compiled-script cache; -1 + errno if the
+ * file cannot be read */
+int shell_exec_file(Shell *shell, const char *path);
+
+/* Read a whole file / fd into a malloc'd NUL-terminated buffer (NULL+errno) */
+char *shell_read_file(const char *path, size_t *out_len);
+char *shell_read_fd(int fd, size_t *out_len);
+
 /* Enable raw terminal mode */
 void shell_enable_raw_mode(Shell *shell);
 
 /* Disable raw terminal mode (restore original) */
 void shell_disable_raw_mode(Shell *shell);
 
-/* Build the prompt string */
-char *shell_build_prompt(Shell *shell);
-
 /* Signal setup for the shell process */
 void shell_setup_signals(Shell *shell);
 
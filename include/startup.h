@@ -0,0 +1,60 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * startup.h - Background startup work and the startup trace
+ *
+ * An interactive shell has two pieces of setup nothing needs until the user
+ * acts: reading the history file and listing every PATH directory for the
+ * executable index. Both run on threads started by shell_init, and each is
+ * joined by whatever first touches its result (shell_history(),
+ * path_cache_index()), usually long after it has finished. On a single
+ * CPU they are deferred to that first use instead.
+ *
+ * A task still running when the shell forks is lost to the child: the
+ * thread does not exist there, and the structure it was filling may be
+ * half-built. startup_wait() tells the caller, who then drops the result.
+ *
+ * VSH_STARTUP_TRACE=1 prints a timestamp on stderr for each step of
+ * shell_init, for the wait on a task and for the first prompt.
+ * ============================================================================ */
+
+#ifndef VSH_STARTUP_H
+#define VSH_STARTUP_H
+
+#include <stdbool.h>
+
+typedef enum StartupTask {
+    STARTUP_HISTORY,        /* Load the history file */
+    STARTUP_PATH_INDEX,     /* List the PATH directories */
+    STARTUP_NTASKS
+} StartupTask;
+
+typedef struct Startup Startup;
+
+/* Work for a task; runs on its own thread with every signal blocked */
+typedef void (*StartupFn)(void *arg);
+
+/* Start the clock (and the trace, if VSH_STARTUP_TRACE is set) */
+Startup *startup_create(void);
+
+/* Join tasks still running (a forked child leaves them alone); a deferred
+ * task is dropped without running */
+void startup_destroy(Startup *st);
+
+/* Run fn(arg) as task in the background; with a single CPU, defer it to
+ * the first startup_wait(). Runs it right away if no thread can be
+ * started, and does nothing for a task already pending. */
+void startup_run(Startup *st, StartupTask task, StartupFn fn, void *arg);
+
+/* Is the task started (or deferred) but not yet waited for? Never blocks. */
+bool startup_pending(const Startup *st, StartupTask task);
+
+/* Wait for the task if it is running. False if its result must not be
+ * used: it was still running in the shell this process forked from.
+ * Cheap once the task is done, so callers wait on every access. */
+bool startup_wait(Startup *st, StartupTask task);
+
+/* One line of the trace: time since startup_create and since the last
+ * step, then what just finished. No-op unless tracing. */
+void startup_trace(Startup *st, const char *step);
+
+#endif /* VSH_STARTUP_H */
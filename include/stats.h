@@ -0,0 +1,143 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * stats.h - Per-phase latency histograms and shell counters
+ *
+ * Each phase of running a command (history expansion, lexing, alias
+ * expansion, parsing, word expansion, starting processes, waiting for
+ * them) is timed on the monotonic clock and folded into a log2 histogram,
+ * so a slow phase shows up as a count in the wrong bucket rather than as
+ * a guess. Phases nest where the work does: the expansion of a word that
+ * runs $(...) includes that command's spawn and wait.
+ *
+ * Timings of the current top-level line are also kept separately so that
+ * `set -o timing` can print a one-line breakdown once it finishes. The
+ * `shellstats` builtin prints the histograms next to arena and cache
+ * counters.
+ * ============================================================================ */
+
+#ifndef VSH_STATS_H
+#define VSH_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef enum StatPhase {
+    STAT_HISTORY,       /* History expansion and recording */
+    STAT_LEX,           /* Tokenizing a line or script */
+    STAT_ALIAS,         /* Alias expansion of the token stream */
+    STAT_PARSE,         /* Building the AST */
+    STAT_EXPAND,        /* Word expansion of a simple command (timed only
+                         * under set -o timing: it is often shorter than
+                         * the two clock reads around it) */
+    STAT_SPAWN,         /* PATH lookup and fork/posix_spawn of a child */
+    STAT_WAIT,          /* Waiting for a foreground job */
+    STAT_LINE,          /* A whole top-level line, end to end */
+    STAT_NPHASES
+} StatPhase;
+
+/* Bucket b counts samples in [2^b, 2^(b+1)) ns; the last one is open */
+#define STAT_BUCKETS 40
+
+typedef struct StatHist {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint32_t buckets[STAT_BUCKETS];
+} StatHist;
+
+typedef enum StatCacheKind {
+    STAT_CACHE_AST,     /* Parsed lines and sourced scripts */
+    STAT_CACHE_VSHC,    /* Compiled-script images on disk */
+    STAT_CACHE_PATH,    /* Command name -> path */
+    STAT_NCACHES
+} StatCacheKind;
+
+/* Hits and misses of one cache */
+typedef struct StatCache {
+    uint64_t hits;
+    uint64_t misses;
+} StatCache;
+
+typedef struct ShellStats {
+    StatHist  phase[STAT_NPHASES];
+    uint64_t  line_ns[STAT_NPHASES];  /* Current top-level line */
+    int       line_depth;             /* Nested shell_exec_line calls */
+
+    uint64_t  forks;                  /* fork() calls in the shell */
+    uint64_t  spawns;                 /* posix_spawn() children */
+
+    StatCache cache[STAT_NCACHES];
+} ShellStats;
+
+ShellStats *stats_create(void);
+void stats_destroy(ShellStats *stats);
+
+/* Clear every histogram and counter */
+void stats_reset(ShellStats *stats);
+
+/* Monotonic clock in nanoseconds */
+static inline uint64_t stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* Record ns spent in phase */
+void stats_record(ShellStats *stats, StatPhase phase, uint64_t ns);
+
+/* Record the time since start (a stats_now() value) in phase; returns now */
+static inline uint64_t stats_since(ShellStats *stats, StatPhase phase,
+                                   uint64_t start)
+{
+    uint64_t now = stats_now();
+    if (stats)
+        stats_record(stats, phase, now - start);
+    return now;
+}
+
+/* Count a lookup in one of the caches */
+static inline void stats_cache(ShellStats *stats, StatCacheKind kind, bool hit)
+{
+    if (stats) {
+        if (hit) stats->cache[kind].hits++;
+        else     stats->cache[kind].misses++;
+    }
+}
+
+/* Count a child started with fork() / posix_spawn() */
+static inline void stats_fork(ShellStats *stats)
+{
+    if (stats) stats->forks++;
+}
+
+static inline void stats_spawn(ShellStats *stats)
+{
+    if (stats) stats->spawns++;
+}
+
+/* A top-level line starts / ends. Returns true for the outermost one,
+ * whose per-line timings are then complete. */
+void stats_line_begin(ShellStats *stats);
+bool stats_line_end(ShellStats *stats);
+
+/* Approximate q-th quantile (0..1) of a histogram: the upper edge of the
+ * bucket it falls in, capped at the maximum seen */
+uint64_t stats_quantile(const StatHist *hist, double q);
+
+/* Short human form of a duration: "850ns", "12.4us", "3.1ms", "2.05s" */
+void stats_format_ns(char *buf, size_t size, uint64_t ns);
+
+/* Short human form of a byte count: "850B", "12.4K", "3.1M", "2.05G" */
+void stats_format_bytes(char *buf, size_t size, unsigned long long bytes);
+
+/* Name of a phase as printed ("history", "lex", ...) */
+const char *stats_phase_name(StatPhase phase);
+
+/* Print the breakdown of the line that just finished, on one line:
+ *   timing: line 1.2ms  history 3.1us  lex 2.0us  ...  wait 1.1ms */
+void stats_print_line(const ShellStats *stats, FILE *fp);
+
+#endif /* VSH_STATS_H */
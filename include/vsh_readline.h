@@ -23,14 +23,22 @@ typedef struct Shell Shell;
  * The caller must free() the returned string. */
 char *vsh_readline(Shell *shell, const char *prompt);
 
-/* Tab completion callback type */
+/* Candidates for the word at the cursor, sorted. A file name candidate
+ * leaves out the directory typed before it: "src/ma" gives "main.c", and
+ * skip is 4. */
 typedef struct Completions {
-    char **entries;
+    const char *const *entries;
     int    count;
+    size_t skip;        /* Bytes of the word the entries do not repeat */
+    bool   pending;     /* The directory is still being listed: retry once
+                         * dir_listing_fd() is readable */
+    const char **owned; /* entries, when not the directory listing's */
     int    capacity;
+    Arena *arena;       /* Command names */
 } Completions;
 
-/* Generate completions for the current word */
+/* Generate completions for the current word. File names stay valid until
+ * the next call. */
 Completions *vsh_complete(Shell *shell, const char *line, int cursor_pos);
 
 /* Free completions */
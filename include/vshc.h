@@ -0,0 +1,46 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * vshc.h - Compiled script cache (.vshc files)
+ *
+ * A sourced file's parsed Script is saved to the user's cache directory in
+ * a flat, offset-based image: every node, argv vector and redirection in
+ * one section, every string (deduplicated) in another. Loading maps the
+ * file privately and turns the offsets into pointers in place, so later
+ * shells run the rc file and its libraries without lexing or parsing.
+ *
+ * Images are keyed by the script's absolute path plus its device, inode,
+ * size and mtime, the vsh version and the in-memory AST layout; anything
+ * that does not match is ignored and rewritten on the next parse.
+ * ============================================================================ */
+
+#ifndef VSH_VSHC_H
+#define VSH_VSHC_H
+
+#include "parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#define VSHC_FORMAT   2
+#define VSHC_MAX_SIZE (16u << 20)   /* Larger images are not written */
+
+typedef struct VshcImage {
+    void         *map;
+    size_t        size;
+    const Script *script;       /* Points into map */
+    const char   *error;        /* Syntax error after the commands, or NULL */
+} VshcImage;
+
+/* The compiled image for path (whose stat is st), if an up-to-date one is
+ * cached. Returns NULL on any mismatch or damage. */
+VshcImage *vshc_load(const char *path, const struct stat *st);
+
+/* Unmap an image; nothing in it may be used afterwards */
+void vshc_unload(VshcImage *img);
+
+/* Save script (parsed from path as it was when st was taken). Best effort:
+ * returns false, with nothing written, if the cache directory is unusable. */
+bool vshc_store(const char *path, const struct stat *st,
+                const Script *script, const char *error);
+
+#endif /* VSH_VSHC_H */
@@ -14,12 +14,24 @@ typedef struct Arena Arena;
 bool wildcard_has_magic(const char *pattern);
 
 /* Match a pattern against a string (fnmatch-style)
- * Supports: *, ?, [abc], [a-z], [!abc] */
+ * Supports: *, ?, [abc], [a-z], [!abc]. A `**` component is only special
+ * to wildcard_expand(); here it matches like `*`. */
 bool wildcard_match(const char *pattern, const char *string);
 
-/* Expand a glob pattern into matching file paths.
+/* Directory listings kept between expansions (keyed by inode + mtime) */
+#define WILDCARD_DIR_CACHE 16
+
+/* Most threads a recursive `**` walk reads directories with */
+#define WILDCARD_WALK_THREADS 8
+
+/* Expand a glob pattern into matching file paths, sorted. A component that
+ * is exactly `**` matches zero or more directories, recursively; hidden
+ * directories are not descended into and symlinks are not followed.
  * Returns an array of arena-allocated strings, with *count set.
  * If no matches, returns NULL and *count = 0. */
 char **wildcard_expand(const char *pattern, Arena *arena, int *count);
 
+/* Drop all cached directory listings */
+void wildcard_cache_clear(void);
+
 #endif /* VSH_WILDCARD_H */
@@ -0,0 +1,365 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * alias.c - Alias table and token-level alias expansion
+ *
+ * Hash table (djb2 + separate chaining) mapping alias names to their text.
+ * Expansion works on the lexed token list rather than the raw line: a word
+ * in command position that names an alias is replaced by the alias body's
+ * tokens, which are lexed once per definition and kept with the entry.
+ * Quoting therefore behaves as it does everywhere else (a quoted word is
+ * never an alias), and the line is never rewritten or lexed twice.
+ * ============================================================================ */
+
+#include "alias.h"
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ---- Internal helpers --------------------------------------------------- */
+
+static unsigned int alias_hash(const char *str)
+{
+    unsigned int hash = 5381;
+    int c;
+    while ((c = (unsigned char)*str++))
+        hash = ((hash << 5) + hash) + (unsigned int)c;
+    return hash % ALIAS_HASH_SIZE;
+}
+
+/* Forget the lexed body; it is rebuilt on next use */
+static void entry_drop_cache(AliasEntry *e)
+{
+    if (e->cache)
+        arena_destroy(e->cache);
+    e->cache  = NULL;
+    e->tokens = NULL;
+}
+
+static void entry_free(AliasEntry *e)
+{
+    entry_drop_cache(e);
+    free(e->name);
+    free(e->value);
+    free(e);
+}
+
+static AliasEntry *entry_find(AliasTable *table, const char *name)
+{
+    for (AliasEntry *e = table->buckets[alias_hash(name)]; e; e = e->next) {
+        if (strcmp(e->name, name) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+/* The entry's body as tokens, lexing it on first use. A body that does not
+ * lex on its own is reported and left unexpanded. */
+static TokenList *entry_tokens(AliasEntry *e)
+{
+    if (e->tokens)
+        return e->tokens;
+
+    Arena *arena = arena_create_sized(1024);
+    if (!arena)
+        return NULL;
+
+    Lexer lex;
+    lexer_init(&lex, e->value, arena);
+    TokenList *list = lexer_tokenize(&lex);
+    if (!list || lex.error) {
+        fprintf(stderr, "vsh: alias: %s: %s\n", e->name,
+                lex.error ? lex.error : "out of memory");
+        arena_destroy(arena);
+        return NULL;
+    }
+
+    e->cache  = arena;
+    e->tokens = list;
+    return list;
+}
+
+/* ---- Public API: table -------------------------------------------------- */
+
+AliasTable *alias_table_create(void)
+{
+    return calloc(1, sizeof(AliasTable));
+}
+
+void alias_table_destroy(AliasTable *table)
+{
+    if (!table)
+        return;
+
+    for (int i = 0; i < ALIAS_HASH_SIZE; i++) {
+        AliasEntry *e = table->buckets[i];
+        while (e) {
+            AliasEntry *next = e->next;
+            entry_free(e);
+            e = next;
+        }
+    }
+    free(table);
+}
+
+void alias_set(AliasTable *table, const char *name, const char *value)
+{
+    AliasEntry *e = entry_find(table, name);
+    table->serial++;
+
+    /* Existing alias: replace the value and its lexed form */
+    if (e) {
+        char *copy = strdup(value);
+        if (!copy)
+            return;
+        free(e->value);
+        e->value = copy;
+        entry_drop_cache(e);
+        return;
+    }
+
+    AliasEntry *entry = calloc(1, sizeof(AliasEntry));
+    if (!entry)
+        return;
+
+    entry->name  = strdup(name);
+    entry->value = strdup(value);
+    if (!entry->name || !entry->value) {
+        entry_free(entry);
+        return;
+    }
+
+    unsigned int h = alias_hash(name);
+    entry->next = table->buckets[h];
+    table->buckets[h] = entry;
+    table->count++;
+}
+
+const char *alias_get(AliasTable *table, const char *name)
+{
+    AliasEntry *e = entry_find(table, name);
+    return e ? e->value : NULL;
+}
+
+bool alias_remove(AliasTable *table, const char *name)
+{
+    AliasEntry **link = &table->buckets[alias_hash(name)];
+
+    for (; *link; link = &(*link)->next) {
+        AliasEntry *e = *link;
+        if (strcmp(e->name, name) == 0) {
+            *link = e->next;
+            entry_free(e);
+            table->count--;
+            table->serial++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* ---- Token-level expansion ---------------------------------------------- */
+
+typedef struct AliasExpander {
+    AliasTable       *table;
+    Arena            *arena;        /* The line's parse arena */
+    const TokenList  *src;          /* The line as lexed */
+    int               src_pos;      /* Index of the token being processed */
+    TokenList        *out;          /* NULL until the first expansion */
+    const AliasEntry *active[ALIAS_DEPTH_MAX];
+    int               depth;
+    int               line, col;    /* Where the outermost alias word was */
+    bool              cmd_pos;      /* Next word starts a simple command */
+    bool              redir_target; /* Next word is a redirection target */
+    bool              check_next;   /* Last alias body ended in a blank */
+} AliasExpander;
+
+static bool out_add(AliasExpander *ax, Token tok)
+{
+    TokenList *list = ax->out;
+    if (list->count >= list->capacity) {
+        int cap = list->capacity * 2;
+        Token *tokens = arena_resize(ax->arena, list->tokens,
+                                     sizeof(Token) * (size_t)list->capacity,
+                                     sizeof(Token) * (size_t)cap);
+        if (!tokens)
+            return false;
+        list->tokens   = tokens;
+        list->capacity = cap;
+    }
+    list->tokens[list->count++] = tok;
+    return true;
+}
+
+/* Switch to building a new list: everything before the current source
+ * token passes through unchanged */
+static bool start_output(AliasExpander *ax)
+{
+    if (ax->out)
+        return true;
+
+    TokenList *list = arena_alloc(ax->arena, sizeof(TokenList));
+    if (!list)
+        return false;
+    list->capacity = ax->src->count * 2 + 16;
+    list->count    = ax->src_pos;
+    list->tokens   = arena_alloc(ax->arena,
+                                 sizeof(Token) * (size_t)list->capacity);
+    if (!list->tokens)
+        return false;
+    memcpy(list->tokens, ax->src->tokens, sizeof(Token) * (size_t)ax->src_pos);
+    ax->out = list;
+    return true;
+}
+
+/* Append tok to the output. Tokens from an alias body are copied into the
+ * parse arena, so the AST outlives a redefinition during execution. */
+static bool emit(AliasExpander *ax, const Token *tok, bool from_alias)
+{
+    if (!ax->out)
+        return true;
+    if (!from_alias)
+        return out_add(ax, *tok);
+
+    Token copy = *tok;
+    copy.line = ax->line;
+    copy.col  = ax->col;
+    if (tok->value) {
+        copy.value = arena_strdup(ax->arena, tok->value);
+        if (!copy.value)
+            return false;
+    }
+    if (tok->heredoc) {
+        HereDoc *hd = arena_alloc(ax->arena, sizeof(HereDoc));
+        if (!hd)
+            return false;
+        *hd = *tok->heredoc;
+        hd->delim = arena_strdup(ax->arena, tok->heredoc->delim);
+        hd->body  = arena_strdup(ax->arena, tok->heredoc->body
+                                                ? tok->heredoc->body : "");
+        hd->next  = NULL;
+        copy.heredoc = hd;
+    }
+    return out_add(ax, copy);
+}
+
+/* Update the command-position state after tok has been emitted */
+static void track_position(AliasExpander *ax, const Token *tok)
+{
+    switch (tok->type) {
+    case TOK_WORD:
+        if (ax->redir_target)
+            ax->redir_target = false;
+        else
+            ax->cmd_pos = false;
+        break;
+    case TOK_REDIR_IN:
+    case TOK_REDIR_OUT:
+    case TOK_REDIR_APPEND:
+    case TOK_REDIR_HERESTR:
+    case TOK_REDIR_DUP:
+        ax->redir_target = true;     /* Here-doc delimiters are consumed */
+        break;
+    case TOK_REDIR_HEREDOC:
+        break;
+    case TOK_PIPE:
+    case TOK_AND:
+    case TOK_OR:
+    case TOK_SEMI:
+    case TOK_AMP:
+    case TOK_NEWLINE:
+    case TOK_LPAREN:
+    case TOK_LBRACE:
+    case TOK_BANG:
+    case TOK_TIME:
+    case TOK_IF:
+    case TOK_THEN:
+    case TOK_ELIF:
+    case TOK_ELSE:
+    case TOK_WHILE:
+    case TOK_DO:
+        ax->cmd_pos = true;
+        ax->redir_target = false;
+        break;
+    default:
+        ax->cmd_pos = false;
+        ax->redir_target = false;
+        break;
+    }
+}
+
+static bool is_active(const AliasExpander *ax, const AliasEntry *e)
+{
+    for (int i = 0; i < ax->depth; i++) {
+        if (ax->active[i] == e)
+            return true;
+    }
+    return false;
+}
+
+static bool process(AliasExpander *ax, const Token *tok, bool from_alias);
+
+/* Replace the current word with alias e's body */
+static bool splice(AliasExpander *ax, const Token *word, AliasEntry *e,
+                   const TokenList *body)
+{
+    if (!start_output(ax))
+        return false;
+    if (ax->depth == 0) {
+        ax->line = word->line;
+        ax->col  = word->col;
+    }
+
+    ax->active[ax->depth++] = e;
+    ax->cmd_pos      = true;
+    ax->redir_target = false;
+    for (int i = 0; i < body->count && body->tokens[i].type != TOK_EOF; i++) {
+        if (!process(ax, &body->tokens[i], true))
+            return false;
+    }
+    ax->depth--;
+
+    size_t len = strlen(e->value);
+    if (len > 0 && (e->value[len - 1] == ' ' || e->value[len - 1] == '\t'))
+        ax->check_next = true;
+    return true;
+}
+
+static bool process(AliasExpander *ax, const Token *tok, bool from_alias)
+{
+    bool candidate = tok->type == TOK_WORD && !tok->quoted && tok->value &&
+                     ((ax->cmd_pos && !ax->redir_target) || ax->check_next);
+    ax->check_next = false;
+
+    if (candidate && ax->depth < ALIAS_DEPTH_MAX) {
+        AliasEntry *e = entry_find(ax->table, tok->value);
+        if (e && !is_active(ax, e)) {
+            TokenList *body = entry_tokens(e);
+            if (body)
+                return splice(ax, tok, e, body);
+        }
+    }
+
+    track_position(ax, tok);
+    return emit(ax, tok, from_alias);
+}
+
+TokenList *alias_expand(AliasTable *table, TokenList *tokens, Arena *arena)
+{
+    if (!table || table->count == 0 || !tokens)
+        return tokens;
+
+    AliasExpander ax = {
+        .table   = table,
+        .arena   = arena,
+        .src     = tokens,
+        .cmd_pos = true,
+    };
+
+    for (ax.src_pos = 0; ax.src_pos < tokens->count; ax.src_pos++) {
+        if (!process(&ax, &tokens->tokens[ax.src_pos], false))
+            return NULL;
+    }
+    return ax.out ? ax.out : tokens;
+}
@@ -5,6 +5,12 @@
  * Page-based bump allocator. Each page is a contiguous block with a flexible
  * array member. Allocations bump a pointer forward; deallocation frees all
  * pages at once, eliminating per-object bookkeeping and memory leaks.
+ *
+ * Pages released by arena_reset()/arena_rewind() are parked on a per-arena
+ * free list (bounded by ARENA_RETAIN_MAX) and handed out again before
+ * malloc is tried, so a workload that spills the same page chain on every
+ * prompt stops re-mallocing it. Chains grow geometrically: the Nth page of a
+ * chain is page_size << (N-1), capped at ARENA_PAGE_MAX.
  * ============================================================================ */
 
 #include "arena.h"
@@ -34,6 +40,52 @@ static ArenaPage *page_new(size_t min_size)
     return page;
 }
 
+/* Size for the next page of a chain that already holds `pages` pages */
+static size_t growth_size(const Arena *arena, size_t pages)
+{
+    size_t size = arena->page_size;
+    for (size_t i = 1; i < pages && size * 2 <= ARENA_PAGE_MAX; i++)
+        size *= 2;
+    return size;
+}
+
+/* Take a page with at least min_size bytes from the free list, or malloc */
+static ArenaPage *page_acquire(Arena *arena, size_t min_size, size_t want)
+{
+    for (ArenaPage **link = &arena->free_pages; *link; link = &(*link)->next) {
+        ArenaPage *page = *link;
+        if (page->size >= min_size) {
+            *link = page->next;
+            arena->free_bytes -= page->size;
+            arena->pages_reused++;
+            page->next = NULL;
+            page->used = 0;
+            return page;
+        }
+    }
+
+    ArenaPage *page = page_new(want > min_size ? want : min_size);
+    if (page)
+        arena->page_mallocs++;
+    return page;
+}
+
+/* Give a chain of pages back: keep what fits under the cap, free the rest */
+static void pages_release(Arena *arena, ArenaPage *page)
+{
+    while (page) {
+        ArenaPage *next = page->next;
+        if (arena->free_bytes + page->size <= ARENA_RETAIN_MAX) {
+            page->next        = arena->free_pages;
+            arena->free_pages = page;
+            arena->free_bytes += page->size;
+        } else {
+            free(page);
+        }
+        page = next;
+    }
+}
+
 /* ---- Public API --------------------------------------------------------- */
 
 Arena *arena_create(void)
@@ -58,6 +110,11 @@ Arena *arena_create_sized(size_t page_size)
     arena->page_size       = page_size;
     arena->total_allocated = 0;
     arena->total_pages     = 1;
+    arena->free_pages      = NULL;
+    arena->free_bytes      = 0;
+    arena->peak_bytes      = 0;
+    arena->page_mallocs    = 1;
+    arena->pages_reused    = 0;
     return arena;
 }
 
@@ -74,15 +131,15 @@ void *arena_alloc(Arena *arena, size_t size)
         void *ptr = page->data + page->used;
         page->used += aligned;
         arena->total_allocated += aligned;
+        if (arena->total_allocated > arena->peak_bytes)
+            arena->peak_bytes = arena->total_allocated;
         return ptr;
     }
 
-    /* Need a new page -- at least page_size, but large enough for this alloc */
-    size_t new_size = arena->page_size;
-    if (aligned > new_size)
-        new_size = aligned;
-
-    ArenaPage *new_page = page_new(new_size);
+    /* Need a new page -- the next geometric size, but large enough for
+     * this alloc; a recycled page of sufficient size is preferred */
+    ArenaPage *new_page = page_acquire(arena, aligned,
+                                       growth_size(arena, arena->total_pages + 1));
     if (!new_page)
         return NULL;
 
@@ -95,6 +152,8 @@ void *arena_alloc(Arena *arena, size_t size)
     void *ptr = new_page->data;
     new_page->used = aligned;
     arena->total_allocated += aligned;
+    if (arena->total_allocated > arena->peak_bytes)
+        arena->peak_bytes = arena->total_allocated;
     return ptr;
 }
 
@@ -140,6 +199,113 @@ char *arena_strndup(Arena *arena, const char *str, size_t n)
     return dup;
 }
 
+void *arena_resize(Arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+    if (!ptr)
+        return arena_alloc(arena, new_size);
+
+    ArenaPage *page = arena->current;
+    size_t old_aligned = align_up(old_size);
+    size_t new_aligned = align_up(new_size);
+    if ((char *)ptr + old_aligned == page->data + page->used &&
+        page->used - old_aligned + new_aligned <= page->size) {
+        page->used = page->used - old_aligned + new_aligned;
+        arena->total_allocated = arena->total_allocated - old_aligned +
+                                 new_aligned;
+        if (arena->total_allocated > arena->peak_bytes)
+            arena->peak_bytes = arena->total_allocated;
+        return ptr;
+    }
+    if (new_size <= old_size)
+        return ptr;
+
+    void *copy = arena_alloc(arena, new_size);
+    if (copy)
+        memcpy(copy, ptr, old_size);
+    return copy;
+}
+
+/* ---- Strings built in place --------------------------------------------- */
+
+void astr_init(ArenaString *s, Arena *arena, size_t cap)
+{
+    s->arena = arena;
+    s->cap   = cap > 0 ? cap : 1;
+    s->data  = arena_alloc(arena, s->cap);
+    s->len   = 0;
+    if (!s->data)
+        s->cap = 0;
+}
+
+void astr_append_n(ArenaString *s, const char *str, size_t n)
+{
+    if (s->len + n + 1 > s->cap) {
+        size_t cap = s->cap * 2;
+        if (cap < s->len + n + 1)
+            cap = s->len + n + 1;
+        char *data = arena_resize(s->arena, s->data, s->cap, cap);
+        if (!data)
+            return;
+        s->data = data;
+        s->cap  = cap;
+    }
+    memcpy(s->data + s->len, str, n);
+    s->len += n;
+}
+
+void astr_append(ArenaString *s, const char *str)
+{
+    astr_append_n(s, str, strlen(str));
+}
+
+void astr_append_char(ArenaString *s, char c)
+{
+    if (s->len + 2 <= s->cap)
+        s->data[s->len++] = c;
+    else
+        astr_append_n(s, &c, 1);
+}
+
+char *astr_finish(ArenaString *s)
+{
+    if (!s->data)
+        return NULL;
+    s->data[s->len] = '\0';
+    s->data = arena_resize(s->arena, s->data, s->cap, s->len + 1);
+    s->cap  = s->len + 1;
+    return s->data;
+}
+
+ArenaMark arena_mark(const Arena *arena)
+{
+    ArenaMark mark = {0};
+    if (!arena)
+        return mark;
+
+    mark.page            = arena->current;
+    mark.used            = arena->current->used;
+    mark.total_allocated = arena->total_allocated;
+    mark.total_pages     = arena->total_pages;
+    return mark;
+}
+
+void arena_rewind(Arena *arena, ArenaMark mark)
+{
+    if (!arena || !mark.page)
+        return;
+
+    /* New pages are always linked after the current one, so everything
+     * past the marked page was allocated after the mark. */
+    pages_release(arena, mark.page->next);
+
+    mark.page->next = NULL;
+    mark.page->used = mark.used;
+
+    arena->current         = mark.page;
+    arena->total_allocated = mark.total_allocated;
+    arena->total_pages     = mark.total_pages;
+}
+
 void arena_reset(Arena *arena)
 {
     if (!arena)
@@ -147,13 +313,8 @@ void arena_reset(Arena *arena)
 
     ArenaPage *head = arena->head;
 
-    /* Free every page after the first */
-    ArenaPage *page = head->next;
-    while (page) {
-        ArenaPage *next = page->next;
-        free(page);
-        page = next;
-    }
+    /* Recycle every page after the first */
+    pages_release(arena, head->next);
 
     /* Reset the first page */
     head->next = NULL;
@@ -169,12 +330,15 @@ void arena_destroy(Arena *arena)
     if (!arena)
         return;
 
-    /* Free all pages */
-    ArenaPage *page = arena->head;
-    while (page) {
-        ArenaPage *next = page->next;
-        free(page);
-        page = next;
+    /* Free all pages, live and retained */
+    ArenaPage *lists[2] = { arena->head, arena->free_pages };
+    for (int i = 0; i < 2; i++) {
+        ArenaPage *page = lists[i];
+        while (page) {
+            ArenaPage *next = page->next;
+            free(page);
+            page = next;
+        }
     }
 
     free(arena);
@@ -190,3 +354,23 @@ size_t arena_bytes_used(const Arena *arena)
         total += page->used;
     return total;
 }
+
+void arena_stats(const Arena *arena, ArenaStats *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!arena)
+        return;
+
+    for (const ArenaPage *page = arena->head; page; page = page->next) {
+        out->bytes_used += page->used;
+        out->capacity   += page->size;
+        out->pages++;
+    }
+    for (const ArenaPage *page = arena->free_pages; page; page = page->next)
+        out->retained_pages++;
+
+    out->peak_bytes     = arena->peak_bytes;
+    out->retained_bytes = arena->free_bytes;
+    out->page_mallocs   = arena->page_mallocs;
+    out->pages_reused   = arena->pages_reused;
+}
@@ -0,0 +1,173 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * ast_cache.c - Parsed-AST cache for repeated command lines and scripts
+ *
+ * A small fully associative table with LRU replacement. Entries are keyed
+ * by kind, a 64-bit FNV-1a hash of the text and the text itself; line
+ * entries also record the alias table generation, since aliases are
+ * applied before parsing. The cached AST is a deep copy (ast_clone) in an
+ * arena owned by the entry, released in one shot on eviction. Entries that
+ * are executing are pinned, so a nested source cannot free the AST that is
+ * running it.
+ * ============================================================================ */
+
+#include "ast_cache.h"
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct AstCache {
+    AstCacheEntry entries[AST_CACHE_SLOTS];
+    unsigned long clock;
+};
+
+/* ---- Internal helpers --------------------------------------------------- */
+
+static uint64_t text_hash(const char *s, size_t len)
+{
+    uint64_t h = 14695981039346656037ull;   /* FNV-1a */
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)s[i]) * 1099511628211ull;
+    return h;
+}
+
+static void entry_clear(AstCacheEntry *e)
+{
+    if (e->arena)
+        arena_destroy(e->arena);
+    memset(e, 0, sizeof(*e));
+}
+
+/* An empty slot, else the least recently used unpinned one, else NULL */
+static AstCacheEntry *pick_victim(AstCache *cache)
+{
+    AstCacheEntry *victim = NULL;
+    for (int i = 0; i < AST_CACHE_SLOTS; i++) {
+        AstCacheEntry *e = &cache->entries[i];
+        if (!e->arena)
+            return e;
+        if (e->active == 0 && (!victim || e->used < victim->used))
+            victim = e;
+    }
+    return victim;
+}
+
+/* Claim a slot for text and give it an arena holding a copy of the text */
+static AstCacheEntry *entry_new(AstCache *cache, AstKind kind,
+                                const char *text, size_t len,
+                                unsigned long alias_serial)
+{
+    if (!cache || len > AST_CACHE_TEXT_MAX)
+        return NULL;
+
+    AstCacheEntry *e = pick_victim(cache);
+    if (!e)
+        return NULL;
+    entry_clear(e);
+
+    e->arena = arena_create_sized(1024);
+    if (!e->arena)
+        return NULL;
+    e->text = arena_strndup(e->arena, text, len);
+    if (!e->text) {
+        entry_clear(e);
+        return NULL;
+    }
+    e->kind         = kind;
+    e->hash         = text_hash(text, len);
+    e->len          = len;
+    e->alias_serial = alias_serial;
+    e->used         = ++cache->clock;
+    return e;
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+AstCache *ast_cache_create(void)
+{
+    return calloc(1, sizeof(AstCache));
+}
+
+void ast_cache_destroy(AstCache *cache)
+{
+    if (!cache)
+        return;
+    for (int i = 0; i < AST_CACHE_SLOTS; i++)
+        entry_clear(&cache->entries[i]);
+    free(cache);
+}
+
+AstCacheEntry *ast_cache_find(AstCache *cache, AstKind kind,
+                              const char *text, size_t len,
+                              unsigned long alias_serial)
+{
+    if (!cache || len > AST_CACHE_TEXT_MAX)
+        return NULL;
+
+    uint64_t h = text_hash(text, len);
+    for (int i = 0; i < AST_CACHE_SLOTS; i++) {
+        AstCacheEntry *e = &cache->entries[i];
+        if (!e->arena || e->kind != kind || e->hash != h || e->len != len ||
+            memcmp(e->text, text, len) != 0)
+            continue;
+
+        if (kind == AST_LINE && e->alias_serial != alias_serial) {
+            if (e->active == 0)
+                entry_clear(e);
+            return NULL;
+        }
+        e->used = ++cache->clock;
+        e->active++;
+        return e;
+    }
+    return NULL;
+}
+
+void ast_cache_release(AstCacheEntry *entry)
+{
+    if (entry && entry->active > 0)
+        entry->active--;
+}
+
+void ast_cache_add_line(AstCache *cache, const char *text, size_t len,
+                        unsigned long alias_serial, const ASTNode *ast)
+{
+    AstCacheEntry *e = entry_new(cache, AST_LINE, text, len, alias_serial);
+    if (!e)
+        return;
+
+    e->ast = ast_clone(e->arena, ast);
+    if (!e->ast)
+        entry_clear(e);
+}
+
+void ast_cache_add_script(AstCache *cache, const char *text, size_t len,
+                          const Script *script, const char *error)
+{
+    AstCacheEntry *e = entry_new(cache, AST_SCRIPT, text, len, 0);
+    if (!e)
+        return;
+
+    Script *copy = arena_alloc(e->arena, sizeof(Script));
+    if (!copy)
+        goto fail;
+    copy->count    = script->count;
+    copy->commands = arena_alloc(e->arena,
+                                 sizeof(ASTNode *) * (size_t)(script->count + 1));
+    if (!copy->commands)
+        goto fail;
+    for (int i = 0; i < script->count; i++) {
+        copy->commands[i] = ast_clone(e->arena, script->commands[i]);
+        if (!copy->commands[i] && script->commands[i])
+            goto fail;
+    }
+    if (error && !(e->error = arena_strdup(e->arena, error)))
+        goto fail;
+
+    e->script = copy;
+    return;
+
+fail:
+    entry_clear(e);
+}
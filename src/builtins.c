@@ -5,47 +5,99 @@
 
 #include "builtins.h"
 #include "shell.h"
+#include "path_cache.h"
+#include "output.h"
+#include <errno.h>
+#include <signal.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
 
 static const BuiltinEntry builtin_table[] = {
-    {"cd",       builtin_cd,       "cd [dir]",           "Change the current directory"},
+    {"cd",       builtin_cd,       "cd [-L|-P] [dir]",    "Change the current directory"},
     {"exit",     builtin_exit,     "exit [N]",            "Exit the shell with status N"},
     {"help",     builtin_help,     "help [command]",      "Display help for builtins"},
     {"export",   builtin_export,   "export [VAR=value]",  "Set/display exported variables"},
-    {"unset",    builtin_unset,    "unset VAR",           "Unset a variable"},
+    {"unset",    builtin_unset,    "unset [-f] NAME",     "Unset a variable or function"},
     {"alias",    builtin_alias,    "alias [name=value]",  "Define or display aliases"},
     {"unalias",  builtin_unalias,  "unalias name",        "Remove an alias"},
     {"history",  builtin_history,  "history [-c] [-n N]", "Display or manage command history"},
-    {"jobs",     builtin_jobs,     "jobs",                "List active jobs"},
+    {"jobs",     builtin_jobs,     "jobs [-s]",           "List active jobs"},
     {"fg",       builtin_fg,       "fg [%N]",             "Resume job in foreground"},
     {"bg",       builtin_bg,       "bg [%N]",             "Resume job in background"},
+    {"wait",     builtin_wait,     "wait [%N|PID ...]",   "Wait for background jobs to finish"},
+    {"parallel", builtin_parallel, "parallel [-j N] CMD ::: ITEMS", "Run CMD over ITEMS, N at a time"},
     {"source",   builtin_source,   "source FILE",         "Execute commands from FILE"},
     {".",        builtin_source,   ". FILE",              "Execute commands from FILE"},
-    {"sysinfo",  builtin_sysinfo,  "sysinfo",             "Display system information dashboard"},
-    {"httpfetch",builtin_httpfetch,"httpfetch URL",        "Fetch content from a URL via HTTP"},
-    {"calc",     builtin_calc,     "calc EXPR",           "Evaluate a math expression"},
-    {"watch",    builtin_watch,    "watch [-n SEC] CMD",  "Execute CMD repeatedly"},
+    {"sysinfo",  builtin_sysinfo,  "sysinfo [-w SEC] [-c N] [--line]", "Display system information dashboard"},
+    {"httpfetch",builtin_httpfetch,"httpfetch [-o FILE] URL...", "Fetch content from URLs via HTTP"},
+    {"calc",     builtin_calc,     "calc [-s] [-r V=A..B | -i V] EXPR", "Evaluate a math expression"},
+    {"watch",    builtin_watch,    "watch [-n SEC] [-d] CMD", "Execute CMD repeatedly"},
     {"pushd",    builtin_pushd,    "pushd [dir]",         "Push directory onto stack"},
     {"popd",     builtin_popd,     "popd",                "Pop directory from stack"},
     {"dirs",     builtin_dirs,     "dirs",                "Display directory stack"},
     {"colors",   builtin_colors,   "colors",              "Display terminal color palette"},
-    {"pwd",      builtin_pwd,      "pwd",                 "Print working directory"},
+    {"pwd",      builtin_pwd,      "pwd [-L|-P]",         "Print working directory"},
     {"echo",     builtin_echo,     "echo [args...]",      "Display text"},
     {"type",     builtin_type,     "type NAME",           "Describe a command"},
+    {"hash",     builtin_hash,     "hash [-r] [NAME]",    "Remember or list command paths"},
     {"return",   builtin_return_cmd,"return [N]",         "Return from a function"},
     {"local",    builtin_local,    "local VAR=value",     "Declare a local variable"},
+    {"read",     builtin_read,     "read [-r] [-d D] [-n N] [VAR...]", "Read a line into variables"},
+    {"set",      builtin_set,      "set [-o|+o] [NAME]",  "Set or show shell options"},
+    {"shellstats",builtin_shellstats,"shellstats [-r]",   "Show phase timings and cache hit rates"},
+    {"cat",      builtin_cat,      "cat [-u] [FILE...]",  "Concatenate files to stdout"},
+    {"tee",      builtin_tee,      "tee [-ai] [FILE...]", "Copy stdin to stdout and files"},
     {NULL, NULL, NULL, NULL}
 };
 
+/* ---- Name index ---------------------------------------------------------
+ * Open-addressed table of indices into builtin_table, keyed on the length
+ * and the first and last characters. Built once; a lookup is a couple of
+ * byte compares plus one memcmp on a length match. */
+
+#define BUILTIN_SLOTS 128   /* Power of two, well above the table size */
+
+static unsigned char builtin_index[BUILTIN_SLOTS];  /* entry + 1, 0 = empty */
+static size_t        builtin_len[BUILTIN_SLOTS];
+static bool          index_built = false;
+
+static unsigned int name_hash(const char *name, size_t len) {
+    unsigned char first = (unsigned char)name[0];
+    unsigned char last  = (unsigned char)name[len - 1];
+    return ((unsigned int)len * 31u + first * 7u + last) & (BUILTIN_SLOTS - 1);
+}
+
+static void build_index(void) {
+    for (int i = 0; builtin_table[i].name; i++) {
+        size_t len = strlen(builtin_table[i].name);
+        unsigned int h = name_hash(builtin_table[i].name, len);
+        while (builtin_index[h])
+            h = (h + 1) & (BUILTIN_SLOTS - 1);
+        builtin_index[h] = (unsigned char)(i + 1);
+        builtin_len[h]   = len;
+    }
+    index_built = true;
+}
+
 void builtins_init(void) {
-    /* Table is statically initialized, nothing to do currently */
+    if (!index_built)
+        build_index();
 }
 
 const BuiltinEntry *builtins_lookup(const char *name) {
-    for (int i = 0; builtin_table[i].name; i++) {
-        if (strcmp(builtin_table[i].name, name) == 0)
-            return &builtin_table[i];
+    if (!name || !name[0])
+        return NULL;
+    if (!index_built)
+        build_index();
+
+    size_t len = strlen(name);
+    for (unsigned int h = name_hash(name, len); builtin_index[h];
+         h = (h + 1) & (BUILTIN_SLOTS - 1)) {
+        const BuiltinEntry *e = &builtin_table[builtin_index[h] - 1];
+        if (builtin_len[h] == len && e->name[0] == name[0] &&
+            memcmp(e->name, name, len) == 0)
+            return e;
     }
     return NULL;
 }
@@ -54,10 +106,44 @@ bool builtins_is_builtin(const char *name) {
     return builtins_lookup(name) != NULL;
 }
 
+bool builtins_is_pure(const BuiltinEntry *b) {
+    BuiltinHandler h = b->handler;
+    return h == builtin_echo || h == builtin_pwd || h == builtin_type ||
+           h == builtin_calc || h == builtin_dirs || h == builtin_jobs ||
+           h == builtin_help || h == builtin_colors || h == builtin_sysinfo;
+}
+
+bool builtins_is_contained(const BuiltinEntry *b) {
+    BuiltinHandler h = b->handler;
+    return builtins_is_pure(b) || builtins_is_copy(b) ||
+           h == builtin_cd || h == builtin_pushd || h == builtin_popd ||
+           h == builtin_export || h == builtin_unset || h == builtin_local ||
+           h == builtin_read;
+}
+
+bool builtins_is_copy(const BuiltinEntry *b) {
+    return b->handler == builtin_cat || b->handler == builtin_tee;
+}
+
+bool builtins_defers(Shell *shell, const BuiltinEntry *b, int argc, char **argv) {
+    return builtins_is_copy(b) &&
+           !builtin_copy_accepts(argc, argv, STDIN_FILENO, STDOUT_FILENO) &&
+           path_cache_lookup(shell, argv[0]) != NULL;
+}
+
+int builtins_finish(Shell *shell, const char *name, int status) {
+    if (out_flush(shell->out) == 0 || status != 0)
+        return status;
+    if (errno == EPIPE)
+        return 128 + SIGPIPE;
+    fprintf(stderr, "vsh: %s: write error: %s\n", name, strerror(errno));
+    return 1;
+}
+
 int builtins_execute(Shell *shell, int argc, char **argv) {
     const BuiltinEntry *entry = builtins_lookup(argv[0]);
     if (!entry) return -1;
-    return entry->handler(shell, argc, argv);
+    return builtins_finish(shell, argv[0], entry->handler(shell, argc, argv));
 }
 
 const BuiltinEntry *builtins_table(int *count) {
@@ -1,300 +1,244 @@
 /* ============================================================================
  * vsh - Vanguard Shell
- * builtins/calc.c - Math expression evaluator with recursive descent parsing
+ * builtins/calc.c - Math expression evaluator
+ *
+ * Expressions are compiled to bytecode once and cached by the shell (see
+ * expr.c), so calc in a loop only pays for evaluation. Names other than
+ * constants and functions are shell variables. With -r or -i the same
+ * program is evaluated over a whole series of inputs a block at a time.
  * ============================================================================ */
 
 #include "builtins.h"
 #include "shell.h"
+#include "output.h"
+#include "env.h"
+#include "expr.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
-#include <ctype.h>
-#include <float.h>
-
-/* ---- Token types -------------------------------------------------------- */
-
-typedef enum {
-    TOK_NUM,
-    TOK_PLUS,
-    TOK_MINUS,
-    TOK_STAR,
-    TOK_SLASH,
-    TOK_PERCENT,
-    TOK_POWER,    /* ** or ^ */
-    TOK_LPAREN,
-    TOK_RPAREN,
-    TOK_IDENT,    /* function name or constant */
-    TOK_END,
-    TOK_ERROR
-} TokenType;
-
-typedef struct {
-    TokenType type;
-    double    num;
-    char      ident[32];
-} Token;
-
-/* ---- Parser state ------------------------------------------------------- */
-
-typedef struct {
-    const char *input;
-    int         pos;
-    Token       cur;
-    int         error;
-    char        errmsg[128];
-} Parser;
-
-/* ---- Lexer -------------------------------------------------------------- */
-
-static void skip_whitespace(Parser *p) {
-    while (p->input[p->pos] == ' ' || p->input[p->pos] == '\t')
-        p->pos++;
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define CALC_USAGE "Usage: calc [-s] [-r VAR=START..END[:STEP] | -i VAR] EXPRESSION\n"
+
+/* Integer format if exact, otherwise up to 10 significant digits */
+static void print_number(OutBuf *out, double v) {
+    if (isfinite(v) && v == floor(v) && fabs(v) < 1e15)
+        out_printf(out, "%.0f\n", v);
+    else
+        out_printf(out, "%.10g\n", v);
 }
 
-static void next_token(Parser *p) {
-    skip_whitespace(p);
-
-    char c = p->input[p->pos];
-
-    if (c == '\0') {
-        p->cur.type = TOK_END;
-        return;
-    }
-
-    /* Numbers: digits or leading dot */
-    if (isdigit((unsigned char)c) || (c == '.' && isdigit((unsigned char)p->input[p->pos + 1]))) {
-        char *end;
-        p->cur.num = strtod(p->input + p->pos, &end);
-        p->pos = end - p->input;
-        p->cur.type = TOK_NUM;
-        return;
-    }
-
-    /* Identifiers (functions and constants) */
-    if (isalpha((unsigned char)c) || c == '_') {
-        int start = p->pos;
-        while (isalnum((unsigned char)p->input[p->pos]) || p->input[p->pos] == '_')
-            p->pos++;
-        int len = p->pos - start;
-        if (len >= (int)sizeof(p->cur.ident)) len = (int)sizeof(p->cur.ident) - 1;
-        memcpy(p->cur.ident, p->input + start, len);
-        p->cur.ident[len] = '\0';
-        p->cur.type = TOK_IDENT;
-        return;
+/* ---- Series evaluation -------------------------------------------------- */
+
+typedef struct CalcSeries {
+    const ExprProgram *prog;
+    const double *cols[EXPR_VARS_MAX];
+    double        input[EXPR_BLOCK];    /* The series variable's values */
+    double        out[EXPR_BLOCK];
+    OutBuf       *sink;                 /* Where results are printed */
+    bool          summary;
+    size_t        count;
+    double        sum, min, max;
+} CalcSeries;
+
+/* Evaluate the first n queued inputs and print or accumulate the results */
+static int series_flush(CalcSeries *cs, size_t n) {
+    char err[128];
+    if (n == 0)
+        return 0;
+    if (expr_eval_block(cs->prog, cs->cols, n, cs->out, err, sizeof(err)) < 0) {
+        fprintf(stderr, "vsh: calc: %s\n", err);
+        return -1;
     }
-
-    /* Two-character operators */
-    if (c == '*' && p->input[p->pos + 1] == '*') {
-        p->pos += 2;
-        p->cur.type = TOK_POWER;
-        return;
+    for (size_t i = 0; i < n; i++) {
+        double v = cs->out[i];
+        if (!cs->summary) {
+            print_number(cs->sink, v);
+            continue;
+        }
+        if (cs->count == 0 || v < cs->min) cs->min = v;
+        if (cs->count == 0 || v > cs->max) cs->max = v;
+        cs->sum += v;
+        cs->count++;
     }
+    return 0;
+}
 
-    /* Single-character operators */
-    p->pos++;
-    switch (c) {
-    case '+': p->cur.type = TOK_PLUS;    return;
-    case '-': p->cur.type = TOK_MINUS;   return;
-    case '*': p->cur.type = TOK_STAR;    return;
-    case '/': p->cur.type = TOK_SLASH;   return;
-    case '%': p->cur.type = TOK_PERCENT; return;
-    case '^': p->cur.type = TOK_POWER;   return;
-    case '(': p->cur.type = TOK_LPAREN;  return;
-    case ')': p->cur.type = TOK_RPAREN;  return;
-    default:
-        p->cur.type = TOK_ERROR;
-        snprintf(p->errmsg, sizeof(p->errmsg),
-                 "unexpected character '%c'", c);
-        p->error = 1;
+static void series_summary(const CalcSeries *cs) {
+    out_printf(cs->sink, "n    %zu\n", cs->count);
+    if (cs->count == 0)
         return;
-    }
+    out_puts(cs->sink, "sum  "); print_number(cs->sink, cs->sum);
+    out_puts(cs->sink, "min  "); print_number(cs->sink, cs->min);
+    out_puts(cs->sink, "max  "); print_number(cs->sink, cs->max);
+    out_puts(cs->sink, "mean ");
+    print_number(cs->sink, cs->sum / (double)cs->count);
 }
 
-/* ---- Recursive descent parser ------------------------------------------- */
-
-static double parse_expr(Parser *p);
-
-static void parser_error(Parser *p, const char *msg) {
-    if (!p->error) {
-        snprintf(p->errmsg, sizeof(p->errmsg), "%s", msg);
-        p->error = 1;
+/* Parse START..END[:STEP] */
+static bool parse_range(const char *s, double *start, double *end,
+                        double *step) {
+    const char *dots = strstr(s, "..");
+    char *p;
+    if (!dots || dots == s)
+        return false;
+    *start = strtod(s, &p);             /* "1..5" would read "1." */
+    if (p != dots && !(p == dots + 1 && dots[-1] != '.'))
+        return false;
+    s = dots + 2;
+    *end = strtod(s, &p);
+    if (p == s)
+        return false;
+    *step = *end >= *start ? 1 : -1;
+    if (*p == ':') {
+        s = p + 1;
+        *step = strtod(s, &p);
+        if (p == s || *step == 0)
+            return false;
     }
+    return *p == '\0' && isfinite(*start) && isfinite(*end);
 }
 
-/* primary → NUMBER | '(' expr ')' | FUNC '(' expr ')' | CONST */
-static double parse_primary(Parser *p) {
-    if (p->error) return 0;
-
-    if (p->cur.type == TOK_NUM) {
-        double val = p->cur.num;
-        next_token(p);
-        return val;
-    }
-
-    if (p->cur.type == TOK_LPAREN) {
-        next_token(p);  /* consume '(' */
-        double val = parse_expr(p);
-        if (p->cur.type != TOK_RPAREN) {
-            parser_error(p, "expected closing ')'");
-            return 0;
+static int run_range(CalcSeries *cs, double start, double end, double step) {
+    double span = (end - start) / step;
+    if (span < 0)
+        return 0;                       /* Step points away from END */
+
+    /* Compute each value from its index so error does not accumulate */
+    size_t n = (size_t)floor(span + 1e-9) + 1;
+    size_t queued = 0;
+    for (size_t i = 0; i < n; i++) {
+        cs->input[queued++] = start + (double)i * step;
+        if (queued == EXPR_BLOCK) {
+            if (series_flush(cs, queued) < 0)
+                return -1;
+            queued = 0;
         }
-        next_token(p);  /* consume ')' */
-        return val;
     }
-
-    if (p->cur.type == TOK_IDENT) {
-        char name[32];
-        strncpy(name, p->cur.ident, sizeof(name) - 1);
-        name[sizeof(name) - 1] = '\0';
-
-        /* Check for constants */
-        if (strcmp(name, "pi") == 0 || strcmp(name, "PI") == 0) {
-            next_token(p);
-            return 3.14159265358979323846;
-        }
-        if (strcmp(name, "e") == 0 || strcmp(name, "E") == 0) {
-            /* Make sure it's not 'e' as part of scientific notation -
-             * strtod already handles that, so if we get here it's the
-             * constant */
-            next_token(p);
-            return 2.71828182845904523536;
-        }
-
-        /* Must be a function call: FUNC '(' expr ')' */
-        next_token(p);  /* consume identifier */
-        if (p->cur.type != TOK_LPAREN) {
-            char msg[64];
-            snprintf(msg, sizeof(msg), "unknown identifier '%s'", name);
-            parser_error(p, msg);
-            return 0;
-        }
-        next_token(p);  /* consume '(' */
-        double arg = parse_expr(p);
-        if (p->cur.type != TOK_RPAREN) {
-            parser_error(p, "expected ')' after function argument");
-            return 0;
-        }
-        next_token(p);  /* consume ')' */
-
-        /* Dispatch function */
-        if (strcmp(name, "sqrt") == 0) {
-            if (arg < 0) { parser_error(p, "sqrt of negative number"); return 0; }
-            return sqrt(arg);
-        }
-        if (strcmp(name, "sin") == 0)   return sin(arg);
-        if (strcmp(name, "cos") == 0)   return cos(arg);
-        if (strcmp(name, "tan") == 0)   return tan(arg);
-        if (strcmp(name, "log") == 0) {
-            if (arg <= 0) { parser_error(p, "log of non-positive number"); return 0; }
-            return log(arg);
-        }
-        if (strcmp(name, "log10") == 0) {
-            if (arg <= 0) { parser_error(p, "log10 of non-positive number"); return 0; }
-            return log10(arg);
-        }
-        if (strcmp(name, "abs") == 0)   return fabs(arg);
-        if (strcmp(name, "ceil") == 0)  return ceil(arg);
-        if (strcmp(name, "floor") == 0) return floor(arg);
-
-        char msg[64];
-        snprintf(msg, sizeof(msg), "unknown function '%s'", name);
-        parser_error(p, msg);
-        return 0;
-    }
-
-    parser_error(p, "expected number, '(', or function");
-    return 0;
-}
-
-/* unary → ['-' | '+'] primary */
-static double parse_unary(Parser *p) {
-    if (p->error) return 0;
-
-    if (p->cur.type == TOK_MINUS) {
-        next_token(p);
-        return -parse_unary(p);
-    }
-    if (p->cur.type == TOK_PLUS) {
-        next_token(p);
-        return parse_unary(p);
-    }
-    return parse_primary(p);
+    return series_flush(cs, queued);
 }
 
-/* power → unary (('**' | '^') power)?    -- right-associative via recursion */
-static double parse_power(Parser *p) {
-    if (p->error) return 0;
-
-    double base = parse_unary(p);
-    if (p->cur.type == TOK_POWER) {
-        next_token(p);
-        double exp = parse_power(p);  /* right-associative: recurse */
-        return pow(base, exp);
+/* Standard input through read(2): calc runs in the shell, where a stdio
+ * buffer or EOF flag on stdin would outlive the redirection. -i reads to
+ * the end anyway, so it reads in blocks; when it stops early, a seekable
+ * stdin is moved back to just past the last line used. */
+typedef struct LineReader {
+    char   buf[16384];
+    size_t pos, len;
+} LineReader;
+
+/* Next line, without its newline and cut to size - 1 bytes; false at end
+ * of input */
+static bool next_line(LineReader *lr, char *line, size_t size) {
+    size_t n = 0;
+    bool any = false;
+    for (;;) {
+        if (lr->pos == lr->len) {
+            ssize_t r = read(STDIN_FILENO, lr->buf, sizeof(lr->buf));
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                break;
+            lr->pos = 0;
+            lr->len = (size_t)r;
+        }
+        char c = lr->buf[lr->pos++];
+        any = true;
+        if (c == '\n')
+            break;
+        if (n + 1 < size)
+            line[n++] = c;
     }
-    return base;
+    line[n] = '\0';
+    return any;
 }
 
-/* term → power (('*' | '/' | '%') power)* */
-static double parse_term(Parser *p) {
-    if (p->error) return 0;
-
-    double left = parse_power(p);
-    while (p->cur.type == TOK_STAR || p->cur.type == TOK_SLASH ||
-           p->cur.type == TOK_PERCENT) {
-        TokenType op = p->cur.type;
-        next_token(p);
-        double right = parse_power(p);
-        if (op == TOK_STAR) {
-            left *= right;
-        } else if (op == TOK_SLASH) {
-            if (right == 0) {
-                parser_error(p, "division by zero");
-                return 0;
-            }
-            left /= right;
-        } else {
-            if (right == 0) {
-                parser_error(p, "modulo by zero");
-                return 0;
-            }
-            left = fmod(left, right);
+static int read_numbers(CalcSeries *cs, LineReader *lr) {
+    char line[256];
+    size_t queued = 0, lineno = 0;
+    while (next_line(lr, line, sizeof(line))) {
+        lineno++;
+        char *p = line, *end;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\n' || *p == '\0')
+            continue;
+        double v = strtod(p, &end);
+        while (*end == ' ' || *end == '\t' || *end == '\n' || *end == '\r')
+            end++;
+        if (end == p || *end != '\0') {
+            fprintf(stderr, "vsh: calc: line %zu: not a number\n", lineno);
+            return -1;
+        }
+        cs->input[queued++] = v;
+        if (queued == EXPR_BLOCK) {
+            if (series_flush(cs, queued) < 0)
+                return -1;
+            queued = 0;
         }
     }
-    return left;
+    return series_flush(cs, queued);
 }
 
-/* expr → term (('+' | '-') term)* */
-static double parse_expr(Parser *p) {
-    if (p->error) return 0;
-
-    double left = parse_term(p);
-    while (p->cur.type == TOK_PLUS || p->cur.type == TOK_MINUS) {
-        TokenType op = p->cur.type;
-        next_token(p);
-        double right = parse_term(p);
-        if (op == TOK_PLUS)
-            left += right;
-        else
-            left -= right;
-    }
-    return left;
+/* One number per line on stdin; blank lines are skipped */
+static int run_stdin(CalcSeries *cs) {
+    LineReader lr = { .pos = 0, .len = 0 };
+    int status = read_numbers(cs, &lr);
+    if (lr.pos < lr.len)
+        lseek(STDIN_FILENO, -(off_t)(lr.len - lr.pos), SEEK_CUR);
+    return status;
 }
 
 /* ---- Main entry point --------------------------------------------------- */
 
 /*
- * calc EXPRESSION
+ * calc [-s] [-r VAR=START..END[:STEP] | -i VAR] EXPRESSION
  *
  * Evaluate a mathematical expression and print the result.
  * Supports: +, -, *, /, %, ** (^), parentheses, constants (pi, e),
- * and functions (sqrt, sin, cos, tan, log, log10, abs, ceil, floor).
+ * functions (sqrt, sin, cos, tan, log, log10, abs, ceil, floor), and
+ * shell variables holding numbers.
+ *   -r VAR=A..B[:S]  Evaluate once for each VAR from A to B in steps of S
+ *   -i VAR           Evaluate once for each number read from stdin
+ *   -s               Print count, sum, min, max and mean instead
  */
 int builtin_calc(Shell *shell, int argc, char **argv) {
-    (void)shell;
+    const char *series_var = NULL;
+    const char *range = NULL;
+    bool summary = false;
+    int argi = 1;
+
+    /* Only exact flags, so that "calc -5+3" is still an expression */
+    while (argi < argc) {
+        if (strcmp(argv[argi], "-s") == 0) {
+            summary = true;
+            argi++;
+        } else if ((strcmp(argv[argi], "-r") == 0 ||
+                    strcmp(argv[argi], "-i") == 0) && argi + 1 < argc) {
+            series_var = argv[argi + 1];
+            range = argv[argi][1] == 'r' ? strchr(series_var, '=') : NULL;
+            if (argv[argi][1] == 'r' && !range) {
+                fprintf(stderr, "vsh: calc: -r: expected VAR=START..END\n");
+                return 1;
+            }
+            argi += 2;
+        } else if (strcmp(argv[argi], "--") == 0) {
+            argi++;
+            break;
+        } else {
+            break;
+        }
+    }
+
+    if (summary && !series_var) {
+        fprintf(stderr, "vsh: calc: -s needs -r or -i\n");
+        return 1;
+    }
 
-    if (argc < 2) {
-        fprintf(stderr, "Usage: calc EXPRESSION\n");
+    if (argi >= argc) {
+        fprintf(stderr, CALC_USAGE);
         fprintf(stderr, "  Operators: + - * / %% ** ^\n");
         fprintf(stderr, "  Constants: pi, e\n");
         fprintf(stderr, "  Functions: sqrt sin cos tan log log10 abs ceil floor\n");
@@ -303,7 +247,7 @@ int builtin_calc(Shell *shell, int argc, char **argv) {
 
     /* Join all arguments into a single expression string */
     size_t total_len = 0;
-    for (int i = 1; i < argc; i++)
+    for (int i = argi; i < argc; i++)
         total_len += strlen(argv[i]) + 1;
 
     char *expr = malloc(total_len + 1);
@@ -312,43 +256,89 @@ int builtin_calc(Shell *shell, int argc, char **argv) {
         return 1;
     }
     expr[0] = '\0';
-    for (int i = 1; i < argc; i++) {
-        if (i > 1) strcat(expr, " ");
+    for (int i = argi; i < argc; i++) {
+        if (i > argi) strcat(expr, " ");
         strcat(expr, argv[i]);
     }
 
-    /* Initialize parser */
-    Parser parser;
-    memset(&parser, 0, sizeof(parser));
-    parser.input = expr;
-    parser.pos   = 0;
-    parser.error = 0;
+    char err[128];
+    const ExprProgram *prog = expr_compile(shell->expr_cache, expr,
+                                           err, sizeof(err));
+    free(expr);
+    if (!prog) {
+        fprintf(stderr, "vsh: calc: %s\n", err);
+        return 1;
+    }
 
-    next_token(&parser);
-    double result = parse_expr(&parser);
+    /* Bind every other variable from the environment */
+    size_t name_len = range ? (size_t)(range - series_var)
+                            : (series_var ? strlen(series_var) : 0);
+    CalcSeries *cs = series_var ? calloc(1, sizeof(CalcSeries)) : NULL;
+    double values[EXPR_VARS_MAX];
+    double *consts = NULL;      /* EXPR_BLOCK copies of each value */
+    int nvars = expr_nvars(prog);
 
-    if (parser.error) {
-        fprintf(stderr, "vsh: calc: %s\n", parser.errmsg);
-        free(expr);
+    if (series_var && (!cs || !(consts = malloc(sizeof(double) * EXPR_BLOCK *
+                                                (size_t)(nvars ? nvars : 1))))) {
+        fprintf(stderr, "vsh: calc: out of memory\n");
+        free(cs);
         return 1;
     }
 
-    if (parser.cur.type != TOK_END) {
-        fprintf(stderr, "vsh: calc: unexpected token at position %d\n",
-                parser.pos);
-        free(expr);
-        return 1;
+    for (int slot = 0; slot < nvars; slot++) {
+        const char *name = expr_var_name(prog, slot);
+        if (cs && strlen(name) == name_len &&
+            strncmp(name, series_var, name_len) == 0) {
+            cs->cols[slot] = cs->input;
+            continue;
+        }
+
+        const char *val = env_get(shell->env, name);
+        char *end = NULL;
+        values[slot] = val ? strtod(val, &end) : 0;
+        if (!val || end == val || *end != '\0') {
+            fprintf(stderr, "vsh: calc: unknown identifier '%s'\n", name);
+            free(consts);
+            free(cs);
+            return 1;
+        }
+        if (cs) {
+            double *col = consts + (size_t)slot * EXPR_BLOCK;
+            for (int i = 0; i < EXPR_BLOCK; i++)
+                col[i] = values[slot];
+            cs->cols[slot] = col;
+        }
     }
 
-    free(expr);
+    if (!cs) {
+        double result;
+        if (expr_eval(prog, values, &result, err, sizeof(err)) < 0) {
+            fprintf(stderr, "vsh: calc: %s\n", err);
+            return 1;
+        }
+        print_number(shell->out, result);
+        return 0;
+    }
 
-    /* Print result: integer format if exact, otherwise up to 10 significant digits */
-    if (isfinite(result) && result == floor(result) &&
-        fabs(result) < 1e15) {
-        printf("%.0f\n", result);
+    cs->prog    = prog;
+    cs->sink    = shell->out;
+    cs->summary = summary;
+
+    int rc;
+    double start, end, step;
+    if (!range) {
+        rc = run_stdin(cs);
+    } else if (!parse_range(range + 1, &start, &end, &step)) {
+        fprintf(stderr, "vsh: calc: -r: invalid range '%s'\n", range + 1);
+        rc = -1;
     } else {
-        printf("%.10g\n", result);
+        rc = run_range(cs, start, end, step);
     }
 
-    return 0;
+    if (rc == 0 && summary)
+        series_summary(cs);
+
+    free(consts);
+    free(cs);
+    return rc == 0 ? 0 : 1;
 }
@@ -0,0 +1,234 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * builtins/cat.c - cat and tee without a process
+ *
+ * Both move their data with fd_copy()/fd_tee() (fdcopy.c), so `cat log >
+ * out` is a copy_file_range and `cat log | grep x` a splice into the pipe.
+ * Anything they do not implement (cat -n, tee --output-error, ...) is left
+ * to the external command of the same name: see builtin_copy_accepts().
+ * ============================================================================ */
+
+#include "builtins.h"
+#include "shell.h"
+#include "output.h"
+#include "fdcopy.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* What a cat or tee command line asks for */
+typedef struct CopyArgs {
+    int    argc;
+    char **argv;
+    bool   tee;
+    bool   append;      /* tee -a */
+    int    nfiles;      /* Operands ("-" is stdin for cat) */
+} CopyArgs;
+
+/* Index of the first operand at or after i (argc when none is left).
+ * Options may follow operands, as with GNU tools, up to a "--". */
+static int next_operand(const CopyArgs *a, int i, bool *options) {
+    for (; i < a->argc; i++) {
+        const char *arg = a->argv[i];
+        if (*options && strcmp(arg, "--") == 0)
+            *options = false;
+        else if (!*options || arg[0] != '-' || arg[1] == '\0')
+            break;
+    }
+    return i;
+}
+
+/* Check the options; false for one the builtin lacks */
+static bool parse_args(int argc, char **argv, CopyArgs *a) {
+    memset(a, 0, sizeof(*a));
+    a->argc = argc;
+    a->argv = argv;
+    a->tee  = strcmp(argv[0], "tee") == 0;
+
+    bool options = true;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (options && strcmp(arg, "--") == 0) {
+            options = false;
+            continue;
+        }
+        if (!options || arg[0] != '-' || arg[1] == '\0') {
+            a->nfiles++;
+            continue;
+        }
+        for (const char *p = arg + 1; *p; p++) {
+            if (!a->tee && *p == 'u')
+                continue;               /* Output is never buffered */
+            if (a->tee && *p == 'a')
+                a->append = true;
+            else if (!a->tee || *p != 'i')
+                return false;           /* -i: SIGINT is not ours to take */
+        }
+    }
+    return true;
+}
+
+/* ---- Deciding who runs it ----------------------------------------------- */
+
+/* In an interactive shell SIGINT is ignored, so a copy running in the
+ * shell cannot be interrupted */
+static bool uninterruptible(void) {
+    struct sigaction sa;
+    return sigaction(SIGINT, NULL, &sa) == 0 && sa.sa_handler == SIG_IGN;
+}
+
+bool builtin_copy_accepts(int argc, char **argv, int in_fd, int out_fd) {
+    CopyArgs a;
+    if (!parse_args(argc, argv, &a))
+        return false;
+    if (!uninterruptible())
+        return true;
+
+    /* Only input that ends on its own: regular files, or a pipe on stdin.
+     * A terminal, a device or a named FIFO could keep the shell forever. */
+    bool reads_file = false;
+    bool reads_stdin = a.tee || a.nfiles == 0;
+    bool options = true;
+    for (int i = 1; !a.tee && (i = next_operand(&a, i, &options)) < argc; i++) {
+        struct stat st;
+        if (strcmp(argv[i], "-") == 0)
+            reads_stdin = true;
+        else if (stat(argv[i], &st) == 0 && !S_ISREG(st.st_mode))
+            return false;
+        else
+            reads_file = true;
+    }
+    if (reads_stdin) {
+        struct stat st;
+        if (fstat(in_fd, &st) < 0)
+            return false;
+        if (S_ISREG(st.st_mode))
+            reads_file = true;
+        else if (!S_ISFIFO(st.st_mode))
+            return false;
+    }
+
+    /* Nor a whole file scrolling past on the terminal */
+    return !(reads_file && isatty(out_fd));
+}
+
+/* ---- Running it ---------------------------------------------------------- */
+
+/* A failed copy: quiet for a reader that went away, as if killed by
+ * SIGPIPE; otherwise reported against name */
+static int copy_failed(const char *cmd, const char *name) {
+    if (errno == EPIPE)
+        return 128 + SIGPIPE;
+    fprintf(stderr, "vsh: %s: %s: %s\n", cmd, name, strerror(errno));
+    return 1;
+}
+
+/* The same regular file on both sides would copy into itself forever */
+static bool same_file(int a, int b) {
+    struct stat sa, sb;
+    return fstat(a, &sa) == 0 && fstat(b, &sb) == 0 && S_ISREG(sa.st_mode) &&
+           sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+/* Copy one operand of cat; false once the output has gone away */
+static bool cat_one(const char *name, int in_fd, int out_fd, int *status) {
+    bool is_stdin = strcmp(name, "-") == 0;
+    int fd = is_stdin ? in_fd : open(name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "vsh: cat: %s: %s\n", name, strerror(errno));
+        *status = 1;
+        return true;
+    }
+
+    if (same_file(fd, out_fd)) {
+        fprintf(stderr, "vsh: cat: %s: input file is output file\n", name);
+        *status = 1;
+    } else if (fd_copy(fd, out_fd) < 0) {
+        *status = copy_failed("cat", name);
+    }
+    if (!is_stdin)
+        close(fd);
+    return *status <= 128;
+}
+
+static int run_cat(const CopyArgs *a, int in_fd, int out_fd) {
+    int status = 0;
+    if (a->nfiles == 0) {
+        cat_one("-", in_fd, out_fd, &status);
+        return status;
+    }
+
+    bool options = true;
+    for (int i = 1; (i = next_operand(a, i, &options)) < a->argc; i++) {
+        if (!cat_one(a->argv[i], in_fd, out_fd, &status))
+            break;
+    }
+    return status;
+}
+
+static int run_tee(const CopyArgs *a, int in_fd, int out_fd) {
+    int *outs = malloc(sizeof(int) * (size_t)(a->nfiles + 1));
+    if (!outs) {
+        fprintf(stderr, "vsh: tee: out of memory\n");
+        return 1;
+    }
+
+    int status = 0, nout = 0;
+    outs[nout++] = out_fd;
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (a->append ? O_APPEND : O_TRUNC);
+    bool options = true;
+    for (int i = 1; (i = next_operand(a, i, &options)) < a->argc; i++) {
+        int fd = open(a->argv[i], flags, 0666);
+        if (fd < 0) {
+            fprintf(stderr, "vsh: tee: %s: %s\n", a->argv[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        outs[nout++] = fd;
+    }
+
+    if (fd_tee(in_fd, outs, nout) < 0)
+        status = copy_failed("tee", "write");
+
+    for (int i = 1; i < nout; i++)
+        close(outs[i]);
+    free(outs);
+    return status;
+}
+
+int builtin_copy_run(int argc, char **argv, int in_fd, int out_fd) {
+    CopyArgs a;
+    if (!parse_args(argc, argv, &a)) {
+        fprintf(stderr, "vsh: %s: unsupported option (no external %s found)\n",
+                argv[0], argv[0]);
+        return 2;
+    }
+    return a.tee ? run_tee(&a, in_fd, out_fd) : run_cat(&a, in_fd, out_fd);
+}
+
+/*
+ * cat [-u] [FILE|-]...
+ *
+ * Copy each FILE (stdin for "-" or no operands) to stdout.
+ */
+int builtin_cat(Shell *shell, int argc, char **argv) {
+    out_flush(shell->out);
+    return builtin_copy_run(argc, argv, STDIN_FILENO, STDOUT_FILENO);
+}
+
+/*
+ * tee [-a] [-i] [FILE]...
+ *
+ * Copy stdin to stdout and to each FILE.
+ *   -a   append to the files instead of truncating them
+ *   -i   accepted; an interrupt is handled by the shell
+ */
+int builtin_tee(Shell *shell, int argc, char **argv) {
+    out_flush(shell->out);
+    return builtin_copy_run(argc, argv, STDIN_FILENO, STDOUT_FILENO);
+}
@@ -5,75 +5,83 @@
 
 #include "builtins.h"
 #include "shell.h"
+#include "output.h"
 #include "env.h"
+#include "cwd.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdbool.h>
 #include <limits.h>
 
+/* Leading -L / -P options; returns the index of the first operand */
+static int parse_mode(int argc, char **argv, bool *physical) {
+    int i = 1;
+    *physical = false;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (strcmp(argv[i], "--") == 0)
+            return i + 1;
+        if (strcmp(argv[i], "-L") == 0)
+            *physical = false;
+        else if (strcmp(argv[i], "-P") == 0)
+            *physical = true;
+        else
+            break;
+    }
+    return i;
+}
+
 /*
- * cd [dir]
+ * cd [-L|-P] [dir]
  *
  * Supports:
  *   cd          - go to HOME
  *   cd -        - go to OLDPWD, print the directory
  *   cd ~        - go to HOME (handled by tilde expansion elsewhere too)
  *   cd <path>   - go to path
+ *   -L          - follow the path as written: "link/.." is "." (default)
+ *   -P          - resolve symlinks: PWD becomes the physical directory
  *
  * Updates PWD and OLDPWD environment variables after a successful chdir.
  */
 int builtin_cd(Shell *shell, int argc, char **argv) {
     const char *target = NULL;
-    char oldpwd[PATH_MAX];
-    char newpwd[PATH_MAX];
+    bool physical;
+    int i = parse_mode(argc, argv, &physical);
 
-    /* Save the current working directory before changing */
-    if (!getcwd(oldpwd, sizeof(oldpwd))) {
-        /* If getcwd fails, try to get from env */
-        const char *pwd_env = env_get(shell->env, "PWD");
-        if (pwd_env) {
-            strncpy(oldpwd, pwd_env, sizeof(oldpwd) - 1);
-            oldpwd[sizeof(oldpwd) - 1] = '\0';
-        } else {
-            oldpwd[0] = '\0';
-        }
-    }
-
-    if (argc < 2 || argv[1] == NULL) {
+    if (i >= argc || argv[i] == NULL) {
         /* cd with no args: go to HOME */
         target = env_get(shell->env, "HOME");
         if (!target || *target == '\0') {
             fprintf(stderr, "vsh: cd: HOME not set\n");
             return 1;
         }
-    } else if (strcmp(argv[1], "-") == 0) {
+    } else if (strcmp(argv[i], "-") == 0) {
         /* cd -: go to OLDPWD */
         target = env_get(shell->env, "OLDPWD");
         if (!target || *target == '\0') {
             fprintf(stderr, "vsh: cd: OLDPWD not set\n");
             return 1;
         }
-        /* Print the directory we're changing to */
-        printf("%s\n", target);
     } else {
-        target = argv[1];
+        target = argv[i];
     }
 
-    /* Perform the directory change */
-    if (chdir(target) != 0) {
-        fprintf(stderr, "vsh: cd: %s: %s\n", target, strerror(errno));
+    /* OLDPWD is about to be replaced */
+    char dest[PATH_MAX];
+    snprintf(dest, sizeof(dest), "%s", target);
+
+    if (cwd_change(shell, dest, physical) != 0) {
+        fprintf(stderr, "vsh: cd: %s: %s\n", dest, strerror(errno));
         return 1;
     }
 
-    /* Update PWD and OLDPWD */
-    if (getcwd(newpwd, sizeof(newpwd))) {
-        env_set(shell->env, "PWD", newpwd, true);
+    /* cd - prints the directory we changed to */
+    if (i < argc && strcmp(argv[i], "-") == 0) {
+        const char *pwd = cwd_get(shell->cwd);
+        out_printf(shell->out, "%s\n", pwd ? pwd : dest);
     }
-    if (oldpwd[0] != '\0') {
-        env_set(shell->env, "OLDPWD", oldpwd, true);
-    }
-
     return 0;
 }
@@ -5,6 +5,7 @@
 
 #include "builtins.h"
 #include "shell.h"
+#include "output.h"
 #include <stdio.h>
 #include <math.h>
 
@@ -31,7 +32,7 @@ static void hsv_to_rgb(double h, double s, double v,
 
 /* ---- Standard 16 colors section ----------------------------------------- */
 
-static void print_standard_colors(void) {
+static void print_standard_colors(OutBuf *out) {
     static const char *names[] = {
         "Black",   "Red",      "Green",   "Yellow",
         "Blue",    "Magenta",  "Cyan",    "White",
@@ -39,27 +40,27 @@ static void print_standard_colors(void) {
         "BrBlue",  "BrMagenta","BrCyan",  "BrWhite"
     };
 
-    printf("\033[1mStandard Colors (0-7):\033[0m\n");
+    out_puts(out, "\033[1mStandard Colors (0-7):\033[0m\n");
     for (int i = 0; i < 8; i++) {
-        printf("  \033[48;5;%dm   \033[0m", i);
-        printf(" %2d %-10s", i, names[i]);
-        if (i == 3) printf("\n");
+        out_printf(out, "  \033[48;5;%dm   \033[0m", i);
+        out_printf(out, " %2d %-10s", i, names[i]);
+        if (i == 3) out_puts(out, "\n");
     }
-    printf("\n\n");
+    out_puts(out, "\n\n");
 
-    printf("\033[1mBright Colors (8-15):\033[0m\n");
+    out_puts(out, "\033[1mBright Colors (8-15):\033[0m\n");
     for (int i = 8; i < 16; i++) {
-        printf("  \033[48;5;%dm   \033[0m", i);
-        printf(" %2d %-10s", i, names[i]);
-        if (i == 11) printf("\n");
+        out_printf(out, "  \033[48;5;%dm   \033[0m", i);
+        out_printf(out, " %2d %-10s", i, names[i]);
+        if (i == 11) out_puts(out, "\n");
     }
-    printf("\n\n");
+    out_puts(out, "\n\n");
 }
 
 /* ---- 256-color palette section ------------------------------------------ */
 
-static void print_256_colors(void) {
-    printf("\033[1m216 Color Cube (16-231):\033[0m\n");
+static void print_256_colors(OutBuf *out) {
+    out_puts(out, "\033[1m216 Color Cube (16-231):\033[0m\n");
 
     /*
      * Colors 16-231 form a 6x6x6 RGB cube.
@@ -70,52 +71,52 @@ static void print_256_colors(void) {
      * for compactness: 6 rows, each row has 36 colored blocks.
      */
     for (int g = 0; g < 6; g++) {
-        printf("  ");
+        out_puts(out, "  ");
         for (int r = 0; r < 6; r++) {
             for (int b = 0; b < 6; b++) {
                 int idx = 16 + 36 * r + 6 * g + b;
-                printf("\033[48;5;%dm  \033[0m", idx);
+                out_printf(out, "\033[48;5;%dm  \033[0m", idx);
             }
-            if (r < 5) printf(" ");
+            if (r < 5) out_puts(out, " ");
         }
-        printf("\n");
+        out_puts(out, "\n");
     }
-    printf("\n");
+    out_puts(out, "\n");
 
-    printf("\033[1mGrayscale Ramp (232-255):\033[0m\n  ");
+    out_puts(out, "\033[1mGrayscale Ramp (232-255):\033[0m\n  ");
     for (int i = 232; i <= 255; i++) {
-        printf("\033[48;5;%dm  \033[0m", i);
+        out_printf(out, "\033[48;5;%dm  \033[0m", i);
     }
-    printf("\n\n");
+    out_puts(out, "\n\n");
 }
 
 /* ---- True-color rainbow gradient ---------------------------------------- */
 
-static void print_truecolor_gradient(void) {
-    printf("\033[1mTrue Color Gradient (24-bit):\033[0m\n  ");
+static void print_truecolor_gradient(OutBuf *out) {
+    out_puts(out, "\033[1mTrue Color Gradient (24-bit):\033[0m\n  ");
 
     int width = 80;
     for (int i = 0; i < width; i++) {
         double hue = (double)i / (double)width * 360.0;
         int r, g, b;
         hsv_to_rgb(hue, 1.0, 1.0, &r, &g, &b);
-        printf("\033[48;2;%d;%d;%dm \033[0m", r, g, b);
+        out_printf(out, "\033[48;2;%d;%d;%dm \033[0m", r, g, b);
     }
-    printf("\n\n");
+    out_puts(out, "\n\n");
 }
 
 /* ---- ANSI reference ----------------------------------------------------- */
 
-static void print_reference(void) {
-    printf("\033[1mANSI Color Code Reference:\033[0m\n");
-    printf("  \\033[38;5;Nm      - 256-color foreground (N = 0-255)\n");
-    printf("  \\033[48;5;Nm      - 256-color background (N = 0-255)\n");
-    printf("  \\033[38;2;R;G;Bm  - True-color foreground (RGB 0-255)\n");
-    printf("  \\033[48;2;R;G;Bm  - True-color background (RGB 0-255)\n");
-    printf("  \\033[0m            - Reset all attributes\n");
-    printf("  \\033[1m            - Bold\n");
-    printf("  \\033[2m            - Dim\n");
-    printf("  \\033[4m            - Underline\n");
+static void print_reference(OutBuf *out) {
+    out_puts(out, "\033[1mANSI Color Code Reference:\033[0m\n");
+    out_puts(out, "  \\033[38;5;Nm      - 256-color foreground (N = 0-255)\n");
+    out_puts(out, "  \\033[48;5;Nm      - 256-color background (N = 0-255)\n");
+    out_puts(out, "  \\033[38;2;R;G;Bm  - True-color foreground (RGB 0-255)\n");
+    out_puts(out, "  \\033[48;2;R;G;Bm  - True-color background (RGB 0-255)\n");
+    out_puts(out, "  \\033[0m            - Reset all attributes\n");
+    out_puts(out, "  \\033[1m            - Bold\n");
+    out_puts(out, "  \\033[2m            - Dim\n");
+    out_puts(out, "  \\033[4m            - Underline\n");
 }
 
 /* ---- Main entry point --------------------------------------------------- */
@@ -127,14 +128,14 @@ static void print_reference(void) {
  * palette, true-color gradient, and an ANSI code reference.
  */
 int builtin_colors(Shell *shell, int argc, char **argv) {
-    (void)shell; (void)argc; (void)argv;
-
-    printf("\n");
-    print_standard_colors();
-    print_256_colors();
-    print_truecolor_gradient();
-    print_reference();
-    printf("\n");
+    (void)argc; (void)argv;
+
+    out_putc(shell->out, '\n');
+    print_standard_colors(shell->out);
+    print_256_colors(shell->out);
+    print_truecolor_gradient(shell->out);
+    print_reference(shell->out);
+    out_putc(shell->out, '\n');
 
     return 0;
 }
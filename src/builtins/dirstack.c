@@ -5,7 +5,8 @@
 
 #include "builtins.h"
 #include "shell.h"
-#include "env.h"
+#include "output.h"
+#include "cwd.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,16 +18,16 @@
 
 static void print_dirstack(Shell *shell) {
     /* Print current directory first */
-    char cwd[PATH_MAX];
-    if (getcwd(cwd, sizeof(cwd)))
-        printf("%s", cwd);
+    const char *cwd = cwd_get(shell->cwd);
+    if (cwd)
+        out_printf(shell->out, "%s", cwd);
 
     /* Then print stack entries from top to bottom */
     DirStack *ds = shell->dirstack;
     for (int i = ds->top - 1; i >= 0; i--) {
-        printf(" %s", ds->dirs[i]);
+        out_printf(shell->out, " %s", ds->dirs[i]);
     }
-    printf("\n");
+    out_putc(shell->out, '\n');
 }
 
 /*
@@ -40,11 +41,13 @@ int builtin_pushd(Shell *shell, int argc, char **argv) {
     DirStack *ds = shell->dirstack;
     char cwd[PATH_MAX];
 
-    if (!getcwd(cwd, sizeof(cwd))) {
+    const char *pwd = cwd_get(shell->cwd);
+    if (!pwd) {
         fprintf(stderr, "vsh: pushd: cannot get current directory: %s\n",
                 strerror(errno));
         return 1;
     }
+    snprintf(cwd, sizeof(cwd), "%s", pwd);
 
     if (argc < 2) {
         /* Swap top two: current dir and top of stack */
@@ -56,7 +59,7 @@ int builtin_pushd(Shell *shell, int argc, char **argv) {
         /* Top of stack becomes new dir, current dir goes to top of stack */
         char *top_dir = ds->dirs[ds->top - 1];
 
-        if (chdir(top_dir) != 0) {
+        if (cwd_change(shell, top_dir, false) != 0) {
             fprintf(stderr, "vsh: pushd: %s: %s\n", top_dir, strerror(errno));
             return 1;
         }
@@ -65,11 +68,6 @@ int builtin_pushd(Shell *shell, int argc, char **argv) {
         free(ds->dirs[ds->top - 1]);
         ds->dirs[ds->top - 1] = strdup(cwd);
 
-        /* Update PWD */
-        char newpwd[PATH_MAX];
-        if (getcwd(newpwd, sizeof(newpwd)))
-            env_set(shell->env, "PWD", newpwd, true);
-
         print_dirstack(shell);
         return 0;
     }
@@ -82,7 +80,7 @@ int builtin_pushd(Shell *shell, int argc, char **argv) {
         return 1;
     }
 
-    if (chdir(target) != 0) {
+    if (cwd_change(shell, target, false) != 0) {
         fprintf(stderr, "vsh: pushd: %s: %s\n", target, strerror(errno));
         return 1;
     }
@@ -91,12 +89,6 @@ int builtin_pushd(Shell *shell, int argc, char **argv) {
     ds->dirs[ds->top] = strdup(cwd);
     ds->top++;
 
-    /* Update environment */
-    env_set(shell->env, "OLDPWD", cwd, true);
-    char newpwd[PATH_MAX];
-    if (getcwd(newpwd, sizeof(newpwd)))
-        env_set(shell->env, "PWD", newpwd, true);
-
     print_dirstack(shell);
     return 0;
 }
@@ -118,18 +110,12 @@ int builtin_popd(Shell *shell, int argc, char **argv) {
         return 1;
     }
 
-    char cwd[PATH_MAX];
-    if (getcwd(cwd, sizeof(cwd))) {
-        /* Save current dir as OLDPWD */
-        env_set(shell->env, "OLDPWD", cwd, true);
-    }
-
     /* Pop the top entry */
     ds->top--;
     char *target = ds->dirs[ds->top];
     ds->dirs[ds->top] = NULL;
 
-    if (chdir(target) != 0) {
+    if (cwd_change(shell, target, false) != 0) {
         fprintf(stderr, "vsh: popd: %s: %s\n", target, strerror(errno));
         free(target);
         ds->top++;  /* Restore the entry since cd failed */
@@ -138,11 +124,6 @@ int builtin_popd(Shell *shell, int argc, char **argv) {
 
     free(target);
 
-    /* Update PWD */
-    char newpwd[PATH_MAX];
-    if (getcwd(newpwd, sizeof(newpwd)))
-        env_set(shell->env, "PWD", newpwd, true);
-
     print_dirstack(shell);
     return 0;
 }
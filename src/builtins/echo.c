@@ -5,7 +5,13 @@
 
 #include "builtins.h"
 #include "shell.h"
+#include "output.h"
+#include "alias.h"
 #include "env.h"
+#include "functions.h"
+#include "path_cache.h"
+#include "cwd.h"
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,18 +22,24 @@
 /* ---- pwd ---------------------------------------------------------------- */
 
 /*
- * pwd
+ * pwd [-L|-P]
  *
- * Print the current working directory.
+ * Print the current working directory: the logical one the shell tracks
+ * ($PWD, symlinks as they were followed), or with -P the physical one.
  */
 int builtin_pwd(Shell *shell, int argc, char **argv) {
-    (void)shell;
-    (void)argc;
-    (void)argv;
+    bool physical = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-P") == 0)
+            physical = true;
+        else if (strcmp(argv[i], "-L") == 0)
+            physical = false;
+    }
 
     char cwd[PATH_MAX];
-    if (getcwd(cwd, sizeof(cwd))) {
-        printf("%s\n", cwd);
+    const char *dir = physical ? getcwd(cwd, sizeof(cwd)) : cwd_get(shell->cwd);
+    if (dir) {
+        out_printf(shell->out, "%s\n", dir);
         return 0;
     }
 
@@ -41,17 +53,17 @@ int builtin_pwd(Shell *shell, int argc, char **argv) {
  * Print a single escape character. Advances *p past the escape sequence.
  * Returns false if \c is encountered (meaning: stop printing).
  */
-static bool print_escape(const char **p) {
+static bool print_escape(OutBuf *out, const char **p) {
     switch (**p) {
-    case 'n':  putchar('\n'); break;
-    case 't':  putchar('\t'); break;
-    case '\\': putchar('\\'); break;
-    case 'a':  putchar('\a'); break;
-    case 'b':  putchar('\b'); break;
-    case 'e':  putchar('\033'); break;
-    case 'f':  putchar('\f'); break;
-    case 'r':  putchar('\r'); break;
-    case 'v':  putchar('\v'); break;
+    case 'n':  out_putc(out, '\n'); break;
+    case 't':  out_putc(out, '\t'); break;
+    case '\\': out_putc(out, '\\'); break;
+    case 'a':  out_putc(out, '\a'); break;
+    case 'b':  out_putc(out, '\b'); break;
+    case 'e':  out_putc(out, '\033'); break;
+    case 'f':  out_putc(out, '\f'); break;
+    case 'r':  out_putc(out, '\r'); break;
+    case 'v':  out_putc(out, '\v'); break;
     case 'c':  return false;  /* Stop output */
     case '0': {
         /* Octal: \0NNN */
@@ -59,7 +71,7 @@ static bool print_escape(const char **p) {
         const char *s = *p + 1;
         for (int j = 0; j < 3 && *s >= '0' && *s <= '7'; j++, s++)
             val = val * 8 + (unsigned int)(*s - '0');
-        putchar((int)(val & 0xff));
+        out_putc(out, (char)(val & 0xff));
         *p = s - 1;  /* Will be incremented by caller */
         break;
     }
@@ -77,13 +89,13 @@ static bool print_escape(const char **p) {
             else
                 break;
         }
-        putchar((int)(val & 0xff));
+        out_putc(out, (char)(val & 0xff));
         *p = s - 1;
         break;
     }
     default:
-        putchar('\\');
-        putchar(**p);
+        out_putc(out, '\\');
+        out_putc(out, **p);
         break;
     }
     return true;
@@ -97,8 +109,7 @@ static bool print_escape(const char **p) {
  * -e: interpret backslash escape sequences.
  */
 int builtin_echo(Shell *shell, int argc, char **argv) {
-    (void)shell;
-
+    OutBuf *out = shell->out;
     bool newline = true;
     bool escapes = false;
     int start = 1;
@@ -132,7 +143,7 @@ int builtin_echo(Shell *shell, int argc, char **argv) {
 
     for (int i = start; i < argc; i++) {
         if (i > start)
-            putchar(' ');
+            out_putc(out, ' ');
 
         if (escapes) {
             const char *s = argv[i];
@@ -140,76 +151,33 @@ int builtin_echo(Shell *shell, int argc, char **argv) {
             while (*s && keep_going) {
                 if (*s == '\\' && *(s + 1)) {
                     s++;
-                    keep_going = print_escape(&s);
+                    keep_going = print_escape(out, &s);
                 } else {
-                    putchar(*s);
+                    out_putc(out, *s);
                 }
                 s++;
             }
-            if (!keep_going) {
-                fflush(stdout);
+            if (!keep_going)
                 return 0;
-            }
         } else {
-            fputs(argv[i], stdout);
+            out_puts(out, argv[i]);
         }
     }
 
     if (newline)
-        putchar('\n');
-
-    fflush(stdout);
+        out_putc(out, '\n');
     return 0;
 }
 
 /* ---- type --------------------------------------------------------------- */
 
-/*
- * Check if a file exists and is executable in any PATH directory.
- * Returns a malloc'd string with the full path, or NULL.
- */
-static char *find_in_path(const char *name) {
-    /* If name contains a slash, check directly */
-    if (strchr(name, '/')) {
-        if (access(name, X_OK) == 0)
-            return strdup(name);
-        return NULL;
-    }
-
-    const char *path_env = getenv("PATH");
-    if (!path_env)
-        return NULL;
-
-    char *path_copy = strdup(path_env);
-    if (!path_copy)
-        return NULL;
-
-    char *saveptr;
-    char *dir = strtok_r(path_copy, ":", &saveptr);
-    while (dir) {
-        char fullpath[PATH_MAX];
-        int n = snprintf(fullpath, sizeof(fullpath), "%s/%s", dir, name);
-        if (n > 0 && (size_t)n < sizeof(fullpath)) {
-            struct stat st;
-            if (stat(fullpath, &st) == 0 && S_ISREG(st.st_mode) &&
-                access(fullpath, X_OK) == 0) {
-                free(path_copy);
-                return strdup(fullpath);
-            }
-        }
-        dir = strtok_r(NULL, ":", &saveptr);
-    }
-
-    free(path_copy);
-    return NULL;
-}
-
 /*
  * type NAME ...
  *
  * For each NAME, describe how it would be interpreted:
- *   - builtin
  *   - alias (with expansion)
+ *   - function
+ *   - builtin
  *   - external command (with path)
  *   - not found
  */
@@ -228,24 +196,44 @@ int builtin_type(Shell *shell, int argc, char **argv) {
         if (shell->aliases) {
             const char *val = alias_get(shell->aliases, name);
             if (val) {
-                printf("%s is aliased to '%s'\n", name, val);
+                out_printf(shell->out, "%s is aliased to '%s'\n", name, val);
                 found = true;
             }
         }
 
+        /* Check functions */
+        if (!found && func_lookup(shell->functions, name)) {
+            out_printf(shell->out, "%s is a function\n", name);
+            found = true;
+        }
+
         /* Check builtins */
         if (!found && builtins_is_builtin(name)) {
-            printf("%s is a shell builtin\n", name);
+            out_printf(shell->out, "%s is a shell builtin\n", name);
             found = true;
         }
 
-        /* Check external commands in PATH */
+        /* Check external commands: the path cache first, then PATH */
         if (!found) {
-            char *path = find_in_path(name);
-            if (path) {
-                printf("%s is %s\n", name, path);
-                free(path);
+            const char *hashed = path_cache_peek(shell, name);
+            if (hashed) {
+                out_printf(shell->out, "%s is hashed (%s)\n", name, hashed);
                 found = true;
+            } else if (strchr(name, '/')) {
+                if (access(name, X_OK) == 0) {
+                    out_printf(shell->out, "%s is %s\n", name, name);
+                    found = true;
+                }
+            } else {
+                const char *path_list = env_get(shell->env, "PATH");
+                char *path = path_search(path_list ? path_list
+                                                   : PATH_CACHE_DEFAULT_PATH,
+                                         name);
+                if (path) {
+                    out_printf(shell->out, "%s is %s\n", name, path);
+                    free(path);
+                    found = true;
+                }
             }
         }
 
@@ -263,8 +251,8 @@ int builtin_type(Shell *shell, int argc, char **argv) {
 /*
  * return [N]
  *
- * Return from a shell function or sourced script with status N.
- * If not inside a function, print an error.
+ * Return from a shell function or sourced script with status N (default:
+ * the status of the last command). If not inside either, print an error.
  */
 int builtin_return_cmd(Shell *shell, int argc, char **argv) {
     if (!shell->in_function && shell->script_depth == 0) {
@@ -272,7 +260,7 @@ int builtin_return_cmd(Shell *shell, int argc, char **argv) {
         return 1;
     }
 
-    int status = 0;
+    int status = shell->last_status;
     if (argc > 1) {
         char *endp;
         long val = strtol(argv[1], &endp, 10);
@@ -283,13 +271,9 @@ int builtin_return_cmd(Shell *shell, int argc, char **argv) {
         status = (int)(val & 0xff);
     }
 
+    /* The executor sees the flag and unwinds to the function/source call */
     shell->last_status = status;
-
-    /*
-     * The actual control flow return is handled by the caller (executor)
-     * checking last_status after this builtin runs. For a full implementation,
-     * this would use setjmp/longjmp or a return flag. For now we set status.
-     */
+    shell->returning   = true;
     return status;
 }
 
@@ -298,9 +282,8 @@ int builtin_return_cmd(Shell *shell, int argc, char **argv) {
 /*
  * local VAR=value ...
  *
- * Declare a local variable in the current function scope.
- * Full local scope requires a call-frame stack; for now this is a stub
- * that behaves like a regular assignment via env_set.
+ * Declare a local variable in the current function scope. The variable's
+ * previous value (or absence) is restored when the function returns.
  */
 int builtin_local(Shell *shell, int argc, char **argv) {
     if (!shell->in_function) {
@@ -321,17 +304,18 @@ int builtin_local(Shell *shell, int argc, char **argv) {
             key[keylen] = '\0';
 
             const char *value = eq + 1;
-            env_set(shell->env, key, value, false);
+            bool ok = env_local(shell->env, key, value);
             free(key);
-        } else {
+            if (!ok) {
+                fprintf(stderr, "vsh: local: allocation failed\n");
+                return 1;
+            }
+        } else if (!env_local(shell->env, argv[i], "")) {
             /* Just declare the variable with empty value */
-            env_set(shell->env, argv[i], "", false);
+            fprintf(stderr, "vsh: local: allocation failed\n");
+            return 1;
         }
     }
 
     return 0;
 }
-
-/* ---- External alias helper declaration ---------------------------------- */
-/* alias_get is defined in alias.c; we declare it here for type builtin use. */
-extern const char *alias_get(AliasTable *table, const char *name);
@@ -5,7 +5,9 @@
 
 #include "builtins.h"
 #include "shell.h"
+#include "output.h"
 #include "env.h"
+#include "functions.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,17 +23,14 @@
 int builtin_export(Shell *shell, int argc, char **argv) {
     if (argc < 2) {
         /* List all exported variables */
-        for (int i = 0; i < ENV_HASH_SIZE; i++) {
-            EnvEntry *e = shell->env->buckets[i];
-            while (e) {
-                if (e->exported) {
-                    if (e->value) {
-                        printf("declare -x %s=\"%s\"\n", e->key, e->value);
-                    } else {
-                        printf("declare -x %s\n", e->key);
-                    }
-                }
-                e = e->next;
+        for (int i = 0; i < shell->env->capacity; i++) {
+            const EnvEntry *e = shell->env->slots[i].entry;
+            if (!e || !e->exported) continue;
+            if (e->value) {
+                out_printf(shell->out, "declare -x %s=\"%s\"\n",
+                           e->key->name, e->value);
+            } else {
+                out_printf(shell->out, "declare -x %s\n", e->key->name);
             }
         }
         return 0;
@@ -63,18 +62,39 @@ int builtin_export(Shell *shell, int argc, char **argv) {
 }
 
 /*
- * unset VAR ...
+ * unset [-f | -v] NAME ...
  *
- * Unset each named variable from the environment.
+ * Unset each named variable from the environment (-v, the default), or
+ * remove each named shell function (-f).
  */
 int builtin_unset(Shell *shell, int argc, char **argv) {
-    if (argc < 2) {
+    bool functions = false;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-f") == 0) {
+            functions = true;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            functions = false;
+        } else if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        } else {
+            fprintf(stderr, "vsh: unset: %s: invalid option\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if (i >= argc) {
         fprintf(stderr, "vsh: unset: not enough arguments\n");
         return 1;
     }
 
-    for (int i = 1; i < argc; i++) {
-        env_unset(shell->env, argv[i]);
+    for (; i < argc; i++) {
+        if (functions)
+            func_remove(shell->functions, argv[i]);
+        else
+            env_unset(shell->env, argv[i]);
     }
 
     return 0;
@@ -5,6 +5,7 @@
 
 #include "builtins.h"
 #include "shell.h"
+#include "output.h"
 #include "job_control.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -65,7 +66,8 @@ int builtin_fg(Shell *shell, int argc, char **argv) {
     if (!job)
         return 1;
 
-    printf("[%d] %s\n", job->id, job->command);
+    out_printf(shell->out, "[%d] %s\n", job->id, job->command);
+    out_flush(shell->out);      /* Before the job takes the terminal */
     return job_continue_foreground(shell, job);
 }
 
@@ -80,6 +82,6 @@ int builtin_bg(Shell *shell, int argc, char **argv) {
     if (!job)
         return 1;
 
-    printf("[%d] %s &\n", job->id, job->command);
+    out_printf(shell->out, "[%d] %s &\n", job->id, job->command);
     return job_continue_background(shell, job);
 }
@@ -0,0 +1,112 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * builtins/hash.c - Command path cache builtin
+ * ============================================================================ */
+
+#include "builtins.h"
+#include "shell.h"
+#include "output.h"
+#include "path_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* qsort comparator: entries by command name */
+static int cmp_entry(const void *a, const void *b) {
+    const PathCacheEntry *ea = *(const PathCacheEntry *const *)a;
+    const PathCacheEntry *eb = *(const PathCacheEntry *const *)b;
+    return strcmp(ea->name, eb->name);
+}
+
+/* Print every cached entry with its hit count, sorted by name */
+static int print_cache(Shell *shell) {
+    PathCache *cache = path_cache_current(shell);
+
+    if (!cache || cache->count == 0) {
+        out_puts(shell->out, "hash: hash table empty\n");
+        return 0;
+    }
+
+    PathCacheEntry **list = malloc(sizeof(PathCacheEntry *) * (size_t)cache->count);
+    if (!list) {
+        fprintf(stderr, "vsh: hash: allocation failed\n");
+        return 1;
+    }
+
+    int n = 0;
+    for (int i = 0; i < PATH_CACHE_HASH_SIZE; i++) {
+        for (PathCacheEntry *e = cache->buckets[i]; e; e = e->next)
+            list[n++] = e;
+    }
+    qsort(list, (size_t)n, sizeof(PathCacheEntry *), cmp_entry);
+
+    out_puts(shell->out, "hits\tcommand\n");
+    for (int i = 0; i < n; i++)
+        out_printf(shell->out, "%4lu\t%s\n", list[i]->hits, list[i]->path);
+
+    free(list);
+    return 0;
+}
+
+/*
+ * hash [-r] [-d NAME...] [-t NAME...] [NAME...]
+ *
+ * No args: list cached command paths with their hit counts.
+ * -r:      forget every cached path.
+ * -d:      forget the given names.
+ * -t:      print the cached (or resolved) path of each name.
+ * NAME:    resolve NAME through PATH and remember it.
+ */
+int builtin_hash(Shell *shell, int argc, char **argv) {
+    if (argc < 2)
+        return print_cache(shell);
+
+    int  i = 1;
+    char mode = 0;   /* 0 = add, 'd' = delete, 't' = print */
+
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            path_cache_clear(shell);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            mode = 'd';
+        } else if (strcmp(argv[i], "-t") == 0) {
+            mode = 't';
+        } else if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        } else {
+            fprintf(stderr, "vsh: hash: %s: invalid option\n", argv[i]);
+            fprintf(stderr, "usage: hash [-r] [-d name] [-t name] [name ...]\n");
+            return 2;
+        }
+    }
+
+    int ret = 0;
+    for (; i < argc; i++) {
+        const char *name = argv[i];
+
+        if (mode == 'd') {
+            if (!path_cache_forget(shell->path_cache, name)) {
+                fprintf(stderr, "vsh: hash: %s: not found\n", name);
+                ret = 1;
+            }
+        } else if (mode == 't') {
+            const char *path = path_cache_peek(shell, name);
+            if (!path && path_cache_add(shell, name))
+                path = path_cache_peek(shell, name);
+            if (path) {
+                out_printf(shell->out, "%s\n", path);
+            } else {
+                fprintf(stderr, "vsh: hash: %s: not found\n", name);
+                ret = 1;
+            }
+        } else if (!strchr(name, '/') && !builtins_is_builtin(name)) {
+            if (!path_cache_add(shell, name)) {
+                fprintf(stderr, "vsh: hash: %s: not found\n", name);
+                ret = 1;
+            }
+        }
+    }
+
+    return ret;
+}
@@ -5,6 +5,7 @@
 
 #include "builtins.h"
 #include "shell.h"
+#include "output.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -15,24 +16,25 @@
  * With arg: print detailed help for that specific builtin.
  */
 int builtin_help(Shell *shell, int argc, char **argv) {
-    (void)shell;
-
     int count = 0;
     const BuiltinEntry *table = builtins_table(&count);
 
     if (argc < 2) {
         /* Print header */
-        printf("\033[1mvsh - Vanguard Shell Built-in Commands\033[0m\n\n");
+        out_puts(shell->out,
+                 "\033[1mvsh - Vanguard Shell Built-in Commands\033[0m\n\n");
 
         /* Print each builtin: bold name, usage, dim description */
         for (int i = 0; i < count; i++) {
-            printf("  \033[1m%-12s\033[0m %-24s \033[2m%s\033[0m\n",
-                   table[i].name,
-                   table[i].usage,
-                   table[i].help);
+            out_printf(shell->out,
+                       "  \033[1m%-12s\033[0m %-24s \033[2m%s\033[0m\n",
+                       table[i].name,
+                       table[i].usage,
+                       table[i].help);
         }
 
-        printf("\nType 'help <command>' for detailed help on a specific builtin.\n");
+        out_puts(shell->out, "\nType 'help <command>' for detailed help on "
+                             "a specific builtin.\n");
         return 0;
     }
 
@@ -43,8 +45,8 @@ int builtin_help(Shell *shell, int argc, char **argv) {
         return 1;
     }
 
-    printf("\033[1m%s\033[0m - %s\n", entry->name, entry->help);
-    printf("Usage: %s\n", entry->usage);
+    out_printf(shell->out, "\033[1m%s\033[0m - %s\n", entry->name, entry->help);
+    out_printf(shell->out, "Usage: %s\n", entry->usage);
 
     return 0;
 }
@@ -5,6 +5,7 @@
 
 #include "builtins.h"
 #include "shell.h"
+#include "output.h"
 #include "history.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,7 +22,8 @@
  * not in this builtin.
  */
 int builtin_history(Shell *shell, int argc, char **argv) {
-    if (!shell->history) {
+    History *hist = shell_history(shell);
+    if (!hist) {
         fprintf(stderr, "vsh: history: history not initialized\n");
         return 1;
     }
@@ -31,7 +33,7 @@ int builtin_history(Shell *shell, int argc, char **argv) {
     /* Parse options */
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-c") == 0) {
-            history_clear(shell->history);
+            history_clear(hist);
             return 0;
         } else if (strcmp(argv[i], "-n") == 0) {
             if (i + 1 >= argc) {
@@ -52,16 +54,16 @@ int builtin_history(Shell *shell, int argc, char **argv) {
         }
     }
 
-    int total = history_count(shell->history);
+    int total = history_count(hist);
     int start = 0;
 
     if (show_last >= 0 && show_last < total)
         start = total - show_last;
 
     for (int i = start; i < total; i++) {
-        const char *line = history_get(shell->history, i);
+        const char *line = history_get(hist, i);
         if (line) {
-            printf("  %4d  %s\n", i + 1, line);
+            out_printf(shell->out, "  %4d  %s\n", i + 1, line);
         }
     }
 
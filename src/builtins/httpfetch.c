@@ -1,16 +1,29 @@
 /* ============================================================================
  * vsh - Vanguard Shell
  * builtins/httpfetch.c - Fetch content from a URL via raw HTTP sockets
+ *
+ * Responses are streamed: the body is passed from one fixed receive buffer
+ * to the output as it arrives, with Content-Length, chunked and read-to-
+ * close framing. Connections are HTTP/1.1 keep-alive and stay in a small
+ * pool (with the getaddrinfo() answers) for the life of the shell, so
+ * health checks against the same endpoints pay one handshake, not one
+ * per request.
  * ============================================================================ */
 
 #include "builtins.h"
 #include "shell.h"
+#include "output.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <ctype.h>
+#include <time.h>
+#include <signal.h>
+#include <stddef.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netdb.h>
@@ -20,6 +33,15 @@
 #define HTTP_MAX_REDIRECTS 5
 #define HTTP_RECV_BUFSZ    8192
 #define HTTP_TIMEOUT_SEC   10
+#define HTTP_LINE_MAX      8192    /* Status, header or chunk-size line */
+#define HTTP_HEADER_MAX    32768   /* All response header fields */
+#define HTTP_POOL_SIZE     8       /* Idle keep-alive connections kept */
+#define HTTP_IDLE_SEC      30      /* ... for at most this long */
+#define HTTP_DNS_SLOTS     16
+#define HTTP_DNS_TTL       60
+
+#define HTTP_USAGE "Usage: httpfetch [-H] [-v] [-o FILE] URL...\n" \
+                   "       httpfetch -P N [-J] [URL...]\n"
 
 /* ---- URL parsing -------------------------------------------------------- */
 
@@ -97,16 +119,38 @@ static int parse_url(const char *url, ParsedURL *out) {
     return 0;
 }
 
-/* ---- HTTP fetch core ---------------------------------------------------- */
+/* ---- Address cache ------------------------------------------------------ */
 
-/*
- * Perform a single HTTP GET and collect the full response into a
- * dynamically allocated buffer.  Caller must free *response.
- * Returns 0 on success, -1 on error.
- */
-static int http_get(const ParsedURL *url, int verbose,
-                    char **response, size_t *resp_len) {
-    struct addrinfo hints, *res, *rp;
+typedef struct DnsEntry {
+    char             host[256];
+    char             port[8];
+    struct addrinfo *res;
+    time_t           expires;
+} DnsEntry;
+
+static DnsEntry dns_cache[HTTP_DNS_SLOTS];
+
+/* getaddrinfo() through a small cache, so repeated fetches from the same
+ * host skip the lookup for HTTP_DNS_TTL seconds. Returns NULL (after
+ * printing why) on failure. */
+static const struct addrinfo *resolve(const ParsedURL *url) {
+    time_t now = time(NULL);
+    DnsEntry *slot = &dns_cache[0];
+
+    for (int i = 0; i < HTTP_DNS_SLOTS; i++) {
+        DnsEntry *e = &dns_cache[i];
+        if (e->res && strcmp(e->host, url->host) == 0 &&
+            strcmp(e->port, url->port) == 0) {
+            if (e->expires > now)
+                return e->res;
+            slot = e;
+            break;
+        }
+        if (e->expires < slot->expires)
+            slot = e;
+    }
+
+    struct addrinfo hints, *res;
     memset(&hints, 0, sizeof(hints));
     hints.ai_family   = AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;
@@ -115,114 +159,205 @@ static int http_get(const ParsedURL *url, int verbose,
     if (gai != 0) {
         fprintf(stderr, "vsh: httpfetch: DNS resolution failed for '%s': %s\n",
                 url->host, gai_strerror(gai));
-        return -1;
+        return NULL;
     }
 
-    int sockfd = -1;
-    for (rp = res; rp != NULL; rp = rp->ai_next) {
-        sockfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-        if (sockfd == -1) continue;
+    if (slot->res)
+        freeaddrinfo(slot->res);
+    snprintf(slot->host, sizeof(slot->host), "%s", url->host);
+    snprintf(slot->port, sizeof(slot->port), "%s", url->port);
+    slot->res     = res;
+    slot->expires = now + HTTP_DNS_TTL;
+    return res;
+}
+
+/* ---- Connection pool ---------------------------------------------------- */
+
+/* A connection and its receive buffer. Idle keep-alive connections stay
+ * in the pool between invocations and are picked up by host and port. */
+typedef struct HttpConn {
+    bool   open;
+    int    fd;
+    int    err;                    /* errno of the last failure, 0 = EOF */
+    char   host[256];
+    char   port[8];
+    time_t idle_since;
+    char   buf[HTTP_RECV_BUFSZ];   /* Received but not yet consumed */
+    size_t pos;
+    size_t len;
+} HttpConn;
+
+static HttpConn conn_pool[HTTP_POOL_SIZE];
+
+static void conn_close(HttpConn *c) {
+    if (c->open)
+        close(c->fd);
+    c->open = false;
+    c->pos  = 0;
+    c->len  = 0;
+}
+
+static int connect_to(const ParsedURL *url) {
+    const struct addrinfo *res = resolve(url);
+    if (!res)
+        return -1;
 
-        /* Set receive timeout */
+    int sockfd = -1, err = 0;
+    for (const struct addrinfo *rp = res; rp != NULL; rp = rp->ai_next) {
+        sockfd = socket(rp->ai_family, rp->ai_socktype | SOCK_CLOEXEC,
+                        rp->ai_protocol);
+        if (sockfd == -1) {
+            err = errno;
+            continue;
+        }
+
+        /* Set send/receive timeouts */
         struct timeval tv;
         tv.tv_sec  = HTTP_TIMEOUT_SEC;
         tv.tv_usec = 0;
         setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
         setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
 
-        if (connect(sockfd, rp->ai_addr, rp->ai_addrlen) == 0) break;
+        if (connect(sockfd, rp->ai_addr, rp->ai_addrlen) == 0)
+            break;
 
+        err = errno;
         close(sockfd);
         sockfd = -1;
     }
-    freeaddrinfo(res);
 
-    if (sockfd == -1) {
+    if (sockfd == -1)
         fprintf(stderr, "vsh: httpfetch: connection to %s:%s failed: %s\n",
-                url->host, url->port, strerror(errno));
-        return -1;
-    }
+                url->host, url->port, strerror(err));
+    return sockfd;
+}
 
-    /* Build HTTP request */
-    char request[4096];
-    int rlen = snprintf(request, sizeof(request),
-        "GET %s HTTP/1.1\r\n"
-        "Host: %s\r\n"
-        "User-Agent: vsh/1.0.0\r\n"
-        "Accept: */*\r\n"
-        "Connection: close\r\n"
-        "\r\n",
-        url->path, url->host);
+/* An idle pooled connection to url's host, or a new one in the slot that
+ * has been idle longest. *reused tells which. */
+static HttpConn *conn_acquire(const ParsedURL *url, bool *reused) {
+    time_t now = time(NULL);
+    HttpConn *slot = &conn_pool[0];
 
-    if (verbose) {
-        fprintf(stderr, "\033[2m> GET %s HTTP/1.1\033[0m\n", url->path);
-        fprintf(stderr, "\033[2m> Host: %s\033[0m\n", url->host);
-        fprintf(stderr, "\033[2m> User-Agent: vsh/1.0.0\033[0m\n");
-        fprintf(stderr, "\033[2m> Accept: */*\033[0m\n");
-        fprintf(stderr, "\033[2m> Connection: close\033[0m\n");
-        fprintf(stderr, "\033[2m>\033[0m\n");
+    for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+        HttpConn *c = &conn_pool[i];
+        if (c->open && now - c->idle_since > HTTP_IDLE_SEC)
+            conn_close(c);
+        if (c->open && strcmp(c->host, url->host) == 0 &&
+            strcmp(c->port, url->port) == 0) {
+            *reused = true;
+            return c;
+        }
+        if (slot->open && (!c->open || c->idle_since < slot->idle_since))
+            slot = c;
     }
 
-    /* Send request */
-    ssize_t sent = 0;
-    while (sent < rlen) {
-        ssize_t n = send(sockfd, request + sent, rlen - sent, 0);
-        if (n <= 0) {
-            fprintf(stderr, "vsh: httpfetch: send failed: %s\n", strerror(errno));
-            close(sockfd);
+    conn_close(slot);
+    int fd = connect_to(url);
+    if (fd < 0)
+        return NULL;
+    slot->open = true;
+    slot->fd   = fd;
+    slot->err  = 0;
+    snprintf(slot->host, sizeof(slot->host), "%s", url->host);
+    snprintf(slot->port, sizeof(slot->port), "%s", url->port);
+    *reused = false;
+    return slot;
+}
+
+/* Return a connection after its response was read in full */
+static void conn_release(HttpConn *c, bool keep_alive) {
+    if (keep_alive && c->pos == c->len)
+        c->idle_since = time(NULL);
+    else
+        conn_close(c);
+}
+
+static void report_io_error(int err) {
+    if (err == EAGAIN || err == EWOULDBLOCK)
+        fprintf(stderr, "vsh: httpfetch: connection timed out\n");
+    else if (err == 0)
+        fprintf(stderr, "vsh: httpfetch: connection closed by server\n");
+    else if (err == EPROTO)
+        fprintf(stderr, "vsh: httpfetch: malformed response\n");
+    else
+        fprintf(stderr, "vsh: httpfetch: %s\n", strerror(err));
+}
+
+/* ---- Buffered reading --------------------------------------------------- */
+
+/* Make sure unread bytes are buffered: 1 = data, 0 = closed, -1 = error */
+static int conn_fill(HttpConn *c) {
+    if (c->pos < c->len)
+        return 1;
+    for (;;) {
+        ssize_t n = recv(c->fd, c->buf, sizeof(c->buf), 0);
+        if (n > 0) {
+            c->pos = 0;
+            c->len = (size_t)n;
+            return 1;
+        }
+        if (n == 0) {
+            c->err = 0;
+            return 0;
+        }
+        if (errno != EINTR) {
+            c->err = errno;
             return -1;
         }
-        sent += n;
-    }
-
-    /* Read response into dynamic buffer */
-    size_t capacity = HTTP_RECV_BUFSZ;
-    size_t total = 0;
-    char *buf = malloc(capacity);
-    if (!buf) {
-        fprintf(stderr, "vsh: httpfetch: out of memory\n");
-        close(sockfd);
-        return -1;
     }
+}
 
+/* Read one line without its CRLF. Returns its length, or -1 if the
+ * connection failed or the line does not fit in cap. */
+static int conn_read_line(HttpConn *c, char *line, size_t cap) {
+    size_t n = 0;
     for (;;) {
-        if (total + HTTP_RECV_BUFSZ > capacity) {
-            capacity *= 2;
-            char *newbuf = realloc(buf, capacity);
-            if (!newbuf) {
-                fprintf(stderr, "vsh: httpfetch: out of memory\n");
-                free(buf);
-                close(sockfd);
-                return -1;
-            }
-            buf = newbuf;
-        }
-        ssize_t n = recv(sockfd, buf + total, HTTP_RECV_BUFSZ, 0);
-        if (n < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                fprintf(stderr, "vsh: httpfetch: connection timed out\n");
-                free(buf);
-                close(sockfd);
-                return -1;
-            }
-            fprintf(stderr, "vsh: httpfetch: recv error: %s\n", strerror(errno));
-            free(buf);
-            close(sockfd);
+        if (conn_fill(c) <= 0)
+            return -1;
+        const char *start = c->buf + c->pos;
+        size_t avail = c->len - c->pos;
+        const char *nl = memchr(start, '\n', avail);
+        size_t take = nl ? (size_t)(nl - start) : avail;
+        if (n + take >= cap) {
+            c->err = EPROTO;
             return -1;
         }
-        if (n == 0) break;  /* connection closed */
-        total += n;
+        memcpy(line + n, start, take);
+        n += take;
+        c->pos += take + (nl ? 1 : 0);
+        if (nl)
+            break;
     }
-    close(sockfd);
+    if (n > 0 && line[n - 1] == '\r')
+        n--;
+    line[n] = '\0';
+    return (int)n;
+}
 
-    /* Null-terminate for easy string handling */
-    buf = realloc(buf, total + 1);
-    if (buf) buf[total] = '\0';
+/* ---- Responses ---------------------------------------------------------- */
 
-    *response = buf;
-    *resp_len = total;
-    return 0;
-}
+typedef enum {
+    BODY_NONE,          /* 1xx, 204, 304 */
+    BODY_LENGTH,        /* Content-Length bytes */
+    BODY_CHUNKED,       /* Transfer-Encoding: chunked */
+    BODY_UNTIL_CLOSE    /* Neither: the server closes when done */
+} BodyKind;
+
+typedef struct HttpResponse {
+    int                status;
+    bool               keep_alive;
+    BodyKind           body;
+    unsigned long long length;
+    size_t             hdr_len;
+    char               headers[HTTP_HEADER_MAX];  /* CRLF-separated */
+} HttpResponse;
+
+/* Where a body goes: an output buffer, or nowhere (out == NULL) */
+typedef struct BodySink {
+    OutBuf            *out;
+    unsigned long long bytes;
+    int                last;    /* Last byte written */
+} BodySink;
 
 /* Case-insensitive search for a header value.  Returns pointer into buf. */
 static const char *find_header(const char *headers, size_t hdr_len,
@@ -244,6 +379,17 @@ static const char *find_header(const char *headers, size_t hdr_len,
     return NULL;
 }
 
+/* Whether header name's value contains token (case-insensitive) */
+static bool header_has(const HttpResponse *resp, const char *name,
+                       const char *token) {
+    const char *val = find_header(resp->headers, resp->hdr_len, name);
+    if (!val)
+        return false;
+    const char *eol = strstr(val, "\r\n");
+    const char *hit = strcasestr(val, token);
+    return hit && (!eol || hit < eol);
+}
+
 static int extract_status_code(const char *response) {
     /* "HTTP/1.x NNN ..." */
     const char *sp = strchr(response, ' ');
@@ -251,46 +397,254 @@ static int extract_status_code(const char *response) {
     return atoi(sp + 1);
 }
 
-/* ---- Main entry point --------------------------------------------------- */
+/* Read the status line and header fields, skipping interim 1xx responses,
+ * and work out how the body is framed. */
+static int read_response_head(HttpConn *c, HttpResponse *resp) {
+    char line[HTTP_LINE_MAX];
+
+    do {
+        resp->hdr_len = 0;
+        resp->headers[0] = '\0';
+        for (;;) {
+            int n = conn_read_line(c, line, sizeof(line));
+            if (n < 0)
+                return -1;
+            if (n == 0 && resp->hdr_len > 0)
+                break;
+            if (resp->hdr_len + (size_t)n + 3 > sizeof(resp->headers)) {
+                c->err = EPROTO;
+                return -1;
+            }
+            memcpy(resp->headers + resp->hdr_len, line, (size_t)n);
+            resp->hdr_len += (size_t)n;
+            memcpy(resp->headers + resp->hdr_len, "\r\n", 3);
+            resp->hdr_len += 2;
+        }
+        if (strncmp(resp->headers, "HTTP/", 5) != 0) {
+            c->err = EPROTO;
+            return -1;
+        }
+        resp->status = extract_status_code(resp->headers);
+    } while (resp->status >= 100 && resp->status < 200);
+
+    bool http10 = strncmp(resp->headers, "HTTP/1.0", 8) == 0;
+    resp->keep_alive = http10 ? header_has(resp, "Connection", "keep-alive")
+                              : !header_has(resp, "Connection", "close");
+
+    const char *cl = find_header(resp->headers, resp->hdr_len,
+                                 "Content-Length");
+    if (resp->status == 204 || resp->status == 304) {
+        resp->body = BODY_NONE;
+    } else if (header_has(resp, "Transfer-Encoding", "chunked")) {
+        resp->body = BODY_CHUNKED;
+    } else if (cl) {
+        resp->body   = BODY_LENGTH;
+        resp->length = strtoull(cl, NULL, 10);
+    } else {
+        resp->body       = BODY_UNTIL_CLOSE;
+        resp->keep_alive = false;
+    }
+    return 0;
+}
+
+/* Pass n buffered/received bytes (or everything up to EOF) to the sink,
+ * one receive buffer at a time */
+static int copy_bytes(HttpConn *c, unsigned long long n, bool until_close,
+                      BodySink *sink) {
+    while (until_close || n > 0) {
+        int r = conn_fill(c);
+        if (r == 0 && until_close)
+            return 0;
+        if (r <= 0)
+            return -1;
+
+        size_t avail = c->len - c->pos;
+        if (!until_close && avail > n)
+            avail = (size_t)n;
+        const char *data = c->buf + c->pos;
+        if (sink->out)
+            out_write(sink->out, data, avail);
+        sink->last   = (unsigned char)data[avail - 1];
+        sink->bytes += avail;
+        c->pos      += avail;
+        if (!until_close)
+            n -= avail;
+    }
+    return 0;
+}
+
+static int read_body(HttpConn *c, const HttpResponse *resp, BodySink *sink) {
+    switch (resp->body) {
+    case BODY_NONE:        return 0;
+    case BODY_LENGTH:      return copy_bytes(c, resp->length, false, sink);
+    case BODY_UNTIL_CLOSE: return copy_bytes(c, 0, true, sink);
+    case BODY_CHUNKED:     break;
+    }
+
+    /* size-in-hex [;extensions] CRLF data CRLF ... 0 CRLF trailers CRLF */
+    char line[HTTP_LINE_MAX];
+    for (;;) {
+        if (conn_read_line(c, line, sizeof(line)) < 0)
+            return -1;
+        char *endp;
+        unsigned long long size = strtoull(line, &endp, 16);
+        if (endp == line) {
+            c->err = EPROTO;
+            return -1;
+        }
+        if (size == 0)
+            break;
+        if (copy_bytes(c, size, false, sink) < 0)
+            return -1;
+        if (conn_read_line(c, line, sizeof(line)) != 0) {
+            c->err = EPROTO;
+            return -1;
+        }
+    }
+
+    int n;
+    while ((n = conn_read_line(c, line, sizeof(line))) > 0)
+        ;
+    return n == 0 ? 0 : -1;
+}
+
+/* ---- HTTP fetch core ---------------------------------------------------- */
+
+typedef struct FetchOpts {
+    bool    headers_only;
+    bool    verbose;
+    OutBuf *out;
+} FetchOpts;
+
+static int send_all(HttpConn *c, const char *buf, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(c->fd, buf + sent, len - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            c->err = n < 0 ? errno : EPIPE;
+            return -1;
+        }
+        sent += (size_t)n;
+    }
+    return 0;
+}
 
 /*
- * httpfetch [-H] [-v] URL
- *
- * Fetch content from a URL over HTTP using raw sockets.
- *   -H  Show response headers only
- *   -v  Verbose: show request and response headers
+ * Send a GET for url and read the response head. On success *out is the
+ * connection, positioned at the start of the body. A pooled connection the
+ * server has since dropped is replaced by a fresh one transparently.
  */
-int builtin_httpfetch(Shell *shell, int argc, char **argv) {
-    (void)shell;
+static int http_get(const ParsedURL *url, bool verbose, HttpResponse *resp,
+                    HttpConn **out) {
+    char request[4096];
+    int rlen = snprintf(request, sizeof(request),
+        "GET %s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "User-Agent: vsh/1.0.0\r\n"
+        "Accept: */*\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n",
+        url->path, url->host);
+    if (rlen < 0 || (size_t)rlen >= sizeof(request)) {
+        fprintf(stderr, "vsh: httpfetch: URL too long\n");
+        return -1;
+    }
 
-    int headers_only = 0;
-    int verbose = 0;
-    const char *url_str = NULL;
+    if (verbose) {
+        fprintf(stderr, "\033[2m> GET %s HTTP/1.1\033[0m\n", url->path);
+        fprintf(stderr, "\033[2m> Host: %s\033[0m\n", url->host);
+        fprintf(stderr, "\033[2m> User-Agent: vsh/1.0.0\033[0m\n");
+        fprintf(stderr, "\033[2m> Accept: */*\033[0m\n");
+        fprintf(stderr, "\033[2m> Connection: keep-alive\033[0m\n");
+        fprintf(stderr, "\033[2m>\033[0m\n");
+    }
 
-    /* Parse options */
-    for (int i = 1; i < argc; i++) {
-        if (argv[i][0] == '-' && argv[i][1] != '\0') {
-            for (int j = 1; argv[i][j]; j++) {
-                switch (argv[i][j]) {
-                case 'H': headers_only = 1; break;
-                case 'v': verbose = 1;      break;
-                default:
-                    fprintf(stderr, "vsh: httpfetch: unknown option '-%c'\n",
-                            argv[i][j]);
-                    fprintf(stderr, "Usage: httpfetch [-H] [-v] URL\n");
-                    return 1;
-                }
-            }
-        } else {
-            url_str = argv[i];
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = false;
+        HttpConn *c = conn_acquire(url, &reused);
+        if (!c)
+            return -1;
+
+        resp->hdr_len = 0;
+        if (send_all(c, request, (size_t)rlen) == 0 &&
+            read_response_head(c, resp) == 0) {
+            *out = c;
+            return 0;
         }
+
+        bool got_reply = resp->hdr_len > 0;
+        int err = c->err;
+        conn_close(c);
+        if (reused && !got_reply)
+            continue;   /* Idle connection closed by the server: reconnect */
+        report_io_error(err);
+        return -1;
     }
+    return -1;
+}
 
-    if (!url_str) {
-        fprintf(stderr, "Usage: httpfetch [-H] [-v] URL\n");
-        return 1;
+static bool is_redirect(int status) {
+    return status == 301 || status == 302 || status == 303 ||
+           status == 307 || status == 308;
+}
+
+/* Follow a Location header; returns 0 with url updated */
+static int follow_location(const char *loc, size_t loc_len, ParsedURL *url,
+                           bool verbose) {
+    char loc_str[2048];
+    if (loc_len >= sizeof(loc_str)) loc_len = sizeof(loc_str) - 1;
+    memcpy(loc_str, loc, loc_len);
+    loc_str[loc_len] = '\0';
+
+    if (verbose) {
+        fprintf(stderr, "\033[33m-> Redirecting to: %s\033[0m\n\n", loc_str);
+    }
+
+    /* Parse new URL - handle relative redirects */
+    if (strncmp(loc_str, "http://", 7) == 0 ||
+        strncmp(loc_str, "https://", 8) == 0) {
+        if (parse_url(loc_str, url) != 0) {
+            fprintf(stderr, "vsh: httpfetch: invalid redirect URL '%s'\n",
+                    loc_str);
+            return -1;
+        }
+        if (strcasecmp(url->scheme, "https") == 0) {
+            fprintf(stderr, "vsh: httpfetch: warning: redirect to HTTPS "
+                    "not supported\n");
+            strcpy(url->port, "80");
+        }
+    } else {
+        /* Relative redirect - keep host, update path */
+        strncpy(url->path, loc_str, sizeof(url->path) - 1);
+        url->path[sizeof(url->path) - 1] = '\0';
     }
+    return 0;
+}
+
+/* Print the status line and (for -v/-H) the header fields to stderr */
+static void print_head(const HttpResponse *resp) {
+    const char *hp = resp->headers;
+    const char *end = resp->headers + resp->hdr_len;
+    const char *le = strstr(hp, "\r\n");
+
+    int code = resp->status;
+    const char *color = (code >= 200 && code < 300) ? "\033[32m" :
+                        (code >= 300 && code < 400) ? "\033[33m" :
+                        "\033[31m";
+    fprintf(stderr, "%s%.*s\033[0m\n", color, (int)(le - hp), hp);
 
+    for (hp = le + 2; hp < end; hp = le + 2) {
+        le = strstr(hp, "\r\n");
+        if (!le) break;
+        fprintf(stderr, "\033[2m< %.*s\033[0m\n", (int)(le - hp), hp);
+    }
+    fprintf(stderr, "\n");
+}
+
+/* Fetch one URL, following redirects, streaming the body to opt->out */
+static int fetch_url(const char *url_str, const FetchOpts *opt) {
     ParsedURL url;
     if (parse_url(url_str, &url) != 0) {
         fprintf(stderr, "vsh: httpfetch: invalid URL '%s'\n", url_str);
@@ -308,121 +662,638 @@ int builtin_httpfetch(Shell *shell, int argc, char **argv) {
         return 1;
     }
 
-    int redirects = 0;
+    static HttpResponse resp;   /* Too big for the stack */
+
+    for (int redirects = 0; ; redirects++) {
+        HttpConn *c = NULL;
+        if (http_get(&url, opt->verbose, &resp, &c) != 0)
+            return 1;
 
-    while (redirects <= HTTP_MAX_REDIRECTS) {
-        char *response = NULL;
-        size_t resp_len = 0;
+        if (opt->verbose || opt->headers_only)
+            print_head(&resp);
 
-        if (http_get(&url, verbose, &response, &resp_len) != 0) {
+        /* Check for redirect */
+        const char *loc = is_redirect(resp.status)
+                        ? find_header(resp.headers, resp.hdr_len, "Location")
+                        : NULL;
+        if (loc) {
+            if (redirects >= HTTP_MAX_REDIRECTS) {
+                fprintf(stderr, "vsh: httpfetch: too many redirects\n");
+                conn_close(c);
+                return 1;
+            }
+            const char *loc_end = strstr(loc, "\r\n");
+            size_t loc_len = loc_end ? (size_t)(loc_end - loc) : strlen(loc);
+            int rc = follow_location(loc, loc_len, &url, opt->verbose);
+
+            /* Drain the (small) redirect body so the connection is reusable */
+            BodySink discard = { NULL, 0, 0 };
+            if (read_body(c, &resp, &discard) == 0)
+                conn_release(c, resp.keep_alive);
+            else
+                conn_close(c);
+            if (rc != 0)
+                return 1;
+            continue;
+        }
+
+        BodySink sink = { opt->out, 0, '\n' };
+        if (opt->headers_only) {
+            /* Not worth downloading a body nobody reads */
+            conn_release(c, resp.keep_alive && resp.body == BODY_NONE);
+        } else if (read_body(c, &resp, &sink) != 0) {
+            report_io_error(c->err);
+            conn_close(c);
             return 1;
+        } else {
+            conn_release(c, resp.keep_alive);
         }
 
-        /* Find header/body separator */
-        char *sep = strstr(response, "\r\n\r\n");
-        if (!sep) {
-            /* No proper separator - print everything */
-            fwrite(response, 1, resp_len, stdout);
-            free(response);
-            return 0;
+        /* Ensure the prompt starts on a fresh line */
+        if (opt->out->fd == STDOUT_FILENO && sink.last != '\n' &&
+            isatty(STDOUT_FILENO))
+            out_putc(opt->out, '\n');
+        if (out_flush(opt->out) < 0) {
+            report_io_error(errno);
+            return 1;
+        }
+
+        return (resp.status >= 200 && resp.status < 400) ? 0 : 1;
+    }
+}
+
+/* ---- Concurrent probes -------------------------------------------------- */
+
+/*
+ * httpfetch -P N checks many URLs at once: up to N non-blocking sockets are
+ * driven by one epoll loop, and each result (status, latency, body bytes)
+ * is printed as soon as it is known. Bodies are counted, not kept.
+ */
+
+#define PROBE_DEFAULT_PARALLEL 16
+#define PROBE_HEAD_MAX         8192
+
+typedef enum {
+    PROBE_IDLE,
+    PROBE_CONNECT,
+    PROBE_SEND,
+    PROBE_HEAD,
+    PROBE_BODY
+} ProbeState;
+
+typedef enum { CH_SIZE, CH_DATA, CH_DATA_END } ChunkState;
+
+typedef struct Probe {
+    ProbeState         state;
+    const char        *url;
+    int                fd;
+    struct timespec    start;
+    size_t             req_len;
+    size_t             sent;
+    size_t             head_len;
+    int                status;
+    BodyKind           body;
+    unsigned long long remaining;   /* BODY_LENGTH bytes, or of this chunk */
+    unsigned long long bytes;       /* Body bytes received */
+    ChunkState         chunk_state;
+    unsigned long long chunk;       /* Size line being parsed */
+    bool               chunk_digits;
+    bool               chunk_ext;
+    /* Buffers last: probe_start() clears everything before them */
+    char               req[4096];
+    char               head[PROBE_HEAD_MAX];
+} Probe;
+
+typedef struct ProbeRun {
+    OutBuf *out;
+    int    epfd;
+    bool   json;
+    int    failed;
+} ProbeRun;
+
+static volatile sig_atomic_t probe_interrupted = 0;
+
+static void probe_sigint_handler(int sig) {
+    (void)sig;
+    probe_interrupted = 1;
+}
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1e3 +
+           (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void json_string(OutBuf *out, const char *s) {
+    out_putc(out, '"');
+    for (; *s; s++) {
+        unsigned char ch = (unsigned char)*s;
+        if (ch == '"' || ch == '\\')
+            out_printf(out, "\\%c", ch);
+        else if (ch < 0x20)
+            out_printf(out, "\\u%04x", ch);
+        else
+            out_putc(out, (char)ch);
+    }
+    out_putc(out, '"');
+}
+
+/* Report a probe's outcome (error == NULL: it got a response) and free
+ * its slot */
+static void probe_finish(ProbeRun *run, Probe *p, const char *error) {
+    OutBuf *out = run->out;
+    double ms = elapsed_ms(&p->start);
+    bool ok = !error && p->status >= 200 && p->status < 400;
+    if (!ok)
+        run->failed++;
+
+    if (run->json) {
+        out_puts(out, "{\"url\":");
+        json_string(out, p->url);
+        if (error) {
+            out_printf(out, ",\"status\":null,\"ms\":%.2f,\"bytes\":%llu,"
+                       "\"error\":", ms, p->bytes);
+            json_string(out, error);
+            out_puts(out, "}\n");
+        } else {
+            out_printf(out, ",\"status\":%d,\"ms\":%.2f,\"bytes\":%llu}\n",
+                       p->status, ms, p->bytes);
         }
+    } else if (error) {
+        out_printf(out, "ERR %9.2f %10llu %s (%s)\n", ms, p->bytes, p->url,
+                   error);
+    } else {
+        out_printf(out, "%3d %9.2f %10llu %s\n", p->status, ms, p->bytes,
+                   p->url);
+    }
+    out_flush(out);     /* Each result as soon as it is known */
+
+    if (p->fd >= 0)
+        close(p->fd);   /* Also drops it from the epoll set */
+    p->fd    = -1;
+    p->state = PROBE_IDLE;
+}
 
-        size_t hdr_len = sep - response;
-        char *body = sep + 4;
-        size_t body_len = resp_len - (body - response);
-
-        /* Print status line */
-        char *first_line_end = strstr(response, "\r\n");
-        if (first_line_end) {
-            if (verbose || headers_only) {
-                int code = extract_status_code(response);
-                const char *color = (code >= 200 && code < 300) ? "\033[32m" :
-                                    (code >= 300 && code < 400) ? "\033[33m" :
-                                    "\033[31m";
-                fprintf(stderr, "%s%.*s\033[0m\n", color,
-                        (int)(first_line_end - response), response);
+/* Count body bytes; returns true once the body is complete */
+static bool probe_body(Probe *p, const char *data, size_t len) {
+    switch (p->body) {
+    case BODY_NONE:
+        return true;
+    case BODY_UNTIL_CLOSE:
+        p->bytes += len;
+        return false;
+    case BODY_LENGTH: {
+        size_t take = len < p->remaining ? len : (size_t)p->remaining;
+        p->bytes     += take;
+        p->remaining -= take;
+        return p->remaining == 0;
+    }
+    case BODY_CHUNKED:
+        break;
+    }
+
+    size_t i = 0;
+    while (i < len) {
+        switch (p->chunk_state) {
+        case CH_SIZE: {
+            char c = data[i++];
+            if (c == '\n') {
+                if (p->chunk == 0)
+                    return true;   /* Last chunk; trailers are not needed */
+                p->remaining    = p->chunk;
+                p->chunk        = 0;
+                p->chunk_digits = false;
+                p->chunk_ext    = false;
+                p->chunk_state  = CH_DATA;
+            } else if (!p->chunk_ext && isxdigit((unsigned char)c)) {
+                int v = isdigit((unsigned char)c) ? c - '0'
+                                                  : (tolower(c) - 'a') + 10;
+                p->chunk = p->chunk * 16 + (unsigned)v;
+                p->chunk_digits = true;
+            } else {
+                p->chunk_ext = true;   /* ";extension" or CR */
             }
+            break;
+        }
+        case CH_DATA: {
+            size_t take = len - i < p->remaining ? len - i
+                                                 : (size_t)p->remaining;
+            p->bytes     += take;
+            p->remaining -= take;
+            i += take;
+            if (p->remaining == 0)
+                p->chunk_state = CH_DATA_END;
+            break;
+        }
+        case CH_DATA_END:
+            if (data[i++] == '\n')
+                p->chunk_state = CH_SIZE;
+            break;
         }
+    }
+    return false;
+}
+
+/* The response head is complete in p->head: pick up status and framing */
+static void probe_parse_head(Probe *p, size_t head_len) {
+    static HttpResponse resp;
+    memcpy(resp.headers, p->head, head_len);
+    resp.headers[head_len] = '\0';
+    resp.hdr_len = head_len;
+
+    p->status = extract_status_code(resp.headers);
+    const char *cl = find_header(resp.headers, resp.hdr_len, "Content-Length");
+    if (p->status == 204 || p->status == 304 ||
+        (p->status >= 100 && p->status < 200)) {
+        p->body = BODY_NONE;
+    } else if (header_has(&resp, "Transfer-Encoding", "chunked")) {
+        p->body = BODY_CHUNKED;
+    } else if (cl) {
+        p->body      = BODY_LENGTH;
+        p->remaining = strtoull(cl, NULL, 10);
+    } else {
+        p->body = BODY_UNTIL_CLOSE;
+    }
+}
+
+/* Read what is available; finishes the probe on completion or error */
+static void probe_read(ProbeRun *run, Probe *p) {
+    static char buf[65536];
 
-        /* Verbose/headers: print response headers */
-        if (verbose || headers_only) {
-            const char *hp = first_line_end ? first_line_end + 2 : response;
-            while (hp < sep) {
-                const char *le = strstr(hp, "\r\n");
-                if (!le) break;
-                fprintf(stderr, "\033[2m< %.*s\033[0m\n", (int)(le - hp), hp);
-                hp = le + 2;
+    for (;;) {
+        ssize_t n = recv(p->fd, buf, sizeof(buf), 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                probe_finish(run, p, strerror(errno));
+            return;
+        }
+        if (n == 0) {
+            if (p->state == PROBE_HEAD)
+                probe_finish(run, p, "connection closed by server");
+            else if (p->body == BODY_UNTIL_CLOSE)
+                probe_finish(run, p, NULL);
+            else
+                probe_finish(run, p, "truncated body");
+            return;
+        }
+
+        const char *data = buf;
+        size_t len = (size_t)n;
+        if (p->state == PROBE_HEAD) {
+            size_t room = sizeof(p->head) - 1 - p->head_len;
+            size_t take = len < room ? len : room;
+            memcpy(p->head + p->head_len, buf, take);
+            p->head_len += take;
+            p->head[p->head_len] = '\0';
+
+            char *end = strstr(p->head, "\r\n\r\n");
+            if (!end) {
+                if (p->head_len >= sizeof(p->head) - 1)
+                    probe_finish(run, p, "response headers too large");
+                else
+                    continue;
+                return;
+            }
+            size_t head_len = (size_t)(end - p->head) + 2;
+            probe_parse_head(p, head_len);
+            p->state = PROBE_BODY;
+
+            /* Whatever followed the blank line is body */
+            size_t used = (size_t)(end + 4 - p->head) - (p->head_len - take);
+            data = buf + used;
+            len  = len - used;
+            if (p->body == BODY_NONE) {
+                probe_finish(run, p, NULL);
+                return;
+            }
+        }
+        if (probe_body(p, data, len)) {
+            probe_finish(run, p, NULL);
+            return;
+        }
+    }
+}
+
+/* Drive one probe forward after an epoll event */
+static void probe_advance(ProbeRun *run, Probe *p) {
+    if (p->state == PROBE_CONNECT) {
+        int err = 0;
+        socklen_t elen = sizeof(err);
+        getsockopt(p->fd, SOL_SOCKET, SO_ERROR, &err, &elen);
+        if (err) {
+            probe_finish(run, p, strerror(err));
+            return;
+        }
+        p->state = PROBE_SEND;
+    }
+
+    if (p->state == PROBE_SEND) {
+        while (p->sent < p->req_len) {
+            ssize_t n = send(p->fd, p->req + p->sent, p->req_len - p->sent,
+                             MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
+            if (n < 0) {
+                probe_finish(run, p, strerror(errno));
+                return;
             }
-            fprintf(stderr, "\n");
+            p->sent += (size_t)n;
         }
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = p };
+        epoll_ctl(run->epfd, EPOLL_CTL_MOD, p->fd, &ev);
+        p->state = PROBE_HEAD;
+        return;
+    }
 
-        /* Check for redirect */
-        int status = extract_status_code(response);
-        if ((status == 301 || status == 302 || status == 303 ||
-             status == 307 || status == 308) && redirects < HTTP_MAX_REDIRECTS) {
-            const char *loc = find_header(response, hdr_len, "Location");
-            if (loc) {
-                /* Extract location value until \r\n */
-                const char *loc_end = strstr(loc, "\r\n");
-                size_t loc_len = loc_end ? (size_t)(loc_end - loc) : strlen(loc);
-                char loc_str[2048];
-                if (loc_len >= sizeof(loc_str)) loc_len = sizeof(loc_str) - 1;
-                memcpy(loc_str, loc, loc_len);
-                loc_str[loc_len] = '\0';
-
-                if (verbose) {
-                    fprintf(stderr, "\033[33m-> Redirecting to: %s\033[0m\n\n",
-                            loc_str);
-                }
+    probe_read(run, p);
+}
+
+/* Begin a probe in slot p: resolve, open a non-blocking socket, connect */
+static void probe_start(ProbeRun *run, Probe *p, const char *url_str) {
+    memset(p, 0, offsetof(Probe, req));
+    p->url = url_str;
+    p->fd  = -1;
+    clock_gettime(CLOCK_MONOTONIC, &p->start);
+
+    ParsedURL url;
+    if (parse_url(url_str, &url) != 0 ||
+        (strcasecmp(url.scheme, "http") != 0 &&
+         strcasecmp(url.scheme, "https") != 0)) {
+        probe_finish(run, p, "invalid URL");
+        return;
+    }
+    if (strcasecmp(url.scheme, "https") == 0)
+        strcpy(url.port, "80");
+
+    const struct addrinfo *ai = resolve(&url);
+    if (!ai) {
+        probe_finish(run, p, "DNS resolution failed");
+        return;
+    }
+
+    int rlen = snprintf(p->req, sizeof(p->req),
+        "GET %s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "User-Agent: vsh/1.0.0\r\n"
+        "Accept: */*\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        url.path, url.host);
+    if (rlen < 0 || (size_t)rlen >= sizeof(p->req)) {
+        probe_finish(run, p, "URL too long");
+        return;
+    }
+    p->req_len = (size_t)rlen;
+
+    p->fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                   ai->ai_protocol);
+    if (p->fd < 0) {
+        probe_finish(run, p, strerror(errno));
+        return;
+    }
+    p->state = PROBE_SEND;
+    if (connect(p->fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+        if (errno != EINPROGRESS) {
+            probe_finish(run, p, strerror(errno));
+            return;
+        }
+        p->state = PROBE_CONNECT;
+    }
+
+    struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = p };
+    if (epoll_ctl(run->epfd, EPOLL_CTL_ADD, p->fd, &ev) < 0)
+        probe_finish(run, p, strerror(errno));
+}
+
+/* Run every URL through at most `parallel` concurrent probes. Returns the
+ * number of URLs that failed or answered with a 4xx/5xx status. */
+static int probe_urls(OutBuf *out, char **urls, int nurls, int parallel,
+                      bool json) {
+    ProbeRun run = { .out = out, .epfd = epoll_create1(EPOLL_CLOEXEC),
+                     .json = json };
+    if (run.epfd < 0) {
+        fprintf(stderr, "vsh: httpfetch: epoll_create1: %s\n", strerror(errno));
+        return nurls;
+    }
+    if (parallel > nurls)
+        parallel = nurls;
+
+    Probe *slots = malloc(sizeof(Probe) * (size_t)parallel);
+    if (!slots) {
+        fprintf(stderr, "vsh: httpfetch: out of memory\n");
+        close(run.epfd);
+        return nurls;
+    }
+    for (int i = 0; i < parallel; i++) {
+        slots[i].state = PROBE_IDLE;
+        slots[i].fd    = -1;
+    }
+
+    probe_interrupted = 0;
+    struct sigaction sa_new, sa_old;
+    memset(&sa_new, 0, sizeof(sa_new));
+    sa_new.sa_handler = probe_sigint_handler;
+    sigemptyset(&sa_new.sa_mask);
+    sigaction(SIGINT, &sa_new, &sa_old);
+
+    struct epoll_event events[64];
+    int next = 0;
+
+    while (!probe_interrupted) {
+        /* Fill free slots; a probe may finish (fail) right away */
+        int active = 0;
+        for (int i = 0; i < parallel; i++) {
+            while (slots[i].state == PROBE_IDLE && next < nurls)
+                probe_start(&run, &slots[i], urls[next++]);
+            if (slots[i].state != PROBE_IDLE)
+                active++;
+        }
+        if (active == 0)
+            break;
+
+        int n = epoll_wait(run.epfd, events, 64, 100);
+        if (n < 0 && errno != EINTR)
+            break;
+        for (int i = 0; i < n; i++) {
+            Probe *p = events[i].data.ptr;
+            if (p->state != PROBE_IDLE)
+                probe_advance(&run, p);
+        }
+
+        /* Per-request deadline */
+        for (int i = 0; i < parallel; i++) {
+            if (slots[i].state != PROBE_IDLE &&
+                elapsed_ms(&slots[i].start) > HTTP_TIMEOUT_SEC * 1e3)
+                probe_finish(&run, &slots[i], "timed out");
+        }
+    }
+
+    for (int i = 0; i < parallel; i++) {
+        if (slots[i].state != PROBE_IDLE)
+            probe_finish(&run, &slots[i], "interrupted");
+    }
+    sigaction(SIGINT, &sa_old, NULL);
+
+    free(slots);
+    close(run.epfd);
+    return probe_interrupted ? run.failed + (nurls - next) : run.failed;
+}
 
-                free(response);
+/* URLs for -P when none are given: one per line on stdin */
+static char **read_url_list(int *count) {
+    char **urls = NULL;
+    int n = 0, cap = 0;
+    char *line = NULL;
+    size_t lcap = 0;
+    ssize_t len;
 
-                /* Parse new URL - handle relative redirects */
-                if (strncmp(loc_str, "http://", 7) == 0 ||
-                    strncmp(loc_str, "https://", 8) == 0) {
-                    if (parse_url(loc_str, &url) != 0) {
-                        fprintf(stderr,
-                                "vsh: httpfetch: invalid redirect URL '%s'\n",
-                                loc_str);
+    while ((len = getline(&line, &lcap, stdin)) >= 0) {
+        while (len > 0 && isspace((unsigned char)line[len - 1]))
+            line[--len] = '\0';
+        char *s = line;
+        while (isspace((unsigned char)*s))
+            s++;
+        if (*s == '\0' || *s == '#')
+            continue;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            char **tmp = realloc(urls, sizeof(char *) * (size_t)cap);
+            if (!tmp)
+                break;
+            urls = tmp;
+        }
+        urls[n] = strdup(s);
+        if (urls[n])
+            n++;
+    }
+    free(line);
+    *count = n;
+    return urls;
+}
+
+/* ---- Main entry point --------------------------------------------------- */
+
+/*
+ * httpfetch [-H] [-v] [-o FILE] URL...
+ * httpfetch -P N [-J] [URL...]
+ *
+ * Fetch content from one or more URLs over HTTP using raw sockets. Bodies
+ * are streamed as they arrive (chunked transfer coding is decoded), and
+ * connections and DNS answers are kept for reuse by later requests to the
+ * same host, in this invocation or the next.
+ *   -H       Show response headers only
+ *   -v       Verbose: show request and response headers
+ *   -o FILE  Write bodies to FILE instead of stdout
+ *   -P N     Check the URLs N at a time (read from stdin if none are given)
+ *            and print "STATUS MS BYTES URL" per URL as each completes
+ *   -J       With -P: print one JSON object per URL instead
+ */
+int builtin_httpfetch(Shell *shell, int argc, char **argv) {
+    FetchOpts opt = { false, false, shell->out };
+    const char *out_path = NULL;
+    int parallel = 0;
+    bool json = false;
+    int first_url = argc;
+
+    /* Parse options */
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            for (int j = 1; argv[i][j]; j++) {
+                const char *arg = NULL;
+                char flag = argv[i][j];
+                switch (flag) {
+                case 'H': opt.headers_only = true; continue;
+                case 'v': opt.verbose = true;      continue;
+                case 'J': json = true;             continue;
+                case 'o':
+                case 'P':
+                    break;
+                default:
+                    fprintf(stderr, "vsh: httpfetch: unknown option '-%c'\n",
+                            flag);
+                    fprintf(stderr, HTTP_USAGE);
+                    return 1;
+                }
+
+                /* Options with a value: the rest of this word, or the next */
+                if (argv[i][j + 1]) {
+                    arg = argv[i] + j + 1;
+                } else if (i + 1 < argc) {
+                    arg = argv[++i];
+                } else {
+                    fprintf(stderr, "vsh: httpfetch: -%c requires an argument\n",
+                            flag);
+                    return 1;
+                }
+                if (flag == 'o') {
+                    out_path = arg;
+                } else {
+                    char *endp;
+                    long v = strtol(arg, &endp, 10);
+                    if (*endp != '\0' || v < 1 || v > 4096) {
+                        fprintf(stderr, "vsh: httpfetch: invalid -P '%s'\n", arg);
                         return 1;
                     }
-                    if (strcasecmp(url.scheme, "https") == 0) {
-                        fprintf(stderr,
-                                "vsh: httpfetch: warning: redirect to HTTPS "
-                                "not supported\n");
-                        strcpy(url.port, "80");
-                    }
-                } else {
-                    /* Relative redirect - keep host, update path */
-                    strncpy(url.path, loc_str, sizeof(url.path) - 1);
-                    url.path[sizeof(url.path) - 1] = '\0';
+                    parallel = (int)v;
                 }
-
-                redirects++;
-                continue;
+                break;
             }
+            continue;
         }
+        first_url = i;
+        break;
+    }
 
-        /* If max redirects exceeded */
-        if (redirects >= HTTP_MAX_REDIRECTS &&
-            (status == 301 || status == 302 || status == 303 ||
-             status == 307 || status == 308)) {
-            fprintf(stderr, "vsh: httpfetch: too many redirects\n");
-            free(response);
-            return 1;
-        }
+    if (json && !parallel)
+        parallel = PROBE_DEFAULT_PARALLEL;
 
-        /* Print body (unless headers-only) */
-        if (!headers_only && body_len > 0) {
-            fwrite(body, 1, body_len, stdout);
-            /* Ensure trailing newline */
-            if (body[body_len - 1] != '\n') putchar('\n');
+    if (parallel) {
+        int nurls = argc - first_url;
+        char **urls = argv + first_url;
+        char **owned = NULL;
+        if (nurls == 0)
+            urls = owned = read_url_list(&nurls);
+
+        int failed = nurls > 0
+                   ? probe_urls(shell->out, urls, nurls, parallel, json) : 0;
+
+        for (int i = 0; owned && i < nurls; i++)
+            free(owned[i]);
+        free(owned);
+        return failed ? 1 : 0;
+    }
+
+    if (first_url >= argc) {
+        fprintf(stderr, HTTP_USAGE);
+        return 1;
+    }
+
+    int out_fd = -1;
+    if (out_path) {
+        out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (out_fd < 0 || !(opt.out = out_create(out_fd))) {
+            fprintf(stderr, "vsh: httpfetch: %s: %s\n", out_path,
+                    strerror(errno));
+            if (out_fd >= 0)
+                close(out_fd);
+            return 1;
         }
+    }
 
-        free(response);
-        return (status >= 200 && status < 400) ? 0 : 1;
+    int status = 0;
+    for (int i = first_url; i < argc; i++) {
+        if (fetch_url(argv[i], &opt) != 0)
+            status = 1;
     }
 
-    fprintf(stderr, "vsh: httpfetch: too many redirects\n");
-    return 1;
+    if (out_fd >= 0) {
+        out_destroy(opt.out);
+        close(out_fd);
+    }
+    return status;
 }
@@ -7,16 +7,31 @@
 #include "shell.h"
 #include "job_control.h"
 #include <stdio.h>
+#include <string.h>
 
 /*
- * jobs
+ * jobs [-s]
  *
  * List all active jobs and their statuses.
+ *   -s   also show each job's CPU% (since the previous `jobs -s`), its
+ *        resident memory (peak, once finished) and how long it has run
  */
 int builtin_jobs(Shell *shell, int argc, char **argv) {
-    (void)argc;
-    (void)argv;
+    bool stats = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0) {
+            stats = true;
+        } else {
+            fprintf(stderr, "vsh: jobs: %s: invalid option\n", argv[i]);
+            fprintf(stderr, "Usage: jobs [-s]\n");
+            return 2;
+        }
+    }
 
-    job_list_print(shell);
+    job_reap(shell);
+    if (stats)
+        job_stats_print(shell);
+    else
+        job_list_print(shell);
     return 0;
 }
@@ -0,0 +1,485 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * builtins/parallel.c - Run a command template over items with a job pool
+ *
+ * Every item becomes one job in the shell's job table, forked as a subshell
+ * that runs the expanded template with stdin on /dev/null and stdout on a
+ * pipe. At most -j jobs run at once. Output is buffered per job and written
+ * in input order as soon as every earlier job has finished; with -t it is
+ * streamed instead, line by line, each line prefixed with its item. stderr
+ * is not captured.
+ * ============================================================================ */
+
+#include "builtins.h"
+#include "shell.h"
+#include "output.h"
+#include "job_control.h"
+#include "safe_string.h"
+#include "stats.h"
+#include "pipetime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/* GNU parallel's convention: the exit status counts failures, capped */
+#define PARALLEL_MAX_FAILED 101
+
+typedef struct PoolTask {
+    const char *item;
+    pid_t       pid;        /* 0 until started */
+    int         fd;         /* Read end of the stdout pipe, -1 at EOF */
+    Job        *job;
+    SafeString *out;        /* Buffered output, or the partial line with -t */
+    int         status;
+    bool        done;       /* Reaped */
+} PoolTask;
+
+typedef struct PoolOptions {
+    long jobs;
+    bool tag;
+    bool verbose;
+} PoolOptions;
+
+static volatile sig_atomic_t pool_interrupted = 0;
+
+static void pool_sigint_handler(int sig) {
+    (void)sig;
+    pool_interrupted = 1;
+}
+
+static double timespec_diff(const struct timespec *a, const struct timespec *b) {
+    return (double)(b->tv_sec - a->tv_sec) +
+           (double)(b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+static double rusage_cpu(const struct rusage *ru) {
+    return (double)ru->ru_utime.tv_sec + (double)ru->ru_utime.tv_usec / 1e6 +
+           (double)ru->ru_stime.tv_sec + (double)ru->ru_stime.tv_usec / 1e6;
+}
+
+/* Append item single-quoted, so it stays one word */
+static void append_quoted(SafeString *cmd, const char *item) {
+    sstr_append_char(cmd, '\'');
+    for (const char *p = item; *p; p++) {
+        if (*p == '\'')
+            sstr_append(cmd, "'\\''");
+        else
+            sstr_append_char(cmd, *p);
+    }
+    sstr_append_char(cmd, '\'');
+}
+
+/* Expand the template: {} is replaced by the item; without any {}, the
+ * item is appended as a final argument. */
+static void build_command(SafeString *cmd, char **tmpl, int ntmpl,
+                          const char *item) {
+    bool placed = false;
+
+    sstr_clear(cmd);
+    for (int i = 0; i < ntmpl; i++) {
+        if (i > 0)
+            sstr_append_char(cmd, ' ');
+        const char *w = tmpl[i];
+        const char *hole;
+        while ((hole = strstr(w, "{}")) != NULL) {
+            sstr_append_n(cmd, w, (size_t)(hole - w));
+            append_quoted(cmd, item);
+            w = hole + 2;
+            placed = true;
+        }
+        sstr_append(cmd, w);
+    }
+    if (!placed) {
+        sstr_append_char(cmd, ' ');
+        append_quoted(cmd, item);
+    }
+}
+
+/* Split stdin into one item per non-empty line. The items point into buf. */
+static char **read_stdin_items(SafeString *buf, int *count) {
+    char chunk[4096];
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, chunk, sizeof(chunk))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR && !pool_interrupted)
+                continue;
+            break;
+        }
+        sstr_append_n(buf, chunk, (size_t)n);
+    }
+
+    int cap = 16, nitems = 0;
+    char **items = malloc((size_t)cap * sizeof(char *));
+    if (!items)
+        return NULL;
+
+    char *p = sstr_data(buf);
+    while (p && *p) {
+        char *nl = strchr(p, '\n');
+        if (nl)
+            *nl = '\0';
+        if (*p) {
+            if (nitems == cap) {
+                cap *= 2;
+                char **tmp = realloc(items, (size_t)cap * sizeof(char *));
+                if (!tmp)
+                    break;
+                items = tmp;
+            }
+            items[nitems++] = p;
+        }
+        p = nl ? nl + 1 : NULL;
+    }
+    *count = nitems;
+    return items;
+}
+
+static bool start_task(Shell *shell, PoolTask *t, const char *command) {
+    t->out = sstr_new(256);
+    if (!t->out) {
+        fprintf(stderr, "vsh: parallel: out of memory\n");
+        return false;
+    }
+
+    int pfd[2];
+    if (pipe2(pfd, O_CLOEXEC) < 0) {
+        perror("vsh: parallel: pipe");
+        return false;
+    }
+
+    out_flush(shell->out);
+    pid_t pid = fork();
+    stats_fork(shell->stats);
+    if (pid < 0) {
+        perror("vsh: parallel: fork");
+        close(pfd[0]);
+        close(pfd[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        setpgid(0, 0);
+        job_child_reset_signals();
+        shell->interactive = false;
+
+        int devnull = open("/dev/null", O_RDONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            close(devnull);
+        }
+        dup2(pfd[1], STDOUT_FILENO);
+        close(pfd[0]);
+        close(pfd[1]);
+
+        int status = shell_exec_line(shell, command);
+        fflush(stdout);
+        _exit(status);
+    }
+
+    setpgid(pid, pid);
+    close(pfd[1]);
+    t->pid = pid;
+    t->fd  = pfd[0];
+    t->job = job_add(shell, pid, &pid, 1, command, true);
+    return true;
+}
+
+/* Write out the complete lines collected for t, each tagged with its item */
+static void flush_tagged(OutBuf *out, PoolTask *t, bool final) {
+    const char *data = sstr_cstr(t->out);
+    size_t start = 0;
+    for (size_t i = 0; i < t->out->len; i++) {
+        if (data[i] != '\n')
+            continue;
+        out_printf(out, "%s\t%.*s\n", t->item, (int)(i - start),
+                   data + start);
+        start = i + 1;
+    }
+    if (final && start < t->out->len) {
+        out_printf(out, "%s\t%.*s\n", t->item, (int)(t->out->len - start),
+                   data + start);
+        start = t->out->len;
+    }
+    sstr_delete(t->out, 0, start);
+    out_flush(out);
+}
+
+/* Collect t's exit status once its stdout is closed. */
+static void try_reap(Shell *shell, PoolTask *t) {
+    int status;
+    struct rusage usage;
+    pid_t r;
+    do {
+        r = wait4(t->pid, &status, WNOHANG, &usage);
+    } while (r < 0 && errno == EINTR);
+    if (r == 0)
+        return;
+    if (r > 0 && shell->timer)
+        pipetime_reaped(shell, r, status, &usage);
+
+    if (r < 0) {
+        t->status = 127;
+    } else {
+        job_update_status(shell, t->pid, status, &usage);
+        if (WIFEXITED(status))
+            t->status = WEXITSTATUS(status);
+        else if (WIFSIGNALED(status))
+            t->status = 128 + WTERMSIG(status);
+        else
+            return;     /* Stopped: still ours */
+    }
+    if (t->job)
+        job_remove(shell, t->job->id);
+    t->job  = NULL;
+    t->done = true;
+}
+
+static void read_task(OutBuf *out, PoolTask *t, bool tag) {
+    char chunk[4096];
+    ssize_t n = read(t->fd, chunk, sizeof(chunk));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return;
+    if (n <= 0) {
+        close(t->fd);
+        t->fd = -1;
+        if (tag)
+            flush_tagged(out, t, true);
+        return;
+    }
+    sstr_append_n(t->out, chunk, (size_t)n);
+    if (tag)
+        flush_tagged(out, t, false);
+}
+
+static int run_pool(Shell *shell, char **tmpl, int ntmpl, char **items,
+                    int nitems, const PoolOptions *opt) {
+    PoolTask *tasks = calloc((size_t)nitems, sizeof(PoolTask));
+    struct pollfd *pfds = calloc((size_t)opt->jobs, sizeof(struct pollfd));
+    PoolTask **polled = calloc((size_t)opt->jobs, sizeof(PoolTask *));
+    SafeString *cmd = sstr_new(128);
+    if (!tasks || !pfds || !polled || !cmd) {
+        fprintf(stderr, "vsh: parallel: out of memory\n");
+        free(tasks);
+        free(pfds);
+        free(polled);
+        sstr_free(cmd);
+        return 1;
+    }
+    for (int i = 0; i < nitems; i++) {
+        tasks[i].item = items[i];
+        tasks[i].fd   = -1;
+    }
+
+    int next_start = 0, next_emit = 0, running = 0, failed = 0;
+    bool start_failed = false;
+
+    while (next_emit < nitems) {
+        /* Fill the pool */
+        while (!pool_interrupted && !start_failed && running < opt->jobs &&
+               next_start < nitems) {
+            PoolTask *t = &tasks[next_start];
+            build_command(cmd, tmpl, ntmpl, t->item);
+            if (!start_task(shell, t, sstr_cstr(cmd))) {
+                start_failed = true;
+                break;
+            }
+            next_start++;
+            running++;
+        }
+
+        /* Items that will never start count as failed */
+        if ((pool_interrupted || start_failed) && next_start < nitems) {
+            for (int i = next_start; i < nitems; i++) {
+                tasks[i].done   = true;
+                tasks[i].status = 1;
+            }
+            next_start = nitems;
+        }
+
+        /* Wait for output, or poll briefly for children that closed
+         * stdout but have not exited yet */
+        int npoll = 0;
+        bool lingering = false;
+        for (int i = next_emit; i < next_start; i++) {
+            PoolTask *t = &tasks[i];
+            if (t->fd >= 0) {
+                pfds[npoll].fd     = t->fd;
+                pfds[npoll].events = POLLIN;
+                polled[npoll++]    = t;
+            } else if (t->pid && !t->done) {
+                lingering = true;
+            }
+        }
+        if (npoll > 0 || lingering) {
+            int n = poll(pfds, (nfds_t)npoll, lingering ? 10 : -1);
+            if (n < 0 && errno == EINTR && pool_interrupted) {
+                for (int i = next_emit; i < next_start; i++) {
+                    if (tasks[i].pid && !tasks[i].done)
+                        kill(-tasks[i].pid, SIGTERM);
+                }
+            }
+            for (int i = 0; n > 0 && i < npoll; i++) {
+                if (pfds[i].revents)
+                    read_task(shell->out, polled[i], opt->tag);
+            }
+        }
+
+        for (int i = next_emit; i < next_start; i++) {
+            PoolTask *t = &tasks[i];
+            if (t->pid && !t->done && t->fd < 0) {
+                try_reap(shell, t);
+                if (t->done)
+                    running--;
+            }
+        }
+
+        /* Emit finished jobs in input order */
+        while (next_emit < nitems && tasks[next_emit].done) {
+            PoolTask *t = &tasks[next_emit];
+            if (t->out) {
+                if (!opt->tag && t->out->len > 0) {
+                    out_write(shell->out, sstr_cstr(t->out), t->out->len);
+                    out_flush(shell->out);
+                }
+                sstr_free(t->out);
+                t->out = NULL;
+            }
+            if (t->status != 0)
+                failed++;
+            next_emit++;
+        }
+    }
+
+    free(tasks);
+    free(pfds);
+    free(polled);
+    sstr_free(cmd);
+
+    if (pool_interrupted)
+        return 130;
+    return failed > PARALLEL_MAX_FAILED ? PARALLEL_MAX_FAILED : failed;
+}
+
+/*
+ * parallel [-j N] [-t] [-v] COMMAND [ARGS...] [::: ITEM...]
+ *
+ * Run COMMAND once per item, up to N at a time (default: online CPUs).
+ * Items follow ":::" or are read from stdin, one per line. "{}" in the
+ * command is replaced by the item; without it the item is appended.
+ *   -j N   Concurrency limit
+ *   -t     Stream output as it arrives, each line prefixed "ITEM<TAB>"
+ *   -v     Report job count, failures, wall and CPU time on stderr
+ *
+ * The exit status is the number of failed jobs (at most 101).
+ */
+int builtin_parallel(Shell *shell, int argc, char **argv) {
+    PoolOptions opt = { 0, false, false };
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(argv[i], "-t") == 0) {
+            opt.tag = true;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            opt.verbose = true;
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            const char *val = argv[i][2] ? argv[i] + 2
+                            : (i + 1 < argc ? argv[++i] : NULL);
+            char *endp;
+            opt.jobs = val ? strtol(val, &endp, 10) : 0;
+            if (!val || *endp != '\0' || opt.jobs <= 0) {
+                fprintf(stderr, "vsh: parallel: -j requires a positive number\n");
+                return 2;
+            }
+        } else {
+            fprintf(stderr, "vsh: parallel: %s: invalid option\n", argv[i]);
+            return 2;
+        }
+    }
+
+    int tmpl_start = i, ntmpl = 0;
+    while (i < argc && strcmp(argv[i], ":::") != 0) {
+        i++;
+        ntmpl++;
+    }
+    if (ntmpl == 0) {
+        fprintf(stderr,
+                "Usage: parallel [-j N] [-t] [-v] COMMAND [ARGS...] [::: ITEM...]\n");
+        return 2;
+    }
+
+    if (opt.jobs == 0) {
+        opt.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+        if (opt.jobs <= 0)
+            opt.jobs = 1;
+    }
+
+    /* Interrupting stops new jobs and terminates the running ones */
+    pool_interrupted = 0;
+    struct sigaction sa_new, sa_old;
+    memset(&sa_new, 0, sizeof(sa_new));
+    sa_new.sa_handler = pool_sigint_handler;
+    sigemptyset(&sa_new.sa_mask);
+    sa_new.sa_flags = 0;
+    sigaction(SIGINT, &sa_new, &sa_old);
+
+    SafeString *input = NULL;
+    char **items;
+    int nitems = 0;
+    if (i < argc) {
+        items  = argv + i + 1;
+        nitems = argc - i - 1;
+    } else {
+        input = sstr_new(4096);
+        items = input ? read_stdin_items(input, &nitems) : NULL;
+        if (!items) {
+            fprintf(stderr, "vsh: parallel: out of memory\n");
+            sigaction(SIGINT, &sa_old, NULL);
+            sstr_free(input);
+            return 1;
+        }
+    }
+    if (opt.jobs > nitems)
+        opt.jobs = nitems > 0 ? nitems : 1;
+
+    struct timespec t0, t1;
+    struct rusage ru0, ru1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    getrusage(RUSAGE_CHILDREN, &ru0);
+
+    int status = nitems > 0 ? run_pool(shell, argv + tmpl_start, ntmpl, items,
+                                       nitems, &opt)
+                            : 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    getrusage(RUSAGE_CHILDREN, &ru1);
+    if (opt.verbose) {
+        int failed = status == 130 ? -1 : status;
+        fprintf(stderr, "parallel: %d job%s, ", nitems, nitems == 1 ? "" : "s");
+        if (failed < 0)
+            fprintf(stderr, "interrupted, ");
+        else
+            fprintf(stderr, "%d failed, ", failed);
+        fprintf(stderr, "%.3fs wall, %.3fs cpu (%ld at a time)\n",
+                timespec_diff(&t0, &t1), rusage_cpu(&ru1) - rusage_cpu(&ru0),
+                opt.jobs);
+    }
+
+    sigaction(SIGINT, &sa_old, NULL);
+    if (input) {
+        free(items);
+        sstr_free(input);
+    }
+    return status;
+}
@@ -0,0 +1,323 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * builtins/read.c - Read a line from stdin into shell variables
+ *
+ * A byte-at-a-time read(2) is the only way never to take more input than
+ * the line, and it is what makes shell read loops slow. vsh reads stdin a
+ * block at a time instead whenever that cannot take input from anyone
+ * else:
+ *   - Regular files are read with pread() and the file offset is moved to
+ *     the end of each line afterwards, so later readers (and children
+ *     sharing the descriptor) start exactly where read stopped. The block
+ *     is kept for the next line only in a while-read loop, and only while
+ *     the file's size and mtime are unchanged; otherwise every read starts
+ *     from the file as it is now.
+ *   - Pipes are read in blocks while read is the whole condition of a
+ *     while loop, which then owns the pipe. Anything buffered is handed
+ *     to the next read of the same pipe first, in or out of a loop.
+ * Everything else, such as a terminal, is read a byte at a time.
+ * ============================================================================ */
+
+#include "builtins.h"
+#include "shell.h"
+#include "env.h"
+#include "safe_string.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define READ_BLOCK 16384
+
+/* ---- Input buffer ------------------------------------------------------- */
+
+typedef struct ReadBuffer {
+    dev_t  dev;             /* Identity of the buffered file or pipe */
+    ino_t  ino;
+    bool   valid;
+    bool   seekable;        /* Regular file: data[0] is at offset base */
+    off_t  size;            /* ... and the file's size and mtime then */
+    struct timespec mtime;
+    off_t  base;
+    size_t pos;
+    size_t len;
+    char   data[READ_BLOCK];
+} ReadBuffer;
+
+static ReadBuffer readbuf;
+
+typedef enum ReadMode {
+    MODE_BYTE,              /* One read(2) per byte */
+    MODE_PIPE,              /* Block reads from a pipe the loop owns */
+    MODE_FILE               /* pread() blocks, seek back when done */
+} ReadMode;
+
+/* Pick the mode for fd and line the buffer up with its current position */
+static ReadMode read_begin(Shell *shell, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        readbuf.valid = false;
+        return MODE_BYTE;
+    }
+
+    bool same = readbuf.valid && readbuf.dev == st.st_dev &&
+                readbuf.ino == st.st_ino;
+
+    if (S_ISREG(st.st_mode)) {
+        off_t off = lseek(fd, 0, SEEK_CUR);
+        if (off < 0)
+            return MODE_BYTE;
+        /* Someone else may have moved the offset, or rewritten the file,
+         * since the last read */
+        bool fresh = same && readbuf.seekable && shell->read_loop > 0 &&
+                     readbuf.size == st.st_size &&
+                     readbuf.mtime.tv_sec == st.st_mtim.tv_sec &&
+                     readbuf.mtime.tv_nsec == st.st_mtim.tv_nsec;
+        if (!fresh || off < readbuf.base ||
+            off > readbuf.base + (off_t)readbuf.len) {
+            readbuf.base = off;
+            readbuf.len  = 0;
+        }
+        readbuf.size     = st.st_size;
+        readbuf.mtime    = st.st_mtim;
+        readbuf.pos      = (size_t)(off - readbuf.base);
+        readbuf.seekable = true;
+    } else if (!same || readbuf.seekable) {
+        readbuf.len = readbuf.pos = 0;
+        readbuf.seekable = false;
+    }
+
+    readbuf.dev   = st.st_dev;
+    readbuf.ino   = st.st_ino;
+    readbuf.valid = true;
+
+    if (S_ISREG(st.st_mode))
+        return MODE_FILE;
+    if (S_ISFIFO(st.st_mode) && shell->read_loop > 0)
+        return MODE_PIPE;
+    return MODE_BYTE;
+}
+
+/* Next input byte, -1 at end of input, -2 on error */
+static int read_byte(int fd, ReadMode mode) {
+    if (readbuf.pos < readbuf.len)
+        return (unsigned char)readbuf.data[readbuf.pos++];
+
+    ssize_t n;
+    do {
+        if (mode == MODE_FILE) {
+            readbuf.base += (off_t)readbuf.len;
+            readbuf.len = readbuf.pos = 0;
+            n = pread(fd, readbuf.data, READ_BLOCK, readbuf.base);
+        } else if (mode == MODE_PIPE) {
+            readbuf.len = readbuf.pos = 0;
+            n = read(fd, readbuf.data, READ_BLOCK);
+        } else {
+            unsigned char c;
+            n = read(fd, &c, 1);
+            if (n == 1)
+                return c;
+        }
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0)
+        return -2;
+    if (n == 0)
+        return -1;
+    readbuf.len = (size_t)n;
+    return (unsigned char)readbuf.data[readbuf.pos++];
+}
+
+/* Leave the file offset just past what was consumed */
+static void read_end(int fd, ReadMode mode) {
+    if (mode == MODE_FILE)
+        lseek(fd, readbuf.base + (off_t)readbuf.pos, SEEK_SET);
+}
+
+/* ---- Field splitting ---------------------------------------------------- */
+
+/* Each byte of a line has a flag: escaped with a backslash, so it is
+ * never a separator */
+typedef struct ReadLine {
+    SafeString *text;
+    SafeString *escaped;
+} ReadLine;
+
+static bool is_sep(const ReadLine *rl, size_t i, const char *ifs) {
+    return rl->escaped->data[i] == '0' && rl->text->data[i] != '\0' &&
+           strchr(ifs, rl->text->data[i]) != NULL;
+}
+
+static bool is_sep_space(const ReadLine *rl, size_t i, const char *ifs) {
+    return is_sep(rl, i, ifs) && isspace((unsigned char)rl->text->data[i]);
+}
+
+/* Assign the fields of the line to names; the last one takes the rest */
+static void assign_fields(Shell *shell, const ReadLine *rl, char **names,
+                          int nnames, const char *ifs) {
+    const char *s = rl->text->data;
+    size_t n = rl->text->len, i = 0;
+
+    while (i < n && is_sep_space(rl, i, ifs))
+        i++;
+
+    for (int v = 0; v < nnames; v++) {
+        size_t start = i, end;
+        if (v == nnames - 1) {
+            end = n;
+            while (end > start && is_sep_space(rl, end - 1, ifs))
+                end--;
+        } else {
+            while (i < n && !is_sep(rl, i, ifs))
+                i++;
+            end = i;
+            /* Separator: spaces, at most one other IFS character, spaces */
+            while (i < n && is_sep_space(rl, i, ifs))
+                i++;
+            if (i < n && is_sep(rl, i, ifs) && !is_sep_space(rl, i, ifs))
+                i++;
+            while (i < n && is_sep_space(rl, i, ifs))
+                i++;
+        }
+
+        char *value = strndup(s + start, end - start);
+        if (value) {
+            env_assign(shell->env, names[v], value);
+            free(value);
+        }
+    }
+}
+
+static bool valid_name(const char *s) {
+    if (!isalpha((unsigned char)*s) && *s != '_')
+        return false;
+    while (*++s) {
+        if (!isalnum((unsigned char)*s) && *s != '_')
+            return false;
+    }
+    return true;
+}
+
+/* ---- Main entry point --------------------------------------------------- */
+
+/*
+ * read [-r] [-d DELIM] [-n COUNT] [NAME...]
+ *
+ * Read a line from standard input and split it on IFS into the NAMEs, the
+ * last NAME getting the rest of the line. With no NAME the whole line goes
+ * into REPLY unsplit.
+ *   -r        Backslash is an ordinary character (otherwise it escapes the
+ *             next one, and backslash-newline continues the line)
+ *   -d DELIM  End at the first character of DELIM instead of newline
+ *             (at NUL if DELIM is empty)
+ *   -n COUNT  Return after COUNT characters if no delimiter came first
+ *
+ * Returns 1 at end of input, even if a partial line was read and assigned.
+ */
+int builtin_read(Shell *shell, int argc, char **argv) {
+    bool raw = false;
+    int delim = '\n';
+    long count = 0;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char *o = argv[i] + 1; *o; o++) {
+            if (*o == 'r') {
+                raw = true;
+                continue;
+            }
+            if (*o != 'd' && *o != 'n') {
+                fprintf(stderr, "vsh: read: -%c: invalid option\n", *o);
+                fprintf(stderr, "Usage: read [-r] [-d DELIM] [-n COUNT] [NAME...]\n");
+                return 1;
+            }
+            const char *val = o[1] ? o + 1 : (i + 1 < argc ? argv[++i] : NULL);
+            if (!val) {
+                fprintf(stderr, "vsh: read: -%c: option requires an argument\n",
+                        *o);
+                return 1;
+            }
+            if (*o == 'd') {
+                delim = (unsigned char)val[0];
+            } else {
+                char *end;
+                count = strtol(val, &end, 10);
+                if (*end != '\0' || count < 0) {
+                    fprintf(stderr, "vsh: read: %s: invalid count\n", val);
+                    return 1;
+                }
+            }
+            break;
+        }
+    }
+
+    for (int v = i; v < argc; v++) {
+        if (!valid_name(argv[v])) {
+            fprintf(stderr, "vsh: read: `%s': not a valid identifier\n",
+                    argv[v]);
+            return 1;
+        }
+    }
+
+    ReadLine rl = { sstr_new(128), sstr_new(128) };
+    if (!rl.text || !rl.escaped) {
+        fprintf(stderr, "vsh: read: out of memory\n");
+        sstr_free(rl.text);
+        sstr_free(rl.escaped);
+        return 1;
+    }
+
+    fflush(stdout);     /* A prompt printed with echo -n shows first */
+
+    int fd = STDIN_FILENO;
+    ReadMode mode = read_begin(shell, fd);
+    bool complete = false;
+    int c = 0;
+
+    while (count == 0 || (long)rl.text->len < count) {
+        c = read_byte(fd, mode);
+        if (c < 0)
+            break;
+        if (c == delim) {
+            complete = true;
+            break;
+        }
+
+        char flag = '0';
+        if (!raw && c == '\\') {
+            c = read_byte(fd, mode);
+            if (c < 0)
+                break;
+            if (c == '\n')
+                continue;       /* Line continuation */
+            flag = '1';
+        }
+        sstr_append_char(rl.text, (char)c);
+        sstr_append_char(rl.escaped, flag);
+    }
+    if (count > 0 && (long)rl.text->len == count)
+        complete = true;
+
+    read_end(fd, mode);
+
+    if (c == -2)
+        fprintf(stderr, "vsh: read: %s\n", strerror(errno));
+
+    if (i == argc) {
+        env_assign(shell->env, "REPLY", sstr_cstr(rl.text));
+    } else {
+        const char *ifs = env_get(shell->env, "IFS");
+        assign_fields(shell, &rl, argv + i, argc - i, ifs ? ifs : " \t\n");
+    }
+
+    sstr_free(rl.text);
+    sstr_free(rl.escaped);
+    return complete ? 0 : 1;
+}
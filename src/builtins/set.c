@@ -0,0 +1,148 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * builtins/set.c - Shell options
+ * ============================================================================ */
+
+#include "builtins.h"
+#include "shell.h"
+#include "output.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct ShellOption {
+    const char *name;
+    size_t      offset;     /* Of the bool in Shell */
+} ShellOption;
+
+static const ShellOption shell_options[] = {
+    { "jobstats", offsetof(Shell, opt_jobstats) },
+    { "lastpipe", offsetof(Shell, opt_lastpipe) },
+    { "timing",   offsetof(Shell, opt_timing) },
+};
+
+#define NOPTIONS (sizeof(shell_options) / sizeof(shell_options[0]))
+
+static bool *option_flag(Shell *shell, const ShellOption *opt) {
+    return (bool *)((char *)shell + opt->offset);
+}
+
+/* ---- pipesize ------------------------------------------------------------ */
+
+/* "64K", "1M", "1048576": bytes, or -1 */
+static long parse_size(const char *s) {
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(s, &end, 10);
+    if (end == s || errno)
+        return -1;
+    switch (*end) {
+    case 'k': case 'K': n <<= 10; end++; break;
+    case 'm': case 'M': n <<= 20; end++; break;
+    case 'g': case 'G': n <<= 30; end++; break;
+    default: break;
+    }
+    return *end || n == 0 || n > 0x7fffffff ? -1 : (long)n;
+}
+
+/* set -o pipesize=SIZE: tried on a scratch pipe, so a size above the
+ * unprivileged limit fails here rather than silently on every pipeline */
+static int set_pipe_size(Shell *shell, const char *value) {
+    long size = parse_size(value);
+    if (size < 0) {
+        fprintf(stderr, "vsh: set: pipesize: %s: invalid size\n", value);
+        return 1;
+    }
+
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) {
+        fprintf(stderr, "vsh: set: pipesize: %s\n", strerror(errno));
+        return 1;
+    }
+    int got = fcntl(p[1], F_SETPIPE_SZ, (int)size);
+    int err = errno;
+    close(p[0]);
+    close(p[1]);
+    if (got < 0) {
+        fprintf(stderr, "vsh: set: pipesize: %s: %s%s\n", value, strerror(err),
+                err == EPERM ? " (see /proc/sys/fs/pipe-max-size)" : "");
+        return 1;
+    }
+    shell->opt_pipe_size = got;     /* Rounded up to a power-of-two of pages */
+    return 0;
+}
+
+/*
+ * set [-o | +o] [NAME]
+ *
+ * Turn the option NAME on (-o) or off (+o). With no NAME, or no
+ * arguments at all, list the options and whether each is on.
+ *   jobstats   Report a finished background job with how long it ran,
+ *              the CPU time it used and its peak memory
+ *   lastpipe   Run the last stage of a pipeline in the shell itself when
+ *              it is a builtin, function or compound command, so that
+ *              `cmd | while read x; do ...; done` can set variables
+ *              (ignored while job control is active, as in bash)
+ *   timing     After each command line, print how long it took and how
+ *              that time split across its phases to stderr (see
+ *              shellstats for the totals), and after each pipeline what
+ *              every stage read and wrote
+ *   pipesize=SIZE
+ *              Give pipeline pipes SIZE bytes of buffer (K, M, G suffixes;
+ *              the kernel rounds up) instead of the default 64K;
+ *              +o pipesize restores the default
+ */
+int builtin_set(Shell *shell, int argc, char **argv) {
+    if (argc == 1 || (argc == 2 && (strcmp(argv[1], "-o") == 0 ||
+                                    strcmp(argv[1], "+o") == 0))) {
+        for (size_t i = 0; i < NOPTIONS; i++)
+            out_printf(shell->out, "%-15s %s\n", shell_options[i].name,
+                       *option_flag(shell, &shell_options[i]) ? "on" : "off");
+        char size[32] = "default";
+        if (shell->opt_pipe_size > 0)
+            stats_format_bytes(size, sizeof(size),
+                               (unsigned long long)shell->opt_pipe_size);
+        out_printf(shell->out, "%-15s %s\n", "pipesize", size);
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        bool on = strcmp(argv[i], "-o") == 0;
+        if ((!on && strcmp(argv[i], "+o") != 0) || i + 1 >= argc) {
+            fprintf(stderr, "vsh: set: %s: invalid option\n", argv[i]);
+            fprintf(stderr, "Usage: set [-o | +o] [NAME]\n");
+            return 1;
+        }
+
+        const char *name = argv[++i];
+        if (strncmp(name, "pipesize", 8) == 0 &&
+            (name[8] == '\0' || name[8] == '=')) {
+            if (!on)
+                shell->opt_pipe_size = 0;
+            else if (name[8] == '=')
+                status |= set_pipe_size(shell, name + 9);
+            else {
+                fprintf(stderr, "vsh: set: pipesize: missing size (pipesize=SIZE)\n");
+                status = 1;
+            }
+            continue;
+        }
+
+        size_t k = 0;
+        while (k < NOPTIONS && strcmp(shell_options[k].name, name) != 0)
+            k++;
+        if (k == NOPTIONS) {
+            fprintf(stderr, "vsh: set: %s: invalid option name\n", name);
+            status = 1;
+            continue;
+        }
+        *option_flag(shell, &shell_options[k]) = on;
+    }
+    return status;
+}
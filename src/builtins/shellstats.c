@@ -0,0 +1,103 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * builtins/shellstats.c - Phase timings, arena usage and cache hit rates
+ * ============================================================================ */
+
+#include "builtins.h"
+#include "shell.h"
+#include "output.h"
+#include "stats.h"
+#include "arena.h"
+#include "path_cache.h"
+#include "exec_index.h"
+#include <stdio.h>
+#include <string.h>
+
+static void print_phases(Shell *shell, const ShellStats *st) {
+    out_printf(shell->out, "%-10s %8s %10s %10s %10s %10s %10s\n",
+               "phase", "count", "total", "mean", "p50", "p99", "max");
+
+    /* The whole line first, then its phases in the order they run */
+    static const StatPhase order[] = {
+        STAT_LINE, STAT_HISTORY, STAT_LEX, STAT_ALIAS, STAT_PARSE,
+        STAT_EXPAND, STAT_SPAWN, STAT_WAIT,
+    };
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        const StatHist *h = &st->phase[order[i]];
+        char total[32] = "-", mean[32] = "-", p50[32] = "-", p99[32] = "-",
+             max[32] = "-";
+        if (h->count) {
+            stats_format_ns(total, sizeof(total), h->total_ns);
+            stats_format_ns(mean, sizeof(mean), h->total_ns / h->count);
+            stats_format_ns(p50, sizeof(p50), stats_quantile(h, 0.50));
+            stats_format_ns(p99, sizeof(p99), stats_quantile(h, 0.99));
+            stats_format_ns(max, sizeof(max), h->max_ns);
+        }
+        out_printf(shell->out, "%-10s %8llu %10s %10s %10s %10s %10s\n",
+                   stats_phase_name(order[i]), (unsigned long long)h->count,
+                   total, mean, p50, p99, max);
+    }
+}
+
+static void print_cache(Shell *shell, const char *name, unsigned long long hits,
+                        unsigned long long misses) {
+    unsigned long long n = hits + misses;
+    if (n)
+        out_printf(shell->out, "%-10s %8llu %8llu %7.1f%%\n", name, hits,
+                   misses, 100.0 * (double)hits / (double)n);
+    else
+        out_printf(shell->out, "%-10s %8llu %8llu %8s\n", name, hits, misses, "-");
+}
+
+/*
+ * shellstats [-r]
+ *
+ * Print where the shell's time has gone since it started (or since the
+ * last -r): a latency histogram summary per phase of running a line, then
+ * processes started, parse-arena usage and the hit rates of the AST,
+ * compiled-script, command-path and PATH-index caches.
+ *   -r   reset every counter instead of printing
+ */
+int builtin_shellstats(Shell *shell, int argc, char **argv) {
+    ShellStats *st = shell->stats;
+    if (!st) {
+        fprintf(stderr, "vsh: shellstats: not available\n");
+        return 1;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "-r") == 0) {
+        stats_reset(st);
+        return 0;
+    }
+    if (argc > 1) {
+        fprintf(stderr, "vsh: shellstats: %s: invalid option\n", argv[1]);
+        fprintf(stderr, "Usage: shellstats [-r]\n");
+        return 2;
+    }
+
+    print_phases(shell, st);
+
+    out_printf(shell->out, "\nprocesses  %llu forked, %llu spawned\n",
+               (unsigned long long)st->forks, (unsigned long long)st->spawns);
+
+    ArenaStats as;
+    arena_stats(shell->parse_arena, &as);
+    out_printf(shell->out, "arena      peak %zu bytes, %zu pages (%zu retained), "
+               "%zu page mallocs, %zu reused\n",
+               as.peak_bytes, as.pages, as.retained_pages, as.page_mallocs,
+               as.pages_reused);
+
+    out_printf(shell->out, "\n%-10s %8s %8s %8s\n", "cache", "hits", "misses", "rate");
+    print_cache(shell, "ast", st->cache[STAT_CACHE_AST].hits,
+                st->cache[STAT_CACHE_AST].misses);
+    print_cache(shell, "vshc", st->cache[STAT_CACHE_VSHC].hits,
+                st->cache[STAT_CACHE_VSHC].misses);
+    print_cache(shell, "path", st->cache[STAT_CACHE_PATH].hits,
+                st->cache[STAT_CACHE_PATH].misses);
+
+    /* Completion reads the PATH index: a hit is a directory listing reused */
+    unsigned long kept, rescanned;
+    exec_index_counts(path_cache_index(shell), &kept, &rescanned);
+    print_cache(shell, "path-index", kept, rescanned);
+    return 0;
+}
@@ -16,6 +16,7 @@
  * source FILE  /  . FILE
  *
  * Read and execute commands from FILE in the current shell environment.
+ * The file is parsed as a whole, so constructs may span multiple lines.
  * Guards against infinite recursion with a maximum nesting depth.
  * Returns the exit status of the last command executed.
  */
@@ -34,41 +35,23 @@ int builtin_source(Shell *shell, int argc, char **argv) {
         return 1;
     }
 
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        fprintf(stderr, "vsh: %s: %s: %s\n", argv[0], filename, strerror(errno));
-        return 1;
-    }
-
+    /* The whole file is lexed and parsed once (or loaded from its compiled
+     * image), then run command by command */
     shell->script_depth++;
+    int status = shell_exec_file(shell, filename);
+    int err = errno;
+    shell->script_depth--;
 
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t nread;
-    int status = 0;
-
-    while ((nread = getline(&line, &len, fp)) != -1) {
-        /* Strip trailing newline */
-        if (nread > 0 && line[nread - 1] == '\n')
-            line[nread - 1] = '\0';
-
-        /* Skip empty lines and comments */
-        const char *p = line;
-        while (*p == ' ' || *p == '\t') p++;
-        if (*p == '\0' || *p == '#')
-            continue;
-
-        status = shell_exec_line(shell, line);
-
-        /* If shell was told to stop (e.g. exit), break out */
-        if (!shell->running)
-            break;
+    if (status < 0) {
+        fprintf(stderr, "vsh: %s: %s: %s\n", argv[0], filename, strerror(err));
+        return 1;
     }
 
-    free(line);
-    fclose(fp);
-
-    shell->script_depth--;
+    /* 'return' at the top level of the file ends the source */
+    if (shell->returning) {
+        shell->returning = false;
+        status = shell->last_status;
+    }
 
     return status;
 }
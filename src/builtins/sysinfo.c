@@ -1,18 +1,26 @@
 /* ============================================================================
  * vsh - Vanguard Shell
  * builtins/sysinfo.c - Display system information dashboard
+ *
+ * Also a sampling mode (-w) and a one-line format (--line) for prompts and
+ * status bars, both cheap enough to run every second on a large box.
  * ============================================================================ */
 
 #include "builtins.h"
 #include "shell.h"
+#include "output.h"
+#include "stats.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/utsname.h>
 #include <sys/statvfs.h>
-#include <dirent.h>
-#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
 
 /* ---- ANSI color helpers ------------------------------------------------- */
 #define CLR_RESET   "\033[0m"
@@ -28,57 +36,57 @@
 
 /* ---- Small helpers ------------------------------------------------------ */
 
-static void print_top_border(void) {
-    printf(CLR_CYAN "╔");
-    for (int i = 0; i < BOX_W; i++) printf("═");
-    printf("╗" CLR_RESET "\n");
+static void print_top_border(OutBuf *out) {
+    out_puts(out, CLR_CYAN "╔");
+    out_repeat(out, "═", BOX_W);
+    out_puts(out, "╗" CLR_RESET "\n");
 }
 
-static void print_mid_border(void) {
-    printf(CLR_CYAN "╠");
-    for (int i = 0; i < BOX_W; i++) printf("═");
-    printf("╣" CLR_RESET "\n");
+static void print_mid_border(OutBuf *out) {
+    out_puts(out, CLR_CYAN "╠");
+    out_repeat(out, "═", BOX_W);
+    out_puts(out, "╣" CLR_RESET "\n");
 }
 
-static void print_bot_border(void) {
-    printf(CLR_CYAN "╚");
-    for (int i = 0; i < BOX_W; i++) printf("═");
-    printf("╝" CLR_RESET "\n");
+static void print_bot_border(OutBuf *out) {
+    out_puts(out, CLR_CYAN "╚");
+    out_repeat(out, "═", BOX_W);
+    out_puts(out, "╝" CLR_RESET "\n");
 }
 
 /*
  * Print a row:  ║  Label     : Value                    ║
  * label_width is the space for the label text (padded).
  */
-static void print_row(const char *label, const char *value) {
+static void print_row(OutBuf *out, const char *label, const char *value) {
     /* "  %-10s : %-Ns" where N fills to BOX_W */
     /* inside the box we have BOX_W chars to work with */
     int inner = BOX_W - 2; /* 2 for leading spaces removed below - actually let's just do it */
-    printf(CLR_CYAN "║" CLR_RESET "  " CLR_CYAN "%-10s" CLR_RESET " : "
-           CLR_WHITE "%-*s" CLR_RESET CLR_CYAN "║" CLR_RESET "\n",
-           label, inner - 15, value);
+    out_printf(out, CLR_CYAN "║" CLR_RESET "  " CLR_CYAN "%-10s" CLR_RESET
+               " : " CLR_WHITE "%-*s" CLR_RESET CLR_CYAN "║" CLR_RESET "\n",
+               label, inner - 15, value);
 }
 
 /* Print a raw line inside the box (already formatted content) */
-static void print_box_line(const char *content) {
+static void print_box_line(OutBuf *out, const char *content) {
     /* We need to pad to BOX_W visible chars.  content may have ANSI codes.
      * Easiest: print content then pad manually. */
-    printf(CLR_CYAN "║" CLR_RESET "  %s", content);
+    out_printf(out, CLR_CYAN "║" CLR_RESET "  %s", content);
     /* We can't easily measure visible width with ANSI, so just pad with
      * enough spaces and close.  We'll use a fixed field approach. */
-    printf(CLR_CYAN "║" CLR_RESET "\n");
+    out_puts(out, CLR_CYAN "║" CLR_RESET "\n");
 }
 
-static void print_title(const char *title) {
+static void print_title(OutBuf *out, const char *title) {
     int tlen = (int)strlen(title);
     int pad_total = BOX_W - tlen;
     int pad_left = pad_total / 2;
     int pad_right = pad_total - pad_left;
-    printf(CLR_CYAN "║" CLR_BOLD CLR_WHITE);
-    for (int i = 0; i < pad_left; i++) putchar(' ');
-    printf("%s", title);
-    for (int i = 0; i < pad_right; i++) putchar(' ');
-    printf(CLR_RESET CLR_CYAN "║" CLR_RESET "\n");
+    out_puts(out, CLR_CYAN "║" CLR_BOLD CLR_WHITE);
+    out_repeat(out, " ", pad_left);
+    out_puts(out, title);
+    out_repeat(out, " ", pad_right);
+    out_puts(out, CLR_RESET CLR_CYAN "║" CLR_RESET "\n");
 }
 
 /* ---- Data readers ------------------------------------------------------- */
@@ -105,19 +113,209 @@ static void read_os_name(char *buf, size_t sz) {
     if (buf[0] == '\0') snprintf(buf, sz, "Unknown");
 }
 
-static void read_uptime(char *buf, size_t sz) {
-    FILE *f = fopen("/proc/uptime", "r");
-    buf[0] = '\0';
-    if (!f) { snprintf(buf, sz, "N/A"); return; }
-    double up = 0;
-    if (fscanf(f, "%lf", &up) != 1) up = 0;
-    fclose(f);
+/* ---- /proc sampling ---------------------------------------------------- */
+
+/*
+ * The /proc files are opened once per shell and re-read with pread() at
+ * offset 0 into one fixed buffer: no FILE, no reopen, and no scan of
+ * /proc -- the task count is the last field of /proc/loadavg. CPU usage
+ * is the change in /proc/stat's busy and total jiffies since the previous
+ * sample, which for a one-shot `sysinfo` is the previous call in this
+ * shell (or a short priming sample on the first).
+ */
+
+#define SAMPLE_BUF      65536       /* Holds the cpu lines of /proc/stat */
+#define SAMPLE_PRIME_MS 100         /* First sample: measure over this */
+#define CORES_PER_ROW   7
+
+typedef struct CpuTimes {
+    unsigned long long busy;
+    unsigned long long total;
+} CpuTimes;
+
+typedef struct Sampler {
+    bool      opened;
+    int       meminfo, uptime, loadavg, stat;   /* -1 if unavailable */
+    int       ncpu;             /* Cores in the last /proc/stat read */
+    int       cap;              /* Entries in prev/cur, [0] is all CPUs */
+    CpuTimes *prev;
+    CpuTimes *cur;
+    bool      have;             /* cur holds a reading */
+    bool      primed;           /* And prev one with the same cores */
+    uint64_t  when;             /* stats_now() of the cur reading */
+    char      cpu_name[128];
+    char      buf[SAMPLE_BUF];
+} Sampler;
+
+typedef struct Sample {
+    unsigned long mem_total, mem_avail, swap_total, swap_free;  /* kB */
+    double        uptime;
+    double        load[3];
+    long          running, tasks;
+    int           cpu_pct;      /* -1 if unknown */
+    int           ncpu;
+    const CpuTimes *prev, *cur; /* Per-core deltas: entries 1..ncpu */
+} Sample;
+
+static Sampler sampler;
+
+static int proc_open(const char *path) {
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+/* Re-read a /proc file from the start into the sampler's buffer */
+static const char *proc_read(int fd) {
+    if (fd < 0)
+        return NULL;
+    size_t got = 0;
+    while (got < SAMPLE_BUF - 1) {
+        ssize_t n = pread(fd, sampler.buf + got, SAMPLE_BUF - 1 - got,
+                          (off_t)got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        got += (size_t)n;
+    }
+    sampler.buf[got] = '\0';
+    return got ? sampler.buf : NULL;
+}
+
+/* Value of "Key:   123 kB" in /proc/meminfo text */
+static unsigned long meminfo_field(const char *text, const char *key) {
+    size_t klen = strlen(key);
+    for (const char *p = text; p; ) {
+        if (strncmp(p, key, klen) == 0 && p[klen] == ':')
+            return strtoul(p + klen + 1, NULL, 10);
+        p = strchr(p, '\n');
+        if (p)
+            p++;
+    }
+    return 0;
+}
+
+/* Parse the "cpu" and "cpuN" lines of /proc/stat into cur[0..]. Returns
+ * false if there were none. */
+static bool parse_stat(const char *text) {
+    int n = 0;
+    for (const char *p = text; p && strncmp(p, "cpu", 3) == 0; ) {
+        if (n == sampler.cap) {
+            int cap = sampler.cap ? sampler.cap * 2 : 16;
+            CpuTimes *cur  = realloc(sampler.cur, sizeof(CpuTimes) * (size_t)cap);
+            if (cur)
+                sampler.cur = cur;
+            CpuTimes *prev = realloc(sampler.prev, sizeof(CpuTimes) * (size_t)cap);
+            if (prev)
+                sampler.prev = prev;
+            if (!cur || !prev)
+                break;
+            memset(sampler.prev + sampler.cap, 0,
+                   sizeof(CpuTimes) * (size_t)(cap - sampler.cap));
+            sampler.cap = cap;
+        }
+
+        /* user nice system idle iowait irq softirq steal (guest is in user) */
+        char *q = strchr(p, ' ');
+        unsigned long long v[8] = {0}, total = 0;
+        for (int k = 0; k < 8 && q; k++) {
+            v[k] = strtoull(q, &q, 10);
+            total += v[k];
+        }
+        sampler.cur[n].total = total;
+        sampler.cur[n].busy  = total - v[3] - v[4];
+        n++;
+
+        p = strchr(p, '\n');
+        if (p)
+            p++;
+    }
+    sampler.ncpu = n > 0 ? n - 1 : 0;
+    return n > 0;
+}
+
+static int percent(const CpuTimes *prev, const CpuTimes *cur) {
+    unsigned long long dt = cur->total - prev->total;
+    if (cur->total < prev->total || dt == 0)
+        return 0;
+    unsigned long long db = cur->busy >= prev->busy ? cur->busy - prev->busy : 0;
+    int pct = (int)((db * 100 + dt / 2) / dt);
+    return pct > 100 ? 100 : pct;
+}
+
+static void sampler_open(void) {
+    if (sampler.opened)
+        return;
+    sampler.opened  = true;
+    sampler.meminfo = proc_open("/proc/meminfo");
+    sampler.uptime  = proc_open("/proc/uptime");
+    sampler.loadavg = proc_open("/proc/loadavg");
+    sampler.stat    = proc_open("/proc/stat");
+}
+
+/* Read new CPU times; the current ones become prev */
+static void sample_cpu(void) {
+    CpuTimes *older = sampler.prev;
+    sampler.prev = sampler.cur;
+    sampler.cur  = older;
+
+    int  before = sampler.ncpu;
+    bool had    = sampler.have;
+    const char *text = proc_read(sampler.stat);
+    sampler.have   = text && parse_stat(text);
+    sampler.primed = had && sampler.have && sampler.ncpu == before;
+}
+
+static void take_sample(Sample *s) {
+    memset(s, 0, sizeof(*s));
+    sampler_open();
+
+    const char *text = proc_read(sampler.meminfo);
+    if (text) {
+        s->mem_total  = meminfo_field(text, "MemTotal");
+        s->mem_avail  = meminfo_field(text, "MemAvailable");
+        s->swap_total = meminfo_field(text, "SwapTotal");
+        s->swap_free  = meminfo_field(text, "SwapFree");
+    }
+    if ((text = proc_read(sampler.uptime)) != NULL)
+        s->uptime = strtod(text, NULL);
+    if ((text = proc_read(sampler.loadavg)) != NULL &&
+        sscanf(text, "%lf %lf %lf %ld/%ld", &s->load[0], &s->load[1],
+               &s->load[2], &s->running, &s->tasks) != 5)
+        s->running = s->tasks = 0;
+
+    /* A delta needs some time behind it: back-to-back calls wait a little,
+     * and the first (or one after a CPU came online) measures its own */
+    uint64_t min_ns = SAMPLE_PRIME_MS * 1000000ULL;
+    for (int tries = 0; tries < 2; tries++) {
+        uint64_t since = stats_now() - sampler.when;
+        if (sampler.have && since < min_ns) {
+            struct timespec ts = { 0, (long)(min_ns - since) };
+            nanosleep(&ts, NULL);
+        }
+        sample_cpu();
+        sampler.when = stats_now();
+        if (sampler.primed)
+            break;
+    }
+
+    s->cpu_pct = -1;
+    if (sampler.primed) {
+        s->ncpu    = sampler.ncpu;
+        s->prev    = sampler.prev;
+        s->cur     = sampler.cur;
+        s->cpu_pct = percent(&s->prev[0], &s->cur[0]);
+    }
+}
+
+static void format_uptime(char *buf, size_t sz, double up) {
     int total = (int)up;
     int days  = total / 86400;
     int hours = (total % 86400) / 3600;
     int mins  = (total % 3600) / 60;
     int secs  = total % 60;
-    if (days > 0)
+    if (up <= 0)
+        snprintf(buf, sz, "N/A");
+    else if (days > 0)
         snprintf(buf, sz, "%dd %dh %dm %ds", days, hours, mins, secs);
     else if (hours > 0)
         snprintf(buf, sz, "%dh %dm %ds", hours, mins, secs);
@@ -125,82 +323,30 @@ static void read_uptime(char *buf, size_t sz) {
         snprintf(buf, sz, "%dm %ds", mins, secs);
 }
 
-static void read_cpu(char *name, size_t nsz, int *cores) {
+/* Model name from /proc/cpuinfo, read once: it can be long on big boxes */
+static const char *cpu_name(void) {
+    if (sampler.cpu_name[0])
+        return sampler.cpu_name;
     FILE *f = fopen("/proc/cpuinfo", "r");
-    name[0] = '\0';
-    *cores = 0;
-    if (!f) { snprintf(name, nsz, "N/A"); return; }
     char line[512];
-    while (fgets(line, sizeof(line), f)) {
-        if (strncmp(line, "processor", 9) == 0) {
-            (*cores)++;
-        }
-        if (name[0] == '\0' && strncmp(line, "model name", 10) == 0) {
+    while (f && fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "model name", 10) == 0) {
             char *colon = strchr(line, ':');
             if (colon) {
                 colon++;
                 while (*colon == ' ' || *colon == '\t') colon++;
-                strncpy(name, colon, nsz - 1);
-                name[nsz - 1] = '\0';
-                char *nl = strchr(name, '\n');
+                snprintf(sampler.cpu_name, sizeof(sampler.cpu_name), "%s", colon);
+                char *nl = strchr(sampler.cpu_name, '\n');
                 if (nl) *nl = '\0';
             }
+            break;
         }
     }
-    fclose(f);
-    if (name[0] == '\0') snprintf(name, nsz, "N/A");
-    if (*cores == 0) *cores = 1;
-}
-
-static void read_meminfo(unsigned long *mem_total, unsigned long *mem_free,
-                         unsigned long *mem_avail,
-                         unsigned long *swap_total, unsigned long *swap_free) {
-    *mem_total = *mem_free = *mem_avail = 0;
-    *swap_total = *swap_free = 0;
-    FILE *f = fopen("/proc/meminfo", "r");
-    if (!f) return;
-    char line[256];
-    while (fgets(line, sizeof(line), f)) {
-        unsigned long val;
-        if (sscanf(line, "MemTotal: %lu kB", &val) == 1)       *mem_total = val;
-        else if (sscanf(line, "MemFree: %lu kB", &val) == 1)   *mem_free = val;
-        else if (sscanf(line, "MemAvailable: %lu kB", &val) == 1) *mem_avail = val;
-        else if (sscanf(line, "SwapTotal: %lu kB", &val) == 1) *swap_total = val;
-        else if (sscanf(line, "SwapFree: %lu kB", &val) == 1)  *swap_free = val;
-    }
-    fclose(f);
-}
-
-static void read_loadavg(char *buf, size_t sz) {
-    FILE *f = fopen("/proc/loadavg", "r");
-    buf[0] = '\0';
-    if (!f) { snprintf(buf, sz, "N/A"); return; }
-    double l1, l5, l15;
-    if (fscanf(f, "%lf %lf %lf", &l1, &l5, &l15) == 3)
-        snprintf(buf, sz, "%.2f %.2f %.2f", l1, l5, l15);
-    else
-        snprintf(buf, sz, "N/A");
-    fclose(f);
-}
-
-static int count_processes(void) {
-    DIR *d = opendir("/proc");
-    if (!d) return 0;
-    int count = 0;
-    struct dirent *ent;
-    while ((ent = readdir(d)) != NULL) {
-        /* Check if directory name is all digits (a PID) */
-        const char *p = ent->d_name;
-        if (*p == '\0') continue;
-        bool numeric = true;
-        while (*p) {
-            if (!isdigit((unsigned char)*p)) { numeric = false; break; }
-            p++;
-        }
-        if (numeric) count++;
-    }
-    closedir(d);
-    return count;
+    if (f)
+        fclose(f);
+    if (sampler.cpu_name[0] == '\0')
+        snprintf(sampler.cpu_name, sizeof(sampler.cpu_name), "N/A");
+    return sampler.cpu_name;
 }
 
 /* ---- Progress bar ------------------------------------------------------- */
@@ -226,17 +372,25 @@ static void format_bar(char *buf, size_t sz, int percent, int width) {
     (void)off;
 }
 
-/* ---- Main entry point --------------------------------------------------- */
+/* ---- Output ----------------------------------------------------------- */
 
-/*
- * sysinfo
- *
- * Display a colourful system information dashboard.
- */
-int builtin_sysinfo(Shell *shell, int argc, char **argv) {
-    (void)shell; (void)argc; (void)argv;
+static int used_pct(unsigned long total, unsigned long avail) {
+    return total > 0 && avail <= total ? (int)((total - avail) * 100UL / total) : 0;
+}
 
-    /* Gather data */
+/* Per-core usage, CORES_PER_ROW to a row */
+static void print_cores(OutBuf *out, const Sample *s) {
+    char val[64];
+    for (int c = 0; c < s->ncpu; c += CORES_PER_ROW) {
+        int off = 0;
+        for (int k = c; k < s->ncpu && k < c + CORES_PER_ROW; k++)
+            off += snprintf(val + off, sizeof(val) - (size_t)off, "%4d",
+                            percent(&s->prev[k + 1], &s->cur[k + 1]));
+        print_row(out, c == 0 ? "Per-core %" : "", val);
+    }
+}
+
+static void print_dashboard(OutBuf *out, const Sample *s, bool cores) {
     struct utsname uts;
     uname(&uts);
 
@@ -244,19 +398,7 @@ int builtin_sysinfo(Shell *shell, int argc, char **argv) {
     read_os_name(os_name, sizeof(os_name));
 
     char uptime[64];
-    read_uptime(uptime, sizeof(uptime));
-
-    char cpu_name[128];
-    int cpu_cores;
-    read_cpu(cpu_name, sizeof(cpu_name), &cpu_cores);
-
-    unsigned long mem_total, mem_free, mem_avail, swap_total, swap_free;
-    read_meminfo(&mem_total, &mem_free, &mem_avail, &swap_total, &swap_free);
-
-    char loadavg[64];
-    read_loadavg(loadavg, sizeof(loadavg));
-
-    int procs = count_processes();
+    format_uptime(uptime, sizeof(uptime), s->uptime);
 
     /* Disk usage for / */
     struct statvfs vfs;
@@ -270,69 +412,200 @@ int builtin_sysinfo(Shell *shell, int argc, char **argv) {
     }
 
     /* Memory calculations */
-    double mem_total_gib = mem_total / (1024.0 * 1024.0);
-    unsigned long mem_used_kb = mem_total - mem_avail;
-    double mem_used_gib = mem_used_kb / (1024.0 * 1024.0);
-    int mem_pct = (mem_total > 0) ? (int)(mem_used_kb * 100UL / mem_total) : 0;
+    double mem_total_gib = s->mem_total / (1024.0 * 1024.0);
+    double mem_used_gib  = (s->mem_total - s->mem_avail) / (1024.0 * 1024.0);
+    int    mem_pct       = used_pct(s->mem_total, s->mem_avail);
 
-    double swap_total_gib = swap_total / (1024.0 * 1024.0);
-    unsigned long swap_used_kb = swap_total - swap_free;
-    double swap_used_gib = swap_used_kb / (1024.0 * 1024.0);
-    int swap_pct = (swap_total > 0) ? (int)(swap_used_kb * 100UL / swap_total) : 0;
+    double swap_total_gib = s->swap_total / (1024.0 * 1024.0);
+    double swap_used_gib  = (s->swap_total - s->swap_free) / (1024.0 * 1024.0);
+    int    swap_pct       = used_pct(s->swap_total, s->swap_free);
 
     /* Format value strings */
     char val[256];
 
     /* Print dashboard */
-    print_top_border();
-    print_title("vsh System Information");
-    print_mid_border();
+    print_top_border(out);
+    print_title(out, "vsh System Information");
+    print_mid_border(out);
 
-    print_row("OS",       os_name);
-    print_row("Kernel",   uts.release);
-    print_row("Hostname", uts.nodename);
-    print_row("Uptime",   uptime);
-    print_row("Shell",    "vsh 1.0.0");
+    print_row(out, "OS",       os_name);
+    print_row(out, "Kernel",   uts.release);
+    print_row(out, "Hostname", uts.nodename);
+    print_row(out, "Uptime",   uptime);
+    print_row(out, "Shell",    "vsh 1.0.0");
 
-    snprintf(val, sizeof(val), "%d", procs);
-    print_row("Processes", val);
+    /* Kernel scheduling entities (threads), from /proc/loadavg */
+    snprintf(val, sizeof(val), "%ld (%ld running)", s->tasks, s->running);
+    print_row(out, "Tasks", val);
 
-    print_mid_border();
+    print_mid_border(out);
 
     /* Truncate CPU name if needed */
-    if (strlen(cpu_name) > 30) {
-        cpu_name[30] = '\0';
+    char name[31];
+    const char *cpu = cpu_name();
+    size_t nlen = strlen(cpu) < sizeof(name) - 1 ? strlen(cpu) : sizeof(name) - 1;
+    memcpy(name, cpu, nlen);
+    name[nlen] = '\0';
+    print_row(out, "CPU", name);
+    snprintf(val, sizeof(val), "%d", s->ncpu > 0 ? s->ncpu : 1);
+    print_row(out, "Cores", val);
+    snprintf(val, sizeof(val), "%.2f %.2f %.2f", s->load[0], s->load[1], s->load[2]);
+    print_row(out, "Load Avg", val);
+
+    char bar[512];
+    char bar_line[600];
+    if (s->cpu_pct >= 0) {
+        snprintf(val, sizeof(val), "%d%%", s->cpu_pct);
+        print_row(out, "CPU Usage", val);
+        format_bar(bar, sizeof(bar), s->cpu_pct, 24);
+        snprintf(bar_line, sizeof(bar_line), "%s%*s", bar, BOX_W - 28, "");
+        print_box_line(out, bar_line);
+        if (cores)
+            print_cores(out, s);
     }
-    print_row("CPU",  cpu_name);
-    snprintf(val, sizeof(val), "%d", cpu_cores);
-    print_row("Cores",    val);
-    print_row("Load Avg", loadavg);
 
-    print_mid_border();
+    print_mid_border(out);
 
     /* Memory with bar */
     snprintf(val, sizeof(val), "%.1f/%.1f GiB (%d%%)",
              mem_used_gib, mem_total_gib, mem_pct);
-    print_row("Memory", val);
+    print_row(out, "Memory", val);
 
-    char bar[512];
     format_bar(bar, sizeof(bar), mem_pct, 24);
-    char bar_line[600];
     /* Pad the bar line to fit inside the box */
     snprintf(bar_line, sizeof(bar_line), "%s%*s", bar, BOX_W - 28, "");
-    print_box_line(bar_line);
+    print_box_line(out, bar_line);
 
     /* Swap */
     snprintf(val, sizeof(val), "%.1f/%.1f GiB (%d%%)",
              swap_used_gib, swap_total_gib, swap_pct);
-    print_row("Swap", val);
+    print_row(out, "Swap", val);
 
     /* Disk */
     snprintf(val, sizeof(val), "%.1f/%.1f GiB (%d%%)",
              disk_used, disk_total, disk_pct);
-    print_row("Disk (/)", val);
+    print_row(out, "Disk (/)", val);
 
-    print_bot_border();
+    print_bot_border(out);
+}
 
-    return 0;
+/* One line, no colour: for a prompt or a tmux status bar */
+static void print_line(OutBuf *out, const Sample *s) {
+    char uptime[64];
+    format_uptime(uptime, sizeof(uptime), s->uptime);
+    char *sec = strrchr(uptime, ' ');       /* Seconds are noise here */
+    if (sec && s->uptime >= 60)
+        *sec = '\0';
+
+    if (s->cpu_pct >= 0)
+        out_printf(out, "cpu %d%% ", s->cpu_pct);
+    out_printf(out, "mem %d%% %.1f/%.1fG load %.2f %.2f %.2f tasks %ld/%ld up %s\n",
+               used_pct(s->mem_total, s->mem_avail),
+               (s->mem_total - s->mem_avail) / (1024.0 * 1024.0),
+               s->mem_total / (1024.0 * 1024.0),
+               s->load[0], s->load[1], s->load[2], s->running, s->tasks,
+               uptime);
+}
+
+/* ---- Main entry point --------------------------------------------------- */
+
+/* Flag set by SIGINT handler to break the -w loop */
+static volatile sig_atomic_t sysinfo_interrupted = 0;
+
+static void sysinfo_sigint_handler(int sig) {
+    (void)sig;
+    sysinfo_interrupted = 1;
+}
+
+/* Sleep for interval seconds measured from *next, so output does not
+ * drift by the time each sample takes; false if interrupted */
+static bool sleep_until(struct timespec *next, double interval) {
+    long long ns = next->tv_nsec + (long long)(interval * 1e9);
+    next->tv_sec  += (time_t)(ns / 1000000000LL);
+    next->tv_nsec  = (long)(ns % 1000000000LL);
+    while (!sysinfo_interrupted) {
+        int rc = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL);
+        if (rc == 0)
+            return true;
+        if (rc != EINTR)
+            break;
+    }
+    return false;
+}
+
+/*
+ * sysinfo [-w SECONDS] [-c COUNT] [--line]
+ *
+ * Display a colourful system information dashboard.
+ *   -w SECONDS   refresh every SECONDS until interrupted, with CPU usage
+ *                per core measured over each interval
+ *   -c COUNT     stop after COUNT samples
+ *   --line       a single line (cpu, mem, load, tasks, uptime) instead
+ */
+int builtin_sysinfo(Shell *shell, int argc, char **argv) {
+    double interval = 0;
+    long   count    = 0;
+    bool   line     = false;
+
+    for (int i = 1; i < argc; i++) {
+        char *endp = NULL;
+        if (strcmp(argv[i], "--line") == 0) {
+            line = true;
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            interval = strtod(argv[++i], &endp);
+            if (*endp != '\0' || interval <= 0) {
+                fprintf(stderr, "vsh: sysinfo: invalid interval '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            count = strtol(argv[++i], &endp, 10);
+            if (*endp != '\0' || count <= 0) {
+                fprintf(stderr, "vsh: sysinfo: invalid count '%s'\n", argv[i]);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Usage: sysinfo [-w SECONDS] [-c COUNT] [--line]\n");
+            return 1;
+        }
+    }
+
+    Sample s;
+    if (interval <= 0) {
+        take_sample(&s);
+        if (line)
+            print_line(shell->out, &s);
+        else
+            print_dashboard(shell->out, &s, false);
+        return 0;
+    }
+
+    /* Install our SIGINT handler, saving the old one */
+    sysinfo_interrupted = 0;
+    struct sigaction sa_new, sa_old;
+    memset(&sa_new, 0, sizeof(sa_new));
+    sa_new.sa_handler = sysinfo_sigint_handler;
+    sigemptyset(&sa_new.sa_mask);
+    sigaction(SIGINT, &sa_new, &sa_old);
+
+    bool redraw = !line && isatty(STDOUT_FILENO);
+    int status = 0;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (long n = 0; !sysinfo_interrupted && (count == 0 || n < count); n++) {
+        if (n > 0 && !sleep_until(&next, interval))
+            break;
+        take_sample(&s);
+        if (redraw)
+            out_puts(shell->out, "\x1b[H\x1b[J");
+        if (line)
+            print_line(shell->out, &s);
+        else
+            print_dashboard(shell->out, &s, true);
+        status = builtins_finish(shell, "sysinfo", 0);
+        if (status != 0)
+            break;              /* Reader went away, disk full, ... */
+    }
+
+    sigaction(SIGINT, &sa_old, NULL);
+    return status ? status : sysinfo_interrupted ? 130 : 0;
 }
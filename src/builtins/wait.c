@@ -0,0 +1,64 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * builtins/wait.c - Wait for background jobs
+ * ============================================================================ */
+
+#include "builtins.h"
+#include "shell.h"
+#include "job_control.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Resolve %N (job number) or a bare PID. Prints an error on failure. */
+static Job *find_wait_target(Shell *shell, const char *arg) {
+    char *endp;
+
+    if (arg[0] == '%') {
+        long id = strtol(arg + 1, &endp, 10);
+        Job *job = (*endp == '\0' && id > 0) ? job_find_by_id(shell, (int)id)
+                                             : NULL;
+        if (!job)
+            fprintf(stderr, "vsh: wait: %s: no such job\n", arg);
+        return job;
+    }
+
+    long pid = strtol(arg, &endp, 10);
+    if (*endp != '\0' || pid <= 0) {
+        fprintf(stderr, "vsh: wait: `%s': not a pid or valid job spec\n", arg);
+        return NULL;
+    }
+    Job *job = job_find_by_pid(shell, (pid_t)pid);
+    if (!job)
+        fprintf(stderr, "vsh: wait: pid %ld is not a child of this shell\n",
+                pid);
+    return job;
+}
+
+/*
+ * wait [%N | PID ...]
+ *
+ * Wait for the given jobs to finish and return the exit status of the last
+ * one (127 if it is unknown). With no arguments, wait for every running
+ * job and return 0. Stopped jobs are not waited for.
+ */
+int builtin_wait(Shell *shell, int argc, char **argv) {
+    if (argc < 2) {
+        Job *j;
+        do {
+            for (j = shell->jobs ? shell->jobs->head : NULL; j; j = j->next) {
+                if (j->state == JOB_RUNNING)
+                    break;
+            }
+            if (j)
+                job_wait(shell, j);
+        } while (j);
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        Job *job = find_wait_target(shell, argv[i]);
+        status = job ? job_wait(shell, job) : 127;
+    }
+    return status;
+}
@@ -1,10 +1,21 @@
 /* ============================================================================
  * vsh - Vanguard Shell
  * builtins/watch_cmd.c - Execute a command repeatedly at intervals
+ *
+ * The command is parsed once into its own arena and re-run every tick
+ * through the executor with its output captured, so shell functions and
+ * builtins work, and builtins cost no process at all.
+ * Each frame is compared with the previous one line by line and only the
+ * rows that changed are rewritten, in a single write().
  * ============================================================================ */
 
 #include "builtins.h"
 #include "shell.h"
+#include "arena.h"
+#include "executor.h"
+#include "lexer.h"
+#include "parser.h"
+#include "safe_string.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +23,7 @@
 #include <signal.h>
 #include <time.h>
 #include <errno.h>
+#include <sys/ioctl.h>
 
 /* Flag set by SIGINT handler to break the watch loop */
 static volatile sig_atomic_t watch_interrupted = 0;
@@ -21,20 +33,111 @@ static void watch_sigint_handler(int sig) {
     watch_interrupted = 1;
 }
 
+/* ---- Screen state ------------------------------------------------------- */
+
+#define WATCH_BODY_ROW 3    /* Header, blank line, then the output */
+
+typedef struct WatchScreen {
+    SafeString *prev;       /* Output shown on screen */
+    SafeString *next;       /* Output of this tick */
+    SafeString *frame;      /* Escape sequences for this redraw */
+    bool       *marked;     /* Row is drawn highlighted */
+    int         rows;
+    int         cols;
+    bool        full;       /* Clear the screen and draw every row */
+} WatchScreen;
+
+/* Pick up the terminal size; a change forces a full redraw */
+static void screen_resize(WatchScreen *ws) {
+    struct winsize w;
+    int rows = 24, cols = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0 && w.ws_row > 0) {
+        rows = w.ws_row;
+        cols = w.ws_col;
+    }
+    if (ws->marked && rows == ws->rows && cols == ws->cols)
+        return;
+
+    bool *marked = calloc((size_t)rows, sizeof(bool));
+    if (marked) {
+        free(ws->marked);
+        ws->marked = marked;
+        ws->rows   = rows;
+        ws->cols   = cols;
+    }
+    ws->full = true;
+}
+
+/* Split off the line at *p (without its newline); false at the end */
+static bool next_line(const char **p, const char *end,
+                      const char **line, size_t *len) {
+    if (*p >= end)
+        return false;
+    const char *nl = memchr(*p, '\n', (size_t)(end - *p));
+    *line = *p;
+    *len  = nl ? (size_t)(nl - *p) : (size_t)(end - *p);
+    *p    = nl ? nl + 1 : end;
+    return true;
+}
+
+/* Queue a rewrite of every output row whose text changed, or whose
+ * highlight must come or go */
+static void draw_body(WatchScreen *ws, bool highlight) {
+    const char *np = ws->next->data, *ne = np + ws->next->len;
+    const char *op = ws->prev->data, *oe = op + ws->prev->len;
+    int avail = ws->rows - (WATCH_BODY_ROW - 1);
+
+    for (int row = 0; row < avail; row++) {
+        const char *nl = "", *ol = "";
+        size_t nlen = 0, olen = 0;
+        bool have_new = next_line(&np, ne, &nl, &nlen);
+        bool have_old = next_line(&op, oe, &ol, &olen);
+        if (!have_new && !have_old && !ws->marked[row])
+            break;
+
+        bool changed = have_new != have_old || nlen != olen ||
+                       memcmp(nl, ol, nlen) != 0;
+        bool mark = highlight && changed && !ws->full;
+        if (!ws->full && !changed && !ws->marked[row])
+            continue;
+
+        sstr_appendf(ws->frame, "\x1b[%d;1H", WATCH_BODY_ROW + row);
+        if (mark)
+            sstr_append(ws->frame, "\x1b[7m");
+        sstr_append_n(ws->frame, nl, nlen);
+        sstr_append(ws->frame, mark ? "\x1b[0m\x1b[K" : "\x1b[K");
+        ws->marked[row] = mark;
+    }
+}
+
+/* Write the whole frame, retrying short writes */
+static void flush_frame(SafeString *frame) {
+    size_t off = 0;
+    while (off < frame->len) {
+        ssize_t n = write(STDOUT_FILENO, frame->data + off, frame->len - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        off += (size_t)n;
+    }
+    sstr_clear(frame);
+}
+
 /* ---- Main entry point --------------------------------------------------- */
 
 /*
- * watch [-n SECONDS] COMMAND...
+ * watch [-n SECONDS] [-d] COMMAND...
  *
  * Execute a command repeatedly, refreshing the display at a given interval.
  *   -n SECONDS   Set the update interval (default 2.0, supports decimals)
+ *   -d           Highlight the lines that changed since the last update
  *
  * Press Ctrl+C to stop.
  */
 int builtin_watch(Shell *shell, int argc, char **argv) {
-    (void)shell;
-
     double interval = 2.0;
+    bool highlight = false;
     int cmd_start = 1;  /* Index in argv where the command begins */
 
     /* Parse options */
@@ -63,6 +166,9 @@ int builtin_watch(Shell *shell, int argc, char **argv) {
                 return 1;
             }
             cmd_start = i + 1;
+        } else if (strcmp(argv[i], "-d") == 0) {
+            highlight = true;
+            cmd_start = i + 1;
         } else {
             cmd_start = i;
             break;
@@ -70,30 +176,58 @@ int builtin_watch(Shell *shell, int argc, char **argv) {
     }
 
     if (cmd_start >= argc) {
-        fprintf(stderr, "Usage: watch [-n SECONDS] COMMAND...\n");
+        fprintf(stderr, "Usage: watch [-n SECONDS] [-d] COMMAND...\n");
         return 1;
     }
 
-    /* Join remaining arguments into a single command string */
-    size_t cmd_len = 0;
-    for (int i = cmd_start; i < argc; i++)
-        cmd_len += strlen(argv[i]) + 1;
+    /* Join remaining arguments into a single command and parse it once */
+    SafeString *command = sstr_new(128);
+    for (int i = cmd_start; i < argc; i++) {
+        if (i > cmd_start) sstr_append_char(command, ' ');
+        sstr_append(command, argv[i]);
+    }
 
-    char *command = malloc(cmd_len + 1);
-    if (!command) {
+    Arena *arena = arena_create_sized(ARENA_PAGE_SIZE * 4);
+    if (!command || !arena) {
         fprintf(stderr, "vsh: watch: out of memory\n");
+        sstr_free(command);
+        arena_destroy(arena);
         return 1;
     }
-    command[0] = '\0';
-    for (int i = cmd_start; i < argc; i++) {
-        if (i > cmd_start) strcat(command, " ");
-        strcat(command, argv[i]);
+
+    Lexer lex;
+    lexer_init(&lex, sstr_cstr(command), arena);
+    TokenList *tokens = lexer_tokenize(&lex);
+    ASTNode *ast = NULL;
+    const char *error = NULL;
+    if (!tokens || lex.error) {
+        error = lex.error ? lex.error : "tokenization failed";
+    } else {
+        Parser parser;
+        parser_init(&parser, tokens, arena);
+        ast = parser_parse(&parser);
+        if (parser.had_error || !ast)
+            error = parser_error(&parser) ? parser_error(&parser)
+                                          : "unexpected token";
+    }
+    if (error) {
+        fprintf(stderr, "vsh: watch: syntax error: %s\n", error);
+        sstr_free(command);
+        arena_destroy(arena);
+        return 2;
     }
 
     /* Get hostname for header */
     char hostname[256];
     if (gethostname(hostname, sizeof(hostname)) != 0)
-        strncpy(hostname, "unknown", sizeof(hostname));
+        snprintf(hostname, sizeof(hostname), "unknown");
+    hostname[sizeof(hostname) - 1] = '\0';
+
+    WatchScreen ws = {
+        .prev  = sstr_new(4096),
+        .next  = sstr_new(4096),
+        .frame = sstr_new(4096),
+    };
 
     /* Install our SIGINT handler, saving the old one */
     watch_interrupted = 0;
@@ -111,38 +245,36 @@ int builtin_watch(Shell *shell, int argc, char **argv) {
 
     int last_status = 0;
 
-    while (!watch_interrupted) {
-        /* Clear screen and move cursor to top-left */
-        printf("\x1b[2J\x1b[H");
+    /* Long lines are clipped rather than wrapped, so rows stay rows */
+    sstr_append(ws.frame, "\x1b[?25l\x1b[?7l");
+
+    while (!watch_interrupted && ws.prev && ws.next && ws.frame) {
+        screen_resize(&ws);
 
-        /* Header line */
+        sstr_clear(ws.next);
+        last_status = executor_capture_node(shell, ast, ws.next);
+        if (watch_interrupted) break;
+
+        if (ws.full)
+            sstr_append(ws.frame, "\x1b[H\x1b[2J");
+
+        /* Header line: only the clock moves, but it is one row */
         time_t now = time(NULL);
         struct tm *tm = localtime(&now);
         char timebuf[64];
         strftime(timebuf, sizeof(timebuf), "%a %b %d %H:%M:%S %Y", tm);
+        sstr_appendf(ws.frame,
+                     "\x1b[1;1H\033[1mEvery %.1fs: \033[0m%-40s "
+                     "\033[2m%s: %s\033[0m\x1b[K",
+                     interval, sstr_cstr(command), hostname, timebuf);
 
-        printf("\033[1mEvery %.1fs: \033[0m%-40s \033[2m%s: %s\033[0m\n\n",
-               interval, command, hostname, timebuf);
-        fflush(stdout);
-
-        /* Execute the command and print its output */
-        FILE *fp = popen(command, "r");
-        if (!fp) {
-            fprintf(stderr, "vsh: watch: failed to execute '%s': %s\n",
-                    command, strerror(errno));
-            last_status = 1;
-        } else {
-            char buf[4096];
-            while (fgets(buf, sizeof(buf), fp) != NULL) {
-                if (watch_interrupted) break;
-                fputs(buf, stdout);
-            }
-            int pstat = pclose(fp);
-            last_status = WIFEXITED(pstat) ? WEXITSTATUS(pstat) : 1;
-        }
-        fflush(stdout);
+        draw_body(&ws, highlight);
+        flush_frame(ws.frame);
+        ws.full = false;
 
-        if (watch_interrupted) break;
+        SafeString *shown = ws.prev;
+        ws.prev = ws.next;
+        ws.next = shown;
 
         /* Sleep for the interval, but wake up on signal */
         struct timespec rem = ts;
@@ -154,9 +286,21 @@ int builtin_watch(Shell *shell, int argc, char **argv) {
         }
     }
 
+    /* Leave the cursor below the output, wrapping and cursor restored */
+    if (ws.frame) {
+        sstr_appendf(ws.frame, "\x1b[%d;1H\x1b[?7h\x1b[?25h\n",
+                     ws.rows > 0 ? ws.rows : 1);
+        flush_frame(ws.frame);
+    }
+
     /* Restore previous SIGINT handler */
     sigaction(SIGINT, &sa_old, NULL);
 
-    free(command);
+    free(ws.marked);
+    sstr_free(ws.prev);
+    sstr_free(ws.next);
+    sstr_free(ws.frame);
+    sstr_free(command);
+    arena_destroy(arena);
     return last_status;
 }
@@ -0,0 +1,386 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * bytecode.c - Compiler and interpreter for the flat instruction form
+ *
+ * Code shapes (S = loop slot):
+ *
+ *   a && b      a; JUMP_FAIL end; b; end:
+ *   a || b      a; JUMP_OK end; b; end:
+ *   ! a         a; NOT
+ *   if c; then t; else e; fi
+ *               c; JUMP_FAIL else; t; JUMP end; else: e (or TRUE); end:
+ *   while c; do b; done
+ *               LOOP_ENTER S; top: c; JUMP_FAIL exit; b; LOOP_SAVE S;
+ *               JUMP top; exit: LOOP_EXIT S
+ *   for v in w; do b; done
+ *               LOOP_ENTER S; top: FOR_NEXT S exit; b; LOOP_SAVE S;
+ *               JUMP top; exit: LOOP_EXIT S
+ *
+ * The interpreter keeps one status register, mirrors it into $? after
+ * every step as the tree walker does, and stops as soon as exit or return
+ * starts unwinding.
+ * ============================================================================ */
+
+#include "bytecode.h"
+#include "arena.h"
+#include "env.h"
+#include "executor.h"
+#include "shell.h"
+#include "wildcard.h"
+
+#include <string.h>
+
+/* ---- Compiler ----------------------------------------------------------- */
+
+typedef struct BcCompiler {
+    Arena     *arena;
+    BcProgram *prog;
+    int        capacity;
+    bool       failed;
+} BcCompiler;
+
+/* Append an instruction; returns its index (-1 once compilation failed) */
+static int emit(BcCompiler *c, BcOp op, ASTNode *node)
+{
+    if (c->failed)
+        return -1;
+
+    BcProgram *p = c->prog;
+    if (p->count >= c->capacity) {
+        int cap = c->capacity * 2;
+        BcInstr *code = arena_resize(c->arena, p->code,
+                                     sizeof(BcInstr) * (size_t)c->capacity,
+                                     sizeof(BcInstr) * (size_t)cap);
+        if (!code) {
+            c->failed = true;
+            return -1;
+        }
+        p->code     = code;
+        c->capacity = cap;
+    }
+
+    BcInstr *in = &p->code[p->count];
+    memset(in, 0, sizeof(*in));
+    in->op   = (uint8_t)op;
+    in->node = node;
+    return p->count++;
+}
+
+/* Point jump at the next instruction to be emitted */
+static void patch(BcCompiler *c, int jump)
+{
+    if (jump >= 0)
+        c->prog->code[jump].target = c->prog->count;
+}
+
+static void emit_jump(BcCompiler *c, BcOp op, int target)
+{
+    int at = emit(c, op, NULL);
+    if (at >= 0)
+        c->prog->code[at].target = target;
+}
+
+static int new_slot(BcCompiler *c)
+{
+    if (c->prog->nloops >= BC_LOOP_MAX) {
+        c->failed = true;
+        return 0;
+    }
+    return c->prog->nloops++;
+}
+
+static void compile_node(BcCompiler *c, ASTNode *node);
+
+static void compile_while(BcCompiler *c, ASTNode *node)
+{
+    WhileNode *wn = &node->while_node;
+    int slot = new_slot(c);
+
+    int enter = emit(c, BC_LOOP_ENTER, NULL);
+    int top   = c->prog->count;
+
+    /* A loop whose condition is just read consumes all of stdin itself */
+    ASTNode *cond = wn->condition;
+    int cond_at = c->prog->count;
+    compile_node(c, cond);
+    if (!c->failed && cond && cond->type == NODE_COMMAND &&
+        cond->cmd.argc > 0 && strcmp(cond->cmd.argv[0], "read") == 0)
+        c->prog->code[cond_at].flags |= BC_READ_LOOP;
+
+    int exit = emit(c, BC_JUMP_FAIL, NULL);
+    compile_node(c, wn->body);
+    int save = emit(c, BC_LOOP_SAVE, NULL);
+    emit_jump(c, BC_JUMP, top);
+    patch(c, exit);
+    int leave = emit(c, BC_LOOP_EXIT, NULL);
+
+    if (c->failed)
+        return;
+    c->prog->code[enter].slot = (uint16_t)slot;
+    c->prog->code[save].slot  = (uint16_t)slot;
+    c->prog->code[save].flags = BC_REWIND;
+    c->prog->code[leave].slot = (uint16_t)slot;
+}
+
+static void compile_for(BcCompiler *c, ASTNode *node)
+{
+    int slot = new_slot(c);
+
+    int enter = emit(c, BC_LOOP_ENTER, NULL);
+    int top   = emit(c, BC_FOR_NEXT, node);
+    compile_node(c, node->for_node.body);
+    int save = emit(c, BC_LOOP_SAVE, NULL);
+    emit_jump(c, BC_JUMP, top);
+    patch(c, top);
+    int leave = emit(c, BC_LOOP_EXIT, NULL);
+
+    if (c->failed)
+        return;
+    c->prog->code[enter].slot = (uint16_t)slot;
+    c->prog->code[top].slot   = (uint16_t)slot;
+    c->prog->code[save].slot  = (uint16_t)slot;
+    c->prog->code[leave].slot = (uint16_t)slot;
+}
+
+static void compile_node(BcCompiler *c, ASTNode *node)
+{
+    if (!node) {
+        emit(c, BC_TRUE, NULL);
+        return;
+    }
+
+    int jump;
+    switch (node->type) {
+    case NODE_COMMAND:
+        emit(c, BC_CMD, node);
+        break;
+
+    case NODE_ARITH:
+        emit(c, BC_ARITH, node);
+        break;
+
+    case NODE_AND:
+    case NODE_OR:
+        compile_node(c, node->binary.left);
+        jump = emit(c, node->type == NODE_AND ? BC_JUMP_FAIL : BC_JUMP_OK,
+                    NULL);
+        compile_node(c, node->binary.right);
+        patch(c, jump);
+        break;
+
+    case NODE_SEQUENCE:
+        compile_node(c, node->binary.left);
+        compile_node(c, node->binary.right);
+        break;
+
+    case NODE_NEGATE:
+        compile_node(c, node->child);
+        emit(c, BC_NOT, NULL);
+        break;
+
+    case NODE_BLOCK:
+        compile_node(c, node->child);
+        break;
+
+    case NODE_PIPELINE:
+        /* A lone command (usually `! cmd`) runs in-process anyway */
+        if (node->pipeline.count == 1 && !node->pipeline.timed) {
+            compile_node(c, node->pipeline.commands[0]);
+            if (node->pipeline.negated)
+                emit(c, BC_NOT, NULL);
+        } else {
+            emit(c, BC_NODE, node);
+        }
+        break;
+
+    case NODE_IF: {
+        IfNode *ifn = &node->if_node;
+        compile_node(c, ifn->condition);
+        jump = emit(c, BC_JUMP_FAIL, NULL);
+        compile_node(c, ifn->then_body);
+        int end = emit(c, BC_JUMP, NULL);
+        patch(c, jump);
+        if (ifn->else_body)
+            compile_node(c, ifn->else_body);
+        else
+            emit(c, BC_TRUE, NULL);
+        patch(c, end);
+        break;
+    }
+
+    case NODE_WHILE:
+        compile_while(c, node);
+        break;
+
+    case NODE_FOR:
+        compile_for(c, node);
+        break;
+
+    case NODE_BACKGROUND:
+    case NODE_SUBSHELL:
+    case NODE_FUNCTION:
+        emit(c, BC_NODE, node);
+        break;
+    }
+}
+
+BcProgram *bc_compile(Arena *arena, ASTNode *node)
+{
+    BcProgram *prog = arena_calloc(arena, 1, sizeof(BcProgram));
+    if (!prog)
+        return NULL;
+
+    BcCompiler c = { .arena = arena, .prog = prog, .capacity = 32 };
+    prog->code = arena_alloc(arena, sizeof(BcInstr) * (size_t)c.capacity);
+    if (!prog->code)
+        return NULL;
+
+    compile_node(&c, node);
+    return c.failed ? NULL : prog;
+}
+
+/* ---- Interpreter -------------------------------------------------------- */
+
+/* Per-loop state while a program runs */
+typedef struct BcLoop {
+    ArenaMark mark;             /* Parse arena on loop entry */
+    int       result;           /* Status of the last body run */
+    int       word;             /* for: next word index */
+    char    **matches;          /* for: glob matches of the current word */
+    int       nmatch;
+    int       match;            /* for: next match to bind */
+    ArenaMark match_mark;       /* for: arena after the matches */
+} BcLoop;
+
+/* Bind the for loop's next value; false when the words are exhausted */
+static bool for_next(Shell *shell, BcLoop *l, ForNode *fn)
+{
+    Arena *arena = shell->parse_arena;
+
+    if (l->match < l->nmatch) {
+        arena_rewind(arena, l->match_mark);
+        env_set(shell->env, fn->varname, l->matches[l->match++], false);
+        return true;
+    }
+
+    /* Each word's expansion lives only as long as its iterations */
+    arena_rewind(arena, l->mark);
+    l->nmatch = l->match = 0;
+    if (l->word >= fn->nwords)
+        return false;
+
+    int i = l->word++;
+    unsigned int flags = fn->word_flags ? fn->word_flags[i] : WORD_ALL;
+    char *word = fn->words[i];
+    if (flags & (WORD_EXPAND | WORD_TILDE))
+        word = env_expand_word(shell, word, flags, arena);
+
+    if ((flags & WORD_GLOB) && wildcard_has_magic(word)) {
+        int count = 0;
+        char **matches = wildcard_expand(word, arena, &count);
+        if (matches && count > 0) {
+            l->matches    = matches;
+            l->nmatch     = count;
+            l->match      = 1;
+            l->match_mark = arena_mark(arena);
+            word = matches[0];
+        }
+    }
+
+    env_set(shell->env, fn->varname, word, false);
+    return true;
+}
+
+int bc_run(Shell *shell, const BcProgram *prog)
+{
+    Arena *arena = shell->parse_arena;
+    ArenaMark base = arena_mark(arena);
+
+    BcLoop *loops = arena_calloc(arena, (size_t)prog->nloops + 1,
+                                 sizeof(BcLoop));
+    if (!loops)
+        return 1;
+
+    const BcInstr *code = prog->code;
+    int status = 0;
+    int pc = 0;
+
+    while (pc < prog->count) {
+        const BcInstr *in = &code[pc++];
+        BcLoop *l = &loops[in->slot];
+
+        switch ((BcOp)in->op) {
+        case BC_CMD:
+            if (in->flags & BC_READ_LOOP) {
+                shell->read_loop++;
+                status = executor_exec_command(shell, &in->node->cmd);
+                shell->read_loop--;
+            } else {
+                status = executor_exec_command(shell, &in->node->cmd);
+            }
+            break;
+
+        case BC_ARITH: {
+            long long value;
+            status = env_arith(shell, in->node->expr, &value, arena)
+                     ? (value != 0 ? 0 : 1) : 1;
+            break;
+        }
+
+        case BC_NODE:
+            status = executor_execute(shell, in->node);
+            break;
+
+        case BC_TRUE:
+            status = 0;
+            break;
+
+        case BC_NOT:
+            status = status == 0 ? 1 : 0;
+            break;
+
+        case BC_JUMP:
+            pc = in->target;
+            continue;
+
+        case BC_JUMP_OK:
+            if (status == 0)
+                pc = in->target;
+            continue;
+
+        case BC_JUMP_FAIL:
+            if (status != 0)
+                pc = in->target;
+            continue;
+
+        case BC_LOOP_ENTER:
+            memset(l, 0, sizeof(*l));
+            l->mark = arena_mark(arena);
+            continue;
+
+        case BC_LOOP_SAVE:
+            l->result = status;
+            if (in->flags & BC_REWIND)
+                arena_rewind(arena, l->mark);
+            continue;
+
+        case BC_LOOP_EXIT:
+            arena_rewind(arena, l->mark);
+            status = l->result;
+            break;
+
+        case BC_FOR_NEXT:
+            if (!for_next(shell, l, &in->node->for_node))
+                pc = in->target;
+            continue;
+        }
+
+        shell->last_status = status;
+        if (UNWINDING(shell))
+            break;
+    }
+
+    arena_rewind(arena, base);
+    shell->last_status = status;
+    return status;
+}
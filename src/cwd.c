@@ -0,0 +1,211 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * cwd.c - Logical working directory ($PWD) without getcwd
+ *
+ * The path is only ever rebuilt from text: cd, pushd and popd resolve
+ * their argument against it with cwd_resolve() and chdir() to the result,
+ * falling back to the argument as given (and getcwd() for the name) when
+ * the logical path does not lead anywhere. The O_PATH descriptor held on
+ * the directory serves two purposes: its device and inode are what
+ * cwd_get() compares stat(".") against, and cwd_mark() duplicates it so a
+ * subshell run in the shell can come back with fchdir() instead of
+ * walking a long (perhaps NFS) path again.
+ * ============================================================================ */
+
+#include "cwd.h"
+#include "shell.h"
+#include "env.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+struct Cwd {
+    char  path[PATH_MAX];       /* Logical path, valid when known */
+    bool  known;
+    int   fd;                   /* O_PATH descriptor of it, -1 if none */
+    dev_t dev;
+    ino_t ino;
+};
+
+/* ---- Internal helpers --------------------------------------------------- */
+
+/* Record "." (already open as fd, or opened here when fd is -1) under the
+ * name path, or under getcwd()'s name for it when path is NULL */
+static void cwd_set(Cwd *c, int fd, const char *path)
+{
+    if (c->fd >= 0)
+        close(c->fd);
+    c->fd = fd >= 0 ? fd : open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+
+    struct stat st;
+    if (c->fd >= 0 && fstat(c->fd, &st) == 0) {
+        c->dev = st.st_dev;
+        c->ino = st.st_ino;
+    } else if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+
+    if (path && strlen(path) < sizeof(c->path)) {
+        strcpy(c->path, path);
+        c->known = true;
+    } else {
+        c->known = getcwd(c->path, sizeof(c->path)) != NULL;
+    }
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+Cwd *cwd_create(const char *pwd)
+{
+    Cwd *c = calloc(1, sizeof(Cwd));
+    if (!c)
+        return NULL;
+    c->fd = -1;
+
+    /* An inherited $PWD is kept if it is already in canonical form (no
+     * ".", "..", or repeated slashes) and is the directory we are in */
+    char canon[PATH_MAX];
+    struct stat a, b;
+    bool adopt = pwd && pwd[0] == '/' &&
+                 cwd_resolve("/", pwd, canon, sizeof(canon)) &&
+                 strcmp(canon, pwd) == 0 &&
+                 stat(pwd, &a) == 0 && stat(".", &b) == 0 &&
+                 a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+    cwd_set(c, -1, adopt ? pwd : NULL);
+    return c;
+}
+
+void cwd_destroy(Cwd *c)
+{
+    if (!c)
+        return;
+    if (c->fd >= 0)
+        close(c->fd);
+    free(c);
+}
+
+const char *cwd_get(Cwd *c)
+{
+    if (!c)
+        return NULL;
+
+    /* Something other than cwd_change() moved us: learn the new name */
+    struct stat st;
+    if (c->fd < 0 || stat(".", &st) != 0 ||
+        st.st_dev != c->dev || st.st_ino != c->ino)
+        cwd_set(c, -1, NULL);
+    return c->known ? c->path : NULL;
+}
+
+bool cwd_resolve(const char *base, const char *target, char *out, size_t size)
+{
+    size_t len = 0;
+    if (size < 2)
+        return false;
+
+    if (target[0] != '/') {
+        len = strlen(base);
+        if (len >= size)
+            return false;
+        memcpy(out, base, len);
+        while (len > 1 && out[len - 1] == '/')
+            len--;
+    }
+
+    for (const char *p = target; *p; ) {
+        while (*p == '/')
+            p++;
+        if (!*p)
+            break;
+        const char *end = strchr(p, '/');
+        size_t      n   = end ? (size_t)(end - p) : strlen(p);
+
+        if (n == 2 && p[0] == '.' && p[1] == '.') {
+            /* Drop the last component, but never the root */
+            while (len > 0 && out[len - 1] != '/')
+                len--;
+            if (len > 1)
+                len--;
+        } else if (n != 1 || p[0] != '.') {
+            bool sep = len == 0 || out[len - 1] != '/';
+            if (len + sep + n >= size)
+                return false;
+            if (sep)
+                out[len++] = '/';
+            memcpy(out + len, p, n);
+            len += n;
+        }
+        p += n;
+    }
+
+    if (len == 0)
+        out[len++] = '/';
+    out[len] = '\0';
+    return true;
+}
+
+int cwd_change(Shell *shell, const char *target, bool physical)
+{
+    Cwd *c = shell->cwd;
+    const char *cur = cwd_get(c);
+
+    char oldpwd[PATH_MAX], logical[PATH_MAX];
+    oldpwd[0] = '\0';
+    if (cur)
+        strcpy(oldpwd, cur);
+
+    bool resolved = !physical && (cur || target[0] == '/') &&
+                    cwd_resolve(cur ? cur : "/", target, logical,
+                                sizeof(logical));
+    if (resolved && chdir(logical) == 0) {
+        cwd_set(c, -1, logical);
+    } else {
+        /* Physically, as given: ".." after a symlink, -P, a path too long */
+        if (chdir(target) != 0)
+            return -1;
+        cwd_set(c, -1, NULL);
+    }
+
+    if (oldpwd[0])
+        env_set(shell->env, "OLDPWD", oldpwd, true);
+    if (c->known)
+        env_set(shell->env, "PWD", c->path, true);
+    return 0;
+}
+
+bool cwd_mark(Cwd *c, CwdMark *mark)
+{
+    const char *path = cwd_get(c);
+    mark->fd = c && c->fd >= 0 ? fcntl(c->fd, F_DUPFD_CLOEXEC, 0)
+                               : open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (mark->fd < 0)
+        return false;
+    mark->path = path ? strdup(path) : NULL;
+    if (path && !mark->path) {
+        close(mark->fd);
+        return false;
+    }
+    return true;
+}
+
+int cwd_return(Cwd *c, CwdMark *mark)
+{
+    int rc = fchdir(mark->fd);
+    if (rc == 0 && c) {
+        cwd_set(c, mark->fd, mark->path);
+    } else {
+        int err = errno;
+        close(mark->fd);
+        errno = err;
+    }
+    free(mark->path);
+    mark->fd   = -1;
+    mark->path = NULL;
+    return rc;
+}
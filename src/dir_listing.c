@@ -0,0 +1,388 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * dir_listing.c - Cached, sorted directory listing for file name completion
+ *
+ * A listing is read with getdents64() into a single arena: d_type says
+ * which entries are directories, and only DT_UNKNOWN and symlinks cost an
+ * fstatat(). The first DIR_LISTING_SYNC_MAX entries are read in the
+ * foreground, which covers nearly every directory. A larger one is handed,
+ * open descriptor and all, to a thread that reads the rest, sorts it and
+ * signals an eventfd; dir_listing_collect() joins it. Until then the
+ * directory answers DIR_LISTING_BUSY and the editor stays responsive.
+ *
+ * The listing is stamped with the directory's stat() from before it was
+ * read, so an entry added while reading moves the mtime and the next Tab
+ * lists again. Matches for a prefix are a contiguous run of the sorted
+ * names; the run found last time bounds the search when the new prefix
+ * extends the old one.
+ * ============================================================================ */
+
+#include "dir_listing.h"
+#include "arena.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+typedef struct Listing {
+    dev_t           dev;            /* Identity of the directory ... */
+    ino_t           ino;
+    struct timespec mtime;          /* ... and its mtime before reading */
+    Arena          *arena;          /* The names */
+    const char    **names;          /* Sorted once complete */
+    size_t          count;
+    size_t          cap;
+    int             fd;             /* Directory, -1 once read to the end */
+    bool            failed;         /* Out of memory or a read error */
+} Listing;
+
+struct DirListing {
+    Listing     *ready;             /* Complete listing, or NULL */
+    Listing     *loading;           /* Being finished by the worker */
+    pthread_t    worker;
+    int          event_fd;          /* Signalled by the worker, -1 if never
+                                     * needed */
+    atomic_bool  cancel;            /* The worker's listing is unwanted */
+
+    /* The previous match, in ready */
+    char         last_base[NAME_MAX + 1];
+    size_t       last_len;
+    size_t       lo, hi;
+    bool         have_last;
+
+    /* Ready's names without the hidden ones (for an empty base) */
+    const char **visible;
+    size_t       nvisible;
+    bool         have_visible;
+};
+
+typedef enum ReadResult { READ_DONE, READ_MORE, READ_FAILED } ReadResult;
+
+/* ---- Listings ----------------------------------------------------------- */
+
+static void listing_free(Listing *l)
+{
+    if (!l)
+        return;
+    if (l->fd >= 0)
+        close(l->fd);
+    arena_destroy(l->arena);
+    free(l->names);
+    free(l);
+}
+
+static bool listing_add(Listing *l, const char *name, size_t len, bool dir)
+{
+    if (l->count == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 256;
+        const char **names = realloc(l->names, cap * sizeof(*names));
+        if (!names)
+            return false;
+        l->names = names;
+        l->cap   = cap;
+    }
+    char *s = arena_alloc(l->arena, len + dir + 1);
+    if (!s)
+        return false;
+    memcpy(s, name, len);
+    if (dir)
+        s[len] = '/';
+    s[len + dir] = '\0';
+    l->names[l->count++] = s;
+    return true;
+}
+
+/* Read entries until end of directory, until at least limit are held, or
+ * until cancel is set */
+static ReadResult listing_read(Listing *l, size_t limit, atomic_bool *cancel)
+{
+    char buf[32768];
+    ssize_t n = 0;
+    while (l->count < limit && !atomic_load(cancel) &&
+           (n = getdents64(l->fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t off = 0; off < n; ) {
+            struct dirent64 *d = (struct dirent64 *)(buf + off);
+            off += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' &&
+                (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            /* A symlink is shown as what it points to */
+            bool dir = d->d_type == DT_DIR;
+            struct stat st;
+            if ((d->d_type == DT_UNKNOWN || d->d_type == DT_LNK) &&
+                fstatat(l->fd, name, &st, 0) == 0)
+                dir = S_ISDIR(st.st_mode);
+
+            if (!listing_add(l, name, strlen(name), dir)) {
+                l->failed = true;
+                return READ_FAILED;
+            }
+        }
+    }
+    if (l->count >= limit || atomic_load(cancel))
+        return READ_MORE;
+    if (n < 0) {
+        l->failed = true;
+        return READ_FAILED;
+    }
+    close(l->fd);
+    l->fd = -1;
+    return READ_DONE;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static void listing_sort(Listing *l)
+{
+    qsort(l->names, l->count, sizeof(*l->names), compare_names);
+}
+
+/* ---- Worker ------------------------------------------------------------- */
+
+static void *listing_worker(void *arg)
+{
+    DirListing *dl = arg;
+    Listing    *l  = dl->loading;
+    if (listing_read(l, SIZE_MAX, &dl->cancel) == READ_DONE &&
+        !atomic_load(&dl->cancel))
+        listing_sort(l);
+
+    uint64_t one = 1;
+    while (write(dl->event_fd, &one, sizeof(one)) < 0 && errno == EINTR)
+        ;
+    return NULL;
+}
+
+/* Hand the rest of l to the worker. False if no thread could be started. */
+static bool start_worker(DirListing *dl, Listing *l)
+{
+    if (dl->event_fd < 0)
+        dl->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (dl->event_fd < 0)
+        return false;
+
+    atomic_store(&dl->cancel, false);
+    dl->loading = l;
+
+    /* Signals stay with the main thread */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    bool started = pthread_create(&dl->worker, NULL, listing_worker, dl) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (!started)
+        dl->loading = NULL;
+    return started;
+}
+
+/* Stop and discard the worker's listing */
+static void cancel_worker(DirListing *dl)
+{
+    if (!dl->loading)
+        return;
+    atomic_store(&dl->cancel, true);
+    pthread_join(dl->worker, NULL);
+
+    uint64_t v;
+    while (read(dl->event_fd, &v, sizeof(v)) < 0 && errno == EINTR)
+        ;
+    listing_free(dl->loading);
+    dl->loading = NULL;
+}
+
+static void set_ready(DirListing *dl, Listing *l)
+{
+    listing_free(dl->ready);
+    dl->ready        = l;
+    dl->have_last    = false;
+    dl->have_visible = false;
+}
+
+/* ---- Matching ----------------------------------------------------------- */
+
+static bool same_dir(const Listing *l, const struct stat *st)
+{
+    return l && l->dev == st->st_dev && l->ino == st->st_ino &&
+           l->mtime.tv_sec == st->st_mtim.tv_sec &&
+           l->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/* First index in [lo, hi) whose name compares to the prefix as more than
+ * `after` allows: >= 0 when after is false, > 0 when it is true */
+static size_t bound(const Listing *l, size_t lo, size_t hi,
+                    const char *base, size_t len, bool after)
+{
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = strncmp(l->names[mid], base, len);
+        if (c < 0 || (after && c == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Start a listing of dir, stamped with st. Returns it complete, or NULL
+ * and the status to report (busy: the worker has it). */
+static Listing *list_dir(DirListing *dl, const char *dir, const struct stat *st,
+                         DirListingStatus *status)
+{
+    *status = DIR_LISTING_NONE;
+    Listing *l = calloc(1, sizeof(Listing));
+    if (!l)
+        return NULL;
+    l->dev   = st->st_dev;
+    l->ino   = st->st_ino;
+    l->mtime = st->st_mtim;
+    l->arena = arena_create_sized(64 * 1024);
+    l->fd    = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (!l->arena || l->fd < 0) {
+        listing_free(l);
+        return NULL;
+    }
+
+    /* Not a cancellation flag of any worker: none is running now */
+    atomic_bool never = false;
+    ReadResult r = listing_read(l, DIR_LISTING_SYNC_MAX, &never);
+    if (r == READ_MORE && start_worker(dl, l)) {
+        *status = DIR_LISTING_BUSY;
+        return NULL;
+    }
+    if (r == READ_MORE)
+        r = listing_read(l, SIZE_MAX, &never);  /* No thread: finish here */
+    if (r != READ_DONE) {
+        listing_free(l);
+        return NULL;
+    }
+    listing_sort(l);
+    *status = DIR_LISTING_OK;
+    return l;
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+DirListing *dir_listing_create(void)
+{
+    DirListing *dl = calloc(1, sizeof(DirListing));
+    if (!dl)
+        return NULL;
+    dl->event_fd = -1;
+    atomic_init(&dl->cancel, false);
+    return dl;
+}
+
+void dir_listing_destroy(DirListing *dl)
+{
+    if (!dl)
+        return;
+    cancel_worker(dl);
+    listing_free(dl->ready);
+    free(dl->visible);
+    if (dl->event_fd >= 0)
+        close(dl->event_fd);
+    free(dl);
+}
+
+DirListingStatus dir_listing_match(DirListing *dl, const char *dir,
+                                   const char *base, size_t base_len,
+                                   const char *const **names, size_t *count)
+{
+    *names = NULL;
+    *count = 0;
+
+    struct stat st;
+    if (stat(dir, &st) < 0 || !S_ISDIR(st.st_mode))
+        return DIR_LISTING_NONE;
+
+    if (!same_dir(dl->ready, &st)) {
+        if (same_dir(dl->loading, &st))
+            return DIR_LISTING_BUSY;
+        cancel_worker(dl);
+
+        DirListingStatus status;
+        Listing *l = list_dir(dl, dir, &st, &status);
+        if (!l)
+            return status;
+        set_ready(dl, l);
+    }
+    Listing *l = dl->ready;
+
+    if (base_len == 0) {
+        /* Hidden names are scattered through the order: filter them */
+        if (!dl->have_visible) {
+            const char **v = realloc(dl->visible, (l->count + 1) * sizeof(*v));
+            if (!v)
+                return DIR_LISTING_NONE;
+            dl->visible  = v;
+            dl->nvisible = 0;
+            for (size_t i = 0; i < l->count; i++) {
+                if (l->names[i][0] != '.')
+                    v[dl->nvisible++] = l->names[i];
+            }
+            dl->have_visible = true;
+        }
+        *names = dl->visible;
+        *count = dl->nvisible;
+        return DIR_LISTING_OK;
+    }
+
+    /* Typing on from the last prefix can only drop matches */
+    size_t lo = 0, hi = l->count;
+    if (dl->have_last && dl->last_len <= base_len &&
+        memcmp(dl->last_base, base, dl->last_len) == 0) {
+        lo = dl->lo;
+        hi = dl->hi;
+    }
+    lo = bound(l, lo, hi, base, base_len, false);
+    hi = bound(l, lo, hi, base, base_len, true);
+
+    dl->have_last = base_len < sizeof(dl->last_base);
+    if (dl->have_last) {
+        memcpy(dl->last_base, base, base_len);
+        dl->last_len = base_len;
+        dl->lo = lo;
+        dl->hi = hi;
+    }
+    *names = l->names + lo;
+    *count = hi - lo;
+    return DIR_LISTING_OK;
+}
+
+int dir_listing_fd(const DirListing *dl)
+{
+    return dl && dl->loading ? dl->event_fd : -1;
+}
+
+bool dir_listing_collect(DirListing *dl)
+{
+    uint64_t v;
+    if (!dl || !dl->loading || read(dl->event_fd, &v, sizeof(v)) != sizeof(v))
+        return false;
+
+    pthread_join(dl->worker, NULL);
+    Listing *l = dl->loading;
+    dl->loading = NULL;
+    if (l->failed || l->fd >= 0) {
+        listing_free(l);
+        return false;
+    }
+    set_ready(dl, l);
+    return true;
+}
@@ -2,10 +2,11 @@
  * vsh - Vanguard Shell
  * env.c - Environment variable management and expansion
  *
- * Implements a hash table (djb2 + separate chaining) for shell variables,
+ * Implements the variable table (open addressing with linear probing over
+ * interned names, grown at 3/4 load), function-local scope frames,
  * environment import/export, and the full $-expansion engine including
  * ${VAR:-default}, ${VAR:=default}, ${VAR:+alt}, ${VAR:?err}, positional
- * parameters, special variables, and tilde expansion.
+ * parameters, special variables, $((...)) arithmetic, and tilde expansion.
  * ============================================================================ */
 
 #include <stdlib.h>
@@ -19,19 +20,229 @@
 #include "shell.h"
 #include "arena.h"
 #include "safe_string.h"
+#include "lexer.h"
+#include "executor.h"
+#include "expr.h"
 
 extern char **environ;
 
-/* ---- Hash Function (djb2) ----------------------------------------------- */
+/* ---- Hash Function (FNV-1a) --------------------------------------------- */
 
-static unsigned int env_hash(const char *s)
+static uint32_t env_hash(const char *s, size_t *len)
 {
-    unsigned long hash = 5381;
-    while (*s)
-        hash = hash * 33 + (unsigned char)*s++;
-    return (unsigned int)(hash % ENV_HASH_SIZE);
+    uint32_t hash = 2166136261u;
+    const char *p = s;
+    for (; *p; p++)
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    *len = (size_t)(p - s);
+    return hash;
 }
 
+/* Let PATH-derived caches notice that PATH changed */
+static inline void note_change(EnvTable *env, const EnvKey *key)
+{
+    if (key->len == 4 && memcmp(key->name, "PATH", 4) == 0)
+        env->path_serial++;
+}
+
+/* Add (sign = 1) or remove (sign = -1) an entry's share of the cached envp.
+ * Any change to an exported entry invalidates the cache. */
+static void account_export(EnvTable *env, const EnvEntry *e, int sign)
+{
+    if (!e->exported)
+        return;
+    size_t bytes = e->key->len + 1 + strlen(e->value) + 1;
+    if (sign > 0) {
+        env->export_count++;
+        env->export_bytes += bytes;
+    } else {
+        env->export_count--;
+        env->export_bytes -= bytes;
+    }
+    env->export_serial++;
+}
+
+/* ---- Interned names ----------------------------------------------------- */
+
+/* The interned copy of name (hash h, length len), created on first use.
+ * Names are kept until the table is destroyed, so unsetting and setting a
+ * variable again, or saving it in a scope frame, never copies the name. */
+static const EnvKey *intern(EnvTable *env, const char *name, size_t len,
+                            uint32_t h)
+{
+    if (env->key_count * 2 >= env->key_capacity) {
+        int cap = env->key_capacity ? env->key_capacity * 2 : ENV_MIN_SLOTS * 2;
+        EnvKey **keys = calloc((size_t)cap, sizeof(EnvKey *));
+        if (!keys)
+            return NULL;
+        for (int i = 0; i < env->key_capacity; i++) {
+            EnvKey *k = env->keys[i];
+            if (!k)
+                continue;
+            int j = (int)(k->hash & (uint32_t)(cap - 1));
+            while (keys[j])
+                j = (j + 1) & (cap - 1);
+            keys[j] = k;
+        }
+        free(env->keys);
+        env->keys         = keys;
+        env->key_capacity = cap;
+    }
+
+    int mask = env->key_capacity - 1;
+    int j = (int)(h & (uint32_t)mask);
+    for (; env->keys[j]; j = (j + 1) & mask) {
+        const EnvKey *k = env->keys[j];
+        if (k->hash == h && k->len == len && memcmp(k->name, name, len) == 0)
+            return k;
+    }
+
+    EnvKey *k = malloc(sizeof(EnvKey) + len + 1);
+    if (!k)
+        return NULL;
+    k->hash = h;
+    k->len  = (uint32_t)len;
+    memcpy(k->name, name, len + 1);
+    env->keys[j] = k;
+    env->key_count++;
+    return k;
+}
+
+/* ---- Saved variables ---------------------------------------------------- */
+
+/* Record name's current state in frame sc, unless the frame already has
+ * it: the state before the frame's first change is what comes back */
+static bool save_name(EnvScope *sc, const EnvKey *name, const EnvEntry *e)
+{
+    for (int i = 0; i < sc->count; i++) {
+        if (sc->saved[i].key == name)
+            return true;
+    }
+
+    if (sc->count >= sc->capacity) {
+        int cap = sc->capacity ? sc->capacity * 2 : 4;
+        EnvSaved *saved = realloc(sc->saved, sizeof(EnvSaved) * (size_t)cap);
+        if (!saved)
+            return false;
+        sc->saved    = saved;
+        sc->capacity = cap;
+    }
+
+    EnvSaved *s = &sc->saved[sc->count];
+    s->key      = name;
+    s->value    = NULL;
+    s->exported = e && e->exported;
+    if (e && !(s->value = strdup(e->value)))
+        return false;
+    sc->count++;
+    return true;
+}
+
+/* A variable is about to change: save it in the innermost snapshot */
+static inline void snapshot_save(EnvTable *env, const EnvKey *name,
+                                 const EnvEntry *e)
+{
+    if (env->snapshot && name)
+        save_name(&env->scopes[env->snapshot - 1], name, e);
+}
+
+/* ---- Slot table --------------------------------------------------------- */
+
+/* Index of name's slot, or of the empty slot where it would go */
+static int probe(const EnvTable *env, const char *name, size_t len,
+                 uint32_t h)
+{
+    int mask = env->capacity - 1;
+    int i = (int)(h & (uint32_t)mask);
+    for (; env->slots[i].entry; i = (i + 1) & mask) {
+        const EnvKey *k = env->slots[i].entry->key;
+        if (env->slots[i].hash == h && k->len == len &&
+            memcmp(k->name, name, len) == 0)
+            break;
+    }
+    return i;
+}
+
+static bool grow_slots(EnvTable *env)
+{
+    int cap = env->capacity ? env->capacity * 2 : ENV_MIN_SLOTS;
+    EnvSlot *slots = calloc((size_t)cap, sizeof(EnvSlot));
+    if (!slots)
+        return false;
+
+    for (int i = 0; i < env->capacity; i++) {
+        if (!env->slots[i].entry)
+            continue;
+        int j = (int)(env->slots[i].hash & (uint32_t)(cap - 1));
+        while (slots[j].entry)
+            j = (j + 1) & (cap - 1);
+        slots[j] = env->slots[i];
+    }
+    free(env->slots);
+    env->slots    = slots;
+    env->capacity = cap;
+    return true;
+}
+
+/* Empty slot i, shifting later members of its probe run back so lookups
+ * never need tombstones */
+static void remove_slot(EnvTable *env, int i)
+{
+    int mask = env->capacity - 1;
+    int j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!env->slots[j].entry)
+            break;
+        int home = (int)(env->slots[j].hash & (uint32_t)mask);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            env->slots[i] = env->slots[j];
+            i = j;
+        }
+    }
+    env->slots[i].entry = NULL;
+    env->slots[i].hash  = 0;
+}
+
+static EnvEntry *find_entry(const EnvTable *env, const char *key)
+{
+    if (env->count == 0)
+        return NULL;
+    size_t len;
+    uint32_t h = env_hash(key, &len);
+    return env->slots[probe(env, key, len, h)].entry;
+}
+
+/* Store value in e, reusing its inline buffer or heap block if it fits */
+static bool entry_store(EnvEntry *e, const char *value)
+{
+    size_t len = strlen(value);
+    if (e->value_cap == 0 && len < ENV_INLINE_VALUE) {
+        e->value = e->inline_value;
+    } else if (len >= e->value_cap) {
+        size_t cap = len + 1 < 64 ? 64 : len + 1;
+        char *block = malloc(cap);
+        if (!block)
+            return false;
+        if (e->value_cap)
+            free(e->value);
+        e->value     = block;
+        e->value_cap = cap;
+    }
+    memmove(e->value, value, len + 1);
+    return true;
+}
+
+static void entry_free(EnvEntry *e)
+{
+    if (e->value_cap)
+        free(e->value);
+    free(e);
+}
+
+static void set_var(EnvTable *env, const char *key, const char *value,
+                    bool exported, bool mirror);
+
 /* ---- Public API --------------------------------------------------------- */
 
 EnvTable *env_create(void)
@@ -39,6 +250,10 @@ EnvTable *env_create(void)
     EnvTable *env = calloc(1, sizeof(EnvTable));
     if (!env)
         return NULL;
+    if (!grow_slots(env)) {
+        free(env);
+        return NULL;
+    }
 
     /* Import every variable from the inherited environment */
     if (environ) {
@@ -54,7 +269,7 @@ EnvTable *env_create(void)
                 continue;
 
             const char *val = eq + 1;
-            env_set(env, key, val, true);
+            set_var(env, key, val, true, false);
             free(key);
         }
     }
@@ -83,16 +298,19 @@ void env_destroy(EnvTable *env)
     if (!env)
         return;
 
-    for (int i = 0; i < ENV_HASH_SIZE; i++) {
-        EnvEntry *e = env->buckets[i];
-        while (e) {
-            EnvEntry *next = e->next;
-            free(e->key);
-            free(e->value);
-            free(e);
-            e = next;
-        }
+    while (env->depth > 0)
+        env_pop_scope(env);
+    free(env->scopes);
+
+    for (int i = 0; i < env->capacity; i++) {
+        if (env->slots[i].entry)
+            entry_free(env->slots[i].entry);
     }
+    for (int i = 0; i < env->key_capacity; i++)
+        free(env->keys[i]);
+    free(env->slots);
+    free(env->keys);
+    free(env->envp);
     free(env);
 }
 
@@ -101,74 +319,97 @@ const char *env_get(EnvTable *env, const char *key)
     if (!env || !key)
         return NULL;
 
-    unsigned int h = env_hash(key);
-    for (EnvEntry *e = env->buckets[h]; e; e = e->next) {
-        if (strcmp(e->key, key) == 0)
-            return e->value;
-    }
-    return NULL;
+    EnvEntry *e = find_entry(env, key);
+    return e ? e->value : NULL;
 }
 
-void env_set(EnvTable *env, const char *key, const char *value, bool exported)
+/* env_set; mirror = also update the process environment (the C library's
+ * getenv callers). Imported variables are already there, and setenv is a
+ * linear scan, so importing a large environment skips it. */
+static void set_var(EnvTable *env, const char *key, const char *value,
+                    bool exported, bool mirror)
 {
-    if (!env || !key)
+    size_t len;
+    uint32_t h = env_hash(key, &len);
+    int i = probe(env, key, len, h);
+
+    /* Existing entry: counters rewrite the same variable over and over,
+     * so the value is overwritten in place whenever it fits */
+    EnvEntry *e = env->slots[i].entry;
+    if (env->snapshot)
+        snapshot_save(env, e ? e->key : intern(env, key, len, h), e);
+    if (e) {
+        account_export(env, e, -1);
+        entry_store(e, value);
+        e->exported = exported;
+        account_export(env, e, 1);
+        note_change(env, e->key);
+        if (exported && mirror)
+            setenv(key, value, 1);
         return;
-    if (!value)
-        value = "";
-
-    unsigned int h = env_hash(key);
+    }
 
-    /* Search for existing entry */
-    for (EnvEntry *e = env->buckets[h]; e; e = e->next) {
-        if (strcmp(e->key, key) == 0) {
-            free(e->value);
-            e->value = strdup(value);
-            e->exported = exported;
-            if (exported)
-                setenv(key, value, 1);
+    if ((env->count + 1) * 4 > env->capacity * 3) {
+        if (!grow_slots(env))
             return;
-        }
+        i = probe(env, key, len, h);
     }
 
-    /* Create new entry and prepend to chain */
-    EnvEntry *entry = malloc(sizeof(EnvEntry));
+    const EnvKey *name = intern(env, key, len, h);
+    EnvEntry *entry = name ? calloc(1, sizeof(EnvEntry)) : NULL;
     if (!entry)
         return;
-
-    entry->key      = strdup(key);
-    entry->value    = strdup(value);
+    entry->key = name;
+    if (!entry_store(entry, value)) {
+        entry_free(entry);
+        return;
+    }
     entry->exported = exported;
-    entry->next     = env->buckets[h];
-    env->buckets[h] = entry;
+
+    env->slots[i].hash  = h;
+    env->slots[i].entry = entry;
     env->count++;
+    account_export(env, entry, 1);
+    note_change(env, name);
 
-    if (exported)
+    if (exported && mirror)
         setenv(key, value, 1);
 }
 
-void env_unset(EnvTable *env, const char *key)
+void env_set(EnvTable *env, const char *key, const char *value, bool exported)
 {
     if (!env || !key)
         return;
+    set_var(env, key, value ? value : "", exported, true);
+}
 
-    unsigned int h = env_hash(key);
-    EnvEntry *prev = NULL;
+void env_assign(EnvTable *env, const char *key, const char *value)
+{
+    if (!env || !key)
+        return;
+    EnvEntry *e = find_entry(env, key);
+    env_set(env, key, value, e && e->exported);
+}
 
-    for (EnvEntry *e = env->buckets[h]; e; prev = e, e = e->next) {
-        if (strcmp(e->key, key) == 0) {
-            if (prev)
-                prev->next = e->next;
-            else
-                env->buckets[h] = e->next;
+void env_unset(EnvTable *env, const char *key)
+{
+    if (!env || !key || env->count == 0)
+        return;
 
-            free(e->key);
-            free(e->value);
-            free(e);
-            env->count--;
-            unsetenv(key);
-            return;
-        }
-    }
+    size_t len;
+    uint32_t h = env_hash(key, &len);
+    int i = probe(env, key, len, h);
+    EnvEntry *e = env->slots[i].entry;
+    if (!e)
+        return;
+
+    snapshot_save(env, e->key, e);
+    remove_slot(env, i);
+    account_export(env, e, -1);
+    env->count--;
+    note_change(env, e->key);
+    entry_free(e);
+    unsetenv(key);
 }
 
 void env_export(EnvTable *env, const char *key)
@@ -176,66 +417,135 @@ void env_export(EnvTable *env, const char *key)
     if (!env || !key)
         return;
 
-    unsigned int h = env_hash(key);
-    for (EnvEntry *e = env->buckets[h]; e; e = e->next) {
-        if (strcmp(e->key, key) == 0) {
-            e->exported = true;
-            setenv(e->key, e->value, 1);
-            return;
-        }
+    EnvEntry *e = find_entry(env, key);
+    if (!e)
+        return;
+    snapshot_save(env, e->key, e);
+    if (!e->exported) {
+        e->exported = true;
+        account_export(env, e, 1);
     }
+    setenv(e->key->name, e->value, 1);
 }
 
-char **env_build_envp(EnvTable *env)
-{
-    if (!env)
-        return NULL;
+/* ---- Scope frames ------------------------------------------------------- */
 
-    /* Count exported entries */
-    int count = 0;
-    for (int i = 0; i < ENV_HASH_SIZE; i++) {
-        for (EnvEntry *e = env->buckets[i]; e; e = e->next) {
-            if (e->exported)
-                count++;
-        }
+bool env_push_scope(EnvTable *env)
+{
+    if (env->depth >= env->scope_capacity) {
+        int cap = env->scope_capacity ? env->scope_capacity * 2 : 8;
+        EnvScope *scopes = realloc(env->scopes, sizeof(EnvScope) * (size_t)cap);
+        if (!scopes)
+            return false;
+        env->scopes         = scopes;
+        env->scope_capacity = cap;
     }
+    EnvScope *sc = &env->scopes[env->depth++];
+    sc->saved    = NULL;
+    sc->count    = 0;
+    sc->capacity = 0;
+    sc->snapshot = false;
+    return true;
+}
 
-    char **envp = malloc(sizeof(char *) * (size_t)(count + 1));
-    if (!envp)
-        return NULL;
+bool env_push_snapshot(EnvTable *env)
+{
+    if (!env_push_scope(env))
+        return false;
+    env->scopes[env->depth - 1].snapshot = true;
+    env->snapshot = env->depth;
+    return true;
+}
 
-    int idx = 0;
-    for (int i = 0; i < ENV_HASH_SIZE; i++) {
-        for (EnvEntry *e = env->buckets[i]; e; e = e->next) {
-            if (!e->exported)
-                continue;
+void env_pop_scope(EnvTable *env)
+{
+    if (env->depth == 0)
+        return;
 
-            size_t klen = strlen(e->key);
-            size_t vlen = strlen(e->value);
-            /* "KEY=VALUE\0" */
-            char *str = malloc(klen + 1 + vlen + 1);
-            if (!str) {
-                /* Best-effort: null-terminate what we have */
-                envp[idx] = NULL;
-                return envp;
-            }
-            memcpy(str, e->key, klen);
-            str[klen] = '=';
-            memcpy(str + klen + 1, e->value, vlen + 1);
-            envp[idx++] = str;
+    /* Newest first, so the state before the first `local` wins. Putting
+     * a snapshot's variables back counts as a change for the one around
+     * it, if any. */
+    EnvScope *sc = &env->scopes[--env->depth];
+    if (sc->snapshot) {
+        env->snapshot = 0;
+        for (int i = env->depth; i > 0 && !env->snapshot; i--) {
+            if (env->scopes[i - 1].snapshot)
+                env->snapshot = i;
         }
     }
-    envp[idx] = NULL;
-    return envp;
+    for (int i = sc->count - 1; i >= 0; i--) {
+        EnvSaved *s = &sc->saved[i];
+        if (s->value)
+            env_set(env, s->key->name, s->value, s->exported);
+        else
+            env_unset(env, s->key->name);
+        free(s->value);
+    }
+    free(sc->saved);
 }
 
-void env_free_envp(char **envp)
+bool env_local(EnvTable *env, const char *key, const char *value)
 {
+    if (!env || !key)
+        return false;
+    if (env->depth == 0) {
+        env_set(env, key, value, false);
+        return true;
+    }
+
+    size_t len;
+    uint32_t h = env_hash(key, &len);
+    const EnvKey *name = intern(env, key, len, h);
+    if (!name)
+        return false;
+
+    /* Only the first `local` of a name in a frame records the outer value */
+    EnvEntry *e = env->slots[probe(env, key, len, h)].entry;
+    if (!save_name(&env->scopes[env->depth - 1], name, e))
+        return false;
+
+    env_set(env, key, value, false);
+    return true;
+}
+
+char **env_envp(EnvTable *env)
+{
+    if (!env)
+        return NULL;
+    if (env->envp && env->envp_serial == env->export_serial)
+        return env->envp;
+
+    /*
+     * One allocation: the NULL-terminated pointer array followed by the
+     * "KEY=VALUE\0" strings it points into. The sizes are maintained as
+     * variables change, so a rebuild is a single pass over the table.
+     */
+    size_t ptrs = sizeof(char *) * (size_t)(env->export_count + 1);
+    char **envp = malloc(ptrs + env->export_bytes);
     if (!envp)
-        return;
-    for (int i = 0; envp[i]; i++)
-        free(envp[i]);
-    free(envp);
+        return env->envp; /* Stale but usable beats nothing */
+
+    char *str = (char *)envp + ptrs;
+    int   idx = 0;
+    for (int i = 0; i < env->capacity; i++) {
+        const EnvEntry *e = env->slots[i].entry;
+        if (!e || !e->exported)
+            continue;
+
+        size_t klen = e->key->len;
+        size_t vlen = strlen(e->value);
+        envp[idx++] = str;
+        memcpy(str, e->key->name, klen);
+        str[klen] = '=';
+        memcpy(str + klen + 1, e->value, vlen + 1);
+        str += klen + 1 + vlen + 1;
+    }
+    envp[idx] = NULL;
+
+    free(env->envp);
+    env->envp        = envp;
+    env->envp_serial = env->export_serial;
+    return envp;
 }
 
 /* ---- Variable Expansion Engine ------------------------------------------ */
@@ -274,7 +584,7 @@ static const char *read_brace_body(const char *p, SafeString *out)
  * Appends the expansion result to `result`.
  */
 static const char *expand_brace(Shell *shell, const char *p,
-                                SafeString *result)
+                                ArenaString *result)
 {
     /* Read the variable name (up to ':', '}', or modifier chars) */
     const char *start = p;
@@ -292,8 +602,10 @@ static const char *expand_brace(Shell *shell, const char *p,
         p += 2; /* skip ':' and operator character */
 
         /* Read the body (default/alternate/message) up to closing '}' */
-        SafeString *body = sstr_new(64);
-        p = read_brace_body(p, body);
+        /* Defaults are short: the body normally stays in the struct */
+        SafeString body;
+        sstr_init(&body);
+        p = read_brace_body(p, &body);
 
         /* Expand the body text one level (simple $VAR and ${VAR} only) */
         /* We re-use env_expand for this by creating a temporary arena.
@@ -303,48 +615,48 @@ static const char *expand_brace(Shell *shell, const char *p,
         switch (op) {
         case '-': /* ${VAR:-default} */
             if (!val || val[0] == '\0')
-                sstr_append(result, sstr_cstr(body));
+                astr_append(result, sstr_cstr(&body));
             else
-                sstr_append(result, val);
+                astr_append(result, val);
             break;
 
         case '=': /* ${VAR:=default} */
             if (!val || val[0] == '\0') {
-                env_set(shell->env, varname, sstr_cstr(body), false);
-                sstr_append(result, sstr_cstr(body));
+                env_set(shell->env, varname, sstr_cstr(&body), false);
+                astr_append(result, sstr_cstr(&body));
             } else {
-                sstr_append(result, val);
+                astr_append(result, val);
             }
             break;
 
         case '+': /* ${VAR:+alternate} */
             if (val && val[0] != '\0')
-                sstr_append(result, sstr_cstr(body));
+                astr_append(result, sstr_cstr(&body));
             /* else: expand to nothing */
             break;
 
         case '?': /* ${VAR:?message} */
             if (!val || val[0] == '\0') {
                 fprintf(stderr, "vsh: %s: %s\n", varname,
-                        sstr_empty(body) ? "parameter null or not set"
-                                         : sstr_cstr(body));
+                        sstr_empty(&body) ? "parameter null or not set"
+                                         : sstr_cstr(&body));
             } else {
-                sstr_append(result, val);
+                astr_append(result, val);
             }
             break;
 
         default:
             /* Unknown operator – just output the value if set */
             if (val)
-                sstr_append(result, val);
+                astr_append(result, val);
             break;
         }
 
-        sstr_free(body);
+        sstr_release(&body);
     } else {
         /* Simple ${VAR} */
         if (val)
-            sstr_append(result, val);
+            astr_append(result, val);
     }
 
     free(varname);
@@ -356,18 +668,162 @@ static const char *expand_brace(Shell *shell, const char *p,
     return p;
 }
 
-char *env_expand(Shell *shell, const char *input, Arena *arena)
+/* ---- Arithmetic Expansion ------------------------------------------------ */
+
+/* $(...) of n bytes at p is $((...)): the inner parentheses close together
+ * with the outer ones, so "$((a) (b))" is still command substitution */
+static bool is_arithmetic(const char *p, size_t n)
 {
-    if (!input)
-        return arena_strdup(arena, "");
+    if (n < 5 || p[2] != '(' || p[n - 2] != ')')
+        return false;
+    int depth = 0;
+    for (size_t i = 2; i < n - 1; i++) {
+        if (p[i] == '(')
+            depth++;
+        else if (p[i] == ')' && --depth == 0)
+            return i == n - 2;
+    }
+    return false;
+}
+
+/* Shell variables are integers in arithmetic; unset or empty is 0 */
+static bool arith_value(const char *val, long long *out)
+{
+    *out = 0;
+    if (!val)
+        return true;
+    while (isspace((unsigned char)*val))
+        val++;
+    if (!*val)
+        return true;
+
+    char *end;
+    *out = (long long)strtoull(val, &end, 0);
+    if (*val == '-')
+        *out = strtoll(val, &end, 0);
+    while (isspace((unsigned char)*end))
+        end++;
+    return *end == '\0';
+}
+
+/*
+ * The program comes from the shell's expression cache and runs on a stack
+ * array, so a loop counter costs no process and, once compiled, no
+ * allocation. Variables the expression assigns are written back even if
+ * it fails part way.
+ */
+bool env_arith(Shell *shell, const char *expr, long long *value, Arena *arena)
+{
+    /* $x and $(cmd) inside are expanded first */
+    if (strchr(expr, '$') || strchr(expr, '`'))
+        expr = env_expand(shell, expr, arena);
+
+    char err[128];
+    const ExprProgram *prog = expr_compile_int(shell->expr_cache, expr,
+                                               err, sizeof(err));
+    if (!prog) {
+        fprintf(stderr, "vsh: %s: %s\n", expr, err);
+        shell->last_status = 1;
+        return false;
+    }
+
+    long long vals[EXPR_VARS_MAX];
+    int nvars = expr_nvars(prog);
+    for (int slot = 0; slot < nvars; slot++) {
+        const char *name = expr_var_name(prog, slot);
+        if (!arith_value(env_get(shell->env, name), &vals[slot])) {
+            fprintf(stderr, "vsh: %s: %s: not an integer\n", expr, name);
+            shell->last_status = 1;
+            return false;
+        }
+    }
+
+    unsigned int assigned = 0;
+    int rc = expr_eval_int(prog, vals, &assigned, value, err, sizeof(err));
+
+    for (int slot = 0; slot < nvars; slot++) {
+        if (!(assigned & (1u << slot)))
+            continue;
+        char num[32];
+        snprintf(num, sizeof(num), "%lld", vals[slot]);
+        env_assign(shell->env, expr_var_name(prog, slot), num);
+    }
+
+    if (rc < 0) {
+        fprintf(stderr, "vsh: %s: %s\n", expr, err);
+        shell->last_status = 1;
+        return false;
+    }
+    return true;
+}
+
+/* Append the value of the len bytes of text inside $((...)) */
+static void expand_arithmetic(Shell *shell, const char *src, size_t len,
+                              ArenaString *result, Arena *arena)
+{
+    char small[256];
+    char *text = len < sizeof(small) ? small : malloc(len + 1);
+    if (!text)
+        return;
+    memcpy(text, src, len);
+    text[len] = '\0';
+
+    long long value;
+    if (env_arith(shell, text, &value, arena)) {
+        char num[32];
+        snprintf(num, sizeof(num), "%lld", value);
+        astr_append(result, num);
+    } else {
+        shell->expand_error = true;
+    }
+    if (text != small)
+        free(text);
+}
+
+/* Append the output of the command in src[0..len) */
+static void expand_capture(Shell *shell, const char *src, size_t len,
+                           ArenaString *result)
+{
+    SafeString *out = sstr_scratch();
+    if (!out)
+        return;
+    executor_capture(shell, src, len, out);
+    astr_append_n(result, out->data, out->len);
+    sstr_scratch_done(out);
+}
+
+/* Append the decimal form of n */
+static void append_int(ArenaString *result, long long n)
+{
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%lld", n);
+    astr_append_n(result, buf, (size_t)len);
+}
 
-    SafeString *result = sstr_new(strlen(input) + 64);
+/* Expand the $ and ` constructs of input[0..] onto result */
+static void expand_dollars(Shell *shell, const char *input,
+                           ArenaString *result, Arena *arena)
+{
     const char *p = input;
 
     while (*p) {
-        if (*p != '$') {
-            sstr_append_char(result, *p);
-            p++;
+        /* Copy the run of plain text up to the next construct at once */
+        size_t plain = strcspn(p, "$`");
+        if (plain > 0) {
+            astr_append_n(result, p, plain);
+            p += plain;
+            continue;
+        }
+
+        if (*p == '`') {
+            /* `...` – command substitution, old style */
+            size_t n = lexer_scan_subst(p, strlen(p));
+            if (n > 0) {
+                expand_capture(shell, p + 1, n - 2, result);
+                p += n;
+            } else {
+                astr_append_char(result, *p++);
+            }
             continue;
         }
 
@@ -376,56 +832,59 @@ char *env_expand(Shell *shell, const char *input, Arena *arena)
 
         if (!*p) {
             /* Trailing '$' with nothing after it */
-            sstr_append_char(result, '$');
+            astr_append_char(result, '$');
             break;
         }
 
         switch (*p) {
 
-        case '$': { /* $$ – shell PID */
-            char buf[32];
-            snprintf(buf, sizeof(buf), "%d", (int)shell->shell_pid);
-            sstr_append(result, buf);
+        case '$': /* $$ – shell PID */
+            append_int(result, (long long)shell->shell_pid);
             p++;
             break;
-        }
 
-        case '?': { /* $? – last exit status */
-            char buf[32];
-            snprintf(buf, sizeof(buf), "%d", shell->last_status);
-            sstr_append(result, buf);
+        case '?': /* $? – last exit status */
+            append_int(result, shell->last_status);
             p++;
             break;
-        }
 
-        case '#': { /* $# – positional parameter count */
-            char buf[32];
-            snprintf(buf, sizeof(buf), "%d", shell->pos_count);
-            sstr_append(result, buf);
+        case '#': /* $# – positional parameter count */
+            append_int(result, shell->pos_count);
             p++;
             break;
-        }
 
-        case '!': { /* $! – last background PID (stub) */
-            sstr_append(result, "");
+        case '!': /* $! – last background PID (stub) */
             p++;
             break;
-        }
 
         case '0': case '1': case '2': case '3': case '4':
         case '5': case '6': case '7': case '8': case '9': {
             int idx = *p - '0';
             if (idx == 0) {
                 /* $0 – shell name or script name */
-                sstr_append(result, "vsh");
+                astr_append(result, "vsh");
             } else if (idx <= shell->pos_count && shell->pos_params) {
-                sstr_append(result, shell->pos_params[idx - 1]);
+                astr_append(result, shell->pos_params[idx - 1]);
             }
             /* else: expand to nothing */
             p++;
             break;
         }
 
+        case '(': { /* $(...) – command substitution, $((...)) - arithmetic */
+            size_t n = lexer_scan_subst(p - 1, strlen(p - 1));
+            if (n == 0) {
+                astr_append_char(result, '$');
+                break;
+            }
+            if (is_arithmetic(p - 1, n))
+                expand_arithmetic(shell, p + 2, n - 5, result, arena);
+            else
+                expand_capture(shell, p + 1, n - 3, result);
+            p += n - 1;
+            break;
+        }
+
         case '{': { /* ${...} construct */
             p++; /* skip '{' */
             p = expand_brace(shell, p, result);
@@ -439,109 +898,146 @@ char *env_expand(Shell *shell, const char *input, Arena *arena)
                 while (*p && (isalnum((unsigned char)*p) || *p == '_'))
                     p++;
                 size_t namelen = (size_t)(p - start);
-                char *varname = strndup(start, namelen);
+                char small[64];
+                char *varname = namelen < sizeof(small)
+                              ? small : malloc(namelen + 1);
                 if (varname) {
+                    memcpy(varname, start, namelen);
+                    varname[namelen] = '\0';
                     const char *val = env_get(shell->env, varname);
                     if (val)
-                        sstr_append(result, val);
-                    free(varname);
+                        astr_append(result, val);
+                    if (varname != small)
+                        free(varname);
                 }
             } else {
                 /* Unknown $X – output literally */
-                sstr_append_char(result, '$');
-                sstr_append_char(result, *p);
+                astr_append_char(result, '$');
+                astr_append_char(result, *p);
                 p++;
             }
             break;
         }
         }
     }
-
-    char *expanded = arena_strdup(arena, sstr_cstr(result));
-    sstr_free(result);
-    return expanded;
 }
 
 /* ---- Tilde Expansion ---------------------------------------------------- */
 
+/*
+ * The directory named by the ~ prefix at the start of word (~, ~+, ~-,
+ * ~user), with *len set to the length of the prefix, or NULL if there is
+ * no such user.
+ */
+static const char *tilde_dir(Shell *shell, const char *word, size_t *len)
+{
+    const char *rest = word + 1;
+    size_t n = strcspn(rest, "/");
+    *len = n + 1;
+
+    /* ~+ → PWD, ~- → OLDPWD, ~ → current user's HOME */
+    const char *var = n == 0 ? "HOME"
+                    : n == 1 && rest[0] == '+' ? "PWD"
+                    : n == 1 && rest[0] == '-' ? "OLDPWD"
+                    : NULL;
+    if (var) {
+        const char *dir = env_get(shell->env, var);
+        return dir ? dir : "";
+    }
+
+    /* ~user → that user's home directory */
+    char *username = strndup(rest, n);
+    if (!username)
+        return NULL;
+    struct passwd *pw = getpwnam(username);
+    free(username);
+    return pw ? pw->pw_dir : NULL;
+}
+
 char *env_expand_tilde(Shell *shell, const char *path, Arena *arena)
 {
     if (!path || path[0] != '~')
         return arena_strdup(arena, path ? path : "");
+    return env_expand_word(shell, path, WORD_TILDE, arena);
+}
 
-    const char *rest = path + 1;
-
-    /* ~+ → PWD */
-    if (rest[0] == '+' && (rest[1] == '/' || rest[1] == '\0')) {
-        const char *pwd = env_get(shell->env, "PWD");
-        if (!pwd) pwd = "";
-        if (rest[1] == '/') {
-            SafeString *s = sstr_new(256);
-            sstr_append(s, pwd);
-            sstr_append(s, rest + 1); /* includes the '/' */
-            char *out = arena_strdup(arena, sstr_cstr(s));
-            sstr_free(s);
-            return out;
-        }
-        return arena_strdup(arena, pwd);
-    }
-
-    /* ~- → OLDPWD */
-    if (rest[0] == '-' && (rest[1] == '/' || rest[1] == '\0')) {
-        const char *oldpwd = env_get(shell->env, "OLDPWD");
-        if (!oldpwd) oldpwd = "";
-        if (rest[1] == '/') {
-            SafeString *s = sstr_new(256);
-            sstr_append(s, oldpwd);
-            sstr_append(s, rest + 1);
-            char *out = arena_strdup(arena, sstr_cstr(s));
-            sstr_free(s);
-            return out;
+/* ---- Word Expansion ----------------------------------------------------- */
+
+char *env_expand(Shell *shell, const char *input, Arena *arena)
+{
+    return env_expand_word(shell, input, WORD_EXPAND, arena);
+}
+
+/* Expand the run [start, end) of a here-document body into result */
+static void expand_run(Shell *shell, const char *start, const char *end,
+                       ArenaString *result, Arena *arena)
+{
+    if (end == start)
+        return;
+    char *run = arena_strndup(arena, start, (size_t)(end - start));
+    if (run)
+        expand_dollars(shell, run, result, arena);
+}
+
+char *env_expand_heredoc(Shell *shell, const char *body, Arena *arena)
+{
+    if (!body)
+        return arena_strdup(arena, "");
+    if (!strchr(body, '\\'))
+        return env_expand(shell, body, arena);
+
+    ArenaString result;
+    astr_init(&result, arena, strlen(body) + 64);
+
+    /* Runs between escapes are expanded as they are; an escape inside a
+     * substitution belongs to the command and stays in its run */
+    const char *run = body, *p = body;
+    while (*p) {
+        if (*p == '\\' && p[1] && strchr("$`\\\n", p[1])) {
+            expand_run(shell, run, p, &result, arena);
+            if (p[1] != '\n')
+                astr_append_char(&result, p[1]);
+            p += 2;
+            run = p;
+            continue;
         }
-        return arena_strdup(arena, oldpwd);
-    }
-
-    /* ~ or ~/... → current user's HOME */
-    if (rest[0] == '/' || rest[0] == '\0') {
-        const char *home = env_get(shell->env, "HOME");
-        if (!home) home = "";
-        if (rest[0] == '/') {
-            SafeString *s = sstr_new(256);
-            sstr_append(s, home);
-            sstr_append(s, rest); /* includes the '/' */
-            char *out = arena_strdup(arena, sstr_cstr(s));
-            sstr_free(s);
-            return out;
+        if (*p == '`' || (*p == '$' && (p[1] == '(' || p[1] == '{'))) {
+            size_t n = lexer_scan_subst(p, strlen(p));
+            if (n > 0) {
+                p += n;
+                continue;
+            }
         }
-        return arena_strdup(arena, home);
-    }
-
-    /* ~user or ~user/... → lookup user's home directory */
-    const char *slash = strchr(rest, '/');
-    char *username;
-    if (slash) {
-        username = strndup(rest, (size_t)(slash - rest));
-    } else {
-        username = strdup(rest);
+        p++;
     }
-    if (!username)
-        return arena_strdup(arena, path);
+    expand_run(shell, run, p, &result, arena);
+    return astr_finish(&result);
+}
 
-    struct passwd *pw = getpwnam(username);
-    free(username);
+char *env_expand_word(Shell *shell, const char *word, unsigned int flags,
+                      Arena *arena)
+{
+    if (!word)
+        return arena_strdup(arena, "");
 
-    if (!pw)
-        return arena_strdup(arena, path);
+    ArenaString result;
+    astr_init(&result, arena, strlen(word) + 64);
 
-    if (slash) {
-        SafeString *s = sstr_new(256);
-        sstr_append(s, pw->pw_dir);
-        sstr_append(s, slash); /* includes the '/' */
-        char *out = arena_strdup(arena, sstr_cstr(s));
-        sstr_free(s);
-        return out;
+    const char *p = word;
+    size_t len;
+    const char *dir;
+    if ((flags & WORD_TILDE) && p[0] == '~' &&
+        (dir = tilde_dir(shell, p, &len)) != NULL) {
+        astr_append(&result, dir);
+        p += len;
     }
-    return arena_strdup(arena, pw->pw_dir);
+
+    if (flags & WORD_EXPAND)
+        expand_dollars(shell, p, &result, arena);
+    else
+        astr_append(&result, p);
+
+    return astr_finish(&result);
 }
 
 /* ---- Assignment Parsing ------------------------------------------------- */
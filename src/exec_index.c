@@ -0,0 +1,422 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * exec_index.c - Sorted index of the executables on PATH
+ *
+ * A directory's mtime changes whenever an entry is created, removed or
+ * renamed, so an unchanged (dev, ino, mtime) triple means its listing is
+ * still exact. The one hole is a change landing in the same clock tick as
+ * our scan; a directory modified within the last second is therefore
+ * treated as "racy" and re-read at the next refresh until it settles.
+ *
+ * Only regular files are listed. The exec bit recorded at scan time is
+ * used for completion; lookups re-check the candidate with stat() and
+ * access(), since chmod does not touch the directory's mtime.
+ * ============================================================================ */
+
+#include "exec_index.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+typedef struct ExecName {
+    const char *name;       /* Points into ExecDir.names_buf */
+    bool        exec;       /* Had an exec bit when scanned */
+} ExecName;
+
+typedef struct ExecDir {
+    char           *path;       /* PATH element as written ("" = cwd) */
+    dev_t           dev;
+    ino_t           ino;
+    struct timespec mtime;
+    bool            valid;      /* Directory existed at the last refresh */
+    bool            stale;      /* Re-read at the next refresh */
+    char           *names_buf;
+    ExecName       *names;      /* Sorted by name */
+    int             count;
+} ExecDir;
+
+struct ExecIndex {
+    ExecDir       *dirs;
+    int            ndirs;
+    unsigned long  serial;
+    bool           have_serial;
+    const char   **merged;      /* Unique executable names, sorted */
+    int            nmerged;
+    bool           merged_dirty;
+    unsigned long  kept;        /* Refreshes that kept a directory listing */
+    unsigned long  rescanned;   /* ... and that had to re-read it */
+};
+
+/* ---- Internal helpers --------------------------------------------------- */
+
+static const char *dir_open_path(const ExecDir *d)
+{
+    return d->path[0] ? d->path : ".";
+}
+
+static void dir_drop_names(ExecDir *d)
+{
+    free(d->names_buf);
+    free(d->names);
+    d->names_buf = NULL;
+    d->names     = NULL;
+    d->count     = 0;
+}
+
+static void dir_free(ExecDir *d)
+{
+    dir_drop_names(d);
+    free(d->path);
+}
+
+static int cmp_names(const void *a, const void *b)
+{
+    return strcmp(((const ExecName *)a)->name, ((const ExecName *)b)->name);
+}
+
+static int cmp_strs(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* Re-read one directory's listing. Returns false on allocation failure
+ * (the directory is left empty and stale). */
+static bool dir_scan(ExecDir *d)
+{
+    dir_drop_names(d);
+
+    DIR *dp = opendir(dir_open_path(d));
+    if (!dp)
+        return true;
+    int dfd = dirfd(dp);
+
+    /* Names are collected as offsets so the buffer can grow freely */
+    size_t buf_len = 0, buf_cap = 4096;
+    char  *buf = malloc(buf_cap);
+    int    cap = 64, count = 0;
+    size_t *offs = malloc((size_t)cap * sizeof(size_t));
+    bool   *exec = malloc((size_t)cap * sizeof(bool));
+    bool    ok = buf && offs && exec;
+
+    struct dirent *ent;
+    while (ok && (ent = readdir(dp)) != NULL) {
+        if (ent->d_type != DT_REG && ent->d_type != DT_LNK &&
+            ent->d_type != DT_UNKNOWN)
+            continue;
+
+        struct stat st;
+        if (fstatat(dfd, ent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        size_t len = strlen(ent->d_name) + 1;
+        if (buf_len + len > buf_cap) {
+            while (buf_len + len > buf_cap)
+                buf_cap *= 2;
+            char *nb = realloc(buf, buf_cap);
+            if (!nb) { ok = false; break; }
+            buf = nb;
+        }
+        if (count == cap) {
+            cap *= 2;
+            size_t *no = realloc(offs, (size_t)cap * sizeof(size_t));
+            if (no) offs = no;
+            bool *ne = no ? realloc(exec, (size_t)cap * sizeof(bool)) : NULL;
+            if (ne) exec = ne;
+            if (!no || !ne) { ok = false; break; }
+        }
+
+        memcpy(buf + buf_len, ent->d_name, len);
+        offs[count] = buf_len;
+        exec[count] = (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0;
+        buf_len += len;
+        count++;
+    }
+    closedir(dp);
+
+    ExecName *names = ok && count > 0 ? malloc((size_t)count * sizeof(ExecName))
+                                      : NULL;
+    if (ok && count > 0 && !names)
+        ok = false;
+
+    if (!ok) {
+        free(buf);
+        free(offs);
+        free(exec);
+        d->stale = true;
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        names[i].name = buf + offs[i];
+        names[i].exec = exec[i];
+    }
+    free(offs);
+    free(exec);
+    if (count > 1)
+        qsort(names, (size_t)count, sizeof(ExecName), cmp_names);
+
+    d->names_buf = buf;
+    d->names     = names;
+    d->count     = count;
+    return true;
+}
+
+static const ExecName *dir_find(const ExecDir *d, const char *name)
+{
+    int lo = 0, hi = d->count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        int c = strcmp(d->names[mid].name, name);
+        if (c == 0)
+            return &d->names[mid];
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return NULL;
+}
+
+static void rebuild_merged(ExecIndex *idx)
+{
+    free(idx->merged);
+    idx->merged  = NULL;
+    idx->nmerged = 0;
+    idx->merged_dirty = false;
+
+    int total = 0;
+    for (int i = 0; i < idx->ndirs; i++)
+        total += idx->dirs[i].count;
+    if (total == 0)
+        return;
+
+    const char **all = malloc((size_t)total * sizeof(char *));
+    if (!all) {
+        idx->merged_dirty = true;
+        return;
+    }
+
+    int n = 0;
+    for (int i = 0; i < idx->ndirs; i++) {
+        const ExecDir *d = &idx->dirs[i];
+        for (int j = 0; j < d->count; j++) {
+            if (d->names[j].exec)
+                all[n++] = d->names[j].name;
+        }
+    }
+    qsort(all, (size_t)n, sizeof(char *), cmp_strs);
+
+    int u = 0;
+    for (int i = 0; i < n; i++) {
+        if (u == 0 || strcmp(all[u - 1], all[i]) != 0)
+            all[u++] = all[i];
+    }
+
+    idx->merged  = all;
+    idx->nmerged = u;
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+ExecIndex *exec_index_create(void)
+{
+    return calloc(1, sizeof(ExecIndex));
+}
+
+void exec_index_destroy(ExecIndex *idx)
+{
+    if (!idx)
+        return;
+    for (int i = 0; i < idx->ndirs; i++)
+        dir_free(&idx->dirs[i]);
+    free(idx->dirs);
+    free(idx->merged);
+    free(idx);
+}
+
+void exec_index_set_path(ExecIndex *idx, const char *path_list,
+                         unsigned long serial)
+{
+    if (!idx || !path_list)
+        return;
+    if (idx->have_serial && idx->serial == serial)
+        return;
+
+    int n = 1;
+    for (const char *p = path_list; *p; p++) {
+        if (*p == ':')
+            n++;
+    }
+
+    ExecDir *dirs = calloc((size_t)n, sizeof(ExecDir));
+    if (!dirs)
+        return;
+
+    const char *elem = path_list;
+    for (int i = 0; i < n; i++) {
+        const char *end = strchr(elem, ':');
+        size_t len = end ? (size_t)(end - elem) : strlen(elem);
+
+        /* Keep the listing of a directory that was already on the path */
+        for (int j = 0; j < idx->ndirs; j++) {
+            ExecDir *old = &idx->dirs[j];
+            if (old->path && strlen(old->path) == len &&
+                memcmp(old->path, elem, len) == 0) {
+                dirs[i] = *old;
+                old->path = NULL;
+                old->names_buf = NULL;
+                old->names = NULL;
+                break;
+            }
+        }
+        if (!dirs[i].path) {
+            dirs[i].path = strndup(elem, len);
+            dirs[i].stale = true;
+            if (!dirs[i].path) {
+                for (int k = 0; k < i; k++)
+                    dir_free(&dirs[k]);
+                free(dirs);
+                return;
+            }
+        }
+        elem = end ? end + 1 : elem + len;
+    }
+
+    for (int j = 0; j < idx->ndirs; j++)
+        dir_free(&idx->dirs[j]);
+    free(idx->dirs);
+
+    idx->dirs   = dirs;
+    idx->ndirs  = n;
+    idx->serial = serial;
+    idx->have_serial  = true;
+    idx->merged_dirty = true;
+}
+
+void exec_index_refresh(ExecIndex *idx)
+{
+    if (!idx)
+        return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    for (int i = 0; i < idx->ndirs; i++) {
+        ExecDir *d = &idx->dirs[i];
+        struct stat st;
+
+        if (stat(dir_open_path(d), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            if (d->valid || d->count) {
+                dir_drop_names(d);
+                idx->merged_dirty = true;
+            }
+            d->valid = false;
+            continue;
+        }
+
+        if (d->valid && !d->stale && d->dev == st.st_dev &&
+            d->ino == st.st_ino &&
+            d->mtime.tv_sec == st.st_mtim.tv_sec &&
+            d->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            idx->kept++;
+            continue;
+        }
+
+        d->dev   = st.st_dev;
+        d->ino   = st.st_ino;
+        d->mtime = st.st_mtim;
+        d->valid = true;
+        d->stale = st.st_mtim.tv_sec >= now.tv_sec - 1;
+        dir_scan(d);
+        idx->rescanned++;
+        idx->merged_dirty = true;
+    }
+}
+
+void exec_index_counts(const ExecIndex *idx, unsigned long *kept,
+                       unsigned long *rescanned)
+{
+    *kept      = idx ? idx->kept : 0;
+    *rescanned = idx ? idx->rescanned : 0;
+}
+
+void exec_index_invalidate(ExecIndex *idx)
+{
+    if (!idx)
+        return;
+    for (int i = 0; i < idx->ndirs; i++)
+        idx->dirs[i].stale = true;
+}
+
+char *exec_index_find(ExecIndex *idx, const char *name)
+{
+    if (!idx || !name || !*name)
+        return NULL;
+
+    exec_index_refresh(idx);
+
+    size_t name_len = strlen(name);
+    for (int i = 0; i < idx->ndirs; i++) {
+        const ExecDir *d = &idx->dirs[i];
+        if (!d->valid || !dir_find(d, name))
+            continue;
+
+        size_t dir_len = strlen(d->path);
+        char fullpath[PATH_MAX];
+        if (dir_len + 1 + name_len >= sizeof(fullpath))
+            continue;
+        if (dir_len == 0) {
+            memcpy(fullpath, name, name_len + 1);
+        } else {
+            memcpy(fullpath, d->path, dir_len);
+            fullpath[dir_len] = '/';
+            memcpy(fullpath + dir_len + 1, name, name_len + 1);
+        }
+
+        struct stat st;
+        if (stat(fullpath, &st) == 0 && S_ISREG(st.st_mode) &&
+            access(fullpath, X_OK) == 0)
+            return strdup(fullpath);
+    }
+    return NULL;
+}
+
+int exec_index_complete(ExecIndex *idx, const char *prefix, size_t prefix_len,
+                        ExecIndexFn fn, void *ctx)
+{
+    if (!idx || !fn)
+        return 0;
+
+    exec_index_refresh(idx);
+    if (idx->merged_dirty)
+        rebuild_merged(idx);
+
+    /* Lower bound of prefix */
+    int lo = 0, hi = idx->nmerged;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strncmp(idx->merged[mid], prefix, prefix_len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    int reported = 0;
+    for (int i = lo; i < idx->nmerged; i++) {
+        const char *name = idx->merged[i];
+        if (strncmp(name, prefix, prefix_len) != 0)
+            break;
+        if (prefix_len == 0 && name[0] == '.')
+            continue;
+        fn(name, ctx);
+        reported++;
+    }
+    return reported;
+}
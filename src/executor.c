@@ -18,8 +18,19 @@
 #include "wildcard.h"
 #include "arena.h"
 #include "parser.h"
+#include "functions.h"
+#include "path_cache.h"
+#include "proc_spawn.h"
+#include "lexer.h"
+#include "safe_string.h"
+#include "output.h"
+#include "bytecode.h"
+#include "stats.h"
+#include "pipetime.h"
+#include "cwd.h"
 
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <fcntl.h>
@@ -44,7 +55,8 @@ static int exec_while(Shell *shell, ASTNode *node);
 static int exec_for(Shell *shell, ASTNode *node);
 static int exec_function(Shell *shell, ASTNode *node);
 static int exec_block(Shell *shell, ASTNode *node);
-static void child_reset_signals(void);
+static int exec_arith(Shell *shell, ASTNode *node);
+static int exec_compiled(Shell *shell, ASTNode *node);
 
 /* ---- Main dispatcher ---------------------------------------------------- */
 
@@ -65,10 +77,11 @@ int executor_execute(Shell *shell, ASTNode *node)
     case NODE_NEGATE:     status = exec_negate(shell, node);     break;
     case NODE_SUBSHELL:   status = exec_subshell(shell, node);   break;
     case NODE_IF:         status = exec_if(shell, node);         break;
-    case NODE_WHILE:      status = exec_while(shell, node);      break;
-    case NODE_FOR:        status = exec_for(shell, node);        break;
+    case NODE_WHILE:      status = exec_compiled(shell, node);   break;
+    case NODE_FOR:        status = exec_compiled(shell, node);   break;
     case NODE_FUNCTION:   status = exec_function(shell, node);   break;
     case NODE_BLOCK:      status = exec_block(shell, node);      break;
+    case NODE_ARITH:      status = exec_arith(shell, node);      break;
     }
 
     shell->last_status = status;
@@ -77,51 +90,142 @@ int executor_execute(Shell *shell, ASTNode *node)
 
 /* ---- Simple command execution ------------------------------------------- */
 
+/* The WORD_* flags of argv word i; words that did not come from the
+ * parser are assumed to need everything */
+static inline unsigned int word_flags(const CommandNode *cmd, int i)
+{
+    return cmd->argv_flags ? cmd->argv_flags[i] : WORD_ALL;
+}
+
+/* Append word to the argv being built, growing it as needed */
+static void push_word(Arena *arena, char *word, char ***out_argv,
+                      int *out_argc, int *out_cap)
+{
+    if (*out_argc >= *out_cap) {
+        *out_cap *= 2;
+        char **tmp = arena_alloc(arena, sizeof(char *) * (*out_cap));
+        memcpy(tmp, *out_argv, sizeof(char *) * (*out_argc));
+        *out_argv = tmp;
+    }
+    (*out_argv)[(*out_argc)++] = word;
+}
+
 /*
- * Expand a single word: variable expansion, tilde expansion, wildcard
- * expansion.  Appends results to *out_argv / *out_argc (may produce multiple
- * words due to glob expansion).  All strings are arena-allocated.
+ * Expand a single word: tilde and variable expansion in one pass, then
+ * wildcard expansion. The parser's flags say which of these the word can
+ * need at all; a literal word is appended as it is, without a copy.
+ * Appends results to *out_argv / *out_argc (may produce multiple words due
+ * to glob expansion).  All strings are arena-allocated.
  */
-static void expand_word(Shell *shell, const char *word, Arena *arena,
-                        char ***out_argv, int *out_argc, int *out_cap)
+static void expand_word(Shell *shell, char *word, unsigned int flags,
+                        Arena *arena, char ***out_argv, int *out_argc,
+                        int *out_cap)
 {
-    /* Variable expansion */
-    char *expanded = env_expand(shell, word, arena);
-
-    /* Tilde expansion (only when the word starts with ~) */
-    if (expanded[0] == '~')
-        expanded = env_expand_tilde(shell, expanded, arena);
+    char *expanded = word;
+    if (flags & (WORD_EXPAND | WORD_TILDE))
+        expanded = env_expand_word(shell, word, flags, arena);
 
     /* Wildcard / glob expansion */
-    if (wildcard_has_magic(expanded)) {
+    if ((flags & WORD_GLOB) && wildcard_has_magic(expanded)) {
         int   glob_count = 0;
         char **matches = wildcard_expand(expanded, arena, &glob_count);
         if (matches && glob_count > 0) {
-            for (int i = 0; i < glob_count; i++) {
-                if (*out_argc >= *out_cap) {
-                    *out_cap *= 2;
-                    char **tmp = arena_alloc(arena, sizeof(char *) * (*out_cap));
-                    memcpy(tmp, *out_argv, sizeof(char *) * (*out_argc));
-                    *out_argv = tmp;
-                }
-                (*out_argv)[(*out_argc)++] = matches[i];
-            }
+            for (int i = 0; i < glob_count; i++)
+                push_word(arena, matches[i], out_argv, out_argc, out_cap);
             return;
         }
         /* No matches -- fall through and use the literal pattern */
     }
 
-    /* Single word -- append it */
-    if (*out_argc >= *out_cap) {
-        *out_cap *= 2;
-        char **tmp = arena_alloc(arena, sizeof(char *) * (*out_cap));
-        memcpy(tmp, *out_argv, sizeof(char *) * (*out_argc));
-        *out_argv = tmp;
+    push_word(arena, expanded, out_argv, out_argc, out_cap);
+}
+
+char **executor_expand_argv(Shell *shell, CommandNode *cmd, int *out_argc)
+{
+    Arena *arena = shell->parse_arena;
+    int    cap   = cmd->argc > 4 ? cmd->argc * 2 : 8;
+    int    argc  = 0;
+    char **argv  = arena_alloc(arena, sizeof(char *) * cap);
+
+    for (int i = 0; i < cmd->argc; i++)
+        expand_word(shell, cmd->argv[i], word_flags(cmd, i), arena,
+                    &argv, &argc, &cap);
+
+    /* Null-terminate the argv array */
+    if (argc >= cap) {
+        cap++;
+        char **tmp = arena_alloc(arena, sizeof(char *) * cap);
+        memcpy(tmp, argv, sizeof(char *) * argc);
+        argv = tmp;
+    }
+    argv[argc] = NULL;
+
+    *out_argc = argc;
+    return argv;
+}
+
+/*
+ * The builtin for this command, if any. When argv[0] is a literal word (no
+ * expansion can change it) the answer is cached on the node.
+ */
+static const BuiltinEntry *resolve_builtin(CommandNode *cmd, const char *name)
+{
+    if (cmd->resolved)
+        return cmd->builtin;
+
+    const BuiltinEntry *entry = builtins_lookup(name);
+    if (cmd->argc > 0 && word_flags(cmd, 0) == 0) {
+        cmd->builtin  = entry;
+        cmd->resolved = true;
     }
-    (*out_argv)[(*out_argc)++] = expanded;
+    return entry;
 }
 
-int executor_exec_command(Shell *shell, CommandNode *cmd)
+/* Does a command without words read stdin from somewhere and write stdout
+ * to a file? Then it is a copy: `< in > out` behaves as `cat < in > out`. */
+static bool redirects_copy(const Redirection *r)
+{
+    bool in = false, out = false;
+    for (; r; r = r->next) {
+        int fd = r->fd;
+        switch (r->type) {
+        case REDIR_INPUT:
+        case REDIR_HEREDOC:
+        case REDIR_HERESTRING:
+            in |= fd < 0 || fd == 0;
+            break;
+        case REDIR_OUTPUT:
+        case REDIR_APPEND:
+            out |= fd < 0 || fd == 1;
+            break;
+        default:
+            break;
+        }
+    }
+    return in && out;
+}
+
+/* Start expanding a command's words; returns the enclosing command's
+ * expand_error, which expansion_failed() puts back */
+static bool expansion_begin(Shell *shell)
+{
+    bool outer = shell->expand_error;
+    shell->expand_error = false;
+    return outer;
+}
+
+/* Did an arithmetic expansion fail since expansion_begin()? Then the
+ * command is abandoned with status 1, as bash does. */
+static bool expansion_failed(Shell *shell, bool outer)
+{
+    bool failed = shell->expand_error;
+    shell->expand_error = outer;
+    if (failed)
+        shell->last_status = 1;
+    return failed;
+}
+
+static int run_simple_command(Shell *shell, CommandNode *cmd)
 {
     Arena *arena = shell->parse_arena;
 
@@ -131,7 +235,10 @@ int executor_exec_command(Shell *shell, CommandNode *cmd)
             char *key   = NULL;
             char *value = NULL;
             if (env_parse_assignment(cmd->assignments[i], &key, &value, arena)) {
+                bool outer = expansion_begin(shell);
                 char *exp_val = env_expand(shell, value, arena);
+                if (expansion_failed(shell, outer))
+                    return 1;
                 env_set(shell->env, key, exp_val, false);
             }
         }
@@ -140,38 +247,92 @@ int executor_exec_command(Shell *shell, CommandNode *cmd)
     }
 
     /* ---- Expand all arguments ------------------------------------------- */
-    int   cap  = cmd->argc > 4 ? cmd->argc * 2 : 8;
-    int   argc = 0;
-    char **argv = arena_alloc(arena, sizeof(char *) * cap);
-
-    for (int i = 0; i < cmd->argc; i++)
-        expand_word(shell, cmd->argv[i], arena, &argv, &argc, &cap);
-
-    /* Null-terminate the argv array */
-    if (argc >= cap) {
-        cap++;
-        char **tmp = arena_alloc(arena, sizeof(char *) * cap);
-        memcpy(tmp, argv, sizeof(char *) * argc);
-        argv = tmp;
-    }
-    argv[argc] = NULL;
+    /* Two clock reads cost about as much as expanding a short command, so
+     * expansion is only timed on request (set -o timing) */
+    uint64_t t = shell->opt_timing ? stats_now() : 0;
+    int    argc = 0;
+    bool   outer = expansion_begin(shell);
+    char **argv = executor_expand_argv(shell, cmd, &argc);
+    if (shell->opt_timing)
+        stats_since(shell->stats, STAT_EXPAND, t);
+    if (expansion_failed(shell, outer))
+        return 1;
 
+    /* ---- Redirections alone -------------------------------------------- */
+    /* `> file` creates or truncates the file; `< in > out` copies in to out
+     * with the cat builtin */
+    static char cat_name[] = "cat";
+    static char *cat_argv[] = { cat_name, NULL };
+    bool redirect_only = argc == 0 && cmd->nassign == 0;
     if (argc == 0) {
-        shell->last_status = 0;
-        return 0;
+        if (!redirect_only || !redirects_copy(cmd->redirs)) {
+            RedirSave save;
+            int status = 0;
+            if (cmd->redirs) {
+                status = executor_push_redirections(shell, cmd->redirs, &save) < 0;
+                if (status == 0)
+                    executor_restore_redirections(&save);
+            }
+            shell->last_status = status;
+            return status;
+        }
+        argc = 1;
+        argv = cat_argv;
     }
 
-    /* ---- Builtin? ------------------------------------------------------- */
-    if (builtins_is_builtin(argv[0])) {
+    /* ---- Shell function or builtin? (both run in-process) --------------- */
+    FuncEntry *fn = redirect_only ? NULL : func_lookup(shell->functions, argv[0]);
+    const BuiltinEntry *builtin = fn ? NULL : resolve_builtin(cmd, argv[0]);
+    if (fn || builtin) {
         /* Apply command-local variable assignments to a temporary env */
         /* (simplified: we skip per-command env overrides for builtins) */
-        int status = builtins_execute(shell, argc, argv);
+        RedirSave save;
+        if (executor_push_redirections(shell, cmd->redirs, &save) < 0) {
+            shell->last_status = 1;
+            return 1;
+        }
+
+        /* A cat or tee the builtin cannot do here runs as the external */
+        if (builtin && builtins_defers(shell, builtin, argc, argv)) {
+            executor_restore_redirections(&save);
+            goto external;
+        }
+
+        int status = fn ? func_call(shell, fn, argc, argv)
+                        : builtin->handler(shell, argc, argv);
+        if (builtin)
+            status = builtins_finish(shell, argv[0], status);
+
+        executor_restore_redirections(&save);
         shell->last_status = status;
         return status;
     }
 
-    /* ---- External command: fork & exec ---------------------------------- */
-    pid_t pid = fork();
+    /* ---- External command: resolve in the parent, then spawn ----------- */
+external:
+    t = stats_now();
+    const char *path = path_cache_lookup(shell, argv[0]);
+
+    /*
+     * posix_spawn when the whole child can be described up front. If it
+     * fails (missing file, ENOEXEC script, redirection error, ...) the fork
+     * path below runs the same command again and reports the error the
+     * usual way.
+     */
+    pid_t pid = -1;
+    if (path && cmd->nassign == 0 && spawn_supported(shell, cmd->redirs, true)) {
+        SpawnRequest req = {
+            .path = path, .argv = argv, .redirs = cmd->redirs,
+            .stdin_fd = -1, .stdout_fd = -1, .pgid = 0, .foreground = true,
+        };
+        pid = spawn_command(shell, &req);
+    }
+
+    if (pid < 0) {
+        out_flush(shell->out);
+        pid = fork();
+        stats_fork(shell->stats);
+    }
     if (pid < 0) {
         perror("vsh: fork");
         shell->last_status = 1;
@@ -180,12 +341,13 @@ int executor_exec_command(Shell *shell, CommandNode *cmd)
 
     if (pid == 0) {
         /* ---- Child process ---------------------------------------------- */
-        /* New process group */
-        setpgid(0, 0);
-        if (shell->interactive)
+        /* New process group, when doing job control */
+        if (shell->interactive) {
+            setpgid(0, 0);
             tcsetpgrp(STDIN_FILENO, getpid());
+        }
 
-        child_reset_signals();
+        job_child_reset_signals();
 
         /* Apply command-local variable assignments to environment */
         for (int i = 0; i < cmd->nassign; i++) {
@@ -198,33 +360,68 @@ int executor_exec_command(Shell *shell, CommandNode *cmd)
         }
 
         /* Apply redirections */
-        if (executor_apply_redirections(cmd->redirs) < 0)
+        if (executor_apply_redirections(shell, cmd->redirs) < 0)
             _exit(1);
 
-        /* Build envp and exec */
-        char **envp = env_build_envp(shell->env);
-        execve(argv[0], argv, envp);
-
-        /* execve with bare name failed -- try PATH lookup via execvp */
-        execvp(argv[0], argv);
-
-        /* If we get here, exec failed */
-        int err = errno;
-        fprintf(stderr, "vsh: %s: %s\n", argv[0], strerror(err));
-        env_free_envp(envp);
-        _exit(err == ENOENT ? 127 : 126);
+        executor_exec_external(shell, path, argv);
     }
 
     /* ---- Parent process ------------------------------------------------- */
-    setpgid(pid, pid);
+    if (shell->interactive)
+        setpgid(pid, pid);
+    stats_since(shell->stats, STAT_SPAWN, t);
 
     Job *job = job_add(shell, pid, &pid, 1, argv[0], true);
     int status = job_wait_foreground(shell, job);
 
+    /* A stale cached path (binary moved or removed) is re-resolved next time */
+    if (status == 127 && path != argv[0])
+        path_cache_forget(shell->path_cache, argv[0]);
+
     shell->last_status = status;
     return status;
 }
 
+int executor_exec_command(Shell *shell, CommandNode *cmd)
+{
+    /* Expansion scratch (argv, globs, temporaries) is released as soon as
+     * the command finishes, so loops run in constant memory */
+    ArenaMark mark = arena_mark(shell->parse_arena);
+    int status = run_simple_command(shell, cmd);
+    arena_rewind(shell->parse_arena, mark);
+    return status;
+}
+
+/* ---- Exec an external command (child side) ------------------------------ */
+
+void executor_exec_external(Shell *shell, const char *path, char **argv)
+{
+    if (!path) {
+        fprintf(stderr, "vsh: %s: command not found\n", argv[0]);
+        _exit(127);
+    }
+
+    char **envp = env_envp(shell->env);
+    execve(path, argv, envp);
+    int err = errno;
+
+    /* No #! line and not a binary: run it as a shell script, like execvp */
+    if (err == ENOEXEC) {
+        int argc = 0;
+        while (argv[argc]) argc++;
+        char **sh_argv = malloc(sizeof(char *) * (size_t)(argc + 2));
+        if (sh_argv) {
+            sh_argv[0] = "sh";
+            sh_argv[1] = (char *)path;
+            memcpy(sh_argv + 2, argv + 1, sizeof(char *) * (size_t)argc);
+            execve("/bin/sh", sh_argv, envp);
+        }
+    }
+
+    fprintf(stderr, "vsh: %s: %s\n", argv[0], strerror(err));
+    _exit(err == ENOENT ? 127 : 126);
+}
+
 /* ---- Wrapper for the dispatcher ----------------------------------------- */
 
 static int exec_command(Shell *shell, ASTNode *node)
@@ -236,7 +433,12 @@ static int exec_command(Shell *shell, ASTNode *node)
 
 static int exec_pipeline(Shell *shell, ASTNode *node)
 {
-    return pipeline_execute(shell, &node->pipeline);
+    ArenaMark mark = arena_mark(shell->parse_arena);
+    int status = node->pipeline.timed
+        ? pipetime_execute(shell, &node->pipeline)
+        : pipeline_execute(shell, &node->pipeline);
+    arena_rewind(shell->parse_arena, mark);
+    return status;
 }
 
 /* ---- Logical AND (&&) --------------------------------------------------- */
@@ -244,7 +446,7 @@ static int exec_pipeline(Shell *shell, ASTNode *node)
 static int exec_and(Shell *shell, ASTNode *node)
 {
     int status = executor_execute(shell, node->binary.left);
-    if (status == 0)
+    if (status == 0 && !UNWINDING(shell))
         status = executor_execute(shell, node->binary.right);
     return status;
 }
@@ -254,7 +456,7 @@ static int exec_and(Shell *shell, ASTNode *node)
 static int exec_or(Shell *shell, ASTNode *node)
 {
     int status = executor_execute(shell, node->binary.left);
-    if (status != 0)
+    if (status != 0 && !UNWINDING(shell))
         status = executor_execute(shell, node->binary.right);
     return status;
 }
@@ -263,7 +465,9 @@ static int exec_or(Shell *shell, ASTNode *node)
 
 static int exec_sequence(Shell *shell, ASTNode *node)
 {
-    executor_execute(shell, node->binary.left);
+    int status = executor_execute(shell, node->binary.left);
+    if (UNWINDING(shell))
+        return status;
     return executor_execute(shell, node->binary.right);
 }
 
@@ -271,22 +475,28 @@ static int exec_sequence(Shell *shell, ASTNode *node)
 
 static int exec_background(Shell *shell, ASTNode *node)
 {
+    out_flush(shell->out);
     pid_t pid = fork();
+    stats_fork(shell->stats);
     if (pid < 0) {
         perror("vsh: fork");
         return 1;
     }
 
     if (pid == 0) {
-        /* Child: new process group, execute the node */
-        setpgid(0, 0);
-        child_reset_signals();
+        /* Child: new process group, execute the node. It never owns the
+         * terminal, so commands it runs must not take it either. */
+        if (shell->interactive)
+            setpgid(0, 0);
+        job_child_reset_signals();
+        shell->interactive = false;
         int status = executor_execute(shell, node->child);
         _exit(status);
     }
 
     /* Parent: register background job */
-    setpgid(pid, pid);
+    if (shell->interactive)
+        setpgid(pid, pid);
     Job *job = job_add(shell, pid, &pid, 1, "(background)", false);
     if (job)
         fprintf(stderr, "[%d] %d\n", job->id, (int)pid);
@@ -304,9 +514,124 @@ static int exec_negate(Shell *shell, ASTNode *node)
 
 /* ---- Subshell ( ... ) --------------------------------------------------- */
 
+/*
+ * Can a subshell run this without a process of its own? Only if all it can
+ * change is what exec_subshell_in_shell() puts back: variables, the
+ * working directory and the directory stack. External commands are
+ * processes anyway. exit, return, set, sourcing, functions (calling or
+ * defining them), aliases, history, job control and background jobs all
+ * need the fork, as does a command name that is not a literal word.
+ */
+static bool contained(Shell *shell, const ASTNode *node)
+{
+    if (!node)
+        return true;
+
+    switch (node->type) {
+    case NODE_COMMAND: {
+        const CommandNode *cmd = &node->cmd;
+        if (cmd->argc == 0)
+            return true;
+        if (word_flags(cmd, 0) != 0 ||
+            func_lookup(shell->functions, cmd->argv[0]))
+            return false;
+        const BuiltinEntry *b = builtins_lookup(cmd->argv[0]);
+        if (!b)
+            return true;
+        if (!builtins_is_contained(b))
+            return false;
+        if (b->handler == builtin_unset) {
+            for (int i = 1; i < cmd->argc; i++) {
+                if (word_flags(cmd, i) != 0 || strcmp(cmd->argv[i], "-f") == 0)
+                    return false;
+            }
+        }
+        return true;
+    }
+    case NODE_PIPELINE:
+        for (int i = 0; i < node->pipeline.count; i++) {
+            if (!contained(shell, node->pipeline.commands[i]))
+                return false;
+        }
+        return true;
+    case NODE_AND:
+    case NODE_OR:
+    case NODE_SEQUENCE:
+        return contained(shell, node->binary.left) &&
+               contained(shell, node->binary.right);
+    case NODE_NEGATE:
+    case NODE_SUBSHELL:
+    case NODE_BLOCK:
+        return contained(shell, node->child);
+    case NODE_IF:
+        return contained(shell, node->if_node.condition) &&
+               contained(shell, node->if_node.then_body) &&
+               contained(shell, node->if_node.else_body);
+    case NODE_WHILE:
+        return contained(shell, node->while_node.condition) &&
+               contained(shell, node->while_node.body);
+    case NODE_FOR:
+        return contained(shell, node->for_node.body);
+    case NODE_ARITH:
+        return true;
+    case NODE_BACKGROUND:
+    case NODE_FUNCTION:
+        return false;
+    }
+    return false;
+}
+
+/*
+ * Run a subshell body in the shell and put back what it changed: every
+ * variable it set, unset or exported (an env snapshot frame), the working
+ * directory (an O_PATH mark with its logical name) and the directory
+ * stack. Returns -1, having run nothing, if that state cannot be saved.
+ */
+static int exec_subshell_in_shell(Shell *shell, ASTNode *node)
+{
+    CwdMark cwd;
+    if (!cwd_mark(shell->cwd, &cwd))
+        return -1;
+
+    DirStack *ds = shell->dirstack;
+    char *dirs[DIRSTACK_MAX];
+    int top = ds ? ds->top : 0, saved = 0;
+    while (saved < top && (dirs[saved] = strdup(ds->dirs[saved])) != NULL)
+        saved++;
+    if (saved < top || !env_push_snapshot(shell->env)) {
+        while (saved > 0)
+            free(dirs[--saved]);
+        cwd_return(shell->cwd, &cwd);
+        return -1;
+    }
+
+    int status = executor_execute(shell, node->child);
+    out_flush(shell->out);
+
+    env_pop_scope(shell->env);
+    if (cwd_return(shell->cwd, &cwd) < 0)
+        fprintf(stderr, "vsh: subshell: cannot return to directory: %s\n",
+                strerror(errno));
+    if (ds) {
+        for (int i = 0; i < ds->top; i++)
+            free(ds->dirs[i]);
+        memcpy(ds->dirs, dirs, sizeof(char *) * (size_t)top);
+        ds->top = top;
+    }
+    return status;
+}
+
 static int exec_subshell(Shell *shell, ASTNode *node)
 {
+    if (contained(shell, node->child)) {
+        int status = exec_subshell_in_shell(shell, node);
+        if (status >= 0)
+            return status;
+    }
+
+    out_flush(shell->out);
     pid_t pid = fork();
+    stats_fork(shell->stats);
     if (pid < 0) {
         perror("vsh: fork");
         return 1;
@@ -314,16 +639,23 @@ static int exec_subshell(Shell *shell, ASTNode *node)
 
     if (pid == 0) {
         /* Child: new process group, execute, then exit */
-        setpgid(0, 0);
-        if (shell->interactive)
+        if (shell->interactive) {
+            setpgid(0, 0);
             tcsetpgrp(STDIN_FILENO, getpid());
-        child_reset_signals();
+        }
+        job_child_reset_signals();
+        /* Foreground jobs hand the terminal back to us, not the parent;
+         * like the top-level shell, taking it back must not stop us */
+        shell->shell_pid = getpid();
+        if (shell->interactive)
+            signal(SIGTTOU, SIG_IGN);
         int status = executor_execute(shell, node->child);
         _exit(status);
     }
 
     /* Parent: wait for the subshell */
-    setpgid(pid, pid);
+    if (shell->interactive)
+        setpgid(pid, pid);
     Job *job = job_add(shell, pid, &pid, 1, "(subshell)", true);
     return job_wait_foreground(shell, job);
 }
@@ -335,6 +667,8 @@ static int exec_if(Shell *shell, ASTNode *node)
     IfNode *ifn = &node->if_node;
 
     int cond = executor_execute(shell, ifn->condition);
+    if (UNWINDING(shell))
+        return cond;
     if (cond == 0)
         return executor_execute(shell, ifn->then_body);
 
@@ -349,11 +683,28 @@ static int exec_if(Shell *shell, ASTNode *node)
 static int exec_while(Shell *shell, ASTNode *node)
 {
     WhileNode *wn = &node->while_node;
+    ArenaMark  mark = arena_mark(shell->parse_arena);
     int status = 0;
 
-    while (executor_execute(shell, wn->condition) == 0)
+    /* A loop whose condition is just read consumes all of stdin itself */
+    ASTNode *cond = wn->condition;
+    int owns = cond && cond->type == NODE_COMMAND && cond->cmd.argc > 0 &&
+               strcmp(cond->cmd.argv[0], "read") == 0;
+
+    for (;;) {
+        shell->read_loop += owns;
+        int cond_status = executor_execute(shell, wn->condition);
+        shell->read_loop -= owns;
+        if (cond_status != 0 || UNWINDING(shell))
+            break;
+
         status = executor_execute(shell, wn->body);
+        arena_rewind(shell->parse_arena, mark);
+        if (UNWINDING(shell))
+            break;
+    }
 
+    arena_rewind(shell->parse_arena, mark);
     return status;
 }
 
@@ -366,56 +717,75 @@ static int exec_for(Shell *shell, ASTNode *node)
     int      status = 0;
 
     for (int i = 0; i < fn->nwords; i++) {
-        /* Expand each word */
-        char *word = env_expand(shell, fn->words[i], arena);
-        if (word[0] == '~')
-            word = env_expand_tilde(shell, word, arena);
+        /* Each word's expansion lives only as long as its iterations */
+        ArenaMark mark = arena_mark(arena);
+
+        unsigned int flags = fn->word_flags ? fn->word_flags[i] : WORD_ALL;
+        char *word = fn->words[i];
+        if (flags & (WORD_EXPAND | WORD_TILDE))
+            word = env_expand_word(shell, word, flags, arena);
 
         /* Wildcard expansion on the word */
-        if (wildcard_has_magic(word)) {
+        if ((flags & WORD_GLOB) && wildcard_has_magic(word)) {
             int   glob_count = 0;
             char **matches = wildcard_expand(word, arena, &glob_count);
             if (matches && glob_count > 0) {
-                for (int j = 0; j < glob_count; j++) {
+                ArenaMark body_mark = arena_mark(arena);
+                for (int j = 0; j < glob_count && !UNWINDING(shell); j++) {
                     env_set(shell->env, fn->varname, matches[j], false);
                     status = executor_execute(shell, fn->body);
+                    arena_rewind(arena, body_mark);
                 }
+                arena_rewind(arena, mark);
+                if (UNWINDING(shell))
+                    break;
                 continue;
             }
         }
 
         env_set(shell->env, fn->varname, word, false);
         status = executor_execute(shell, fn->body);
+        arena_rewind(arena, mark);
+        if (UNWINDING(shell))
+            break;
     }
 
     return status;
 }
 
+/* ---- Compiled loops ----------------------------------------------------- */
+
+/* Loops run as bytecode: the loop and everything nested in it are compiled
+ * into the parse arena on entry, so each iteration is a linear pass over
+ * instructions instead of a recursive walk. The tree walkers above remain
+ * for whatever cannot be compiled. */
+static int exec_compiled(Shell *shell, ASTNode *node)
+{
+    ArenaMark  mark = arena_mark(shell->parse_arena);
+    BcProgram *prog = bc_compile(shell->parse_arena, node);
+    if (!prog) {
+        arena_rewind(shell->parse_arena, mark);
+        return node->type == NODE_WHILE ? exec_while(shell, node)
+                                        : exec_for(shell, node);
+    }
+
+    int status = bc_run(shell, prog);
+    arena_rewind(shell->parse_arena, mark);
+    return status;
+}
+
 /* ---- Function definition ------------------------------------------------ */
 
 static int exec_function(Shell *shell, ASTNode *node)
 {
-    /*
-     * Store the function body AST in the environment as a special variable.
-     * The convention is "func:<name>" → pointer-as-string.  This is a
-     * simplified approach; a proper implementation would use a dedicated
-     * function table.  We store the raw pointer value so we can retrieve it
-     * at call time.
-     */
+    /* The body is deep-copied into the function table, so the definition
+     * survives the reset of the parse arena it came from. */
     FunctionNode *fn = &node->func;
-    char key[256];
-    snprintf(key, sizeof(key), "func:%s", fn->name);
-
-    /*
-     * Encode the ASTNode pointer as a hex string.  The body AST lives in
-     * the parse arena which is only valid for the current top-level command,
-     * so in practice functions should be defined via rc files that persist
-     * the arena.  For now this is a minimal placeholder implementation.
-     */
-    char ptr_buf[32];
-    snprintf(ptr_buf, sizeof(ptr_buf), "%p", (void *)fn->body);
-    env_set(shell->env, key, ptr_buf, false);
-
+    if (!func_define(shell->functions, fn->name, fn->body)) {
+        fprintf(stderr, "vsh: %s: cannot define function: out of memory\n",
+                fn->name);
+        return 1;
+    }
     return 0;
 }
 
@@ -426,9 +796,317 @@ static int exec_block(Shell *shell, ASTNode *node)
     return executor_execute(shell, node->child);
 }
 
+/* ---- Arithmetic (( ... )) ----------------------------------------------- */
+
+/* True (0) when the expression is non-zero; a loop condition that costs
+ * no process */
+static int exec_arith(Shell *shell, ASTNode *node)
+{
+    long long value;
+    if (!env_arith(shell, node->expr, &value, shell->parse_arena))
+        return 1;
+    return value != 0 ? 0 : 1;
+}
+
+/* ---- Command substitution ----------------------------------------------- */
+
+/* Calls followed into function bodies before a substitution forks anyway
+ * (this also stops at a function that calls itself) */
+#define CAPTURE_FUNC_DEPTH 8
+
+/* Whether a substitution can run without forking: lists of simple
+ * commands naming pure builtins, or functions whose bodies are such lists.
+ * Nothing else may run in the shell, where a cd or export would outlive
+ * the substitution. */
+static bool capture_in_process(Shell *shell, const ASTNode *node, int depth)
+{
+    if (!node)
+        return true;
+
+    switch (node->type) {
+    case NODE_COMMAND: {
+        const CommandNode *cmd = &node->cmd;
+        if (cmd->argc == 0 || cmd->nassign > 0 || word_flags(cmd, 0) != 0)
+            return false;
+        FuncEntry *fn = func_lookup(shell->functions, cmd->argv[0]);
+        if (fn)
+            return depth < CAPTURE_FUNC_DEPTH &&
+                   capture_in_process(shell, fn->body, depth + 1);
+        /* history with no arguments only lists, like the pure builtins */
+        const BuiltinEntry *b = builtins_lookup(cmd->argv[0]);
+        return b && (builtins_is_pure(b) ||
+                     (b->handler == builtin_history && cmd->argc == 1));
+    }
+    case NODE_AND:
+    case NODE_OR:
+    case NODE_SEQUENCE:
+        return capture_in_process(shell, node->binary.left, depth) &&
+               capture_in_process(shell, node->binary.right, depth);
+    case NODE_NEGATE:
+    case NODE_BLOCK:
+        return capture_in_process(shell, node->child, depth);
+    default:
+        return false;
+    }
+}
+
+/* Run node with stdout on an anonymous memfd, then append what it wrote to
+ * out with a single pread. The memfd never blocks the writer, however much
+ * it writes, and no process is created for builtins. */
+static int capture_builtin(Shell *shell, ASTNode *node, SafeString *out)
+{
+    int mfd = memfd_create("vsh-subst", MFD_CLOEXEC);
+    if (mfd < 0) {
+        perror("vsh: memfd_create");
+        return 1;
+    }
+
+    out_flush(shell->out);
+    fflush(stdout);
+    int saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    dup2(mfd, STDOUT_FILENO);
+
+    bool running = shell->running;
+    int status = executor_execute(shell, node);
+    /* exit inside $(...) ends the substitution, not the shell */
+    shell->running = running;
+
+    out_flush(shell->out);
+    fflush(stdout);
+    if (saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    } else {
+        close(STDOUT_FILENO);
+    }
+
+    off_t size = lseek(mfd, 0, SEEK_END);
+    if (size > 0 && sstr_ensure(out, (size_t)size)) {
+        ssize_t n = pread(mfd, out->data + out->len, (size_t)size, 0);
+        if (n > 0)
+            out->len += (size_t)n;
+        out->data[out->len] = '\0';
+    }
+    close(mfd);
+    return status;
+}
+
+/* Run node in a child writing into a pipe, reading its output into out as
+ * it is produced. A lone external command is exec'd by the child itself. */
+static int capture_child(Shell *shell, ASTNode *node, SafeString *out)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("vsh: pipe");
+        return 1;
+    }
+
+    out_flush(shell->out);
+    fflush(stdout);
+    pid_t pid = fork();
+    stats_fork(shell->stats);
+    if (pid < 0) {
+        perror("vsh: fork");
+        close(fds[0]);
+        close(fds[1]);
+        return 1;
+    }
+
+    if (pid == 0) {
+        /* Stays in the shell's process group, like any expansion */
+        job_child_reset_signals();
+        shell->interactive = false;
+        shell->shell_pid = getpid();
+        dup2(fds[1], STDOUT_FILENO);
+
+        const CommandNode *single = node && node->type == NODE_COMMAND
+                                    ? &node->cmd : NULL;
+        if (single && single->argc > 0 && single->nassign == 0 &&
+            word_flags(single, 0) == 0 &&
+            !func_lookup(shell->functions, single->argv[0]) &&
+            !builtins_lookup(single->argv[0])) {
+            int argc = 0;
+            char **argv = executor_expand_argv(shell, &node->cmd, &argc);
+            if (executor_apply_redirections(shell, single->redirs) < 0)
+                _exit(1);
+            executor_exec_external(shell, path_cache_lookup(shell, argv[0]),
+                                   argv);
+        }
+        int status = executor_execute(shell, node);
+        fflush(stdout);
+        _exit(status);
+    }
+
+    close(fds[1]);
+    for (;;) {
+        if (!sstr_ensure(out, 4096))
+            break;
+        ssize_t n = read(fds[0], out->data + out->len, out->cap - out->len - 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        out->len += (size_t)n;
+    }
+    out->data[out->len] = '\0';
+    close(fds[0]);
+
+    int wstatus = 0;
+    struct rusage usage;
+    while (wait4(pid, &wstatus, 0, &usage) < 0) {
+        if (errno != EINTR)
+            return 1;
+    }
+    if (shell->timer)
+        pipetime_reaped(shell, pid, wstatus, &usage);
+    if (WIFEXITED(wstatus))
+        return WEXITSTATUS(wstatus);
+    if (WIFSIGNALED(wstatus))
+        return 128 + WTERMSIG(wstatus);
+    return 1;
+}
+
+int executor_capture_node(Shell *shell, ASTNode *node, SafeString *out)
+{
+    if (capture_in_process(shell, node, 0))
+        return capture_builtin(shell, node, out);
+    return capture_child(shell, node, out);
+}
+
+int executor_capture(Shell *shell, const char *src, size_t len,
+                     SafeString *out)
+{
+    Arena *arena = shell->parse_arena;
+    ArenaMark mark = arena_mark(arena);
+    size_t start = out->len;
+    int status;
+
+    Lexer lex;
+    lexer_init(&lex, arena_strndup(arena, src, len), arena);
+    TokenList *tokens = lexer_tokenize(&lex);
+    const char *error = NULL;
+    ASTNode *ast = NULL;
+
+    if (!tokens || lex.error) {
+        error = lex.error ? lex.error : "tokenization failed";
+    } else {
+        Parser parser;
+        parser_init(&parser, tokens, arena);
+        ast = parser_parse(&parser);
+        if (parser.had_error) {
+            error = parser_error(&parser);
+            if (!error)
+                error = "unexpected token";
+        }
+    }
+
+    if (error) {
+        fprintf(stderr, "vsh: command substitution: %s\n", error);
+        status = 2;
+    } else {
+        status = executor_capture_node(shell, ast, out);
+    }
+
+    /* Trailing newlines are dropped by moving the end back */
+    while (out->len > start && out->data[out->len - 1] == '\n')
+        out->len--;
+    out->data[out->len] = '\0';
+
+    arena_rewind(arena, mark);
+    shell->last_status = status;
+    return status;
+}
+
 /* ---- Redirections ------------------------------------------------------- */
 
-int executor_apply_redirections(Redirection *redirs)
+/*
+ * Descriptor that reads back text, for here-documents and here-strings.
+ * Text that fits in a pipe is written into one up front (which cannot
+ * block); anything larger goes into an anonymous memfd. Nothing touches
+ * the filesystem either way.
+ */
+static int open_text_fd(const char *text, size_t len)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == 0) {
+        int cap = fcntl(fds[1], F_GETPIPE_SZ);
+        if (cap > 0 && len <= (size_t)cap) {
+            size_t off = 0;
+            while (off < len) {
+                ssize_t n = write(fds[1], text + off, len - off);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    break;
+                off += (size_t)n;
+            }
+            close(fds[1]);
+            if (off == len)
+                return fds[0];
+            close(fds[0]);
+            return -1;
+        }
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    int fd = memfd_create("vsh-heredoc", MFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = write(fd, text + off, len - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+/* Text a here-document or here-string feeds to the command */
+static const char *redir_text(Shell *shell, const Redirection *r, size_t *len)
+{
+    const char *text = r->target;
+    if (r->expand && shell && strpbrk(text, "$`\\")) {
+        text = r->type == REDIR_HEREDOC
+             ? env_expand_heredoc(shell, text, shell->parse_arena)
+             : env_expand(shell, text, shell->parse_arena);
+    }
+    if (!text)
+        text = "";
+
+    *len = strlen(text);
+    if (r->type == REDIR_HERESTRING) {
+        /* A here-string always ends in a newline */
+        char *line = arena_alloc(shell->parse_arena, *len + 2);
+        if (!line)
+            return NULL;
+        memcpy(line, text, *len);
+        line[(*len)++] = '\n';
+        line[*len] = '\0';
+        text = line;
+    }
+    return text;
+}
+
+/* Parse the target of >& / <&. Returns the fd, -2 for "-", -1 if invalid. */
+static int dup_target(const char *target)
+{
+    if (strcmp(target, "-") == 0)
+        return -2;
+    char *endp;
+    long n = strtol(target, &endp, 10);
+    if (endp == target || *endp != '\0' || n < 0 || n > 1023)
+        return -1;
+    return (int)n;
+}
+
+int executor_apply_redirections(Shell *shell, Redirection *redirs)
 {
     for (Redirection *r = redirs; r; r = r->next) {
         int fd  = r->fd;
@@ -481,50 +1159,115 @@ int executor_apply_redirections(Redirection *redirs)
             break;
 
         case REDIR_DUP_OUT:
-            if (fd < 0) fd = STDOUT_FILENO;
-            if (dup2(atoi(r->target), fd) < 0) {
-                perror("vsh: dup2");
+        case REDIR_DUP_IN:
+            if (fd < 0)
+                fd = r->type == REDIR_DUP_IN ? STDIN_FILENO : STDOUT_FILENO;
+            src = dup_target(r->target);
+            if (src == -2) {
+                close(fd);
+                break;
+            }
+            if (src < 0) {
+                fprintf(stderr, "vsh: %s: ambiguous redirect\n", r->target);
+                return -1;
+            }
+            if (src != fd && dup2(src, fd) < 0) {
+                fprintf(stderr, "vsh: %d: %s\n", src, strerror(errno));
                 return -1;
             }
             break;
 
-        case REDIR_DUP_IN:
+        case REDIR_HEREDOC:
+        case REDIR_HERESTRING: {
             if (fd < 0) fd = STDIN_FILENO;
-            if (dup2(atoi(r->target), fd) < 0) {
+            size_t len = 0;
+            const char *text = redir_text(shell, r, &len);
+            src = text ? open_text_fd(text, len) : -1;
+            if (src < 0) {
+                fprintf(stderr, "vsh: here-document: %s\n", strerror(errno));
+                return -1;
+            }
+            if (dup2(src, fd) < 0) {
                 perror("vsh: dup2");
+                close(src);
                 return -1;
             }
-            break;
-
-        case REDIR_HEREDOC:
-            fprintf(stderr, "vsh: heredoc: not yet implemented\n");
+            close(src);
             break;
         }
+        }
     }
 
     return 0;
 }
 
-/* ---- Placeholder for redirection restore (used in parent after fork) ---- */
+/* ---- In-process redirections (builtins and functions) ------------------- */
 
-void executor_restore_redirections(void)
+/* Default fd a redirection applies to when none was given. */
+static int redir_default_fd(const Redirection *r)
 {
-    /*
-     * In the current architecture redirections are only applied in child
-     * processes (post-fork), so the parent never needs to restore them.
-     * This stub exists for future use when builtins apply redirections
-     * in-process and need to undo them afterwards.
-     */
+    if (r->fd >= 0)
+        return r->fd;
+    return (r->type == REDIR_INPUT || r->type == REDIR_HEREDOC ||
+            r->type == REDIR_HERESTRING || r->type == REDIR_DUP_IN)
+           ? STDIN_FILENO : STDOUT_FILENO;
 }
 
-/* ---- Helper: reset signals to defaults in child process ----------------- */
+int executor_push_redirections(Shell *shell, Redirection *redirs,
+                               RedirSave *save)
+{
+    save->count = 0;
+    if (!redirs)
+        return 0;
+
+    /* Anything buffered so far belongs to the old targets */
+    out_flush(shell->out);
+    fflush(stdout);
+    fflush(stderr);
+
+    for (Redirection *r = redirs; r; r = r->next) {
+        int fd = redir_default_fd(r);
+
+        bool seen = false;
+        for (int i = 0; i < save->count; i++)
+            seen = seen || save->fd[i] == fd;
+        if (seen)
+            continue;
+
+        if (save->count >= REDIR_SAVE_MAX) {
+            fprintf(stderr, "vsh: too many redirections\n");
+            executor_restore_redirections(save);
+            return -1;
+        }
 
-static void child_reset_signals(void)
+        /* Park the current target above the user fd range (-1 if closed) */
+        save->fd[save->count]    = fd;
+        save->saved[save->count] = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+        save->count++;
+    }
+
+    if (executor_apply_redirections(shell, redirs) < 0) {
+        executor_restore_redirections(save);
+        return -1;
+    }
+    return 0;
+}
+
+void executor_restore_redirections(RedirSave *save)
 {
-    signal(SIGINT,  SIG_DFL);
-    signal(SIGQUIT, SIG_DFL);
-    signal(SIGTSTP, SIG_DFL);
-    signal(SIGTTIN, SIG_DFL);
-    signal(SIGTTOU, SIG_DFL);
-    signal(SIGCHLD, SIG_DFL);
+    if (save->count == 0)
+        return;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    for (int i = save->count - 1; i >= 0; i--) {
+        if (save->saved[i] >= 0) {
+            dup2(save->saved[i], save->fd[i]);
+            close(save->saved[i]);
+        } else {
+            close(save->fd[i]);
+        }
+    }
+    save->count = 0;
 }
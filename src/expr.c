@@ -0,0 +1,1198 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * expr.c - Compiled arithmetic expressions
+ *
+ * A recursive-descent compiler emits postfix bytecode directly, folding
+ * operations on constants as it goes, and records the stack depth the
+ * program needs. Evaluation is a switch over the instructions with a
+ * fixed-size stack: no allocation, no re-parsing. The block evaluator runs
+ * the same instructions over up to EXPR_BLOCK values at a time; every
+ * arithmetic instruction becomes one flat loop over the block.
+ *
+ * Programs compiled for shell arithmetic ($((...))) use the same
+ * instructions over long long with C's operators instead: assignments
+ * store into variable slots, and &&, || and ?: compile to jumps.
+ * ============================================================================ */
+
+#include "expr.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ---- Bytecode ----------------------------------------------------------- */
+
+typedef enum ExprOpcode {
+    OP_CONST,       /* push k (n when integer) */
+    OP_VAR,         /* push vars[arg] */
+    OP_NEG,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_POW,
+    OP_FN,          /* top = functions[arg](top) */
+
+    /* Integer programs only */
+    OP_SHL,
+    OP_SHR,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_EQ,
+    OP_NE,
+    OP_BAND,
+    OP_BOR,
+    OP_BXOR,
+    OP_NOT,
+    OP_BNOT,
+    OP_BOOL,        /* top = top != 0 */
+    OP_DUP,
+    OP_POP,
+    OP_STORE,       /* vars[arg] = top, top stays */
+    OP_JZ,          /* pop; jump to arg if it was 0 */
+    OP_JNZ,
+    OP_JMP,
+    OP_AND,         /* && and ||: compiled to jumps, never emitted */
+    OP_OR
+} ExprOpcode;
+
+typedef struct ExprOp {
+    ExprOpcode op;
+    int        arg;
+    union {
+        double    k;
+        long long n;
+    };
+} ExprOp;
+
+struct ExprProgram {
+    ExprOp *ops;
+    int     nops;
+    int     cap;
+    int     max_depth;
+    bool    integer;
+    int     nvars;
+    char   *vars[EXPR_VARS_MAX];
+};
+
+typedef enum FnDomain { DOM_ANY, DOM_NONNEG, DOM_POSITIVE } FnDomain;
+
+typedef struct ExprFunc {
+    const char *name;
+    double    (*fn)(double);
+    FnDomain    domain;
+} ExprFunc;
+
+static const ExprFunc functions[] = {
+    { "sqrt",  sqrt,  DOM_NONNEG   },
+    { "sin",   sin,   DOM_ANY      },
+    { "cos",   cos,   DOM_ANY      },
+    { "tan",   tan,   DOM_ANY      },
+    { "log",   log,   DOM_POSITIVE },
+    { "log10", log10, DOM_POSITIVE },
+    { "abs",   fabs,  DOM_ANY      },
+    { "ceil",  ceil,  DOM_ANY      },
+    { "floor", floor, DOM_ANY      },
+};
+
+#define NFUNCTIONS ((int)(sizeof(functions) / sizeof(functions[0])))
+
+static bool in_domain(const ExprFunc *f, double x)
+{
+    switch (f->domain) {
+    case DOM_NONNEG:   return x >= 0;
+    case DOM_POSITIVE: return x > 0;
+    default:           return true;
+    }
+}
+
+static void domain_error(const ExprFunc *f, char *err, size_t errlen)
+{
+    snprintf(err, errlen, "%s of %s number", f->name,
+             f->domain == DOM_NONNEG ? "negative" : "non-positive");
+}
+
+/* ---- Integer arithmetic ------------------------------------------------- */
+
+/* Overflow wraps, as in other shells, rather than being undefined */
+static long long wrap(unsigned long long v)
+{
+    return (long long)v;
+}
+
+static long long int_unary(ExprOpcode op, long long a)
+{
+    switch (op) {
+    case OP_NEG:  return wrap(-(unsigned long long)a);
+    case OP_NOT:  return !a;
+    case OP_BNOT: return ~a;
+    default:      return a != 0;
+    }
+}
+
+/* a op b into *r; returns an error message instead if there is none */
+static const char *int_binary(ExprOpcode op, long long a, long long b,
+                              long long *r)
+{
+    unsigned long long ua = (unsigned long long)a;
+    unsigned long long ub = (unsigned long long)b;
+
+    switch (op) {
+    case OP_ADD:  *r = wrap(ua + ub);                 break;
+    case OP_SUB:  *r = wrap(ua - ub);                 break;
+    case OP_MUL:  *r = wrap(ua * ub);                 break;
+    case OP_SHL:  *r = wrap(ua << (b & 63));          break;
+    case OP_SHR:  *r = a >> (b & 63);                 break;
+    case OP_LT:   *r = a < b;                         break;
+    case OP_LE:   *r = a <= b;                        break;
+    case OP_GT:   *r = a > b;                         break;
+    case OP_GE:   *r = a >= b;                        break;
+    case OP_EQ:   *r = a == b;                        break;
+    case OP_NE:   *r = a != b;                        break;
+    case OP_BAND: *r = a & b;                         break;
+    case OP_BOR:  *r = a | b;                         break;
+    case OP_BXOR: *r = a ^ b;                         break;
+    case OP_DIV:
+    case OP_MOD:
+        if (b == 0)
+            return "division by zero";
+        if (a == LLONG_MIN && b == -1)
+            *r = op == OP_DIV ? LLONG_MIN : 0;
+        else
+            *r = op == OP_DIV ? a / b : a % b;
+        break;
+    default: {  /* OP_POW */
+        if (b < 0)
+            return "exponent less than 0";
+        unsigned long long acc = 1;
+        while (b) {
+            if (b & 1)
+                acc *= ua;
+            ua *= ua;
+            b >>= 1;
+        }
+        *r = wrap(acc);
+        break;
+    }
+    }
+    return NULL;
+}
+
+/* ---- Compiler ----------------------------------------------------------- */
+
+typedef enum ExprTok {
+    T_NUM,
+    T_PLUS,
+    T_MINUS,
+    T_STAR,
+    T_SLASH,
+    T_PERCENT,
+    T_POWER,        /* ** or ^ */
+    T_LPAREN,
+    T_RPAREN,
+    T_IDENT,        /* function, constant or variable */
+    T_END,
+    T_ERROR,
+
+    /* Integer programs: every binary operator is T_BINOP */
+    T_BINOP,
+    T_ASSIGN,       /* = (OP_STORE) or compound, e.g. += (OP_ADD) */
+    T_BANG,
+    T_TILDE,
+    T_QUEST,
+    T_COLON,
+    T_COMMA,
+    T_INC,
+    T_DEC
+} ExprTok;
+
+typedef struct OpToken {
+    const char *text;
+    ExprTok     tok;
+    ExprOpcode  op;
+} OpToken;
+
+/* Longest first, so that "**" wins over "*" */
+static const OpToken float_ops[] = {
+    { "**", T_POWER,   OP_POW }, { "+", T_PLUS,    OP_ADD },
+    { "-",  T_MINUS,   OP_SUB }, { "*", T_STAR,    OP_MUL },
+    { "/",  T_SLASH,   OP_DIV }, { "%", T_PERCENT, OP_MOD },
+    { "^",  T_POWER,   OP_POW }, { "(", T_LPAREN,  OP_CONST },
+    { ")",  T_RPAREN,  OP_CONST },
+    { NULL, T_ERROR,   OP_CONST }
+};
+
+static const OpToken int_ops[] = {
+    { "<<=", T_ASSIGN, OP_SHL },  { ">>=", T_ASSIGN, OP_SHR },
+    { "**",  T_BINOP,  OP_POW },  { "<<",  T_BINOP,  OP_SHL },
+    { ">>",  T_BINOP,  OP_SHR },  { "<=",  T_BINOP,  OP_LE },
+    { ">=",  T_BINOP,  OP_GE },   { "==",  T_BINOP,  OP_EQ },
+    { "!=",  T_BINOP,  OP_NE },   { "&&",  T_BINOP,  OP_AND },
+    { "||",  T_BINOP,  OP_OR },   { "++",  T_INC,    OP_ADD },
+    { "--",  T_DEC,    OP_SUB },  { "+=",  T_ASSIGN, OP_ADD },
+    { "-=",  T_ASSIGN, OP_SUB },  { "*=",  T_ASSIGN, OP_MUL },
+    { "/=",  T_ASSIGN, OP_DIV },  { "%=",  T_ASSIGN, OP_MOD },
+    { "&=",  T_ASSIGN, OP_BAND }, { "^=",  T_ASSIGN, OP_BXOR },
+    { "|=",  T_ASSIGN, OP_BOR },  { "+",   T_BINOP,  OP_ADD },
+    { "-",   T_BINOP,  OP_SUB },  { "*",   T_BINOP,  OP_MUL },
+    { "/",   T_BINOP,  OP_DIV },  { "%",   T_BINOP,  OP_MOD },
+    { "<",   T_BINOP,  OP_LT },   { ">",   T_BINOP,  OP_GT },
+    { "&",   T_BINOP,  OP_BAND }, { "|",   T_BINOP,  OP_BOR },
+    { "^",   T_BINOP,  OP_BXOR }, { "=",   T_ASSIGN, OP_STORE },
+    { "!",   T_BANG,   OP_NOT },  { "~",   T_TILDE,  OP_BNOT },
+    { "?",   T_QUEST,  OP_CONST },{ ":",   T_COLON,  OP_CONST },
+    { ",",   T_COMMA,  OP_CONST },{ "(",   T_LPAREN, OP_CONST },
+    { ")",   T_RPAREN, OP_CONST },
+    { NULL,  T_ERROR,  OP_CONST }
+};
+
+typedef struct Compiler {
+    const char  *src;
+    int          pos;
+    ExprTok      tok;
+    ExprOpcode   op;            /* Of a T_BINOP or T_ASSIGN */
+    double       num;
+    long long    inum;
+    char         ident[32];
+    ExprProgram *prog;
+    bool         integer;
+    int          depth;
+    int          barrier;       /* First instruction after the last jump
+                                 * target; nothing before it is folded */
+    bool         failed;
+    char        *err;
+    size_t       errlen;
+} Compiler;
+
+static void compile_error(Compiler *c, const char *msg)
+{
+    if (!c->failed) {
+        snprintf(c->err, c->errlen, "%s", msg);
+        c->failed = true;
+    }
+}
+
+static void next_token(Compiler *c)
+{
+    while (c->src[c->pos] == ' ' || c->src[c->pos] == '\t' ||
+           (c->integer && c->src[c->pos] == '\n'))
+        c->pos++;
+
+    char ch = c->src[c->pos];
+    if (ch == '\0') {
+        c->tok = T_END;
+        return;
+    }
+
+    /* Integers: decimal, 0x hex or 0 octal */
+    if (c->integer && isdigit((unsigned char)ch)) {
+        char *end;
+        c->inum = (long long)strtoull(c->src + c->pos, &end, 0);
+        if (isalnum((unsigned char)*end) || *end == '_' || *end == '.') {
+            compile_error(c, "invalid number");
+            c->tok = T_ERROR;
+            return;
+        }
+        c->pos = (int)(end - c->src);
+        c->tok = T_NUM;
+        return;
+    }
+
+    /* Numbers: digits or leading dot */
+    if (!c->integer && (isdigit((unsigned char)ch) ||
+        (ch == '.' && isdigit((unsigned char)c->src[c->pos + 1])))) {
+        char *end;
+        c->num = strtod(c->src + c->pos, &end);
+        c->pos = (int)(end - c->src);
+        c->tok = T_NUM;
+        return;
+    }
+
+    /* Identifiers (functions, constants, variables) */
+    if (isalpha((unsigned char)ch) || ch == '_') {
+        int start = c->pos;
+        while (isalnum((unsigned char)c->src[c->pos]) || c->src[c->pos] == '_')
+            c->pos++;
+        int len = c->pos - start;
+        if (len >= (int)sizeof(c->ident))
+            len = (int)sizeof(c->ident) - 1;
+        memcpy(c->ident, c->src + start, (size_t)len);
+        c->ident[len] = '\0';
+        c->tok = T_IDENT;
+        return;
+    }
+
+    for (const OpToken *t = c->integer ? int_ops : float_ops; t->text; t++) {
+        size_t len = strlen(t->text);
+        if (strncmp(c->src + c->pos, t->text, len) == 0) {
+            c->pos += (int)len;
+            c->tok = t->tok;
+            c->op  = t->op;
+            return;
+        }
+    }
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "unexpected character '%c'", ch);
+    compile_error(c, msg);
+    c->tok = T_ERROR;
+}
+
+static int stack_effect(ExprOpcode op)
+{
+    switch (op) {
+    case OP_CONST: case OP_VAR: case OP_DUP:
+        return 1;
+    case OP_NEG: case OP_FN: case OP_NOT: case OP_BNOT: case OP_BOOL:
+    case OP_STORE: case OP_JMP:
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static ExprOp *emit(Compiler *c, ExprOpcode op, int arg)
+{
+    ExprProgram *p = c->prog;
+    if (c->failed)
+        return NULL;
+
+    if (p->nops == p->cap) {
+        int cap = p->cap ? p->cap * 2 : 16;
+        ExprOp *ops = realloc(p->ops, sizeof(ExprOp) * (size_t)cap);
+        if (!ops) {
+            compile_error(c, "out of memory");
+            return NULL;
+        }
+        p->ops = ops;
+        p->cap = cap;
+    }
+    ExprOp *ins = &p->ops[p->nops++];
+    *ins = (ExprOp){ .op = op, .arg = arg };
+
+    c->depth += stack_effect(op);
+    if (c->depth > p->max_depth)
+        p->max_depth = c->depth;
+    if (c->depth > EXPR_STACK_MAX)
+        compile_error(c, "expression too deeply nested");
+    return ins;
+}
+
+static void emit_const(Compiler *c, double k)
+{
+    ExprOp *ins = emit(c, OP_CONST, 0);
+    if (ins)
+        ins->k = k;
+}
+
+static void emit_int(Compiler *c, long long n)
+{
+    ExprOp *ins = emit(c, OP_CONST, 0);
+    if (ins)
+        ins->n = n;
+}
+
+/* Jump targets: the next instruction to be emitted */
+static int here(Compiler *c)
+{
+    c->barrier = c->prog->nops;
+    return c->prog->nops;
+}
+
+static void patch(Compiler *c, int jump)
+{
+    if (!c->failed)
+        c->prog->ops[jump].arg = here(c);
+}
+
+/* The program's back-th last instruction, if it pushes a constant that
+ * nothing jumps past */
+static ExprOp *last_const(Compiler *c, int back)
+{
+    ExprProgram *p = c->prog;
+    if (p->nops - back < c->barrier || c->failed)
+        return NULL;
+    ExprOp *op = &p->ops[p->nops - back];
+    return op->op == OP_CONST ? op : NULL;
+}
+
+static void emit_unary(Compiler *c, ExprOpcode op, int fn)
+{
+    ExprOp *a = last_const(c, 1);
+    if (a && c->integer) {
+        a->n = int_unary(op, a->n);
+        return;
+    }
+    if (a && op == OP_NEG) {
+        a->k = -a->k;
+        return;
+    }
+    if (a && op == OP_FN && in_domain(&functions[fn], a->k)) {
+        a->k = functions[fn].fn(a->k);
+        return;
+    }
+    emit(c, op, fn);
+}
+
+static void emit_binary(Compiler *c, ExprOpcode op)
+{
+    ExprOp *b = last_const(c, 1);
+    ExprOp *a = b ? last_const(c, 2) : NULL;
+
+    /* Fold, except where evaluation has to report an error */
+    if (a && c->integer) {
+        long long r;
+        if (!int_binary(op, a->n, b->n, &r)) {
+            a->n = r;
+            c->prog->nops--;
+            c->depth--;
+            return;
+        }
+    } else if (a && !((op == OP_DIV || op == OP_MOD) && b->k == 0)) {
+        switch (op) {
+        case OP_ADD: a->k += b->k;            break;
+        case OP_SUB: a->k -= b->k;            break;
+        case OP_MUL: a->k *= b->k;            break;
+        case OP_DIV: a->k /= b->k;            break;
+        case OP_MOD: a->k = fmod(a->k, b->k); break;
+        default:     a->k = pow(a->k, b->k);  break;
+        }
+        c->prog->nops--;
+        c->depth--;
+        return;
+    }
+    emit(c, op, 0);
+}
+
+static int var_slot(Compiler *c, const char *name)
+{
+    ExprProgram *p = c->prog;
+    for (int i = 0; i < p->nvars; i++) {
+        if (strcmp(p->vars[i], name) == 0)
+            return i;
+    }
+    if (p->nvars == EXPR_VARS_MAX) {
+        compile_error(c, "too many variables");
+        return 0;
+    }
+    p->vars[p->nvars] = strdup(name);
+    if (!p->vars[p->nvars]) {
+        compile_error(c, "out of memory");
+        return 0;
+    }
+    return p->nvars++;
+}
+
+static void compile_expr(Compiler *c);
+
+/* primary → NUMBER | '(' expr ')' | FUNC '(' expr ')' | CONST | VAR */
+static void compile_primary(Compiler *c)
+{
+    if (c->failed)
+        return;
+
+    if (c->tok == T_NUM) {
+        emit_const(c, c->num);
+        next_token(c);
+        return;
+    }
+
+    if (c->tok == T_LPAREN) {
+        next_token(c);
+        compile_expr(c);
+        if (c->tok != T_RPAREN) {
+            compile_error(c, "expected closing ')'");
+            return;
+        }
+        next_token(c);
+        return;
+    }
+
+    if (c->tok != T_IDENT) {
+        compile_error(c, "expected number, '(', or function");
+        return;
+    }
+
+    char name[32];
+    memcpy(name, c->ident, sizeof(name));
+    next_token(c);
+
+    if (strcmp(name, "pi") == 0 || strcmp(name, "PI") == 0) {
+        emit_const(c, 3.14159265358979323846);
+        return;
+    }
+    if (strcmp(name, "e") == 0 || strcmp(name, "E") == 0) {
+        /* strtod already took 'e' in scientific notation */
+        emit_const(c, 2.71828182845904523536);
+        return;
+    }
+
+    if (c->tok != T_LPAREN) {
+        emit(c, OP_VAR, var_slot(c, name));
+        return;
+    }
+
+    int fn = 0;
+    while (fn < NFUNCTIONS && strcmp(functions[fn].name, name) != 0)
+        fn++;
+    if (fn == NFUNCTIONS) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "unknown function '%s'", name);
+        compile_error(c, msg);
+        return;
+    }
+
+    next_token(c);
+    compile_expr(c);
+    if (c->tok != T_RPAREN) {
+        compile_error(c, "expected ')' after function argument");
+        return;
+    }
+    next_token(c);
+    emit_unary(c, OP_FN, fn);
+}
+
+/* unary → ['-' | '+'] unary | primary */
+static void compile_unary(Compiler *c)
+{
+    if (c->tok == T_MINUS) {
+        next_token(c);
+        compile_unary(c);
+        emit_unary(c, OP_NEG, 0);
+        return;
+    }
+    if (c->tok == T_PLUS) {
+        next_token(c);
+        compile_unary(c);
+        return;
+    }
+    compile_primary(c);
+}
+
+/* power → unary (('**' | '^') power)?    -- right-associative */
+static void compile_power(Compiler *c)
+{
+    compile_unary(c);
+    if (c->tok == T_POWER) {
+        next_token(c);
+        compile_power(c);
+        emit_binary(c, OP_POW);
+    }
+}
+
+/* term → power (('*' | '/' | '%') power)* */
+static void compile_term(Compiler *c)
+{
+    compile_power(c);
+    while (!c->failed &&
+           (c->tok == T_STAR || c->tok == T_SLASH || c->tok == T_PERCENT)) {
+        ExprOpcode op = c->op;
+        next_token(c);
+        compile_power(c);
+        emit_binary(c, op);
+    }
+}
+
+/* expr → term (('+' | '-') term)* */
+static void compile_expr(Compiler *c)
+{
+    compile_term(c);
+    while (!c->failed && (c->tok == T_PLUS || c->tok == T_MINUS)) {
+        ExprOpcode op = c->op;
+        next_token(c);
+        compile_term(c);
+        emit_binary(c, op);
+    }
+}
+
+/* ---- Integer grammar ---------------------------------------------------- */
+
+/*
+ * The C operators, lowest precedence first:
+ *   ,   = op=   ?:   ||   &&   |   ^   &   == !=   < <= > >=   << >>
+ *   + -   * / %   **   unary - + ! ~ ++ --   postfix ++ --
+ * Like calc, unary minus binds tighter than **.
+ */
+
+#define LEVEL_TOP 10
+
+static int binary_level(ExprOpcode op)
+{
+    switch (op) {
+    case OP_OR:   return 1;
+    case OP_AND:  return 2;
+    case OP_BOR:  return 3;
+    case OP_BXOR: return 4;
+    case OP_BAND: return 5;
+    case OP_EQ: case OP_NE: return 6;
+    case OP_LT: case OP_LE: case OP_GT: case OP_GE: return 7;
+    case OP_SHL: case OP_SHR: return 8;
+    case OP_ADD: case OP_SUB: return 9;
+    case OP_MUL: case OP_DIV: case OP_MOD: return LEVEL_TOP;
+    default:      return 0;
+    }
+}
+
+static void compile_i_comma(Compiler *c);
+static void compile_i_assign(Compiler *c);
+static void compile_i_unary(Compiler *c);
+
+/* Load, add one (or subtract), store; the new value stays on the stack */
+static void emit_step(Compiler *c, int slot, ExprOpcode op)
+{
+    emit(c, OP_VAR, slot);
+    emit_int(c, 1);
+    emit(c, op, 0);
+    emit(c, OP_STORE, slot);
+}
+
+static void compile_i_primary(Compiler *c)
+{
+    if (c->failed)
+        return;
+
+    if (c->tok == T_NUM) {
+        emit_int(c, c->inum);
+        next_token(c);
+        return;
+    }
+
+    if (c->tok == T_LPAREN) {
+        next_token(c);
+        compile_i_comma(c);
+        if (c->tok != T_RPAREN) {
+            compile_error(c, "expected closing ')'");
+            return;
+        }
+        next_token(c);
+        return;
+    }
+
+    if (c->tok != T_IDENT) {
+        compile_error(c, "expected number, variable or '('");
+        return;
+    }
+
+    int slot = var_slot(c, c->ident);
+    next_token(c);
+    if (c->tok == T_INC || c->tok == T_DEC) {
+        /* x++ is the old value: keep a copy under the stored one */
+        ExprOpcode op = c->op;
+        emit(c, OP_VAR, slot);
+        emit(c, OP_DUP, 0);
+        emit_int(c, 1);
+        emit(c, op, 0);
+        emit(c, OP_STORE, slot);
+        emit(c, OP_POP, 0);
+        next_token(c);
+        return;
+    }
+    emit(c, OP_VAR, slot);
+}
+
+/* power → unary ('**' power)? */
+static void compile_i_power(Compiler *c)
+{
+    compile_i_unary(c);
+    if (c->tok == T_BINOP && c->op == OP_POW) {
+        next_token(c);
+        compile_i_power(c);
+        emit_binary(c, OP_POW);
+    }
+}
+
+static void compile_i_unary(Compiler *c)
+{
+    ExprOpcode op;
+
+    switch (c->tok) {
+    case T_BINOP:
+        if (c->op != OP_ADD && c->op != OP_SUB)
+            break;
+        op = c->op;
+        next_token(c);
+        compile_i_unary(c);
+        if (op == OP_SUB)
+            emit_unary(c, OP_NEG, 0);
+        return;
+    case T_BANG:
+    case T_TILDE:
+        op = c->op;
+        next_token(c);
+        compile_i_unary(c);
+        emit_unary(c, op, 0);
+        return;
+    case T_INC:
+    case T_DEC:
+        op = c->op;
+        next_token(c);
+        if (c->tok != T_IDENT) {
+            compile_error(c, "++ or -- needs a variable");
+            return;
+        }
+        emit_step(c, var_slot(c, c->ident), op);
+        next_token(c);
+        return;
+    default:
+        break;
+    }
+    compile_i_primary(c);
+}
+
+/* One precedence level of binary operators, left-associative */
+static void compile_i_binary(Compiler *c, int level)
+{
+    if (level > LEVEL_TOP) {
+        compile_i_power(c);
+        return;
+    }
+
+    compile_i_binary(c, level + 1);
+    while (!c->failed && c->tok == T_BINOP && binary_level(c->op) == level) {
+        ExprOpcode op = c->op;
+        next_token(c);
+        if (op != OP_AND && op != OP_OR) {
+            compile_i_binary(c, level + 1);
+            emit_binary(c, op);
+            continue;
+        }
+
+        /* a && b:  a JZ F; b BOOL JMP E; F: 0; E:   (|| mirrors it) */
+        ExprOp *j = emit(c, op == OP_AND ? OP_JZ : OP_JNZ, 0);
+        int skip = j ? c->prog->nops - 1 : 0;
+        compile_i_binary(c, level + 1);
+        emit(c, OP_BOOL, 0);
+        ExprOp *e = emit(c, OP_JMP, 0);
+        int end = e ? c->prog->nops - 1 : 0;
+        patch(c, skip);
+        c->depth--;
+        emit_int(c, op == OP_OR);
+        patch(c, end);
+    }
+}
+
+/* ternary → binary ('?' expr ':' ternary)? */
+static void compile_i_ternary(Compiler *c)
+{
+    compile_i_binary(c, 1);
+    if (c->failed || c->tok != T_QUEST)
+        return;
+
+    next_token(c);
+    ExprOp *j = emit(c, OP_JZ, 0);
+    int other = j ? c->prog->nops - 1 : 0;
+    compile_i_comma(c);
+    if (c->tok != T_COLON) {
+        compile_error(c, "expected ':' in conditional");
+        return;
+    }
+    next_token(c);
+    ExprOp *e = emit(c, OP_JMP, 0);
+    int end = e ? c->prog->nops - 1 : 0;
+    patch(c, other);
+    c->depth--;
+    compile_i_ternary(c);
+    patch(c, end);
+}
+
+/* assign → ternary | VAR ('=' | op=) assign */
+static void compile_i_assign(Compiler *c)
+{
+    int start = c->prog->nops;
+    compile_i_ternary(c);
+    if (c->failed || c->tok != T_ASSIGN)
+        return;
+
+    ExprProgram *p = c->prog;
+    if (p->nops != start + 1 || p->ops[start].op != OP_VAR) {
+        compile_error(c, "assignment to a non-variable");
+        return;
+    }
+
+    int slot = p->ops[start].arg;
+    ExprOpcode op = c->op;
+    if (op == OP_STORE) {
+        p->nops--;              /* The old value is not needed */
+        c->depth--;
+    }
+    next_token(c);
+    compile_i_assign(c);
+    if (op != OP_STORE)
+        emit_binary(c, op);
+    emit(c, OP_STORE, slot);
+}
+
+/* expr → assign (',' assign)* */
+static void compile_i_comma(Compiler *c)
+{
+    compile_i_assign(c);
+    while (!c->failed && c->tok == T_COMMA) {
+        emit(c, OP_POP, 0);
+        next_token(c);
+        compile_i_assign(c);
+    }
+}
+
+static void program_free(ExprProgram *p)
+{
+    if (!p)
+        return;
+    for (int i = 0; i < p->nvars; i++)
+        free(p->vars[i]);
+    free(p->ops);
+    free(p);
+}
+
+static ExprProgram *compile(const char *src, bool integer,
+                            char *err, size_t errlen)
+{
+    ExprProgram *prog = calloc(1, sizeof(ExprProgram));
+    if (!prog) {
+        snprintf(err, errlen, "out of memory");
+        return NULL;
+    }
+    prog->integer = integer;
+
+    Compiler c = { .src = src, .prog = prog, .integer = integer,
+                   .err = err, .errlen = errlen };
+    next_token(&c);
+    if (!integer) {
+        compile_expr(&c);
+    } else if (c.tok == T_END) {
+        emit_int(&c, 0);                /* $(( )) is 0 */
+    } else {
+        compile_i_comma(&c);
+    }
+    if (!c.failed && c.tok != T_END) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "unexpected token at position %d", c.pos);
+        compile_error(&c, msg);
+    }
+    if (c.failed) {
+        program_free(prog);
+        return NULL;
+    }
+    return prog;
+}
+
+/* ---- Cache -------------------------------------------------------------- */
+
+/* Two-way set associative: a loop alternating between two expressions
+ * that hash to the same set still hits. */
+#define EXPR_CACHE_SETS 32
+
+typedef struct ExprCacheEntry {
+    char          *src;
+    unsigned int   hash;
+    unsigned long  used;
+    ExprProgram   *prog;
+} ExprCacheEntry;
+
+struct ExprCache {
+    ExprCacheEntry entries[EXPR_CACHE_SETS][2];
+    unsigned long  clock;
+};
+
+static unsigned int expr_hash(const char *s)
+{
+    unsigned int h = 2166136261u;   /* FNV-1a */
+    for (; *s; s++)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+ExprCache *expr_cache_create(void)
+{
+    return calloc(1, sizeof(ExprCache));
+}
+
+void expr_cache_destroy(ExprCache *cache)
+{
+    if (!cache)
+        return;
+    for (int s = 0; s < EXPR_CACHE_SETS; s++) {
+        for (int w = 0; w < 2; w++) {
+            free(cache->entries[s][w].src);
+            program_free(cache->entries[s][w].prog);
+        }
+    }
+    free(cache);
+}
+
+static const ExprProgram *cached_compile(ExprCache *cache, const char *src,
+                                         bool integer, char *err,
+                                         size_t errlen)
+{
+    /* The cache owns every program; without one there is no owner */
+    if (!cache) {
+        snprintf(err, errlen, "out of memory");
+        return NULL;
+    }
+
+    unsigned int h = expr_hash(src);
+    ExprCacheEntry *set = cache->entries[h % EXPR_CACHE_SETS];
+    cache->clock++;
+
+    for (int w = 0; w < 2; w++) {
+        if (set[w].prog && set[w].hash == h &&
+            set[w].prog->integer == integer && strcmp(set[w].src, src) == 0) {
+            set[w].used = cache->clock;
+            return set[w].prog;
+        }
+    }
+
+    ExprProgram *prog = compile(src, integer, err, errlen);
+    if (!prog)
+        return NULL;
+
+    char *copy = strdup(src);
+    if (!copy) {
+        program_free(prog);
+        snprintf(err, errlen, "out of memory");
+        return NULL;
+    }
+
+    ExprCacheEntry *victim = set[0].used <= set[1].used ? &set[0] : &set[1];
+    free(victim->src);
+    program_free(victim->prog);
+    victim->src  = copy;
+    victim->hash = h;
+    victim->used = cache->clock;
+    victim->prog = prog;
+    return prog;
+}
+
+const ExprProgram *expr_compile(ExprCache *cache, const char *src,
+                                char *err, size_t errlen)
+{
+    return cached_compile(cache, src, false, err, errlen);
+}
+
+const ExprProgram *expr_compile_int(ExprCache *cache, const char *src,
+                                    char *err, size_t errlen)
+{
+    return cached_compile(cache, src, true, err, errlen);
+}
+
+int expr_nvars(const ExprProgram *prog)
+{
+    return prog->nvars;
+}
+
+const char *expr_var_name(const ExprProgram *prog, int slot)
+{
+    return prog->vars[slot];
+}
+
+/* ---- Scalar evaluation -------------------------------------------------- */
+
+int expr_eval(const ExprProgram *prog, const double *vars, double *result,
+              char *err, size_t errlen)
+{
+    double st[EXPR_STACK_MAX];
+    int sp = 0;
+
+    for (int i = 0; i < prog->nops; i++) {
+        const ExprOp *op = &prog->ops[i];
+        switch (op->op) {
+        case OP_CONST: st[sp++] = op->k;          break;
+        case OP_VAR:   st[sp++] = vars[op->arg];  break;
+        case OP_NEG:   st[sp - 1] = -st[sp - 1];  break;
+        case OP_ADD:   sp--; st[sp - 1] += st[sp]; break;
+        case OP_SUB:   sp--; st[sp - 1] -= st[sp]; break;
+        case OP_MUL:   sp--; st[sp - 1] *= st[sp]; break;
+        case OP_DIV:
+            sp--;
+            if (st[sp] == 0) {
+                snprintf(err, errlen, "division by zero");
+                return -1;
+            }
+            st[sp - 1] /= st[sp];
+            break;
+        case OP_MOD:
+            sp--;
+            if (st[sp] == 0) {
+                snprintf(err, errlen, "modulo by zero");
+                return -1;
+            }
+            st[sp - 1] = fmod(st[sp - 1], st[sp]);
+            break;
+        case OP_POW:
+            sp--;
+            st[sp - 1] = pow(st[sp - 1], st[sp]);
+            break;
+        case OP_FN: {
+            const ExprFunc *f = &functions[op->arg];
+            if (!in_domain(f, st[sp - 1])) {
+                domain_error(f, err, errlen);
+                return -1;
+            }
+            st[sp - 1] = f->fn(st[sp - 1]);
+            break;
+        }
+        default:
+            break;              /* Integer programs only */
+        }
+    }
+
+    *result = st[0];
+    return 0;
+}
+
+/* ---- Integer evaluation ------------------------------------------------- */
+
+int expr_eval_int(const ExprProgram *prog, long long *vars,
+                  unsigned int *assigned, long long *result,
+                  char *err, size_t errlen)
+{
+    long long st[EXPR_STACK_MAX];
+    int sp = 0;
+
+    for (int pc = 0; pc < prog->nops; pc++) {
+        const ExprOp *op = &prog->ops[pc];
+        switch (op->op) {
+        case OP_CONST: st[sp++] = op->n;            break;
+        case OP_VAR:   st[sp++] = vars[op->arg];    break;
+        case OP_DUP:   st[sp] = st[sp - 1]; sp++;   break;
+        case OP_POP:   sp--;                        break;
+        case OP_STORE:
+            vars[op->arg] = st[sp - 1];
+            *assigned |= 1u << op->arg;
+            break;
+        case OP_JZ:
+            if (st[--sp] == 0)
+                pc = op->arg - 1;
+            break;
+        case OP_JNZ:
+            if (st[--sp] != 0)
+                pc = op->arg - 1;
+            break;
+        case OP_JMP:
+            pc = op->arg - 1;
+            break;
+        case OP_NEG: case OP_NOT: case OP_BNOT: case OP_BOOL:
+            st[sp - 1] = int_unary(op->op, st[sp - 1]);
+            break;
+        default: {
+            sp--;
+            const char *msg = int_binary(op->op, st[sp - 1], st[sp],
+                                         &st[sp - 1]);
+            if (msg) {
+                snprintf(err, errlen, "%s", msg);
+                return -1;
+            }
+            break;
+        }
+        }
+    }
+
+    *result = st[0];
+    return 0;
+}
+
+/* ---- Block evaluation --------------------------------------------------- */
+
+/* Each stack entry is a whole block. Variables are pushed by pointing at
+ * the caller's column; results land in the row for their stack depth. */
+static double block_rows[EXPR_STACK_MAX][EXPR_BLOCK];
+
+int expr_eval_block(const ExprProgram *prog, const double *const *cols,
+                    size_t n, double *out, char *err, size_t errlen)
+{
+    const double *v[EXPR_STACK_MAX];
+
+    for (size_t base = 0; base < n; base += EXPR_BLOCK) {
+        size_t m = n - base < EXPR_BLOCK ? n - base : EXPR_BLOCK;
+        int sp = 0;
+
+        for (int i = 0; i < prog->nops; i++) {
+            const ExprOp *op = &prog->ops[i];
+            double *r;
+            const double *a, *b;
+            int bad = 0;
+
+            switch (op->op) {
+            case OP_CONST:
+                r = block_rows[sp];
+                for (size_t j = 0; j < m; j++)
+                    r[j] = op->k;
+                v[sp++] = r;
+                continue;
+            case OP_VAR:
+                v[sp++] = cols[op->arg] + base;
+                continue;
+            case OP_NEG:
+                r = block_rows[sp - 1];
+                a = v[sp - 1];
+                for (size_t j = 0; j < m; j++)
+                    r[j] = -a[j];
+                v[sp - 1] = r;
+                continue;
+            case OP_FN: {
+                const ExprFunc *f = &functions[op->arg];
+                r = block_rows[sp - 1];
+                a = v[sp - 1];
+                for (size_t j = 0; j < m; j++)
+                    bad |= !in_domain(f, a[j]);
+                if (bad) {
+                    domain_error(f, err, errlen);
+                    return -1;
+                }
+                for (size_t j = 0; j < m; j++)
+                    r[j] = f->fn(a[j]);
+                v[sp - 1] = r;
+                continue;
+            }
+            default:
+                break;
+            }
+
+            /* Binary: a op b into the row of a */
+            sp--;
+            r = block_rows[sp - 1];
+            a = v[sp - 1];
+            b = v[sp];
+            switch (op->op) {
+            case OP_ADD:
+                for (size_t j = 0; j < m; j++) r[j] = a[j] + b[j];
+                break;
+            case OP_SUB:
+                for (size_t j = 0; j < m; j++) r[j] = a[j] - b[j];
+                break;
+            case OP_MUL:
+                for (size_t j = 0; j < m; j++) r[j] = a[j] * b[j];
+                break;
+            case OP_DIV:
+                for (size_t j = 0; j < m; j++) bad |= b[j] == 0;
+                if (bad) {
+                    snprintf(err, errlen, "division by zero");
+                    return -1;
+                }
+                for (size_t j = 0; j < m; j++) r[j] = a[j] / b[j];
+                break;
+            case OP_MOD:
+                for (size_t j = 0; j < m; j++) bad |= b[j] == 0;
+                if (bad) {
+                    snprintf(err, errlen, "modulo by zero");
+                    return -1;
+                }
+                for (size_t j = 0; j < m; j++) r[j] = fmod(a[j], b[j]);
+                break;
+            default:
+                for (size_t j = 0; j < m; j++) r[j] = pow(a[j], b[j]);
+                break;
+            }
+            v[sp - 1] = r;
+        }
+
+        memcpy(out + base, v[0], sizeof(double) * m);
+    }
+    return 0;
+}
@@ -0,0 +1,250 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * fdcopy.c - Moving bytes between file descriptors inside the kernel
+ *
+ * Every kernel path is tried in large steps and abandoned for the next
+ * one on the errors that mean "not for this pair of files"; real errors
+ * (EPIPE, ENOSPC, EIO) end the copy. A first step that reports end of
+ * file is confirmed with read(): copy_file_range and sendfile return 0
+ * for /proc and /sys files, whose size is 0 although they have content.
+ * ============================================================================ */
+
+#include "fdcopy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+/* Bytes asked of one kernel call; each returns what it managed */
+#define FDCOPY_STEP ((size_t)1 << 30)
+
+/* ---- Helpers ------------------------------------------------------------ */
+
+typedef enum FdKind { KIND_FILE, KIND_PIPE, KIND_SOCKET, KIND_OTHER } FdKind;
+
+static FdKind fd_kind(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        return KIND_OTHER;
+    if (S_ISREG(st.st_mode))  return KIND_FILE;
+    if (S_ISFIFO(st.st_mode)) return KIND_PIPE;
+    if (S_ISSOCK(st.st_mode)) return KIND_SOCKET;
+    return KIND_OTHER;
+}
+
+/* The pair cannot be copied this way; another method may work */
+static bool unsupported(int err)
+{
+    return err == EINVAL || err == EXDEV || err == ENOSYS ||
+           err == EOPNOTSUPP || err == ENOTSUP || err == EBADF ||
+           err == ETXTBSY || err == EPERM;
+}
+
+static bool write_all(int fd, const char *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+/* One read from in, at *off (advanced) or at its position */
+static ssize_t read_some(int in, off_t *off, char *buf, size_t n)
+{
+    ssize_t r;
+    do {
+        r = off ? pread(in, buf, n, *off) : read(in, buf, n);
+    } while (r < 0 && errno == EINTR);
+    if (r > 0 && off)
+        *off += r;
+    return r;
+}
+
+/* The read/write loop; limit bounds the bytes copied (SIZE_MAX: to EOF) */
+static long long buffer_copy(int in, off_t *off, int out, size_t limit)
+{
+    char *buf = malloc(FDCOPY_BUFFER_SIZE);
+    if (!buf)
+        return -1;
+
+    long long total = 0;
+    while ((size_t)total < limit) {
+        size_t want = limit - (size_t)total;
+        ssize_t r = read_some(in, off, buf,
+                              want < FDCOPY_BUFFER_SIZE ? want : FDCOPY_BUFFER_SIZE);
+        if (r == 0)
+            break;
+        if (r < 0 || !write_all(out, buf, (size_t)r)) {
+            total = -1;
+            break;
+        }
+        total += r;
+    }
+    free(buf);
+    return total;
+}
+
+/* One kernel step of method m; off is only used for a regular-file input */
+static ssize_t kernel_step(FdCopyMethod m, int in, off_t *off, int out,
+                           size_t len)
+{
+    switch (m) {
+    case FDCOPY_RANGE:    return copy_file_range(in, off, out, NULL, len, 0);
+    case FDCOPY_SPLICE:   return splice(in, off, out, NULL, len, SPLICE_F_MOVE);
+    case FDCOPY_SENDFILE: return sendfile(out, in, off, len);
+    default:              errno = EINVAL; return -1;
+    }
+}
+
+/* Copy at most limit bytes, starting with method m */
+static long long copy_with(FdCopyMethod m, int in, off_t *off, int out,
+                           size_t limit)
+{
+    long long total = 0;
+    while (m != FDCOPY_BUFFER && (size_t)total < limit) {
+        size_t want = limit - (size_t)total;
+        ssize_t n = kernel_step(m, in, off, out,
+                                want < FDCOPY_STEP ? want : FDCOPY_STEP);
+        if (n > 0) {
+            total += n;
+            continue;
+        }
+        if (n == 0 && total > 0)
+            return total;
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && !unsupported(errno))
+            return -1;
+        /* Refused, or an "empty" first step that read() has to confirm */
+        m = m == FDCOPY_RANGE ? FDCOPY_SENDFILE : FDCOPY_BUFFER;
+    }
+    if ((size_t)total >= limit)
+        return total;
+
+    long long rest = buffer_copy(in, off, out, limit - (size_t)total);
+    return rest < 0 ? -1 : total + rest;
+}
+
+/* ---- tee(2) between two outputs ----------------------------------------- */
+
+/* Duplicate a pipe into two outputs: tee() copies the pipe's contents
+ * into the first output (through a scratch pipe unless it is a pipe
+ * itself), then the same bytes are spliced out of in into the second. */
+static long long tee_pair(int in, int out0, int out1)
+{
+    int scratch[2] = { -1, -1 };
+    bool direct = fd_kind(out0) == KIND_PIPE;
+    if (!direct && pipe2(scratch, O_CLOEXEC) < 0)
+        return -2;
+
+    long long total = 0;
+    for (;;) {
+        ssize_t m = tee(in, direct ? out0 : scratch[1], FDCOPY_STEP, 0);
+        if (m < 0 && errno == EINTR)
+            continue;
+        if (m <= 0) {
+            /* Nothing was moved yet: the caller can still copy another way */
+            if (m < 0)
+                total = total == 0 && unsupported(errno) ? -2 : -1;
+            break;
+        }
+        if ((!direct && copy_with(FDCOPY_SPLICE, scratch[0], NULL, out0,
+                                  (size_t)m) != m) ||
+            copy_with(FDCOPY_SPLICE, in, NULL, out1, (size_t)m) != m) {
+            total = -1;
+            break;
+        }
+        total += m;
+    }
+
+    if (!direct) {
+        int err = errno;
+        close(scratch[0]);
+        close(scratch[1]);
+        errno = err;
+    }
+    return total;
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+FdCopyMethod fd_copy_method(int in, int out)
+{
+    FdKind ik = fd_kind(in), ok = fd_kind(out);
+    if (ik == KIND_FILE && ok == KIND_FILE)
+        return FDCOPY_RANGE;
+    if (ik == KIND_PIPE || ok == KIND_PIPE)
+        return FDCOPY_SPLICE;
+    if (ik == KIND_FILE)
+        return FDCOPY_SENDFILE;
+    return FDCOPY_BUFFER;
+}
+
+long long fd_copy(int in, int out)
+{
+    return copy_with(fd_copy_method(in, out), in, NULL, out, SIZE_MAX);
+}
+
+long long fd_tee(int in, const int *outs, int nout)
+{
+    if (nout == 1)
+        return fd_copy(in, outs[0]);
+
+    FdKind kind = fd_kind(in);
+
+    /* A file is copied to each output from the same starting offset */
+    off_t start = kind == KIND_FILE ? lseek(in, 0, SEEK_CUR) : -1;
+    if (start >= 0) {
+        long long total = 0;
+        for (int i = 0; i < nout; i++) {
+            off_t off = start;
+            long long n = copy_with(fd_copy_method(in, outs[i]), in, &off,
+                                    outs[i], SIZE_MAX);
+            if (n < 0)
+                return -1;
+            if (n > total)
+                total = n;
+        }
+        lseek(in, start + total, SEEK_SET);
+        return total;
+    }
+
+    if (kind == KIND_PIPE && nout == 2) {
+        long long n = tee_pair(in, outs[0], outs[1]);
+        if (n != -2)
+            return n;
+    }
+
+    /* Anything else goes through one buffer, written to every output */
+    char *buf = malloc(FDCOPY_BUFFER_SIZE);
+    if (!buf)
+        return -1;
+    long long total = 0;
+    for (;;) {
+        ssize_t r = read_some(in, NULL, buf, FDCOPY_BUFFER_SIZE);
+        if (r == 0)
+            break;
+        bool ok = r > 0;
+        for (int i = 0; ok && i < nout; i++)
+            ok = write_all(outs[i], buf, (size_t)r);
+        if (!ok) {
+            total = -1;
+            break;
+        }
+        total += r;
+    }
+    free(buf);
+    return total;
+}
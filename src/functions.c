@@ -0,0 +1,169 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * functions.c - Shell function table and in-process invocation
+ *
+ * Hash table (djb2 + separate chaining) mapping names to function bodies.
+ * Each entry owns a small arena holding a deep copy of the body AST, so a
+ * definition survives the reset of the parse arena that produced it and
+ * is released in one shot on redefinition or unset. Entries that are
+ * replaced while one of their calls is still running are unlinked at once
+ * but freed only when the last call returns.
+ * ============================================================================ */
+
+#include "functions.h"
+#include "executor.h"
+#include "shell.h"
+#include "arena.h"
+#include "env.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ---- Internal helpers --------------------------------------------------- */
+
+static unsigned int func_hash(const char *s)
+{
+    unsigned long hash = 5381;
+    while (*s)
+        hash = hash * 33 + (unsigned char)*s++;
+    return (unsigned int)(hash % FUNC_HASH_SIZE);
+}
+
+static void entry_free(FuncEntry *e)
+{
+    arena_destroy(e->arena);
+    free(e);
+}
+
+/* Unlink e from its bucket; free it now unless a call is still running it */
+static void entry_retire(FuncTable *table, FuncEntry **link)
+{
+    FuncEntry *e = *link;
+    *link = e->next;
+    table->count--;
+
+    if (e->active > 0)
+        e->removed = true;
+    else
+        entry_free(e);
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+FuncTable *func_table_create(void)
+{
+    return calloc(1, sizeof(FuncTable));
+}
+
+void func_table_destroy(FuncTable *table)
+{
+    if (!table)
+        return;
+
+    for (int i = 0; i < FUNC_HASH_SIZE; i++) {
+        FuncEntry *e = table->buckets[i];
+        while (e) {
+            FuncEntry *next = e->next;
+            entry_free(e);
+            e = next;
+        }
+    }
+    free(table);
+}
+
+bool func_define(FuncTable *table, const char *name, const ASTNode *body)
+{
+    if (!table || !name)
+        return false;
+
+    FuncEntry *e = calloc(1, sizeof(FuncEntry));
+    if (!e)
+        return false;
+
+    e->arena = arena_create_sized(1024);
+    if (!e->arena) {
+        free(e);
+        return false;
+    }
+    e->name = arena_strdup(e->arena, name);
+    e->body = ast_clone(e->arena, body);
+
+    /* Replace any previous definition (name may live in its arena) */
+    func_remove(table, e->name);
+
+    unsigned int h = func_hash(e->name);
+    e->next = table->buckets[h];
+    table->buckets[h] = e;
+    table->count++;
+    return true;
+}
+
+FuncEntry *func_lookup(FuncTable *table, const char *name)
+{
+    if (!table || !name || table->count == 0)
+        return NULL;
+
+    for (FuncEntry *e = table->buckets[func_hash(name)]; e; e = e->next) {
+        if (strcmp(e->name, name) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+bool func_remove(FuncTable *table, const char *name)
+{
+    if (!table || !name)
+        return false;
+
+    FuncEntry **link = &table->buckets[func_hash(name)];
+    while (*link) {
+        if (strcmp((*link)->name, name) == 0) {
+            entry_retire(table, link);
+            return true;
+        }
+        link = &(*link)->next;
+    }
+    return false;
+}
+
+int func_call(Shell *shell, FuncEntry *fn, int argc, char **argv)
+{
+    if (shell->func_depth >= FUNC_MAX_DEPTH) {
+        fprintf(stderr, "vsh: %s: maximum function nesting level (%d) exceeded\n",
+                fn->name, FUNC_MAX_DEPTH);
+        return 1;
+    }
+
+    /* Bind $1..$N (and $#) to the call's arguments */
+    char **saved_params = shell->pos_params;
+    int    saved_count  = shell->pos_count;
+    bool   saved_in_fn  = shell->in_function;
+
+    shell->pos_params  = argv + 1;
+    shell->pos_count   = argc - 1;
+    shell->in_function = true;
+    shell->func_depth++;
+    fn->active++;
+    bool scoped = env_push_scope(shell->env);
+
+    int status = executor_execute(shell, fn->body);
+    if (shell->returning) {
+        status = shell->last_status;
+        shell->returning = false;
+    }
+
+    if (scoped)
+        env_pop_scope(shell->env);
+
+    fn->active--;
+    shell->func_depth--;
+    shell->pos_params  = saved_params;
+    shell->pos_count   = saved_count;
+    shell->in_function = saved_in_fn;
+
+    if (fn->removed && fn->active == 0)
+        entry_free(fn);
+
+    return status;
+}
@@ -0,0 +1,461 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * git_status.c - Cached git branch and asynchronous status for the prompt
+ *
+ * Locating the repository walks up from the working directory once; after
+ * that a prompt in the same directory costs one stat() of HEAD (or of the
+ * directory itself when it is not in a repo). A checkout rewrites HEAD, so
+ * its mtime is enough to notice a branch change.
+ *
+ * Detail comes from `git --no-optional-locks status --porcelain=v2
+ * --branch --untracked-files=no`, spawned into its own process group with
+ * stdin/stderr on /dev/null. It is stamped with the HEAD and index mtimes
+ * it was started for, and a new worker only runs when those have moved.
+ * --no-optional-locks keeps git from rewriting the index, which would
+ * otherwise retrigger the worker forever. The worker is not waited for:
+ * job_reap() collects it, and the output is parsed as it streams in.
+ * ============================================================================ */
+
+#include "git_status.h"
+#include "shell.h"
+#include "env.h"
+#include "path_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+struct GitStatus {
+    char           *cwd;            /* Directory the state below is for */
+    struct timespec cwd_mtime;      /* Revalidates "not in a repo" */
+    char           *git_dir;        /* NULL outside a repo */
+    char           *head_path;
+    char           *index_path;
+    struct timespec head_mtime;
+    char            branch[256];
+    GitInfo         info;
+
+    /* HEAD and index mtimes the stored (or pending) detail belongs to */
+    struct timespec detail_head;
+    struct timespec detail_index;
+    bool            detail_stamped;
+
+    char           *slow_dir;       /* git_dir whose worker timed out */
+
+    /* Running worker */
+    pid_t           worker;
+    int             fd;
+    char           *worker_dir;
+    struct timespec started;
+    bool            line_start;
+    bool            in_header;
+    char            header[128];
+    size_t          header_len;
+    bool            w_seen_oid;
+    bool            w_dirty;
+    int             w_ahead;
+    int             w_behind;
+};
+
+/* ---- Internal helpers --------------------------------------------------- */
+
+static bool ts_equal(struct timespec a, struct timespec b)
+{
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+static long elapsed_ms(struct timespec since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)(now.tv_sec - since.tv_sec) * 1000 +
+           (now.tv_nsec - since.tv_nsec) / 1000000;
+}
+
+static char *join_path(const char *dir, const char *name)
+{
+    size_t dlen = strlen(dir), nlen = strlen(name);
+    bool slash = dlen > 0 && dir[dlen - 1] == '/';
+    char *p = malloc(dlen + nlen + 2);
+    if (!p)
+        return NULL;
+    memcpy(p, dir, dlen);
+    if (!slash)
+        p[dlen++] = '/';
+    memcpy(p + dlen, name, nlen + 1);
+    return p;
+}
+
+/* Read up to cap-1 bytes of a small file, trimming the trailing newline */
+static bool read_small(const char *path, char *buf, size_t cap)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    ssize_t n;
+    do {
+        n = read(fd, buf, cap - 1);
+    } while (n < 0 && errno == EINTR);
+    close(fd);
+    if (n <= 0)
+        return false;
+    buf[n] = '\0';
+    buf[strcspn(buf, "\r\n")] = '\0';
+    return true;
+}
+
+static void stop_worker(GitStatus *gs, bool kill_it)
+{
+    if (gs->worker <= 0)
+        return;
+    if (kill_it)
+        kill(gs->worker, SIGKILL);
+    close(gs->fd);
+    /* If it has not exited yet, job_reap() collects it later */
+    waitpid(gs->worker, NULL, WNOHANG);
+    gs->worker = 0;
+    gs->fd     = -1;
+    free(gs->worker_dir);
+    gs->worker_dir = NULL;
+}
+
+static void forget_repo(GitStatus *gs)
+{
+    free(gs->git_dir);
+    free(gs->head_path);
+    free(gs->index_path);
+    gs->git_dir    = NULL;
+    gs->head_path  = NULL;
+    gs->index_path = NULL;
+    gs->branch[0]  = '\0';
+    gs->detail_stamped = false;
+    memset(&gs->info, 0, sizeof(gs->info));
+}
+
+/* Parse HEAD into gs->branch: the branch name, or a short commit */
+static void read_branch(GitStatus *gs)
+{
+    char buf[256];
+    struct stat st;
+
+    gs->branch[0] = '\0';
+    if (stat(gs->head_path, &st) == 0)
+        gs->head_mtime = st.st_mtim;
+    if (!read_small(gs->head_path, buf, sizeof(buf)))
+        return;
+
+    static const char prefix[] = "ref: refs/heads/";
+    if (strncmp(buf, prefix, sizeof(prefix) - 1) == 0) {
+        snprintf(gs->branch, sizeof(gs->branch), "%s", buf + sizeof(prefix) - 1);
+    } else if (strlen(buf) >= 7) {
+        buf[7] = '\0';
+        snprintf(gs->branch, sizeof(gs->branch), "%s", buf);
+    }
+}
+
+/* The git directory for a worktree root, or NULL. Handles the ".git"
+ * file used by linked worktrees and submodules. */
+static char *git_dir_at(const char *dir)
+{
+    char *dotgit = join_path(dir, ".git");
+    if (!dotgit)
+        return NULL;
+
+    struct stat st;
+    if (stat(dotgit, &st) != 0) {
+        free(dotgit);
+        return NULL;
+    }
+    if (S_ISDIR(st.st_mode))
+        return dotgit;
+
+    char buf[PATH_MAX];
+    bool ok = S_ISREG(st.st_mode) && read_small(dotgit, buf, sizeof(buf)) &&
+              strncmp(buf, "gitdir: ", 8) == 0;
+    free(dotgit);
+    if (!ok)
+        return NULL;
+    return buf[8] == '/' ? strdup(buf + 8) : join_path(dir, buf + 8);
+}
+
+/* Walk up from cwd to find the repository */
+static void locate(GitStatus *gs, const char *cwd)
+{
+    char path[PATH_MAX];
+    char *found = NULL;
+
+    snprintf(path, sizeof(path), "%s", cwd);
+    for (;;) {
+        found = git_dir_at(path);
+        if (found)
+            break;
+        char *slash = strrchr(path, '/');
+        if (!slash || (slash == path && path[1] == '\0'))
+            break;
+        slash[slash == path ? 1 : 0] = '\0';
+    }
+
+    /* Moving around inside one repo keeps its detail */
+    if (found && gs->git_dir && strcmp(found, gs->git_dir) == 0) {
+        free(found);
+        read_branch(gs);
+        return;
+    }
+
+    if (gs->worker > 0)
+        stop_worker(gs, true);
+    forget_repo(gs);
+
+    if (!found) {
+        struct stat st;
+        if (stat(cwd, &st) == 0)
+            gs->cwd_mtime = st.st_mtim;
+        return;
+    }
+
+    gs->git_dir    = found;
+    gs->head_path  = join_path(found, "HEAD");
+    gs->index_path = join_path(found, "index");
+    if (!gs->head_path || !gs->index_path) {
+        forget_repo(gs);
+        return;
+    }
+    read_branch(gs);
+}
+
+static void start_worker(Shell *shell, GitStatus *gs, const char *cwd,
+                         struct timespec index_mtime)
+{
+    const char *git = path_cache_lookup(shell, "git");
+    if (!git)
+        return;
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0)
+        return;
+
+    char *argv[] = {
+        "git", "--no-optional-locks", "-C", (char *)cwd, "status",
+        "--porcelain=v2", "--branch", "--untracked-files=no", NULL
+    };
+
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t attr;
+    sigset_t defaults, empty;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGQUIT);
+    sigaddset(&defaults, SIGTSTP);
+    sigaddset(&defaults, SIGTTIN);
+    sigaddset(&defaults, SIGTTOU);
+    sigaddset(&defaults, SIGCHLD);
+    sigaddset(&defaults, SIGPIPE);
+    sigemptyset(&empty);
+
+    posix_spawn_file_actions_init(&fa);
+    posix_spawnattr_init(&attr);
+    int err = posix_spawn_file_actions_addopen(&fa, STDIN_FILENO, "/dev/null",
+                                               O_RDONLY, 0);
+    if (!err) err = posix_spawn_file_actions_adddup2(&fa, fds[1], STDOUT_FILENO);
+    if (!err) err = posix_spawn_file_actions_addopen(&fa, STDERR_FILENO,
+                                                     "/dev/null", O_WRONLY, 0);
+    if (!err) err = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+                                                    POSIX_SPAWN_SETSIGDEF |
+                                                    POSIX_SPAWN_SETSIGMASK);
+    if (!err) err = posix_spawnattr_setpgroup(&attr, 0);
+    if (!err) err = posix_spawnattr_setsigdefault(&attr, &defaults);
+    if (!err) err = posix_spawnattr_setsigmask(&attr, &empty);
+
+    pid_t pid = -1;
+    char **envp = env_envp(shell->env);
+    if (!err && envp)
+        err = posix_spawn(&pid, git, &fa, &attr, argv, envp);
+    else if (!err)
+        err = ENOMEM;
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&fa);
+    close(fds[1]);
+
+    if (err) {
+        close(fds[0]);
+        return;
+    }
+
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    gs->worker       = pid;
+    gs->fd           = fds[0];
+    gs->worker_dir   = strdup(gs->git_dir);
+    gs->line_start   = true;
+    gs->in_header    = false;
+    gs->header_len   = 0;
+    gs->w_seen_oid   = false;
+    gs->w_dirty      = false;
+    gs->w_ahead      = 0;
+    gs->w_behind     = 0;
+    clock_gettime(CLOCK_MONOTONIC, &gs->started);
+
+    /* Claim these stamps now so the next prompt doesn't start another */
+    gs->detail_head    = gs->head_mtime;
+    gs->detail_index   = index_mtime;
+    gs->detail_stamped = true;
+}
+
+static void parse_header(GitStatus *gs)
+{
+    gs->header[gs->header_len] = '\0';
+    if (strncmp(gs->header, "# branch.oid ", 13) == 0) {
+        gs->w_seen_oid = true;
+    } else if (strncmp(gs->header, "# branch.ab ", 12) == 0) {
+        int a = 0, b = 0;
+        if (sscanf(gs->header + 12, "+%d -%d", &a, &b) == 2) {
+            gs->w_ahead  = a;
+            gs->w_behind = b;
+        }
+    }
+}
+
+static void parse_output(GitStatus *gs, const char *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        char ch = buf[i];
+        if (gs->line_start) {
+            gs->line_start = false;
+            gs->in_header  = ch == '#';
+            gs->header_len = 0;
+            if (!gs->in_header)
+                gs->w_dirty = true;
+        }
+        if (ch == '\n') {
+            if (gs->in_header)
+                parse_header(gs);
+            gs->line_start = true;
+        } else if (gs->in_header && gs->header_len < sizeof(gs->header) - 1) {
+            gs->header[gs->header_len++] = ch;
+        }
+    }
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+GitStatus *git_status_create(void)
+{
+    GitStatus *gs = calloc(1, sizeof(GitStatus));
+    if (gs)
+        gs->fd = -1;
+    return gs;
+}
+
+void git_status_destroy(GitStatus *gs)
+{
+    if (!gs)
+        return;
+    stop_worker(gs, true);
+    forget_repo(gs);
+    free(gs->cwd);
+    free(gs->slow_dir);
+    free(gs);
+}
+
+const GitInfo *git_status_get(Shell *shell, const char *cwd)
+{
+    static const GitInfo none;
+    GitStatus *gs = shell->git_status;
+    if (!gs || !cwd)
+        return &none;
+
+    struct stat st;
+    if (!gs->cwd || strcmp(gs->cwd, cwd) != 0) {
+        free(gs->cwd);
+        gs->cwd = strdup(cwd);
+        locate(gs, cwd);
+    } else if (gs->git_dir) {
+        if (stat(gs->head_path, &st) != 0)
+            locate(gs, cwd);
+        else if (!ts_equal(st.st_mtim, gs->head_mtime))
+            read_branch(gs);
+    } else if (stat(cwd, &st) != 0 || !ts_equal(st.st_mtim, gs->cwd_mtime)) {
+        locate(gs, cwd);
+    }
+
+    gs->info.branch = gs->git_dir && gs->branch[0] ? gs->branch : NULL;
+    if (!gs->info.branch)
+        return &gs->info;
+
+    const char *want = env_get(shell->env, "VSH_GIT_STATUS");
+    bool detail = want && *want && strcmp(want, "0") != 0;
+    if (!detail || (gs->slow_dir && strcmp(gs->slow_dir, gs->git_dir) == 0)) {
+        gs->info.have_detail = false;
+        return &gs->info;
+    }
+
+    struct timespec index_mtime = {0, 0};
+    if (stat(gs->index_path, &st) == 0)
+        index_mtime = st.st_mtim;
+
+    bool current = gs->detail_stamped &&
+                   ts_equal(gs->detail_head, gs->head_mtime) &&
+                   ts_equal(gs->detail_index, index_mtime);
+    if (!current && gs->worker <= 0)
+        start_worker(shell, gs, cwd, index_mtime);
+
+    return &gs->info;
+}
+
+int git_status_fd(const GitStatus *gs)
+{
+    return gs && gs->worker > 0 ? gs->fd : -1;
+}
+
+bool git_status_collect(GitStatus *gs)
+{
+    if (!gs || gs->worker <= 0)
+        return false;
+
+    char buf[4096];
+    for (;;) {
+        ssize_t n = read(gs->fd, buf, sizeof(buf));
+        if (n > 0) {
+            parse_output(gs, buf, (size_t)n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (elapsed_ms(gs->started) > GIT_STATUS_TIMEOUT_MS) {
+                /* Too slow for a prompt: stop asking in this repo */
+                free(gs->slow_dir);
+                gs->slow_dir = strdup(gs->worker_dir);
+                stop_worker(gs, true);
+            }
+            return false;
+        }
+        break;  /* EOF or error */
+    }
+
+    bool ours = gs->git_dir && gs->worker_dir &&
+                strcmp(gs->git_dir, gs->worker_dir) == 0;
+    bool ok = gs->w_seen_oid;
+    stop_worker(gs, false);
+    if (!ours || !ok)
+        return false;
+
+    bool changed = !gs->info.have_detail ||
+                   gs->info.dirty  != gs->w_dirty ||
+                   gs->info.ahead  != gs->w_ahead ||
+                   gs->info.behind != gs->w_behind;
+    gs->info.have_detail = true;
+    gs->info.dirty       = gs->w_dirty;
+    gs->info.ahead       = gs->w_ahead;
+    gs->info.behind      = gs->w_behind;
+    return changed;
+}
@@ -2,18 +2,32 @@
  * vsh - Vanguard Shell
  * history.c - Command history with persistence
  *
- * Maintains a fixed-capacity array of history entries.  Navigation (up/down)
- * uses a separate position cursor that is reset whenever a new prompt starts.
- * History is persisted to ~/.vsh_history via simple line-per-entry text files.
+ * Maintains a fixed-capacity ring buffer of history entries, so evicting the
+ * oldest entry when full is O(1) and positions map to slots by index math.
+ * Line text lives in FIFO chunks that are released as their last entry is
+ * evicted, instead of one malloc per line.  Navigation (up/down) uses a
+ * separate position cursor that is reset whenever a new prompt starts.
+ *
+ * History is persisted to ~/.vsh_history as an append-only record log: each
+ * new entry is written with one O_APPEND write, so concurrent sessions never
+ * rewrite each other's work.  Loading mmaps the file and indexes records in
+ * place.  When the log grows past HISTORY_COMPACT_FACTOR x capacity it is
+ * compacted under an exclusive flock: all sessions' records are merged by
+ * timestamp, trimmed, and renamed over the original.
  * ============================================================================ */
 
 #include "history.h"
+#include "history_search.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /* ---- Internal helpers --------------------------------------------------- */
 
@@ -54,6 +68,320 @@ static bool is_blank(const char *line)
     return true;
 }
 
+/* Entry at logical position pos (0 = oldest); pos must be < count */
+static inline HistoryEntry *entry_at(const History *hist, int pos)
+{
+    int slot = hist->head + pos;
+    if (slot >= hist->capacity)
+        slot -= hist->capacity;
+    return &hist->entries[slot];
+}
+
+/* Copy a line (len bytes + NUL) into the newest chunk, starting a new one
+ * when it does not fit. With decode set, the line is a history file record
+ * (see record_encode): a run of backslashes before a newline or at the end
+ * is halved, and the newline's own escape dropped. */
+static char *chunk_store(History *hist, const char *line, size_t len,
+                         bool decode, HistoryChunk **out_chunk)
+{
+    HistoryChunk *c = hist->newest;
+
+    if (!c || c->used + len + 1 > c->size) {
+        size_t size = len + 1 > HISTORY_CHUNK_SIZE ? len + 1 : HISTORY_CHUNK_SIZE;
+        if (hist->spare && hist->spare->size >= size) {
+            c = hist->spare;
+            hist->spare = NULL;
+        } else {
+            c = malloc(sizeof(HistoryChunk) + size);
+            if (!c)
+                return NULL;
+            c->size = size;
+        }
+        c->next = NULL;
+        c->used = 0;
+        c->live = 0;
+
+        if (hist->newest)
+            hist->newest->next = c;
+        else
+            hist->oldest = c;
+        hist->newest = c;
+    }
+
+    char *dst = c->data + c->used;
+    if (decode) {
+        size_t out = 0;
+        for (size_t i = 0; i < len; ) {
+            if (line[i] != '\\') {
+                dst[out++] = line[i++];
+                continue;
+            }
+            size_t run = 0, keep;
+            while (i + run < len && line[i + run] == '\\')
+                run++;
+            if (i + run < len && line[i + run] != '\n')
+                keep = run;             /* Mid-line: copied as they are */
+            else if (i + run < len)
+                keep = run / 2;         /* 2k + 1 before a newline: k */
+            else
+                keep = (run + 1) / 2;   /* 2k at the end: k */
+            memset(dst + out, '\\', keep);
+            out += keep;
+            i += run;
+        }
+        len = out;
+    } else {
+        memcpy(dst, line, len);
+    }
+    dst[len] = '\0';
+    c->used += len + 1;
+    c->live++;
+    *out_chunk = c;
+    return dst;
+}
+
+/* Drop one reference to a chunk; fully dead chunks at the old end of the
+ * list are released (one is kept as a spare). */
+static void chunk_release(History *hist, HistoryChunk *c)
+{
+    c->live--;
+
+    while (hist->oldest && hist->oldest->live == 0 &&
+           hist->oldest != hist->newest) {
+        HistoryChunk *dead = hist->oldest;
+        hist->oldest = dead->next;
+        if (!hist->spare && dead->size == HISTORY_CHUNK_SIZE)
+            hist->spare = dead;
+        else
+            free(dead);
+    }
+}
+
+/* Append an entry (skipping a repeat of the previous one). Returns the new
+ * entry, or NULL if nothing was added. */
+static HistoryEntry *history_push(History *hist, const char *line, size_t len,
+                                  time_t when, bool decode)
+{
+    if (hist->count > 0 && !decode) {
+        const char *prev = entry_at(hist, hist->count - 1)->line;
+        if (strncmp(prev, line, len) == 0 && prev[len] == '\0')
+            return NULL;
+    }
+
+    HistoryChunk *chunk = NULL;
+    char *copy = chunk_store(hist, line, len, decode, &chunk);
+    if (!copy)
+        return NULL;
+
+    /* Decoded lines are only known after the copy */
+    if (decode && hist->count > 0 &&
+        strcmp(entry_at(hist, hist->count - 1)->line, copy) == 0) {
+        chunk->used -= strlen(copy) + 1;
+        chunk->live--;
+        return NULL;
+    }
+
+    /* If at capacity, the oldest slot is reused for the new entry (its
+     * chunk cannot be the one just written to while others are live) */
+    if (hist->count == hist->capacity) {
+        chunk_release(hist, hist->entries[hist->head].chunk);
+        hist->head = (hist->head + 1) % hist->capacity;
+        hist->count--;
+    }
+
+    HistoryEntry *e = entry_at(hist, hist->count);
+    e->line  = copy;
+    e->index = hist->next_index++;
+    e->when  = when;
+    e->chunk = chunk;
+    hist->count++;
+
+    /* Keep the search index current; once it spans a full turn of the ring
+     * it is mostly stale postings, so drop it and rebuild on demand */
+    if (hist->index) {
+        if (e->index - history_index_base(hist->index) >= 2 * hist->capacity) {
+            history_index_destroy(hist->index);
+            hist->index = NULL;
+        } else {
+            history_index_add(hist->index, e->line, e->index);
+        }
+    }
+    return e;
+}
+
+/* ---- History file records ---------------------------------------------- */
+
+/* Open path and take a flock on it, retrying if the file was replaced by a
+ * compaction between open() and flock(). Returns the fd or -1. */
+static int open_locked(const char *path, int flags, int lock)
+{
+    for (int attempt = 0; attempt < 8; attempt++) {
+        int fd = open(path, flags | O_CLOEXEC, 0600);
+        if (fd < 0)
+            return -1;
+        if (flock(fd, lock) < 0) {
+            close(fd);
+            return -1;
+        }
+
+        struct stat fst, pst;
+        if (fstat(fd, &fst) == 0 && stat(path, &pst) == 0 &&
+            fst.st_ino == pst.st_ino && fst.st_dev == pst.st_dev)
+            return fd;
+        close(fd);
+    }
+    return -1;
+}
+
+/* Size of the encoded record for a line */
+static size_t record_size(const char *line)
+{
+    size_t n = 32;  /* ": <time>:0;" and the final newline */
+    for (const char *p = line; *p; p++)
+        n += (*p == '\n' || *p == '\\') ? 2 : 1;
+    return n;
+}
+
+/*
+ * Encode one record into buf (sized by record_size). Returns its length.
+ * A newline in the line is escaped with a backslash. The backslashes just
+ * before a newline or the end are doubled, so the record's own newline is
+ * the first one after an even run; any others are written as they are.
+ */
+static size_t record_encode(char *buf, const char *line, time_t when)
+{
+    size_t n = (size_t)sprintf(buf, ": %lld:0;", (long long)when);
+    for (const char *p = line; *p; ) {
+        if (*p == '\\') {
+            size_t run = strspn(p, "\\");
+            bool tail = p[run] == '\n' || p[run] == '\0';
+            for (size_t k = 0; k < (tail ? 2 * run : run); k++)
+                buf[n++] = '\\';
+            p += run;
+            continue;
+        }
+        if (*p == '\n')
+            buf[n++] = '\\';
+        buf[n++] = *p++;
+    }
+    buf[n++] = '\n';
+    return n;
+}
+
+/* One parsed record from a mapped history file */
+typedef struct HistoryRecord {
+    const char *text;
+    size_t      len;
+    time_t      when;
+    size_t      seq;    /* File order, to keep the sort stable */
+} HistoryRecord;
+
+/*
+ * Parse the record starting at p. Returns a pointer past it (and its
+ * trailing newline). Extended records carry a timestamp; anything else is
+ * a plain line with time 0.
+ */
+static const char *record_parse(const char *p, const char *end,
+                                HistoryRecord *rec)
+{
+    /* The record ends at the first newline after an even run of
+     * backslashes (none included) */
+    const char *nl = p;
+    for (;;) {
+        nl = memchr(nl, '\n', (size_t)(end - nl));
+        if (!nl) {
+            nl = end;
+            break;
+        }
+        const char *q = nl;
+        while (q > p && q[-1] == '\\')
+            q--;
+        if ((nl - q) % 2 == 0)
+            break;
+        nl++;
+    }
+
+    rec->text = p;
+    rec->len  = (size_t)(nl - p);
+    rec->when = 0;
+
+    if (rec->len > 2 && p[0] == ':' && p[1] == ' ') {
+        const char *q = p + 2;
+        long long when = 0;
+        while (q < nl && isdigit((unsigned char)*q))
+            when = when * 10 + (*q++ - '0');
+        if (q < nl && *q == ':') {
+            q++;
+            while (q < nl && isdigit((unsigned char)*q))
+                q++;
+            if (q < nl && *q == ';') {
+                rec->text = q + 1;
+                rec->len  = (size_t)(nl - rec->text);
+                rec->when = (time_t)when;
+            }
+        }
+    }
+
+    /* Tolerate CRLF files */
+    if (rec->len > 0 && rec->text[rec->len - 1] == '\r')
+        rec->len--;
+
+    return nl < end ? nl + 1 : end;
+}
+
+/* Whether a parsed record holds anything worth keeping */
+static bool record_blank(const HistoryRecord *rec)
+{
+    for (size_t i = 0; i < rec->len; i++) {
+        if (!isspace((unsigned char)rec->text[i]))
+            return false;
+    }
+    return true;
+}
+
+/* Map a whole file read-only. Returns NULL for empty or unreadable files. */
+static const char *map_file(int fd, size_t *out_len)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size <= 0)
+        return NULL;
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    *out_len = (size_t)st.st_size;
+    return map;
+}
+
+/* Append one entry's record to the attached file with a single write */
+static void history_append(History *hist, const HistoryEntry *e)
+{
+    int fd = open_locked(hist->file, O_WRONLY | O_APPEND | O_CREAT, LOCK_SH);
+    if (fd < 0)
+        return;
+
+    char  small[512];
+    size_t need = record_size(e->line);
+    char *buf = need <= sizeof(small) ? small : malloc(need);
+    if (buf) {
+        size_t n = record_encode(buf, e->line, e->when);
+        if (write(fd, buf, n) == (ssize_t)n)
+            hist->file_records++;
+        if (buf != small)
+            free(buf);
+    }
+    close(fd);
+}
+
+static int cmp_records(const void *a, const void *b)
+{
+    const HistoryRecord *ra = a, *rb = b;
+    if (ra->when != rb->when)
+        return ra->when < rb->when ? -1 : 1;
+    return ra->seq < rb->seq ? -1 : (ra->seq > rb->seq);
+}
+
 /* ---- Public API --------------------------------------------------------- */
 
 History *history_create(int capacity)
@@ -61,7 +389,7 @@ History *history_create(int capacity)
     if (capacity <= 0)
         capacity = HISTORY_MAX_SIZE;
 
-    History *hist = malloc(sizeof(History));
+    History *hist = calloc(1, sizeof(History));
     if (!hist)
         return NULL;
 
@@ -71,9 +399,7 @@ History *history_create(int capacity)
         return NULL;
     }
 
-    hist->count      = 0;
     hist->capacity   = capacity;
-    hist->pos        = 0;
     hist->next_index = 1;
     return hist;
 }
@@ -83,9 +409,16 @@ void history_destroy(History *hist)
     if (!hist)
         return;
 
-    for (int i = 0; i < hist->count; i++)
-        free(hist->entries[i].line);
+    HistoryChunk *c = hist->oldest;
+    while (c) {
+        HistoryChunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    free(hist->spare);
 
+    history_index_destroy(hist->index);
+    free(hist->file);
     free(hist->entries);
     free(hist);
 }
@@ -99,24 +432,18 @@ void history_add(History *hist, const char *line)
     if (is_blank(line))
         return;
 
-    /* Skip duplicate of the previous entry */
-    if (hist->count > 0 &&
-        strcmp(hist->entries[hist->count - 1].line, line) == 0)
+    /* Skips a duplicate of the previous entry */
+    HistoryEntry *e = history_push(hist, line, strlen(line), time(NULL), false);
+    if (!e)
         return;
 
-    /* If at capacity, drop the oldest entry and shift left */
-    if (hist->count == hist->capacity) {
-        free(hist->entries[0].line);
-        memmove(&hist->entries[0], &hist->entries[1],
-                (size_t)(hist->capacity - 1) * sizeof(HistoryEntry));
-        hist->count--;
+    /* Persist it right away; compact once the log has grown enough */
+    if (hist->file) {
+        history_append(hist, e);
+        if (hist->file_records > hist->capacity * HISTORY_COMPACT_FACTOR)
+            history_compact(hist);
     }
 
-    /* Append the new entry */
-    hist->entries[hist->count].line  = strdup(line);
-    hist->entries[hist->count].index = hist->next_index++;
-    hist->count++;
-
     /* Reset navigation */
     history_reset_nav(hist);
 }
@@ -125,27 +452,26 @@ const char *history_get(History *hist, int pos)
 {
     if (!hist || pos < 0 || pos >= hist->count)
         return NULL;
-    return hist->entries[pos].line;
+    return entry_at(hist, pos)->line;
 }
 
 const char *history_get_by_index(History *hist, int index)
 {
-    if (!hist)
+    if (!hist || hist->count == 0)
         return NULL;
 
-    /* Scan from the end (most likely to be recent) */
-    for (int i = hist->count - 1; i >= 0; i--) {
-        if (hist->entries[i].index == index)
-            return hist->entries[i].line;
-    }
-    return NULL;
+    /* Global indices are consecutive, so the position is an offset */
+    int pos = index - entry_at(hist, 0)->index;
+    if (pos < 0 || pos >= hist->count)
+        return NULL;
+    return entry_at(hist, pos)->line;
 }
 
 const char *history_last(History *hist)
 {
     if (!hist || hist->count == 0)
         return NULL;
-    return hist->entries[hist->count - 1].line;
+    return entry_at(hist, hist->count - 1)->line;
 }
 
 const char *history_navigate_up(History *hist)
@@ -156,7 +482,7 @@ const char *history_navigate_up(History *hist)
     if (hist->pos > 0)
         hist->pos--;
 
-    return hist->entries[hist->pos].line;
+    return entry_at(hist, hist->pos)->line;
 }
 
 const char *history_navigate_down(History *hist)
@@ -171,7 +497,7 @@ const char *history_navigate_down(History *hist)
         return NULL;               /* back to current input */
     }
 
-    return hist->entries[hist->pos].line;
+    return entry_at(hist, hist->pos)->line;
 }
 
 void history_reset_nav(History *hist)
@@ -188,8 +514,9 @@ const char *history_search_prefix(History *hist, const char *prefix)
 
     size_t plen = strlen(prefix);
     for (int i = hist->count - 1; i >= 0; i--) {
-        if (strncmp(hist->entries[i].line, prefix, plen) == 0)
-            return hist->entries[i].line;
+        const char *entry = entry_at(hist, i)->line;
+        if (strncmp(entry, prefix, plen) == 0)
+            return entry;
     }
     return NULL;
 }
@@ -205,11 +532,12 @@ const char *history_search_substr(History *hist, const char *substr, int *out_po
         start = hist->count - 1;
 
     for (int i = start; i >= 0; i--) {
-        if (strstr(hist->entries[i].line, substr)) {
+        const char *entry = entry_at(hist, i)->line;
+        if (strstr(entry, substr)) {
             if (out_pos)
                 *out_pos = i;
             hist->pos = i;
-            return hist->entries[i].line;
+            return entry;
         }
     }
     return NULL;
@@ -224,26 +552,40 @@ void history_load(History *hist, const char *path)
     if (!expanded)
         return;
 
-    FILE *fp = fopen(expanded, "r");
-    free(expanded);
-    if (!fp)
+    free(hist->file);
+    hist->file = expanded;
+    hist->file_records = 0;
+
+    int fd = open(expanded, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
         return;
 
-    char buf[4096];
-    while (fgets(buf, sizeof(buf), fp)) {
-        /* Strip trailing newline */
-        size_t len = strlen(buf);
-        while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == '\r'))
-            buf[--len] = '\0';
+    size_t len = 0;
+    const char *map = map_file(fd, &len);
+    close(fd);
+    if (!map)
+        return;
 
-        if (len > 0)
-            history_add(hist, buf);
+    /* Pass 1 counts records, so pass 2 only copies the newest `capacity` */
+    const char *end = map + len;
+    HistoryRecord rec;
+    int total = 0;
+    for (const char *p = map; p < end; total++)
+        p = record_parse(p, end, &rec);
+
+    int skip = total - hist->capacity;
+    for (const char *p = map; p < end; skip--) {
+        p = record_parse(p, end, &rec);
+        if (skip <= 0 && !record_blank(&rec))
+            history_push(hist, rec.text, rec.len, rec.when, true);
     }
 
-    fclose(fp);
+    munmap((void *)map, len);
+    hist->file_records = total;
+    history_reset_nav(hist);
 }
 
-void history_save(const History *hist, const char *path)
+void history_save(History *hist, const char *path)
 {
     if (!hist || !path)
         return;
@@ -252,29 +594,147 @@ void history_save(const History *hist, const char *path)
     if (!expanded)
         return;
 
+    /* The attached log already holds everything */
+    if (hist->file && strcmp(expanded, hist->file) == 0) {
+        free(expanded);
+        if (hist->file_records > hist->capacity * HISTORY_COMPACT_FACTOR)
+            history_compact(hist);
+        return;
+    }
+
     FILE *fp = fopen(expanded, "w");
     free(expanded);
     if (!fp)
         return;
 
-    for (int i = 0; i < hist->count; i++)
-        fprintf(fp, "%s\n", hist->entries[i].line);
+    char small[512];
+    for (int i = 0; i < hist->count; i++) {
+        const HistoryEntry *e = entry_at(hist, i);
+        size_t need = record_size(e->line);
+        char *buf = need <= sizeof(small) ? small : malloc(need);
+        if (!buf)
+            continue;
+        fwrite(buf, 1, record_encode(buf, e->line, e->when), fp);
+        if (buf != small)
+            free(buf);
+    }
 
     fclose(fp);
 }
 
+int history_compact(History *hist)
+{
+    if (!hist || !hist->file)
+        return -1;
+
+    int fd = open_locked(hist->file, O_RDONLY, LOCK_EX);
+    if (fd < 0)
+        return -1;
+
+    size_t len = 0;
+    const char *map = map_file(fd, &len);
+    if (!map) {
+        close(fd);
+        return -1;
+    }
+
+    /* Index every record in the file, from every session */
+    size_t cap = 1024, n = 0;
+    HistoryRecord *recs = malloc(cap * sizeof(HistoryRecord));
+    const char *end = map + len;
+    for (const char *p = map; recs && p < end; ) {
+        if (n == cap) {
+            cap *= 2;
+            HistoryRecord *tmp = realloc(recs, cap * sizeof(HistoryRecord));
+            if (!tmp) {
+                free(recs);
+                recs = NULL;
+                break;
+            }
+            recs = tmp;
+        }
+        p = record_parse(p, end, &recs[n]);
+        recs[n].seq = n;
+        if (!record_blank(&recs[n]))
+            n++;
+    }
+
+    int rc = -1;
+    char *tmp_path = NULL;
+    char *out = NULL;
+    if (!recs)
+        goto done;
+
+    /* Merge by time; interleaved sessions come out in the order typed */
+    qsort(recs, n, sizeof(HistoryRecord), cmp_records);
+
+    /* Drop adjacent duplicates, then keep the newest `capacity` */
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (kept > 0 && recs[kept - 1].len == recs[i].len &&
+            memcmp(recs[kept - 1].text, recs[i].text, recs[i].len) == 0)
+            continue;
+        recs[kept++] = recs[i];
+    }
+    size_t first = kept > (size_t)hist->capacity ? kept - (size_t)hist->capacity : 0;
+
+    /* Records keep their on-disk encoding, so they are copied verbatim */
+    size_t out_len = 0;
+    for (size_t i = first; i < kept; i++)
+        out_len += 32 + recs[i].len;
+    out = malloc(out_len + 1);
+
+    size_t plen = strlen(hist->file);
+    tmp_path = malloc(plen + 32);
+    if (!out || !tmp_path)
+        goto done;
+
+    size_t pos = 0;
+    for (size_t i = first; i < kept; i++) {
+        pos += (size_t)sprintf(out + pos, ": %lld:0;", (long long)recs[i].when);
+        memcpy(out + pos, recs[i].text, recs[i].len);
+        pos += recs[i].len;
+        out[pos++] = '\n';
+    }
+
+    snprintf(tmp_path, plen + 32, "%s.%ld.tmp", hist->file, (long)getpid());
+    int tfd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (tfd < 0)
+        goto done;
+    bool ok = write(tfd, out, pos) == (ssize_t)pos;
+    close(tfd);
+
+    /* Rename while still holding the lock on the old file; appenders that
+     * were waiting on it notice the inode change and reopen */
+    if (ok && rename(tmp_path, hist->file) == 0) {
+        hist->file_records = (int)(kept - first);
+        rc = 0;
+    } else {
+        unlink(tmp_path);
+    }
+
+done:
+    free(out);
+    free(tmp_path);
+    free(recs);
+    munmap((void *)map, len);
+    close(fd);
+    return rc;
+}
+
 void history_clear(History *hist)
 {
     if (!hist)
         return;
 
-    for (int i = 0; i < hist->count; i++) {
-        free(hist->entries[i].line);
-        hist->entries[i].line  = NULL;
-        hist->entries[i].index = 0;
-    }
+    for (int i = 0; i < hist->count; i++)
+        chunk_release(hist, entry_at(hist, i)->chunk);
+    memset(hist->entries, 0, (size_t)hist->capacity * sizeof(HistoryEntry));
 
+    hist->head  = 0;
     hist->count = 0;
+    history_index_destroy(hist->index);
+    hist->index = NULL;
     history_reset_nav(hist);
 }
 
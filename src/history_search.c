@@ -0,0 +1,266 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * history_search.c - Trigram index and incremental history search
+ *
+ * Posting lists only ever grow at the end (global indices are assigned in
+ * increasing order), so additions are a push and lists stay sorted.
+ * Entries evicted from the ring leave stale postings behind; searches skip
+ * anything below the ring's oldest index, and history.c drops the whole
+ * index once it has outlived a full turn of the ring so it is rebuilt from
+ * the live entries on the next search.
+ * ============================================================================ */
+
+#include "history_search.h"
+#include "history.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ---- Index -------------------------------------------------------------- */
+
+typedef struct Posting {
+    uint32_t        key;     /* Three bytes packed big-endian */
+    int            *ids;     /* Global indices, ascending */
+    int             count;
+    int             cap;
+    struct Posting *next;
+} Posting;
+
+struct HistoryIndex {
+    Posting *buckets[HISTORY_INDEX_BUCKETS];
+    int      base;
+};
+
+static inline uint32_t trigram_at(const char *p)
+{
+    return ((uint32_t)(unsigned char)p[0] << 16) |
+           ((uint32_t)(unsigned char)p[1] << 8) |
+           (uint32_t)(unsigned char)p[2];
+}
+
+static inline unsigned int trigram_hash(uint32_t key)
+{
+    return ((key * 2654435761u) >> 20) & (HISTORY_INDEX_BUCKETS - 1);
+}
+
+static Posting *posting_find(const HistoryIndex *idx, uint32_t key)
+{
+    for (Posting *p = idx->buckets[trigram_hash(key)]; p; p = p->next) {
+        if (p->key == key)
+            return p;
+    }
+    return NULL;
+}
+
+void history_index_add(HistoryIndex *idx, const char *line, int index)
+{
+    if (!idx || !line)
+        return;
+
+    size_t len = strlen(line);
+    for (size_t i = 0; i + 3 <= len; i++) {
+        uint32_t key = trigram_at(line + i);
+        unsigned int h = trigram_hash(key);
+
+        Posting *p = idx->buckets[h];
+        while (p && p->key != key)
+            p = p->next;
+        if (!p) {
+            p = calloc(1, sizeof(Posting));
+            if (!p)
+                return;
+            p->key = key;
+            p->next = idx->buckets[h];
+            idx->buckets[h] = p;
+        }
+
+        /* A trigram repeated within one line is recorded once */
+        if (p->count > 0 && p->ids[p->count - 1] == index)
+            continue;
+
+        if (p->count == p->cap) {
+            int cap = p->cap ? p->cap * 2 : 4;
+            int *tmp = realloc(p->ids, (size_t)cap * sizeof(int));
+            if (!tmp)
+                return;
+            p->ids = tmp;
+            p->cap = cap;
+        }
+        p->ids[p->count++] = index;
+    }
+}
+
+HistoryIndex *history_index_build(const History *hist)
+{
+    HistoryIndex *idx = calloc(1, sizeof(HistoryIndex));
+    if (!idx)
+        return NULL;
+
+    int n = history_count(hist);
+    for (int i = 0; i < n; i++) {
+        const HistoryEntry *e = &hist->entries[(hist->head + i) % hist->capacity];
+        if (i == 0)
+            idx->base = e->index;
+        history_index_add(idx, e->line, e->index);
+    }
+    if (n == 0)
+        idx->base = hist->next_index;
+    return idx;
+}
+
+int history_index_base(const HistoryIndex *idx)
+{
+    return idx ? idx->base : 0;
+}
+
+void history_index_destroy(HistoryIndex *idx)
+{
+    if (!idx)
+        return;
+
+    for (int i = 0; i < HISTORY_INDEX_BUCKETS; i++) {
+        Posting *p = idx->buckets[i];
+        while (p) {
+            Posting *next = p->next;
+            free(p->ids);
+            free(p);
+            p = next;
+        }
+    }
+    free(idx);
+}
+
+/* ---- Search session ----------------------------------------------------- */
+
+static void cands_push(HistorySearch *s, int index)
+{
+    if (s->ncands == s->cap) {
+        int cap = s->cap ? s->cap * 2 : 64;
+        int *tmp = realloc(s->cands, (size_t)cap * sizeof(int));
+        if (!tmp)
+            return;
+        s->cands = tmp;
+        s->cap   = cap;
+    }
+    s->cands[s->ncands++] = index;
+}
+
+/* Fill cands from scratch, newest first */
+static void collect(HistorySearch *s, const char *query, size_t qlen)
+{
+    History *hist = s->hist;
+    s->ncands = 0;
+
+    int n = history_count(hist);
+    if (n == 0)
+        return;
+    int oldest = hist->entries[hist->head].index;
+
+    if (qlen < 3) {
+        for (int i = n - 1; i >= 0; i--) {
+            const char *line = history_get(hist, i);
+            if (strstr(line, query))
+                cands_push(s, oldest + i);
+        }
+        return;
+    }
+
+    if (!hist->index)
+        hist->index = history_index_build(hist);
+    HistoryIndex *idx = hist->index;
+    if (!idx)
+        return;
+
+    /* Every trigram must occur; walk the rarest one's postings */
+    const Posting *best = NULL;
+    for (size_t i = 0; i + 3 <= qlen; i++) {
+        const Posting *p = posting_find(idx, trigram_at(query + i));
+        if (!p)
+            return;
+        if (!best || p->count < best->count)
+            best = p;
+    }
+
+    for (int i = best->count - 1; i >= 0; i--) {
+        int id = best->ids[i];
+        if (id < oldest)
+            break;
+        const char *line = history_get_by_index(hist, id);
+        if (line && strstr(line, query))
+            cands_push(s, id);
+    }
+}
+
+void history_search_begin(HistorySearch *s, History *hist)
+{
+    memset(s, 0, sizeof(*s));
+    s->hist = hist;
+    s->cur  = -1;
+}
+
+const char *history_search_update(HistorySearch *s, const char *query)
+{
+    if (!s->hist || !query)
+        return NULL;
+
+    size_t qlen = strlen(query);
+    int prev = (s->cur >= 0 && s->cur < s->ncands) ? s->cands[s->cur] : -1;
+
+    if (qlen == 0) {
+        s->ncands = 0;
+        s->cur    = -1;
+    } else if (s->query && s->qlen > 0 && qlen >= s->qlen &&
+               strncmp(query, s->query, s->qlen) == 0) {
+        /* Extension: matches of the longer query are a subset */
+        int kept = 0;
+        for (int i = 0; i < s->ncands; i++) {
+            const char *line = history_get_by_index(s->hist, s->cands[i]);
+            if (line && strstr(line, query))
+                s->cands[kept++] = s->cands[i];
+        }
+        s->ncands = kept;
+    } else {
+        collect(s, query, qlen);
+        prev = -1;
+    }
+
+    free(s->query);
+    s->query = strdup(query);
+    s->qlen  = s->query ? qlen : 0;
+
+    /* Stay on the current match, or the next older one */
+    s->cur = s->ncands > 0 ? 0 : -1;
+    if (prev >= 0) {
+        for (int i = 0; i < s->ncands; i++) {
+            if (s->cands[i] <= prev) {
+                s->cur = i;
+                break;
+            }
+        }
+    }
+    return history_search_current(s);
+}
+
+const char *history_search_older(HistorySearch *s)
+{
+    if (s->cur < 0 || s->cur + 1 >= s->ncands)
+        return NULL;
+    s->cur++;
+    return history_search_current(s);
+}
+
+const char *history_search_current(const HistorySearch *s)
+{
+    if (s->cur < 0 || s->cur >= s->ncands)
+        return NULL;
+    return history_get_by_index(s->hist, s->cands[s->cur]);
+}
+
+void history_search_end(HistorySearch *s)
+{
+    free(s->query);
+    free(s->cands);
+    memset(s, 0, sizeof(*s));
+    s->cur = -1;
+}
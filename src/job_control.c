@@ -2,17 +2,33 @@
  * vsh - Vanguard Shell
  * job_control.c - Job control with process groups and signals
  *
- * Manages background/foreground jobs, process groups, and the SIGCHLD handler.
- * The shell's own process is placed in its own process group and holds the
- * terminal.  Each pipeline gets its own process group; foreground jobs are
- * given the terminal via tcsetpgrp, and background jobs run silently until
- * the shell reports their completion at the next prompt.
+ * Manages background/foreground jobs and process groups.  The shell's own
+ * process is placed in its own process group and holds the terminal.  Each
+ * pipeline gets its own process group; foreground jobs are given the
+ * terminal via tcsetpgrp, and background jobs run silently until the shell
+ * reports their completion at the next prompt.
+ *
+ * No work happens in signal context.  In an interactive shell SIGCHLD is
+ * blocked and read from a signalfd; job_reap() drains it and collects every
+ * changed child with waitpid(WNOHANG).  Reaped PIDs are mapped back to their
+ * job through a hash table, so bookkeeping is O(1) per child regardless of
+ * how many jobs are running.
+ *
+ * The rusage wait4() returns with each exited child is added to its job,
+ * so a finished job knows its CPU time and peak memory; `jobs -s` samples
+ * /proc/PID/stat of the processes still running for the rest.
  * ============================================================================ */
 
 #include "job_control.h"
 #include "shell.h"
+#include "output.h"
+#include "stats.h"
+#include "pipetime.h"
+#include "pipeline.h"
 
 #include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include <unistd.h>
@@ -20,13 +36,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
-
-/* ---- Global shell pointer for signal handlers --------------------------- */
-
-static Shell *g_shell = NULL;
+#include <fcntl.h>
 
 /* ---- Internal helpers --------------------------------------------------- */
 
+#define JOB_PID_MIN_BUCKETS 64
+
 static const char *job_state_str(JobState state)
 {
     switch (state) {
@@ -38,13 +53,237 @@ static const char *job_state_str(JobState state)
     return "Unknown";
 }
 
-/* ---- Public API --------------------------------------------------------- */
+static unsigned pid_hash(pid_t pid, int nbuckets)
+{
+    return ((unsigned)pid * 2654435761u) & (unsigned)(nbuckets - 1);
+}
+
+/* Grow the bucket array so chains stay around one entry long */
+static bool pid_map_reserve(JobTable *jt, int extra)
+{
+    if (jt->by_pid && jt->nlinks + extra <= jt->nbuckets)
+        return true;
+
+    int nb = jt->nbuckets ? jt->nbuckets : JOB_PID_MIN_BUCKETS;
+    while (jt->nlinks + extra > nb)
+        nb *= 2;
+
+    JobPid **buckets = calloc((size_t)nb, sizeof(JobPid *));
+    if (!buckets)
+        return jt->by_pid != NULL;  /* Keep going with longer chains */
+
+    for (int i = 0; i < jt->nbuckets; i++) {
+        JobPid *e = jt->by_pid[i];
+        while (e) {
+            JobPid *next = e->next;
+            unsigned h = pid_hash(e->pid, nb);
+            e->next = buckets[h];
+            buckets[h] = e;
+            e = next;
+        }
+    }
+    free(jt->by_pid);
+    jt->by_pid   = buckets;
+    jt->nbuckets = nb;
+    return true;
+}
+
+static JobPid *pid_map_find(JobTable *jt, pid_t pid)
+{
+    if (!jt->by_pid)
+        return NULL;
+    for (JobPid *e = jt->by_pid[pid_hash(pid, jt->nbuckets)]; e; e = e->next) {
+        if (e->pid == pid)
+            return e;
+    }
+    return NULL;
+}
+
+static void pid_map_unlink(JobTable *jt, JobPid *link)
+{
+    JobPid **pp = &jt->by_pid[pid_hash(link->pid, jt->nbuckets)];
+    while (*pp) {
+        if (*pp == link) {
+            *pp = link->next;
+            jt->nlinks--;
+            return;
+        }
+        pp = &(*pp)->next;
+    }
+}
+
+static void job_free(JobTable *jt, Job *job)
+{
+    for (int i = 0; i < job->npids; i++) {
+        if (job->pids[i] != 0)
+            pid_map_unlink(jt, &job->links[i]);
+    }
+    free(job->links);
+    free(job->pids);
+    free(job->command);
+    free(job);
+}
+
+static int exit_code(int status)
+{
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    return status;
+}
 
-void job_set_shell(Shell *shell)
+/* waitpid(-1) that also returns the child's resource usage, and hands it
+ * to a running `time`. While a pipeline counts its stages' bytes, the child is first
+ * looked at without reaping it, as /proc/PID/io goes with the zombie. */
+static pid_t reap(Shell *shell, int *status, int options,
+                  struct rusage *usage)
 {
-    g_shell = shell;
+    pid_t want = -1;
+    if (shell->pipe_bytes) {
+        siginfo_t si;
+        memset(&si, 0, sizeof(si));
+        if (waitid(P_ALL, 0, &si, WEXITED | WNOWAIT |
+                   (options & (WNOHANG | WUNTRACED | WCONTINUED))) < 0)
+            return -1;
+        if (si.si_pid == 0)
+            return 0;
+        want = si.si_pid;
+        if (si.si_code == CLD_EXITED || si.si_code == CLD_KILLED ||
+            si.si_code == CLD_DUMPED)
+            pipeline_stage_exited(shell, want);
+    }
+
+    pid_t pid = wait4(want, status, options, usage);
+    if (pid > 0 && shell->timer)
+        pipetime_reaped(shell, pid, *status, usage);
+    return pid;
+}
+
+/* ---- Resource accounting ---------------------------------------------- */
+
+/* A `jobs -s` CPU% is over the time since the previous one when that is
+ * at least this long; otherwise (and the first time) over the job's life */
+#define JOB_SAMPLE_MIN_NS 200000000ull
+
+/* How far below a job's own processes `jobs -s` looks for descendants */
+#define JOB_SAMPLE_DEPTH 8
+
+/* "850ms", "12.35s", "4:07", "1:02:33" */
+static void format_elapsed(char *buf, size_t size, uint64_t ns)
+{
+    uint64_t s = ns / 1000000000;
+    if (s < 60)
+        stats_format_ns(buf, size, ns);
+    else if (s < 3600)
+        snprintf(buf, size, "%u:%02u", (unsigned)(s / 60), (unsigned)(s % 60));
+    else
+        snprintf(buf, size, "%u:%02u:%02u", (unsigned)(s / 3600),
+                 (unsigned)(s / 60 % 60), (unsigned)(s % 60));
+}
+
+/* CPU time (its own and its reaped children's) and resident set of a live
+ * process, from /proc/PID/stat; false if it is gone */
+static bool proc_sample(pid_t pid, uint64_t *cpu_us, long *rss_kb)
+{
+    char path[32], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return false;
+    buf[n] = '\0';
+
+    /* The command name in parentheses may hold anything: start after it,
+     * at field 3 (state). utime..cstime are fields 14-17, rss field 24. */
+    char *p = strrchr(buf, ')');
+    if (!p)
+        return false;
+    unsigned long long f[22];
+    int field = 0;
+    for (p++; field < 22 && *p; field++) {
+        while (*p == ' ')
+            p++;
+        f[field] = strtoull(p, &p, 10);
+        while (*p && *p != ' ')
+            p++;
+    }
+    if (field < 22)
+        return false;
+
+    static long hz, page_kb;
+    if (!hz) {
+        hz = sysconf(_SC_CLK_TCK);
+        page_kb = sysconf(_SC_PAGESIZE) / 1024;
+        if (hz <= 0)
+            hz = 100;
+    }
+    *cpu_us = (f[11] + f[12] + f[13] + f[14]) * 1000000 / (unsigned long long)hz;
+    *rss_kb = (long)f[21] * page_kb;
+    return true;
+}
+
+/* Add up proc_sample() over pid and its descendants: a background job is
+ * a forked shell, and the work is done by the commands it runs. Children
+ * come from /proc/PID/task/PID/children (those of the main thread). */
+static void proc_sample_tree(pid_t pid, uint64_t *cpu_us, long *rss_kb,
+                             int depth)
+{
+    uint64_t c;
+    long r;
+    if (!proc_sample(pid, &c, &r))
+        return;
+    *cpu_us += c;
+    *rss_kb += r;
+    if (depth >= JOB_SAMPLE_DEPTH)
+        return;
+
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/task/%d/children", (int)pid, (int)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return;
+    buf[n] = '\0';
+
+    /* A pid cut off at the end of the buffer is left out */
+    char *end = n == (ssize_t)sizeof(buf) - 1 ? strrchr(buf, ' ') : NULL;
+    if (end)
+        *end = '\0';
+    for (char *p = buf; *p; ) {
+        long child = strtol(p, &p, 10);
+        if (child <= 0)
+            break;
+        proc_sample_tree((pid_t)child, cpu_us, rss_kb, depth + 1);
+    }
+    return;
 }
 
+/* Block until the job stops or finishes. Other children that change state
+ * meanwhile are booked against their own jobs. */
+static void wait_while_running(Shell *shell, Job *job)
+{
+    while (job->state == JOB_RUNNING) {
+        int status;
+        struct rusage usage;
+        pid_t pid = reap(shell, &status, WUNTRACED, &usage);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        job_update_status(shell, pid, status, &usage);
+    }
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
 void job_control_init(Shell *shell)
 {
     if (!shell)
@@ -53,6 +292,7 @@ void job_control_init(Shell *shell)
     /* Initialise the job table */
     shell->jobs->head    = NULL;
     shell->jobs->next_id = 1;
+    shell->jobs->event_fd = -1;
 
     if (!shell->interactive)
         return;
@@ -80,34 +320,45 @@ void job_control_init(Shell *shell)
     signal(SIGTTOU, SIG_IGN);
     signal(SIGQUIT, SIG_IGN);
 
-    /* Set up SIGCHLD handler */
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = sigchld_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    sigaction(SIGCHLD, &sa, NULL);
-
-    /* Store global pointer for the signal handler */
-    g_shell = shell;
+    /* SIGCHLD is never delivered asynchronously: it stays blocked and is
+     * read from a signalfd, which the line editor polls next to the
+     * terminal. Children get an empty mask back before exec. */
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &chld, NULL) == 0) {
+        shell->jobs->event_fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (shell->jobs->event_fd < 0)
+            sigprocmask(SIG_UNBLOCK, &chld, NULL);
+    }
 }
 
-void sigchld_handler(int sig)
+int job_event_fd(Shell *shell)
 {
-    (void)sig;
+    if (!shell || !shell->jobs)
+        return -1;
+    return shell->jobs->event_fd;
+}
 
-    if (!g_shell)
+void job_reap(Shell *shell)
+{
+    if (!shell || !shell->jobs)
         return;
 
-    int saved_errno = errno;
-    int status;
-    pid_t pid;
-
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
-        job_update_status(g_shell, pid, status);
+    /* The signalfd only says "something changed"; waitpid finds what */
+    int fd = shell->jobs->event_fd;
+    if (fd >= 0) {
+        struct signalfd_siginfo info[8];
+        while (read(fd, info, sizeof(info)) > 0)
+            ;
     }
 
-    errno = saved_errno;
+    int status;
+    struct rusage usage;
+    pid_t pid;
+    while ((pid = reap(shell, &status, WNOHANG | WUNTRACED | WCONTINUED,
+                       &usage)) > 0)
+        job_update_status(shell, pid, status, &usage);
 }
 
 Job *job_add(Shell *shell, pid_t pgid, pid_t *pids, int npids,
@@ -116,30 +367,59 @@ Job *job_add(Shell *shell, pid_t pgid, pid_t *pids, int npids,
     if (!shell || !shell->jobs)
         return NULL;
 
+    JobTable *jt = shell->jobs;
+    if (!pid_map_reserve(jt, npids))
+        return NULL;
+
     Job *job = malloc(sizeof(Job));
     if (!job)
         return NULL;
 
-    job->id = shell->jobs->next_id++;
+    /* Numbers restart above the newest live job, so they stay small when
+     * jobs come and go (the head always has the highest id) */
+    jt->next_id = jt->head ? jt->head->id + 1 : 1;
+    job->id = jt->next_id++;
     job->pgid = pgid;
 
     /* Copy the PID array */
-    job->pids = malloc((size_t)npids * sizeof(pid_t));
-    if (!job->pids) {
+    job->pids  = malloc((size_t)npids * sizeof(pid_t));
+    job->links = malloc((size_t)npids * sizeof(JobPid));
+    if (!job->pids || !job->links) {
+        free(job->pids);
+        free(job->links);
         free(job);
         return NULL;
     }
     memcpy(job->pids, pids, (size_t)npids * sizeof(pid_t));
-    job->npids = npids;
+    job->npids  = npids;
+    job->nalive = npids;
+    job->status = 0;
+
+    for (int i = 0; i < npids; i++) {
+        JobPid *e = &job->links[i];
+        unsigned h = pid_hash(pids[i], jt->nbuckets);
+        e->pid   = pids[i];
+        e->job   = job;
+        e->index = i;
+        e->next  = jt->by_pid[h];
+        jt->by_pid[h] = e;
+        jt->nlinks++;
+    }
 
     job->state      = JOB_RUNNING;
     job->command    = strdup(command ? command : "");
     job->notified   = false;
     job->foreground = foreground;
+    job->start_ns   = stats_now();
+    job->end_ns     = 0;
+    job->cpu_us     = 0;
+    job->max_rss_kb = 0;
+    job->sample_ns  = 0;
+    job->sample_cpu_us = 0;
 
     /* Prepend to the list */
-    job->next = shell->jobs->head;
-    shell->jobs->head = job;
+    job->next = jt->head;
+    jt->head = job;
 
     return job;
 }
@@ -154,9 +434,7 @@ void job_remove(Shell *shell, int job_id)
         Job *j = *pp;
         if (j->id == job_id) {
             *pp = j->next;
-            free(j->pids);
-            free(j->command);
-            free(j);
+            job_free(shell->jobs, j);
             return;
         }
         pp = &j->next;
@@ -192,13 +470,8 @@ Job *job_find_by_pid(Shell *shell, pid_t pid)
     if (!shell || !shell->jobs)
         return NULL;
 
-    for (Job *j = shell->jobs->head; j; j = j->next) {
-        for (int i = 0; i < j->npids; i++) {
-            if (j->pids[i] == pid)
-                return j;
-        }
-    }
-    return NULL;
+    JobPid *e = pid_map_find(shell->jobs, pid);
+    return e ? e->job : NULL;
 }
 
 Job *job_most_recent(Shell *shell)
@@ -214,14 +487,16 @@ Job *job_most_recent(Shell *shell)
     return best;
 }
 
-void job_update_status(Shell *shell, pid_t pid, int status)
+void job_update_status(Shell *shell, pid_t pid, int status,
+                       const struct rusage *usage)
 {
-    if (!shell)
+    if (!shell || !shell->jobs)
         return;
 
-    Job *job = job_find_by_pid(shell, pid);
-    if (!job)
+    JobPid *link = pid_map_find(shell->jobs, pid);
+    if (!link)
         return;
+    Job *job = link->job;
 
     if (WIFSTOPPED(status)) {
         job->state = JOB_STOPPED;
@@ -230,30 +505,30 @@ void job_update_status(Shell *shell, pid_t pid, int status)
         job->state = JOB_RUNNING;
         job->notified = false;
     } else if (WIFEXITED(status) || WIFSIGNALED(status)) {
-        /* Mark this PID as finished by zeroing it.  When all PIDs are done
-         * the job is complete. */
-        for (int i = 0; i < job->npids; i++) {
-            if (job->pids[i] == pid) {
-                job->pids[i] = 0;
-                break;
-            }
-        }
-
-        /* Check if all processes in the pipeline are finished */
-        bool all_done = true;
-        for (int i = 0; i < job->npids; i++) {
-            if (job->pids[i] != 0) {
-                all_done = false;
-                break;
-            }
+        /* A reaped PID leaves the map and its slot is zeroed */
+        pid_map_unlink(shell->jobs, link);
+        job->pids[link->index] = 0;
+        if (link->index == job->npids - 1)
+            job->status = status;
+        if (usage) {
+            job->cpu_us += (uint64_t)usage->ru_utime.tv_sec * 1000000 +
+                           (uint64_t)usage->ru_utime.tv_usec +
+                           (uint64_t)usage->ru_stime.tv_sec * 1000000 +
+                           (uint64_t)usage->ru_stime.tv_usec;
+            if (usage->ru_maxrss > job->max_rss_kb)
+                job->max_rss_kb = usage->ru_maxrss;
         }
 
-        if (all_done) {
-            if (WIFSIGNALED(status))
+        if (--job->nalive == 0) {
+            job->end_ns = stats_now();
+            /* A pipeline's outcome is that of its last stage */
+            if (WIFSIGNALED(job->status))
                 job->state = JOB_KILLED;
             else
                 job->state = JOB_DONE;
             job->notified = false;
+            if (!job->foreground)
+                shell->jobs->pending++;
         }
     }
 }
@@ -263,25 +538,13 @@ int job_wait_foreground(Shell *shell, Job *job)
     if (!shell || !job)
         return -1;
 
-    int status = 0;
-
     /* Give the terminal to the job's process group */
+    uint64_t t = stats_now();
     if (shell->interactive)
         tcsetpgrp(STDIN_FILENO, job->pgid);
 
-    /* Wait for the job to stop or finish */
-    pid_t pid;
-    while (job->state == JOB_RUNNING) {
-        pid = waitpid(-job->pgid, &status, WUNTRACED);
-        if (pid < 0) {
-            if (errno == ECHILD)
-                break;
-            if (errno == EINTR)
-                continue;
-            break;
-        }
-        job_update_status(shell, pid, status);
-    }
+    wait_while_running(shell, job);
+    stats_since(shell->stats, STAT_WAIT, t);
 
     /* Restore the shell to the foreground */
     if (shell->interactive)
@@ -291,14 +554,30 @@ int job_wait_foreground(Shell *shell, Job *job)
         fprintf(stderr, "\n[%d]+  Stopped                 %s\n",
                 job->id, job->command);
         job->notified = true;
+        return 128 + SIGTSTP;
     }
 
-    /* Extract exit code */
-    if (WIFEXITED(status))
-        return WEXITSTATUS(status);
-    if (WIFSIGNALED(status))
-        return 128 + WTERMSIG(status);
-    return status;
+    /* A finished foreground job has nothing left to report */
+    int code = exit_code(job->status);
+    if (job->state == JOB_DONE || job->state == JOB_KILLED)
+        job_remove(shell, job->id);
+    return code;
+}
+
+int job_wait(Shell *shell, Job *job)
+{
+    if (!shell || !job)
+        return -1;
+
+    wait_while_running(shell, job);
+    if (job->state == JOB_STOPPED)
+        return 128 + SIGTSTP;
+
+    /* Waiting for a job counts as being told about it */
+    int code = exit_code(job->status);
+    if (job->state == JOB_DONE || job->state == JOB_KILLED)
+        job_remove(shell, job->id);
+    return code;
 }
 
 int job_continue_foreground(Shell *shell, Job *job)
@@ -340,18 +619,34 @@ void job_check_background(Shell *shell)
     if (!shell || !shell->jobs)
         return;
 
+    job_reap(shell);
+    if (shell->jobs->pending == 0)
+        return;
+
     Job *j = shell->jobs->head;
     while (j) {
         Job *next = j->next;  /* save — we may remove j */
 
         if ((j->state == JOB_DONE || j->state == JOB_KILLED) && !j->notified) {
-            fprintf(stderr, "[%d]   %-24s%s\n",
-                    j->id, job_state_str(j->state), j->command);
+            if (shell->opt_jobstats) {
+                char elapsed[32], cpu[32], rss[32];
+                format_elapsed(elapsed, sizeof(elapsed), j->end_ns - j->start_ns);
+                stats_format_ns(cpu, sizeof(cpu), j->cpu_us * 1000);
+                stats_format_bytes(rss, sizeof(rss),
+                                   (unsigned long long)j->max_rss_kb * 1024);
+                fprintf(stderr, "[%d]   %-24s%s  (%s, cpu %s, peak %s)\n",
+                        j->id, job_state_str(j->state), j->command,
+                        elapsed, cpu, rss);
+            } else {
+                fprintf(stderr, "[%d]   %-24s%s\n",
+                        j->id, job_state_str(j->state), j->command);
+            }
             job_remove(shell, j->id);
         }
 
         j = next;
     }
+    shell->jobs->pending = 0;
 }
 
 void job_list_print(Shell *shell)
@@ -379,11 +674,83 @@ void job_list_print(Shell *shell)
         if (j == recent)
             marker = '+';
 
-        fprintf(stdout, "[%d]%c  %-24s%s\n",
-                j->id, marker, job_state_str(j->state), j->command);
+        out_printf(shell->out, "[%d]%c  %-24s%s\n",
+                   j->id, marker, job_state_str(j->state), j->command);
+    }
+}
+
+void job_stats_print(Shell *shell)
+{
+    if (!shell || !shell->jobs)
+        return;
+
+    int max_id = 0;
+    for (Job *j = shell->jobs->head; j; j = j->next) {
+        if (j->id > max_id)
+            max_id = j->id;
+    }
+    if (max_id == 0)
+        return;
+
+    out_printf(shell->out, "%-7s%-10s%7s %8s %9s  %s\n",
+               "JOB", "STATE", "CPU%", "RSS", "ELAPSED", "COMMAND");
+    uint64_t now = stats_now();
+    Job *recent = job_most_recent(shell);
+    for (int id = 1; id <= max_id; id++) {
+        Job *j = job_find_by_id(shell, id);
+        if (!j)
+            continue;
+
+        /* Reaped processes are booked already; add the ones still alive */
+        uint64_t cpu_us = j->cpu_us;
+        long     rss_kb = 0;
+        for (int i = 0; i < j->npids; i++) {
+            if (j->pids[i] != 0)
+                proc_sample_tree(j->pids[i], &cpu_us, &rss_kb, 0);
+        }
+        if (j->nalive == 0)
+            rss_kb = j->max_rss_kb;     /* Peak, with nothing left resident */
+
+        uint64_t end  = j->end_ns ? j->end_ns : now;
+        uint64_t from = j->start_ns, base = 0;
+        if (j->sample_ns && j->nalive > 0 &&
+            now - j->sample_ns >= JOB_SAMPLE_MIN_NS) {
+            from = j->sample_ns;
+            base = j->sample_cpu_us;
+        }
+        double wall_us = (double)(end - from) / 1e3;
+        double pct = wall_us > 0 && cpu_us >= base
+                   ? (double)(cpu_us - base) * 100.0 / wall_us : 0.0;
+        if (!j->sample_ns || now - j->sample_ns >= JOB_SAMPLE_MIN_NS) {
+            j->sample_ns     = now;
+            j->sample_cpu_us = cpu_us;
+        }
+
+        char tag[16], rss[32], elapsed[32];
+        snprintf(tag, sizeof(tag), "[%d]%c", j->id, j == recent ? '+' : ' ');
+        stats_format_bytes(rss, sizeof(rss), (unsigned long long)rss_kb * 1024);
+        format_elapsed(elapsed, sizeof(elapsed), end - j->start_ns);
+        out_printf(shell->out, "%-7s%-10s%6.1f%% %8s %9s  %s\n",
+                   tag, job_state_str(j->state), pct, rss, elapsed, j->command);
     }
 }
 
+void job_child_reset_signals(void)
+{
+    signal(SIGINT,  SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+
+    /* The shell keeps SIGCHLD blocked for its signalfd */
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+}
+
 void job_table_destroy(Shell *shell)
 {
     if (!shell || !shell->jobs)
@@ -399,11 +766,16 @@ void job_table_destroy(Shell *shell)
             waitpid(-j->pgid, NULL, 0);
         }
 
-        free(j->pids);
-        free(j->command);
-        free(j);
+        job_free(shell->jobs, j);
         j = next;
     }
 
     shell->jobs->head = NULL;
+    free(shell->jobs->by_pid);
+    shell->jobs->by_pid   = NULL;
+    shell->jobs->nbuckets = 0;
+    if (shell->jobs->event_fd >= 0) {
+        close(shell->jobs->event_fd);
+        shell->jobs->event_fd = -1;
+    }
 }
@@ -6,6 +6,17 @@
  * backslash escapes, multi-character operators, fd-prefixed redirections,
  * comments, and keyword recognition. All token storage is arena-allocated
  * so the entire token list is freed in one shot with the parse arena.
+ *
+ * Command substitutions and ${...} are copied into the word verbatim, up
+ * to their matching close, and expanded together with the rest of it.
+ *
+ * Here-documents are read in line with the token stream: the operator
+ * queues a HereDoc, and the newline that ends its line is followed by the
+ * bodies of every queued document, in order, up to their delimiters.
+ *
+ * Bytes are classified through a 256-entry table. Runs of plain word bytes
+ * and blanks are skipped 16 at a time with SSE2 or NEON where available,
+ * and copied into the word with a single append.
  * ============================================================================ */
 
 #include "lexer.h"
@@ -15,6 +26,163 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define LEX_SIMD_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LEX_SIMD_NEON 1
+#endif
+
+/* ---- Character classes -------------------------------------------------- */
+
+enum {
+    CC_WORD = 0,    /* Copied into the word as-is */
+    CC_BLANK,       /* Space, tab */
+    CC_BREAK,       /* Ends a word: newline, operators, '#' */
+    CC_QUOTE,       /* ' " \ */
+    CC_SUBST,       /* $ ` */
+    CC_GLOB,        /* * ? [ */
+    CC_TILDE        /* ~ */
+};
+
+static const unsigned char char_class[256] = {
+    ['\t'] = CC_BLANK, [' ']  = CC_BLANK,
+    ['\n'] = CC_BREAK, ['|']  = CC_BREAK, ['&'] = CC_BREAK, [';'] = CC_BREAK,
+    ['<']  = CC_BREAK, ['>']  = CC_BREAK, ['('] = CC_BREAK, [')'] = CC_BREAK,
+    ['{']  = CC_BREAK, ['}']  = CC_BREAK, ['#'] = CC_BREAK,
+    ['\''] = CC_QUOTE, ['"']  = CC_QUOTE, ['\\'] = CC_QUOTE,
+    ['$']  = CC_SUBST, ['`']  = CC_SUBST,
+    ['*']  = CC_GLOB,  ['?']  = CC_GLOB,  ['['] = CC_GLOB,
+    ['~']  = CC_TILDE,
+};
+
+#define CHAR_CLASS(c) char_class[(unsigned char)(c)]
+
+#if LEX_SIMD_SSE2
+
+/* Lanes of v within [lo, lo + span] */
+static inline __m128i lanes_in(__m128i v, unsigned char lo, unsigned char span)
+{
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8((char)lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8((char)span)), d);
+}
+
+static inline __m128i lanes_eq(__m128i v, char c)
+{
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+/* Bit i set where p[i] may not be CC_WORD. Control bytes are reported
+ * too; callers recheck the first hit against the table. */
+static inline unsigned int word_stop_mask(const char *p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i m = _mm_or_si128(lanes_in(v, 0x00, 0x2a),   /* ctl .. '*' */
+                             lanes_in(v, ';', 4));      /* ; < = > ? */
+    m = _mm_or_si128(m, lanes_in(v, '[', 1));           /* [ \ */
+    m = _mm_or_si128(m, lanes_in(v, '{', 3));           /* { | } ~ */
+    m = _mm_or_si128(m, lanes_eq(v, '`'));
+    __m128i ok = _mm_or_si128(lanes_eq(v, '!'), lanes_eq(v, '%'));
+    ok = _mm_or_si128(ok, lanes_eq(v, '='));
+    return (unsigned int)_mm_movemask_epi8(_mm_andnot_si128(ok, m));
+}
+
+/* Bit i set where p[i] is not a blank */
+static inline unsigned int blank_stop_mask(const char *p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i b = _mm_or_si128(lanes_eq(v, ' '), lanes_eq(v, '\t'));
+    return (unsigned int)_mm_movemask_epi8(b) ^ 0xffffu;
+}
+
+#define MASK_INDEX(m) ((size_t)__builtin_ctz(m))
+
+#elif LEX_SIMD_NEON
+
+static inline uint8x16_t lanes_in(uint8x16_t v, uint8_t lo, uint8_t span)
+{
+    return vcleq_u8(vsubq_u8(v, vdupq_n_u8(lo)), vdupq_n_u8(span));
+}
+
+static inline uint8x16_t lanes_eq(uint8x16_t v, uint8_t c)
+{
+    return vceqq_u8(v, vdupq_n_u8(c));
+}
+
+/* Four bits per lane: narrowing each 16-bit pair keeps a nibble of each */
+static inline uint64_t lanes_mask(uint8x16_t m)
+{
+    uint8x8_t nib = vshrn_n_u16(vreinterpretq_u16_u8(m), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nib), 0);
+}
+
+static inline uint64_t word_stop_mask(const char *p)
+{
+    uint8x16_t v = vld1q_u8((const uint8_t *)p);
+    uint8x16_t m = vorrq_u8(lanes_in(v, 0x00, 0x2a), lanes_in(v, ';', 4));
+    m = vorrq_u8(m, lanes_in(v, '[', 1));
+    m = vorrq_u8(m, lanes_in(v, '{', 3));
+    m = vorrq_u8(m, lanes_eq(v, '`'));
+    uint8x16_t ok = vorrq_u8(lanes_eq(v, '!'), lanes_eq(v, '%'));
+    ok = vorrq_u8(ok, lanes_eq(v, '='));
+    return lanes_mask(vbicq_u8(m, ok));
+}
+
+static inline uint64_t blank_stop_mask(const char *p)
+{
+    uint8x16_t v = vld1q_u8((const uint8_t *)p);
+    uint8x16_t b = vorrq_u8(lanes_eq(v, ' '), lanes_eq(v, '\t'));
+    return lanes_mask(vmvnq_u8(b));
+}
+
+#define MASK_INDEX(m) ((size_t)__builtin_ctzll(m) >> 2)
+
+#endif
+
+/* Length of the run of CC_WORD bytes at the start of s[0..n) */
+static size_t span_word(const char *s, size_t n)
+{
+    size_t i = 0;
+#if LEX_SIMD_SSE2 || LEX_SIMD_NEON
+    while (i + 16 <= n) {
+        uint64_t m = word_stop_mask(s + i);
+        if (m == 0) {
+            i += 16;
+            continue;
+        }
+        i += MASK_INDEX(m);
+        if (CHAR_CLASS(s[i]) != CC_WORD)
+            return i;
+        i++;                    /* A control byte: keep going */
+    }
+#endif
+    while (i < n && CHAR_CLASS(s[i]) == CC_WORD)
+        i++;
+    return i;
+}
+
+/* Length of the run of blanks at the start of s[0..n) */
+static size_t span_blank(const char *s, size_t n)
+{
+    if (n == 0 || CHAR_CLASS(s[0]) != CC_BLANK)
+        return 0;
+
+    size_t i = 1;
+#if LEX_SIMD_SSE2 || LEX_SIMD_NEON
+    while (i + 16 <= n) {
+        uint64_t m = blank_stop_mask(s + i);
+        if (m != 0)
+            return i + MASK_INDEX(m);
+        i += 16;
+    }
+#endif
+    while (i < n && CHAR_CLASS(s[i]) == CC_BLANK)
+        i++;
+    return i;
+}
 
 /* ---- Internal helpers --------------------------------------------------- */
 
@@ -49,12 +217,38 @@ static inline void lex_advance(Lexer *lex)
     }
 }
 
+/* Advance over n bytes that contain no newline */
+static inline void lex_skip(Lexer *lex, size_t n)
+{
+    lex->pos += (int)n;
+    lex->col += (int)n;
+}
+
+/* Advance over n bytes, which may span lines */
+static void lex_consume(Lexer *lex, size_t n)
+{
+    const char *p   = lex->input + lex->pos;
+    const char *end = p + n;
+    const char *nl;
+
+    while ((nl = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        lex->line++;
+        p = nl + 1;
+        lex->col = 1;
+    }
+    lex->col += (int)(end - p);
+    lex->pos += (int)n;
+}
+
 /* Create a token with the given type and value */
 static Token make_token(TokenType type, const char *value, int line, int col)
 {
     Token tok;
     tok.type     = type;
     tok.value    = (char *)value;
+    tok.word_flags = 0;
+    tok.quoted   = false;
+    tok.heredoc  = NULL;
     tok.redir_fd = -1;
     tok.line     = line;
     tok.col      = col;
@@ -75,21 +269,17 @@ static void lex_error(Lexer *lex, const char *msg)
 /* Skip whitespace (spaces and tabs only, NOT newlines) */
 static void skip_whitespace(Lexer *lex)
 {
-    while (lex->pos < lex->len) {
-        char c = lex->input[lex->pos];
-        if (c == ' ' || c == '\t') {
-            lex_advance(lex);
-        } else {
-            break;
-        }
-    }
+    lex_skip(lex, span_blank(lex->input + lex->pos,
+                             (size_t)(lex->len - lex->pos)));
 }
 
 /* Skip a comment: '#' through end of line (do not consume newline) */
 static void skip_comment(Lexer *lex)
 {
-    while (lex->pos < lex->len && lex->input[lex->pos] != '\n')
-        lex_advance(lex);
+    const char *p  = lex->input + lex->pos;
+    size_t      n  = (size_t)(lex->len - lex->pos);
+    const char *nl = memchr(p, '\n', n);
+    lex_skip(lex, nl ? (size_t)(nl - p) : n);
 }
 
 /* ---- Keyword table ------------------------------------------------------ */
@@ -111,14 +301,18 @@ static const KeywordEntry keywords[] = {
     { "done",     TOK_DONE     },
     { "in",       TOK_IN       },
     { "function", TOK_FUNCTION },
-    { "return",   TOK_RETURN   },
-    { "local",    TOK_LOCAL    },
+    { "time",     TOK_TIME     },
+    /* return and local are builtins, not reserved words: they lex as WORD */
     { NULL,       TOK_WORD     }
 };
 
+#define KEYWORD_MAX_LEN 8
+
 /* Check if a completed word matches a shell keyword; return its type */
-static TokenType check_keyword(const char *word)
+static TokenType check_keyword(const char *word, size_t len)
 {
+    if (len < 2 || len > KEYWORD_MAX_LEN)
+        return TOK_WORD;
     for (const KeywordEntry *kw = keywords; kw->name; kw++) {
         if (strcmp(word, kw->name) == 0)
             return kw->type;
@@ -128,28 +322,35 @@ static TokenType check_keyword(const char *word)
 
 /* ---- TokenList helpers -------------------------------------------------- */
 
-#define TOKLIST_INIT_CAP 32
+#define TOKLIST_INIT_CAP   32
+#define TOKLIST_BYTES_PER  4    /* Input bytes per token, roughly, in scripts */
 
-static TokenList *toklist_new(Arena *arena)
+/* Size the list from the input length so a script rarely regrows it */
+static TokenList *toklist_new(Arena *arena, int input_len)
 {
     TokenList *list = arena_alloc(arena, sizeof(TokenList));
     if (!list)
         return NULL;
 
-    list->tokens   = arena_alloc(arena, sizeof(Token) * TOKLIST_INIT_CAP);
+    int cap = input_len / TOKLIST_BYTES_PER + 1;
+    if (cap < TOKLIST_INIT_CAP)
+        cap = TOKLIST_INIT_CAP;
+    list->tokens   = arena_alloc(arena, sizeof(Token) * (size_t)cap);
     list->count    = 0;
-    list->capacity = TOKLIST_INIT_CAP;
+    list->capacity = list->tokens ? cap : 0;
     return list;
 }
 
 static bool toklist_add(TokenList *list, Token tok, Arena *arena)
 {
     if (list->count >= list->capacity) {
-        int new_cap = list->capacity * 2;
-        Token *new_tokens = arena_alloc(arena, sizeof(Token) * new_cap);
+        int new_cap = list->capacity > 0 ? list->capacity * 2
+                                         : TOKLIST_INIT_CAP;
+        Token *new_tokens = arena_resize(arena, list->tokens,
+                                         sizeof(Token) * (size_t)list->capacity,
+                                         sizeof(Token) * (size_t)new_cap);
         if (!new_tokens)
             return false;
-        memcpy(new_tokens, list->tokens, sizeof(Token) * list->count);
         list->tokens   = new_tokens;
         list->capacity = new_cap;
     }
@@ -157,6 +358,135 @@ static bool toklist_add(TokenList *list, Token tok, Arena *arena)
     return true;
 }
 
+/* ---- Substitutions ------------------------------------------------------ */
+
+/* Length of a quoted section starting at s[0] (a ' or "), including both
+ * quotes, or 0 if it is not closed within n bytes. */
+static size_t scan_quoted(const char *s, size_t n)
+{
+    char q = s[0];
+    size_t i = 1;
+    while (i < n && s[i] != q) {
+        if (q == '"' && s[i] == '\\' && i + 1 < n) {
+            i += 2;
+            continue;
+        }
+        if (q == '"' && (s[i] == '`' ||
+                         (s[i] == '$' && i + 1 < n &&
+                          (s[i + 1] == '(' || s[i + 1] == '{')))) {
+            size_t sub = lexer_scan_subst(s + i, n - i);
+            if (sub == 0)
+                return 0;
+            i += sub;
+            continue;
+        }
+        i++;
+    }
+    return i < n ? i + 1 : 0;
+}
+
+size_t lexer_scan_subst(const char *s, size_t n)
+{
+    if (n == 0)
+        return 0;
+
+    if (s[0] == '`') {
+        for (size_t i = 1; i < n; i++) {
+            if (s[i] == '\\')
+                i++;
+            else if (s[i] == '`')
+                return i + 1;
+        }
+        return 0;
+    }
+
+    if (n < 2 || s[0] != '$' || (s[1] != '(' && s[1] != '{'))
+        return 0;
+
+    char open  = s[1];
+    char close = open == '(' ? ')' : '}';
+    int  depth = 1;
+    size_t i = 2;
+    while (i < n) {
+        char c = s[i];
+        if (c == '\\') {
+            i += 2;
+            continue;
+        }
+        if (c == '\'' || c == '"') {
+            size_t q = scan_quoted(s + i, n - i);
+            if (q == 0)
+                return 0;
+            i += q;
+            continue;
+        }
+        if (c == '`' || (c == '$' && i + 1 < n &&
+                         (s[i + 1] == '(' || s[i + 1] == '{'))) {
+            size_t sub = lexer_scan_subst(s + i, n - i);
+            if (sub == 0)
+                return 0;
+            i += sub;
+            continue;
+        }
+        if (c == open) {
+            depth++;
+        } else if (c == close && --depth == 0) {
+            return i + 1;
+        }
+        i++;
+    }
+    return 0;
+}
+
+/* Copy a substitution starting at the current position into buf verbatim;
+ * it is expanded when the word is. Returns false (with the lexer marked
+ * incomplete) if it is not terminated. */
+static bool lex_substitution(Lexer *lex, ArenaString *buf)
+{
+    size_t n = lexer_scan_subst(lex->input + lex->pos,
+                                (size_t)(lex->len - lex->pos));
+    if (n == 0) {
+        lex_error(lex, lex_cur(lex) == '`' || lex_peek(lex, 1) == '('
+                           ? "unterminated command substitution"
+                           : "unterminated ${...}");
+        lex->incomplete = true;
+        return false;
+    }
+    astr_append_n(buf, lex->input + lex->pos, n);
+    lex_consume(lex, n);
+    return true;
+}
+
+/* Current position starts a $(...), ${...} or `...` construct */
+static inline bool at_substitution(const Lexer *lex)
+{
+    char c = lex_cur(lex);
+    if (c == '`')
+        return true;
+    return c == '$' && (lex_peek(lex, 1) == '(' || lex_peek(lex, 1) == '{');
+}
+
+/* Length of a ((expr)) arithmetic command at the current position, or 0.
+ * The two opening parentheses must close together: "((a) | (b))" is a
+ * subshell within a subshell. */
+static size_t arith_command_len(const Lexer *lex)
+{
+    const char *s = lex->input + lex->pos;
+    size_t n = (size_t)(lex->len - lex->pos);
+    if (n < 4 || s[1] != '(')
+        return 0;
+
+    int depth = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] == '(') {
+            depth++;
+        } else if (s[i] == ')' && --depth == 1) {
+            return i + 1 < n && s[i + 1] == ')' ? i + 2 : 0;
+        }
+    }
+    return 0;
+}
+
 /* ---- Word building ------------------------------------------------------ */
 
 /* Build a WORD token by accumulating characters from the input.
@@ -167,30 +497,50 @@ static Token build_word(Lexer *lex)
     int start_line = lex->line;
     int start_col  = lex->col;
 
-    SafeString *buf = sstr_new(SSTR_INIT_CAP);
-    if (!buf) {
+    /* Built at the top of the arena: the word can grow where it is */
+    ArenaString buf;
+    astr_init(&buf, lex->arena, 16);
+    if (!buf.data) {
         lex_error(lex, "out of memory");
         return make_token(TOK_EOF, NULL, start_line, start_col);
     }
 
     bool in_quotes = false;  /* track if any quoting occurred */
-    (void)in_quotes;
+    unsigned char flags = 0; /* WORD_*, from the unquoted text */
 
     while (lex->pos < lex->len) {
-        char c = lex_cur(lex);
+        /* ---- Plain bytes: one append for the whole run ---- */
+        size_t run = span_word(lex->input + lex->pos,
+                               (size_t)(lex->len - lex->pos));
+        if (run > 0) {
+            astr_append_n(&buf, lex->input + lex->pos, run);
+            lex_skip(lex, run);
+            continue;
+        }
+
+        char c   = lex_cur(lex);
+        int  cls = CHAR_CLASS(c);
+
+        /* ---- Word-breaking characters ---- */
+        if (cls == CC_BLANK || cls == CC_BREAK)
+            break;
 
         /* ---- Single-quoted section ---- */
         if (c == '\'') {
             in_quotes = true;
             lex_advance(lex);  /* consume opening quote */
-            while (lex->pos < lex->len && lex_cur(lex) != '\'') {
-                sstr_append_char(buf, lex_cur(lex));
-                lex_advance(lex);
-            }
-            if (lex->pos >= lex->len) {
+            const char *body = lex->input + lex->pos;
+            const char *end  = memchr(body, '\'',
+                                      (size_t)(lex->len - lex->pos));
+            if (!end) {
+                astr_append_n(&buf, body, (size_t)(lex->len - lex->pos));
+                lex_consume(lex, (size_t)(lex->len - lex->pos));
                 lex_error(lex, "unterminated single quote");
+                lex->incomplete = true;
                 break;
             }
+            astr_append_n(&buf, body, (size_t)(end - body));
+            lex_consume(lex, (size_t)(end - body));
             lex_advance(lex);  /* consume closing quote */
             continue;
         }
@@ -211,21 +561,35 @@ static Token build_word(Lexer *lex)
                             /* line continuation: skip both backslash and newline */
                             lex_advance(lex);
                         } else {
-                            sstr_append_char(buf, next);
+                            astr_append_char(&buf, next);
                             lex_advance(lex);
                         }
                     } else {
                         /* literal backslash */
-                        sstr_append_char(buf, '\\');
+                        astr_append_char(&buf, '\\');
                         lex_advance(lex);
                     }
-                } else {
-                    sstr_append_char(buf, dc);
+                } else if (at_substitution(lex)) {
+                    flags |= WORD_EXPAND;
+                    if (!lex_substitution(lex, &buf))
+                        break;
+                } else if (dc == '$') {
+                    flags |= WORD_EXPAND;
+                    astr_append_char(&buf, dc);
                     lex_advance(lex);
+                } else {
+                    /* Input is NUL-terminated at len */
+                    const char *text = lex->input + lex->pos;
+                    size_t n = strcspn(text, "\"\\$`");
+                    astr_append_n(&buf, text, n);
+                    lex_consume(lex, n);
                 }
             }
+            if (lex->error)
+                break;
             if (lex->pos >= lex->len) {
                 lex_error(lex, "unterminated double quote");
+                lex->incomplete = true;
                 break;
             }
             lex_advance(lex);  /* consume closing quote */
@@ -234,6 +598,7 @@ static Token build_word(Lexer *lex)
 
         /* ---- Backslash escape (outside quotes) ---- */
         if (c == '\\') {
+            in_quotes = true;
             char next = lex_peek(lex, 1);
             if (next == '\n') {
                 /* Line continuation: skip backslash and newline */
@@ -243,37 +608,150 @@ static Token build_word(Lexer *lex)
             }
             if (next == '\0') {
                 /* Backslash at end of input: treat as literal */
-                sstr_append_char(buf, '\\');
+                astr_append_char(&buf, '\\');
                 lex_advance(lex);
                 break;
             }
             lex_advance(lex);  /* consume backslash */
-            sstr_append_char(buf, lex_cur(lex));
+            astr_append_char(&buf, lex_cur(lex));
             lex_advance(lex);  /* consume escaped char */
             continue;
         }
 
-        /* ---- Word-breaking characters ---- */
-        if (c == ' ' || c == '\t' || c == '\n' ||
-            c == '|' || c == '&' || c == ';' ||
-            c == '>' || c == '<' || c == '(' || c == ')' ||
-            c == '{' || c == '}' || c == '#') {
-            break;
+        /* ---- $(...), ${...} and `...`: kept whole, expanded later ---- */
+        if (at_substitution(lex)) {
+            flags |= WORD_EXPAND | WORD_GLOB;
+            if (!lex_substitution(lex, &buf))
+                break;
+            continue;
         }
 
         /* ---- Regular character ---- */
-        sstr_append_char(buf, c);
+        if (cls == CC_SUBST)
+            flags |= WORD_EXPAND | WORD_GLOB;
+        else if (cls == CC_GLOB)
+            flags |= WORD_GLOB;
+        else if (cls == CC_TILDE && buf.len == 0 && !in_quotes)
+            flags |= WORD_TILDE;
+        astr_append_char(&buf, c);
         lex_advance(lex);
     }
 
-    /* Copy the word into the arena and free the SafeString */
-    char *value = arena_strdup(lex->arena, sstr_cstr(buf));
-    sstr_free(buf);
+    size_t len  = buf.len;
+    char *value = astr_finish(&buf);
+    lex->word_quoted = in_quotes;
 
     /* Check for keyword */
-    TokenType type = check_keyword(value);
+    TokenType type = value ? check_keyword(value, len) : TOK_WORD;
 
-    return make_token(type, value, start_line, start_col);
+    Token tok = make_token(type, value, start_line, start_col);
+    tok.word_flags = flags;
+    tok.quoted     = in_quotes;
+    return tok;
+}
+
+/* ---- Here-documents ----------------------------------------------------- */
+
+/* Lex a "<<", "<<-" or "<<<" operator; the position is on the first '<'.
+ * For a here-document the delimiter word is consumed too, and the body is
+ * queued to be read after the current line. */
+static Token lex_heredoc_op(Lexer *lex, int tok_line, int tok_col)
+{
+    lex_advance(lex);
+    lex_advance(lex);
+
+    if (lex_cur(lex) == '<') {
+        lex_advance(lex);
+        return make_token(TOK_REDIR_HERESTR, arena_strdup(lex->arena, "<<<"),
+                          tok_line, tok_col);
+    }
+
+    bool strip_tabs = false;
+    if (lex_cur(lex) == '-') {
+        strip_tabs = true;
+        lex_advance(lex);
+    }
+
+    Token tok = make_token(TOK_REDIR_HEREDOC,
+                           arena_strdup(lex->arena, strip_tabs ? "<<-" : "<<"),
+                           tok_line, tok_col);
+
+    skip_whitespace(lex);
+    char c = lex_cur(lex);
+    if (c == '\0' || c == '\n' || c == '|' || c == '&' || c == ';' ||
+        c == '<' || c == '>' || c == '(' || c == ')') {
+        lex_error(lex, "missing here-document delimiter");
+        return tok;
+    }
+
+    Token word = build_word(lex);
+    HereDoc *hd = arena_calloc(lex->arena, 1, sizeof(HereDoc));
+    if (!hd || !word.value) {
+        lex_error(lex, "out of memory");
+        return tok;
+    }
+    hd->delim      = word.value;
+    hd->expand     = !lex->word_quoted;
+    hd->strip_tabs = strip_tabs;
+
+    *lex->pending_tail = hd;
+    lex->pending_tail  = &hd->next;
+    tok.heredoc = hd;
+    return tok;
+}
+
+/* Read the bodies of all queued here-documents; the position is at the
+ * start of the line after their operators. */
+static void read_heredoc_bodies(Lexer *lex)
+{
+    while (lex->pending) {
+        HereDoc *hd = lex->pending;
+        size_t delim_len = strlen(hd->delim);
+        /* Built in the lexer's arena, where the body ends up anyway */
+        SafeString body;
+        bool ok    = sstr_init_arena(&body, lex->arena, SSTR_INIT_CAP);
+        bool found = false;
+
+        while (lex->pos < lex->len) {
+            const char *line = lex->input + lex->pos;
+            const char *nl = memchr(line, '\n', (size_t)(lex->len - lex->pos));
+            size_t len = nl ? (size_t)(nl - line) : (size_t)(lex->len - lex->pos);
+
+            /* Whole line at once: no newline inside, then one after it */
+            lex->pos += (int)len;
+            lex->col += (int)len;
+            if (nl) {
+                lex->pos++;
+                lex->line++;
+                lex->col = 1;
+            }
+
+            if (hd->strip_tabs) {
+                while (len > 0 && *line == '\t') {
+                    line++;
+                    len--;
+                }
+            }
+            if (len == delim_len && memcmp(line, hd->delim, len) == 0) {
+                found = true;
+                break;
+            }
+            if (ok) {
+                sstr_append_n(&body, line, len);
+                sstr_append_char(&body, '\n');
+            }
+        }
+
+        hd->body = ok ? sstr_data(&body) : arena_strdup(lex->arena, "");
+        lex->pending = hd->next;
+
+        if (!found) {
+            lex_error(lex, "unterminated here-document");
+            lex->incomplete = true;
+            lex->pending = NULL;
+        }
+    }
+    lex->pending_tail = &lex->pending;
 }
 
 /* ---- Public API --------------------------------------------------------- */
@@ -287,6 +765,10 @@ void lexer_init(Lexer *lex, const char *input, Arena *arena)
     lex->col   = 1;
     lex->arena = arena;
     lex->error = NULL;
+    lex->incomplete = false;
+    lex->word_quoted = false;
+    lex->pending = NULL;
+    lex->pending_tail = &lex->pending;
 }
 
 Token lexer_next(Lexer *lex)
@@ -298,8 +780,13 @@ Token lexer_next(Lexer *lex)
     int tok_col  = lex->col;
 
     /* EOF check */
-    if (lex->pos >= lex->len)
+    if (lex->pos >= lex->len) {
+        if (lex->pending) {
+            lex_error(lex, "unterminated here-document");
+            lex->incomplete = true;
+        }
         return make_token(TOK_EOF, NULL, tok_line, tok_col);
+    }
 
     char c = lex_cur(lex);
 
@@ -314,6 +801,8 @@ Token lexer_next(Lexer *lex)
     /* ---- Newline ---- */
     if (c == '\n') {
         lex_advance(lex);
+        if (lex->pending)
+            read_heredoc_bodies(lex);
         return make_token(TOK_NEWLINE, arena_strdup(lex->arena, "\n"),
                           tok_line, tok_col);
     }
@@ -336,22 +825,12 @@ Token lexer_next(Lexer *lex)
                                  arena_strdup(lex->arena, ">>"),
                                  tok_line, tok_col);
             } else if (lex_peek(lex, 1) == '&') {
-                /* 2>&1 style dup redirection */
+                /* 2>&1 style dup redirection; the target is the next word */
                 lex_advance(lex);
                 lex_advance(lex);
-                /* Capture the target fd/word after >& */
-                SafeString *dup_val = sstr_new(8);
-                while (lex->pos < lex->len &&
-                       !isspace((unsigned char)lex_cur(lex)) &&
-                       lex_cur(lex) != '|' && lex_cur(lex) != '&' &&
-                       lex_cur(lex) != ';' && lex_cur(lex) != '\n') {
-                    sstr_append_char(dup_val, lex_cur(lex));
-                    lex_advance(lex);
-                }
                 tok = make_token(TOK_REDIR_DUP,
-                                 arena_strdup(lex->arena, sstr_cstr(dup_val)),
+                                 arena_strdup(lex->arena, ">&"),
                                  tok_line, tok_col);
-                sstr_free(dup_val);
             } else {
                 lex_advance(lex);
                 tok = make_token(TOK_REDIR_OUT,
@@ -361,10 +840,12 @@ Token lexer_next(Lexer *lex)
         } else {
             /* op == '<' */
             if (lex_peek(lex, 1) == '<') {
+                tok = lex_heredoc_op(lex, tok_line, tok_col);
+            } else if (lex_peek(lex, 1) == '&') {
                 lex_advance(lex);
                 lex_advance(lex);
-                tok = make_token(TOK_REDIR_HEREDOC,
-                                 arena_strdup(lex->arena, "<<"),
+                tok = make_token(TOK_REDIR_DUP,
+                                 arena_strdup(lex->arena, "<&"),
                                  tok_line, tok_col);
             } else {
                 lex_advance(lex);
@@ -398,10 +879,13 @@ Token lexer_next(Lexer *lex)
         return make_token(TOK_REDIR_APPEND, arena_strdup(lex->arena, ">>"),
                           tok_line, tok_col);
     }
-    if (c == '<' && next == '<') {
+    if (c == '<' && next == '<')
+        return lex_heredoc_op(lex, tok_line, tok_col);
+    if ((c == '>' || c == '<') && next == '&') {
         lex_advance(lex);
         lex_advance(lex);
-        return make_token(TOK_REDIR_HEREDOC, arena_strdup(lex->arena, "<<"),
+        return make_token(TOK_REDIR_DUP,
+                          arena_strdup(lex->arena, c == '>' ? ">&" : "<&"),
                           tok_line, tok_col);
     }
 
@@ -432,6 +916,13 @@ Token lexer_next(Lexer *lex)
                           tok_line, tok_col);
     }
     if (c == '(') {
+        size_t n = arith_command_len(lex);
+        if (n > 0) {
+            char *expr = arena_strndup(lex->arena, lex->input + lex->pos + 2,
+                                       n - 4);
+            lex_consume(lex, n);
+            return make_token(TOK_ARITH, expr, tok_line, tok_col);
+        }
         lex_advance(lex);
         return make_token(TOK_LPAREN, arena_strdup(lex->arena, "("),
                           tok_line, tok_col);
@@ -480,7 +971,7 @@ Token lexer_peek(Lexer *lex)
 
 TokenList *lexer_tokenize(Lexer *lex)
 {
-    TokenList *list = toklist_new(lex->arena);
+    TokenList *list = toklist_new(lex->arena, lex->len - lex->pos);
     if (!list)
         return NULL;
 
@@ -499,7 +990,7 @@ TokenList *lexer_tokenize(Lexer *lex)
 
 bool token_is_keyword(TokenType type)
 {
-    return type >= TOK_IF && type <= TOK_LOCAL;
+    return type >= TOK_IF && type <= TOK_TIME;
 }
 
 const char *token_type_str(TokenType type)
@@ -515,6 +1006,7 @@ const char *token_type_str(TokenType type)
     case TOK_REDIR_OUT:     return "REDIR_OUT";
     case TOK_REDIR_APPEND:  return "REDIR_APPEND";
     case TOK_REDIR_HEREDOC: return "REDIR_HEREDOC";
+    case TOK_REDIR_HERESTR: return "REDIR_HERESTR";
     case TOK_REDIR_DUP:     return "REDIR_DUP";
     case TOK_LPAREN:        return "LPAREN";
     case TOK_RPAREN:        return "RPAREN";
@@ -532,9 +1024,11 @@ const char *token_type_str(TokenType type)
     case TOK_FUNCTION:      return "FUNCTION";
     case TOK_RETURN:        return "RETURN";
     case TOK_LOCAL:         return "LOCAL";
+    case TOK_TIME:          return "TIME";
     case TOK_LBRACE:        return "LBRACE";
     case TOK_RBRACE:        return "RBRACE";
     case TOK_BANG:          return "BANG";
+    case TOK_ARITH:         return "ARITH";
     case TOK_EOF:           return "EOF";
     }
     return "UNKNOWN";
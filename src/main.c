@@ -14,9 +14,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 
 static void print_version(void) {
-    printf("vsh 1.0.0 (Vanguard Shell)\n");
+    printf("vsh %s (Vanguard Shell)\n", VSH_VERSION_STRING);
     printf("A modern, memory-safe shell written in C\n");
 }
 
@@ -62,35 +63,27 @@ int main(int argc, char **argv) {
         }
     }
 
-    Shell *shell = shell_init(argc, argv);
+    /* Only a shell reading commands from a terminal is interactive: -c and
+     * scripts skip history, the prompt, job control and ~/.vshrc */
+    bool interactive = !opt_c && i >= argc && isatty(STDIN_FILENO);
+    Shell *shell = shell_create(argc, argv, interactive);
     int status;
 
     if (opt_c) {
         /* Execute a single command string */
         status = shell_exec_line(shell, cmd_string);
     } else if (i < argc) {
-        /* Script mode: read and execute commands from a file */
-        FILE *fp = fopen(argv[i], "r");
-        if (!fp) {
+        /* Script mode: parse the whole file once and run it */
+        char *src = shell_read_file(argv[i], NULL);
+        if (!src) {
             fprintf(stderr, "vsh: cannot open '%s': %s\n",
                     argv[i], strerror(errno));
             shell_destroy(shell);
             return 1;
         }
 
-        char line[4096];
-        shell->interactive = false;
-
-        while (fgets(line, sizeof(line), fp)) {
-            size_t len = strlen(line);
-            if (len > 0 && line[len - 1] == '\n') line[len - 1] = '\0';
-            if (line[0] == '#')  continue;   /* Skip comments */
-            if (line[0] == '\0') continue;   /* Skip empty lines */
-            shell_exec_line(shell, line);
-        }
-
-        fclose(fp);
-        status = shell->last_status;
+        status = shell_exec_script(shell, src, argv[i]);
+        free(src);
     } else {
         /* Interactive or piped-stdin mode */
         status = shell_run(shell);
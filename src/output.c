@@ -0,0 +1,150 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * output.c - Block-buffered output for builtins
+ *
+ * Small writes are copied into the block and go out together. A write
+ * that does not fit is either copied after a flush or, when it is at
+ * least half a block, sent straight from the caller's memory in one
+ * writev(2) with the buffered bytes in front of it.
+ * ============================================================================ */
+
+#include "output.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+/* ---- Construction / destruction ----------------------------------------- */
+
+OutBuf *out_create(int fd)
+{
+    OutBuf *out = malloc(sizeof(OutBuf));
+    if (!out)
+        return NULL;
+    out->fd    = fd;
+    out->error = 0;
+    out->len   = 0;
+    return out;
+}
+
+void out_destroy(OutBuf *out)
+{
+    if (!out)
+        return;
+    out_flush(out);
+    free(out);
+}
+
+/* ---- Writing ------------------------------------------------------------ */
+
+/* Write every byte of iov[0..cnt), retrying short writes. After a failure
+ * nothing more is written until the next flush reports it. */
+static void write_iov(OutBuf *out, struct iovec *iov, int cnt)
+{
+    while (cnt > 0 && out->error == 0) {
+        ssize_t n = writev(out->fd, iov, cnt);
+        if (n < 0) {
+            if (errno != EINTR)
+                out->error = errno;
+            continue;
+        }
+        size_t done = (size_t)n;
+        while (cnt > 0 && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+}
+
+void out_write(OutBuf *out, const void *data, size_t n)
+{
+    if (n <= OUT_BUF_SIZE - out->len) {
+        memcpy(out->data + out->len, data, n);
+        out->len += n;
+        return;
+    }
+
+    if (n < OUT_BUF_SIZE / 2) {
+        out_flush(out);
+        memcpy(out->data, data, n);
+        out->len = n;
+        return;
+    }
+
+    struct iovec iov[2] = {
+        { out->data, out->len },
+        { (void *)data, n },
+    };
+    int first = out->len ? 0 : 1;
+    write_iov(out, iov + first, 2 - first);
+    out->len = 0;
+}
+
+void out_puts(OutBuf *out, const char *s)
+{
+    out_write(out, s, strlen(s));
+}
+
+void out_printf(OutBuf *out, const char *fmt, ...)
+{
+    va_list ap;
+
+    /* Format in place; only if that does not fit, flush and try again */
+    for (int attempt = 0; attempt < 2; attempt++) {
+        size_t room = OUT_BUF_SIZE - out->len;
+        va_start(ap, fmt);
+        int n = vsnprintf(out->data + out->len, room, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return;
+        /* vsnprintf needs room for the NUL it always writes */
+        if ((size_t)n < room) {
+            out->len += (size_t)n;
+            return;
+        }
+        if (out->len == 0)
+            break;
+        out_flush(out);
+    }
+
+    /* Longer than the whole block */
+    va_start(ap, fmt);
+    char *text = NULL;
+    int n = vasprintf(&text, fmt, ap);
+    va_end(ap);
+    if (n >= 0) {
+        out_write(out, text, (size_t)n);
+        free(text);
+    }
+}
+
+void out_repeat(OutBuf *out, const char *s, int n)
+{
+    size_t len = strlen(s);
+    for (int i = 0; i < n; i++)
+        out_write(out, s, len);
+}
+
+int out_flush(OutBuf *out)
+{
+    if (out->len > 0) {
+        struct iovec iov = { out->data, out->len };
+        write_iov(out, &iov, 1);
+        out->len = 0;
+    }
+
+    if (out->error == 0)
+        return 0;
+    errno = out->error;
+    out->error = 0;
+    return -1;
+}
@@ -57,6 +57,7 @@ static void parser_error_at(Parser *parser, Token *tok, const char *msg)
         return; /* keep the first error */
 
     parser->had_error = true;
+    parser->incomplete = (tok->type == TOK_EOF);
 
     char buf[256];
     if (tok->type == TOK_EOF) {
@@ -83,6 +84,13 @@ static Token *expect(Parser *parser, TokenType type)
     return NULL;
 }
 
+/* In line mode, a NEWLINE at the outermost list ends the complete command. */
+static bool at_line_end(Parser *parser)
+{
+    return parser->line_mode && parser->depth == 1 &&
+           check(parser, TOK_NEWLINE);
+}
+
 /* Skip any NEWLINE tokens at the current position. */
 static void skip_newlines(Parser *parser)
 {
@@ -187,7 +195,7 @@ static bool is_redir(TokenType t)
 {
     return t == TOK_REDIR_IN || t == TOK_REDIR_OUT ||
            t == TOK_REDIR_APPEND || t == TOK_REDIR_HEREDOC ||
-           t == TOK_REDIR_DUP;
+           t == TOK_REDIR_HERESTR || t == TOK_REDIR_DUP;
 }
 
 /* Return true if the current token can start a command. */
@@ -196,7 +204,9 @@ static bool at_command_start(Parser *parser)
     TokenType t = cur_token(parser)->type;
     return t == TOK_WORD   || t == TOK_IF    || t == TOK_WHILE  ||
            t == TOK_FOR    || t == TOK_LBRACE || t == TOK_LPAREN ||
-           t == TOK_FUNCTION || t == TOK_BANG || is_redir(t);
+           t == TOK_FUNCTION || t == TOK_BANG || t == TOK_ARITH ||
+           t == TOK_TIME ||
+           is_redir(t);
 }
 
 /* ---- Parse functions ---------------------------------------------------- */
@@ -204,7 +214,8 @@ static bool at_command_start(Parser *parser)
 /*
  * parse_redirection - parse a redirection operator + target filename.
  *
- * Appends the new Redirection node to the front of cmd->redirs.
+ * Appends the new Redirection node to the end of cmd->redirs, so they are
+ * applied in source order. A here-document's body comes from the lexer.
  */
 static void parse_redirection(Parser *parser, CommandNode *cmd)
 {
@@ -231,6 +242,10 @@ static void parse_redirection(Parser *parser, CommandNode *cmd)
         rtype = REDIR_HEREDOC;
         default_fd = 0;
         break;
+    case TOK_REDIR_HERESTR:
+        rtype = REDIR_HERESTRING;
+        default_fd = 0;
+        break;
     case TOK_REDIR_DUP:
         /* Determine dup direction from the operator text. */
         if (op->value && op->value[0] == '<') {
@@ -246,17 +261,28 @@ static void parse_redirection(Parser *parser, CommandNode *cmd)
         return;
     }
 
-    /* Expect the target word. */
-    Token *target = expect(parser, TOK_WORD);
-    if (!target)
-        return;
-
     Redirection *redir = arena_calloc(parser->arena, 1, sizeof(Redirection));
-    redir->type   = rtype;
-    redir->fd     = (op->redir_fd >= 0) ? op->redir_fd : default_fd;
-    redir->target = arena_strdup(parser->arena, target->value);
-    redir->next   = cmd->redirs;
-    cmd->redirs   = redir;
+    redir->type = rtype;
+    redir->fd   = (op->redir_fd >= 0) ? op->redir_fd : default_fd;
+
+    if (rtype == REDIR_HEREDOC) {
+        /* The lexer already consumed the delimiter and read the body */
+        const HereDoc *hd = op->heredoc;
+        redir->target = (hd && hd->body) ? hd->body : "";
+        redir->expand = hd ? hd->expand : false;
+    } else {
+        /* Expect the target word. */
+        Token *target = expect(parser, TOK_WORD);
+        if (!target)
+            return;
+        redir->target = arena_strdup(parser->arena, target->value);
+        redir->expand = (rtype == REDIR_HERESTRING);
+    }
+
+    Redirection **tail = &cmd->redirs;
+    while (*tail)
+        tail = &(*tail)->next;
+    *tail = redir;
 }
 
 /*
@@ -271,6 +297,7 @@ static ASTNode *parse_simple_cmd(Parser *parser)
 
     int cap = 8;
     cmd->argv = arena_alloc(parser->arena, cap * sizeof(char *));
+    cmd->argv_flags = arena_alloc(parser->arena, cap);
     cmd->argc = 0;
     cmd->redirs = NULL;
 
@@ -279,7 +306,8 @@ static ASTNode *parse_simple_cmd(Parser *parser)
 
         if (is_redir(t)) {
             parse_redirection(parser, cmd);
-        } else if (t == TOK_WORD) {
+        } else if (t == TOK_WORD || (cmd->argc > 0 && token_is_keyword(t))) {
+            /* Reserved words are only special in command position */
             Token *tok = advance(parser);
             if (cmd->argc >= cap) {
                 int newcap = cap * 2;
@@ -287,8 +315,11 @@ static ASTNode *parse_simple_cmd(Parser *parser)
                                              newcap * sizeof(char *));
                 memcpy(newargv, cmd->argv, cmd->argc * sizeof(char *));
                 cmd->argv = newargv;
+                cmd->argv_flags = arena_resize(parser->arena, cmd->argv_flags,
+                                               (size_t)cap, (size_t)newcap);
                 cap = newcap;
             }
+            cmd->argv_flags[cmd->argc] = tok->word_flags;
             cmd->argv[cmd->argc++] = arena_strdup(parser->arena, tok->value);
         } else {
             break;
@@ -478,9 +509,11 @@ static ASTNode *parse_for(Parser *parser)
         /* Collect words until ';', NEWLINE, or 'do'. */
         int cap = 8;
         char **words = arena_alloc(parser->arena, cap * sizeof(char *));
+        unsigned char *flags = arena_alloc(parser->arena, cap);
         int nwords = 0;
 
-        while (check(parser, TOK_WORD)) {
+        /* `time` is only a keyword in front of a pipeline */
+        while (check(parser, TOK_WORD) || check(parser, TOK_TIME)) {
             Token *w = advance(parser);
             if (nwords >= cap) {
                 int newcap = cap * 2;
@@ -488,12 +521,16 @@ static ASTNode *parse_for(Parser *parser)
                                         newcap * sizeof(char *));
                 memcpy(nw, words, nwords * sizeof(char *));
                 words = nw;
+                flags = arena_resize(parser->arena, flags, (size_t)cap,
+                                     (size_t)newcap);
                 cap = newcap;
             }
+            flags[nwords] = w->word_flags;
             words[nwords++] = arena_strdup(parser->arena, w->value);
         }
 
         node->for_node.words = words;
+        node->for_node.word_flags = flags;
         node->for_node.nwords = nwords;
 
         /* Consume optional ';' or NEWLINE separating word list from 'do'. */
@@ -596,6 +633,13 @@ static ASTNode *parse_command(Parser *parser)
         return make_block_node(parser->arena, body);
     }
 
+    case TOK_ARITH: {
+        ASTNode *node = arena_calloc(parser->arena, 1, sizeof(ASTNode));
+        node->type = NODE_ARITH;
+        node->expr = advance(parser)->value;
+        return node;
+    }
+
     case TOK_LPAREN: {
         advance(parser);
         skip_newlines(parser);
@@ -631,29 +675,60 @@ static ASTNode *parse_command(Parser *parser)
     }
 }
 
+/* The report format after a `time` keyword: -p and -j are options only
+ * when they are plain words right after it */
+static TimeFormat parse_time_options(Parser *parser)
+{
+    TimeFormat format = TIME_TABLE;
+    while (check(parser, TOK_WORD) && !cur_token(parser)->quoted) {
+        const char *opt = cur_token(parser)->value;
+        if (strcmp(opt, "-p") == 0)
+            format = TIME_POSIX;
+        else if (strcmp(opt, "-j") == 0)
+            format = TIME_JSON;
+        else
+            break;
+        advance(parser);
+    }
+    return format;
+}
+
 /*
  * parse_pipeline - parse one or more commands separated by '|'.
  *
- * Optionally prefixed with '!' for negation.
- * If there is only one command and no negation, returns the command
+ * Optionally prefixed with 'time' and/or '!' for negation. A bare `time`
+ * (nothing after it) is a pipeline of no commands.
+ * If there is only one command and no prefix, returns the command
  * directly (avoids unnecessary pipeline wrapper).
  */
 static ASTNode *parse_pipeline(Parser *parser)
 {
+    TimeFormat timed = TIME_NONE;
+    if (check(parser, TOK_TIME)) {
+        advance(parser);
+        timed = parse_time_options(parser);
+    }
+
     bool negated = false;
     if (check(parser, TOK_BANG)) {
         advance(parser);
         negated = true;
     }
 
+    if (timed != TIME_NONE && !negated && !at_command_start(parser)) {
+        ASTNode *node = make_pipeline_node(parser->arena);
+        node->pipeline.timed = timed;
+        return node;
+    }
+
     ASTNode *first = parse_command(parser);
     if (parser->had_error) return NULL;
 
     /* Check for pipe operators. */
-    if (!check(parser, TOK_PIPE) && !negated)
+    if (!check(parser, TOK_PIPE) && !negated && timed == TIME_NONE)
         return first;
 
-    /* We have a pipeline (or negation). Collect all commands. */
+    /* We have a pipeline (or a prefix). Collect all commands. */
     int cap = 4;
     ASTNode **cmds = arena_alloc(parser->arena, cap * sizeof(ASTNode *));
     int count = 0;
@@ -676,11 +751,12 @@ static ASTNode *parse_pipeline(Parser *parser)
         cmds[count++] = cmd;
     }
 
-    /* If only one command but negated, wrap in pipeline for the flag. */
+    /* If only one command but prefixed, wrap in pipeline for the flags. */
     ASTNode *node = make_pipeline_node(parser->arena);
     node->pipeline.commands = cmds;
     node->pipeline.count = count;
     node->pipeline.negated = negated;
+    node->pipeline.timed = timed;
 
     return node;
 }
@@ -697,7 +773,7 @@ static ASTNode *parse_pipeline(Parser *parser)
  * Trailing ';', '&', or NEWLINE are consumed but do not require a
  * following pipeline.
  */
-static ASTNode *parse_list(Parser *parser)
+static ASTNode *parse_list_body(Parser *parser)
 {
     skip_newlines(parser);
 
@@ -727,6 +803,8 @@ static ASTNode *parse_list(Parser *parser)
         } else if (check(parser, TOK_AMP)) {
             advance(parser);
             left = make_background_node(parser->arena, left);
+            if (at_line_end(parser))
+                break;
             skip_newlines(parser);
             if (!at_command_start(parser))
                 break;
@@ -734,7 +812,11 @@ static ASTNode *parse_list(Parser *parser)
             if (parser->had_error) return NULL;
             left = make_binary_node(parser->arena, NODE_SEQUENCE, left, right);
         } else if (check(parser, TOK_SEMI) || check(parser, TOK_NEWLINE)) {
+            if (at_line_end(parser))
+                break;
             advance(parser);
+            if (at_line_end(parser))
+                break;
             skip_newlines(parser);
             if (!at_command_start(parser))
                 break;
@@ -749,6 +831,14 @@ static ASTNode *parse_list(Parser *parser)
     return left;
 }
 
+static ASTNode *parse_list(Parser *parser)
+{
+    parser->depth++;
+    ASTNode *list = parse_list_body(parser);
+    parser->depth--;
+    return list;
+}
+
 /*
  * parse_program - entry point for parsing a complete program.
  *
@@ -784,8 +874,11 @@ void parser_init(Parser *parser, TokenList *tokens, Arena *arena)
     parser->tokens    = tokens;
     parser->pos       = 0;
     parser->arena     = arena;
-    parser->error     = NULL;
-    parser->had_error = false;
+    parser->error      = NULL;
+    parser->had_error  = false;
+    parser->incomplete = false;
+    parser->line_mode  = false;
+    parser->depth      = 0;
 }
 
 /*
@@ -796,6 +889,49 @@ ASTNode *parser_parse(Parser *parser)
     return parse_program(parser);
 }
 
+/*
+ * parser_parse_script - parse every top-level complete command in the input.
+ *
+ * Each newline-terminated command becomes its own AST so the caller can run
+ * them in order and stop early (exit, errors) without re-parsing anything.
+ */
+Script *parser_parse_script(Parser *parser)
+{
+    Script *script = arena_calloc(parser->arena, 1, sizeof(Script));
+    int cap = 16;
+    script->commands = arena_alloc(parser->arena, cap * sizeof(ASTNode *));
+
+    parser->line_mode = true;
+
+    for (;;) {
+        skip_newlines(parser);
+        if (check(parser, TOK_EOF))
+            break;
+
+        ASTNode *cmd = parse_list(parser);
+        if (parser->had_error)
+            break;
+        if (!cmd || (!check(parser, TOK_NEWLINE) && !check(parser, TOK_EOF))) {
+            parser_error_at(parser, cur_token(parser),
+                            "unexpected token after end of command");
+            break;
+        }
+
+        if (script->count >= cap) {
+            int newcap = cap * 2;
+            ASTNode **nc = arena_alloc(parser->arena,
+                                       newcap * sizeof(ASTNode *));
+            memcpy(nc, script->commands, script->count * sizeof(ASTNode *));
+            script->commands = nc;
+            cap = newcap;
+        }
+        script->commands[script->count++] = cmd;
+    }
+
+    parser->line_mode = false;
+    return script;
+}
+
 /*
  * parser_error - return the error message string, or NULL if no error.
  */
@@ -804,6 +940,128 @@ const char *parser_error(const Parser *parser)
     return parser->error;
 }
 
+/* ---- Deep copy ---------------------------------------------------------- */
+
+/* Copy a NULL-terminated (or count-bounded) string vector into arena. */
+static char **clone_strv(Arena *arena, char **src, int count)
+{
+    if (!src)
+        return NULL;
+
+    char **dst = arena_alloc(arena, (size_t)(count + 1) * sizeof(char *));
+    for (int i = 0; i < count; i++)
+        dst[i] = src[i] ? arena_strdup(arena, src[i]) : NULL;
+    dst[count] = NULL;
+    return dst;
+}
+
+static unsigned char *clone_flags(Arena *arena, const unsigned char *src,
+                                  int count)
+{
+    if (!src || count == 0)
+        return NULL;
+
+    unsigned char *dst = arena_alloc(arena, (size_t)count);
+    if (dst)
+        memcpy(dst, src, (size_t)count);
+    return dst;
+}
+
+static Redirection *clone_redirs(Arena *arena, const Redirection *r)
+{
+    Redirection *head = NULL;
+    Redirection **tail = &head;
+
+    for (; r; r = r->next) {
+        Redirection *copy = arena_alloc(arena, sizeof(Redirection));
+        *copy = *r;
+        copy->target = r->target ? arena_strdup(arena, r->target) : NULL;
+        copy->next = NULL;
+        *tail = copy;
+        tail = &copy->next;
+    }
+    return head;
+}
+
+/*
+ * ast_clone - deep-copy an AST into arena.
+ *
+ * Used for anything that must outlive the parse arena (function bodies).
+ */
+ASTNode *ast_clone(Arena *arena, const ASTNode *node)
+{
+    if (!node)
+        return NULL;
+
+    ASTNode *copy = arena_alloc(arena, sizeof(ASTNode));
+    *copy = *node;
+
+    switch (node->type) {
+    case NODE_COMMAND:
+        copy->cmd.argv = clone_strv(arena, node->cmd.argv, node->cmd.argc);
+        copy->cmd.argv_flags = clone_flags(arena, node->cmd.argv_flags,
+                                           node->cmd.argc);
+        copy->cmd.assignments = clone_strv(arena, node->cmd.assignments,
+                                           node->cmd.nassign);
+        copy->cmd.redirs = clone_redirs(arena, node->cmd.redirs);
+        break;
+
+    case NODE_PIPELINE:
+        copy->pipeline.commands = arena_alloc(arena,
+            (size_t)node->pipeline.count * sizeof(ASTNode *));
+        for (int i = 0; i < node->pipeline.count; i++)
+            copy->pipeline.commands[i] = ast_clone(arena,
+                                                   node->pipeline.commands[i]);
+        break;
+
+    case NODE_AND:
+    case NODE_OR:
+    case NODE_SEQUENCE:
+        copy->binary.left  = ast_clone(arena, node->binary.left);
+        copy->binary.right = ast_clone(arena, node->binary.right);
+        break;
+
+    case NODE_BACKGROUND:
+    case NODE_NEGATE:
+    case NODE_SUBSHELL:
+    case NODE_BLOCK:
+        copy->child = ast_clone(arena, node->child);
+        break;
+
+    case NODE_ARITH:
+        copy->expr = arena_strdup(arena, node->expr);
+        break;
+
+    case NODE_IF:
+        copy->if_node.condition = ast_clone(arena, node->if_node.condition);
+        copy->if_node.then_body = ast_clone(arena, node->if_node.then_body);
+        copy->if_node.else_body = ast_clone(arena, node->if_node.else_body);
+        break;
+
+    case NODE_WHILE:
+        copy->while_node.condition = ast_clone(arena, node->while_node.condition);
+        copy->while_node.body      = ast_clone(arena, node->while_node.body);
+        break;
+
+    case NODE_FOR:
+        copy->for_node.varname = arena_strdup(arena, node->for_node.varname);
+        copy->for_node.words   = clone_strv(arena, node->for_node.words,
+                                            node->for_node.nwords);
+        copy->for_node.word_flags = clone_flags(arena,
+                                                node->for_node.word_flags,
+                                                node->for_node.nwords);
+        copy->for_node.body    = ast_clone(arena, node->for_node.body);
+        break;
+
+    case NODE_FUNCTION:
+        copy->func.name = arena_strdup(arena, node->func.name);
+        copy->func.body = ast_clone(arena, node->func.body);
+        break;
+    }
+
+    return copy;
+}
+
 /* ---- Debug AST printer -------------------------------------------------- */
 
 static const char *node_type_str(ASTNodeType type)
@@ -822,6 +1080,7 @@ static const char *node_type_str(ASTNodeType type)
     case NODE_FOR:        return "FOR";
     case NODE_FUNCTION:   return "FUNCTION";
     case NODE_BLOCK:      return "BLOCK";
+    case NODE_ARITH:      return "ARITH";
     }
     return "UNKNOWN";
 }
@@ -839,6 +1098,7 @@ static const char *redir_type_str(RedirType type)
     case REDIR_OUTPUT:  return ">";
     case REDIR_APPEND:  return ">>";
     case REDIR_HEREDOC: return "<<";
+    case REDIR_HERESTRING: return "<<<";
     case REDIR_DUP_OUT: return ">&";
     case REDIR_DUP_IN:  return "<&";
     }
@@ -875,7 +1135,8 @@ void ast_print(const ASTNode *node, int indent)
         break;
 
     case NODE_PIPELINE:
-        fprintf(stderr, "%s (%d commands)\n",
+        fprintf(stderr, "%s%s (%d commands)\n",
+                node->pipeline.timed ? " (timed)" : "",
                 node->pipeline.negated ? " (negated)" : "",
                 node->pipeline.count);
         for (int i = 0; i < node->pipeline.count; i++)
@@ -902,6 +1163,10 @@ void ast_print(const ASTNode *node, int indent)
         ast_print(node->child, indent + 1);
         break;
 
+    case NODE_ARITH:
+        fprintf(stderr, " ((%s))\n", node->expr);
+        break;
+
     case NODE_IF:
         fprintf(stderr, "\n");
         print_indent(indent + 1);
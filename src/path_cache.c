@@ -0,0 +1,298 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * path_cache.c - Hashed command-name to executable-path cache
+ *
+ * A djb2 hash table (separate chaining) of name -> absolute path. Lookups
+ * compare the cache's PATH serial with the environment's, so any change to
+ * PATH through env_set()/env_unset() empties the cache lazily on the next
+ * lookup. Misses are not cached: a command installed later is found on
+ * the next attempt without `hash -r`. In an interactive shell misses go to
+ * the executable index, which answers from sorted directory listings
+ * instead of probing every PATH directory with stat().
+ * ============================================================================ */
+
+#include "path_cache.h"
+#include "shell.h"
+#include "env.h"
+#include "exec_index.h"
+#include "stats.h"
+#include "startup.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+/* ---- Internal helpers --------------------------------------------------- */
+
+static unsigned int path_hash(const char *s)
+{
+    unsigned long hash = 5381;
+    while (*s)
+        hash = hash * 33 + (unsigned char)*s++;
+    return (unsigned int)(hash % PATH_CACHE_HASH_SIZE);
+}
+
+static void entry_free(PathCacheEntry *e)
+{
+    free(e->name);
+    free(e->path);
+    free(e);
+}
+
+static PathCacheEntry *cache_find(PathCache *cache, const char *name)
+{
+    for (PathCacheEntry *e = cache->buckets[path_hash(name)]; e; e = e->next) {
+        if (strcmp(e->name, name) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+static PathCacheEntry *cache_insert(PathCache *cache, const char *name,
+                                    char *path)
+{
+    PathCacheEntry *e = cache_find(cache, name);
+    if (e) {
+        free(e->path);
+        e->path = path;
+        return e;
+    }
+
+    e = calloc(1, sizeof(PathCacheEntry));
+    if (!e) {
+        free(path);
+        return NULL;
+    }
+    e->name = strdup(name);
+    if (!e->name) {
+        free(path);
+        free(e);
+        return NULL;
+    }
+    e->path = path;
+
+    unsigned int h = path_hash(name);
+    e->next = cache->buckets[h];
+    cache->buckets[h] = e;
+    cache->count++;
+    return e;
+}
+
+static const char *search_list(Shell *shell)
+{
+    const char *path_list = env_get(shell->env, "PATH");
+    return path_list ? path_list : PATH_CACHE_DEFAULT_PATH;
+}
+
+static void cache_empty(PathCache *cache)
+{
+    for (int i = 0; i < PATH_CACHE_HASH_SIZE; i++) {
+        PathCacheEntry *e = cache->buckets[i];
+        while (e) {
+            PathCacheEntry *next = e->next;
+            entry_free(e);
+            e = next;
+        }
+        cache->buckets[i] = NULL;
+    }
+    cache->count = 0;
+}
+
+/* Search PATH for name, through the index when there is one. Only an
+ * interactive shell uses it: listing every PATH directory costs a few
+ * milliseconds, which `vsh -c cmd` would pay to find one name, and a
+ * script's names land in the cache after a probe each anyway. */
+static char *resolve(Shell *shell, const char *name)
+{
+    ExecIndex *idx = shell->interactive ? path_cache_index(shell) : NULL;
+    if (idx)
+        return exec_index_find(idx, name);
+    return path_search(search_list(shell), name);
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+PathCache *path_cache_create(void)
+{
+    PathCache *cache = calloc(1, sizeof(PathCache));
+    if (!cache)
+        return NULL;
+    cache->index = exec_index_create();
+    if (!cache->index) {
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void path_cache_destroy(PathCache *cache)
+{
+    if (!cache)
+        return;
+    cache_empty(cache);
+    exec_index_destroy(cache->index);
+    free(cache);
+}
+
+PathCache *path_cache_current(Shell *shell)
+{
+    PathCache *cache = shell->path_cache;
+    if (!cache)
+        return NULL;
+
+    if (cache->path_serial != shell->env->path_serial) {
+        cache_empty(cache);
+        cache->path_serial = shell->env->path_serial;
+    }
+    return cache;
+}
+
+ExecIndex *path_cache_index(Shell *shell)
+{
+    PathCache *cache = shell->path_cache;
+    if (!cache)
+        return NULL;
+
+    /* The startup listing was cut short if this process forked mid-way;
+     * without an index, lookups probe PATH directly */
+    if (!startup_wait(shell->startup, STARTUP_PATH_INDEX))
+        cache->index = NULL;
+    if (!cache->index)
+        return NULL;
+
+    exec_index_set_path(cache->index, search_list(shell),
+                        shell->env->path_serial);
+    return cache->index;
+}
+
+char *path_search(const char *path_list, const char *name)
+{
+    if (!path_list || !name || !*name)
+        return NULL;
+
+    size_t name_len = strlen(name);
+    const char *dir = path_list;
+
+    for (;;) {
+        const char *end = strchr(dir, ':');
+        size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+
+        /* An empty PATH element means the current directory */
+        char fullpath[PATH_MAX];
+        if (dir_len + 1 + name_len < sizeof(fullpath)) {
+            if (dir_len == 0) {
+                memcpy(fullpath, name, name_len + 1);
+            } else {
+                memcpy(fullpath, dir, dir_len);
+                fullpath[dir_len] = '/';
+                memcpy(fullpath + dir_len + 1, name, name_len + 1);
+            }
+
+            struct stat st;
+            if (stat(fullpath, &st) == 0 && S_ISREG(st.st_mode) &&
+                access(fullpath, X_OK) == 0) {
+                return strdup(fullpath);
+            }
+        }
+
+        if (!end)
+            break;
+        dir = end + 1;
+    }
+
+    return NULL;
+}
+
+const char *path_cache_lookup(Shell *shell, const char *name)
+{
+    if (!name || !*name)
+        return NULL;
+    if (strchr(name, '/'))
+        return name;
+
+    PathCache *cache = path_cache_current(shell);
+    if (cache) {
+        PathCacheEntry *e = cache_find(cache, name);
+        stats_cache(shell->stats, STAT_CACHE_PATH, e != NULL);
+        if (e) {
+            e->hits++;
+            return e->path;
+        }
+    }
+
+    char *path = resolve(shell, name);
+    if (!path)
+        return NULL;
+
+    if (!cache) {
+        /* No cache: hand out a path that lives until the next lookup */
+        static char *uncached;
+        free(uncached);
+        uncached = path;
+        return uncached;
+    }
+
+    PathCacheEntry *e = cache_insert(cache, name, path);
+    if (!e)
+        return NULL;
+    e->hits = 1;
+    return e->path;
+}
+
+const char *path_cache_peek(Shell *shell, const char *name)
+{
+    PathCache *cache = path_cache_current(shell);
+    if (!cache || !name)
+        return NULL;
+
+    PathCacheEntry *e = cache_find(cache, name);
+    return e ? e->path : NULL;
+}
+
+bool path_cache_add(Shell *shell, const char *name)
+{
+    PathCache *cache = path_cache_current(shell);
+    if (!cache || !name || strchr(name, '/'))
+        return false;
+
+    char *path = resolve(shell, name);
+    if (!path)
+        return false;
+
+    PathCacheEntry *e = cache_insert(cache, name, path);
+    if (e)
+        e->hits = 0;
+    return e != NULL;
+}
+
+bool path_cache_forget(PathCache *cache, const char *name)
+{
+    if (!cache || !name)
+        return false;
+
+    PathCacheEntry **link = &cache->buckets[path_hash(name)];
+    while (*link) {
+        PathCacheEntry *e = *link;
+        if (strcmp(e->name, name) == 0) {
+            *link = e->next;
+            entry_free(e);
+            cache->count--;
+            return true;
+        }
+        link = &e->next;
+    }
+    return false;
+}
+
+void path_cache_clear(Shell *shell)
+{
+    PathCache *cache = shell->path_cache;
+    if (!cache)
+        return;
+
+    cache_empty(cache);
+    exec_index_invalidate(path_cache_index(shell));
+}
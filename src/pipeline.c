@@ -10,6 +10,18 @@
  *
  * Single-command "pipelines" are optimised by executing in-process so that
  * builtins like `cd` or `export` can modify shell state directly.
+ *
+ * Stages that are plain external commands are expanded in the parent and
+ * started with posix_spawn (see proc_spawn.c); builtins, functions and
+ * compound stages are forked so they can run the shell's own code.
+ *
+ * Three kinds of stage need no process at all. A builtin that only writes
+ * output (echo, history, ...) runs in the shell with its output captured,
+ * which is then written into its pipe, by a thread if the pipe cannot take
+ * it at once. A cat or tee stage runs on a thread of the shell, moving its
+ * data between the pipes with splice (see fdcopy.c). With `set -o
+ * lastpipe` a last stage that is not an external command runs in the
+ * shell with its stdin on the pipe, so it can change shell state.
  * ============================================================================ */
 
 #include "pipeline.h"
@@ -20,27 +32,325 @@
 #include "job_control.h"
 #include "parser.h"
 #include "arena.h"
-#include "wildcard.h"
-
+#include "path_cache.h"
+#include "functions.h"
+#include "proc_spawn.h"
+#include "safe_string.h"
+#include "output.h"
+#include "stats.h"
+#include "pipetime.h"
+
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 /* ---- Forward declarations ----------------------------------------------- */
 
-static void child_reset_signals(void);
-static void exec_pipeline_child(Shell *shell, ASTNode *node);
+static pid_t spawn_stage(Shell *shell, ASTNode *node, int (*pipes)[2],
+                         int n, int i, pid_t pgid, char ***argv_io);
+static void exec_pipeline_child(Shell *shell, ASTNode *node, char **argv);
+
+/* ---- Stages that run in the shell --------------------------------------- */
+
+typedef enum StageKind {
+    STAGE_CHILD,        /* Forked or spawned */
+    STAGE_CAPTURED,     /* Pure builtin: run in the shell, output fed in */
+    STAGE_COPY,         /* cat or tee: a thread copying between the pipes */
+    STAGE_SHELL         /* Last stage under lastpipe: run with stdin wired */
+} StageKind;
+
+/* sysinfo -w and calc -r/-i write for as long as they like. Run in the
+ * shell, nothing would reach the reader until they were done and a reader
+ * that quits could not stop them, so they keep a process of their own.
+ * A word that still has to be expanded might be one of those options. */
+static bool stage_unbounded(const CommandNode *cmd, const BuiltinEntry *b)
+{
+    if (b->handler != builtin_sysinfo && b->handler != builtin_calc)
+        return false;
+    for (int i = 1; i < cmd->argc; i++) {
+        const char *arg = cmd->argv[i];
+        if (!cmd->argv_flags || cmd->argv_flags[i] != 0)
+            return true;
+        if (b->handler == builtin_sysinfo ? strcmp(arg, "-w") == 0
+                                          : strcmp(arg, "-r") == 0 ||
+                                            strcmp(arg, "-i") == 0)
+            return true;
+    }
+    return false;
+}
+
+/* A builtin that only writes output, and stops, can run in the shell
+ * before the other stages start; what it wrote is then fed into its pipe */
+static bool stage_is_pure(Shell *shell, const ASTNode *node)
+{
+    if (node->type != NODE_COMMAND)
+        return false;
+    const CommandNode *cmd = &node->cmd;
+    if (cmd->argc == 0 || cmd->nassign > 0 || cmd->redirs ||
+        func_lookup(shell->functions, cmd->argv[0]))
+        return false;
+
+    const BuiltinEntry *b = builtins_lookup(cmd->argv[0]);
+    return b && ((builtins_is_pure(b) && !stage_unbounded(cmd, b)) ||
+                 (b->handler == builtin_history && cmd->argc == 1));
+}
+
+/* Under lastpipe, anything but an external command runs in the shell */
+static bool stage_in_shell(Shell *shell, const ASTNode *node)
+{
+    switch (node->type) {
+    case NODE_COMMAND:
+        return node->cmd.argc > 0 &&
+               (func_lookup(shell->functions, node->cmd.argv[0]) ||
+                builtins_is_builtin(node->cmd.argv[0]));
+    case NODE_SUBSHELL:
+        return false;
+    default:
+        return true;
+    }
+}
+
+/* Captured output waiting to be written into a pipe */
+typedef struct StageFeed {
+    int         fd;
+    SafeString *out;
+    pthread_t   thread;
+    bool        threaded;
+} StageFeed;
+
+/* Threads started for a pipeline leave every signal to the main thread;
+ * a reader that exits early gives them EPIPE instead of a SIGPIPE */
+static void block_thread_signals(void)
+{
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+}
+
+/* Run fn(arg) on the shell's own thread with only SIGPIPE held off, and
+ * drop a SIGPIPE it raised, so a gone reader gives EPIPE there too */
+static void *call_without_sigpipe(void *(*fn)(void *), void *arg)
+{
+    sigset_t pipe_set, old;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old);
+
+    void *result = fn(arg);
+
+    struct timespec zero = { 0, 0 };
+    while (sigtimedwait(&pipe_set, NULL, &zero) > 0)
+        ;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return result;
+}
+
+static void *feed_write(void *arg)
+{
+    StageFeed *feed = arg;
+    size_t off = 0;
+    while (off < feed->out->len) {
+        ssize_t w = write(feed->fd, feed->out->data + off,
+                          feed->out->len - off);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            break;
+        off += (size_t)w;
+    }
+    close(feed->fd);
+    return NULL;
+}
+
+static void *feed_thread(void *arg)
+{
+    block_thread_signals();
+    return feed_write(arg);
+}
+
+/* Output that fits in the empty pipe is written at once; anything more is
+ * written by a thread while the rest of the pipeline runs */
+static void feed_start(StageFeed *feed)
+{
+    int cap = fcntl(feed->fd, F_GETPIPE_SZ);
+    if (cap > 0 && feed->out->len <= (size_t)cap) {
+        call_without_sigpipe(feed_write, feed);
+        return;
+    }
+    fcntl(feed->fd, F_SETFD, FD_CLOEXEC);
+    feed->threaded = pthread_create(&feed->thread, NULL, feed_thread,
+                                    feed) == 0;
+    if (!feed->threaded)
+        call_without_sigpipe(feed_write, feed);
+}
+
+/* A cat or tee stage: the arguments and fds its thread copies with */
+typedef struct CopyTask {
+    int    argc;
+    char **argv;            /* Owned: a stopped job's thread outlives the line */
+    int    in_fd, out_fd;
+    bool   close_in, close_out;
+} CopyTask;
+
+typedef struct StageCopy {
+    pthread_t thread;
+    bool      threaded;
+    int       status;
+} StageCopy;
+
+/* Might this stage be a cat or tee? Only a plain command qualifies; its
+ * words are expanded before the builtin has the final say. */
+static bool stage_may_copy(Shell *shell, const ASTNode *node)
+{
+    if (node->type != NODE_COMMAND)
+        return false;
+    const CommandNode *cmd = &node->cmd;
+    if (cmd->argc == 0 || cmd->nassign > 0 || cmd->redirs ||
+        func_lookup(shell->functions, cmd->argv[0]))
+        return false;
+
+    const BuiltinEntry *b = builtins_lookup(cmd->argv[0]);
+    return b && builtins_is_copy(b);
+}
+
+static void *copy_run(void *arg)
+{
+    CopyTask *c = arg;
+    int status = builtin_copy_run(c->argc, c->argv, c->in_fd, c->out_fd);
+    if (c->close_in)
+        close(c->in_fd);
+    if (c->close_out)
+        close(c->out_fd);
+
+    for (int i = 0; i < c->argc; i++)
+        free(c->argv[i]);
+    free(c->argv);
+    free(c);
+    return (void *)(intptr_t)status;
+}
+
+static void *copy_thread(void *arg)
+{
+    block_thread_signals();
+    return copy_run(arg);
+}
+
+/* Start the copy for stage i of n with the expanded words in argv */
+static void copy_start(StageCopy *copy, char **argv, int argc,
+                       int (*pipes)[2], int n, int i)
+{
+    CopyTask *c = calloc(1, sizeof(CopyTask));
+    char **own = c ? calloc((size_t)argc + 1, sizeof(char *)) : NULL;
+    bool ok = own != NULL;
+    for (int j = 0; ok && j < argc; j++)
+        ok = (own[j] = strdup(argv[j])) != NULL;
+    if (!ok) {
+        fprintf(stderr, "vsh: %s: out of memory\n", argv[0]);
+        for (int j = 0; own && j < argc; j++)
+            free(own[j]);
+        free(own);
+        free(c);
+        if (i > 0)
+            close(pipes[i - 1][0]);
+        if (i < n - 1)
+            close(pipes[i][1]);
+        copy->status = 1;
+        return;
+    }
+
+    c->argc      = argc;
+    c->argv      = own;
+    c->in_fd     = i > 0 ? pipes[i - 1][0] : STDIN_FILENO;
+    c->out_fd    = i < n - 1 ? pipes[i][1] : STDOUT_FILENO;
+    c->close_in  = i > 0;
+    c->close_out = i < n - 1;
+
+    copy->threaded = pthread_create(&copy->thread, NULL, copy_thread, c) == 0;
+    if (!copy->threaded)
+        copy->status = (int)(intptr_t)call_without_sigpipe(copy_run, c);
+}
+
+/* ---- Per-stage byte counts (set -o timing) ------------------------------ */
+
+/* Read and written byte counts of a process from /proc/PID/io */
+static bool read_proc_io(pid_t pid, unsigned long long *rd,
+                         unsigned long long *wr)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/io", (int)pid);
+    FILE *fp = fopen(path, "re");
+    if (!fp)
+        return false;
+
+    int found = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "rchar: %llu", rd) == 1 ||
+            sscanf(line, "wchar: %llu", wr) == 1)
+            found++;
+    }
+    fclose(fp);
+    return found == 2;
+}
+
+void pipeline_stage_exited(Shell *shell, pid_t pid)
+{
+    for (PipeBytes *b = shell->pipe_bytes; b; b = b->outer) {
+        for (int i = 0; i < b->n; i++) {
+            StageBytes *s = &b->stages[i];
+            if (s->pid == pid && !s->known) {
+                s->known = read_proc_io(pid, &s->read, &s->written);
+                return;
+            }
+        }
+    }
+}
+
+/* One line on stderr: what each stage read and wrote */
+static void print_stage_bytes(const PipelineNode *pipeline,
+                              const PipeBytes *bytes)
+{
+    fputs("timing: pipe", stderr);
+    for (int i = 0; i < bytes->n; i++) {
+        const StageBytes *s = &bytes->stages[i];
+        char rd[32] = "?", wr[32] = "?";
+        if (s->known) {
+            stats_format_bytes(rd, sizeof(rd), s->read);
+            stats_format_bytes(wr, sizeof(wr), s->written);
+        } else if (s->pid == 0) {
+            snprintf(rd, sizeof(rd), "shell");
+            snprintf(wr, sizeof(wr), "shell");
+        }
+        fprintf(stderr, "%s%s %s>%s", i == 0 ? "  " : " | ",
+                pipetime_stage_label(pipeline->commands[i]), rd, wr);
+    }
+    fputc('\n', stderr);
+}
 
 /* ---- Pipeline execution ------------------------------------------------- */
 
+/* Make pipe p close-on-exec, at the capacity set with `set -o pipesize` */
+static bool pipe_open(Shell *shell, int p[2])
+{
+    if (pipe2(p, O_CLOEXEC) < 0)
+        return false;
+    if (shell->opt_pipe_size > 0)
+        fcntl(p[1], F_SETPIPE_SZ, shell->opt_pipe_size);
+    return true;
+}
+
 int pipeline_execute(Shell *shell, PipelineNode *pipeline)
 {
     int n = pipeline->count;
+    if (n <= 0)
+        return 0;
 
     /* ---- Optimisation: single-command pipeline runs in-process ----------- */
     if (n == 1) {
@@ -54,126 +364,260 @@ int pipeline_execute(Shell *shell, PipelineNode *pipeline)
     /* ---- Multi-command pipeline ----------------------------------------- */
 
     /*
-     * Allocate pipe fd pairs.  For N commands we need N-1 pipes.
+     * For N commands we need N-1 pipes.
      * pipes[i] connects command i's stdout to command i+1's stdin.
      *   pipes[i][0] = read end    (stdin of command i+1)
      *   pipes[i][1] = write end   (stdout of command i)
+     *
+     * Each pipe is made close-on-exec just before command i starts, and
+     * the shell closes its ends of a pipe once both of its commands are
+     * started. A child so inherits only the pipe it reads and the pipe it
+     * writes, plus the ends held for stages that run in the shell (held),
+     * and only a child that does not exec has to close anything.
      */
     int (*pipes)[2] = malloc(sizeof(int[2]) * (n - 1));
-    if (!pipes) {
+    pid_t *pids = malloc(sizeof(pid_t) * n);
+    int *held = malloc(sizeof(int) * 2 * (size_t)n);
+    StageKind *kinds = calloc((size_t)n, sizeof(StageKind));
+    StageFeed *feeds = calloc((size_t)n, sizeof(StageFeed));
+    StageCopy *copies = calloc((size_t)n, sizeof(StageCopy));
+    char ***argvs = calloc((size_t)n, sizeof(char **));
+    int *argcs = calloc((size_t)n, sizeof(int));
+    PipeBytes bytes = { shell->pipe_bytes, n, NULL };
+    if (shell->opt_timing)
+        bytes.stages = calloc((size_t)n, sizeof(StageBytes));
+    if (!pipes || !pids || !held || !kinds || !feeds || !copies || !argvs ||
+        !argcs || (shell->opt_timing && !bytes.stages)) {
         perror("vsh: malloc");
+        free(pipes);
+        free(pids);
+        free(held);
+        free(kinds);
+        free(feeds);
+        free(copies);
+        free(argvs);
+        free(argcs);
+        free(bytes.stages);
         return 1;
     }
+    if (bytes.stages)
+        shell->pipe_bytes = &bytes;
 
+    /* Job control needs the whole pipeline in one process group */
+    if (shell->opt_lastpipe && !shell->interactive &&
+        stage_in_shell(shell, pipeline->commands[n - 1]))
+        kinds[n - 1] = STAGE_SHELL;
     for (int i = 0; i < n - 1; i++) {
-        if (pipe(pipes[i]) < 0) {
+        if (stage_is_pure(shell, pipeline->commands[i]))
+            kinds[i] = STAGE_CAPTURED;
+    }
+
+    pid_t pgid = 0; /* Process group id (set to first child's PID) */
+    int npids = 0, nheld = 0;
+
+    int i;
+    for (i = 0; i < n; i++) {
+        if (kinds[i] == STAGE_SHELL)
+            break;
+        if (i < n - 1 && !pipe_open(shell, pipes[i])) {
             perror("vsh: pipe");
-            /* Close any pipes we already opened */
-            for (int j = 0; j < i; j++) {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
+            goto fail;
+        }
+        int in_fd  = i > 0 ? pipes[i - 1][0] : STDIN_FILENO;
+        int out_fd = i < n - 1 ? pipes[i][1] : STDOUT_FILENO;
+
+        if (kinds[i] == STAGE_CAPTURED) {
+            /* Its stdin is not read: the writer before it gets EPIPE */
+            if (i > 0)
+                close(in_fd);
+            feeds[i].fd  = out_fd;
+            feeds[i].out = sstr_new(256);
+            if (feeds[i].out) {
+                executor_capture_node(shell, pipeline->commands[i],
+                                      feeds[i].out);
+                held[nheld++] = out_fd;
+                if (bytes.stages) {
+                    bytes.stages[i].written = feeds[i].out->len;
+                    bytes.stages[i].known   = true;
+                }
+            } else {
+                close(out_fd);
             }
-            free(pipes);
-            return 1;
+            continue;
         }
-    }
 
-    /* Fork all child processes */
-    pid_t *pids = malloc(sizeof(pid_t) * n);
-    if (!pids) {
-        perror("vsh: malloc");
-        for (int i = 0; i < n - 1; i++) {
-            close(pipes[i][0]);
-            close(pipes[i][1]);
+        /* cat and tee are expanded here; one the builtin turns down (an
+         * option it lacks, say) keeps its words for the process */
+        ASTNode *node = pipeline->commands[i];
+        if (kinds[i] == STAGE_CHILD && stage_may_copy(shell, node)) {
+            argvs[i] = executor_expand_argv(shell, &node->cmd, &argcs[i]);
+            const BuiltinEntry *b = argcs[i] > 0 ? builtins_lookup(argvs[i][0])
+                                                 : NULL;
+            if (b && builtins_is_copy(b) &&
+                !func_lookup(shell->functions, argvs[i][0]) &&
+                builtin_copy_accepts(argcs[i], argvs[i], in_fd, out_fd)) {
+                kinds[i] = STAGE_COPY;
+                if (i > 0)
+                    held[nheld++] = in_fd;
+                if (i < n - 1)
+                    held[nheld++] = out_fd;
+                continue;
+            }
         }
-        free(pipes);
-        return 1;
-    }
 
-    pid_t pgid = 0; /* Process group id (set to first child's PID) */
-
-    for (int i = 0; i < n; i++) {
-        pid_t pid = fork();
+        uint64_t t = stats_now();
+        char **argv = argvs[i]; /* Words already expanded (by spawn_stage) */
+        pid_t pid = spawn_stage(shell, node, pipes, n, i, pgid, &argv);
+        if (pid < 0) {
+            out_flush(shell->out);
+            pid = fork();
+            stats_fork(shell->stats);
+        }
         if (pid < 0) {
             perror("vsh: fork");
-            /* Kill any children we already started */
-            for (int j = 0; j < i; j++)
-                kill(pids[j], SIGTERM);
-            for (int j = 0; j < n - 1; j++) {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
+            if (i < n - 1) {
+                close(pipes[i][0]);
+                close(pipes[i][1]);
             }
-            free(pids);
-            free(pipes);
-            return 1;
+            goto fail;
         }
 
         if (pid == 0) {
             /* ---- Child process ------------------------------------------ */
 
-            /* Set process group */
-            setpgid(0, pgid);
+            /* Set process group, when doing job control */
+            if (shell->interactive)
+                setpgid(0, pgid);
 
             /* Wire up pipe ends */
-            if (i > 0) {
-                /* stdin from previous pipe's read end */
-                if (dup2(pipes[i - 1][0], STDIN_FILENO) < 0) {
-                    perror("vsh: dup2");
-                    _exit(1);
-                }
+            if (i > 0 && dup2(in_fd, STDIN_FILENO) < 0) {
+                perror("vsh: dup2");
+                _exit(1);
             }
-            if (i < n - 1) {
-                /* stdout to current pipe's write end */
-                if (dup2(pipes[i][1], STDOUT_FILENO) < 0) {
-                    perror("vsh: dup2");
-                    _exit(1);
-                }
+            if (i < n - 1 && dup2(out_fd, STDOUT_FILENO) < 0) {
+                perror("vsh: dup2");
+                _exit(1);
             }
 
-            /* Close all pipe fds in the child -- they've been dup2'd */
-            for (int j = 0; j < n - 1; j++) {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
+            /* Close the originals and the ends held for in-shell stages */
+            if (i > 0)
+                close(in_fd);
+            if (i < n - 1) {
+                close(pipes[i][0]);
+                close(pipes[i][1]);
             }
+            for (int j = 0; j < nheld; j++)
+                close(held[j]);
 
-            child_reset_signals();
+            job_child_reset_signals();
 
             /* Execute the command */
-            exec_pipeline_child(shell, pipeline->commands[i]);
+            exec_pipeline_child(shell, node, argv);
 
             /* Should not reach here */
             _exit(127);
         }
 
         /* ---- Parent ----------------------------------------------------- */
-        pids[i] = pid;
-        if (i == 0) {
+        pids[npids++] = pid;
+        if (bytes.stages)
+            bytes.stages[i].pid = pid;
+        if (shell->timer)
+            pipetime_stage_started(shell, pipeline, i, pid);
+        if (pgid == 0) {
             pgid = pid; /* First child becomes the process group leader */
         }
-        setpgid(pid, pgid);
+        if (shell->interactive)
+            setpgid(pid, pgid);
+        if (i > 0)
+            close(in_fd);
+        if (i < n - 1)
+            close(out_fd);
+        stats_since(shell->stats, STAT_SPAWN, t);
     }
 
-    /* ---- Parent: close all pipe fds ------------------------------------- */
-    for (int i = 0; i < n - 1; i++) {
-        close(pipes[i][0]);
-        close(pipes[i][1]);
+    /* ---- In-shell stages: feed captured output, start the copies --------- */
+    for (i = 0; i < n - 1; i++) {
+        if (kinds[i] == STAGE_CAPTURED && feeds[i].out)
+            feed_start(&feeds[i]);
+    }
+    for (i = 0; i < n; i++) {
+        if (kinds[i] == STAGE_COPY) {
+            if (i == n - 1)
+                out_flush(shell->out);
+            copy_start(&copies[i], argvs[i], argcs[i], pipes, n, i);
+        }
+    }
+    free(argcs);
+    free(argvs);
+    free(held);
+
+    /* ---- Last stage in the shell, reading the pipe ---------------------- */
+    int status = 0;
+    if (kinds[n - 1] == STAGE_SHELL) {
+        int saved = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(pipes[n - 2][0], STDIN_FILENO);
+        close(pipes[n - 2][0]);
+        status = executor_execute(shell, pipeline->commands[n - 1]);
+        fflush(stdout);
+        if (saved >= 0) {
+            dup2(saved, STDIN_FILENO);
+            close(saved);
+        } else {
+            close(STDIN_FILENO);
+        }
     }
     free(pipes);
 
-    /* ---- Give the pipeline the terminal --------------------------------- */
-    if (shell->interactive)
-        tcsetpgrp(STDIN_FILENO, pgid);
-
     /* ---- Register job and wait ------------------------------------------ */
     /*
      * Build a command string for the job table by joining the first
      * argument of each pipeline command.
      */
-    Job *job = job_add(shell, pgid, pids, n, "(pipeline)", true);
+    if (npids > 0) {
+        /* Give the pipeline the terminal */
+        if (shell->interactive)
+            tcsetpgrp(STDIN_FILENO, pgid);
+
+        Job *job = job_add(shell, pgid, pids, npids, "(pipeline)", true);
+        int job_status = job_wait_foreground(shell, job);
+        if (kinds[n - 1] != STAGE_SHELL)
+            status = job_status;
+    }
 
-    int status = job_wait_foreground(shell, job);
+    /* A copy feeding or draining a stopped job would block until it is
+     * continued: its thread is left to finish on its own */
+    Job *stopped = npids > 0 ? job_find_by_pgid(shell, pgid) : NULL;
+    if (stopped && stopped->state != JOB_STOPPED)
+        stopped = NULL;
+    for (i = 0; i < n; i++) {
+        if (!copies[i].threaded)
+            continue;
+        if (stopped) {
+            pthread_detach(copies[i].thread);
+            continue;
+        }
+        void *ret = NULL;
+        pthread_join(copies[i].thread, &ret);
+        copies[i].status = (int)(intptr_t)ret;
+    }
+    if (kinds[n - 1] == STAGE_COPY && !stopped)
+        status = copies[n - 1].status;
 
+    for (i = 0; i < n; i++) {
+        if (feeds[i].threaded)
+            pthread_join(feeds[i].thread, NULL);
+        sstr_free(feeds[i].out);
+    }
+    if (bytes.stages) {
+        shell->pipe_bytes = bytes.outer;
+        print_stage_bytes(pipeline, &bytes);
+        free(bytes.stages);
+    }
     free(pids);
+    free(kinds);
+    free(feeds);
+    free(copies);
 
     /* ---- Handle negation ------------------------------------------------ */
     if (pipeline->negated)
@@ -181,16 +625,91 @@ int pipeline_execute(Shell *shell, PipelineNode *pipeline)
 
     shell->last_status = status;
     return status;
+
+fail:
+    /* Stop what was started and close every pipe end still open: the one
+     * stage i would have read and those held for in-shell stages */
+    for (int j = 0; j < npids; j++)
+        kill(pids[j], SIGTERM);
+    if (i > 0)
+        close(pipes[i - 1][0]);
+    for (int j = 0; j < nheld; j++)
+        close(held[j]);
+    for (int j = 0; j < n; j++)
+        sstr_free(feeds[j].out);
+    if (bytes.stages)
+        shell->pipe_bytes = bytes.outer;
+    free(bytes.stages);
+    free(pipes);
+    free(pids);
+    free(held);
+    free(kinds);
+    free(feeds);
+    free(copies);
+    free(argvs);
+    free(argcs);
+    return 1;
+}
+
+/* ---- Start a plain external stage without forking ---------------------- */
+
+/*
+ * Returns the child's pid, or -1 when the stage must be forked instead.
+ * Simple commands are expanded here either way (unless *argv_io already
+ * holds their words) and handed back through *argv_io so the forked child
+ * does not expand them a second time.
+ */
+static pid_t spawn_stage(Shell *shell, ASTNode *node, int (*pipes)[2],
+                         int n, int i, pid_t pgid, char ***argv_io)
+{
+    if (node->type != NODE_COMMAND)
+        return -1;
+
+    CommandNode *cmd = &node->cmd;
+    if (cmd->nassign > 0 || !spawn_supported(shell, cmd->redirs, true))
+        return -1;
+
+    int    argc = 0;
+    char **argv = *argv_io;
+    if (argv) {
+        while (argv[argc])
+            argc++;
+    } else {
+        argv = executor_expand_argv(shell, cmd, &argc);
+        *argv_io = argv;
+    }
+
+    /* A cat or tee that did not become a copy stage is the external one */
+    const BuiltinEntry *b = argc > 0 ? builtins_lookup(argv[0]) : NULL;
+    if (argc == 0 || func_lookup(shell->functions, argv[0]) ||
+        (b && !builtins_is_copy(b)))
+        return -1;
+
+    const char *path = path_cache_lookup(shell, argv[0]);
+    if (!path)
+        return -1;
+
+    /* Every pipe end is close-on-exec: nothing to close in the child */
+    SpawnRequest req = {
+        .path       = path,
+        .argv       = argv,
+        .redirs     = cmd->redirs,
+        .stdin_fd   = i > 0 ? pipes[i - 1][0] : -1,
+        .stdout_fd  = i < n - 1 ? pipes[i][1] : -1,
+        .pgid       = pgid,
+        .foreground = true,
+    };
+    return spawn_command(shell, &req);
 }
 
 /* ---- Execute a single pipeline stage in a child process ----------------- */
 
-static void exec_pipeline_child(Shell *shell, ASTNode *node)
+static void exec_pipeline_child(Shell *shell, ASTNode *node, char **argv)
 {
     /*
      * If the node is a simple command, handle it directly so we can apply
-     * redirections and call execvp.  For compound nodes (subshells, etc.)
-     * we just run executor_execute and exit.
+     * redirections and exec.  For compound nodes (subshells, etc.) we just
+     * run executor_execute and exit.
      */
     if (node->type == NODE_COMMAND) {
         CommandNode *cmd = &node->cmd;
@@ -207,89 +726,44 @@ static void exec_pipeline_child(Shell *shell, ASTNode *node)
         }
 
         /* Apply redirections */
-        if (executor_apply_redirections(cmd->redirs) < 0)
-            _exit(1);
-
-        /* Expand arguments */
-        int   cap  = cmd->argc > 4 ? cmd->argc * 2 : 8;
-        int   argc = 0;
-        char **argv = malloc(sizeof(char *) * cap);
-        if (!argv)
+        if (executor_apply_redirections(shell, cmd->redirs) < 0)
             _exit(1);
 
-        for (int i = 0; i < cmd->argc; i++) {
-            char *expanded = env_expand(shell, cmd->argv[i], arena);
-            if (expanded[0] == '~')
-                expanded = env_expand_tilde(shell, expanded, arena);
-
-            if (wildcard_has_magic(expanded)) {
-                int   glob_count = 0;
-                char **matches = wildcard_expand(expanded, arena, &glob_count);
-                if (matches && glob_count > 0) {
-                    for (int j = 0; j < glob_count; j++) {
-                        if (argc >= cap) {
-                            cap *= 2;
-                            argv = realloc(argv, sizeof(char *) * cap);
-                            if (!argv) _exit(1);
-                        }
-                        argv[argc++] = matches[j];
-                    }
-                    continue;
-                }
-            }
-
-            if (argc >= cap) {
-                cap *= 2;
-                argv = realloc(argv, sizeof(char *) * cap);
-                if (!argv) _exit(1);
-            }
-            argv[argc++] = expanded;
+        /* Expand arguments (unless the parent already did) */
+        int argc = 0;
+        if (argv) {
+            while (argv[argc])
+                argc++;
+        } else {
+            argv = executor_expand_argv(shell, cmd, &argc);
         }
 
-        if (argc >= cap) {
-            argv = realloc(argv, sizeof(char *) * (cap + 1));
-            if (!argv) _exit(1);
-        }
-        argv[argc] = NULL;
-
         if (argc == 0)
             _exit(0);
 
         /*
-         * Even builtins must run as subprocesses in a pipeline (they cannot
-         * affect the parent shell's state from a pipe stage).  However we
-         * can still execute them directly here since we're already in a
-         * forked child.
+         * Functions and builtins run in this forked child: a pipe stage
+         * cannot affect the parent shell's state anyway.
          */
-        if (builtins_is_builtin(argv[0])) {
-            int status = builtins_execute(shell, argc, argv);
+        FuncEntry *fn = func_lookup(shell->functions, argv[0]);
+        if (fn) {
+            int status = func_call(shell, fn, argc, argv);
+            fflush(stdout);
             _exit(status);
         }
+        const BuiltinEntry *builtin = builtins_lookup(argv[0]);
+        if (builtin && !builtins_defers(shell, builtin, argc, argv)) {
+            int status = builtin->handler(shell, argc, argv);
+            _exit(builtins_finish(shell, argv[0], status));
+        }
 
-        /* External command */
-        char **envp = env_build_envp(shell->env);
-        execve(argv[0], argv, envp);
-        execvp(argv[0], argv);
-
-        int err = errno;
-        fprintf(stderr, "vsh: %s: %s\n", argv[0], strerror(err));
-        env_free_envp(envp);
-        _exit(err == ENOENT ? 127 : 126);
+        /* External command (the child's copy of the path cache is current
+         * for anything the parent has already run) */
+        executor_exec_external(shell, path_cache_lookup(shell, argv[0]), argv);
     }
 
     /* Non-command node (subshell, compound, etc.) -- just execute and exit */
     int status = executor_execute(shell, node);
+    fflush(stdout);
     _exit(status);
 }
-
-/* ---- Helper: reset signals to defaults in child process ----------------- */
-
-static void child_reset_signals(void)
-{
-    signal(SIGINT,  SIG_DFL);
-    signal(SIGQUIT, SIG_DFL);
-    signal(SIGTSTP, SIG_DFL);
-    signal(SIGTTIN, SIG_DFL);
-    signal(SIGTTOU, SIG_DFL);
-    signal(SIGCHLD, SIG_DFL);
-}
@@ -0,0 +1,307 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * pipetime.c - The `time` keyword: resource usage of a pipeline
+ *
+ * The report is real, user and sys time, peak RSS, voluntary and
+ * involuntary context switches and major and minor page faults: for each
+ * stage that ran as a process, for the shell itself when a stage ran in
+ * it, and in total. A stage's real time runs from the start of the
+ * pipeline until it was reaped, so the stage holding the others up is the
+ * one that finishes last. Formats:
+ *
+ *   time cmd | ...      table on stderr
+ *   time -p cmd | ...   POSIX "real/user/sys" lines
+ *   time -j cmd | ...   one JSON object on a single line
+ * ============================================================================ */
+
+#include "pipetime.h"
+#include "pipeline.h"
+#include "parser.h"
+#include "shell.h"
+#include "stats.h"
+#include "safe_string.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+/* ---- Usage arithmetic --------------------------------------------------- */
+
+static double tv_sec(struct timeval tv)
+{
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static struct timeval tv_add(struct timeval a, struct timeval b)
+{
+    struct timeval r = { a.tv_sec + b.tv_sec, a.tv_usec + b.tv_usec };
+    if (r.tv_usec >= 1000000) {
+        r.tv_sec++;
+        r.tv_usec -= 1000000;
+    }
+    return r;
+}
+
+static struct timeval tv_sub(struct timeval a, struct timeval b)
+{
+    struct timeval r = { a.tv_sec - b.tv_sec, a.tv_usec - b.tv_usec };
+    if (r.tv_usec < 0) {
+        r.tv_sec--;
+        r.tv_usec += 1000000;
+    }
+    return r;
+}
+
+/* Add b's times and counts to a; peak RSS is the larger of the two */
+static void usage_add(struct rusage *a, const struct rusage *b)
+{
+    a->ru_utime  = tv_add(a->ru_utime, b->ru_utime);
+    a->ru_stime  = tv_add(a->ru_stime, b->ru_stime);
+    if (b->ru_maxrss > a->ru_maxrss)
+        a->ru_maxrss = b->ru_maxrss;
+    a->ru_nvcsw  += b->ru_nvcsw;
+    a->ru_nivcsw += b->ru_nivcsw;
+    a->ru_majflt += b->ru_majflt;
+    a->ru_minflt += b->ru_minflt;
+}
+
+/* What the shell itself did between before and after; peak RSS is its
+ * high-water mark, which cannot be taken apart */
+static struct rusage usage_delta(const struct rusage *after,
+                                 const struct rusage *before)
+{
+    struct rusage d;
+    memset(&d, 0, sizeof(d));
+    d.ru_utime  = tv_sub(after->ru_utime, before->ru_utime);
+    d.ru_stime  = tv_sub(after->ru_stime, before->ru_stime);
+    d.ru_maxrss = after->ru_maxrss;
+    d.ru_nvcsw  = after->ru_nvcsw - before->ru_nvcsw;
+    d.ru_nivcsw = after->ru_nivcsw - before->ru_nivcsw;
+    d.ru_majflt = after->ru_majflt - before->ru_majflt;
+    d.ru_minflt = after->ru_minflt - before->ru_minflt;
+    return d;
+}
+
+/* ---- Report ------------------------------------------------------------- */
+
+const char *pipetime_stage_label(const ASTNode *node)
+{
+    if (!node)
+        return "?";
+    switch (node->type) {
+    case NODE_COMMAND:
+        return node->cmd.argc > 0 ? node->cmd.argv[0] : "(assign)";
+    case NODE_PIPELINE:   return "(pipeline)";
+    case NODE_SUBSHELL:   return "( )";
+    case NODE_BLOCK:      return "{ }";
+    case NODE_IF:         return "if";
+    case NODE_WHILE:      return "while";
+    case NODE_FOR:        return "for";
+    case NODE_ARITH:      return "(( ))";
+    case NODE_FUNCTION:   return "function";
+    default:              return "(list)";
+    }
+}
+
+/* One row of a report: a stage, the shell or the total */
+typedef struct Row {
+    const char          *label;
+    pid_t                pid;
+    double               real;
+    const struct rusage *usage;
+} Row;
+
+static void table_header(SafeString *out)
+{
+    sstr_appendf(out, "%-12s %8s %9s %9s %9s %9s %6s %6s %7s %7s\n",
+                 "stage", "pid", "real", "user", "sys", "maxrss",
+                 "vcsw", "ivcsw", "majflt", "minflt");
+}
+
+static void table_row(SafeString *out, const Row *r)
+{
+    char pid[16] = "-", rss[32];
+    if (r->pid > 0)
+        snprintf(pid, sizeof(pid), "%d", (int)r->pid);
+    long kb = r->usage->ru_maxrss;
+    if (kb >= 1024)
+        snprintf(rss, sizeof(rss), "%.1fM", (double)kb / 1024.0);
+    else
+        snprintf(rss, sizeof(rss), "%ldK", kb);
+
+    sstr_appendf(out, "%-12.12s %8s %8.3fs %8.3fs %8.3fs %9s %6ld %6ld %7ld %7ld\n",
+                 r->label, pid, r->real, tv_sec(r->usage->ru_utime),
+                 tv_sec(r->usage->ru_stime), rss, r->usage->ru_nvcsw,
+                 r->usage->ru_nivcsw, r->usage->ru_majflt,
+                 r->usage->ru_minflt);
+}
+
+static void json_string(SafeString *out, const char *s)
+{
+    sstr_append_char(out, '"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            sstr_appendf(out, "\\%c", c);
+        else if (c < 0x20)
+            sstr_appendf(out, "\\u%04x", c);
+        else
+            sstr_append_char(out, (char)c);
+    }
+    sstr_append_char(out, '"');
+}
+
+static void json_fields(SafeString *out, const Row *r)
+{
+    sstr_appendf(out, "\"real\":%.6f,\"user\":%.6f,\"sys\":%.6f,"
+                 "\"maxrss_kb\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld,"
+                 "\"majflt\":%ld,\"minflt\":%ld",
+                 r->real, tv_sec(r->usage->ru_utime),
+                 tv_sec(r->usage->ru_stime), r->usage->ru_maxrss,
+                 r->usage->ru_nvcsw, r->usage->ru_nivcsw,
+                 r->usage->ru_majflt, r->usage->ru_minflt);
+}
+
+static void report(const PipeTimer *t, const struct rusage *self,
+                   uint64_t end_ns, int status)
+{
+    const PipelineNode *p = t->pipeline;
+    double real = (double)(end_ns - t->start_ns) / 1e9;
+
+    /* The shell's row: its own work plus children that were no stage */
+    struct rusage shell_usage = *self;
+    usage_add(&shell_usage, &t->others);
+
+    struct rusage total = shell_usage;
+    bool in_shell = p->count <= 1;
+    for (int i = 0; i < p->count; i++) {
+        if (t->stages[i].pid > 0)
+            usage_add(&total, &t->stages[i].usage);
+        else
+            in_shell = true;
+    }
+
+    Row *rows = calloc((size_t)p->count + 2, sizeof(Row));
+    SafeString *out = sstr_scratch();
+    if (!rows || !out) {
+        free(rows);
+        sstr_scratch_done(out);
+        return;
+    }
+
+    /* Stages that were processes, then the shell if a stage ran in it */
+    int n = 0;
+    if (p->count > 1) {
+        for (int i = 0; i < p->count; i++) {
+            const TimedStage *s = &t->stages[i];
+            if (s->pid <= 0)
+                continue;
+            rows[n++] = (Row){
+                .label = pipetime_stage_label(p->commands[i]), .pid = s->pid,
+                .real  = s->reaped ? (double)(s->end_ns - t->start_ns) / 1e9 : real,
+                .usage = &s->usage,
+            };
+        }
+        if (in_shell)
+            rows[n++] = (Row){ "(shell)", 0, real, &shell_usage };
+    }
+    Row sum = { "total", 0, real, &total };
+
+    switch (p->timed) {
+    case TIME_POSIX:
+        sstr_appendf(out, "real %.2f\nuser %.2f\nsys %.2f\n", real,
+                     tv_sec(total.ru_utime), tv_sec(total.ru_stime));
+        break;
+
+    case TIME_JSON:
+        sstr_append_char(out, '{');
+        json_fields(out, &sum);
+        sstr_appendf(out, ",\"status\":%d,\"stages\":[", status);
+        for (int i = 0; i < n; i++) {
+            sstr_append(out, i ? ",{\"command\":" : "{\"command\":");
+            json_string(out, rows[i].label);
+            sstr_appendf(out, ",\"pid\":%d,", (int)rows[i].pid);
+            json_fields(out, &rows[i]);
+            sstr_append_char(out, '}');
+        }
+        sstr_append(out, "]}\n");
+        break;
+
+    default:
+        table_header(out);
+        for (int i = 0; i < n; i++)
+            table_row(out, &rows[i]);
+        table_row(out, &sum);
+        break;
+    }
+
+    fflush(stdout);
+    fputs(sstr_cstr(out), stderr);
+    sstr_scratch_done(out);
+    free(rows);
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+int pipetime_execute(Shell *shell, PipelineNode *pipeline)
+{
+    PipeTimer timer;
+    memset(&timer, 0, sizeof(timer));
+    timer.pipeline = pipeline;
+    timer.outer    = shell->timer;
+    timer.stages   = calloc((size_t)pipeline->count + 1, sizeof(TimedStage));
+    if (!timer.stages) {
+        fprintf(stderr, "vsh: time: out of memory\n");
+        return pipeline_execute(shell, pipeline);
+    }
+
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    timer.start_ns = stats_now();
+    shell->timer = &timer;
+
+    int status = pipeline_execute(shell, pipeline);
+
+    shell->timer = timer.outer;
+    uint64_t end_ns = stats_now();
+    getrusage(RUSAGE_SELF, &after);
+
+    struct rusage self = usage_delta(&after, &before);
+    report(&timer, &self, end_ns, status);
+    free(timer.stages);
+    return status;
+}
+
+void pipetime_stage_started(Shell *shell, const PipelineNode *pipeline,
+                            int i, pid_t pid)
+{
+    PipeTimer *t = shell->timer;
+    if (t && t->pipeline == pipeline && i >= 0 && i < pipeline->count)
+        t->stages[i].pid = pid;
+}
+
+void pipetime_reaped(Shell *shell, pid_t pid, int status,
+                     const struct rusage *usage)
+{
+    if (!WIFEXITED(status) && !WIFSIGNALED(status))
+        return;
+
+    /* Every enclosing timer sees the child: as one of its stages, or as
+     * work done on behalf of a stage that runs in the shell */
+    uint64_t now = 0;
+    for (PipeTimer *t = shell->timer; t; t = t->outer) {
+        int i = 0;
+        while (i < t->pipeline->count && t->stages[i].pid != pid)
+            i++;
+        if (i == t->pipeline->count) {
+            usage_add(&t->others, usage);
+            continue;
+        }
+        if (!now)
+            now = stats_now();
+        t->stages[i].reaped = true;
+        t->stages[i].end_ns = now;
+        t->stages[i].usage  = *usage;
+    }
+}
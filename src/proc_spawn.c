@@ -0,0 +1,188 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * proc_spawn.c - posix_spawn fast path for external commands
+ *
+ * The child is described entirely up front: pipe ends are dup2'd onto
+ * stdin/stdout, the remaining pipe descriptors are closed, and the command's
+ * redirections become open/dup2 file actions in list order -- the same
+ * sequence executor_apply_redirections() performs after a fork. Signal
+ * dispositions the shell ignores are reset to SIG_DFL and the mask is
+ * cleared, matching job_child_reset_signals().
+ *
+ * The terminal handoff for foreground jobs uses glibc's
+ * posix_spawn_file_actions_addtcsetpgrp_np(); it runs while the child still
+ * has every signal blocked, so the background-group tcsetpgrp() cannot
+ * raise SIGTTOU. Without it, interactive foreground commands keep forking.
+ * ============================================================================ */
+
+#include "proc_spawn.h"
+#include "shell.h"
+#include "env.h"
+#include "parser.h"
+#include "stats.h"
+
+#include <spawn.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#  if __GLIBC_PREREQ(2, 35)
+#    define HAVE_SPAWN_TCSETPGRP 1
+#  endif
+#endif
+
+/* ---- Internal helpers --------------------------------------------------- */
+
+/* Translate one redirection into a file action. Returns 0 or an errno. */
+static int add_redirection(posix_spawn_file_actions_t *fa, const Redirection *r)
+{
+    switch (r->type) {
+    case REDIR_INPUT:
+        return posix_spawn_file_actions_addopen(fa, r->fd < 0 ? STDIN_FILENO : r->fd,
+                                                r->target, O_RDONLY, 0);
+    case REDIR_OUTPUT:
+        return posix_spawn_file_actions_addopen(fa, r->fd < 0 ? STDOUT_FILENO : r->fd,
+                                                r->target,
+                                                O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    case REDIR_APPEND:
+        return posix_spawn_file_actions_addopen(fa, r->fd < 0 ? STDOUT_FILENO : r->fd,
+                                                r->target,
+                                                O_WRONLY | O_CREAT | O_APPEND, 0644);
+    case REDIR_DUP_OUT:
+    case REDIR_DUP_IN: {
+        int fd = r->fd >= 0 ? r->fd
+               : (r->type == REDIR_DUP_IN ? STDIN_FILENO : STDOUT_FILENO);
+        if (strcmp(r->target, "-") == 0)
+            return posix_spawn_file_actions_addclose(fa, fd);
+        /* Anything but a plain number is left to the fork path to report */
+        char *endp;
+        long src = strtol(r->target, &endp, 10);
+        if (endp == r->target || *endp != '\0' || src < 0 || src > 1023)
+            return EINVAL;
+        return posix_spawn_file_actions_adddup2(fa, (int)src, fd);
+    }
+    case REDIR_HEREDOC:
+    case REDIR_HERESTRING:
+        break;
+    }
+    return ENOTSUP;
+}
+
+static int build_file_actions(posix_spawn_file_actions_t *fa,
+                              const SpawnRequest *req, bool take_tty)
+{
+    int err = 0;
+
+#ifdef HAVE_SPAWN_TCSETPGRP
+    /* Must run before fd 0 is rewired to a pipe or file */
+    if (take_tty)
+        err = posix_spawn_file_actions_addtcsetpgrp_np(fa, STDIN_FILENO);
+#else
+    (void)take_tty;
+#endif
+
+    if (!err && req->stdin_fd >= 0 && req->stdin_fd != STDIN_FILENO)
+        err = posix_spawn_file_actions_adddup2(fa, req->stdin_fd, STDIN_FILENO);
+    if (!err && req->stdout_fd >= 0 && req->stdout_fd != STDOUT_FILENO)
+        err = posix_spawn_file_actions_adddup2(fa, req->stdout_fd, STDOUT_FILENO);
+
+    for (int i = 0; !err && i < req->nclose; i++) {
+        if (req->close_fds[i] > STDERR_FILENO)
+            err = posix_spawn_file_actions_addclose(fa, req->close_fds[i]);
+    }
+
+    for (const Redirection *r = req->redirs; !err && r; r = r->next)
+        err = add_redirection(fa, r);
+
+    return err;
+}
+
+static int build_attributes(posix_spawnattr_t *attr, pid_t pgid,
+                            bool set_group)
+{
+    sigset_t defaults, empty;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGQUIT);
+    sigaddset(&defaults, SIGTSTP);
+    sigaddset(&defaults, SIGTTIN);
+    sigaddset(&defaults, SIGTTOU);
+    sigaddset(&defaults, SIGCHLD);
+    sigaddset(&defaults, SIGPIPE);
+    sigemptyset(&empty);
+
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+    if (set_group)
+        flags |= POSIX_SPAWN_SETPGROUP;
+
+    int err = posix_spawnattr_setflags(attr, flags);
+    if (!err && set_group) err = posix_spawnattr_setpgroup(attr, pgid);
+    if (!err) err = posix_spawnattr_setsigdefault(attr, &defaults);
+    if (!err) err = posix_spawnattr_setsigmask(attr, &empty);
+    return err;
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+bool spawn_supported(Shell *shell, const Redirection *redirs, bool foreground)
+{
+#ifndef HAVE_SPAWN_TCSETPGRP
+    if (foreground && shell->interactive)
+        return false;
+#else
+    (void)shell;
+    (void)foreground;
+#endif
+
+    for (const Redirection *r = redirs; r; r = r->next) {
+        if (r->type == REDIR_HEREDOC || r->type == REDIR_HERESTRING)
+            return false;
+    }
+    return true;
+}
+
+pid_t spawn_command(Shell *shell, const SpawnRequest *req)
+{
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t attr;
+    bool take_tty = req->foreground && shell->interactive && req->pgid == 0;
+
+    int err = posix_spawn_file_actions_init(&fa);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    err = posix_spawnattr_init(&attr);
+    if (err) {
+        posix_spawn_file_actions_destroy(&fa);
+        errno = err;
+        return -1;
+    }
+
+    err = build_file_actions(&fa, req, take_tty);
+    if (!err)
+        err = build_attributes(&attr, req->pgid, shell->interactive);
+
+    pid_t pid = -1;
+    if (!err) {
+        char **envp = env_envp(shell->env);
+        if (envp)
+            err = posix_spawn(&pid, req->path, &fa, &attr, req->argv, envp);
+        else
+            err = ENOMEM;
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&fa);
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    stats_spawn(shell->stats);
+    return pid;
+}
@@ -0,0 +1,389 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * prompt.c - Segment-based prompt renderer
+ *
+ * Format:
+ *   [HH:MM:SS] user@host:~/path (git-branch* +ahead -behind) [N jobs]
+ *   $ _                         (green if $?==0, red otherwise)
+ *
+ * Rendering gathers the inputs every segment may need (cwd, git state, the
+ * clock, job count) into a PromptCtx once, then asks each segment for its
+ * key. A segment is re-rendered only when its key changed, so an idle
+ * prompt costs a stat(".") to confirm the logical $PWD the shell tracks
+ * (cwd.c), one stat() for git, and a few comparisons.
+ * ============================================================================ */
+
+#include "prompt.h"
+#include "shell.h"
+#include "env.h"
+#include "cwd.h"
+#include "git_status.h"
+#include "safe_string.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define COL_RESET   "\x1b[0m"
+#define COL_DIM     "\x1b[90m"
+#define COL_GREEN_B "\x1b[1;32m"
+#define COL_BLUE_B  "\x1b[1;34m"
+#define COL_MAG_B   "\x1b[1;35m"
+#define COL_RED_B   "\x1b[1;31m"
+
+typedef struct PromptCtx {
+    Shell         *shell;
+    char           cwd[PATH_MAX];
+    const char    *home;
+    const GitInfo *git;
+    time_t         now;
+    int            jobs;
+} PromptCtx;
+
+typedef struct PromptSegment {
+    const char *name;
+    /* Write everything the output depends on */
+    void (*key)(const PromptCtx *ctx, SafeString *key);
+    void (*render)(const PromptCtx *ctx, SafeString *out);
+} PromptSegment;
+
+typedef struct SegmentCache {
+    SafeString *key;
+    SafeString *bytes;
+    int         rows;       /* Newlines inside the segment */
+    int         width;      /* Visible width after its last newline */
+    bool        valid;
+} SegmentCache;
+
+/* ---- Segments ----------------------------------------------------------- */
+
+static void time_key(const PromptCtx *ctx, SafeString *key)
+{
+    sstr_appendf(key, "%ld", (long)ctx->now);
+}
+
+static void time_render(const PromptCtx *ctx, SafeString *out)
+{
+    char timebuf[16];
+    struct tm *tm_info = localtime(&ctx->now);
+    strftime(timebuf, sizeof(timebuf), "%H:%M:%S", tm_info);
+    sstr_appendf(out, "%s[%s]%s ", COL_DIM, timebuf, COL_RESET);
+}
+
+static const char *prompt_user(const PromptCtx *ctx)
+{
+    const char *user = env_get(ctx->shell->env, "USER");
+    if (!user) user = getenv("USER");
+    return user ? user : "user";
+}
+
+static void host_key(const PromptCtx *ctx, SafeString *key)
+{
+    sstr_append(key, prompt_user(ctx));
+}
+
+static void host_render(const PromptCtx *ctx, SafeString *out)
+{
+    char hostname[256];
+    if (gethostname(hostname, sizeof(hostname)) != 0)
+        snprintf(hostname, sizeof(hostname), "localhost");
+    hostname[sizeof(hostname) - 1] = '\0';
+    /* Trim domain part for readability */
+    char *dot = strchr(hostname, '.');
+    if (dot) *dot = '\0';
+
+    sstr_appendf(out, "%s%s@%s%s:", COL_GREEN_B, prompt_user(ctx), hostname,
+                 COL_RESET);
+}
+
+static void cwd_key(const PromptCtx *ctx, SafeString *key)
+{
+    sstr_append(key, ctx->cwd);
+    sstr_append_char(key, '\0');
+    if (ctx->home)
+        sstr_append(key, ctx->home);
+}
+
+/* HOME prefix replaced by ~ */
+static void cwd_render(const PromptCtx *ctx, SafeString *out)
+{
+    const char *home = ctx->home;
+    const char *rest = ctx->cwd;
+
+    sstr_append(out, COL_BLUE_B);
+    if (home && *home) {
+        size_t home_len = strlen(home);
+        if (strncmp(rest, home, home_len) == 0 &&
+            (rest[home_len] == '/' || rest[home_len] == '\0')) {
+            sstr_append_char(out, '~');
+            rest += home_len;
+        }
+    }
+    sstr_append(out, rest);
+    sstr_append(out, COL_RESET);
+}
+
+static void git_key(const PromptCtx *ctx, SafeString *key)
+{
+    const GitInfo *git = ctx->git;
+    if (!git->branch)
+        return;
+    sstr_append(key, git->branch);
+    if (git->have_detail)
+        sstr_appendf(key, "\n%d %d %d", git->dirty, git->ahead, git->behind);
+}
+
+static void git_render(const PromptCtx *ctx, SafeString *out)
+{
+    const GitInfo *git = ctx->git;
+    if (!git->branch)
+        return;
+
+    sstr_appendf(out, " %s(%s", COL_MAG_B, git->branch);
+    if (git->have_detail) {
+        if (git->dirty)      sstr_append(out, "*");
+        if (git->ahead > 0)  sstr_appendf(out, " +%d", git->ahead);
+        if (git->behind > 0) sstr_appendf(out, " -%d", git->behind);
+    }
+    sstr_appendf(out, ")%s", COL_RESET);
+}
+
+static void jobs_key(const PromptCtx *ctx, SafeString *key)
+{
+    sstr_appendf(key, "%d", ctx->jobs);
+}
+
+static void jobs_render(const PromptCtx *ctx, SafeString *out)
+{
+    if (ctx->jobs > 0)
+        sstr_appendf(out, " %s[%d job%s]%s", COL_DIM, ctx->jobs,
+                     ctx->jobs == 1 ? "" : "s", COL_RESET);
+}
+
+static void newline_key(const PromptCtx *ctx, SafeString *key)
+{
+    (void)ctx;
+    (void)key;
+}
+
+static void newline_render(const PromptCtx *ctx, SafeString *out)
+{
+    (void)ctx;
+    sstr_append_char(out, '\n');
+}
+
+static void status_key(const PromptCtx *ctx, SafeString *key)
+{
+    sstr_appendf(key, "%d", ctx->shell->last_status);
+}
+
+static void status_render(const PromptCtx *ctx, SafeString *out)
+{
+    int status = ctx->shell->last_status;
+    if (status == 0)
+        sstr_appendf(out, "%s$%s ", COL_GREEN_B, COL_RESET);
+    else
+        sstr_appendf(out, "%s[%d]$%s ", COL_RED_B, status, COL_RESET);
+}
+
+static const PromptSegment segments[] = {
+    { "time",    time_key,    time_render    },
+    { "host",    host_key,    host_render    },
+    { "cwd",     cwd_key,     cwd_render     },
+    { "git",     git_key,     git_render     },
+    { "jobs",    jobs_key,    jobs_render    },
+    { "newline", newline_key, newline_render },
+    { "status",  status_key,  status_render  },
+};
+
+#define NSEGMENTS ((int)(sizeof(segments) / sizeof(segments[0])))
+
+struct Prompt {
+    SegmentCache cache[NSEGMENTS];
+    SafeString  *scratch;   /* Key being computed */
+    SafeString  *text;      /* Assembled prompt */
+    int          rows;
+    int          width;
+    bool         valid;
+};
+
+/* ---- Internal helpers --------------------------------------------------- */
+
+static int count_jobs(Shell *shell)
+{
+    int n = 0;
+    if (!shell->jobs)
+        return 0;
+    for (Job *j = shell->jobs->head; j; j = j->next) {
+        if (j->state == JOB_RUNNING || j->state == JOB_STOPPED)
+            n++;
+    }
+    return n;
+}
+
+static void fill_ctx(Shell *shell, PromptCtx *ctx)
+{
+    ctx->shell = shell;
+    const char *cwd = cwd_get(shell->cwd);
+    snprintf(ctx->cwd, sizeof(ctx->cwd), "%s", cwd ? cwd : "?");
+    ctx->home = env_get(shell->env, "HOME");
+    if (!ctx->home)
+        ctx->home = getenv("HOME");
+    ctx->git  = git_status_get(shell, ctx->cwd);
+    ctx->now  = time(NULL);
+    ctx->jobs = count_jobs(shell);
+}
+
+/* Re-render one segment if its key moved. Returns true if it did. */
+static bool update_segment(Prompt *p, int i, const PromptCtx *ctx)
+{
+    SegmentCache *c = &p->cache[i];
+
+    sstr_clear(p->scratch);
+    segments[i].key(ctx, p->scratch);
+    if (c->valid && c->key->len == p->scratch->len &&
+        memcmp(sstr_cstr(c->key), sstr_cstr(p->scratch), c->key->len) == 0)
+        return false;
+
+    /* Swap the new key in; the old buffer becomes the next scratch */
+    SafeString *old = c->key;
+    c->key     = p->scratch;
+    p->scratch = old;
+
+    sstr_clear(c->bytes);
+    segments[i].render(ctx, c->bytes);
+
+    const char *b = sstr_cstr(c->bytes);
+    c->rows = 0;
+    for (size_t k = 0; k < c->bytes->len; k++) {
+        if (b[k] == '\n')
+            c->rows++;
+    }
+    c->width = prompt_visible_width(b, c->bytes->len);
+    c->valid = true;
+    return true;
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+Prompt *prompt_create(void)
+{
+    Prompt *p = calloc(1, sizeof(Prompt));
+    if (!p)
+        return NULL;
+
+    p->scratch = sstr_new(64);
+    p->text    = sstr_new(256);
+    bool ok = p->scratch && p->text;
+    for (int i = 0; ok && i < NSEGMENTS; i++) {
+        p->cache[i].key   = sstr_new(32);
+        p->cache[i].bytes = sstr_new(64);
+        ok = p->cache[i].key && p->cache[i].bytes;
+    }
+    if (!ok) {
+        prompt_destroy(p);
+        return NULL;
+    }
+    return p;
+}
+
+void prompt_destroy(Prompt *p)
+{
+    if (!p)
+        return;
+    for (int i = 0; i < NSEGMENTS; i++) {
+        sstr_free(p->cache[i].key);
+        sstr_free(p->cache[i].bytes);
+    }
+    sstr_free(p->scratch);
+    sstr_free(p->text);
+    free(p);
+}
+
+const char *prompt_render(Shell *shell, bool *changed)
+{
+    Prompt *p = shell->prompt;
+    if (changed)
+        *changed = false;
+    if (!p)
+        return "$ ";
+
+    PromptCtx ctx;
+    fill_ctx(shell, &ctx);
+
+    bool dirty = !p->valid;
+    for (int i = 0; i < NSEGMENTS; i++) {
+        if (update_segment(p, i, &ctx))
+            dirty = true;
+    }
+    if (!dirty)
+        return sstr_cstr(p->text);
+
+    sstr_clear(p->text);
+    p->rows  = 0;
+    p->width = 0;
+    for (int i = 0; i < NSEGMENTS; i++) {
+        const SegmentCache *c = &p->cache[i];
+        sstr_append_n(p->text, sstr_cstr(c->bytes), c->bytes->len);
+        if (c->rows > 0) {
+            p->rows += c->rows;
+            p->width = c->width;
+        } else {
+            p->width += c->width;
+        }
+    }
+    p->valid = true;
+    if (changed)
+        *changed = true;
+    return sstr_cstr(p->text);
+}
+
+void prompt_metrics(Shell *shell, const char *text, int *rows, int *width)
+{
+    Prompt *p = shell ? shell->prompt : NULL;
+    if (p && p->valid && text == sstr_cstr(p->text)) {
+        *rows  = p->rows;
+        *width = p->width;
+        return;
+    }
+
+    size_t len = strlen(text);
+    int n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '\n')
+            n++;
+    }
+    *rows  = n;
+    *width = prompt_visible_width(text, len);
+}
+
+int prompt_visible_width(const char *s, size_t len)
+{
+    int width = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        unsigned char ch = (unsigned char)s[i];
+        if (ch == '\x1b') {
+            i++;
+            if (i < len && s[i] == '[') {
+                /* CSI: parameters, then one final byte in 0x40..0x7e */
+                i++;
+                while (i < len && ((unsigned char)s[i] < 0x40 ||
+                                   (unsigned char)s[i] > 0x7e))
+                    i++;
+            }
+            i++;
+            continue;
+        }
+        if (ch == '\n' || ch == '\r')
+            width = 0;
+        else if ((ch & 0xc0) != 0x80 && ch >= 0x20)
+            width++;
+        i++;
+    }
+    return width;
+}
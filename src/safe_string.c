@@ -5,9 +5,14 @@
  * All mutations are bounds-checked and auto-grow via 2x reallocation.
  * The buffer is always null-terminated. NULL inputs are handled gracefully
  * throughout -- no function will dereference a NULL pointer.
+ *
+ * Where the buffer lives is read off the struct: data == inline_buf is the
+ * inline case, a non-NULL arena the arena case, anything else the heap.
+ * Only sstr_ensure() and the free paths need to tell them apart.
  * ============================================================================ */
 
 #include "safe_string.h"
+#include "arena.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -34,6 +39,7 @@ SafeString *sstr_new(size_t initial_cap)
 
     s->len     = 0;
     s->cap     = initial_cap;
+    s->arena   = NULL;
     s->data[0] = '\0';
     return s;
 }
@@ -59,8 +65,9 @@ SafeString *sstr_from(const char *cstr)
     }
 
     memcpy(s->data, cstr, len + 1);
-    s->len = len;
-    s->cap = cap;
+    s->len   = len;
+    s->cap   = cap;
+    s->arena = NULL;
     return s;
 }
 
@@ -85,8 +92,9 @@ SafeString *sstr_from_n(const char *data, size_t n)
 
     memcpy(s->data, data, n);
     s->data[n] = '\0';
-    s->len = n;
-    s->cap = cap;
+    s->len   = n;
+    s->cap   = cap;
+    s->arena = NULL;
     return s;
 }
 
@@ -95,10 +103,81 @@ void sstr_free(SafeString *s)
     if (!s)
         return;
 
-    free(s->data);
+    sstr_release(s);
     free(s);
 }
 
+void sstr_init(SafeString *s)
+{
+    s->data          = s->inline_buf;
+    s->len           = 0;
+    s->cap           = SSTR_INLINE_CAP;
+    s->arena         = NULL;
+    s->inline_buf[0] = '\0';
+}
+
+bool sstr_init_arena(SafeString *s, Arena *arena, size_t cap)
+{
+    if (cap < SSTR_INIT_CAP)
+        cap = SSTR_INIT_CAP;
+
+    s->data  = arena_alloc(arena, cap);
+    s->len   = 0;
+    s->cap   = cap;
+    s->arena = arena;
+    if (!s->data)
+        return false;
+    s->data[0] = '\0';
+    return true;
+}
+
+void sstr_release(SafeString *s)
+{
+    if (!s)
+        return;
+
+    if (!s->arena && s->data != s->inline_buf)
+        free(s->data);
+    s->data = NULL;
+    s->len  = s->cap = 0;
+}
+
+/* ---- Scratch pool ------------------------------------------------------- */
+
+#define SCRATCH_POOL 8
+
+static _Thread_local SafeString *scratch_pool[SCRATCH_POOL];
+static _Thread_local int         scratch_count;
+
+SafeString *sstr_scratch(void)
+{
+    if (scratch_count == 0)
+        return sstr_new(SSTR_SCRATCH_CAP);
+
+    SafeString *s = scratch_pool[--scratch_count];
+    sstr_clear(s);
+    return s;
+}
+
+void sstr_scratch_done(SafeString *s)
+{
+    if (!s)
+        return;
+
+    /* Keep the pool small, and do not pin one huge capture's buffer */
+    if (scratch_count == SCRATCH_POOL || s->cap > SSTR_SCRATCH_MAX) {
+        sstr_free(s);
+        return;
+    }
+    scratch_pool[scratch_count++] = s;
+}
+
+void sstr_scratch_drain(void)
+{
+    while (scratch_count > 0)
+        sstr_free(scratch_pool[--scratch_count]);
+}
+
 /* ---- Capacity management ------------------------------------------------ */
 
 bool sstr_ensure(SafeString *s, size_t needed)
@@ -115,7 +194,17 @@ bool sstr_ensure(SafeString *s, size_t needed)
     while (new_cap < required)
         new_cap *= 2;
 
-    char *new_data = realloc(s->data, new_cap);
+    char *new_data;
+    if (s->arena) {
+        new_data = arena_resize(s->arena, s->data, s->cap, new_cap);
+    } else if (s->data == s->inline_buf) {
+        /* First growth out of the struct: move to the heap */
+        new_data = malloc(new_cap);
+        if (new_data)
+            memcpy(new_data, s->data, s->len + 1);
+    } else {
+        new_data = realloc(s->data, new_cap);
+    }
     if (!new_data)
         return false;
 
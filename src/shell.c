@@ -16,14 +16,27 @@
 #include "lexer.h"
 #include "parser.h"
 #include "executor.h"
+#include "functions.h"
+#include "path_cache.h"
+#include "git_status.h"
+#include "dir_listing.h"
+#include "expr.h"
+#include "output.h"
+#include "prompt.h"
+#include "alias.h"
+#include "ast_cache.h"
+#include "vshc.h"
+#include "stats.h"
 #include "vsh_readline.h"
+#include "startup.h"
+#include "exec_index.h"
 #include "safe_string.h"
+#include "cwd.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <time.h>
 #include <termios.h>
 #include <signal.h>
 #include <sys/types.h>
@@ -31,60 +44,115 @@
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h>
+#include <fcntl.h>
 
 /* ---- Forward declarations of static helpers ----------------------------- */
 static char *expand_history(Shell *shell, const char *line);
-static char *expand_aliases(Shell *shell, const char *line);
-static char *find_git_branch(void);
-static char *shorten_path(const char *cwd, const char *home);
 static char *build_history_path(void);
+static int   exec_script(Shell *shell, const char *src, const char *name,
+                         bool need_complete, const struct stat *st);
+static void  run_script(Shell *shell, const Script *script, const char *error,
+                        const char *name);
+static void  run_stream(Shell *shell, int fd);
+static bool  input_incomplete(const char *src);
+static char *read_continuation(Shell *shell, char *line);
+
+/* Returned by exec_script when the input ends inside an open construct */
+#define SCRIPT_INCOMPLETE (-1)
+
+/* ---- Background startup tasks ------------------------------------------ */
+
+static void load_history(void *arg) {
+    Shell *shell = arg;
+    history_load(shell->history, shell->history_file);
+}
+
+static void list_path(void *arg) {
+    exec_index_refresh(arg);
+}
+
+/* Read ~/.vsh_history and list the PATH directories off the main thread;
+ * the first prompt does not need either */
+static void start_background_tasks(Shell *shell) {
+    shell->history_file = build_history_path();
+    if (shell->history && shell->history_file)
+        startup_run(shell->startup, STARTUP_HISTORY, load_history, shell);
+
+    /* Pointed at PATH here, so the thread only reads the directories */
+    ExecIndex *idx = path_cache_index(shell);
+    if (idx)
+        startup_run(shell->startup, STARTUP_PATH_INDEX, list_path, idx);
+}
 
 /* ============================================================================
  * shell_init - Allocate and initialize the shell and all subsystems
  * ============================================================================ */
 Shell *shell_init(int argc, char **argv) {
+    return shell_create(argc, argv, isatty(STDIN_FILENO));
+}
+
+Shell *shell_create(int argc, char **argv, bool interactive) {
     Shell *shell = calloc(1, sizeof(Shell));
     if (!shell) {
         fprintf(stderr, "vsh: fatal: out of memory\n");
         exit(1);
     }
 
+    shell->startup    = startup_create();
     shell->shell_pid  = getpid();
-    shell->interactive = isatty(STDIN_FILENO);
+    shell->interactive = interactive;
     shell->running     = true;
 
     /* Subsystem creation */
     shell->parse_arena = arena_create();
     shell->env         = env_create();
+    startup_trace(shell->startup, "environment");
+
     shell->jobs        = calloc(1, sizeof(JobTable));
     if (shell->jobs) {
         shell->jobs->head    = NULL;
         shell->jobs->next_id = 1;
+        shell->jobs->event_fd = -1;
     }
-    shell->history  = history_create(HISTORY_MAX_SIZE);
-    shell->aliases  = calloc(1, sizeof(AliasTable));
-    shell->dirstack = calloc(1, sizeof(DirStack));
-    if (shell->dirstack) {
-        shell->dirstack->top = -1;
+    shell->aliases  = alias_table_create();
+    shell->functions  = func_table_create();
+    shell->path_cache = path_cache_create();
+    shell->expr_cache = expr_cache_create();
+    shell->ast_cache  = ast_cache_create();
+    shell->stats      = stats_create();
+    shell->out        = out_create(STDOUT_FILENO);
+    if (!shell->out) {
+        fprintf(stderr, "vsh: fatal: out of memory\n");
+        exit(1);
+    }
+    shell->dirstack = calloc(1, sizeof(DirStack)); /* Empty: top = 0 */
+    shell->cwd      = cwd_create(env_get(shell->env, "PWD"));
+    if (!shell->cwd) {
+        fprintf(stderr, "vsh: fatal: out of memory\n");
+        exit(1);
     }
+    const char *pwd = cwd_get(shell->cwd);
+    if (pwd)
+        env_set(shell->env, "PWD", pwd, true);
 
     /* Register built-in commands */
     builtins_init();
+    startup_trace(shell->startup, "subsystems and builtins");
 
-    /* Interactive-only initialization */
+    /* Interactive-only initialization: history, prompt, job control */
     if (shell->interactive) {
+        shell->history    = history_create(HISTORY_MAX_SIZE);
+        shell->git_status = git_status_create();
+        shell->dir_listing = dir_listing_create();
+        shell->prompt     = prompt_create();
+
         tcgetattr(STDIN_FILENO, &shell->orig_termios);
         job_control_init(shell);
-        job_set_shell(shell);
-
-        /* Load persistent history */
-        char *hist_path = build_history_path();
-        if (hist_path) {
-            history_load(shell->history, hist_path);
-            free(hist_path);
-        }
-
         shell_setup_signals(shell);
+        startup_trace(shell->startup, "job control and signals");
+
+        start_background_tasks(shell);
+        startup_trace(shell->startup, "history and path index started");
     }
 
     /* Source RC file (~/.vshrc) for interactive shells */
@@ -98,13 +166,14 @@ Shell *shell_init(int argc, char **argv) {
                 if (stat(rc_path, &st) == 0 && S_ISREG(st.st_mode)) {
                     char *source_argv[] = { "source", rc_path, NULL };
                     builtin_source(shell, 2, source_argv);
+                    startup_trace(shell->startup, "~/.vshrc");
                 }
             }
         }
     }
 
     /* Standard environment variables */
-    env_set(shell->env, "VSH_VERSION", "1.0.0", true);
+    env_set(shell->env, "VSH_VERSION", VSH_VERSION_STRING, true);
 
     /* Store positional parameters ($0 .. $N) */
     if (argc > 0 && argv) {
@@ -117,9 +186,18 @@ Shell *shell_init(int argc, char **argv) {
         }
     }
 
+    startup_trace(shell->startup, "ready");
     return shell;
 }
 
+History *shell_history(Shell *shell) {
+    /* A load still running when this process forked off the shell has
+     * left the table half-filled */
+    if (!startup_wait(shell->startup, STARTUP_HISTORY))
+        shell->history = NULL;
+    return shell->history;
+}
+
 /* ============================================================================
  * shell_destroy - Tear down the shell and release all resources
  * ============================================================================ */
@@ -127,40 +205,38 @@ void shell_destroy(Shell *shell) {
     if (!shell) return;
 
     if (shell->interactive) {
-        /* Persist history */
-        char *hist_path = build_history_path();
-        if (hist_path) {
-            history_save(shell->history, hist_path);
-            free(hist_path);
-        }
+        /* Persist history, unless it was never even needed */
+        if (!startup_pending(shell->startup, STARTUP_HISTORY) &&
+            shell->history && shell->history_file)
+            history_save(shell->history, shell->history_file);
         /* Restore original terminal attributes */
         tcsetattr(STDIN_FILENO, TCSAFLUSH, &shell->orig_termios);
     }
 
-    /* Subsystem destruction */
+    /* Subsystem destruction, once no startup task is using them */
+    startup_destroy(shell->startup);
     if (shell->parse_arena)  arena_destroy(shell->parse_arena);
     if (shell->env)          env_destroy(shell->env);
     if (shell->jobs)         { job_table_destroy(shell); free(shell->jobs); }
     if (shell->history)      history_destroy(shell->history);
-
-    /* Free alias table entries */
-    if (shell->aliases) {
-        for (int i = 0; i < ALIAS_HASH_SIZE; i++) {
-            AliasEntry *e = shell->aliases->buckets[i];
-            while (e) {
-                AliasEntry *next = e->next;
-                free(e->name);
-                free(e->value);
-                free(e);
-                e = next;
-            }
-        }
-        free(shell->aliases);
-    }
+    free(shell->history_file);
+    if (shell->functions)    func_table_destroy(shell->functions);
+    if (shell->path_cache)   path_cache_destroy(shell->path_cache);
+    if (shell->git_status)   git_status_destroy(shell->git_status);
+    if (shell->dir_listing)  dir_listing_destroy(shell->dir_listing);
+    if (shell->expr_cache)   expr_cache_destroy(shell->expr_cache);
+    if (shell->ast_cache)    ast_cache_destroy(shell->ast_cache);
+    if (shell->stats)        stats_destroy(shell->stats);
+    if (shell->out)          out_destroy(shell->out);
+    if (shell->prompt)       prompt_destroy(shell->prompt);
+
+    if (shell->aliases)      alias_table_destroy(shell->aliases);
+    cwd_destroy(shell->cwd);
+    sstr_scratch_drain();
 
     /* Free directory stack strings */
     if (shell->dirstack) {
-        for (int i = 0; i <= shell->dirstack->top; i++) {
+        for (int i = 0; i < shell->dirstack->top; i++) {
             free(shell->dirstack->dirs[i]);
         }
         free(shell->dirstack);
@@ -182,12 +258,16 @@ void shell_destroy(Shell *shell) {
  * ============================================================================ */
 int shell_run(Shell *shell) {
     if (shell->interactive) {
+        bool first_prompt = true;
         while (shell->running) {
             job_check_background(shell);
 
-            char *prompt = shell_build_prompt(shell);
-            char *line   = vsh_readline(shell, prompt);
-            free(prompt);
+            const char *prompt = prompt_render(shell, NULL);
+            if (first_prompt) {
+                startup_trace(shell->startup, "first prompt");
+                first_prompt = false;
+            }
+            char *line = vsh_readline(shell, prompt);
 
             if (!line) {
                 /* EOF (Ctrl+D) */
@@ -196,81 +276,259 @@ int shell_run(Shell *shell) {
             }
 
             if (line[0] != '\0') {
+                /* An open quote, here-document or compound command keeps
+                 * reading lines before anything runs */
+                line = read_continuation(shell, line);
                 shell_exec_line(shell, line);
             }
 
             free(line);
         }
     } else {
-        /* Non-interactive: read from stdin line by line */
-        char buf[4096];
-        while (fgets(buf, sizeof(buf), stdin)) {
-            size_t len = strlen(buf);
-            if (len > 0 && buf[len - 1] == '\n') {
-                buf[len - 1] = '\0';
+        /* Non-interactive: a regular file on stdin is run as one script,
+         * anything else (pipes) is consumed one complete command at a time */
+        struct stat st;
+        if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode)) {
+            char *src = shell_read_fd(STDIN_FILENO, NULL);
+            if (src) {
+                shell_exec_script(shell, src, "stdin");
+                free(src);
             }
-            if (buf[0] == '#' || buf[0] == '\0') continue;
-            shell_exec_line(shell, buf);
+        } else {
+            run_stream(shell, STDIN_FILENO);
         }
     }
 
     return shell->last_status;
 }
 
-/* ============================================================================
- * shell_exec_line - Execute a single line of input
- *
- * Pipeline: history expansion -> alias expansion -> lex -> parse -> execute
- * ============================================================================ */
-int shell_exec_line(Shell *shell, const char *line) {
-    if (!line || line[0] == '\0') return shell->last_status;
-
-    /* ---- History expansion (!! / !N / !-N / !prefix) -------------------- */
-    char *expanded = expand_history(shell, line);
-    if (!expanded) return shell->last_status;
-
-    /* Add the (possibly expanded) line to history */
-    history_add(shell->history, expanded);
-
-    /* ---- Alias expansion ------------------------------------------------ */
-    char *aliased = expand_aliases(shell, expanded);
-    if (expanded != line) free(expanded);
-    if (!aliased) return shell->last_status;
-
+/* Lex, alias-expand and parse one line into the parse arena. Reports a
+ * syntax error and sets last_status on failure (returning NULL). */
+static ASTNode *parse_line(Shell *shell, const char *text) {
     /* ---- Lex ------------------------------------------------------------ */
-    arena_reset(shell->parse_arena);
-
+    uint64_t t = stats_now();
     Lexer lex;
-    lexer_init(&lex, aliased, shell->parse_arena);
+    lexer_init(&lex, text, shell->parse_arena);
     TokenList *tokens = lexer_tokenize(&lex);
-
-    if (aliased != expanded && aliased != line) free(aliased);
+    t = stats_since(shell->stats, STAT_LEX, t);
 
     if (!tokens || lex.error) {
         fprintf(stderr, "vsh: syntax error: %s\n",
                 lex.error ? lex.error : "tokenization failed");
         shell->last_status = 2;
-        return shell->last_status;
+        return NULL;
+    }
+
+    /* ---- Alias expansion: command words become their lexed bodies ------ */
+    tokens = alias_expand(shell->aliases, tokens, shell->parse_arena);
+    t = stats_since(shell->stats, STAT_ALIAS, t);
+    if (!tokens) {
+        fprintf(stderr, "vsh: alias: out of memory\n");
+        shell->last_status = 1;
+        return NULL;
     }
 
     /* ---- Parse ---------------------------------------------------------- */
     Parser parser;
     parser_init(&parser, tokens, shell->parse_arena);
     ASTNode *ast = parser_parse(&parser);
+    stats_since(shell->stats, STAT_PARSE, t);
 
     if (parser.had_error || !ast) {
         const char *msg = parser_error(&parser);
         fprintf(stderr, "vsh: parse error: %s\n",
                 msg ? msg : "unexpected token");
         shell->last_status = 2;
-        return shell->last_status;
+        return NULL;
     }
+    return ast;
+}
+
+/* A top-level line or script command that began at start has finished:
+ * record it and, with `set -o timing`, print its breakdown */
+static void end_line(Shell *shell, uint64_t start) {
+    if (!stats_line_end(shell->stats)) return;
+    stats_since(shell->stats, STAT_LINE, start);
+    if (shell->opt_timing)
+        stats_print_line(shell->stats, stderr);
+}
+
+/* The phases of shell_exec_line, each timed into shell->stats */
+static int exec_line(Shell *shell, const char *line) {
+    /* ---- History expansion (!! / !N / !-N / !prefix) -------------------- */
+    /* A non-interactive shell keeps no history and expands no events */
+    char *expanded = (char *)line;
+    History *hist = shell_history(shell);
+    if (hist) {
+        uint64_t t = stats_now();
+        expanded = expand_history(shell, line);
+        if (!expanded) return shell->last_status;
+
+        /* Add the (possibly expanded) line to history */
+        history_add(hist, expanded);
+        stats_since(shell->stats, STAT_HISTORY, t);
+    }
+
+    arena_reset(shell->parse_arena);
+
+    /* ---- Cached AST, else the front end --------------------------------- */
+    size_t len = strlen(expanded);
+    unsigned long serial = shell->aliases ? shell->aliases->serial : 0;
+    AstCacheEntry *hit = ast_cache_find(shell->ast_cache, AST_LINE, expanded,
+                                        len, serial);
+    stats_cache(shell->stats, STAT_CACHE_AST, hit != NULL);
+    ASTNode *ast = hit ? hit->ast : parse_line(shell, expanded);
+    if (ast && !hit)
+        ast_cache_add_line(shell->ast_cache, expanded, len, serial, ast);
+
+    if (expanded != line) free(expanded);
+    if (!ast) return shell->last_status;
 
     /* ---- Execute -------------------------------------------------------- */
     shell->last_status = executor_execute(shell, ast);
+    ast_cache_release(hit);
+    return shell->last_status;
+}
+
+/* ============================================================================
+ * shell_exec_line - Execute a single line of input
+ *
+ * Pipeline: history expansion -> lex -> alias expansion -> parse -> execute
+ *
+ * A line seen before under the same aliases reuses its cached AST and goes
+ * straight from history expansion to execution. Each line is timed as a
+ * whole and phase by phase; `set -o timing` prints the breakdown.
+ * ============================================================================ */
+int shell_exec_line(Shell *shell, const char *line) {
+    if (!line || line[0] == '\0') return shell->last_status;
+
+    uint64_t start = stats_now();
+    stats_line_begin(shell->stats);
+    int status = exec_line(shell, line);
+    end_line(shell, start);
+    return status;
+}
+
+/* ============================================================================
+ * shell_exec_script - Lex and parse a whole script once, then run it
+ *
+ * Tokens and ASTs live in a private arena for the duration of the run, so
+ * the per-line costs of shell_exec_line (history and alias expansion, a
+ * fresh lexer and parser) are paid once per file. As in other shells, no
+ * history or alias expansion is applied to script input. Commands before
+ * a syntax error still run; the error is reported when it is reached.
+ * ============================================================================ */
+int shell_exec_script(Shell *shell, const char *src, const char *name) {
+    exec_script(shell, src, name, false, NULL);
+    return shell->last_status;
+}
+
+/* ============================================================================
+ * shell_exec_file - Run a script file, using its compiled image if current
+ *
+ * The file is stat'ed before it is read, so an image is only ever stored
+ * under the identity of the bytes that were parsed. Returns -1 with errno
+ * set if the file cannot be opened or read; otherwise the script's status.
+ * ============================================================================ */
+int shell_exec_file(Shell *shell, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    int rc = fstat(fd, &st);
+    if (rc != 0 || S_ISDIR(st.st_mode)) {
+        int err = rc != 0 ? errno : EISDIR;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    bool regular = S_ISREG(st.st_mode);
+    VshcImage *img = regular ? vshc_load(path, &st) : NULL;
+    if (regular)
+        stats_cache(shell->stats, STAT_CACHE_VSHC, img != NULL);
+    if (img) {
+        close(fd);
+        run_script(shell, img->script, img->error, path);
+        vshc_unload(img);
+        return shell->last_status;
+    }
+
+    char *src = shell_read_fd(fd, NULL);
+    int err = errno;
+    close(fd);
+    if (!src) {
+        errno = err;
+        return -1;
+    }
+
+    exec_script(shell, src, path, false, regular ? &st : NULL);
+    free(src);
     return shell->last_status;
 }
 
+/* ============================================================================
+ * shell_read_fd / shell_read_file - Slurp a file into a NUL-terminated buffer
+ *
+ * Returns a malloc'd buffer (caller frees) or NULL with errno set.
+ * ============================================================================ */
+char *shell_read_fd(int fd, size_t *out_len) {
+    struct stat st;
+    size_t cap = 4096;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        cap = (size_t)st.st_size + 1;
+    }
+
+    char *buf = malloc(cap);
+    if (!buf) return NULL;
+
+    size_t len = 0;
+    for (;;) {
+        if (len + 1 >= cap) {
+            char *tmp = realloc(buf, cap * 2);
+            if (!tmp) {
+                free(buf);
+                errno = ENOMEM;
+                return NULL;
+            }
+            buf = tmp;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, buf + len, cap - len - 1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            int err = errno;
+            free(buf);
+            errno = err;
+            return NULL;
+        }
+        if (n == 0) break;
+        len += (size_t)n;
+    }
+
+    buf[len] = '\0';
+    if (out_len) *out_len = len;
+    return buf;
+}
+
+char *shell_read_file(const char *path, size_t *out_len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISDIR(st.st_mode)) {
+        close(fd);
+        errno = EISDIR;
+        return NULL;
+    }
+
+    char *buf = shell_read_fd(fd, out_len);
+    int err = errno;
+    close(fd);
+    errno = err;
+    return buf;
+}
+
 /* ============================================================================
  * shell_enable_raw_mode - Switch terminal to cbreak mode for line editing
  * ============================================================================ */
@@ -279,17 +537,20 @@ void shell_enable_raw_mode(Shell *shell) {
 
     struct termios raw = shell->orig_termios;
 
-    /* Disable Ctrl+S/Q flow control, fix Ctrl+M so it reads as 13 */
-    raw.c_iflag &= ~((unsigned)IXON | (unsigned)ICRNL);
+    /* Disable Ctrl+S/Q flow control. ICRNL stays on: an Enter typed ahead
+     * of the next command must reach it as a line end, not as a CR. */
+    raw.c_iflag &= ~(unsigned)IXON;
 
-    /* No echo, no canonical buffering, no Ctrl+V literal-next */
-    /* Keep ISIG so Ctrl+C generates SIGINT (handled by our signal setup) */
-    raw.c_lflag &= ~((unsigned)ECHO | (unsigned)ICANON | (unsigned)IEXTEN);
+    /* No echo, no canonical buffering, no Ctrl+V literal-next, and no
+     * signal keys: the line editor reads Ctrl+C/Ctrl+Z as bytes */
+    raw.c_lflag &= ~((unsigned)ECHO | (unsigned)ICANON | (unsigned)IEXTEN |
+                     (unsigned)ISIG);
 
     raw.c_cc[VMIN]  = 1;   /* Read returns after 1 byte */
     raw.c_cc[VTIME] = 0;   /* No timeout */
 
-    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+    /* TCSADRAIN, not TCSAFLUSH: keep whatever was typed ahead */
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
     shell->raw_mode = true;
 }
 
@@ -299,87 +560,10 @@ void shell_enable_raw_mode(Shell *shell) {
 void shell_disable_raw_mode(Shell *shell) {
     if (!shell->interactive || !shell->raw_mode) return;
 
-    tcsetattr(STDIN_FILENO, TCSAFLUSH, &shell->orig_termios);
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &shell->orig_termios);
     shell->raw_mode = false;
 }
 
-/* ============================================================================
- * shell_build_prompt - Build a coloured, informative prompt string
- *
- * Format:
- *   [HH:MM:SS] user@host:~/path (git-branch)
- *   $ _                         (green if $?==0, red otherwise)
- * ============================================================================ */
-char *shell_build_prompt(Shell *shell) {
-    /* Colour codes */
-    static const char *COL_RESET   = "\x1b[0m";
-    static const char *COL_DIM     = "\x1b[90m";
-    static const char *COL_GREEN_B = "\x1b[1;32m";
-    static const char *COL_BLUE_B  = "\x1b[1;34m";
-    static const char *COL_MAG_B   = "\x1b[1;35m";
-    static const char *COL_RED_B   = "\x1b[1;31m";
-
-    /* Allocate a SafeString to build the prompt incrementally */
-    SafeString *ps = sstr_new(256);
-    if (!ps) return strdup("$ ");
-
-    /* -- Time component --------------------------------------------------- */
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    char timebuf[16];
-    strftime(timebuf, sizeof(timebuf), "%H:%M:%S", tm_info);
-    sstr_appendf(ps, "%s[%s]%s ", COL_DIM, timebuf, COL_RESET);
-
-    /* -- User@Host -------------------------------------------------------- */
-    const char *user = env_get(shell->env, "USER");
-    if (!user) user = getenv("USER");
-    if (!user) user = "user";
-
-    char hostname[256];
-    if (gethostname(hostname, sizeof(hostname)) != 0) {
-        strncpy(hostname, "localhost", sizeof(hostname) - 1);
-        hostname[sizeof(hostname) - 1] = '\0';
-    }
-    /* Trim domain part for readability */
-    char *dot = strchr(hostname, '.');
-    if (dot) *dot = '\0';
-
-    sstr_appendf(ps, "%s%s@%s%s:", COL_GREEN_B, user, hostname, COL_RESET);
-
-    /* -- Working directory (with ~ substitution) -------------------------- */
-    char cwd[PATH_MAX];
-    if (!getcwd(cwd, sizeof(cwd))) {
-        strncpy(cwd, "?", sizeof(cwd));
-    }
-
-    const char *home = env_get(shell->env, "HOME");
-    if (!home) home = getenv("HOME");
-
-    char *display_path = shorten_path(cwd, home);
-    sstr_appendf(ps, "%s%s%s", COL_BLUE_B, display_path, COL_RESET);
-    free(display_path);
-
-    /* -- Git branch (if in a repo) ---------------------------------------- */
-    char *branch = find_git_branch();
-    if (branch) {
-        sstr_appendf(ps, " %s(%s)%s", COL_MAG_B, branch, COL_RESET);
-        free(branch);
-    }
-
-    /* -- Newline + status indicator --------------------------------------- */
-    sstr_append(ps, "\n");
-    if (shell->last_status == 0) {
-        sstr_appendf(ps, "%s$%s ", COL_GREEN_B, COL_RESET);
-    } else {
-        sstr_appendf(ps, "%s[%d]$%s ", COL_RED_B, shell->last_status, COL_RESET);
-    }
-
-    /* Convert SafeString to a plain malloc'd string */
-    char *result = strdup(sstr_cstr(ps));
-    sstr_free(ps);
-    return result ? result : strdup("$ ");
-}
-
 /* ============================================================================
  * shell_setup_signals - Install signal handlers for the interactive shell
  * ============================================================================ */
@@ -401,10 +585,7 @@ void shell_setup_signals(Shell *shell) {
     sigaction(SIGTTOU, &sa, NULL);
     sigaction(SIGPIPE, &sa, NULL);
 
-    /* SIGCHLD: reap background children */
-    sa.sa_handler = sigchld_handler;
-    sa.sa_flags   = SA_RESTART | SA_NOCLDSTOP;
-    sigaction(SIGCHLD, &sa, NULL);
+    /* SIGCHLD stays blocked; job control reads it from a signalfd */
 }
 
 /* ============================================================================
@@ -518,138 +699,194 @@ static char *expand_history(Shell *shell, const char *line) {
     return (char *)line;
 }
 
-/* ---- Alias expansion ---------------------------------------------------- */
+/* ---- Script execution --------------------------------------------------- */
+
+/* Run each top-level command of a parsed script, then report the syntax
+ * error (if any) that ended it */
+static void run_script(Shell *shell, const Script *script, const char *error,
+                       const char *name) {
+    for (int i = 0; i < script->count && shell->running && !shell->returning;
+         i++) {
+        /* Expansion scratch goes back to where this script found it, which
+         * also keeps a sourced file from touching its caller's AST */
+        ArenaMark mark = arena_mark(shell->parse_arena);
+        uint64_t start = stats_now();
+        stats_line_begin(shell->stats);
+        executor_execute(shell, script->commands[i]);
+        end_line(shell, start);
+        arena_rewind(shell->parse_arena, mark);
+    }
 
-/* Simple hash for alias lookup (must match whatever builtins/alias uses) */
-static unsigned alias_hash(const char *key) {
-    unsigned h = 5381;
-    while (*key) {
-        h = ((h << 5) + h) + (unsigned char)*key++;
+    if (error && shell->running && !shell->returning) {
+        fprintf(stderr, "vsh: %s: %s\n", name, error);
+        shell->last_status = 2;
     }
-    return h % ALIAS_HASH_SIZE;
 }
 
-static const char *alias_lookup(AliasTable *tbl, const char *name) {
-    if (!tbl) return NULL;
-    unsigned h = alias_hash(name);
-    for (AliasEntry *e = tbl->buckets[h]; e; e = e->next) {
-        if (strcmp(e->name, name) == 0) return e->value;
+/*
+ * Lex and parse src into a private arena, then run each top-level command.
+ * With need_complete set, input that ends inside an open construct (quote,
+ * if/while/for, brace group) is left unexecuted and SCRIPT_INCOMPLETE is
+ * returned so the caller can append more lines. Sourced files are kept in
+ * the AST cache, so sourcing the same text again skips lexing and parsing;
+ * with st (the stat of the file src was read from) the parse is also saved
+ * as a compiled image for later shells.
+ */
+static int exec_script(Shell *shell, const char *src, const char *name,
+                       bool need_complete, const struct stat *st) {
+    bool   cacheable = !need_complete && shell->script_depth > 0;
+    size_t len       = cacheable ? strlen(src) : 0;
+    AstCacheEntry *hit = cacheable
+        ? ast_cache_find(shell->ast_cache, AST_SCRIPT, src, len, 0)
+        : NULL;
+    if (cacheable)
+        stats_cache(shell->stats, STAT_CACHE_AST, hit != NULL);
+    if (hit) {
+        run_script(shell, hit->script, hit->error, name);
+        ast_cache_release(hit);
+        return shell->last_status;
     }
-    return NULL;
-}
 
-static char *expand_aliases(Shell *shell, const char *line) {
-    if (!shell->aliases || !line || line[0] == '\0') {
-        return (char *)line;
+    Arena *arena = arena_create_sized(ARENA_PAGE_SIZE * 16);
+    if (!arena) {
+        fprintf(stderr, "vsh: %s: out of memory\n", name);
+        shell->last_status = 1;
+        return 1;
     }
 
-    /* Work on a mutable copy */
-    char *current = strdup(line);
-    if (!current) return (char *)line;
+    uint64_t t = stats_now();
+    Lexer lex;
+    lexer_init(&lex, src, arena);
+    TokenList *tokens = lexer_tokenize(&lex);
+    t = stats_since(shell->stats, STAT_LEX, t);
 
-    for (int depth = 0; depth < 10; depth++) {
-        /* Skip leading whitespace */
-        const char *p = current;
-        while (*p && isspace((unsigned char)*p)) p++;
-        if (!*p) break;
+    if (!tokens || lex.error) {
+        if (need_complete && lex.incomplete) {
+            arena_destroy(arena);
+            return SCRIPT_INCOMPLETE;
+        }
+        fprintf(stderr, "vsh: %s: syntax error: %s\n", name,
+                lex.error ? lex.error : "tokenization failed");
+        arena_destroy(arena);
+        shell->last_status = 2;
+        return 2;
+    }
 
-        /* Extract the first word */
-        const char *word_start = p;
-        while (*p && !isspace((unsigned char)*p)) p++;
-        size_t word_len = (size_t)(p - word_start);
+    Parser parser;
+    parser_init(&parser, tokens, arena);
+    Script *script = parser_parse_script(&parser);
+    stats_since(shell->stats, STAT_PARSE, t);
 
-        char word[256];
-        if (word_len >= sizeof(word)) break;
-        memcpy(word, word_start, word_len);
-        word[word_len] = '\0';
+    if (need_complete && parser.had_error && parser.incomplete) {
+        arena_destroy(arena);
+        return SCRIPT_INCOMPLETE;
+    }
 
-        const char *replacement = alias_lookup(shell->aliases, word);
-        if (!replacement) break;
+    const char *error = NULL;
+    if (parser.had_error) {
+        error = parser_error(&parser);
+        if (!error)
+            error = "unexpected token";
+    }
+    if (cacheable)
+        ast_cache_add_script(shell->ast_cache, src, len, script, error);
+    if (st)
+        vshc_store(name, st, script, error);
 
-        /* Build new line: leading_ws + replacement + rest */
-        size_t leading = (size_t)(word_start - current);
-        size_t rep_len = strlen(replacement);
-        size_t rest_len = strlen(p);
+    run_script(shell, script, error, name);
 
-        char *newline = malloc(leading + rep_len + rest_len + 1);
-        if (!newline) break;
+    arena_destroy(arena);
+    return shell->last_status;
+}
 
-        memcpy(newline, current, leading);
-        memcpy(newline + leading, replacement, rep_len);
-        memcpy(newline + leading + rep_len, p, rest_len + 1);
+/* Append the next line of fd, newline included, to buf. A pipe cannot
+ * be handed back what was read past the newline, so this goes a byte at
+ * a time. False at end of input with nothing read. */
+static bool read_line_fd(int fd, SafeString *buf) {
+    bool any = false;
+    char c;
+    for (;;) {
+        ssize_t n = read(fd, &c, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        any = true;
+        sstr_append_char(buf, c);
+        if (c == '\n') break;
+    }
+    return any;
+}
 
-        free(current);
-        current = newline;
+/*
+ * Read commands from a non-seekable stream (e.g. a pipe). Lines are
+ * accumulated until they form complete commands, so multi-line constructs
+ * work. The stream is read straight from the descriptor with no buffer,
+ * so nothing past the current line is taken: a command that reads stdin
+ * gets the lines after it.
+ */
+static void run_stream(Shell *shell, int fd) {
+    SafeString *pending = sstr_new(SSTR_INIT_CAP);
+    if (!pending) return;
+
+    while (shell->running && read_line_fd(fd, pending)) {
+        if (exec_script(shell, sstr_cstr(pending), "stdin", true, NULL)
+                == SCRIPT_INCOMPLETE) {
+            continue;
+        }
+        sstr_clear(pending);
+    }
 
-        /* If the replacement doesn't end with a space, stop expanding
-         * (bash convention: trailing space means expand next word too,
-         *  but we keep it simple and just re-check the first word) */
-        if (rep_len == 0 || replacement[rep_len - 1] != ' ') break;
+    /* Whatever is left is an unterminated construct: report it */
+    if (shell->running && !sstr_empty(pending)) {
+        exec_script(shell, sstr_cstr(pending), "stdin", false, NULL);
     }
 
-    return current;
+    sstr_free(pending);
 }
 
-/* ---- Git branch detection ----------------------------------------------- */
-static char *find_git_branch(void) {
-    char path[PATH_MAX];
-
-    if (!getcwd(path, sizeof(path))) return NULL;
-
-    /* Walk up directory tree looking for .git */
-    while (1) {
-        char git_head[PATH_MAX];
-        int n = snprintf(git_head, sizeof(git_head), "%s/.git/HEAD", path);
-        if (n < 0 || (size_t)n >= sizeof(git_head)) break;
-
-        FILE *fp = fopen(git_head, "r");
-        if (fp) {
-            char buf[256];
-            if (fgets(buf, sizeof(buf), fp)) {
-                fclose(fp);
-                size_t len = strlen(buf);
-                if (len > 0 && buf[len - 1] == '\n') buf[--len] = '\0';
-
-                /* Symbolic ref: "ref: refs/heads/BRANCH" */
-                const char *prefix = "ref: refs/heads/";
-                if (strncmp(buf, prefix, strlen(prefix)) == 0) {
-                    return strdup(buf + strlen(prefix));
-                }
-                /* Detached HEAD: return short hash */
-                if (len >= 7) {
-                    buf[7] = '\0';
-                    return strdup(buf);
-                }
-            }
-            fclose(fp); /* in case fgets failed */
-            return NULL;
-        }
+/* ---- Interactive continuation lines ------------------------------------- */
+
+/* True when src ends inside a quote, here-document or open construct */
+static bool input_incomplete(const char *src) {
+    Arena *arena = arena_create();
+    if (!arena) return false;
 
-        /* Move to parent directory */
-        char *slash = strrchr(path, '/');
-        if (!slash || slash == path) break;
-        *slash = '\0';
+    Lexer lex;
+    lexer_init(&lex, src, arena);
+    TokenList *tokens = lexer_tokenize(&lex);
+
+    bool incomplete = lex.incomplete;
+    if (tokens && !lex.error) {
+        Parser parser;
+        parser_init(&parser, tokens, arena);
+        parser_parse_script(&parser);
+        incomplete = parser.had_error && parser.incomplete;
     }
 
-    return NULL;
+    arena_destroy(arena);
+    return incomplete;
 }
 
-/* ---- Path shortening (HOME -> ~) ---------------------------------------- */
-static char *shorten_path(const char *cwd, const char *home) {
-    if (home && *home) {
-        size_t home_len = strlen(home);
-        if (strncmp(cwd, home, home_len) == 0 &&
-            (cwd[home_len] == '/' || cwd[home_len] == '\0')) {
-            size_t rest_len = strlen(cwd + home_len);
-            char *result = malloc(1 + rest_len + 1);
-            if (result) {
-                result[0] = '~';
-                memcpy(result + 1, cwd + home_len, rest_len + 1);
-                return result;
-            }
-        }
+/* Append "> " continuation lines to line (which is consumed) until the
+ * input is complete or the user ends it with Ctrl+D. */
+static char *read_continuation(Shell *shell, char *line) {
+    if (!input_incomplete(line)) return line;
+
+    SafeString *buf = sstr_from(line);
+    if (!buf) return line;
+    free(line);
+
+    for (;;) {
+        char *more = vsh_readline(shell, "> ");
+        if (!more) break;
+        sstr_append_char(buf, '\n');
+        sstr_append(buf, more);
+        free(more);
+        if (!input_incomplete(sstr_cstr(buf))) break;
     }
-    return strdup(cwd);
+
+    char *full = strdup(sstr_cstr(buf));
+    sstr_free(buf);
+    return full ? full : strdup("");
 }
 
 /* ---- Build path to ~/.vsh_history --------------------------------------- */
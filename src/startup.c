@@ -0,0 +1,174 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * startup.c - Background startup work and the startup trace
+ *
+ * Tasks are plain joinable threads, one per task. Signals are blocked
+ * around pthread_create so the new thread inherits a full mask: SIGCHLD,
+ * SIGINT and friends keep going to the main thread, where job control and
+ * the line editor expect them.
+ *
+ * With a single CPU to run on, a thread would only take turns with the
+ * main thread and push the first prompt back by the milliseconds a
+ * listing of /usr/bin costs. There a task is deferred instead: it runs in
+ * the first startup_wait() for it, which is plain lazy initialisation.
+ * ============================================================================ */
+
+#include "startup.h"
+#include "stats.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct Task {
+    pthread_t thread;
+    bool      running;          /* Started and not yet joined */
+    StartupFn deferred;         /* Or waiting to run in startup_wait() */
+    void     *arg;
+} Task;
+
+struct Startup {
+    pid_t    owner;             /* Process that started the threads */
+    bool     trace;
+    uint64_t start_ns;
+    uint64_t last_ns;           /* Previous trace line */
+    bool     threads;           /* More than one CPU to run on */
+    Task     tasks[STARTUP_NTASKS];
+};
+
+static const char *const task_names[STARTUP_NTASKS] = {
+    [STARTUP_HISTORY]    = "history",
+    [STARTUP_PATH_INDEX] = "path index",
+};
+
+typedef struct TaskStart {
+    StartupFn fn;
+    void     *arg;
+} TaskStart;
+
+static void *task_main(void *p)
+{
+    TaskStart start = *(TaskStart *)p;
+    free(p);
+    start.fn(start.arg);
+    return NULL;
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+Startup *startup_create(void)
+{
+    Startup *st = calloc(1, sizeof(Startup));
+    if (!st)
+        return NULL;
+    st->owner    = getpid();
+    st->start_ns = st->last_ns = stats_now();
+
+    const char *trace = getenv("VSH_STARTUP_TRACE");
+    st->trace = trace && *trace && strcmp(trace, "0") != 0;
+
+    cpu_set_t cpus;
+    st->threads = sched_getaffinity(0, sizeof(cpus), &cpus) == 0
+                      ? CPU_COUNT(&cpus) > 1
+                      : sysconf(_SC_NPROCESSORS_ONLN) > 1;
+    return st;
+}
+
+void startup_destroy(Startup *st)
+{
+    if (!st)
+        return;
+    if (getpid() == st->owner) {
+        for (int i = 0; i < STARTUP_NTASKS; i++) {
+            if (st->tasks[i].running)
+                pthread_join(st->tasks[i].thread, NULL);
+        }
+    }
+    free(st);
+}
+
+void startup_run(Startup *st, StartupTask task, StartupFn fn, void *arg)
+{
+    if (!st || task >= STARTUP_NTASKS) {
+        fn(arg);
+        return;
+    }
+    Task *t = &st->tasks[task];
+    if (t->running || t->deferred)
+        return;
+    if (!st->threads) {
+        t->deferred = fn;
+        t->arg      = arg;
+        return;
+    }
+
+    TaskStart *start = malloc(sizeof(TaskStart));
+    if (start) {
+        start->fn  = fn;
+        start->arg = arg;
+
+        sigset_t all, old;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        t->running = pthread_create(&t->thread, NULL, task_main, start) == 0;
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+    }
+
+    if (!t->running) {
+        free(start);
+        fn(arg);
+    }
+}
+
+bool startup_pending(const Startup *st, StartupTask task)
+{
+    return st && task < STARTUP_NTASKS &&
+           (st->tasks[task].running || st->tasks[task].deferred);
+}
+
+bool startup_wait(Startup *st, StartupTask task)
+{
+    if (!startup_pending(st, task))
+        return true;
+
+    Task *t = &st->tasks[task];
+    uint64_t before = stats_now();
+    const char *how;
+    if (t->deferred) {
+        StartupFn fn = t->deferred;
+        t->deferred = NULL;
+        fn(t->arg);
+        how = "ran";
+    } else {
+        t->running = false;
+        if (getpid() != st->owner)
+            return false;
+        pthread_join(t->thread, NULL);
+        how = "joined, waited";
+    }
+
+    if (st->trace) {
+        char took[32], step[64];
+        stats_format_ns(took, sizeof(took), stats_now() - before);
+        snprintf(step, sizeof(step), "%s %s %s", task_names[task], how, took);
+        startup_trace(st, step);
+    }
+    return true;
+}
+
+void startup_trace(Startup *st, const char *step)
+{
+    if (!st || !st->trace)
+        return;
+
+    uint64_t now = stats_now();
+    char total[32], delta[32];
+    stats_format_ns(total, sizeof(total), now - st->start_ns);
+    stats_format_ns(delta, sizeof(delta), now - st->last_ns);
+    st->last_ns = now;
+    fprintf(stderr, "startup: %9s  +%-9s %s\n", total, delta, step);
+}
@@ -0,0 +1,153 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * stats.c - Per-phase latency histograms and shell counters
+ *
+ * Recording a sample is a bucket index (the position of the highest set
+ * bit) and a few additions, so every phase can stay instrumented all the
+ * time; the cost that matters is the two clock reads around it, which go
+ * through the vDSO.
+ * ============================================================================ */
+
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const phase_names[STAT_NPHASES] = {
+    [STAT_HISTORY] = "history",
+    [STAT_LEX]     = "lex",
+    [STAT_ALIAS]   = "alias",
+    [STAT_PARSE]   = "parse",
+    [STAT_EXPAND]  = "expand",
+    [STAT_SPAWN]   = "spawn",
+    [STAT_WAIT]    = "wait",
+    [STAT_LINE]    = "line",
+};
+
+ShellStats *stats_create(void)
+{
+    return calloc(1, sizeof(ShellStats));
+}
+
+void stats_destroy(ShellStats *stats)
+{
+    free(stats);
+}
+
+void stats_reset(ShellStats *stats)
+{
+    if (!stats)
+        return;
+    int depth = stats->line_depth;
+    memset(stats, 0, sizeof(*stats));
+    stats->line_depth = depth;
+}
+
+/* ---- Recording ---------------------------------------------------------- */
+
+static int bucket_of(uint64_t ns)
+{
+    if (ns == 0)
+        return 0;
+    int b = 63 - __builtin_clzll(ns);
+    return b < STAT_BUCKETS ? b : STAT_BUCKETS - 1;
+}
+
+void stats_record(ShellStats *stats, StatPhase phase, uint64_t ns)
+{
+    if (!stats || phase >= STAT_NPHASES)
+        return;
+
+    StatHist *h = &stats->phase[phase];
+    h->count++;
+    h->total_ns += ns;
+    if (ns > h->max_ns)
+        h->max_ns = ns;
+    h->buckets[bucket_of(ns)]++;
+
+    stats->line_ns[phase] += ns;
+}
+
+void stats_line_begin(ShellStats *stats)
+{
+    if (!stats)
+        return;
+    if (stats->line_depth++ == 0)
+        memset(stats->line_ns, 0, sizeof(stats->line_ns));
+}
+
+bool stats_line_end(ShellStats *stats)
+{
+    if (!stats || stats->line_depth == 0)
+        return false;
+    return --stats->line_depth == 0;
+}
+
+/* ---- Reporting ---------------------------------------------------------- */
+
+uint64_t stats_quantile(const StatHist *hist, double q)
+{
+    if (!hist || hist->count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(q * (double)hist->count);
+    if (rank >= hist->count)
+        rank = hist->count - 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < STAT_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if (seen > rank) {
+            uint64_t upper = b + 1 < 64 ? (UINT64_C(1) << (b + 1)) - 1 : UINT64_MAX;
+            return upper < hist->max_ns ? upper : hist->max_ns;
+        }
+    }
+    return hist->max_ns;
+}
+
+void stats_format_ns(char *buf, size_t size, uint64_t ns)
+{
+    if (ns < 1000)
+        snprintf(buf, size, "%uns", (unsigned)ns);
+    else if (ns < 1000000)
+        snprintf(buf, size, "%.1fus", (double)ns / 1e3);
+    else if (ns < 1000000000)
+        snprintf(buf, size, "%.1fms", (double)ns / 1e6);
+    else
+        snprintf(buf, size, "%.2fs", (double)ns / 1e9);
+}
+
+void stats_format_bytes(char *buf, size_t size, unsigned long long bytes)
+{
+    if (bytes < 1024)
+        snprintf(buf, size, "%lluB", bytes);
+    else if (bytes < 1024 * 1024)
+        snprintf(buf, size, "%.1fK", (double)bytes / 1024.0);
+    else if (bytes < 1024ull * 1024 * 1024)
+        snprintf(buf, size, "%.1fM", (double)bytes / (1024.0 * 1024.0));
+    else
+        snprintf(buf, size, "%.2fG", (double)bytes / (1024.0 * 1024.0 * 1024.0));
+}
+
+const char *stats_phase_name(StatPhase phase)
+{
+    return phase < STAT_NPHASES ? phase_names[phase] : "?";
+}
+
+void stats_print_line(const ShellStats *stats, FILE *fp)
+{
+    if (!stats)
+        return;
+
+    char buf[32];
+    stats_format_ns(buf, sizeof(buf), stats->line_ns[STAT_LINE]);
+    fprintf(fp, "timing: line %s", buf);
+
+    for (int p = 0; p < STAT_LINE; p++) {
+        if (stats->line_ns[p] == 0)
+            continue;
+        stats_format_ns(buf, sizeof(buf), stats->line_ns[p]);
+        fprintf(fp, "  %s %s", phase_names[p], buf);
+    }
+    fputc('\n', fp);
+}
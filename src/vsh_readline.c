@@ -13,13 +13,21 @@
 #include "vsh_readline.h"
 #include "shell.h"
 #include "history.h"
+#include "history_search.h"
 #include "builtins.h"
+#include "path_cache.h"
+#include "exec_index.h"
+#include "git_status.h"
+#include "dir_listing.h"
+#include "job_control.h"
+#include "prompt.h"
 #include "safe_string.h"
+#include "arena.h"
+#include "startup.h"
 
 #include <unistd.h>
+#include <poll.h>
 #include <sys/ioctl.h>
-#include <dirent.h>
-#include <sys/stat.h>
 #include <ctype.h>
 #include <errno.h>
 #include <stdio.h>
@@ -34,13 +42,23 @@
 typedef struct LineEditor {
     SafeString *buf;          /* Current line buffer                       */
     int         cursor;       /* Cursor position (byte offset)             */
-    int         prompt_len;   /* Displayed prompt width (for cursor math)  */
+    const char *prompt;       /* Full prompt text                          */
+    const char *prompt_tail;  /* Last line of the prompt (the input row)   */
+    int         prompt_rows;  /* Prompt lines above the input row          */
+    int         prompt_len;   /* Visible width of prompt_tail              */
     SafeString *yank_buf;     /* Kill ring (last killed text)              */
     Shell      *shell;
+    /* What the terminal shows after the prompt (see refresh_line) */
+    SafeString *shown;        /* Buffer contents on screen                 */
+    int         shown_cursor; /* Buffer offset the terminal cursor is at   */
+    bool        shown_valid;  /* False: redraw the input row from scratch  */
+    int         cols;         /* Terminal width used for that layout       */
+    bool        redraw_pending; /* Screen is behind the buffer             */
     /* Reverse search state */
     bool        searching;
     SafeString *search_buf;
     int         search_pos;   /* Position in history for search            */
+    bool        tab_pending;  /* Tab waits for a directory to be listed    */
 } LineEditor;
 
 /* Persistent yank buffer across invocations (static) */
@@ -49,6 +67,15 @@ static SafeString *s_yank_buf = NULL;
 /* Saved line when navigating history */
 static SafeString *s_saved_line = NULL;
 
+/* Output batch reused by every refresh */
+static SafeString *s_out_buf = NULL;
+
+/* Screen contents tracked by refresh_line() */
+static SafeString *s_shown_buf = NULL;
+
+/* Bracketed paste accumulator */
+static SafeString *s_paste_buf = NULL;
+
 /* --------------------------------------------------------------------------
  * Low-level I/O helpers
  * -------------------------------------------------------------------------- */
@@ -74,17 +101,43 @@ static void term_puts(const char *s)
     term_write(s, strlen(s));
 }
 
-/* Signal-safe single-byte read; retries on EINTR. Returns 1 on success, 0
- * on EOF, -1 on error. */
+/* Keys are read one byte at a time, so whatever is typed after Enter stays
+ * in the tty for the command that runs next. Inside a bracketed paste,
+ * where no Enter can end the line, one read() takes everything the tty has
+ * and bytes are served from this buffer; the little a read may take past
+ * the paste's end is handled as keys. */
+#define TERM_INBUF_SIZE 8192
+
+static char   s_in_buf[TERM_INBUF_SIZE];
+static size_t s_in_pos = 0;
+static size_t s_in_len = 0;
+static bool   s_in_bulk = false;    /* In a bracketed paste */
+
+/* Input waiting: bytes already read, or more in the tty (fast typing) */
+static bool term_input_pending(void)
+{
+    int avail = 0;
+    return s_in_pos < s_in_len ||
+           (ioctl(STDIN_FILENO, FIONREAD, &avail) == 0 && avail > 0);
+}
+
+/* Signal-safe byte read; retries on EINTR. Returns 1 on success, 0 on EOF,
+ * -1 on error. */
 static int term_read_char(char *c)
 {
-    for (;;) {
-        ssize_t n = read(STDIN_FILENO, c, 1);
-        if (n == 1) return 1;
+    while (s_in_pos >= s_in_len) {
+        ssize_t n = read(STDIN_FILENO, s_in_buf,
+                         s_in_bulk ? sizeof(s_in_buf) : 1);
         if (n == 0) return 0;
-        if (errno == EINTR) continue;
-        return -1;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        s_in_pos = 0;
+        s_in_len = (size_t)n;
     }
+    *c = s_in_buf[s_in_pos++];
+    return 1;
 }
 
 /* Get terminal width. Falls back to 80. */
@@ -100,73 +153,357 @@ static int term_cols(void)
  * Display / refresh
  * -------------------------------------------------------------------------- */
 
-static void refresh_line(LineEditor *ed, const char *prompt)
+/* Take a new prompt: the geometry is computed once here (or taken from
+ * the prompt renderer's cache), never per keypress. */
+static void set_prompt(LineEditor *ed, const char *prompt)
+{
+    const char *nl = strrchr(prompt, '\n');
+    ed->prompt      = prompt;
+    ed->prompt_tail = nl ? nl + 1 : prompt;
+    prompt_metrics(ed->shell, prompt, &ed->prompt_rows, &ed->prompt_len);
+}
+
+/* Screen cell of buffer offset `offset` of text, relative to column 0 of
+ * the prompt's last line. Text wraps at ed->cols and a '\n' (from a paste)
+ * starts a new row. */
+static void cell_of(const LineEditor *ed, const char *text, int offset,
+                    int *row, int *col)
+{
+    int r = ed->prompt_len / ed->cols;
+    int c = ed->prompt_len % ed->cols;
+    for (int i = 0; i < offset; i++) {
+        if (text[i] == '\n' || ++c == ed->cols) {
+            r++;
+            c = 0;
+        }
+    }
+    *row = r;
+    *col = c;
+}
+
+/* Append the cursor motion between two cells */
+static void emit_move(SafeString *out, int r0, int c0, int r1, int c1)
+{
+    char seq[32];
+
+    if (r1 < r0) {
+        snprintf(seq, sizeof(seq), "\x1b[%dA", r0 - r1);
+        sstr_append(out, seq);
+    } else if (r1 > r0) {
+        snprintf(seq, sizeof(seq), "\x1b[%dB", r1 - r0);
+        sstr_append(out, seq);
+    }
+
+    if (c1 == c0)
+        return;
+    if (c1 == 0) {
+        sstr_append_char(out, '\r');
+    } else if (c1 == c0 - 1) {
+        sstr_append_char(out, '\b');
+    } else {
+        snprintf(seq, sizeof(seq), "\x1b[%d%c", c1 > c0 ? c1 - c0 : c0 - c1,
+                 c1 > c0 ? 'C' : 'D');
+        sstr_append(out, seq);
+    }
+}
+
+/* Append text[from..to), which starts at column col. Reaching the right
+ * margin would leave the terminal in its pending-wrap state, so the wrap
+ * is forced at once; the cursor then always is where cell_of() says. A
+ * newline clears the rest of its row first. */
+static void emit_text(SafeString *out, const LineEditor *ed, const char *text,
+                      int from, int to, int col)
+{
+    int run = from;
+    for (int i = from; i < to; i++) {
+        if (text[i] == '\n') {
+            sstr_append_n(out, text + run, (size_t)(i - run));
+            sstr_append(out, "\x1b[K\r\n");
+            run = i + 1;
+            col = 0;
+        } else if (++col == ed->cols) {
+            sstr_append_n(out, text + run, (size_t)(i + 1 - run));
+            sstr_append(out, "\r\n");
+            run = i + 1;
+            col = 0;
+        }
+    }
+    sstr_append_n(out, text + run, (size_t)(to - run));
+}
+
+static void flush_out(SafeString *out)
+{
+    if (out->len > 0)
+        term_write(sstr_cstr(out), out->len);
+    sstr_clear(out);
+}
+
+static SafeString *out_buf(void)
+{
+    if (!s_out_buf)
+        s_out_buf = sstr_new(256);
+    return s_out_buf;
+}
+
+static void draw_line(LineEditor *ed);
+
+/* Bring the terminal cursor to the start of the input row and forget the
+ * screen layout; the next refresh_line() redraws from there. */
+static void screen_home(LineEditor *ed)
+{
+    SafeString *out = out_buf();
+    if (ed->shown_valid) {
+        int row, col;
+        cell_of(ed, sstr_cstr(ed->shown), ed->shown_cursor, &row, &col);
+        if (row > 0)
+            sstr_appendf(out, "\x1b[%dA", row);
+    }
+    sstr_append_char(out, '\r');
+    flush_out(out);
+    ed->shown_valid    = false;
+    ed->redraw_pending = false;
+}
+
+/* Move the terminal cursor past the end of the input, e.g. before Enter
+ * or a completion listing writes below it. */
+static void screen_end(LineEditor *ed)
+{
+    if (ed->redraw_pending)
+        draw_line(ed);
+    if (!ed->shown_valid)
+        return;
+
+    const char *shown = sstr_cstr(ed->shown);
+    int r0, c0, r1, c1;
+    cell_of(ed, shown, ed->shown_cursor, &r0, &c0);
+    cell_of(ed, shown, (int)ed->shown->len, &r1, &c1);
+
+    SafeString *out = out_buf();
+    emit_move(out, r0, c0, r1, c1);
+    flush_out(out);
+    ed->shown_cursor = (int)ed->shown->len;
+}
+
+/* The full prompt (and an empty buffer) was just written from column 0 */
+static void screen_prompt_written(LineEditor *ed)
+{
+    sstr_clear(ed->shown);
+    ed->shown_cursor = 0;
+    ed->shown_valid  = true;
+    ed->cols         = term_cols();
+    if (ed->prompt_len > 0 && ed->prompt_len % ed->cols == 0)
+        term_puts("\r\n");
+}
+
+/* Bring the screen up to date with the buffer and cursor.
+ *
+ * The terminal's contents are tracked in ed->shown, so only the cells from
+ * the first difference onwards are rewritten (a keystroke at the end of
+ * the line is a single byte), a pure cursor move is just a motion
+ * sequence, and a line wider than the terminal is laid out over several
+ * rows. When the layout is unknown (after a terminal resize, or output
+ * that bypassed the editor) the input row is redrawn from column 0. */
+static void draw_line(LineEditor *ed)
 {
     const char *buf = sstr_cstr(ed->buf);
-    size_t      len = ed->buf->len;
+    int         len = (int)ed->buf->len;
+    SafeString *out = out_buf();
+    int         r0, c0, r1, c1;
 
-    /* Build output in one batch to reduce flicker. */
-    SafeString *out = sstr_new(256);
+    ed->redraw_pending = false;
 
-    /* \r - move to column 0 */
-    sstr_append(out, "\r");
+    int cols = term_cols();
+    if (ed->shown_valid && cols != ed->cols) {
+        /* The old layout is meaningless at the new width */
+        ed->shown_valid = false;
+        sstr_append_char(out, '\r');
+    }
+    ed->cols = cols;
+
+    if (!ed->shown_valid) {
+        /* Full redraw of the input row from column 0 */
+        sstr_append(out, ed->prompt_tail);
+        if (ed->prompt_len > 0 && ed->prompt_len % cols == 0)
+            sstr_append(out, "\r\n");
+        emit_text(out, ed, buf, 0, len, ed->prompt_len % cols);
+        sstr_append(out, "\x1b[J");
+        cell_of(ed, buf, len, &r0, &c0);
+        cell_of(ed, buf, ed->cursor, &r1, &c1);
+        emit_move(out, r0, c0, r1, c1);
+    } else {
+        const char *old = sstr_cstr(ed->shown);
+        int old_len = (int)ed->shown->len;
+        int same = 0;
+        while (same < len && same < old_len && buf[same] == old[same])
+            same++;
+
+        cell_of(ed, old, ed->shown_cursor, &r0, &c0);
+        if (same == len && same == old_len) {
+            cell_of(ed, buf, ed->cursor, &r1, &c1);
+            emit_move(out, r0, c0, r1, c1);
+        } else {
+            /* Everything before `same` has the same layout in both */
+            cell_of(ed, buf, same, &r1, &c1);
+            emit_move(out, r0, c0, r1, c1);
+            emit_text(out, ed, buf, same, len, c1);
+            if (same < old_len)
+                sstr_append(out, "\x1b[J");
+            cell_of(ed, buf, len, &r0, &c0);
+            cell_of(ed, buf, ed->cursor, &r1, &c1);
+            emit_move(out, r0, c0, r1, c1);
+        }
+    }
 
-    /* Write prompt */
-    sstr_append(out, prompt);
+    sstr_clear(ed->shown);
+    sstr_append_n(ed->shown, buf, (size_t)len);
+    ed->shown_cursor = ed->cursor;
+    ed->shown_valid  = true;
+    flush_out(out);
+}
 
-    /* Write buffer content */
-    sstr_append_n(out, buf, len);
+/* Request a redraw. While more input is already buffered (a paste or fast
+ * typing) the redraw is deferred until the buffer runs dry, so a burst of
+ * keys costs one screen update. */
+static void refresh_line(LineEditor *ed)
+{
+    if (term_input_pending()) {
+        ed->redraw_pending = true;
+        return;
+    }
+    draw_line(ed);
+}
 
-    /* Clear to end of line */
-    sstr_append(out, "\x1b[0K");
+/* Redraw the whole prompt from the current row, then the input row */
+static void redisplay(LineEditor *ed)
+{
+    term_write(ed->prompt, (size_t)(ed->prompt_tail - ed->prompt));
+    ed->shown_valid = false;
+    refresh_line(ed);
+}
 
-    /* Move cursor to correct position:
-     * \r brings us to col 0, then advance prompt_len + cursor positions. */
-    sstr_append(out, "\r");
-    int pos = ed->prompt_len + ed->cursor;
-    if (pos > 0) {
-        char seq[32];
-        snprintf(seq, sizeof(seq), "\x1b[%dC", pos);
-        sstr_append(out, seq);
+/* Replace the prompt in place: back up over the old one's extra rows,
+ * clear below, and redraw with the new prompt. */
+static void repaint_prompt(LineEditor *ed)
+{
+    int old_rows = ed->prompt_rows;
+    bool changed = false;
+    const char *fresh = prompt_render(ed->shell, &changed);
+    if (!changed)
+        return;
+
+    screen_home(ed);
+    char seq[32];
+    if (old_rows > 0) {
+        snprintf(seq, sizeof(seq), "\x1b[%dA", old_rows);
+        term_puts(seq);
     }
+    term_puts("\r\x1b[J");
+
+    set_prompt(ed, fresh);
+    redisplay(ed);
+}
 
-    term_write(sstr_cstr(out), out->len);
-    sstr_free(out);
+/* Read one key while servicing the prompt's git status worker, whose
+ * result repaints the prompt, and the directory listing worker, whose
+ * result answers a Tab still waiting for it (the Tab is returned again).
+ * Same return values as term_read_char(). */
+static int read_key(LineEditor *ed, char *c)
+{
+    GitStatus *gs = ed->shell->git_status;
+    DirListing *dl = ed->shell->dir_listing;
+    int job_fd = job_event_fd(ed->shell);
+
+    if (term_input_pending())
+        return term_read_char(c);
+
+    /* About to wait: catch the screen up on deferred redraws first */
+    if (ed->redraw_pending)
+        draw_line(ed);
+
+    /* Children that finish while we wait are reaped here, so the prompt
+     * only has to report them */
+    while (job_fd >= 0 || git_status_fd(gs) >= 0 || dir_listing_fd(dl) >= 0) {
+        struct pollfd pfd[4] = {
+            { .fd = STDIN_FILENO,       .events = POLLIN },
+            { .fd = job_fd,             .events = POLLIN },
+            { .fd = git_status_fd(gs),  .events = POLLIN },
+            { .fd = dir_listing_fd(dl), .events = POLLIN },
+        };
+        /* Wake periodically so a hung worker hits its timeout */
+        int n = poll(pfd, 4, pfd[2].fd >= 0 ? 250 : -1);
+        if (n < 0 && errno != EINTR)
+            break;
+        if (n > 0 && pfd[0].revents)
+            break;
+        if (n > 0 && pfd[1].revents)
+            job_reap(ed->shell);
+        if (pfd[2].fd >= 0 && git_status_collect(gs))
+            repaint_prompt(ed);
+        if (n > 0 && pfd[3].revents && dir_listing_collect(dl) &&
+            ed->tab_pending) {
+            *c = '\t';
+            return 1;
+        }
+    }
+    return term_read_char(c);
 }
 
 /* --------------------------------------------------------------------------
  * Completions helpers
  * -------------------------------------------------------------------------- */
 
+/* Matches listed below the line at most; past this only their number is */
+#define COMPLETION_SHOW_MAX 1000
+
 static Completions *completions_new(void)
 {
-    Completions *c = calloc(1, sizeof(*c));
-    if (!c) return NULL;
-    c->capacity = 16;
-    c->entries = calloc((size_t)c->capacity, sizeof(char *));
-    if (!c->entries) { free(c); return NULL; }
-    return c;
+    return calloc(1, sizeof(Completions));
 }
 
+/* Add a candidate of our own (a command name), copied into the arena */
 static void completions_add(Completions *c, const char *entry)
 {
     if (!c || !entry) return;
+    if (!c->arena && !(c->arena = arena_create()))
+        return;
     if (c->count >= c->capacity) {
-        int newcap = c->capacity * 2;
-        char **tmp = realloc(c->entries, (size_t)newcap * sizeof(char *));
+        int newcap = c->capacity ? c->capacity * 2 : 64;
+        const char **tmp = realloc(c->owned, (size_t)newcap * sizeof(char *));
         if (!tmp) return;
-        c->entries  = tmp;
+        c->owned    = tmp;
         c->capacity = newcap;
     }
-    c->entries[c->count++] = strdup(entry);
+    char *copy = arena_strdup(c->arena, entry);
+    if (!copy) return;
+    c->owned[c->count++] = copy;
+    c->entries = c->owned;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* Sort our own candidates and drop duplicates (a builtin that is also on
+ * PATH: echo, test, ...) */
+static void completions_sort(Completions *c)
+{
+    if (c->count < 2) return;
+    qsort(c->owned, (size_t)c->count, sizeof(char *), compare_entries);
+    int n = 1;
+    for (int i = 1; i < c->count; i++) {
+        if (strcmp(c->owned[i], c->owned[n - 1]) != 0)
+            c->owned[n++] = c->owned[i];
+    }
+    c->count = n;
 }
 
 void completions_free(Completions *comp)
 {
     if (!comp) return;
-    for (int i = 0; i < comp->count; i++)
-        free(comp->entries[i]);
-    free(comp->entries);
+    free(comp->owned);
+    if (comp->arena)
+        arena_destroy(comp->arena);
     free(comp);
 }
 
@@ -194,34 +531,13 @@ static bool is_command_position(const char *line, int ws)
     return true;
 }
 
-/* Add executable matches from a single directory. */
-static void complete_from_dir(Completions *comp, const char *dir_path,
-                              const char *prefix, size_t prefix_len)
+static void add_completion(const char *name, void *ctx)
 {
-    DIR *d = opendir(dir_path);
-    if (!d) return;
-
-    struct dirent *ent;
-    while ((ent = readdir(d)) != NULL) {
-        if (ent->d_name[0] == '.' && prefix_len == 0)
-            continue; /* skip hidden unless prefix starts with '.' */
-        if (strncmp(ent->d_name, prefix, prefix_len) != 0)
-            continue;
-
-        /* Check if executable */
-        char path[4096];
-        snprintf(path, sizeof(path), "%s/%s", dir_path, ent->d_name);
-        struct stat st;
-        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) &&
-            (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH))) {
-            completions_add(comp, ent->d_name);
-        }
-    }
-    closedir(d);
+    completions_add(ctx, name);
 }
 
-/* Complete command names (PATH + builtins). */
-static void complete_commands(Completions *comp, Shell *shell __attribute__((unused)),
+/* Complete command names (builtins + the PATH executable index). */
+static void complete_commands(Completions *comp, Shell *shell,
                               const char *prefix, size_t prefix_len)
 {
     /* Builtins */
@@ -233,92 +549,52 @@ static void complete_commands(Completions *comp, Shell *shell __attribute__((unu
     }
 
     /* PATH directories */
-    const char *path_var = getenv("PATH");
-    if (!path_var) return;
-
-    char *path_copy = strdup(path_var);
-    if (!path_copy) return;
-
-    char *saveptr = NULL;
-    for (char *dir = strtok_r(path_copy, ":", &saveptr);
-         dir != NULL;
-         dir = strtok_r(NULL, ":", &saveptr)) {
-        complete_from_dir(comp, dir, prefix, prefix_len);
-    }
-    free(path_copy);
+    exec_index_complete(path_cache_index(shell), prefix, prefix_len,
+                        add_completion, comp);
+    completions_sort(comp);
 }
 
-/* Complete file/directory names. */
-static void complete_files(Completions *comp, const char *prefix, size_t prefix_len)
+/* Complete file/directory names from the shell's cached listing of the
+ * directory part of the word. */
+static void complete_files(Completions *comp, Shell *shell,
+                           const char *prefix, size_t prefix_len)
 {
-    const char *dir_part  = ".";
-    const char *base_part = prefix;
-    size_t base_len = prefix_len;
+    const char *dir_part = ".";
+    char dir_buf[4096];
 
     /* Split into directory and basename parts. */
-    char dir_buf[4096];
     const char *last_slash = NULL;
     for (size_t i = 0; i < prefix_len; i++) {
         if (prefix[i] == '/')
             last_slash = prefix + i;
     }
-
     if (last_slash) {
         size_t dlen = (size_t)(last_slash - prefix);
         if (dlen == 0) {
             dir_part = "/";
         } else {
-            if (dlen >= sizeof(dir_buf)) dlen = sizeof(dir_buf) - 1;
+            if (dlen >= sizeof(dir_buf)) return;
             memcpy(dir_buf, prefix, dlen);
             dir_buf[dlen] = '\0';
             dir_part = dir_buf;
         }
-        base_part = last_slash + 1;
-        base_len  = prefix_len - (size_t)(base_part - prefix);
+        comp->skip = (size_t)(last_slash - prefix) + 1;
     }
 
-    DIR *d = opendir(dir_part);
-    if (!d) return;
-
-    struct dirent *ent;
-    while ((ent = readdir(d)) != NULL) {
-        /* Skip . and .. unless explicitly typed. */
-        if (ent->d_name[0] == '.' && base_len == 0)
-            continue;
-        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
-            continue;
-
-        if (strncmp(ent->d_name, base_part, base_len) != 0)
-            continue;
-
-        /* Build the full completion string (re-include dir_part if needed). */
-        char full[4096];
-        if (last_slash) {
-            size_t dlen = (size_t)(last_slash - prefix) + 1; /* include slash */
-            if (dlen >= sizeof(full)) continue;
-            memcpy(full, prefix, dlen);
-            full[dlen] = '\0';
-            strncat(full, ent->d_name, sizeof(full) - dlen - 1);
-        } else {
-            snprintf(full, sizeof(full), "%s", ent->d_name);
-        }
-
-        /* Append '/' for directories. */
-        char check_path[PATH_MAX];
-        int cp_len = snprintf(check_path, sizeof(check_path), "%s/%s", dir_part, ent->d_name);
-        if (cp_len < 0 || (size_t)cp_len >= sizeof(check_path)) continue;
-        struct stat st;
-        if (stat(check_path, &st) == 0 && S_ISDIR(st.st_mode)) {
-            size_t flen = strlen(full);
-            if (flen + 1 < sizeof(full)) {
-                full[flen]     = '/';
-                full[flen + 1] = '\0';
-            }
-        }
-
-        completions_add(comp, full);
+    if (!shell->dir_listing)
+        return;
+    const char *const *names;
+    size_t count;
+    DirListingStatus st = dir_listing_match(shell->dir_listing, dir_part,
+                                            prefix + comp->skip,
+                                            prefix_len - comp->skip,
+                                            &names, &count);
+    if (st == DIR_LISTING_BUSY) {
+        comp->pending = true;
+    } else if (st == DIR_LISTING_OK) {
+        comp->entries = names;
+        comp->count   = count > INT_MAX ? INT_MAX : (int)count;
     }
-    closedir(d);
 }
 
 Completions *vsh_complete(Shell *shell, const char *line, int cursor_pos)
@@ -337,81 +613,88 @@ Completions *vsh_complete(Shell *shell, const char *line, int cursor_pos)
     if (is_command_position(line, ws)) {
         /* If prefix contains a slash, complete as file path (e.g. ./foo). */
         if (strchr(prefix, '/'))
-            complete_files(comp, prefix, prefix_len);
+            complete_files(comp, shell, prefix, prefix_len);
         else
             complete_commands(comp, shell, prefix, prefix_len);
     } else {
-        complete_files(comp, prefix, prefix_len);
+        complete_files(comp, shell, prefix, prefix_len);
     }
 
     return comp;
 }
 
-/* Find the longest common prefix among completions. */
+/* Longest common prefix of the completions: being sorted, that of the
+ * first and the last. */
 static size_t common_prefix_len(Completions *comp)
 {
     if (comp->count == 0) return 0;
-    if (comp->count == 1) return strlen(comp->entries[0]);
 
-    size_t cpl = strlen(comp->entries[0]);
-    for (int i = 1; i < comp->count; i++) {
-        size_t j = 0;
-        while (j < cpl && comp->entries[i][j] == comp->entries[0][j])
-            j++;
-        cpl = j;
+    const char *first = comp->entries[0];
+    const char *last  = comp->entries[comp->count - 1];
+    size_t j = 0;
+    while (first[j] && first[j] == last[j])
+        j++;
+    return j;
+}
+
+/* Insert n bytes of text at the cursor. */
+static void insert_text(LineEditor *ed, const char *text, size_t n)
+{
+    sstr_ensure(ed->buf, n + 1);
+    for (size_t i = 0; i < n; i++) {
+        sstr_insert_char(ed->buf, (size_t)ed->cursor, text[i]);
+        ed->cursor++;
     }
-    return cpl;
 }
 
 /* Handle tab key. */
-static void handle_tab(LineEditor *ed, const char *prompt)
+static void handle_tab(LineEditor *ed)
 {
     const char *line = sstr_cstr(ed->buf);
     Completions *comp = vsh_complete(ed->shell, line, ed->cursor);
+    ed->tab_pending = comp && comp->pending;
     if (!comp || comp->count == 0) {
         completions_free(comp);
         return;
     }
 
+    /* What of the word the entries have to match: past its directory */
     int ws = word_start(line, ed->cursor);
-    size_t prefix_len = (size_t)(ed->cursor - ws);
+    size_t typed = (size_t)(ed->cursor - ws) - comp->skip;
 
     if (comp->count == 1) {
         /* Single match: insert the remaining part + space. */
         const char *match = comp->entries[0];
         size_t mlen = strlen(match);
-        if (mlen > prefix_len) {
-            const char *suffix = match + prefix_len;
-            size_t slen = mlen - prefix_len;
-            /* Insert suffix into buffer at cursor. */
-            sstr_ensure(ed->buf, slen + 1);
-            for (size_t i = 0; i < slen; i++) {
-                sstr_insert_char(ed->buf, (size_t)ed->cursor, suffix[i]);
-                ed->cursor++;
-            }
-        }
+        if (mlen > typed)
+            insert_text(ed, match + typed, mlen - typed);
         /* Append a space if the completion doesn't end with '/'. */
         size_t blen = ed->buf->len;
         if (blen == 0 || ed->buf->data[ed->cursor - 1] != '/') {
             sstr_insert_char(ed->buf, (size_t)ed->cursor, ' ');
             ed->cursor++;
         }
-        refresh_line(ed, prompt);
+        refresh_line(ed);
     } else {
         /* Multiple matches: complete to longest common prefix. */
         size_t cpl = common_prefix_len(comp);
-        if (cpl > prefix_len) {
-            const char *suffix = comp->entries[0] + prefix_len;
-            size_t slen = cpl - prefix_len;
-            sstr_ensure(ed->buf, slen);
-            for (size_t i = 0; i < slen; i++) {
-                sstr_insert_char(ed->buf, (size_t)ed->cursor, suffix[i]);
-                ed->cursor++;
-            }
-            refresh_line(ed, prompt);
+        if (cpl > typed) {
+            insert_text(ed, comp->entries[0] + typed, cpl - typed);
+            refresh_line(ed);
         }
-        /* Display all matches. */
+        /* Display all matches below the input. */
+        screen_end(ed);
         term_puts("\r\n");
+        if (comp->count > COMPLETION_SHOW_MAX) {
+            char note[64];
+            snprintf(note, sizeof(note), "(%d matches; type more to narrow them)",
+                     comp->count);
+            term_puts(note);
+            term_puts("\r\n");
+            redisplay(ed);
+            completions_free(comp);
+            return;
+        }
         int cols = term_cols();
         /* Find max entry length for columnar display. */
         int maxlen = 0;
@@ -432,7 +715,7 @@ static void handle_tab(LineEditor *ed, const char *prompt)
         }
         term_puts("\r\n");
         /* Re-display prompt and line. */
-        refresh_line(ed, prompt);
+        redisplay(ed);
     }
 
     completions_free(comp);
@@ -558,9 +841,9 @@ static void move_word_forward(LineEditor *ed)
  * History navigation
  * -------------------------------------------------------------------------- */
 
-static void history_nav_up(LineEditor *ed, const char *prompt)
+static void history_nav_up(LineEditor *ed)
 {
-    History *hist = ed->shell->history;
+    History *hist = shell_history(ed->shell);
     if (!hist) return;
 
     /* Save current line if we are at the bottom (first up press). */
@@ -574,13 +857,13 @@ static void history_nav_up(LineEditor *ed, const char *prompt)
     if (entry) {
         sstr_set(ed->buf, entry);
         ed->cursor = (int)ed->buf->len;
-        refresh_line(ed, prompt);
+        refresh_line(ed);
     }
 }
 
-static void history_nav_down(LineEditor *ed, const char *prompt)
+static void history_nav_down(LineEditor *ed)
 {
-    History *hist = ed->shell->history;
+    History *hist = shell_history(ed->shell);
     if (!hist) return;
 
     const char *entry = history_navigate_down(hist);
@@ -595,38 +878,40 @@ static void history_nav_down(LineEditor *ed, const char *prompt)
             sstr_clear(ed->buf);
         ed->cursor = (int)ed->buf->len;
     }
-    refresh_line(ed, prompt);
+    refresh_line(ed);
 }
 
 /* --------------------------------------------------------------------------
  * Reverse incremental search (Ctrl+R)
  * -------------------------------------------------------------------------- */
 
-static void reverse_search(LineEditor *ed, const char *prompt)
+static void reverse_search(LineEditor *ed)
 {
-    History *hist = ed->shell->history;
+    History *hist = shell_history(ed->shell);
     if (!hist) return;
 
-    SafeString *search_buf = sstr_new(64);
-    int search_pos = hist->count; /* Start past the end (search from newest). */
+    /* Each keystroke refines the previous candidate set; see
+     * history_search.c for the trigram index behind the first lookup. */
+    HistorySearch search;
+    history_search_begin(&search, hist);
+    SafeString query;
+    SafeString *search_buf = &query;
+    sstr_init(search_buf);
+    bool failing = false;
+
+    /* The search line replaces the whole (possibly wrapped) input */
+    screen_home(ed);
+    term_puts("\x1b[J");
 
     for (;;) {
-        /* Build the search prompt. */
-        const char *match = "";
-        if (search_buf->len > 0) {
-            int out_pos = search_pos;
-            const char *found = history_search_substr(hist, sstr_cstr(search_buf), &out_pos);
-            if (found) {
-                match = found;
-                search_pos = out_pos;
-            }
-        }
+        const char *match = history_search_current(&search);
+        if (!match) match = "";
 
         /* Display: (reverse-i-search)`query': matched_line */
         char search_prompt[512];
         snprintf(search_prompt, sizeof(search_prompt),
-                 "\r\x1b[0K(reverse-i-search)`%s': %s",
-                 sstr_cstr(search_buf), match);
+                 "\r\x1b[0K(%sreverse-i-search)`%s': %s",
+                 failing ? "failed " : "", sstr_cstr(search_buf), match);
         term_puts(search_prompt);
 
         char c;
@@ -636,8 +921,7 @@ static void reverse_search(LineEditor *ed, const char *prompt)
 
         if (c == 18) {
             /* Ctrl+R again: search further back. */
-            if (search_pos > 0)
-                search_pos--;
+            failing = search_buf->len > 0 && !history_search_older(&search);
             continue;
         } else if (c == 10 || c == 13) {
             /* Enter: accept the match. */
@@ -645,52 +929,103 @@ static void reverse_search(LineEditor *ed, const char *prompt)
                 sstr_set(ed->buf, match);
                 ed->cursor = (int)ed->buf->len;
             }
-            sstr_free(search_buf);
-            /* Clear search line and refresh normal prompt. */
-            term_puts("\r\x1b[0K");
-            refresh_line(ed, prompt);
-            return;
+            break;
         } else if (c == 7 || c == 27) {
             /* Ctrl+G or Escape: cancel search, restore original line. */
-            sstr_free(search_buf);
-            term_puts("\r\x1b[0K");
-            refresh_line(ed, prompt);
-            return;
+            break;
         } else if (c == 127 || c == 8) {
             /* Backspace: remove last char from search query. */
-            if (search_buf->len > 0) {
+            if (search_buf->len > 0)
                 sstr_truncate(search_buf, search_buf->len - 1);
-                search_pos = hist->count; /* Reset search position. */
-            }
+            failing = !history_search_update(&search, sstr_cstr(search_buf)) &&
+                      search_buf->len > 0;
         } else if (c >= 32) {
-            /* Printable character: add to search query. */
+            /* Printable character: narrow the current candidates. */
             sstr_append_char(search_buf, c);
-            /* Don't reset search_pos so we search from current position. */
+            failing = !history_search_update(&search, sstr_cstr(search_buf));
         } else {
-            /* Any other control char: cancel search and inject the char back
-             * by accepting match and processing the character in the main loop.
-             * For simplicity, just accept the match. */
+            /* Any other control char: accept the match. */
             if (match[0] != '\0') {
                 sstr_set(ed->buf, match);
                 ed->cursor = (int)ed->buf->len;
             }
-            sstr_free(search_buf);
-            term_puts("\r\x1b[0K");
-            refresh_line(ed, prompt);
-            return;
+            break;
         }
     }
 
-    sstr_free(search_buf);
+    history_search_end(&search);
+    sstr_release(search_buf);
     term_puts("\r\x1b[0K");
-    refresh_line(ed, prompt);
+    refresh_line(ed);
+}
+
+/* --------------------------------------------------------------------------
+ * Bracketed paste
+ * -------------------------------------------------------------------------- */
+
+#define PASTE_END     "\x1b[201~"
+#define PASTE_END_LEN (sizeof(PASTE_END) - 1)
+
+/* Collect everything up to ESC [ 201 ~ and insert it at the cursor as
+ * literal text: pasted newlines don't run the line, and the whole paste
+ * is one buffer operation and one redraw. */
+static void handle_paste(LineEditor *ed)
+{
+    if (!s_paste_buf)
+        s_paste_buf = sstr_new(1024);
+    SafeString *paste = s_paste_buf;
+    sstr_clear(paste);
+
+    char c;
+    s_in_bulk = true;
+    while (term_read_char(&c) > 0) {
+        sstr_append_char(paste, c);
+        if (paste->len >= PASTE_END_LEN &&
+            memcmp(paste->data + paste->len - PASTE_END_LEN, PASTE_END,
+                   PASTE_END_LEN) == 0) {
+            sstr_truncate(paste, paste->len - PASTE_END_LEN);
+            break;
+        }
+    }
+    s_in_bulk = false;
+
+    /* Terminals paste line ends as CR; keep them as newlines, drop NULs
+     * and other controls except tab */
+    char *p = paste->data;
+    size_t n = 0;
+    for (size_t i = 0; i < paste->len; i++) {
+        char ch = p[i];
+        if (ch == '\r') {
+            if (i + 1 < paste->len && p[i + 1] == '\n')
+                continue;
+            ch = '\n';
+        }
+        if ((unsigned char)ch < 32 && ch != '\n' && ch != '\t')
+            continue;
+        p[n++] = ch;
+    }
+    sstr_truncate(paste, n);
+    if (n == 0)
+        return;
+
+    size_t cur = (size_t)ed->cursor;
+    if (cur == ed->buf->len) {
+        sstr_append_n(ed->buf, paste->data, n);
+    } else {
+        /* Reuse the paste buffer's tail room for the text after the cursor */
+        size_t tail = ed->buf->len - cur;
+        sstr_append_n(paste, ed->buf->data + cur, tail);
+        sstr_truncate(ed->buf, cur);
+        sstr_append_n(ed->buf, paste->data, n + tail);
+    }
+    ed->cursor = (int)(cur + n);
 }
 
 /* --------------------------------------------------------------------------
  * Escape sequence handling
  * -------------------------------------------------------------------------- */
 
-static void handle_escape(LineEditor *ed, const char *prompt)
+static void handle_escape(LineEditor *ed)
 {
     char seq[4];
 
@@ -704,30 +1039,45 @@ static void handle_escape(LineEditor *ed, const char *prompt)
             return;
 
         if (seq[1] >= '0' && seq[1] <= '9') {
-            /* Extended sequence like ESC [ 3 ~ */
-            if (term_read_char(&seq[2]) <= 0)
-                return;
-            if (seq[2] == '~') {
-                switch (seq[1]) {
-                case '1': /* Home */
+            /* Extended sequence like ESC [ 3 ~ or ESC [ 200 ~; modifier
+             * parameters (";5") are read and ignored */
+            int code = 0;
+            bool param = false;
+            char fin = seq[1];
+            while ((fin >= '0' && fin <= '9') || fin == ';') {
+                if (fin == ';')
+                    param = true;
+                else if (!param && code < 10000)
+                    code = code * 10 + (fin - '0');
+                if (term_read_char(&fin) <= 0)
+                    return;
+            }
+            if (fin == '~') {
+                switch (code) {
+                case 1: /* Home */
+                case 7:
                     ed->cursor = 0;
                     break;
-                case '3': /* Delete */
+                case 3: /* Delete */
                     if (ed->cursor < (int)ed->buf->len)
                         sstr_delete(ed->buf, (size_t)ed->cursor, 1);
                     break;
-                case '4': /* End */
+                case 4: /* End */
+                case 8:
                     ed->cursor = (int)ed->buf->len;
                     break;
+                case 200: /* Bracketed paste */
+                    handle_paste(ed);
+                    break;
                 }
             }
         } else {
             switch (seq[1]) {
             case 'A': /* Up arrow */
-                history_nav_up(ed, prompt);
+                history_nav_up(ed);
                 return; /* refresh already done */
             case 'B': /* Down arrow */
-                history_nav_down(ed, prompt);
+                history_nav_down(ed);
                 return; /* refresh already done */
             case 'C': /* Right arrow */
                 if (ed->cursor < (int)ed->buf->len)
@@ -769,29 +1119,42 @@ static void handle_escape(LineEditor *ed, const char *prompt)
     }
     /* Other ESC sequences are silently ignored. */
 
-    refresh_line(ed, prompt);
+    refresh_line(ed);
 }
 
 /* --------------------------------------------------------------------------
  * Main readline function
  * -------------------------------------------------------------------------- */
 
+/* Leave editing mode; returns result for the caller's convenience */
+static char *editor_finish(LineEditor *ed, char *result)
+{
+    term_puts("\x1b[?2004l");
+    shell_disable_raw_mode(ed->shell);
+    sstr_scratch_done(ed->buf);
+    return result;
+}
+
 char *vsh_readline(Shell *shell, const char *prompt)
 {
     /* Initialize the editor state. */
     LineEditor ed;
     memset(&ed, 0, sizeof(ed));
-    ed.buf        = sstr_new(256);
+    ed.buf        = sstr_scratch();     /* Last line's buffer, grown */
     ed.cursor     = 0;
-    ed.prompt_len = (int)strlen(prompt); /* Assumes no escape sequences in prompt width calc - may need refinement */
     ed.yank_buf   = s_yank_buf;
     ed.shell      = shell;
     ed.searching  = false;
     ed.search_buf = NULL;
     ed.search_pos = 0;
-
-    /* Reset history navigation position for this new prompt. */
-    if (shell->history)
+    set_prompt(&ed, prompt);
+    if (!s_shown_buf)
+        s_shown_buf = sstr_new(256);
+    ed.shown = s_shown_buf;
+
+    /* Reset history navigation position for this new prompt. A history
+     * still loading is joined on first use instead, already reset. */
+    if (!startup_pending(shell->startup, STARTUP_HISTORY) && shell->history)
         history_reset_nav(shell->history);
 
     /* Clear the saved-line buffer for fresh history navigation. */
@@ -800,130 +1163,142 @@ char *vsh_readline(Shell *shell, const char *prompt)
     else
         s_saved_line = sstr_new(64);
 
+    /* Editing needs unbuffered input without echo; bracketed paste makes
+     * the terminal wrap pasted text in ESC [ 200 ~ ... ESC [ 201 ~ */
+    shell_enable_raw_mode(shell);
+    term_puts("\x1b[?2004h");
+
     /* Write prompt to terminal. */
     term_puts(prompt);
+    screen_prompt_written(&ed);
 
     /* Main input loop. */
     for (;;) {
         char c;
-        int rc = term_read_char(&c);
+        int rc = read_key(&ed, &c);
 
         if (rc <= 0) {
             /* EOF or error. */
-            sstr_free(ed.buf);
-            return NULL;
+            return editor_finish(&ed, NULL);
         }
 
+        /* A Tab waiting for its directory listing is dropped by any other
+         * key; the listing is kept for the next one */
+        if (c != 9)
+            ed.tab_pending = false;
+
         switch (c) {
 
         /* ---- Enter ---- */
         case 13:
         case 10: {
+            screen_end(&ed);
             term_puts("\r\n");
             char *result = NULL;
             if (ed.buf->len > 0) {
                 result = strdup(sstr_cstr(ed.buf));
                 /* Add to history if non-empty. */
-                if (shell->history)
-                    history_add(shell->history, result);
+                History *hist = shell_history(shell);
+                if (hist)
+                    history_add(hist, result);
             } else {
                 result = strdup("");
             }
-            sstr_free(ed.buf);
-            return result;
+            return editor_finish(&ed, result);
         }
 
         /* ---- Ctrl+A: beginning of line ---- */
         case 1:
             ed.cursor = 0;
-            refresh_line(&ed, prompt);
+            refresh_line(&ed);
             break;
 
         /* ---- Ctrl+B: move left ---- */
         case 2:
             if (ed.cursor > 0)
                 ed.cursor--;
-            refresh_line(&ed, prompt);
+            refresh_line(&ed);
             break;
 
         /* ---- Ctrl+C: cancel line ---- */
         case 3:
+            screen_end(&ed);
             term_puts("^C\r\n");
             sstr_clear(ed.buf);
             ed.cursor = 0;
             /* Print fresh prompt. */
-            term_puts(prompt);
+            term_puts(ed.prompt);
+            screen_prompt_written(&ed);
             break;
 
         /* ---- Ctrl+D: EOF or delete ---- */
         case 4:
             if (ed.buf->len == 0) {
                 /* EOF on empty line. */
-                sstr_free(ed.buf);
-                return NULL;
+                return editor_finish(&ed, NULL);
             }
             /* Delete char at cursor. */
             if (ed.cursor < (int)ed.buf->len)
                 sstr_delete(ed.buf, (size_t)ed.cursor, 1);
-            refresh_line(&ed, prompt);
+            refresh_line(&ed);
             break;
 
         /* ---- Ctrl+E: end of line ---- */
         case 5:
             ed.cursor = (int)ed.buf->len;
-            refresh_line(&ed, prompt);
+            refresh_line(&ed);
             break;
 
         /* ---- Ctrl+F: move right ---- */
         case 6:
             if (ed.cursor < (int)ed.buf->len)
                 ed.cursor++;
-            refresh_line(&ed, prompt);
+            refresh_line(&ed);
             break;
 
         /* ---- Tab ---- */
         case 9:
-            handle_tab(&ed, prompt);
+            handle_tab(&ed);
             break;
 
         /* ---- Ctrl+K: kill to end ---- */
         case 11:
             kill_to_end(&ed);
-            refresh_line(&ed, prompt);
+            refresh_line(&ed);
             break;
 
         /* ---- Ctrl+L: clear screen ---- */
         case 12:
             term_puts("\x1b[H\x1b[2J");
-            refresh_line(&ed, prompt);
+            redisplay(&ed);
             break;
 
         /* ---- Ctrl+R: reverse search ---- */
         case 18:
-            reverse_search(&ed, prompt);
+            reverse_search(&ed);
             break;
 
         /* ---- Ctrl+U: kill to start ---- */
         case 21:
             kill_to_start(&ed);
-            refresh_line(&ed, prompt);
+            refresh_line(&ed);
             break;
 
         /* ---- Ctrl+W: kill previous word ---- */
         case 23:
             kill_prev_word(&ed);
-            refresh_line(&ed, prompt);
+            refresh_line(&ed);
             break;
 
         /* ---- Ctrl+Y: yank ---- */
         case 25:
             yank(&ed);
-            refresh_line(&ed, prompt);
+            refresh_line(&ed);
             break;
 
         /* ---- Escape: start of escape sequence ---- */
         case 27:
-            handle_escape(&ed, prompt);
+            handle_escape(&ed);
             break;
 
         /* ---- Backspace ---- */
@@ -933,7 +1308,7 @@ char *vsh_readline(Shell *shell, const char *prompt)
                 ed.cursor--;
                 sstr_delete(ed.buf, (size_t)ed.cursor, 1);
             }
-            refresh_line(&ed, prompt);
+            refresh_line(&ed);
             break;
 
         /* ---- Printable characters ---- */
@@ -941,7 +1316,7 @@ char *vsh_readline(Shell *shell, const char *prompt)
             if ((unsigned char)c >= 32) {
                 sstr_insert_char(ed.buf, (size_t)ed.cursor, c);
                 ed.cursor++;
-                refresh_line(&ed, prompt);
+                refresh_line(&ed);
             }
             /* Ignore other control characters. */
             break;
@@ -0,0 +1,685 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * vshc.c - Compiled script cache (.vshc files)
+ *
+ * File layout:
+ *
+ *   VshcHeader | nodes section | strings section
+ *
+ * The nodes section holds the Script, ASTNodes, Redirections and argument
+ * vectors exactly as they are laid out in memory, except that every
+ * pointer field holds an offset: into the nodes section for structures and
+ * vectors, into the strings section for strings. Offset 0 is NULL in both
+ * (each section starts with a reserved slot). The strings section is a
+ * deduplicating table of NUL-terminated strings.
+ *
+ * Loading maps the file MAP_PRIVATE and walks the tree once, checking each
+ * offset against its section and replacing it with a pointer. A field that
+ * was already relocated no longer looks like an offset, so damaged files
+ * with shared or cyclic links are rejected rather than looped over.
+ * ============================================================================ */
+
+#include "vshc.h"
+#include "shell.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define VSHC_MAGIC "VSHC"
+
+typedef struct VshcHeader {
+    char     magic[4];
+    uint32_t format;
+    uint32_t layout;            /* Struct sizes this image was written with */
+    char     version[12];       /* VSH_VERSION_STRING */
+    uint64_t dev, ino, size;    /* The source file when it was parsed */
+    int64_t  mtime_sec, mtime_nsec;
+    uint64_t nodes_off, nodes_size;
+    uint64_t strs_off, strs_size;
+    uint64_t path;              /* String: absolute path of the source */
+    uint64_t error;             /* String: syntax error, 0 if none */
+    uint64_t script;            /* Node: the Script */
+} VshcHeader;
+
+/* Offsets travel in pointer fields */
+#define AS_PTR(type, off) ((type)(uintptr_t)(off))
+#define AS_OFF(ptr)       ((uintptr_t)(ptr))
+
+static uint32_t layout_signature(void)
+{
+    return (uint32_t)(sizeof(void *) << 24 | sizeof(ASTNode) << 16 |
+                      sizeof(CommandNode) << 8 | sizeof(Redirection));
+}
+
+/* ---- Cache file location ------------------------------------------------ */
+
+/* The cache directory, created if missing; false if there is none */
+static bool cache_dir(char *buf, size_t size, bool create)
+{
+    const char *xdg  = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int n;
+
+    if (xdg && xdg[0] == '/')
+        n = snprintf(buf, size, "%s/vsh", xdg);
+    else if (home && home[0] == '/')
+        n = snprintf(buf, size, "%s/.cache/vsh", home);
+    else
+        return false;
+    if (n < 0 || (size_t)n >= size)
+        return false;
+
+    if (!create)
+        return true;
+    if (mkdir(buf, 0700) == 0 || errno == EEXIST)
+        return true;
+
+    /* $HOME/.cache itself may be missing */
+    char *slash = strrchr(buf, '/');
+    *slash = '\0';
+    bool ok = mkdir(buf, 0700) == 0 || errno == EEXIST;
+    *slash = '/';
+    return ok && (mkdir(buf, 0700) == 0 || errno == EEXIST);
+}
+
+/* Resolve path and name its image: <cache dir>/<fnv1a(abs path)>.vshc */
+static bool cache_file(const char *path, char *abs, char *file, bool create)
+{
+    if (!realpath(path, abs))
+        return false;
+
+    char dir[PATH_MAX];
+    if (!cache_dir(dir, sizeof(dir), create))
+        return false;
+
+    uint64_t h = 14695981039346656037ull;   /* FNV-1a */
+    for (const char *p = abs; *p; p++)
+        h = (h ^ (unsigned char)*p) * 1099511628211ull;
+
+    int n = snprintf(file, PATH_MAX, "%s/%016llx.vshc", dir,
+                     (unsigned long long)h);
+    return n > 0 && n < PATH_MAX;
+}
+
+/* ---- Encoding ----------------------------------------------------------- */
+
+typedef struct ByteBuf {
+    char   *data;
+    size_t  len;
+    size_t  cap;
+} ByteBuf;
+
+typedef struct Encoder {
+    ByteBuf   nodes;
+    ByteBuf   strs;
+    uint32_t *slots;            /* String table: offset, 0 = empty slot */
+    size_t    nslots;
+    size_t    nstrs;
+    bool      failed;           /* Out of memory or over VSHC_MAX_SIZE */
+} Encoder;
+
+/* Append n bytes aligned to align; returns their offset (0 on failure) */
+static uintptr_t buf_put(Encoder *e, ByteBuf *b, const void *data, size_t n,
+                         size_t align)
+{
+    size_t off = (b->len + align - 1) & ~(align - 1);
+    if (off + n > VSHC_MAX_SIZE) {
+        e->failed = true;
+        return 0;
+    }
+    if (off + n > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 4096;
+        while (cap < off + n)
+            cap *= 2;
+        char *grown = realloc(b->data, cap);
+        if (!grown) {
+            e->failed = true;
+            return 0;
+        }
+        b->data = grown;
+        b->cap  = cap;
+    }
+    memset(b->data + b->len, 0, off - b->len);
+    memcpy(b->data + off, data, n);
+    b->len = off + n;
+    return off;
+}
+
+static uint32_t str_hash(const char *s)
+{
+    uint32_t h = 2166136261u;   /* FNV-1a */
+    for (; *s; s++)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+/* Offset of s in the string table, adding it the first time */
+static uintptr_t enc_str(Encoder *e, const char *s)
+{
+    if (!s || e->failed)
+        return 0;
+
+    if (e->nstrs * 2 >= e->nslots) {
+        size_t n = e->nslots ? e->nslots * 2 : 256;
+        uint32_t *slots = calloc(n, sizeof(uint32_t));
+        if (!slots) {
+            e->failed = true;
+            return 0;
+        }
+        for (size_t i = 0; i < e->nslots; i++) {
+            if (!e->slots[i])
+                continue;
+            size_t j = str_hash(e->strs.data + e->slots[i]) & (n - 1);
+            while (slots[j])
+                j = (j + 1) & (n - 1);
+            slots[j] = e->slots[i];
+        }
+        free(e->slots);
+        e->slots  = slots;
+        e->nslots = n;
+    }
+
+    size_t j = str_hash(s) & (e->nslots - 1);
+    for (; e->slots[j]; j = (j + 1) & (e->nslots - 1)) {
+        if (strcmp(e->strs.data + e->slots[j], s) == 0)
+            return e->slots[j];
+    }
+
+    uintptr_t off = buf_put(e, &e->strs, s, strlen(s) + 1, 1);
+    if (off) {
+        e->slots[j] = (uint32_t)off;
+        e->nstrs++;
+    }
+    return off;
+}
+
+static uintptr_t enc_strv(Encoder *e, char **v, int count)
+{
+    if (!v || e->failed)
+        return 0;
+
+    char **tmp = calloc((size_t)count + 1, sizeof(char *));
+    if (!tmp) {
+        e->failed = true;
+        return 0;
+    }
+    for (int i = 0; i < count; i++)
+        tmp[i] = AS_PTR(char *, enc_str(e, v[i]));
+    uintptr_t off = buf_put(e, &e->nodes, tmp,
+                            ((size_t)count + 1) * sizeof(char *),
+                            _Alignof(char *));
+    free(tmp);
+    return off;
+}
+
+static uintptr_t enc_flags(Encoder *e, const unsigned char *flags, int count)
+{
+    if (!flags || count == 0)
+        return 0;
+    return buf_put(e, &e->nodes, flags, (size_t)count, 1);
+}
+
+static uintptr_t enc_redirs(Encoder *e, const Redirection *r)
+{
+    if (!r || e->failed)
+        return 0;
+
+    Redirection copy = *r;
+    copy.target = AS_PTR(char *, enc_str(e, r->target));
+    copy.next   = AS_PTR(Redirection *, enc_redirs(e, r->next));
+    return buf_put(e, &e->nodes, &copy, sizeof(copy), _Alignof(Redirection));
+}
+
+static uintptr_t enc_node(Encoder *e, const ASTNode *node)
+{
+    if (!node || e->failed)
+        return 0;
+
+    ASTNode copy = *node;
+
+    switch (node->type) {
+    case NODE_COMMAND:
+        copy.cmd.argv = AS_PTR(char **, enc_strv(e, node->cmd.argv,
+                                                 node->cmd.argc));
+        copy.cmd.argv_flags = AS_PTR(unsigned char *,
+                                     enc_flags(e, node->cmd.argv_flags,
+                                               node->cmd.argc));
+        copy.cmd.assignments = AS_PTR(char **,
+                                      enc_strv(e, node->cmd.assignments,
+                                               node->cmd.nassign));
+        copy.cmd.redirs   = AS_PTR(Redirection *,
+                                   enc_redirs(e, node->cmd.redirs));
+        copy.cmd.builtin  = NULL;   /* Resolved again by the loading shell */
+        copy.cmd.resolved = false;
+        break;
+
+    case NODE_PIPELINE: {
+        int n = node->pipeline.count;
+        ASTNode **tmp = calloc((size_t)n + 1, sizeof(ASTNode *));
+        if (!tmp) {
+            e->failed = true;
+            return 0;
+        }
+        for (int i = 0; i < n; i++)
+            tmp[i] = AS_PTR(ASTNode *, enc_node(e, node->pipeline.commands[i]));
+        copy.pipeline.commands = AS_PTR(ASTNode **,
+            buf_put(e, &e->nodes, tmp, ((size_t)n + 1) * sizeof(ASTNode *),
+                    _Alignof(ASTNode *)));
+        free(tmp);
+        break;
+    }
+
+    case NODE_AND:
+    case NODE_OR:
+    case NODE_SEQUENCE:
+        copy.binary.left  = AS_PTR(ASTNode *, enc_node(e, node->binary.left));
+        copy.binary.right = AS_PTR(ASTNode *, enc_node(e, node->binary.right));
+        break;
+
+    case NODE_BACKGROUND:
+    case NODE_NEGATE:
+    case NODE_SUBSHELL:
+    case NODE_BLOCK:
+        copy.child = AS_PTR(ASTNode *, enc_node(e, node->child));
+        break;
+
+    case NODE_ARITH:
+        copy.expr = AS_PTR(char *, enc_str(e, node->expr));
+        break;
+
+    case NODE_IF:
+        copy.if_node.condition = AS_PTR(ASTNode *,
+                                        enc_node(e, node->if_node.condition));
+        copy.if_node.then_body = AS_PTR(ASTNode *,
+                                        enc_node(e, node->if_node.then_body));
+        copy.if_node.else_body = AS_PTR(ASTNode *,
+                                        enc_node(e, node->if_node.else_body));
+        break;
+
+    case NODE_WHILE:
+        copy.while_node.condition = AS_PTR(ASTNode *,
+            enc_node(e, node->while_node.condition));
+        copy.while_node.body = AS_PTR(ASTNode *,
+                                      enc_node(e, node->while_node.body));
+        break;
+
+    case NODE_FOR:
+        copy.for_node.varname = AS_PTR(char *,
+                                       enc_str(e, node->for_node.varname));
+        copy.for_node.words = AS_PTR(char **,
+                                     enc_strv(e, node->for_node.words,
+                                              node->for_node.nwords));
+        copy.for_node.word_flags = AS_PTR(unsigned char *,
+            enc_flags(e, node->for_node.word_flags, node->for_node.nwords));
+        copy.for_node.body = AS_PTR(ASTNode *,
+                                    enc_node(e, node->for_node.body));
+        break;
+
+    case NODE_FUNCTION:
+        copy.func.name = AS_PTR(char *, enc_str(e, node->func.name));
+        copy.func.body = AS_PTR(ASTNode *, enc_node(e, node->func.body));
+        break;
+    }
+
+    return buf_put(e, &e->nodes, &copy, sizeof(copy), _Alignof(ASTNode));
+}
+
+static uintptr_t enc_script(Encoder *e, const Script *script)
+{
+    int n = script->count;
+    ASTNode **tmp = calloc((size_t)n + 1, sizeof(ASTNode *));
+    if (!tmp) {
+        e->failed = true;
+        return 0;
+    }
+    for (int i = 0; i < n; i++)
+        tmp[i] = AS_PTR(ASTNode *, enc_node(e, script->commands[i]));
+
+    Script copy = { .count = n };
+    copy.commands = AS_PTR(ASTNode **,
+        buf_put(e, &e->nodes, tmp, ((size_t)n + 1) * sizeof(ASTNode *),
+                _Alignof(ASTNode *)));
+    free(tmp);
+    return buf_put(e, &e->nodes, &copy, sizeof(copy), _Alignof(Script));
+}
+
+static bool write_all(int fd, const void *data, size_t n)
+{
+    const char *p = data;
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+bool vshc_store(const char *path, const struct stat *st,
+                const Script *script, const char *error)
+{
+    char abs[PATH_MAX], file[PATH_MAX];
+    if (!script || !cache_file(path, abs, file, true))
+        return false;
+
+    /* Offset 0 of each section is the NULL slot */
+    static const char zero[8];
+    Encoder e = {0};
+    buf_put(&e, &e.nodes, zero, sizeof(zero), 8);
+    buf_put(&e, &e.strs, zero, 1, 1);
+
+    VshcHeader h = {
+        .magic      = VSHC_MAGIC,
+        .format     = VSHC_FORMAT,
+        .layout     = layout_signature(),
+        .dev        = (uint64_t)st->st_dev,
+        .ino        = (uint64_t)st->st_ino,
+        .size       = (uint64_t)st->st_size,
+        .mtime_sec  = (int64_t)st->st_mtim.tv_sec,
+        .mtime_nsec = (int64_t)st->st_mtim.tv_nsec,
+    };
+    snprintf(h.version, sizeof(h.version), "%s", VSH_VERSION_STRING);
+    h.script = enc_script(&e, script);
+    h.path   = enc_str(&e, abs);
+    h.error  = enc_str(&e, error);
+
+    bool ok = !e.failed;
+    if (ok) {
+        h.nodes_off  = (sizeof(h) + 7) & ~(uint64_t)7;
+        h.nodes_size = e.nodes.len;
+        h.strs_off   = h.nodes_off + h.nodes_size;
+        h.strs_size  = e.strs.len;
+
+        /* Written aside and renamed over, so readers never see half */
+        char tmp[PATH_MAX + 8];
+        snprintf(tmp, sizeof(tmp), "%s.XXXXXX", file);
+        int fd = mkstemp(tmp);
+        ok = fd >= 0;
+        if (ok) {
+            ok = write_all(fd, &h, sizeof(h)) &&
+                 write_all(fd, zero, (size_t)h.nodes_off - sizeof(h)) &&
+                 write_all(fd, e.nodes.data, e.nodes.len) &&
+                 write_all(fd, e.strs.data, e.strs.len);
+            close(fd);
+            if (!ok || rename(tmp, file) != 0) {
+                unlink(tmp);
+                ok = false;
+            }
+        }
+    }
+
+    free(e.nodes.data);
+    free(e.strs.data);
+    free(e.slots);
+    return ok;
+}
+
+/* ---- Loading ------------------------------------------------------------ */
+
+typedef struct Decoder {
+    char   *nodes;
+    size_t  nodes_size;
+    char   *strs;
+    size_t  strs_size;
+    bool    bad;
+} Decoder;
+
+/* A size-byte object at a node-section offset, or NULL */
+static void *rel_obj(Decoder *d, const void *field, size_t size, size_t align)
+{
+    uintptr_t off = AS_OFF(field);
+    if (off == 0)
+        return NULL;
+    if (off % align != 0 || off >= d->nodes_size ||
+        size > d->nodes_size - off) {
+        d->bad = true;
+        return NULL;
+    }
+    return d->nodes + off;
+}
+
+static char *rel_str(Decoder *d, const char *field)
+{
+    uintptr_t off = AS_OFF(field);
+    if (off == 0)
+        return NULL;
+    if (off >= d->strs_size) {
+        d->bad = true;
+        return NULL;
+    }
+    return d->strs + off;
+}
+
+static bool count_ok(Decoder *d, int count, size_t elem)
+{
+    if (count < 0 || (size_t)count >= d->nodes_size / elem) {
+        d->bad = true;
+        return false;
+    }
+    return true;
+}
+
+static char **rel_strv(Decoder *d, char **field, int count)
+{
+    if (!field || !count_ok(d, count, sizeof(char *)))
+        return NULL;
+
+    char **v = rel_obj(d, field, ((size_t)count + 1) * sizeof(char *),
+                       _Alignof(char *));
+    if (!v)
+        return NULL;
+    for (int i = 0; i < count; i++)
+        v[i] = rel_str(d, v[i]);
+    v[count] = NULL;
+    return v;
+}
+
+static unsigned char *rel_flags(Decoder *d, unsigned char *field, int count)
+{
+    if (!field || !count_ok(d, count, 1))
+        return NULL;
+    return rel_obj(d, field, (size_t)count, 1);
+}
+
+static Redirection *rel_redirs(Decoder *d, Redirection *field)
+{
+    Redirection *head = rel_obj(d, field, sizeof(Redirection),
+                                _Alignof(Redirection));
+    for (Redirection *r = head; r && !d->bad; r = r->next) {
+        if ((unsigned)r->type > REDIR_DUP_IN) {
+            d->bad = true;
+            break;
+        }
+        r->target = rel_str(d, r->target);
+        r->next   = rel_obj(d, r->next, sizeof(Redirection),
+                            _Alignof(Redirection));
+    }
+    return head;
+}
+
+static ASTNode *rel_node(Decoder *d, ASTNode *field);
+
+static ASTNode **rel_nodev(Decoder *d, ASTNode **field, int count)
+{
+    if (!field || !count_ok(d, count, sizeof(ASTNode *)))
+        return NULL;
+
+    ASTNode **v = rel_obj(d, field, ((size_t)count + 1) * sizeof(ASTNode *),
+                          _Alignof(ASTNode *));
+    for (int i = 0; v && i < count && !d->bad; i++)
+        v[i] = rel_node(d, v[i]);
+    return v;
+}
+
+static ASTNode *rel_node(Decoder *d, ASTNode *field)
+{
+    ASTNode *n = rel_obj(d, field, sizeof(ASTNode), _Alignof(ASTNode));
+    if (!n || d->bad)
+        return n;
+
+    switch (n->type) {
+    case NODE_COMMAND:
+        n->cmd.argv        = rel_strv(d, n->cmd.argv, n->cmd.argc);
+        n->cmd.argv_flags  = rel_flags(d, n->cmd.argv_flags, n->cmd.argc);
+        n->cmd.assignments = rel_strv(d, n->cmd.assignments, n->cmd.nassign);
+        n->cmd.redirs      = rel_redirs(d, n->cmd.redirs);
+        n->cmd.builtin     = NULL;
+        n->cmd.resolved    = false;
+        if (!n->cmd.argv && n->cmd.argc > 0)
+            d->bad = true;
+        break;
+
+    case NODE_PIPELINE:
+        n->pipeline.commands = rel_nodev(d, n->pipeline.commands,
+                                         n->pipeline.count);
+        break;
+
+    case NODE_AND:
+    case NODE_OR:
+    case NODE_SEQUENCE:
+        n->binary.left  = rel_node(d, n->binary.left);
+        n->binary.right = rel_node(d, n->binary.right);
+        break;
+
+    case NODE_BACKGROUND:
+    case NODE_NEGATE:
+    case NODE_SUBSHELL:
+    case NODE_BLOCK:
+        n->child = rel_node(d, n->child);
+        break;
+
+    case NODE_ARITH:
+        n->expr = rel_str(d, n->expr);
+        break;
+
+    case NODE_IF:
+        n->if_node.condition = rel_node(d, n->if_node.condition);
+        n->if_node.then_body = rel_node(d, n->if_node.then_body);
+        n->if_node.else_body = rel_node(d, n->if_node.else_body);
+        break;
+
+    case NODE_WHILE:
+        n->while_node.condition = rel_node(d, n->while_node.condition);
+        n->while_node.body      = rel_node(d, n->while_node.body);
+        break;
+
+    case NODE_FOR:
+        n->for_node.varname    = rel_str(d, n->for_node.varname);
+        n->for_node.words      = rel_strv(d, n->for_node.words,
+                                          n->for_node.nwords);
+        n->for_node.word_flags = rel_flags(d, n->for_node.word_flags,
+                                           n->for_node.nwords);
+        n->for_node.body       = rel_node(d, n->for_node.body);
+        break;
+
+    case NODE_FUNCTION:
+        n->func.name = rel_str(d, n->func.name);
+        n->func.body = rel_node(d, n->func.body);
+        break;
+
+    default:
+        d->bad = true;
+        break;
+    }
+    return n;
+}
+
+/* Header matches this build and the source file as it is now */
+static bool header_ok(const VshcHeader *h, size_t size, const struct stat *st)
+{
+    char version[sizeof(h->version)] = {0};
+    snprintf(version, sizeof(version), "%s", VSH_VERSION_STRING);
+
+    return memcmp(h->magic, VSHC_MAGIC, sizeof(h->magic)) == 0 &&
+           h->format == VSHC_FORMAT &&
+           h->layout == layout_signature() &&
+           memcmp(h->version, version, sizeof(version)) == 0 &&
+           h->dev == (uint64_t)st->st_dev &&
+           h->ino == (uint64_t)st->st_ino &&
+           h->size == (uint64_t)st->st_size &&
+           h->mtime_sec == (int64_t)st->st_mtim.tv_sec &&
+           h->mtime_nsec == (int64_t)st->st_mtim.tv_nsec &&
+           h->nodes_off % 8 == 0 && h->nodes_off >= sizeof(*h) &&
+           h->nodes_off <= size && h->nodes_size <= size - h->nodes_off &&
+           h->strs_off <= size && h->strs_size <= size - h->strs_off &&
+           h->strs_size > 0;
+}
+
+VshcImage *vshc_load(const char *path, const struct stat *st)
+{
+    char abs[PATH_MAX], file[PATH_MAX];
+    if (!cache_file(path, abs, file, false))
+        return NULL;
+
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat fst;
+    if (fstat(fd, &fst) != 0 || fst.st_size < (off_t)sizeof(VshcHeader) ||
+        fst.st_size > (off_t)VSHC_MAX_SIZE + 4096) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)fst.st_size;
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    VshcHeader *h = map;
+    Decoder d = {0};
+    if (header_ok(h, size, st)) {
+        d.nodes      = (char *)map + h->nodes_off;
+        d.nodes_size = (size_t)h->nodes_size;
+        d.strs       = (char *)map + h->strs_off;
+        d.strs_size  = (size_t)h->strs_size;
+    }
+
+    const char *src_path = NULL;
+    Script *script = NULL;
+    if (d.strs && d.strs[d.strs_size - 1] == '\0') {
+        src_path = rel_str(&d, AS_PTR(char *, h->path));
+        if (src_path && strcmp(src_path, abs) == 0) {
+            script = rel_obj(&d, AS_PTR(Script *, h->script), sizeof(Script),
+                             _Alignof(Script));
+            if (script)
+                script->commands = rel_nodev(&d, script->commands,
+                                             script->count);
+        }
+    }
+
+    VshcImage *img = NULL;
+    if (script && !d.bad && (script->commands || script->count == 0))
+        img = malloc(sizeof(VshcImage));
+    if (!img) {
+        munmap(map, size);
+        return NULL;
+    }
+
+    img->map    = map;
+    img->size   = size;
+    img->script = script;
+    img->error  = rel_str(&d, AS_PTR(char *, h->error));
+    return img;
+}
+
+void vshc_unload(VshcImage *img)
+{
+    if (!img)
+        return;
+    munmap(img->map, img->size);
+    free(img);
+}
@@ -4,19 +4,36 @@
  *
  * Provides pattern matching (fnmatch-style) and file-glob expansion.
  * wildcard_match() is a hand-rolled recursive matcher used for tab completion
- * and programmatic matching.  wildcard_expand() delegates to POSIX glob(3) for
- * robust filesystem expansion, then copies results into the caller's arena.
+ * and programmatic matching.  wildcard_expand() walks the filesystem itself
+ * on top of it: the pattern is split into '/' components, literal components
+ * are appended without touching the disk, and only components containing
+ * magic characters read a directory.  Entry types come from d_type, so stat
+ * is needed only for symlinks and filesystems that report DT_UNKNOWN.
+ *
+ * Directory listings are read with getdents64 into one name block and kept
+ * in a small LRU cache keyed by device, inode and mtime, so a glob repeated
+ * in a loop re-reads a directory only after it changes.
+ *
+ * A `**` component walks the whole tree below it instead, on up to
+ * WILDCARD_WALK_THREADS threads that steal directories from each other.
  * ============================================================================ */
 
 #include "wildcard.h"
 #include "arena.h"
 
-#include <glob.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 /* ---- Internal helpers --------------------------------------------------- */
 
@@ -65,6 +82,641 @@ static bool match_bracket(const char **pp, char c)
     return negate ? !matched : matched;
 }
 
+/* ---- Directory listing cache -------------------------------------------- */
+
+typedef struct DirEntryRef {
+    unsigned int  name;         /* Offset into DirListing.names */
+    unsigned char type;         /* DT_* from getdents64 */
+} DirEntryRef;
+
+typedef struct DirListing {
+    bool            valid;
+    dev_t           dev;
+    ino_t           ino;
+    struct timespec mtime;
+    char           *names;      /* NUL-separated entry names */
+    size_t          names_len;
+    DirEntryRef    *entries;
+    size_t          count;
+    unsigned long   last_used;
+} DirListing;
+
+static DirListing    dir_cache[WILDCARD_DIR_CACHE];
+static unsigned long dir_clock = 0;
+
+static void listing_free(DirListing *dl)
+{
+    free(dl->names);
+    free(dl->entries);
+    memset(dl, 0, sizeof(*dl));
+}
+
+/* Append one entry name to a listing being built. Returns false on OOM. */
+static bool listing_add(DirListing *dl, size_t *names_cap, size_t *entries_cap,
+                        const char *name, unsigned char type)
+{
+    size_t len = strlen(name) + 1;
+
+    if (dl->names_len + len > *names_cap) {
+        size_t cap = *names_cap ? *names_cap : 4096;
+        while (dl->names_len + len > cap)
+            cap *= 2;
+        char *tmp = realloc(dl->names, cap);
+        if (!tmp)
+            return false;
+        dl->names  = tmp;
+        *names_cap = cap;
+    }
+    if (dl->count == *entries_cap) {
+        size_t cap = *entries_cap ? *entries_cap * 2 : 64;
+        DirEntryRef *tmp = realloc(dl->entries, cap * sizeof(DirEntryRef));
+        if (!tmp)
+            return false;
+        dl->entries  = tmp;
+        *entries_cap = cap;
+    }
+
+    memcpy(dl->names + dl->names_len, name, len);
+    dl->entries[dl->count].name = (unsigned int)dl->names_len;
+    dl->entries[dl->count].type = type;
+    dl->count++;
+    dl->names_len += len;
+    return true;
+}
+
+/* Read every entry of the open directory fd (except . and ..) */
+static bool listing_read(DirListing *dl, int fd)
+{
+    size_t names_cap = 0, entries_cap = 0;
+
+#ifdef __linux__
+    /* Raw getdents64: one large buffer per syscall and no DIR allocation */
+    char buf[32768];
+    for (;;) {
+        ssize_t n = getdents64(fd, buf, sizeof(buf));
+        if (n < 0)
+            return false;
+        if (n == 0)
+            break;
+        for (ssize_t off = 0; off < n; ) {
+            struct dirent64 *d = (struct dirent64 *)(buf + off);
+            off += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' &&
+                (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+            if (!listing_add(dl, &names_cap, &entries_cap, name, d->d_type))
+                return false;
+        }
+    }
+    return true;
+#else
+    int dup_fd = dup(fd);
+    DIR *dir = dup_fd >= 0 ? fdopendir(dup_fd) : NULL;
+    if (!dir) {
+        if (dup_fd >= 0)
+            close(dup_fd);
+        return false;
+    }
+    bool ok = true;
+    struct dirent *d;
+    while (ok && (d = readdir(dir)) != NULL) {
+        const char *name = d->d_name;
+        if (name[0] == '.' &&
+            (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+        ok = listing_add(dl, &names_cap, &entries_cap, name, d->d_type);
+    }
+    closedir(dir);
+    return ok;
+#endif
+}
+
+/* The listing of directory `path`, from the cache when its inode and mtime
+ * are unchanged. Returns NULL if it cannot be read. */
+static const DirListing *dir_listing(const char *path)
+{
+    int fd = open(path[0] ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    DirListing *victim = &dir_cache[0];
+    for (int i = 0; i < WILDCARD_DIR_CACHE; i++) {
+        DirListing *dl = &dir_cache[i];
+        if (dl->valid && dl->dev == st.st_dev && dl->ino == st.st_ino) {
+            if (dl->mtime.tv_sec == st.st_mtim.tv_sec &&
+                dl->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+                close(fd);
+                dl->last_used = ++dir_clock;
+                return dl;
+            }
+            victim = dl;        /* Stale copy of this directory: replace it */
+            break;
+        }
+        /* Otherwise evict an empty slot, or the least recently used */
+        if (victim->valid && (!dl->valid || dl->last_used < victim->last_used))
+            victim = dl;
+    }
+
+    listing_free(victim);
+    bool ok = listing_read(victim, fd);
+    close(fd);
+    if (!ok) {
+        listing_free(victim);
+        return NULL;
+    }
+
+    victim->valid     = true;
+    victim->dev       = st.st_dev;
+    victim->ino       = st.st_ino;
+    victim->mtime     = st.st_mtim;
+    victim->last_used = ++dir_clock;
+    return victim;
+}
+
+/* ---- Filesystem walk ----------------------------------------------------- */
+
+typedef struct GlobWalk {
+    Arena  *arena;
+    char  **results;            /* malloc'd while collecting */
+    int     count;
+    int     cap;
+    bool    dirs_only;          /* Pattern ended in '/' */
+    bool    failed;
+    char    path[PATH_MAX];
+} GlobWalk;
+
+static void walk_add(GlobWalk *w, size_t len)
+{
+    if (w->count == w->cap) {
+        int cap = w->cap ? w->cap * 2 : 16;
+        char **tmp = realloc(w->results, (size_t)cap * sizeof(char *));
+        if (!tmp) {
+            w->failed = true;
+            return;
+        }
+        w->results = tmp;
+        w->cap     = cap;
+    }
+    char *copy = arena_alloc(w->arena, len + 2);
+    if (!copy) {
+        w->failed = true;
+        return;
+    }
+    memcpy(copy, w->path, len);
+    if (w->dirs_only)
+        copy[len++] = '/';
+    copy[len] = '\0';
+    w->results[w->count++] = copy;
+}
+
+/* Append "/name" (or "name" at the root of a relative walk) to w->path.
+ * Returns the new length, or 0 if it would not fit. */
+static size_t walk_join(GlobWalk *w, size_t len, const char *name, size_t nlen)
+{
+    size_t need = len + (len > 0 && w->path[len - 1] != '/') + nlen;
+    if (need >= sizeof(w->path))
+        return 0;
+    if (len > 0 && w->path[len - 1] != '/')
+        w->path[len++] = '/';
+    memcpy(w->path + len, name, nlen);
+    w->path[len + nlen] = '\0';
+    return len + nlen;
+}
+
+/* Is w->path (an entry of type `type`) usable as a directory? */
+static bool walk_is_dir(GlobWalk *w, unsigned char type)
+{
+    if (type == DT_DIR)
+        return true;
+    if (type != DT_LNK && type != DT_UNKNOWN)
+        return false;
+
+    struct stat st;
+    return stat(w->path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/* Copy a literal component with backslash escapes removed */
+static size_t unescape(char *dst, const char *src, size_t n)
+{
+    size_t out = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (src[i] == '\\' && i + 1 < n)
+            i++;
+        dst[out++] = src[i];
+    }
+    return out;
+}
+
+/* ---- Recursive ** walk --------------------------------------------------- */
+
+/*
+ * A `**` component reads a whole tree, which is worth spreading over the
+ * CPUs. Each worker owns a deque of directories still to read: it pushes
+ * the subdirectories it finds and pops them back from the same end, so it
+ * stays depth-first in its own part of the tree, while an idle worker takes
+ * the oldest (shallowest, usually largest) directory from the other end of
+ * someone else's. `pending` counts directories queued or being read; the
+ * walk is over when it drops to zero.
+ *
+ * Paths are built in a per-worker arena, so a stolen directory is just a
+ * pointer into its finder's arena, and nothing is freed until the end.
+ * Workers do not touch the listing cache, which is not thread-safe.
+ */
+
+typedef enum TreeMode {
+    TREE_ALL,                   /* `**` last: every entry */
+    TREE_MATCH,                 /* `** /tail`: entries matching tail */
+    TREE_DIRS,                  /* More components follow: directories */
+} TreeMode;
+
+typedef struct TreeDeque {
+    pthread_mutex_t lock;
+    const char    **dirs;
+    size_t          head;       /* Steal from here */
+    size_t          tail;       /* Push and pop here */
+    size_t          cap;
+} TreeDeque;
+
+typedef struct TreeWorker {
+    struct TreeWalk *tw;
+    int              index;
+    pthread_t        thread;
+    bool             started;
+    TreeDeque        deque;
+    Arena           *arena;
+    const char     **found;
+    size_t           nfound;
+    size_t           cap;
+} TreeWorker;
+
+typedef struct TreeWalk {
+    TreeMode    mode;
+    const char *tail;
+    bool        dirs_only;
+    int         nworkers;
+    atomic_long pending;
+    atomic_bool failed;
+    TreeWorker  workers[WILDCARD_WALK_THREADS];
+} TreeWalk;
+
+/* Workers to use: one per CPU we may run on, up to WILDCARD_WALK_THREADS */
+static int tree_workers(void)
+{
+    static int workers = 0;
+    if (workers == 0) {
+        cpu_set_t cpus;
+        long n = sched_getaffinity(0, sizeof(cpus), &cpus) == 0
+                     ? CPU_COUNT(&cpus)
+                     : sysconf(_SC_NPROCESSORS_ONLN);
+        workers = n < 1 ? 1 : n > WILDCARD_WALK_THREADS ? WILDCARD_WALK_THREADS
+                                                        : (int)n;
+    }
+    return workers;
+}
+
+static bool deque_push(TreeDeque *dq, const char *dir)
+{
+    bool ok = true;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail == dq->cap && dq->head > 0) {
+        memmove(dq->dirs, dq->dirs + dq->head,
+                (dq->tail - dq->head) * sizeof(char *));
+        dq->tail -= dq->head;
+        dq->head  = 0;
+    }
+    if (dq->tail == dq->cap) {
+        size_t cap = dq->cap ? dq->cap * 2 : 64;
+        const char **tmp = realloc(dq->dirs, cap * sizeof(char *));
+        if (tmp) {
+            dq->dirs = tmp;
+            dq->cap  = cap;
+        } else {
+            ok = false;
+        }
+    }
+    if (ok)
+        dq->dirs[dq->tail++] = dir;
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+/* Take the newest directory (owner) or the oldest (thief) */
+static const char *deque_take(TreeDeque *dq, bool steal)
+{
+    const char *dir = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head)
+        dir = steal ? dq->dirs[dq->head++] : dq->dirs[--dq->tail];
+    if (dq->head == dq->tail)
+        dq->head = dq->tail = 0;
+    pthread_mutex_unlock(&dq->lock);
+    return dir;
+}
+
+static void tree_found(TreeWorker *me, const char *path)
+{
+    if (me->nfound == me->cap) {
+        size_t cap = me->cap ? me->cap * 2 : 64;
+        const char **tmp = realloc(me->found, cap * sizeof(char *));
+        if (!tmp) {
+            atomic_store(&me->tw->failed, true);
+            return;
+        }
+        me->found = tmp;
+        me->cap   = cap;
+    }
+    me->found[me->nfound++] = path;
+}
+
+/* Read one directory: record what the mode wants, queue the subdirectories.
+ * Hidden entries are never descended into. */
+static void tree_read(TreeWorker *me, const char *dir)
+{
+    TreeWalk *tw = me->tw;
+    int fd = open(dir[0] ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    size_t dlen = strlen(dir);
+    bool   slash = dlen > 0 && dir[dlen - 1] != '/';
+    bool   show_hidden = tw->mode == TREE_MATCH && tw->tail[0] == '.';
+    char   buf[32768];
+    ssize_t n;
+    while (!atomic_load(&tw->failed) &&
+           (n = getdents64(fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t off = 0; off < n; ) {
+            struct dirent64 *d = (struct dirent64 *)(buf + off);
+            off += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' &&
+                (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            unsigned char type = d->d_type;
+            struct stat st;
+            if (type == DT_UNKNOWN &&
+                fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+                type = S_ISDIR(st.st_mode) ? DT_DIR
+                     : S_ISLNK(st.st_mode) ? DT_LNK : DT_REG;
+
+            bool hidden  = name[0] == '.';
+            bool descend = !hidden && type == DT_DIR;
+            bool record;
+            switch (tw->mode) {
+            case TREE_ALL:   record = !hidden; break;
+            case TREE_MATCH: record = (!hidden || show_hidden) &&
+                                      wildcard_match(tw->tail, name); break;
+            default:         record = descend; break;
+            }
+            /* A symlink to a directory counts as one, but is not followed */
+            if (record && tw->dirs_only && type != DT_DIR)
+                record = type == DT_LNK && fstatat(fd, name, &st, 0) == 0 &&
+                         S_ISDIR(st.st_mode);
+            if (!record && !descend)
+                continue;
+
+            size_t nlen = strlen(name);
+            if (dlen + slash + nlen >= PATH_MAX)
+                continue;
+            char *path = arena_alloc(me->arena, dlen + slash + nlen + 1);
+            if (!path) {
+                atomic_store(&tw->failed, true);
+                break;
+            }
+            memcpy(path, dir, dlen);
+            if (slash)
+                path[dlen] = '/';
+            memcpy(path + dlen + slash, name, nlen + 1);
+
+            if (record)
+                tree_found(me, path);
+            if (descend) {
+                atomic_fetch_add(&tw->pending, 1);
+                if (!deque_push(&me->deque, path)) {
+                    atomic_fetch_sub(&tw->pending, 1);
+                    atomic_store(&tw->failed, true);
+                }
+            }
+        }
+    }
+    close(fd);
+}
+
+static void *tree_worker(void *p)
+{
+    TreeWorker *me = p;
+    TreeWalk   *tw = me->tw;
+    for (;;) {
+        const char *dir = deque_take(&me->deque, false);
+        for (int k = 1; !dir && k < tw->nworkers; k++)
+            dir = deque_take(&tw->workers[(me->index + k) % tw->nworkers].deque,
+                             true);
+        if (dir) {
+            if (!atomic_load(&tw->failed))
+                tree_read(me, dir);
+            atomic_fetch_sub(&tw->pending, 1);
+        } else if (atomic_load(&tw->pending) == 0) {
+            break;
+        } else {
+            sched_yield();      /* Someone is still reading; wait for work */
+        }
+    }
+    return NULL;
+}
+
+/* Walk the tree below base with every worker, the caller being the first.
+ * Returns false if memory ran out. */
+static bool tree_walk(TreeWalk *tw, const char *base)
+{
+    tw->nworkers = tree_workers();
+    atomic_init(&tw->pending, 1);
+    atomic_init(&tw->failed, false);
+    for (int k = 0; k < tw->nworkers; k++) {
+        TreeWorker *wk = &tw->workers[k];
+        wk->tw    = tw;
+        wk->index = k;
+        pthread_mutex_init(&wk->deque.lock, NULL);
+        wk->arena = arena_create();
+        if (!wk->arena)
+            atomic_store(&tw->failed, true);
+    }
+
+    bool ok = !atomic_load(&tw->failed) &&
+              deque_push(&tw->workers[0].deque, base);
+    if (ok) {
+        /* Workers inherit a full signal mask, as startup tasks do */
+        sigset_t all, old;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        for (int k = 1; k < tw->nworkers; k++) {
+            TreeWorker *wk = &tw->workers[k];
+            wk->started = pthread_create(&wk->thread, NULL, tree_worker, wk) == 0;
+        }
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+        tree_worker(&tw->workers[0]);
+        for (int k = 1; k < tw->nworkers; k++) {
+            if (tw->workers[k].started)
+                pthread_join(tw->workers[k].thread, NULL);
+        }
+    }
+    return ok && !atomic_load(&tw->failed);
+}
+
+static void tree_free(TreeWalk *tw)
+{
+    for (int k = 0; k < tw->nworkers; k++) {
+        TreeWorker *wk = &tw->workers[k];
+        pthread_mutex_destroy(&wk->deque.lock);
+        free(wk->deque.dirs);
+        free(wk->found);
+        if (wk->arena)
+            arena_destroy(wk->arena);
+    }
+}
+
+static void walk(GlobWalk *w, size_t len, char **comps, int n, int i);
+
+/* Component i is `**`: zero or more directories below w->path[0..len) */
+static void walk_globstar(GlobWalk *w, size_t len, char **comps, int n, int i)
+{
+    /* `** / **` means no more than `**` */
+    while (i + 1 < n && strcmp(comps[i + 1], "**") == 0)
+        i++;
+
+    TreeWalk *tw = calloc(1, sizeof(TreeWalk));
+    if (!tw) {
+        w->failed = true;
+        return;
+    }
+    tw->mode      = i == n - 1 ? TREE_ALL : i == n - 2 ? TREE_MATCH : TREE_DIRS;
+    tw->tail      = tw->mode == TREE_MATCH ? comps[n - 1] : NULL;
+    tw->dirs_only = w->dirs_only && tw->mode != TREE_DIRS;
+
+    /* The base itself is the "zero directories" case */
+    if (tw->mode == TREE_DIRS)
+        walk(w, len, comps, n, i + 1);
+
+    if (!tree_walk(tw, w->path))
+        w->failed = true;
+
+    for (int k = 0; k < tw->nworkers && !w->failed; k++) {
+        TreeWorker *wk = &tw->workers[k];
+        for (size_t j = 0; j < wk->nfound && !w->failed; j++) {
+            size_t plen = strlen(wk->found[j]);
+            memcpy(w->path, wk->found[j], plen + 1);
+            if (tw->mode == TREE_DIRS)
+                walk(w, plen, comps, n, i + 1);
+            else
+                walk_add(w, plen);
+        }
+    }
+    w->path[len] = '\0';
+    tree_free(tw);
+    free(tw);
+}
+
+/*
+ * Match components comps[i..n-1] below w->path[0..len). Literal components
+ * are appended blind; the final path is checked once with lstat. Magic
+ * components match against the (cached) directory listing, and all but the
+ * last keep only entries that are directories.
+ */
+static void walk(GlobWalk *w, size_t len, char **comps, int n, int i)
+{
+    if (w->failed)
+        return;
+
+    if (i == n) {
+        struct stat st;
+        if (w->dirs_only ? stat(w->path, &st) == 0 && S_ISDIR(st.st_mode)
+                         : lstat(w->path, &st) == 0)
+            walk_add(w, len);
+        return;
+    }
+
+    const char *comp = comps[i];
+    bool        last = (i == n - 1);
+
+    if (strcmp(comp, "**") == 0) {
+        walk_globstar(w, len, comps, n, i);
+        return;
+    }
+
+    if (!wildcard_has_magic(comp)) {
+        char   lit[NAME_MAX + 1];
+        size_t clen = strlen(comp);
+        if (clen > NAME_MAX)
+            return;
+        size_t nlen   = unescape(lit, comp, clen);
+        size_t newlen = walk_join(w, len, lit, nlen);
+        if (newlen)
+            walk(w, newlen, comps, n, i + 1);
+        w->path[len] = '\0';
+        return;
+    }
+
+    const DirListing *dl = dir_listing(w->path);
+    if (!dl)
+        return;
+
+    /* Hidden entries only match a component that starts with a dot */
+    bool show_hidden = comp[0] == '.';
+
+    /* The listing may be evicted by the recursion; copy what we need */
+    size_t        count = dl->count;
+    DirEntryRef  *refs  = NULL;
+    char         *names = NULL;
+    bool          owned = !last;
+    if (owned) {
+        refs  = malloc(count * sizeof(DirEntryRef) + 1);
+        names = malloc(dl->names_len + 1);
+        if (!refs || !names) {
+            free(refs);
+            free(names);
+            w->failed = true;
+            return;
+        }
+        memcpy(refs, dl->entries, count * sizeof(DirEntryRef));
+        memcpy(names, dl->names, dl->names_len);
+    } else {
+        refs  = dl->entries;
+        names = dl->names;
+    }
+
+    for (size_t k = 0; k < count && !w->failed; k++) {
+        const char *name = names + refs[k].name;
+        if (name[0] == '.' && !show_hidden)
+            continue;
+        if (!wildcard_match(comp, name))
+            continue;
+
+        size_t newlen = walk_join(w, len, name, strlen(name));
+        if (!newlen)
+            continue;
+
+        if (last) {
+            if (!w->dirs_only || walk_is_dir(w, refs[k].type))
+                walk_add(w, newlen);
+        } else if (walk_is_dir(w, refs[k].type)) {
+            walk(w, newlen, comps, n, i + 1);
+        }
+        w->path[len] = '\0';
+    }
+
+    if (owned) {
+        free(refs);
+        free(names);
+    }
+}
+
 /* ---- Public API --------------------------------------------------------- */
 
 bool wildcard_has_magic(const char *pattern)
@@ -168,50 +820,69 @@ char **wildcard_expand(const char *pattern, Arena *arena, int *count)
         if (count) *count = 0;
         return NULL;
     }
+    *count = 0;
 
     /* If no glob characters, let the caller use the literal string */
-    if (!wildcard_has_magic(pattern)) {
-        *count = 0;
+    if (!wildcard_has_magic(pattern))
         return NULL;
-    }
 
-    /* Use POSIX glob(3) for the heavy lifting */
-    glob_t g;
-    int flags = GLOB_NOSORT | GLOB_TILDE | GLOB_MARK;
-    int ret = glob(pattern, flags, NULL, &g);
-
-    if (ret != 0 || g.gl_pathc == 0) {
-        globfree(&g);
-        *count = 0;
+    /* Split into components, dropping empty ones from repeated slashes */
+    char *copy = strdup(pattern);
+    int   max  = 1;
+    for (const char *p = pattern; *p; p++)
+        max += (*p == '/');
+    char **comps = malloc((size_t)max * sizeof(char *));
+    if (!copy || !comps) {
+        free(copy);
+        free(comps);
         return NULL;
     }
 
-    /* Strip trailing '/' added by GLOB_MARK for directories.  We added
-     * GLOB_MARK only so callers can tell dirs apart if they want to, but
-     * the traditional shell behaviour is to not append it unless the user
-     * typed it.  Actually, most shells strip it, so we do too. */
-    for (size_t i = 0; i < g.gl_pathc; i++) {
-        size_t len = strlen(g.gl_pathv[i]);
-        if (len > 1 && g.gl_pathv[i][len - 1] == '/')
-            g.gl_pathv[i][len - 1] = '\0';
+    int n = 0;
+    for (char *p = copy; *p; ) {
+        while (*p == '/')
+            *p++ = '\0';
+        if (!*p)
+            break;
+        comps[n++] = p;
+        while (*p && *p != '/')
+            p++;
     }
 
-    /* Sort results alphabetically (we used GLOB_NOSORT) */
-    qsort(g.gl_pathv, g.gl_pathc, sizeof(char *), cmp_strings);
+    GlobWalk w = {0};
+    w.arena     = arena;
+    w.dirs_only = pattern[strlen(pattern) - 1] == '/';
+
+    size_t len = 0;
+    if (pattern[0] == '/')
+        w.path[len++] = '/';
+    w.path[len] = '\0';
+
+    if (n > 0)
+        walk(&w, len, comps, n, 0);
+
+    free(comps);
+    free(copy);
 
-    /* Copy results into the arena */
-    int n = (int)g.gl_pathc;
-    char **results = arena_alloc(arena, (size_t)n * sizeof(char *));
-    if (!results) {
-        globfree(&g);
-        *count = 0;
+    if (w.failed || w.count == 0) {
+        free(w.results);
         return NULL;
     }
 
-    for (int i = 0; i < n; i++)
-        results[i] = arena_strdup(arena, g.gl_pathv[i]);
+    /* Sort results alphabetically, as glob(3) would */
+    qsort(w.results, (size_t)w.count, sizeof(char *), cmp_strings);
 
-    globfree(&g);
-    *count = n;
+    char **results = arena_alloc(arena, (size_t)w.count * sizeof(char *));
+    if (results) {
+        memcpy(results, w.results, (size_t)w.count * sizeof(char *));
+        *count = w.count;
+    }
+    free(w.results);
     return results;
 }
+
+void wildcard_cache_clear(void)
+{
+    for (int i = 0; i < WILDCARD_DIR_CACHE; i++)
+        listing_free(&dir_cache[i]);
+}
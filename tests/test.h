@@ -41,5 +41,16 @@ void test_arena(void);
 void test_safe_string(void);
 void test_lexer(void);
 void test_parser(void);
+void test_wildcard(void);
+void test_history(void);
+void test_exec_index(void);
+void test_expr(void);
+void test_output(void);
+void test_alias(void);
+void test_env(void);
+void test_stats(void);
+void test_fdcopy(void);
+void test_cwd(void);
+void test_dir_listing(void);
 
 #endif /* VSH_TEST_H */
@@ -0,0 +1,86 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * test_alias.c - Token-level alias expansion tests
+ * ============================================================================ */
+
+#include "alias.h"
+#include "arena.h"
+#include "lexer.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Lex line, expand aliases and join the resulting token values with spaces
+ * (newlines shown as ";") into buf */
+static const char *expand(AliasTable *table, Arena *arena, const char *line,
+                          char *buf, size_t size) {
+    arena_reset(arena);
+    Lexer lex;
+    lexer_init(&lex, line, arena);
+    TokenList *tl = alias_expand(table, lexer_tokenize(&lex), arena);
+
+    buf[0] = '\0';
+    for (int i = 0; tl && i < tl->count && tl->tokens[i].type != TOK_EOF; i++) {
+        const char *v = tl->tokens[i].type == TOK_NEWLINE
+                            ? ";" : tl->tokens[i].value;
+        if (i > 0)
+            strncat(buf, " ", size - strlen(buf) - 1);
+        strncat(buf, v ? v : "?", size - strlen(buf) - 1);
+    }
+    return buf;
+}
+
+void test_alias(void) {
+    printf("\n--- Alias Expansion ---\n");
+
+    AliasTable *table = alias_table_create();
+    Arena *arena = arena_create();
+    char buf[256];
+    const char *r;
+
+    /* No aliases: the lexed list is returned untouched */
+    arena_reset(arena);
+    Lexer lex;
+    lexer_init(&lex, "ll -a", arena);
+    TokenList *tl = lexer_tokenize(&lex);
+    TokenList *same = alias_expand(table, tl, arena);
+    ASSERT_TRUE(same == tl);
+
+    alias_set(table, "ll", "ls -l");
+    alias_set(table, "sudo", "sudo ");
+    alias_set(table, "ls", "ls --color");
+    alias_set(table, "two", "echo a; echo b");
+
+    /* Command position only, and never for quoted words */
+    r = expand(table, arena, "ll x | ll; echo ll", buf, sizeof(buf));
+    ASSERT_STR_EQ(r, "ls --color -l x | ls --color -l ; echo ll");
+    r = expand(table, arena, "'ll' \\ll \"ll\"", buf, sizeof(buf));
+    ASSERT_STR_EQ(r, "ll ll ll");
+
+    /* An alias is not re-expanded inside itself; chains do expand */
+    r = expand(table, arena, "ls /", buf, sizeof(buf));
+    ASSERT_STR_EQ(r, "ls --color /");
+
+    /* Trailing blank: the next word is a candidate too */
+    r = expand(table, arena, "sudo ll", buf, sizeof(buf));
+    ASSERT_STR_EQ(r, "sudo ls --color -l");
+
+    /* Operators inside a body work; redirection targets are not commands */
+    r = expand(table, arena, "two > ll", buf, sizeof(buf));
+    ASSERT_STR_EQ(r, "echo a ; echo b > ll");
+    r = expand(table, arena, "if ll; then two; fi", buf, sizeof(buf));
+    ASSERT_STR_EQ(r, "if ls --color -l ; then echo a ; echo b ; fi");
+
+    /* Redefining or removing an alias drops its lexed body */
+    alias_set(table, "ll", "ls -1");
+    r = expand(table, arena, "ll", buf, sizeof(buf));
+    ASSERT_STR_EQ(r, "ls --color -1");
+    ASSERT_TRUE(alias_remove(table, "ls"));
+    r = expand(table, arena, "ll", buf, sizeof(buf));
+    ASSERT_STR_EQ(r, "ls -1");
+
+    arena_destroy(arena);
+    alias_table_destroy(table);
+    printf("  Alias tests complete\n");
+}
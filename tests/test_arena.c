@@ -62,6 +62,66 @@ void test_arena(void) {
     void *p5 = arena_alloc(arena, 64);
     ASSERT_TRUE(p5 != NULL);
 
+    /* Test mark / rewind: scratch after the mark is released, nothing
+     * before it is touched, and repeated rounds do not grow the arena */
+    char *keep = arena_strdup(arena, "kept");
+    ArenaMark mark = arena_mark(arena);
+    size_t at_mark = arena_bytes_used(arena);
+    for (int round = 0; round < 100; round++) {
+        for (int i = 0; i < 50; i++)
+            arena_alloc(arena, 1000);
+        arena_rewind(arena, mark);
+    }
+    ASSERT_EQ(arena_bytes_used(arena), at_mark);
+    ASSERT_EQ(arena->total_pages, mark.total_pages);
+    ASSERT_STR_EQ(keep, "kept");
+
+    /* Nested marks rewind in LIFO order */
+    ArenaMark outer = arena_mark(arena);
+    arena_alloc(arena, 5000);
+    ArenaMark inner = arena_mark(arena);
+    arena_alloc(arena, 5000);
+    arena_rewind(arena, inner);
+    ASSERT_EQ(arena_bytes_used(arena), at_mark + 5000);
+    arena_rewind(arena, outer);
+    ASSERT_EQ(arena_bytes_used(arena), at_mark);
+
+    /* Pages released by a reset are reused instead of re-malloced */
+    arena_reset(arena);
+    for (int i = 0; i < 20; i++)
+        arena_alloc(arena, 3000);
+    ArenaStats before;
+    arena_stats(arena, &before);
+    ASSERT_TRUE(before.pages > 1);
+    ASSERT_TRUE(before.peak_bytes >= 20 * 3000);
+
+    arena_reset(arena);
+    for (int i = 0; i < 20; i++)
+        arena_alloc(arena, 3000);
+    ArenaStats after;
+    arena_stats(arena, &after);
+    ASSERT_EQ(after.page_mallocs, before.page_mallocs);
+    ASSERT_TRUE(after.pages_reused >= before.pages - 1);
+
+    /* Geometric growth keeps the chain short */
+    ASSERT_TRUE(after.pages < 20);
+
+    /* Growing the newest block happens in place */
+    arena_reset(arena);
+    char *blk = arena_alloc(arena, 16);
+    char *grown = arena_resize(arena, blk, 16, 64);
+    ASSERT_TRUE(grown == blk);
+
+    /* ArenaString builds a NUL-terminated string in one block */
+    ArenaString as;
+    astr_init(&as, arena, 4);
+    astr_append(&as, "hello");
+    astr_append_char(&as, ' ');
+    astr_append_n(&as, "world!!", 5);
+    char *joined = astr_finish(&as);
+    const char *js = joined;
+    ASSERT_STR_EQ(js, "hello world");
+
     /* Test destroy */
     arena_destroy(arena);
 
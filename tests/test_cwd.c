@@ -0,0 +1,55 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * test_cwd.c - Logical working directory tests
+ * ============================================================================ */
+
+#include "cwd.h"
+#include "test.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Resolve target against base into a static buffer ("" if it overflows) */
+static const char *resolved(const char *base, const char *target) {
+    static char buf[PATH_MAX];
+    if (!cwd_resolve(base, target, buf, sizeof(buf)))
+        buf[0] = '\0';
+    return buf;
+}
+
+void test_cwd(void) {
+    printf("\n--- Working Directory ---\n");
+
+    /* "." and ".." are applied to the text, never above the root */
+    ASSERT_STR_EQ(resolved("/a/link", ".."), "/a");
+    ASSERT_STR_EQ(resolved("/a/b", "./c//d/../e/"), "/a/b/c/e");
+    ASSERT_STR_EQ(resolved("/a", "../../.."), "/");
+    ASSERT_STR_EQ(resolved("/a", "/x/./y/.."), "/x");
+    ASSERT_STR_EQ(resolved("/", "tmp"), "/tmp");
+    char small[4];
+    bool fits = cwd_resolve("/", "toolong", small, sizeof(small));
+    ASSERT_TRUE(!fits);
+
+    /* A $PWD that is not canonical, or not ".", is replaced by getcwd */
+    char start[PATH_MAX];
+    ASSERT_TRUE(getcwd(start, sizeof(start)) != NULL);
+    ASSERT_TRUE(chdir("/tmp") == 0);
+    Cwd *cwd = cwd_create("/tmp/.");
+    ASSERT_STR_EQ(cwd_get(cwd), "/tmp");
+    cwd_destroy(cwd);
+    cwd = cwd_create("/");
+    ASSERT_STR_EQ(cwd_get(cwd), "/tmp");
+
+    /* A chdir() the shell did not make is noticed, and a mark comes back */
+    CwdMark mark;
+    ASSERT_TRUE(cwd_mark(cwd, &mark));
+    ASSERT_TRUE(chdir("/") == 0);
+    ASSERT_STR_EQ(cwd_get(cwd), "/");
+    ASSERT_EQ(cwd_return(cwd, &mark), 0);
+    ASSERT_STR_EQ(cwd_get(cwd), "/tmp");
+    cwd_destroy(cwd);
+
+    ASSERT_TRUE(chdir(start) == 0);
+}
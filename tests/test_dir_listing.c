@@ -0,0 +1,126 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * test_dir_listing.c - Tab completion directory cache tests
+ * ============================================================================ */
+
+#include "dir_listing.h"
+#include "test.h"
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static void touch(const char *dir, const char *name) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd >= 0) close(fd);
+}
+
+/* Match prefix in dir and join the names with spaces */
+static const char *match_joined(DirListing *dl, const char *dir,
+                                const char *prefix) {
+    static char buf[1024];
+    const char *const *names;
+    size_t count;
+    buf[0] = '\0';
+    if (dir_listing_match(dl, dir, prefix, strlen(prefix), &names, &count) !=
+        DIR_LISTING_OK)
+        return "(not ok)";
+    for (size_t i = 0; i < count; i++) {
+        if (buf[0]) strcat(buf, " ");
+        strcat(buf, names[i]);
+    }
+    return buf;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+                        struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+void test_dir_listing(void) {
+    printf("\n--- Directory listing ---\n");
+
+    char d[] = "/tmp/vsh_dl_XXXXXX";
+    ASSERT_TRUE(mkdtemp(d) != NULL);
+    touch(d, "beta");
+    touch(d, "alpha");
+    touch(d, "alps");
+    touch(d, ".hidden");
+    char sub[600], link[600];
+    snprintf(sub, sizeof(sub), "%s/sub", d);
+    snprintf(link, sizeof(link), "%s/lnk", d);
+    mkdir(sub, 0755);
+    ASSERT_TRUE(symlink("sub", link) == 0);
+
+    DirListing *dl = dir_listing_create();
+    ASSERT_TRUE(dl != NULL);
+
+    /* Sorted; directories (and links to them) marked; hidden on request */
+    ASSERT_STR_EQ(match_joined(dl, d, ""), "alpha alps beta lnk/ sub/");
+    ASSERT_STR_EQ(match_joined(dl, d, "."), ".hidden");
+
+    /* Narrowing as the word grows, and widening again when it shrinks */
+    ASSERT_STR_EQ(match_joined(dl, d, "al"), "alpha alps");
+    ASSERT_STR_EQ(match_joined(dl, d, "alp"), "alpha alps");
+    ASSERT_STR_EQ(match_joined(dl, d, "alph"), "alpha");
+    ASSERT_STR_EQ(match_joined(dl, d, "alx"), "");
+    ASSERT_STR_EQ(match_joined(dl, d, "b"), "beta");
+
+    /* A new entry moves the directory's mtime */
+    touch(d, "alpine");
+    ASSERT_STR_EQ(match_joined(dl, d, "alp"), "alpha alpine alps");
+
+    const char *const *names;
+    size_t count;
+    DirListingStatus st = dir_listing_match(dl, "/nonexistent/vsh", "", 0,
+                                            &names, &count);
+    ASSERT_EQ(st, DIR_LISTING_NONE);
+
+    /* A large directory is finished by the worker */
+    char big[600];
+    snprintf(big, sizeof(big), "%s/big", d);
+    mkdir(big, 0755);
+    int nbig = DIR_LISTING_SYNC_MAX + 100;
+    char name[32];
+    for (int i = 0; i < nbig; i++) {
+        snprintf(name, sizeof(name), "f%06d", i);
+        touch(big, name);
+    }
+    st = dir_listing_match(dl, big, "f", 1, &names, &count);
+    ASSERT_EQ(st, DIR_LISTING_BUSY);
+    int fd = dir_listing_fd(dl);
+    ASSERT_TRUE(fd >= 0);
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int ready = poll(&pfd, 1, 10000);
+    ASSERT_EQ(ready, 1);
+    bool collected = dir_listing_collect(dl);
+    ASSERT_TRUE(collected);
+    fd = dir_listing_fd(dl);
+    ASSERT_EQ(fd, -1);
+    st = dir_listing_match(dl, big, "f", 1, &names, &count);
+    ASSERT_EQ(st, DIR_LISTING_OK);
+    ASSERT_EQ(count, (size_t)nbig);
+    ASSERT_STR_EQ(names[0], "f000000");
+    ASSERT_STR_EQ(match_joined(dl, big, "f05009"), "f050090 f050091 f050092 "
+                  "f050093 f050094 f050095 f050096 f050097 f050098 f050099");
+
+    /* Listing elsewhere while the worker runs drops its listing */
+    touch(big, "extra");
+    st = dir_listing_match(dl, big, "", 0, &names, &count);
+    ASSERT_EQ(st, DIR_LISTING_BUSY);
+    ASSERT_STR_EQ(match_joined(dl, d, "b"), "beta big/");
+    fd = dir_listing_fd(dl);
+    ASSERT_EQ(fd, -1);
+
+    dir_listing_destroy(dl);
+    nftw(d, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+    printf("  Directory listing tests complete\n");
+}
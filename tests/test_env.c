@@ -0,0 +1,110 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * test_env.c - Variable table and scope frame tests
+ * ============================================================================ */
+
+#include "env.h"
+#include "arena.h"
+#include "shell.h"
+#include "test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void test_env(void) {
+    printf("\n--- Environment ---\n");
+
+    EnvTable *env = env_create();
+    ASSERT_TRUE(env != NULL);
+    if (!env) return;
+
+    /* Enough names to force several resizes, then holes from unset */
+    char key[32], val[32];
+    for (int i = 0; i < 2000; i++) {
+        snprintf(key, sizeof(key), "VSH_T%d", i);
+        snprintf(val, sizeof(val), "v%d", i);
+        env_set(env, key, val, false);
+    }
+    for (int i = 0; i < 2000; i += 3) {
+        snprintf(key, sizeof(key), "VSH_T%d", i);
+        env_unset(env, key);
+    }
+    int found = 0, missing = 0;
+    for (int i = 0; i < 2000; i++) {
+        snprintf(key, sizeof(key), "VSH_T%d", i);
+        snprintf(val, sizeof(val), "v%d", i);
+        const char *v = env_get(env, key);
+        if (i % 3 == 0) missing += v == NULL;
+        else found += v && strcmp(v, val) == 0;
+    }
+    ASSERT_EQ(found, 1333);
+    ASSERT_EQ(missing, 667);
+
+    /* Values move between the inline buffer and the heap */
+    const char *longval = "a value far too long for the inline buffer";
+    env_set(env, "VSH_V", "short", false);
+    env_set(env, "VSH_V", longval, false);
+    const char *v = env_get(env, "VSH_V");
+    ASSERT_STR_EQ(v, longval);
+    env_set(env, "VSH_V", "x", false);
+    v = env_get(env, "VSH_V");
+    ASSERT_STR_EQ(v, "x");
+
+    /* Scope frames restore the outer value, or its absence */
+    env_set(env, "VSH_OUTER", "outer", true);
+    env_push_scope(env);
+    env_local(env, "VSH_OUTER", "inner");
+    env_local(env, "VSH_OUTER", "again");
+    env_local(env, "VSH_NEW", "new");
+    v = env_get(env, "VSH_OUTER");
+    ASSERT_STR_EQ(v, "again");
+    env_pop_scope(env);
+    v = env_get(env, "VSH_OUTER");
+    ASSERT_STR_EQ(v, "outer");
+    ASSERT_TRUE(env_get(env, "VSH_NEW") == NULL);
+
+    bool exported = false;
+    char **envp = env_envp(env);
+    for (int i = 0; envp && envp[i]; i++)
+        exported |= strcmp(envp[i], "VSH_OUTER=outer") == 0;
+    ASSERT_TRUE(exported);
+
+    /* A snapshot frame undoes plain sets, unsets and exports too */
+    env_set(env, "VSH_KEEP", "kept", false);
+    env_push_snapshot(env);
+    env_set(env, "VSH_KEEP", "changed", false);
+    env_set(env, "VSH_KEEP", "twice", false);
+    env_unset(env, "VSH_OUTER");
+    env_export(env, "VSH_V");
+    env_set(env, "VSH_NEW", "new", true);
+    env_pop_scope(env);
+    v = env_get(env, "VSH_KEEP");
+    ASSERT_STR_EQ(v, "kept");
+    v = env_get(env, "VSH_OUTER");
+    ASSERT_STR_EQ(v, "outer");
+    ASSERT_TRUE(env_get(env, "VSH_NEW") == NULL);
+    exported = false;
+    envp = env_envp(env);
+    for (int i = 0; envp && envp[i]; i++)
+        exported |= strncmp(envp[i], "VSH_V=", 6) == 0;
+    ASSERT_TRUE(!exported);
+
+    /* Here-document bodies: a backslash escapes $, `, itself and newline */
+    Shell shell;
+    memset(&shell, 0, sizeof(shell));
+    shell.env = env;
+    Arena *arena = arena_create();
+    env_set(env, "VSH_HD", "val", false);
+    const char *hd = env_expand_heredoc(&shell, "$VSH_HD \\$VSH_HD \\\\$VSH_HD "
+                                        "\\` a\\b \\\"q\\\"\n", arena);
+    ASSERT_STR_EQ(hd, "val $VSH_HD \\val ` a\\b \\\"q\\\"\n");
+    hd = env_expand_heredoc(&shell, "jo\\\nined ${VSH_HD}\n", arena);
+    ASSERT_STR_EQ(hd, "joined val\n");
+    arena_destroy(arena);
+    env_unset(env, "VSH_HD");
+
+    env_unset(env, "VSH_KEEP");
+    env_unset(env, "VSH_OUTER");
+    env_destroy(env);
+}
@@ -0,0 +1,102 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * test_exec_index.c - PATH executable index tests
+ * ============================================================================ */
+
+#include "exec_index.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+static void make_file(const char *dir, const char *name, mode_t mode) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CREAT, mode);
+    if (fd >= 0) close(fd);
+    chmod(path, mode);
+}
+
+static void join_name(const char *name, void *ctx) {
+    char *buf = ctx;
+    if (buf[0]) strcat(buf, " ");
+    strcat(buf, name);
+}
+
+/* Complete prefix and join the results with spaces */
+static const char *complete_joined(ExecIndex *idx, const char *prefix) {
+    static char buf[1024];
+    buf[0] = '\0';
+    exec_index_complete(idx, prefix, strlen(prefix), join_name, buf);
+    return buf;
+}
+
+void test_exec_index(void) {
+    printf("\n--- Exec index ---\n");
+
+    char a[] = "/tmp/vsh_xa_XXXXXX";
+    char b[] = "/tmp/vsh_xb_XXXXXX";
+    ASSERT_TRUE(mkdtemp(a) != NULL);
+    ASSERT_TRUE(mkdtemp(b) != NULL);
+    make_file(a, "gamma", 0755);
+    make_file(a, "alpha", 0755);
+    make_file(a, "notes", 0644);
+    make_file(b, "alpha", 0755);
+    make_file(b, "beta", 0755);
+    make_file(b, ".hidden", 0755);
+
+    char list[128];
+    snprintf(list, sizeof(list), "%s:%s", a, b);
+
+    ExecIndex *idx = exec_index_create();
+    ASSERT_TRUE(idx != NULL);
+    exec_index_set_path(idx, list, 1);
+
+    /* Merged, sorted, unique; non-executables and dot-files left out */
+    ASSERT_STR_EQ(complete_joined(idx, ""), "alpha beta gamma");
+    ASSERT_STR_EQ(complete_joined(idx, "g"), "gamma");
+    ASSERT_STR_EQ(complete_joined(idx, "."), ".hidden");
+    ASSERT_STR_EQ(complete_joined(idx, "z"), "");
+
+    /* PATH order decides which alpha wins */
+    char expect_buf[256];
+    const char *expect = expect_buf;
+    char *found = exec_index_find(idx, "alpha");
+    snprintf(expect_buf, sizeof(expect_buf), "%s/alpha", a);
+    ASSERT_STR_EQ(found, expect);
+    free(found);
+
+    char *missing = exec_index_find(idx, "notes");
+    ASSERT_TRUE(missing == NULL);
+
+    /* A new file is picked up without invalidation */
+    make_file(b, "delta", 0755);
+    found = exec_index_find(idx, "delta");
+    snprintf(expect_buf, sizeof(expect_buf), "%s/delta", b);
+    ASSERT_STR_EQ(found, expect);
+    free(found);
+
+    /* Dropping a directory from the list drops its names */
+    exec_index_set_path(idx, b, 2);
+    ASSERT_STR_EQ(complete_joined(idx, ""), "alpha beta delta");
+
+    exec_index_destroy(idx);
+
+    const char *names[] = { "gamma", "alpha", "notes", NULL };
+    char path[512];
+    for (int i = 0; names[i]; i++) {
+        snprintf(path, sizeof(path), "%s/%s", a, names[i]);
+        unlink(path);
+    }
+    const char *bnames[] = { "alpha", "beta", ".hidden", "delta", NULL };
+    for (int i = 0; bnames[i]; i++) {
+        snprintf(path, sizeof(path), "%s/%s", b, bnames[i]);
+        unlink(path);
+    }
+    rmdir(a);
+    rmdir(b);
+
+    printf("  Exec index tests complete\n");
+}
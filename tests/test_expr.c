@@ -0,0 +1,95 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * test_expr.c - Compiled expression tests
+ * ============================================================================ */
+
+#include "expr.h"
+#include "test.h"
+
+#include <string.h>
+
+void test_expr(void) {
+    printf("\n--- Expressions ---\n");
+
+    ExprCache *cache = expr_cache_create();
+    ASSERT_TRUE(cache != NULL);
+
+    char err[128];
+    double r = 0;
+
+    /* Precedence, right-associative power, constant folding */
+    const ExprProgram *p = expr_compile(cache, "2 + 3 * 2 ** 3 ** 0", err,
+                                        sizeof(err));
+    ASSERT_TRUE(p != NULL);
+    ASSERT_EQ(expr_nvars(p), 0);
+    ASSERT_EQ(expr_eval(p, NULL, &r, err, sizeof(err)), 0);
+    ASSERT_TRUE(r == 8);
+
+    /* The same source comes back from the cache */
+    const ExprProgram *again = expr_compile(cache, "2 + 3 * 2 ** 3 ** 0", err,
+                                            sizeof(err));
+    ASSERT_TRUE(again == p);
+
+    /* Variables get slots in order of first use */
+    p = expr_compile(cache, "x*x + y - x", err, sizeof(err));
+    ASSERT_TRUE(p != NULL);
+    ASSERT_EQ(expr_nvars(p), 2);
+    const char *name = expr_var_name(p, 1);
+    ASSERT_STR_EQ(name, "y");
+    double vars[2] = { 3, 1 };
+    ASSERT_EQ(expr_eval(p, vars, &r, err, sizeof(err)), 0);
+    ASSERT_TRUE(r == 7);
+
+    /* Block evaluation agrees with scalar evaluation */
+    double xs[600], ys[600], out[600];
+    for (int i = 0; i < 600; i++) {
+        xs[i] = i;
+        ys[i] = 2;
+    }
+    const double *cols[2] = { xs, ys };
+    ASSERT_EQ(expr_eval_block(p, cols, 600, out, err, sizeof(err)), 0);
+    ASSERT_TRUE(out[0] == 2 && out[599] == 599.0 * 599 + 2 - 599);
+
+    /* Runtime errors */
+    p = expr_compile(cache, "1 / (x - 1)", err, sizeof(err));
+    ASSERT_TRUE(p != NULL);
+    ASSERT_EQ(expr_eval_block(p, cols, 600, out, err, sizeof(err)), -1);
+    const char *msg = err;
+    ASSERT_STR_EQ(msg, "division by zero");
+    ASSERT_TRUE(expr_compile(cache, "sqrt(-1)", err, sizeof(err)) != NULL);
+
+    /* Syntax errors */
+    ASSERT_TRUE(expr_compile(cache, "2 +", err, sizeof(err)) == NULL);
+    ASSERT_TRUE(expr_compile(cache, "nope(1)", err, sizeof(err)) == NULL);
+    ASSERT_STR_EQ(msg, "unknown function 'nope'");
+
+    /* Integer programs: C operators, assignments, short circuits */
+    long long n = 0, iv[3] = { 0, 5, 0 };    /* y, x, z */
+    unsigned int assigned = 0;
+    p = expr_compile_int(cache, "y = x++ * 2, z += y > 9 && 1 / 0, x << 1",
+                         err, sizeof(err));
+    ASSERT_TRUE(p != NULL);
+    ASSERT_EQ(expr_nvars(p), 3);
+    int rc = expr_eval_int(p, iv, &assigned, &n, err, sizeof(err));
+    ASSERT_EQ(rc, -1);
+    ASSERT_EQ(iv[0], 10LL);
+    ASSERT_EQ(iv[1], 6LL);
+    ASSERT_EQ(assigned, 3u);
+
+    p = expr_compile_int(cache, "(x ? 7 : 3) * 2 + (0 || 4) - ~0 + 2 ** 10",
+                         err, sizeof(err));
+    ASSERT_TRUE(p != NULL);
+    assigned = 0;
+    rc = expr_eval_int(p, iv, &assigned, &n, err, sizeof(err));
+    ASSERT_EQ(rc, 0);
+    ASSERT_EQ(n, 14LL + 1 + 1 + 1024);
+    ASSERT_EQ(assigned, 0u);
+
+    /* The same text is a separate program in each mode */
+    ASSERT_TRUE(expr_compile_int(cache, "7 / 2", err, sizeof(err)) !=
+                expr_compile(cache, "7 / 2", err, sizeof(err)));
+    ASSERT_TRUE(expr_compile_int(cache, "1.5", err, sizeof(err)) == NULL);
+    ASSERT_TRUE(expr_compile_int(cache, "2 = 3", err, sizeof(err)) == NULL);
+
+    expr_cache_destroy(cache);
+}
@@ -0,0 +1,119 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * test_fdcopy.c - Kernel copy (copy_file_range / splice / sendfile) tests
+ * ============================================================================ */
+
+#include "fdcopy.h"
+#include "test.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* A memfd holding n bytes of a repeating pattern, positioned at 0 */
+static int pattern_file(size_t n) {
+    int fd = memfd_create("vsh-fdcopy", MFD_CLOEXEC);
+    char *buf = malloc(n);
+    for (size_t i = 0; i < n; i++)
+        buf[i] = (char)('a' + i % 26);
+    if (write(fd, buf, n) != (ssize_t)n)
+        n = 0;
+    free(buf);
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+/* Does fd hold the pattern, n bytes long? */
+static bool holds_pattern(int fd, size_t n) {
+    if (lseek(fd, 0, SEEK_END) != (off_t)n)
+        return false;
+    char *buf = malloc(n + 1);
+    bool ok = pread(fd, buf, n + 1, 0) == (ssize_t)n;
+    for (size_t i = 0; ok && i < n; i++)
+        ok = buf[i] == (char)('a' + i % 26);
+    free(buf);
+    return ok;
+}
+
+/* Drain a pipe into a fresh memfd */
+static int drain(int rd) {
+    int fd = memfd_create("vsh-fdcopy-out", MFD_CLOEXEC);
+    char buf[4096];
+    ssize_t r;
+    while ((r = read(rd, buf, sizeof(buf))) > 0) {
+        if (write(fd, buf, (size_t)r) != r)
+            break;
+    }
+    return fd;
+}
+
+void test_fdcopy(void) {
+    printf("\n--- Kernel Copy ---\n");
+
+    /* File to file: copied from the current offset to the end */
+    size_t n = 3 * FDCOPY_BUFFER_SIZE + 17;
+    int in = pattern_file(n);
+    int out = memfd_create("vsh-fdcopy-out", MFD_CLOEXEC);
+    FdCopyMethod m = fd_copy_method(in, out);
+    ASSERT_EQ(m, FDCOPY_RANGE);
+    long long got = fd_copy(in, out);
+    ASSERT_EQ(got, (long long)n);
+    ASSERT_TRUE(holds_pattern(out, n));
+    got = fd_copy(in, out);
+    ASSERT_EQ(got, 0);
+    close(out);
+
+    /* File into a pipe small enough not to block, then out of it */
+    size_t small = 1000;
+    close(in);
+    in = pattern_file(small);
+    int p[2];
+    ASSERT_TRUE(pipe2(p, O_CLOEXEC) == 0);
+    m = fd_copy_method(in, p[1]);
+    ASSERT_EQ(m, FDCOPY_SPLICE);
+    got = fd_copy(in, p[1]);
+    ASSERT_EQ(got, (long long)small);
+    close(p[1]);
+    out = memfd_create("vsh-fdcopy-out", MFD_CLOEXEC);
+    got = fd_copy(p[0], out);
+    ASSERT_EQ(got, (long long)small);
+    ASSERT_TRUE(holds_pattern(out, small));
+    close(p[0]);
+    close(out);
+
+    /* tee from a file: every output gets it all, the input ends at EOF */
+    lseek(in, 0, SEEK_SET);
+    int outs[2] = { memfd_create("a", MFD_CLOEXEC), memfd_create("b", MFD_CLOEXEC) };
+    got = fd_tee(in, outs, 2);
+    ASSERT_EQ(got, (long long)small);
+    ASSERT_TRUE(holds_pattern(outs[0], small));
+    ASSERT_TRUE(holds_pattern(outs[1], small));
+    off_t pos = lseek(in, 0, SEEK_CUR);
+    ASSERT_EQ(pos, (off_t)small);
+    close(outs[0]);
+    close(outs[1]);
+
+    /* tee from a pipe into a pipe and a file, through tee(2) */
+    int q[2];
+    ASSERT_TRUE(pipe2(p, O_CLOEXEC) == 0 && pipe2(q, O_CLOEXEC) == 0);
+    lseek(in, 0, SEEK_SET);
+    got = fd_copy(in, p[1]);
+    ASSERT_EQ(got, (long long)small);
+    close(p[1]);
+    outs[0] = q[1];
+    outs[1] = memfd_create("b", MFD_CLOEXEC);
+    got = fd_tee(p[0], outs, 2);
+    ASSERT_EQ(got, (long long)small);
+    close(q[1]);
+    int copied = drain(q[0]);
+    ASSERT_TRUE(holds_pattern(copied, small));
+    ASSERT_TRUE(holds_pattern(outs[1], small));
+    close(copied);
+    close(outs[1]);
+    close(p[0]);
+    close(q[0]);
+    close(in);
+}
@@ -0,0 +1,207 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * test_history.c - History ring buffer tests
+ * ============================================================================ */
+
+#include "history.h"
+#include "history_search.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Read a whole (small) file into a static buffer */
+static const char *slurp(const char *path) {
+    static char buf[4096];
+    FILE *fp = fopen(path, "r");
+    size_t n = fp ? fread(buf, 1, sizeof(buf) - 1, fp) : 0;
+    if (fp) fclose(fp);
+    buf[n] = '\0';
+    return buf;
+}
+
+static void test_history_file(void) {
+    char path[] = "/tmp/vsh_hist_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+
+    /* Old one-line-per-command files still load, with time 0 */
+    const char *legacy = "ls -l\nmake\n";
+    ASSERT_EQ(write(fd, legacy, strlen(legacy)), (long)strlen(legacy));
+    close(fd);
+
+    History *a = history_create(4);
+    history_load(a, path);
+    ASSERT_EQ(history_count(a), 2);
+    ASSERT_STR_EQ(history_get(a, 1), "make");
+
+    /* New entries are appended as timestamped records immediately */
+    history_add(a, "echo one");
+    history_add(a, "printf 'a\nb'");
+    const char *disk = slurp(path);
+    ASSERT_TRUE(strstr(disk, ";echo one\n") != NULL);
+    ASSERT_TRUE(strstr(disk, ";printf 'a\\\nb'\n") != NULL);
+
+    /* A second session sees them, multi-line entries intact */
+    History *b = history_create(4);
+    history_load(b, path);
+    ASSERT_EQ(history_count(b), 4);
+    ASSERT_STR_EQ(history_get(b, 3), "printf 'a\nb'");
+
+    /* Both sessions append; compaction merges and trims to capacity */
+    history_add(b, "from b");
+    history_add(a, "from a");
+    ASSERT_EQ(history_compact(a), 0);
+
+    History *c = history_create(4);
+    history_load(c, path);
+    ASSERT_EQ(history_count(c), 4);
+    ASSERT_STR_EQ(history_get(c, 0), "echo one");
+    ASSERT_STR_EQ(history_get(c, 2), "from b");
+    ASSERT_STR_EQ(history_get(c, 3), "from a");
+
+    history_destroy(a);
+    history_destroy(b);
+    history_destroy(c);
+    unlink(path);
+
+    /* Backslashes before a newline or the end survive the round trip */
+    char path2[] = "/tmp/vsh_hist_XXXXXX";
+    fd = mkstemp(path2);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+    const char *lines[] = { "echo tail\\", "two\\\\", "cont\\\nnext",
+                            "mid\\dle", "after" };
+    History *w = history_create(8);
+    history_load(w, path2);
+    for (int i = 0; i < 5; i++)
+        history_add(w, lines[i]);
+    History *r = history_create(8);
+    history_load(r, path2);
+    ASSERT_EQ(history_count(r), 5);
+    for (int i = 0; i < 5; i++)
+        ASSERT_STR_EQ(history_get(r, i), lines[i]);
+    history_destroy(w);
+    history_destroy(r);
+    unlink(path2);
+}
+
+static void test_history_search(void) {
+    History *hist = history_create(8);
+    history_add(hist, "git status");
+    history_add(hist, "make test");
+    history_add(hist, "git commit -m wip");
+    history_add(hist, "ls");
+    history_add(hist, "git push");
+
+    HistorySearch s;
+    history_search_begin(&s, hist);
+
+    /* Short queries scan; newest match first */
+    const char *m = history_search_update(&s, "gi");
+    ASSERT_STR_EQ(m, "git push");
+    m = history_search_older(&s);
+    ASSERT_STR_EQ(m, "git commit -m wip");
+
+    /* Extending the query keeps the current match while it still fits */
+    m = history_search_update(&s, "git");
+    ASSERT_STR_EQ(m, "git commit -m wip");
+    m = history_search_update(&s, "git s");
+    ASSERT_STR_EQ(m, "git status");
+    m = history_search_older(&s);
+    ASSERT_TRUE(m == NULL);
+
+    /* A fresh query goes through the trigram index */
+    m = history_search_update(&s, "test");
+    ASSERT_STR_EQ(m, "make test");
+    m = history_search_update(&s, "nomatch");
+    ASSERT_TRUE(m == NULL);
+
+    /* Entries added later are indexed too, evicted ones disappear */
+    for (int i = 0; i < 8; i++) {
+        char line[32];
+        snprintf(line, sizeof(line), "echo round %d", i);
+        history_add(hist, line);
+    }
+    history_search_end(&s);
+    history_search_begin(&s, hist);
+    m = history_search_update(&s, "round 7");
+    ASSERT_STR_EQ(m, "echo round 7");
+    m = history_search_update(&s, "status");
+    ASSERT_TRUE(m == NULL);
+    history_search_end(&s);
+
+    history_destroy(hist);
+}
+
+void test_history(void) {
+    printf("\n--- History ---\n");
+
+    History *hist = history_create(3);
+    ASSERT_TRUE(hist != NULL);
+
+    /* Blank lines and repeats of the previous line are skipped */
+    history_add(hist, "one");
+    history_add(hist, "one");
+    history_add(hist, "   ");
+    history_add(hist, "two");
+    ASSERT_EQ(history_count(hist), 2);
+    ASSERT_STR_EQ(history_last(hist), "two");
+
+    /* Past capacity the oldest entry is evicted, positions stay 0-based */
+    history_add(hist, "three");
+    history_add(hist, "four");
+    history_add(hist, "five");
+    ASSERT_EQ(history_count(hist), 3);
+    ASSERT_STR_EQ(history_get(hist, 0), "three");
+    ASSERT_STR_EQ(history_get(hist, 2), "five");
+    ASSERT_TRUE(history_get(hist, 3) == NULL);
+
+    /* Global indices survive eviction */
+    ASSERT_TRUE(history_get_by_index(hist, 1) == NULL);
+    ASSERT_STR_EQ(history_get_by_index(hist, 3), "three");
+    ASSERT_STR_EQ(history_get_by_index(hist, 5), "five");
+    ASSERT_TRUE(history_get_by_index(hist, 6) == NULL);
+
+    /* Navigation walks the ring oldest <- newest (the ASSERT macros
+     * evaluate their arguments more than once, so capture results first) */
+    const char *nav = history_navigate_up(hist);
+    ASSERT_STR_EQ(nav, "five");
+    nav = history_navigate_up(hist);
+    ASSERT_STR_EQ(nav, "four");
+    nav = history_navigate_down(hist);
+    ASSERT_STR_EQ(nav, "five");
+    nav = history_navigate_down(hist);
+    ASSERT_TRUE(nav == NULL);
+
+    ASSERT_STR_EQ(history_search_prefix(hist, "th"), "three");
+    int pos = -1;
+    history_reset_nav(hist);
+    const char *found = history_search_substr(hist, "ou", &pos);
+    ASSERT_STR_EQ(found, "four");
+    ASSERT_EQ(pos, 1);
+
+    /* Many long lines cycle through chunks without losing text */
+    char line[1000];
+    memset(line, 'x', sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\0';
+    for (int i = 0; i < 500; i++) {
+        line[0] = (char)('a' + i % 26);
+        history_add(hist, line);
+    }
+    ASSERT_EQ(history_count(hist), 3);
+    ASSERT_EQ((int)strlen(history_last(hist)), 999);
+    ASSERT_EQ(history_last(hist)[0], 'a' + 499 % 26);
+
+    history_clear(hist);
+    ASSERT_EQ(history_count(hist), 0);
+    history_add(hist, "after");
+    ASSERT_STR_EQ(history_get(hist, 0), "after");
+
+    history_destroy(hist);
+
+    test_history_file();
+    test_history_search();
+
+    printf("  History tests complete\n");
+}
@@ -145,6 +145,115 @@ void test_lexer(void) {
     ASSERT_TOK_TYPE(tl, 2, TOK_REDIR_APPEND);
     ASSERT_TOK_VAL(tl, 3, TOK_WORD, "log.txt");
 
+    /* Here-document: body read after the line, delimiter consumed */
+    arena_reset(arena);
+    lexer_init(&lex, "cat <<EOF; echo x\nhello $X\nEOF\necho after", arena);
+    tl = lexer_tokenize(&lex);
+    ASSERT_TRUE(tl != NULL && !lex.error);
+    ASSERT_TOK_VAL(tl, 0, TOK_WORD, "cat");
+    ASSERT_TOK_TYPE(tl, 1, TOK_REDIR_HEREDOC);
+    if (tl->count > 1) {
+        const HereDoc *hd = tl->tokens[1].heredoc;
+        ASSERT_TRUE(hd != NULL);
+        if (hd) {
+            ASSERT_STR_EQ(hd->body, "hello $X\n");
+            ASSERT_TRUE(hd->expand);
+        }
+    }
+    ASSERT_TOK_TYPE(tl, 2, TOK_SEMI);
+    ASSERT_TOK_VAL(tl, 4, TOK_WORD, "x");
+    ASSERT_TOK_TYPE(tl, 5, TOK_NEWLINE);
+    ASSERT_TOK_VAL(tl, 6, TOK_WORD, "echo");
+    ASSERT_TOK_VAL(tl, 7, TOK_WORD, "after");
+
+    /* <<- strips tabs; a quoted delimiter turns expansion off */
+    arena_reset(arena);
+    lexer_init(&lex, "cat <<-'E'\n\t\tbody\n\tE\n", arena);
+    tl = lexer_tokenize(&lex);
+    ASSERT_TRUE(tl != NULL && !lex.error);
+    ASSERT_TOK_TYPE(tl, 1, TOK_REDIR_HEREDOC);
+    if (tl->count > 1 && tl->tokens[1].heredoc) {
+        ASSERT_STR_EQ(tl->tokens[1].heredoc->body, "body\n");
+        ASSERT_TRUE(!tl->tokens[1].heredoc->expand);
+    }
+
+    /* Missing delimiter line leaves the input incomplete */
+    arena_reset(arena);
+    lexer_init(&lex, "cat <<EOF\nbody\n", arena);
+    tl = lexer_tokenize(&lex);
+    ASSERT_TRUE(lex.error != NULL);
+    ASSERT_TRUE(lex.incomplete);
+
+    /* Here-string and fd duplication */
+    arena_reset(arena);
+    lexer_init(&lex, "tr a b <<< word 2>&1 >&-", arena);
+    tl = lexer_tokenize(&lex);
+    ASSERT_TRUE(tl != NULL && !lex.error);
+    ASSERT_TOK_TYPE(tl, 3, TOK_REDIR_HERESTR);
+    ASSERT_TOK_VAL(tl, 4, TOK_WORD, "word");
+    ASSERT_TOK_VAL(tl, 5, TOK_REDIR_DUP, ">&");
+    if (tl->count > 5)
+        ASSERT_EQ(tl->tokens[5].redir_fd, 2);
+    ASSERT_TOK_VAL(tl, 6, TOK_WORD, "1");
+    ASSERT_TOK_VAL(tl, 7, TOK_REDIR_DUP, ">&");
+    ASSERT_TOK_VAL(tl, 8, TOK_WORD, "-");
+
+    /* Substitutions stay whole, operators and quotes inside included */
+    arena_reset(arena);
+    lexer_init(&lex, "echo a$(ls | grep \")\")b \"${X:-y}\" `id -u`; x", arena);
+    tl = lexer_tokenize(&lex);
+    ASSERT_TRUE(tl != NULL && !lex.error);
+    ASSERT_TOK_VAL(tl, 1, TOK_WORD, "a$(ls | grep \")\")b");
+    ASSERT_TOK_VAL(tl, 2, TOK_WORD, "${X:-y}");
+    ASSERT_TOK_VAL(tl, 3, TOK_WORD, "`id -u`");
+    ASSERT_TOK_TYPE(tl, 4, TOK_SEMI);
+
+    arena_reset(arena);
+    lexer_init(&lex, "echo $(date", arena);
+    tl = lexer_tokenize(&lex);
+    ASSERT_TRUE(lex.error != NULL);
+    ASSERT_TRUE(lex.incomplete);
+
+    /* ((expr)) is one token; ((a) | (b)) is two subshells */
+    arena_reset(arena);
+    lexer_init(&lex, "((i += (2 > 1))) && ((a) | (b))", arena);
+    tl = lexer_tokenize(&lex);
+    ASSERT_TRUE(tl != NULL && !lex.error);
+    ASSERT_TOK_VAL(tl, 0, TOK_ARITH, "i += (2 > 1)");
+    ASSERT_TOK_TYPE(tl, 1, TOK_AND);
+    ASSERT_TOK_TYPE(tl, 2, TOK_LPAREN);
+    ASSERT_TOK_TYPE(tl, 3, TOK_LPAREN);
+
+    /* Word flags follow the quoting the token text no longer shows */
+    arena_reset(arena);
+    lexer_init(&lex, "ls -l '$x' \"$y\" ~/a \"~\" *.c '*' \\* $(id)", arena);
+    tl = lexer_tokenize(&lex);
+    ASSERT_TRUE(tl != NULL && tl->count == 11);
+    ASSERT_EQ(tl->tokens[0].word_flags, 0);
+    ASSERT_EQ(tl->tokens[1].word_flags, 0);
+    ASSERT_EQ(tl->tokens[2].word_flags, 0);
+    ASSERT_EQ(tl->tokens[3].word_flags, WORD_EXPAND);
+    ASSERT_EQ(tl->tokens[4].word_flags, WORD_TILDE);
+    ASSERT_EQ(tl->tokens[5].word_flags, 0);
+    ASSERT_EQ(tl->tokens[6].word_flags, WORD_GLOB);
+    ASSERT_EQ(tl->tokens[7].word_flags, 0);
+    ASSERT_EQ(tl->tokens[8].word_flags, 0);
+    ASSERT_EQ(tl->tokens[9].word_flags, WORD_EXPAND | WORD_GLOB);
+
+    /* Long plain runs end exactly at the first special byte, and
+     * positions stay right across multi-line quotes */
+    arena_reset(arena);
+    lexer_init(&lex, "abcdefghijklmnopqrstuvwxyz%=!0123456789*x "
+                     "'a\nb' \"c\nd\" z", arena);
+    tl = lexer_tokenize(&lex);
+    ASSERT_TRUE(tl != NULL && tl->count == 5);
+    ASSERT_TOK_VAL(tl, 0, TOK_WORD, "abcdefghijklmnopqrstuvwxyz%=!0123456789*x");
+    ASSERT_EQ(tl->tokens[0].word_flags, WORD_GLOB);
+    ASSERT_TOK_VAL(tl, 1, TOK_WORD, "a\nb");
+    ASSERT_TOK_VAL(tl, 2, TOK_WORD, "c\nd");
+    ASSERT_EQ(tl->tokens[3].line, 3);
+    ASSERT_EQ(tl->tokens[3].col, 4);
+
     arena_destroy(arena);
     printf("  Lexer tests complete\n");
 }
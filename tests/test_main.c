@@ -18,6 +18,17 @@ int main(void) {
     test_safe_string();
     test_lexer();
     test_parser();
+    test_wildcard();
+    test_history();
+    test_exec_index();
+    test_expr();
+    test_output();
+    test_alias();
+    test_env();
+    test_stats();
+    test_fdcopy();
+    test_cwd();
+    test_dir_listing();
 
     printf("\n=== Results: %d/%d passed", tests_passed, tests_run);
     if (tests_failed > 0) {
@@ -0,0 +1,93 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * test_output.c - Builtin output buffer tests
+ * ============================================================================ */
+
+#include "output.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Everything written to fd so far */
+static char *contents(int fd, size_t *len) {
+    off_t size = lseek(fd, 0, SEEK_END);
+    char *buf = malloc((size_t)size + 1);
+    ssize_t n = pread(fd, buf, (size_t)size, 0);
+    buf[n > 0 ? n : 0] = '\0';
+    *len = n > 0 ? (size_t)n : 0;
+    return buf;
+}
+
+static void empty(int fd) {
+    if (ftruncate(fd, 0) == 0)
+        lseek(fd, 0, SEEK_SET);
+}
+
+void test_output(void) {
+    printf("\n--- Output Buffer ---\n");
+
+    int fd = memfd_create("vsh-test", MFD_CLOEXEC);
+    ASSERT_TRUE(fd >= 0);
+    OutBuf *out = out_create(fd);
+    ASSERT_TRUE(out != NULL);
+
+    /* Small pieces stay buffered until the flush */
+    out_puts(out, "ab");
+    out_putc(out, 'c');
+    out_printf(out, "%d-%s\n", 42, "x");
+    out_repeat(out, "=", 3);
+    size_t len;
+    char *text = contents(fd, &len);
+    ASSERT_EQ(len, 0);
+    free(text);
+
+    int rc = out_flush(out);
+    ASSERT_EQ(rc, 0);
+    text = contents(fd, &len);
+    const char *got = text;
+    ASSERT_STR_EQ(got, "abc42-x\n===");
+    free(text);
+
+    /* A large payload goes out behind what is buffered, in order */
+    size_t big = OUT_BUF_SIZE + 123;
+    char *payload = malloc(big);
+    memset(payload, 'z', big);
+    empty(fd);
+    out_puts(out, "head");
+    out_write(out, payload, big);
+    out_putc(out, '!');
+    out_flush(out);
+    text = contents(fd, &len);
+    ASSERT_EQ(len, big + 5);
+    ASSERT_TRUE(memcmp(text, "headzzz", 7) == 0);
+    ASSERT_EQ(text[len - 1], '!');
+    free(text);
+
+    /* So does formatted text longer than the whole buffer */
+    payload[big - 1] = '\0';
+    empty(fd);
+    out_putc(out, '<');
+    out_printf(out, "%s>", payload);
+    out_flush(out);
+    text = contents(fd, &len);
+    ASSERT_EQ(len, big + 1);
+    ASSERT_EQ(text[0], '<');
+    ASSERT_EQ(text[len - 1], '>');
+    free(text);
+    free(payload);
+
+    /* A failed write is reported once, by the next flush */
+    out->fd = -1;
+    out_puts(out, "lost");
+    rc = out_flush(out);
+    ASSERT_EQ(rc, -1);
+    rc = out_flush(out);
+    ASSERT_EQ(rc, 0);
+
+    out->fd = fd;
+    out_destroy(out);
+    close(fd);
+}
@@ -6,8 +6,14 @@
 #include "parser.h"
 #include "lexer.h"
 #include "arena.h"
+#include "ast_cache.h"
+#include "vshc.h"
+#include "bytecode.h"
 #include "test.h"
 
+#include <stdlib.h>
+#include <unistd.h>
+
 /* Helper: parse a string and return the AST */
 static ASTNode *parse_str(const char *input, Arena *arena) {
     Lexer lex;
@@ -20,6 +26,20 @@ static ASTNode *parse_str(const char *input, Arena *arena) {
     return parser_parse(&parser);
 }
 
+/* Helper: parse a string as a script of top-level commands */
+static Script *parse_script_str(const char *input, Arena *arena, bool *had_error) {
+    Lexer lex;
+    lexer_init(&lex, input, arena);
+    TokenList *tl = lexer_tokenize(&lex);
+    if (!tl) return NULL;
+
+    Parser parser;
+    parser_init(&parser, tl, arena);
+    Script *script = parser_parse_script(&parser);
+    *had_error = parser.had_error;
+    return script;
+}
+
 void test_parser(void) {
     printf("\n--- Parser ---\n");
     Arena *arena = arena_create();
@@ -49,6 +69,26 @@ void test_parser(void) {
         ASSERT_STR_EQ(ast->pipeline.commands[1]->cmd.argv[0], "grep");
     }
 
+    /* time prefix: -j is an option, a later "time" is a word */
+    arena_reset(arena);
+    ast = parse_str("time -j sort data | uniq -c time", arena);
+    ASSERT_TRUE(ast != NULL);
+    if (ast) {
+        ASSERT_EQ((int)ast->type, (int)NODE_PIPELINE);
+        ASSERT_EQ((int)ast->pipeline.timed, (int)TIME_JSON);
+        ASSERT_EQ(ast->pipeline.count, 2);
+        ASSERT_STR_EQ(ast->pipeline.commands[0]->cmd.argv[0], "sort");
+        ASSERT_EQ(ast->pipeline.commands[1]->cmd.argc, 3);
+    }
+
+    arena_reset(arena);
+    ast = parse_str("time", arena);
+    ASSERT_TRUE(ast != NULL);
+    if (ast) {
+        ASSERT_EQ((int)ast->pipeline.timed, (int)TIME_TABLE);
+        ASSERT_EQ(ast->pipeline.count, 0);
+    }
+
     /* AND operator */
     arena_reset(arena);
     ast = parse_str("true && echo yes", arena);
@@ -106,6 +146,28 @@ void test_parser(void) {
         ASSERT_EQ((int)ast->cmd.redirs->type, (int)REDIR_INPUT);
     }
 
+    /* Redirections keep source order; here-docs carry their body */
+    arena_reset(arena);
+    ast = parse_str("cat <<EOF > out 2>&1\nline\nEOF\n", arena);
+    ASSERT_TRUE(ast != NULL);
+    if (ast && ast->type == NODE_COMMAND) {
+        Redirection *r = ast->cmd.redirs;
+        ASSERT_TRUE(r != NULL && r->type == REDIR_HEREDOC);
+        if (r && r->type == REDIR_HEREDOC) {
+            ASSERT_STR_EQ(r->target, "line\n");
+            ASSERT_TRUE(r->expand);
+            r = r->next;
+        }
+        ASSERT_TRUE(r != NULL && r->type == REDIR_OUTPUT);
+        if (r && r->type == REDIR_OUTPUT)
+            r = r->next;
+        ASSERT_TRUE(r != NULL && r->type == REDIR_DUP_OUT);
+        if (r && r->type == REDIR_DUP_OUT) {
+            ASSERT_EQ(r->fd, 2);
+            ASSERT_STR_EQ(r->target, "1");
+        }
+    }
+
     /* Empty input - should return NULL (no commands) */
     arena_reset(arena);
     ast = parse_str("", arena);
@@ -120,6 +182,151 @@ void test_parser(void) {
         ASSERT_EQ(ast->pipeline.count, 3);
     }
 
+    /* Keywords are plain words outside command position */
+    arena_reset(arena);
+    ast = parse_str("echo done if fi", arena);
+    ASSERT_TRUE(ast != NULL);
+    if (ast) {
+        ASSERT_EQ((int)ast->type, (int)NODE_COMMAND);
+        ASSERT_EQ(ast->cmd.argc, 4);
+        ASSERT_STR_EQ(ast->cmd.argv[1], "done");
+    }
+
+    /* Script: one AST per top-level command, constructs span lines */
+    arena_reset(arena);
+    bool err = false;
+    Script *script = parse_script_str(
+        "echo a; echo b\nif true\nthen\n  echo c\nfi\n\nls &\n", arena, &err);
+    ASSERT_TRUE(script != NULL);
+    ASSERT_TRUE(!err);
+    if (script) {
+        ASSERT_EQ(script->count, 3);
+        ASSERT_EQ((int)script->commands[0]->type, (int)NODE_SEQUENCE);
+        ASSERT_EQ((int)script->commands[1]->type, (int)NODE_IF);
+        ASSERT_EQ((int)script->commands[2]->type, (int)NODE_BACKGROUND);
+    }
+
+    /* Script: commands before a syntax error are kept */
+    arena_reset(arena);
+    script = parse_script_str("echo a\nfi\necho b\n", arena, &err);
+    ASSERT_TRUE(err);
+    ASSERT_TRUE(script != NULL && script->count == 1);
+
+    /* Deep copy survives the source arena */
+    arena_reset(arena);
+    ast = parse_str("f() { if true; then echo a > out; fi; }", arena);
+    ASSERT_TRUE(ast != NULL && ast->type == NODE_FUNCTION);
+    if (ast) {
+        Arena *copy_arena = arena_create();
+        ASTNode *copy = ast_clone(copy_arena, ast->func.body);
+        arena_reset(arena);
+        ASSERT_TRUE(copy != NULL);
+        if (copy) {
+            ASSERT_EQ((int)copy->type, (int)NODE_IF);
+            ASTNode *then = copy->if_node.then_body;
+            ASSERT_TRUE(then != NULL && then->type == NODE_COMMAND);
+            if (then && then->type == NODE_COMMAND) {
+                ASSERT_STR_EQ(then->cmd.argv[1], "a");
+                ASSERT_TRUE(then->cmd.redirs != NULL);
+                ASSERT_STR_EQ(then->cmd.redirs->target, "out");
+            }
+        }
+        arena_destroy(copy_arena);
+    }
+
+    /* AST cache: hits survive a parse-arena reset; aliases invalidate */
+    AstCache *cache = ast_cache_create();
+    arena_reset(arena);
+    const char *line = "echo cached | wc";
+    ast = parse_str(line, arena);
+    ast_cache_add_line(cache, line, strlen(line), 1, ast);
+    arena_reset(arena);
+    AstCacheEntry *hit = ast_cache_find(cache, AST_LINE, line, strlen(line), 1);
+    ASSERT_TRUE(hit != NULL && hit->ast->type == NODE_PIPELINE);
+    ast_cache_release(hit);
+    AstCacheEntry *other = ast_cache_find(cache, AST_SCRIPT, line,
+                                          strlen(line), 1);
+    ASSERT_TRUE(other == NULL);
+    AstCacheEntry *stale = ast_cache_find(cache, AST_LINE, line,
+                                          strlen(line), 2);
+    ASSERT_TRUE(stale == NULL);
+    stale = ast_cache_find(cache, AST_LINE, line, strlen(line), 1);
+    ASSERT_TRUE(stale == NULL);
+    ast_cache_destroy(cache);
+
+    /* Bytecode: a loop compiles to one flat run with resolved jumps */
+    arena_reset(arena);
+    ast = parse_str("for x in a b; do ! cmd && other; done", arena);
+    BcProgram *prog = ast ? bc_compile(arena, ast) : NULL;
+    ASSERT_TRUE(prog != NULL);
+    if (prog) {
+        ASSERT_EQ(prog->count, 9);
+        ASSERT_EQ(prog->nloops, 1);
+        ASSERT_EQ(prog->code[1].op, BC_FOR_NEXT);
+        ASSERT_EQ(prog->code[1].target, 8);
+        ASSERT_EQ(prog->code[3].op, BC_NOT);
+        ASSERT_EQ(prog->code[4].op, BC_JUMP_FAIL);
+        ASSERT_EQ(prog->code[4].target, 6);
+        ASSERT_EQ(prog->code[7].target, 1);
+        ASSERT_EQ(prog->code[8].op, BC_LOOP_EXIT);
+    }
+
+    /* Compiled images: round trip, then a changed source is ignored */
+    char dir[] = "/tmp/vsh_vshc_XXXXXX";
+    if (mkdtemp(dir)) {
+        char *saved = getenv("XDG_CACHE_HOME");
+        saved = saved ? strdup(saved) : NULL;
+        setenv("XDG_CACHE_HOME", dir, 1);
+
+        char path[64];
+        snprintf(path, sizeof(path), "%s/lib.sh", dir);
+        const char *text = "for w in a 'b c'; do echo $w > out; done\nf() { :; }\n";
+        FILE *fp = fopen(path, "w");
+        if (fp) {
+            fputs(text, fp);
+            fclose(fp);
+        }
+
+        struct stat st;
+        bool parse_error = false;
+        arena_reset(arena);
+        Script *lib = parse_script_str(text, arena, &parse_error);
+        bool stored = stat(path, &st) == 0 &&
+                      vshc_store(path, &st, lib, "bad token");
+        ASSERT_TRUE(stored);
+
+        VshcImage *img = vshc_load(path, &st);
+        ASSERT_TRUE(img != NULL);
+        if (img) {
+            const ASTNode *loop = img->script->commands[0];
+            ASSERT_EQ(img->script->count, 2);
+            ASSERT_EQ((int)loop->type, (int)NODE_FOR);
+            ASSERT_EQ(loop->for_node.nwords, 2);
+            const char *word = loop->for_node.words[1];
+            ASSERT_STR_EQ(word, "b c");
+            const ASTNode *body = loop->for_node.body;
+            ASSERT_TRUE(body->type == NODE_COMMAND && body->cmd.redirs &&
+                        strcmp(body->cmd.redirs->target, "out") == 0);
+            ASSERT_STR_EQ(img->error, "bad token");
+            vshc_unload(img);
+        }
+
+        st.st_size++;
+        VshcImage *stale_img = vshc_load(path, &st);
+        ASSERT_TRUE(stale_img == NULL);
+
+        char cmd[96];
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+        if (system(cmd) != 0)
+            printf("  (could not remove %s)\n", dir);
+        if (saved) {
+            setenv("XDG_CACHE_HOME", saved, 1);
+            free(saved);
+        } else {
+            unsetenv("XDG_CACHE_HOME");
+        }
+    }
+
     arena_destroy(arena);
     printf("  Parser tests complete\n");
 }
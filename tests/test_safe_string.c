@@ -4,8 +4,11 @@
  * ============================================================================ */
 
 #include "safe_string.h"
+#include "arena.h"
 #include "test.h"
 
+#include <stdbool.h>
+
 void test_safe_string(void) {
     printf("\n--- Safe String ---\n");
 
@@ -99,5 +102,38 @@ void test_safe_string(void) {
     /* NULL safety */
     sstr_free(NULL);
 
+    /* Inline: short text stays in the struct, longer moves to the heap */
+    SafeString small;
+    sstr_init(&small);
+    sstr_appendf(&small, "%s-%d", "inline", 42);
+    bool in_struct = small.data == small.inline_buf;
+    ASSERT_TRUE(in_struct);
+    for (int i = 0; i < SSTR_INLINE_CAP; i++)
+        sstr_append_char(&small, 'y');
+    in_struct = small.data == small.inline_buf;
+    ASSERT_TRUE(!in_struct);
+    ASSERT_TRUE(strncmp(sstr_cstr(&small), "inline-42yyy", 12) == 0);
+    sstr_release(&small);
+
+    /* Arena: grows in place at the top of the arena */
+    Arena *arena = arena_create();
+    SafeString grown;
+    ASSERT_TRUE(sstr_init_arena(&grown, arena, 8));
+    for (int i = 0; i < 500; i++)
+        sstr_append(&grown, "ab");
+    ASSERT_EQ(grown.len, (size_t)1000);
+    ASSERT_TRUE(sstr_data(&grown)[999] == 'b');
+    arena_destroy(arena);
+
+    /* Scratch strings come back cleared, buffer and all */
+    SafeString *scratch = sstr_scratch();
+    sstr_append(scratch, "reused");
+    sstr_scratch_done(scratch);
+    SafeString *again = sstr_scratch();
+    ASSERT_TRUE(again == scratch);
+    ASSERT_TRUE(sstr_empty(again));
+    sstr_scratch_done(again);
+    sstr_scratch_drain();
+
     printf("  SafeString tests complete\n");
 }
@@ -0,0 +1,51 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * test_stats.c - Phase histogram tests
+ * ============================================================================ */
+
+#include "stats.h"
+#include "test.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void test_stats(void) {
+    printf("\n--- Stats ---\n");
+
+    ShellStats *st = stats_create();
+    ASSERT_TRUE(st != NULL);
+    if (!st) return;
+
+    /* 90 fast samples and 10 slow ones */
+    for (int i = 0; i < 90; i++) stats_record(st, STAT_LEX, 1500);
+    for (int i = 0; i < 10; i++) stats_record(st, STAT_LEX, 3000000);
+    const StatHist *h = &st->phase[STAT_LEX];
+    ASSERT_EQ(h->count, 100);
+    ASSERT_EQ(h->max_ns, 3000000);
+    uint64_t p50 = stats_quantile(h, 0.50);
+    uint64_t p99 = stats_quantile(h, 0.99);
+    ASSERT_TRUE(p50 >= 1500 && p50 < 3000);     /* Within its log2 bucket */
+    ASSERT_EQ(p99, 3000000);                    /* Capped at the maximum */
+
+    /* Only the outermost line completes; nested lines add to it */
+    stats_line_begin(st);
+    stats_record(st, STAT_WAIT, 10);
+    stats_line_begin(st);
+    stats_record(st, STAT_WAIT, 5);
+    bool inner = stats_line_end(st);
+    bool outer = stats_line_end(st);
+    ASSERT_TRUE(!inner);
+    ASSERT_TRUE(outer);
+    ASSERT_EQ(st->line_ns[STAT_WAIT], 15);
+
+    char buf[32];
+    stats_format_ns(buf, sizeof(buf), 850);
+    ASSERT_TRUE(strcmp(buf, "850ns") == 0);
+    stats_format_ns(buf, sizeof(buf), 3100000);
+    ASSERT_TRUE(strcmp(buf, "3.1ms") == 0);
+
+    stats_reset(st);
+    ASSERT_EQ(st->phase[STAT_LEX].count, 0);
+
+    stats_destroy(st);
+}
@@ -0,0 +1,99 @@
+/* ============================================================================
+ * vsh - Vanguard Shell
+ * test_wildcard.c - Pattern matching and glob expansion tests
+ * ============================================================================ */
+
+#include "wildcard.h"
+#include "arena.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+static void touch(const char *dir, const char *name) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CREAT, 0644);
+    if (fd >= 0) close(fd);
+}
+
+static void make_dir(const char *dir, const char *name) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    mkdir(path, 0755);
+}
+
+/* Expand pattern (relative to dir) and join the results with spaces */
+static const char *expand_joined(Arena *arena, const char *dir,
+                                 const char *pattern) {
+    char full[512];
+    snprintf(full, sizeof(full), "%s/%s", dir, pattern);
+
+    int count = 0;
+    char **matches = wildcard_expand(full, arena, &count);
+
+    static char buf[2048];
+    size_t skip = strlen(dir) + 1;
+    buf[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        if (i > 0) strcat(buf, " ");
+        strcat(buf, matches[i] + skip);
+    }
+    return buf;
+}
+
+void test_wildcard(void) {
+    printf("\n--- Wildcard ---\n");
+
+    /* Pure matching */
+    ASSERT_TRUE(wildcard_match("*.c", "main.c"));
+    ASSERT_TRUE(wildcard_match("[a-c]?x", "bzx"));
+    ASSERT_TRUE(!wildcard_match("[!a-c]*", "apple"));
+    ASSERT_TRUE(wildcard_match("\\*", "*"));
+
+    char dir[] = "/tmp/vsh_glob_XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    make_dir(dir, "a");
+    make_dir(dir, "b");
+    touch(dir, "a/x.log");
+    touch(dir, "a/y.txt");
+    touch(dir, "b/z.log");
+    touch(dir, "top.log");
+    touch(dir, ".hidden");
+
+    Arena *arena = arena_create();
+
+    /* Components are matched level by level, results sorted */
+    ASSERT_STR_EQ(expand_joined(arena, dir, "*/*.log"), "a/x.log b/z.log");
+    ASSERT_STR_EQ(expand_joined(arena, dir, "*"), "a b top.log");
+    ASSERT_STR_EQ(expand_joined(arena, dir, ".*"), ".hidden");
+    ASSERT_STR_EQ(expand_joined(arena, dir, "*/"), "a/ b/");
+    ASSERT_STR_EQ(expand_joined(arena, dir, "?/y.txt"), "a/y.txt");
+    ASSERT_STR_EQ(expand_joined(arena, dir, "*/nope"), "");
+    ASSERT_STR_EQ(expand_joined(arena, dir, "top.log"), "");  /* no magic */
+
+    /* ** descends any depth, skipping hidden directories */
+    make_dir(dir, "a/deep");
+    touch(dir, "a/deep/v.log");
+    ASSERT_STR_EQ(expand_joined(arena, dir, "**/*.log"),
+                  "a/deep/v.log a/x.log b/z.log top.log");
+    ASSERT_STR_EQ(expand_joined(arena, dir, "**/"), "a/ a/deep/ b/");
+    ASSERT_STR_EQ(expand_joined(arena, dir, "a/**"),
+                  "a/deep a/deep/v.log a/x.log a/y.txt");
+    ASSERT_STR_EQ(expand_joined(arena, dir, "**/deep/*"), "a/deep/v.log");
+
+    /* A changed directory is re-read despite the listing cache */
+    touch(dir, "a/w.log");
+    ASSERT_STR_EQ(expand_joined(arena, dir, "a/*.log"), "a/w.log a/x.log");
+
+    arena_destroy(arena);
+    wildcard_cache_clear();
+
+    char cmd[600];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+    ASSERT_EQ(system(cmd), 0);
+
+    printf("  Wildcard tests complete\n");
+}